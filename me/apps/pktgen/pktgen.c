@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file        pktgen.c
+ * @brief       Rate controlled packet generator in a worker ME.
+ *
+ * All contexts of the ME generate packets for generator PKTGEN_GEN from the
+ * template pktgen_tmpl[PKTGEN_GEN] with pktio_gen() and send them to the
+ * destination in pktgen_cfg[PKTGEN_GEN].  Packets are paced by the ME
+ * timestamp counter: a context claims the next transmit slot, waits for it
+ * and then builds and sends its packet, so the contexts of the ME share the
+ * configured rate.  Each packet carries a sequence number starting at 0
+ * each time the generator is enabled.
+ *
+ * The configuration is read by the contexts every PKTGEN_POLL_TICKS
+ * timestamp ticks, so the rate, destination and enable can be changed
+ * while running (see user/tools/pktgen_ctl.c).  Changes to the template
+ * apply from the next packet.  A run only starts when 'enable' changes to
+ * a new non-zero value.  When a packet count is configured, the generator
+ * sets PKTGEN_DONE in 'enable' once it has been sent, which keeps the run
+ * identifier for the host to pick the next one and stops the run even if
+ * a read raced with the update.
+ *
+ * With PKTIO_CTM_CREDIT_CACHE, the context reading the configuration also
+ * polls the Packet Engine for CTM credits into the ME's cache, and returns
+ * the cached credits to the island while the generator is stopped.
+ */
+#include <nfp.h>
+#include <stdint.h>
+
+#include <nfp/me.h>
+#include <nfp/mem_atomic.h>
+#include <nfp/mem_bulk.h>
+
+#include <pktio/pktio.h>
+
+#ifndef PKTGEN_GEN
+#warning "No PKTGEN_GEN #defined: assuming 0"
+#define PKTGEN_GEN 0
+#endif
+
+#define PKTGEN_NUM_GENS     8
+
+#if (PKTGEN_GEN >= PKTGEN_NUM_GENS)
+#error "PKTGEN_GEN out of range"
+#endif
+
+/* Timestamp ticks between reads of the configuration */
+#ifndef PKTGEN_POLL_TICKS
+#define PKTGEN_POLL_TICKS   (1 << 12)
+#endif
+
+/*
+ * Slots in the past that may be caught up on after a stall, e.g. when CTM
+ * buffers ran out.  Beyond that the schedule restarts from the current time
+ * rather than sending a burst.
+ */
+#ifndef PKTGEN_MAX_BURST
+#define PKTGEN_MAX_BURST    16
+#endif
+
+/* Set in pktgen_cfg.enable by the generator at the end of a counted run */
+#define PKTGEN_DONE         0x80000000
+
+/**
+ * Generator configuration, written by the host.
+ */
+struct pktgen_cfg {
+    uint32_t enable;    /**< Run identifier: a new non-zero value starts
+                          *  a run, 0 or PKTGEN_DONE set stops it */
+    uint32_t dst;       /**< Destination, PKT_WIRE_PORT(nbi, port) */
+    uint32_t interval;  /**< Timestamp ticks between packets, 24.8 fixed
+                          *  point */
+    uint32_t count;     /**< Packets to send, 0 for no limit */
+};
+
+__export __emem struct pktgen_cfg pktgen_cfg[PKTGEN_NUM_GENS];
+__export __emem __align(128)
+    struct pktio_gen_tmpl pktgen_tmpl[PKTGEN_NUM_GENS];
+
+/* Per generator: packets sent, packets not built (no CTM buffer or invalid
+ * template), packets dropped by pktio_tx() (e.g. MAC port paused) */
+__export __emem uint64_t pktgen_stats[PKTGEN_NUM_GENS][3];
+
+/* State shared by the contexts of the ME */
+__shared __lmem uint64_t pktgen_next;       /* Next slot, 24.8 ticks */
+__shared __lmem uint64_t pktgen_poll_at;    /* Next configuration read */
+__shared __lmem uint32_t pktgen_interval;
+__shared __lmem uint32_t pktgen_dst;
+__shared __lmem uint32_t pktgen_seq;
+__shared __lmem uint32_t pktgen_run_id;
+__shared __lmem uint32_t pktgen_left;       /* Packets left, if counted */
+__shared __lmem uint32_t pktgen_counted;
+__shared __lmem uint32_t pktgen_run;
+__shared __lmem uint32_t pktgen_polling;
+
+
+static void
+pktgen_poll(uint64_t now)
+{
+    __xread struct pktgen_cfg cfg_xr;
+    struct pktgen_cfg cfg;
+
+    pktgen_polling = 1;
+    mem_read32(&cfg_xr, &pktgen_cfg[PKTGEN_GEN], sizeof(cfg_xr));
+    cfg = cfg_xr;
+
+    if (cfg.enable == 0 || (cfg.enable & PKTGEN_DONE) ||
+        cfg.interval == 0) {
+        pktgen_run = 0;
+        pktgen_run_id = 0;
+    } else {
+        if (cfg.enable != pktgen_run_id) {
+            /* Start a new run */
+            pktgen_next = now << 8;
+            pktgen_seq = 0;
+            pktgen_left = cfg.count;
+            pktgen_counted = (cfg.count != 0);
+            pktgen_run_id = cfg.enable;
+            pktgen_run = 1;
+        }
+        pktgen_interval = cfg.interval;
+        pktgen_dst = cfg.dst;
+    }
+
+    pktgen_poll_at = now + PKTGEN_POLL_TICKS;
+#ifdef PKTIO_CTM_CREDIT_CACHE
+    if (pktgen_run)
+        pktio_ctm_credit_poll();
+    else
+        pktio_ctm_credit_release();
+#endif
+    pktgen_polling = 0;
+}
+
+
+static void
+pktgen_done(uint32_t run_id)
+{
+    __xwrite uint32_t enable = run_id | PKTGEN_DONE;
+
+    mem_write32(&enable, &pktgen_cfg[PKTGEN_GEN].enable, sizeof(enable));
+}
+
+
+void main(void)
+{
+    uint64_t now;
+    uint64_t slot;
+    uint32_t seq;
+    uint32_t dst;
+
+    if (ctx() == 0) {
+        pktgen_run = 0;
+        pktgen_run_id = 0;
+        pktgen_polling = 0;
+        pktgen_poll_at = 0;
+        pktio_tx_init();
+    }
+
+    for (;;) {
+        now = me_tsc_read();
+        if (now >= pktgen_poll_at && !pktgen_polling)
+            pktgen_poll(now);
+
+        if (!pktgen_run) {
+            sleep(PKTGEN_POLL_TICKS * 16);
+            continue;
+        }
+
+        /* Claim the next slot, no context swap until the state is
+         * updated */
+        slot = pktgen_next;
+        if (slot + PKTGEN_MAX_BURST * pktgen_interval < (now << 8))
+            slot = now << 8;
+        pktgen_next = slot + pktgen_interval;
+        seq = pktgen_seq++;
+        dst = pktgen_dst;
+        if (pktgen_counted && --pktgen_left == 0) {
+            pktgen_run = 0;
+            pktgen_done(pktgen_run_id);
+        }
+
+        while ((me_tsc_read() << 8) < slot)
+            ctx_swap();
+
+        if (pktio_gen(&pktgen_tmpl[PKTGEN_GEN], seq) < 0) {
+            mem_incr64(&pktgen_stats[PKTGEN_GEN][1]);
+            continue;
+        }
+
+        pkt.p_dst = dst;
+        if (pktio_tx() != 0) {
+            mem_incr64(&pktgen_stats[PKTGEN_GEN][2]);
+            continue;
+        }
+        mem_incr64(&pktgen_stats[PKTGEN_GEN][0]);
+    }
+}
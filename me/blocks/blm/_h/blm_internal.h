@@ -60,12 +60,15 @@
 #define BLM_LM_BLQ_DMA_EVNT_PEND_CNT_OFFSET     2
 #define BLM_LM_BLQ_NULL_RECYCLE_OFFSET          3
 #define BLM_LM_BLQ_CACHE_RDWR_BUSY_OFFSET       4
+#define BLM_LM_BLQ_POOL_FREE_MIN_OFFSET         5
+#define BLM_LM_BLQ_POOL_FREE_MAX_OFFSET         6
+#define BLM_LM_BLQ_POOL_EVENT_OFFSET            7
 
 #define BLM_MAX_DMA_PENDING_EVNTS               5
 #define BLM_NBI_BLQ_CACHE_DEFICIT               47
 
 /* BLM Stats */
-#define BLQ_STATS_SIZE                    128
+#define BLQ_STATS_SIZE                    256
 
 .declare_resource BLQ_STATS_OFFSETS island BLQ_STATS_SIZE
 .alloc_resource BLM_STATS_CACHE_REFILLS               BLQ_STATS_OFFSETS           island 8 /* Offset-0  */
@@ -84,6 +87,17 @@
 .alloc_resource BLM_STATS_OFFSET_RFU2                 BLQ_STATS_OFFSETS           island 8 /* Offset-13 */
 .alloc_resource BLM_STATS_OFFSET_RFU3                 BLQ_STATS_OFFSETS           island 8 /* Offset-14 */
 .alloc_resource BLM_STATS_OFFSET_RFU4                 BLQ_STATS_OFFSETS           island 8 /* Offset-15 */
+/* Buffer accounting, see blm_pool_sample().  FREE, FREE_MIN and FREE_MAX are written together. */
+.alloc_resource BLM_STATS_POOL_TOTAL                  BLQ_STATS_OFFSETS           island 8 /* Offset-16 */
+.alloc_resource BLM_STATS_POOL_FREE                   BLQ_STATS_OFFSETS           island 8 /* Offset-17 */
+.alloc_resource BLM_STATS_POOL_FREE_MIN               BLQ_STATS_OFFSETS           island 8 /* Offset-18 */
+.alloc_resource BLM_STATS_POOL_FREE_MAX               BLQ_STATS_OFFSETS           island 8 /* Offset-19 */
+.alloc_resource BLM_STATS_POOL_LOW_EVNTS              BLQ_STATS_OFFSETS           island 8 /* Offset-20 */
+
+/* Low pool events, written to NFP_CLS_AUTOPUSH_USER_EVENT */
+#define BLM_CLS_USER_EVENT_ADDR         0x30400
+#define BLM_POOL_EVENT_TYPE             3       /* NFP_EVENT_TYPE_FIFO_BELOW_WM */
+#define BLM_POOL_EVENT_DISARMED_bit     31
 
 /* BLM CLS Autopush filters */
 .declare_resource BLM_AP_FILTERS island 8 cls_apfilters
@@ -35,9 +35,55 @@
  * an MU buffer and blm_buf_free() to release it.  The _bulk() variants
  * allow the user to allocate and free buffers in batches.  These APIs
  * do not maintain any local state in the client microengine and do
- * not require any explicit initialization.
+ * not require any explicit initialization, unless the magazine is
+ * enabled.
+ *
+ * When BLM_MAGAZINE_SIZE is #defined to a non-zero value, each ME keeps
+ * a magazine of up to that many buffer handles per BLQ in local memory.
+ * blm_buf_free() pushes the handle onto the magazine and
+ * blm_buf_alloc_cached() pops one off it, so that neither touches the
+ * EMU ring while the magazine is neither full nor empty.  An empty
+ * magazine is refilled with BLM_MAGAZINE_BATCH handles by one
+ * blm_buf_alloc_bulk() and a full one spills BLM_MAGAZINE_BATCH handles
+ * with one blm_buf_free_bulk(), so blm_buf_free() may then swap context,
+ * which it otherwise never does.  The other calls, whose handles are in
+ * transfer registers, always use the ring.  The ME must call
+ * blm_mag_init() once before any other context uses the magazine,
+ * which pktio_tx_init() does for pktio users, and may call
+ * blm_mag_drain() to return the handles it holds to the ring.
+ * Up to BLM_MAGAZINE_SIZE buffers per BLQ sit in each ME's magazine, so
+ * the BLQs must hold that many more buffers than the application needs.
+ * blm_mag_stats() counts the ring operations saved.
+ *
+ * When BLM_BUF_DEBUG is #defined, here and for the BLM MEs, the calls
+ * tag each buffer they hand out or take back, see "Buffer debugging" in
+ * blm_cfg.h.  blm_buf_free() counts a double free in blm_dbg_errs() if
+ * the buffer is already free.  Handles freed with the _bulk() calls or
+ * by microcode through blm_api.uc are not tagged, which hides a double
+ * free of them.  Allocations must be tagged, or a later blm_buf_free()
+ * finds the buffer still tagged free and reports a false double free:
+ * __blm_buf_alloc() and __blm_buf_alloc_bulk() with sig_done return
+ * before the handles arrive, so their caller must pass each handle it
+ * keeps to blm_buf_dbg_alloc(), and microcode must tag the buffers it
+ * allocates with nfp_blm_buf_dbg_alloc() of blm_api.uc.  Each tag costs
+ * an EMEM operation.
  */
 
+#ifndef BLM_MAGAZINE_SIZE
+    #define BLM_MAGAZINE_SIZE       0
+#endif
+
+#ifndef BLM_MAGAZINE_BATCH
+    #define BLM_MAGAZINE_BATCH      8
+#endif
+
+#if (BLM_MAGAZINE_SIZE != 0)
+    #if (BLM_MAGAZINE_BATCH < 1 || BLM_MAGAZINE_BATCH > 16 || \
+         BLM_MAGAZINE_BATCH > BLM_MAGAZINE_SIZE)
+        #error "BLM_MAGAZINE_BATCH must be 1 to 16 and fit the magazine"
+    #endif
+#endif
+
 /* Not supporting SPLIT_EMU configuration */
 #ifdef SPLIT_EMU_RINGS
     #error "SPLIT_EMU_RINGS configuration not supported."
@@ -56,7 +102,8 @@
 typedef unsigned int blm_buf_handle_t;
 
 /**
- * Convert a blm buffer handle to a 40 bit address
+ * Convert a blm buffer handle to a 40 bit address, for buffers of any
+ * size class
  */
 #define blm_buf_handle2ptr(_bh) (__mem40 void *) \
                                 ((unsigned long long)(_bh) << 11)
@@ -67,6 +114,28 @@ typedef unsigned int blm_buf_handle_t;
 #define blm_buf_ptr2handle(_bp) (blm_buf_handle_t) \
                                 ((unsigned long long)(_bp) >> 11)
 
+/**
+ * Size in bytes of the buffers of a BLQ (0-3), see "Buffer size classes"
+ * in blm_cfg.h.  A constant if the BLQ is.
+ */
+#define BLM_BLQ_BUF_SIZE(_blq)                                  \
+    ((_blq) == 0 ? NBI8_BLQ_EMU_0_PKTBUF_SIZE :                 \
+     (_blq) == 1 ? NBI8_BLQ_EMU_1_PKTBUF_SIZE :                 \
+     (_blq) == 2 ? NBI8_BLQ_EMU_2_PKTBUF_SIZE :                 \
+                   NBI8_BLQ_EMU_3_PKTBUF_SIZE)
+
+/**
+ * Select the BLQ with the smallest buffers that hold a given number of
+ * bytes, the lowest numbered one of equal sizes.  For buffers that the
+ * application allocates itself; the NBI DMA picks the BLQ of received
+ * packets.
+ *
+ * @param size  Bytes needed in the buffer, packet offset included
+ *
+ * @return The BLQ (0-3), or -1 if no buffers are large enough.
+ */
+__intrinsic int blm_buf_blq(unsigned int size);
+
 /**
  * Allocate a single buffer from a BLM EMU ring.
  *
@@ -101,7 +170,8 @@ __intrinsic int blm_buf_alloc_bulk(__xread blm_buf_handle_t *bufs,
                                    unsigned int count, unsigned int blq);
 
 /**
- * Free a single buffer back into a BLM EMU ring
+ * Free a single buffer back into a BLM EMU ring, or into the ME's
+ * magazine if it is enabled
  *
  * @param buf   The buffer handle to free
  * @param blq   The blq number to free into (0-3)
@@ -123,4 +193,80 @@ __intrinsic void __blm_buf_free_bulk(__xwrite blm_buf_handle_t *bufs,
 __intrinsic void blm_buf_free_bulk(__xwrite blm_buf_handle_t *bufs,
                                    unsigned int count, unsigned int blq);
 
+/**
+ * Buffer debugging errors, see blm_dbg_errs().
+ */
+struct blm_dbg_err {
+    unsigned int double_frees;  /* Frees of a buffer that was free */
+    unsigned int last_handle;   /* Handle of the last double free */
+    unsigned int last_blq;      /* BLQ it was freed into */
+    unsigned int last_tag;      /* Its tag, with the generation it was freed */
+};
+
+/**
+ * Tag a buffer as allocated in the current generation.  Only needed after
+ * __blm_buf_alloc() or __blm_buf_alloc_bulk() with sig_done, and only if
+ * BLM_BUF_DEBUG is #defined, otherwise a no-op.
+ *
+ * @param buf   [in] The buffer handle
+ */
+__intrinsic void blm_buf_dbg_alloc(blm_buf_handle_t buf);
+
+/**
+ * Read the buffer debugging errors.  All zero if BLM_BUF_DEBUG is not
+ * #defined.
+ *
+ * @param err   [out] The errors
+ */
+__intrinsic void blm_dbg_errs(struct blm_dbg_err *err);
+
+/**
+ * Magazine statistics of a BLQ in an ME, see blm_mag_stats().  The EMU
+ * ring operations saved are allocs + frees - (refills + spills +
+ * ring_allocs + ring_frees).
+ */
+struct blm_mag_stats {
+    unsigned int allocs;        /* blm_buf_alloc_cached() calls */
+    unsigned int frees;         /* blm_buf_free() calls */
+    unsigned int refills;       /* Bulk allocations of a batch */
+    unsigned int spills;        /* Bulk frees of a batch */
+    unsigned int ring_allocs;   /* Single allocations, the ring was low */
+    unsigned int ring_frees;    /* Single frees, the magazine was full */
+};
+
+/**
+ * Allocate a single buffer, from the ME's magazine if it is enabled.
+ *
+ * @param buf   [out] The buffer handle
+ * @param blq   [in] The blq number to allocate from (0-3)
+ *
+ * @return 0 on success, -1 on failure.
+ */
+__intrinsic int blm_buf_alloc_cached(blm_buf_handle_t *buf,
+                                     unsigned int blq);
+
+/**
+ * Empty the magazines of the ME.  Must be called by one context of the
+ * ME before any calls to blm_buf_alloc_cached() or blm_buf_free() if
+ * BLM_MAGAZINE_SIZE is non-zero.
+ */
+__intrinsic void blm_mag_init(void);
+
+/**
+ * Return the buffers in the ME's magazine of a BLQ to the EMU ring.
+ *
+ * @param blq   [in] The blq number (0-3)
+ */
+__intrinsic void blm_mag_drain(unsigned int blq);
+
+/**
+ * Read the magazine statistics of a BLQ in this ME.  All zero if the
+ * magazine is disabled.
+ *
+ * @param blq   [in] The blq number (0-3)
+ * @param stats [out] The statistics
+ */
+__intrinsic void blm_mag_stats(unsigned int blq,
+                               struct blm_mag_stats *stats);
+
 #endif /* __NFP_BLM_H__ */
@@ -32,6 +32,66 @@
  *
  */
 
+#ifdef BLM_BUF_DEBUG
+    /* Buffer tags, see "Buffer debugging" in blm_cfg.h.  Shared with both BLM instances and blm.h */
+    .alloc_mem _blm_dbg_tags    emem    global  BLM_DBG_TAGS_SIZE BLM_DBG_TAGS_SIZE
+#endif
+
+/*
+ * Tag the buffers of the first N handles in the transfer register array
+ * HANDLES popped (clr_imm) or freed (set_imm), see "Buffer debugging" in
+ * blm_cfg.h.  The freed tags are written before the handles are
+ * journalled, so that an allocation never finds a stale one.  N must be
+ * a constant.
+ */
+#macro blm_dbg_tag(CMD, HANDLES, N)
+#ifdef BLM_BUF_DEBUG
+.begin
+    .reg _hi
+    .reg _lo
+    .reg _mask
+    .reg _ind
+    .reg _off
+    .sig sig_tag
+
+    move(_hi, ((_blm_dbg_tags >>8) & 0xFF000000))
+    move(_lo, (_blm_dbg_tags & 0xFFFFFFFF))
+    move(_mask, BLM_DBG_KEY_MASK)
+    move(_ind, BLM_DBG_TAG_IND_REF)
+    #define_eval _TAG_I     0
+    #while (_TAG_I < N)
+        alu[_off, _mask, AND, HANDLES[_TAG_I]]
+        alu[_off, _lo, +, _off, <<2]
+        alu[--, --, b, _ind]
+        #if (streq('CMD', 'set_imm'))
+            mem[CMD, --, _hi, <<8, _off, 1], indirect_ref, sig_done[sig_tag]
+            ctx_arb[sig_tag]
+        #else
+            mem[CMD, --, _hi, <<8, _off, 1], indirect_ref
+        #endif
+        #define_eval _TAG_I     (_TAG_I + 1)
+    #endloop
+    #undef _TAG_I
+.end
+#endif
+#endm /* blm_dbg_tag */
+
+/*
+ * Tag the buffers of the first N handles of the transfer register array
+ * BUFS as allocated, once nfp_blm_buf_alloc() has signalled without an
+ * error.  Needed with
+ * BLM_BUF_DEBUG for every buffer that may later be freed with
+ * blm_buf_free() of blm.h, which otherwise finds the buffer tagged free
+ * and reports a double free.  A no-op without BLM_BUF_DEBUG.
+ *
+ *   Example usage:
+ *   nfp_blm_buf_alloc($x[0], BLM_SMALL_PKT, BLM_SMALL_PKT, 4, sig_buf, SIG_WAIT)
+ *   nfp_blm_buf_dbg_alloc($x, 4)
+ */
+#macro nfp_blm_buf_dbg_alloc(BUFS, N)
+    blm_dbg_tag(clr_imm, BUFS, N)
+#endm /* nfp_blm_buf_dbg_alloc */
+
 /*
  *   Example usage:
  *   NFP_BLM_BUF_POOL_BIND(BLM_NBI8_BLQ0_EMU_QID, BLM_SMALL_PKT,  BLM_NBI8_BLQ0_EMU_Q_LOCALITY, BLM_NBI8_BLQ0_EMU_Q_ISLAND)
@@ -147,6 +147,53 @@
 #define EMU_PKTBUF_ALIGNMENT 2048
 #endif
 
+/*
+ * Buffer size classes.
+ *
+ * Each BLQ (and its EMU ring) is one size class:  all of its buffers
+ * have the BLQ's PKTBUF_SIZE below.  The NBI DMA takes buffers for a
+ * packet from the primary, else the secondary, BLQ of the buffer pool
+ * that the picocode selected by packet size (see NBI_DMA_BPx_BLQ_TARGET
+ * in init_config.h), and reports the BLQ in the "bls" field of the
+ * packet metadata, which is then the class to free the buffer into.
+ *
+ * The buffer descriptors of the NBI and the BLM buffer handles hold the
+ * MU address >> 11, so classes are multiples of 2048 bytes and
+ * blm_buf_handle2ptr() is the same shift for all of them.  The part of a
+ * packet past the SPLIT_LENGTH is written at its own offset in the MU
+ * buffer, so a buffer must hold the packet offset plus its length.
+ *
+ * Defining BLM_SIZE_CLASSES sizes the buffers of BLQs 2 and 3, the
+ * lists of the large packet buffer pools, to BLM_LARGE_PKTBUF_SIZE, so
+ * that jumbo frames fit one buffer without all buffers being that
+ * large.  BLQs 0 and 1 keep 2048 byte buffers.  Explicit PKTBUF_SIZE
+ * definitions take precedence.  user/tools/blm_class_model.c compares
+ * the memory efficiency of class configurations on packet size mixes.
+ *
+ * Size classes only help traffic with jumbo frames, which would otherwise
+ * need large buffers for every packet.  Small packets still take a 2048
+ * byte buffer each, as no class can be smaller.  On a mix without jumbo
+ * frames, such as imix, BLM_SIZE_CLASSES is no more efficient than the
+ * default 2048 byte BLQs: the model gives 17.7% for both.
+ */
+#ifdef BLM_SIZE_CLASSES
+    #ifndef BLM_LARGE_PKTBUF_SIZE
+        #define BLM_LARGE_PKTBUF_SIZE 10240
+    #endif
+    #ifndef NBI8_BLQ_EMU_2_PKTBUF_SIZE
+        #define NBI8_BLQ_EMU_2_PKTBUF_SIZE BLM_LARGE_PKTBUF_SIZE
+    #endif
+    #ifndef NBI8_BLQ_EMU_3_PKTBUF_SIZE
+        #define NBI8_BLQ_EMU_3_PKTBUF_SIZE BLM_LARGE_PKTBUF_SIZE
+    #endif
+    #ifndef NBI9_BLQ_EMU_2_PKTBUF_SIZE
+        #define NBI9_BLQ_EMU_2_PKTBUF_SIZE BLM_LARGE_PKTBUF_SIZE
+    #endif
+    #ifndef NBI9_BLQ_EMU_3_PKTBUF_SIZE
+        #define NBI9_BLQ_EMU_3_PKTBUF_SIZE BLM_LARGE_PKTBUF_SIZE
+    #endif
+#endif
+
 /* Define per "BLQ-EMU pair" packet buffer size - MUST be a mult of 2048 */
 #ifndef NBI8_BLQ_EMU_0_PKTBUF_SIZE
 #define NBI8_BLQ_EMU_0_PKTBUF_SIZE 2048
@@ -204,6 +251,83 @@
 #endif
 
 
+/*
+ * Buffer accounting.
+ *
+ * The ingress context of each BLQ samples the free buffers of the BLQ,
+ * those in the EMU ring plus those in the BLM cache, on every DMA event
+ * and every BLM_POOL_SAMPLE_ALARMS alarms.  The CTM_NBI_BLQx_STATS_BASE
+ * stats then hold the number of buffers configured for the BLQ, the last
+ * sample and the lowest and highest samples since the firmware was
+ * loaded.  The buffers not free are in use:  held by the application,
+ * in flight in the NBI or waiting in the BDSRAM of the DMA, which holds
+ * up to the BLQ length.  A pool that slowly leaks shows as a falling
+ * low watermark of the free buffers at an unchanged load.
+ *
+ * When BLM_POOL_LOW_THRESH is non-zero, the sample falling below it
+ * counts BLM_STATS_POOL_LOW_EVNTS and sends a user event (type
+ * NFP_EVENT_TYPE_FIFO_BELOW_WM) to the event bus through the CLS of the
+ * BLM island, with source BLM_POOL_EVENT_SOURCE | (BLM_INSTANCE_ID << 2)
+ * | BLQ.  The event is sent again only after the sample has risen to
+ * BLM_POOL_LOW_THRESH + BLM_POOL_LOW_HYST.  user/tools/blm_stat reads
+ * the stats.
+ */
+#ifndef BLM_POOL_SAMPLE_ALARMS
+    #define BLM_POOL_SAMPLE_ALARMS          256
+#endif
+
+#ifndef BLM_POOL_LOW_THRESH
+    #define BLM_POOL_LOW_THRESH             0
+#endif
+
+#ifndef BLM_POOL_LOW_HYST
+    #define BLM_POOL_LOW_HYST               64
+#endif
+
+#ifndef BLM_POOL_EVENT_SOURCE
+    #define BLM_POOL_EVENT_SOURCE           0xb10
+#endif
+
+#if ((BLM_POOL_SAMPLE_ALARMS & (BLM_POOL_SAMPLE_ALARMS - 1)) != 0 || \
+     BLM_POOL_SAMPLE_ALARMS < 1 || BLM_POOL_SAMPLE_ALARMS > 256)
+    #error "BLM_POOL_SAMPLE_ALARMS must be a power of 2 up to 256"
+#endif
+
+#if ((BLM_POOL_EVENT_SOURCE & 0x7) != 0 || BLM_POOL_EVENT_SOURCE > 0xfff)
+    #error "BLM_POOL_EVENT_SOURCE must be 12 bits with the low 3 clear"
+#endif
+
+/*
+ * Buffer debugging.
+ *
+ * Defining BLM_BUF_DEBUG, for the BLM MEs and the MEs using blm.h alike,
+ * keeps a tag word per buffer in _blm_dbg_tags, indexed by the low
+ * BLM_BUF_DEBUG_KEY_BITS bits of the handle.  Bit 0, BLM_DBG_TAG_FREE,
+ * is set while the buffer is in an EMU ring or a magazine, having been
+ * freed, and the other bits hold the generation in _blm_dbg_gen when the
+ * application last allocated or freed the buffer.  Freeing a buffer
+ * whose FREE bit is set counts a double free in _blm_dbg_err.  The host
+ * advances the generation, and buffers that have been out since an old
+ * generation are leak candidates.  See blm.h for the calls covered.
+ *
+ * The BLM returns the buffers of the TM to the EMU rings through the ME
+ * in this mode, to tag them.  The tags cost 4 bytes per 2K of handle
+ * space, 4MB for the default 20 bits, which cover 2GB of buffers:  all
+ * buffers must differ in those bits of their handles.
+ */
+#ifndef BLM_BUF_DEBUG_KEY_BITS
+    #define BLM_BUF_DEBUG_KEY_BITS          20
+#endif
+
+#define BLM_DBG_TAG_FREE                    1
+#define BLM_DBG_TAG_GEN_shf                 1
+#define BLM_DBG_KEY_MASK                    ((1 << BLM_BUF_DEBUG_KEY_BITS) - 1)
+#define BLM_DBG_TAGS_SIZE                   (4 << BLM_BUF_DEBUG_KEY_BITS)
+
+/* Indirect reference of a 32-bit set_imm/clr_imm of BLM_DBG_TAG_FREE */
+#define BLM_DBG_TAG_IND_REF                 ((BLM_DBG_TAG_FREE << 16) | (8 << 8) | (1 << 7) | (2 << 3))
+
+
 /*****************************************************************************
     BLQ and EMU Rings buffers configuration.
 
@@ -59,6 +59,16 @@
     .alloc_mem id        i0.ctm                 island  BLQ_STATS_SIZE 8
 #endloop
 
+#ifdef BLM_BUF_DEBUG
+    /* Buffer tags (_blm_dbg_tags) are allocated by blm_api.uc */
+    /* Generation, advanced by the host, and BLM_BUF_DEBUG_KEY_BITS */
+    .alloc_mem _blm_dbg_gen     emem    global  8 8
+    /* Double frees, last double freed handle, its BLQ and its previous tag */
+    .alloc_mem _blm_dbg_err     emem    global  16 8
+    .init _blm_dbg_gen+0    1
+    .init _blm_dbg_gen+4    BLM_BUF_DEBUG_KEY_BITS
+#endif
+
 #ifndef SINGLE_NBI
     #define BLM_NBI_MODE        BLM_DUAL_NBI_MODE
 
@@ -272,6 +282,10 @@
         immed[lmaddr[BLM_LM_BLQ_NULL_RECYCLE_OFFSET], (INGRESS_BLQ_NULL_RECYCLE | (EGRESS_BLQ_NULL_RECYCLE <<1))]
         #undef INGRESS_BLQ_NULL_RECYCLE
         #undef EGRESS_BLQ_NULL_RECYCLE
+        /* Free buffer watermarks and the low pool event, see blm_pool_sample() */
+        move(lmaddr[BLM_LM_BLQ_POOL_FREE_MIN_OFFSET], 0x7fffffff)
+        immed[lmaddr[BLM_LM_BLQ_POOL_FREE_MAX_OFFSET], 0]
+        move(lmaddr[BLM_LM_BLQ_POOL_EVENT_OFFSET], (((BLM_POOL_EVENT_SOURCE | (BLM_INSTANCE_ID << 2) | blq) << 4) | BLM_POOL_EVENT_TYPE))
 #endm /* blm_init_lm */
 
 /*
@@ -291,7 +305,25 @@
  * Macro to pull buffers from Egress(TM) side to EMU ring
  */
 #macro blm_egress_pull_buffers_to_emu_ring(NbiNum, blq, addr, ringid)
-    #if (__REVISION_MIN < __REVISION_B0)
+    #ifdef BLM_BUF_DEBUG
+        /* Through the ME, to tag the buffers free before they are on the ring */
+        #define_eval _MAX_PULL_DATA_LEN     16
+        .sig sig_pull_buf2emu
+        #define_eval _MAX_ITER     (NBI_BLQ_EVENT_THRESHOLD /_MAX_PULL_DATA_LEN)
+        #define_eval _LOOP_ITER    0
+        #while _LOOP_ITER < _MAX_ITER
+            blm_poptome(NbiNum, blq, $nbitmbuf[0], (_MAX_PULL_DATA_LEN >>1), sig_pull_buf2emu, SIG_WAIT)
+            blm_dbg_tag(set_imm, $nbitmbuf, _MAX_PULL_DATA_LEN)
+            aggregate_copy($nbitmbuf, $nbitmbuf, 16)
+            alu[--, --, b, ((0xf <<1)|1), <<7]
+            mem[journal, $nbitmbuf[0], addr, <<8, ringid, max_15], indirect_ref, sig_done[sig_pull_buf2emu]
+            ctx_arb[sig_pull_buf2emu]
+            #define_eval _LOOP_ITER     (_LOOP_ITER + 1)
+        #endloop
+        #undef _LOOP_ITER
+        #undef _MAX_PULL_DATA_LEN
+        #undef _MAX_ITER
+    #elif (__REVISION_MIN < __REVISION_B0)
         #ifndef TH_12713
             #define TH_12713    NBI_READ
         #endif
@@ -544,6 +576,95 @@
     alu[BLM_BLQ_LM_REF[BLM_LM_BLQ_CACHE_ENTRY_CNT_OFFSET], BLM_BLQ_LM_REF[BLM_LM_BLQ_CACHE_ENTRY_CNT_OFFSET], +, n]
 #endm /* blm_incr_cache_cnt */
 
+/*
+ * Sample the free buffers of the BLQ, those in the EMU ring plus those in
+ * the cache.  Keep the lowest and highest samples in LM, write the three
+ * to the stats and send the low pool event, see "Buffer accounting" in
+ * blm_cfg.h.  Uses $nbidmabuf, so not while a cache fill holds it.
+ */
+#macro blm_pool_sample()
+.begin
+    .reg free
+    .reg _addr
+    .sig sig_pool
+
+    mem[push_qdesc, $nbidmabuf[0], addr, <<8, ringid], sig_done[sig_pool]
+    ctx_arb[sig_pool]
+    /* The entry count is the low 24 bits of the third descriptor word */
+    ld_field_w_clr[free, 0111, $nbidmabuf[2]]
+    blm_cache_acquire_lock()
+    alu[free, free, +, BLM_BLQ_LM_REF[BLM_LM_BLQ_CACHE_ENTRY_CNT_OFFSET]]
+    blm_cache_release_lock()
+
+    .if (free < BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_FREE_MIN_OFFSET])
+        alu[BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_FREE_MIN_OFFSET], --, b, free]
+    .endif
+    .if (free > BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_FREE_MAX_OFFSET])
+        alu[BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_FREE_MAX_OFFSET], --, b, free]
+    .endif
+
+    /* BLM_STATS_POOL_FREE, _FREE_MIN and _FREE_MAX, low words first */
+    alu[$nbidmabuf[0], --, b, free]
+    immed[$nbidmabuf[1], 0]
+    alu[$nbidmabuf[2], --, b, BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_FREE_MIN_OFFSET]]
+    immed[$nbidmabuf[3], 0]
+    alu[$nbidmabuf[4], --, b, BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_FREE_MAX_OFFSET]]
+    immed[$nbidmabuf[5], 0]
+    alu[_addr, blq_stats_base, +, BLM_STATS_POOL_FREE]
+    mem[write, $nbidmabuf[0], 0, <<8, _addr, 3], sig_done[sig_pool]
+    ctx_arb[sig_pool]
+
+    #if (BLM_POOL_LOW_THRESH > 0)
+    .begin
+        .reg thresh
+
+        move(thresh, BLM_POOL_LOW_THRESH)
+        .if (free < thresh)
+            /* Once until the pool has recovered */
+            br_bset[BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_EVENT_OFFSET], BLM_POOL_EVENT_DISARMED_bit, pool_event_done#]
+            alu[$nbidmabuf[0], --, b, BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_EVENT_OFFSET]]
+            alu[BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_EVENT_OFFSET], BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_EVENT_OFFSET], OR, 1, <<BLM_POOL_EVENT_DISARMED_bit]
+            move(_addr, BLM_CLS_USER_EVENT_ADDR)
+            cls[write, $nbidmabuf[0], _addr, 0, 1], sig_done[sig_pool]
+            ctx_arb[sig_pool]
+            blm_stats(BLM_STATS_POOL_LOW_EVNTS)
+        .else
+            move(thresh, (BLM_POOL_LOW_THRESH + BLM_POOL_LOW_HYST))
+            .if (free >= thresh)
+                alu[BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_EVENT_OFFSET], BLM_BLQ_LM_REF[BLM_LM_BLQ_POOL_EVENT_OFFSET], AND~, 1, <<BLM_POOL_EVENT_DISARMED_bit]
+            .endif
+        .endif
+pool_event_done#:
+    .end
+    #endif
+.end
+#endm /* blm_pool_sample */
+
+/*
+ * Write the number of buffers configured for the BLQ, of both the EMU
+ * ring and the BDSRAM, to BLM_STATS_POOL_TOTAL
+ */
+#macro blm_init_pool_total(blq)
+.begin
+    .reg _addr
+    .reg $total[2]
+    .xfer_order $total
+    .sig total_sig
+
+    #define_eval _POOL_TOTAL    0
+    #for _mem_type [EMU_IMEM0,EMU_IMEM1,EMU_EMEM0,EMU_EMEM1,EMU_EMEM2,EMU_EMEM0_CACHE,EMU_EMEM1_CACHE,EMU_EMEM2_CACHE,BDSRAM_IMEM0,BDSRAM_IMEM1,BDSRAM_EMEM0,BDSRAM_EMEM1,BDSRAM_EMEM2,BDSRAM_EMEM0_CACHE,BDSRAM_EMEM1_CACHE,BDSRAM_EMEM2_CACHE]
+        #define_eval _POOL_TOTAL    (_POOL_TOTAL + BLM_NBI/**/NBII/**/_BLQ/**/blq/**/_/**/_mem_type/**/_NUM_BUFS)
+    #endloop
+    move($total[0], _POOL_TOTAL)
+    immed[$total[1], 0]
+    alu[_addr, blq_stats_base, +, BLM_STATS_POOL_TOTAL]
+    mem[write, $total[0], 0, <<8, _addr, 1], sig_done[total_sig]
+    ctx_arb[total_sig]
+    #undef _POOL_TOTAL
+    #undef _mem_type
+.end
+#endm /* blm_init_pool_total */
+
 /*
  *
  */
@@ -563,6 +684,7 @@
     D(MAILBOX3, 0x3334)
 
     aggregate_copy($nbidmabuf, $nbidmabuf, 16)
+    blm_dbg_tag(clr_imm, $nbidmabuf, 16)
     blm_cache_acquire_lock()
     alu[cache_offset, --, b, BLM_BLQ_LM_REF[BLM_LM_BLQ_CACHE_ENTRY_CNT_OFFSET], <<2]
     alu[cache_offset, cache_offset, +, BLM_BLQ_LM_REF[BLM_LM_BLQ_CACHE_ADDR_OFFSET]]
@@ -600,10 +722,14 @@ end_cache_fill#:
     nop
     nop
     nop
-    alu[temp, blq_stats_base, +, 64]
-    mem[write, $x[0], addrhi, <<8, temp, 8], sig_done[ctm_sig]
-    wait1#:
-    br_!signal[ctm_sig, wait1#]
+    #define_eval _STATS_OFF     64
+    #while (_STATS_OFF < BLQ_STATS_SIZE)
+        alu[temp, blq_stats_base, +, _STATS_OFF]
+        mem[write, $x[0], addrhi, <<8, temp, 8], sig_done[ctm_sig]
+        ctx_arb[ctm_sig]
+        #define_eval _STATS_OFF     (_STATS_OFF + 64)
+    #endloop
+    #undef _STATS_OFF
 .end
 #endif
 #endm /* blm_init_stats */
@@ -1210,6 +1336,7 @@ ctx0#:
     move(cache_size, BLM_NBI_BLQ0_CACHE_SIZE)
     #undef _NBIX
     blm_init_stats()
+    blm_init_pool_total(0)
     blm_init_filter_match(cls_ap_filter_match, CTX0_FILTER_MATCH)
     blm_init_filter_number(cls_ap_filter_number, BLM_BLQ0_AP_FILTER_NUM)
     /* Clear Mailbox */
@@ -1243,6 +1370,7 @@ ctx2#:
     move(cache_size, BLM_NBI_BLQ1_CACHE_SIZE)
     #undef _NBIX
     blm_init_stats()
+    blm_init_pool_total(1)
     blm_init_filter_match(cls_ap_filter_match, CTX2_FILTER_MATCH)
     blm_init_filter_number(cls_ap_filter_number, BLM_BLQ2_AP_FILTER_NUM)
     /* Setup per BLQ LM index */
@@ -1272,6 +1400,7 @@ ctx4#:
     move(cache_size, BLM_NBI_BLQ2_CACHE_SIZE)
     #undef _NBIX
     blm_init_stats()
+    blm_init_pool_total(2)
     blm_init_filter_match(cls_ap_filter_match, CTX4_FILTER_MATCH)
     blm_init_filter_number(cls_ap_filter_number, BLM_BLQ4_AP_FILTER_NUM)
     /* Setup per BLQ LM index */
@@ -1301,6 +1430,7 @@ ctx6#:
     move(cache_size, BLM_NBI_BLQ3_CACHE_SIZE)
     #undef _NBIX
     blm_init_stats()
+    blm_init_pool_total(3)
     blm_init_filter_match(cls_ap_filter_match, CTX6_FILTER_MATCH)
     blm_init_filter_number(cls_ap_filter_number, BLM_BLQ6_AP_FILTER_NUM)
     /* Setup per BLQ LM index */
@@ -1619,6 +1749,14 @@ service_check#:
                 blm_cache_release_lock()
             .endw
             cache_fill_complete#:
+
+            /* Sample the pool on each DMA event and every BLM_POOL_SAMPLE_ALARMS alarms */
+            .if (is_aps == 0)
+                alu[--, alarm_cnt, AND, (BLM_POOL_SAMPLE_ALARMS - 1)]
+                bne[pool_sample_skip#]
+            .endif
+            blm_pool_sample()
+            pool_sample_skip#:
         .endif
         D(MAILBOX1, 0xaaaa0000)
 
@@ -18,11 +18,89 @@
  */
 
 #include <assert.h>
+#include <nfp/mem_atomic.h>
 #include <nfp/mem_ring.h>
 #include <nfp6000/nfp_me.h>
 
 #include "blm.h"
 
+/* BLQs per NBI */
+#define BLM_NUM_BLQ         4
+
+#if (BLM_MAGAZINE_SIZE != 0)
+struct blm_mag {
+    unsigned int count;
+    blm_buf_handle_t bufs[BLM_MAGAZINE_SIZE];
+};
+
+__shared __lmem struct blm_mag blm_mags[BLM_NUM_BLQ];
+__shared __lmem struct blm_mag_stats blm_mags_stats[BLM_NUM_BLQ];
+#endif
+
+#ifdef BLM_BUF_DEBUG
+/* Allocated by blm_main.uc, see "Buffer debugging" in blm_cfg.h */
+__import __shared __emem unsigned int blm_dbg_tags[1 << BLM_BUF_DEBUG_KEY_BITS];
+__import __shared __emem unsigned int blm_dbg_gen[2];
+__import __shared __emem struct blm_dbg_err blm_dbg_err;
+
+static __intrinsic unsigned int
+_blm_dbg_gen_tag(void)
+{
+    __xread unsigned int gen;
+
+    mem_read_atomic(&gen, blm_dbg_gen, sizeof(gen));
+    return gen << BLM_DBG_TAG_GEN_shf;
+}
+#endif
+
+__intrinsic void
+blm_buf_dbg_alloc(blm_buf_handle_t buf)
+{
+#ifdef BLM_BUF_DEBUG
+    __xwrite unsigned int tag;
+
+    tag = _blm_dbg_gen_tag();
+    mem_write_atomic(&tag, &blm_dbg_tags[buf & BLM_DBG_KEY_MASK],
+                     sizeof(tag));
+#endif
+}
+
+/* Tag a buffer free, before it is on the ring or in the magazine */
+static __intrinsic void
+_blm_dbg_free(blm_buf_handle_t buf, unsigned int blq)
+{
+#ifdef BLM_BUF_DEBUG
+    __xrw unsigned int tag;
+    __xwrite unsigned int err[3];
+
+    tag = _blm_dbg_gen_tag() | BLM_DBG_TAG_FREE;
+    mem_swap(&tag, &blm_dbg_tags[buf & BLM_DBG_KEY_MASK], sizeof(tag));
+    if (tag & BLM_DBG_TAG_FREE) {
+        err[0] = buf;
+        err[1] = blq;
+        err[2] = tag;
+        mem_incr32(&blm_dbg_err.double_frees);
+        mem_write_atomic(err, &blm_dbg_err.last_handle, sizeof(err));
+    }
+#endif
+}
+
+__intrinsic void
+blm_dbg_errs(struct blm_dbg_err *err)
+{
+#ifdef BLM_BUF_DEBUG
+    __xread struct blm_dbg_err xerr;
+
+    mem_read_atomic(&xerr, &blm_dbg_err, sizeof(xerr));
+    *err = xerr;
+#else
+    err->double_frees = 0;
+    err->last_handle = 0;
+    err->last_blq = 0;
+    err->last_tag = 0;
+#endif
+}
+
 __intrinsic int
 __blm_buf_alloc(__xread blm_buf_handle_t *buf, unsigned int blq,
                 SIGNAL_PAIR *sigpair, sync_t sync)
@@ -42,6 +120,9 @@ __blm_buf_alloc_bulk(__xread blm_buf_handle_t *bufs, unsigned int count,
 {
     mem_ring_addr_t raddr_hi;
     unsigned int rnum;
+#ifdef BLM_BUF_DEBUG
+    unsigned int i;
+#endif
 
     try_ctassert(blq <= 3);
     try_ctassert(count <= 16);
@@ -62,6 +143,10 @@ __blm_buf_alloc_bulk(__xread blm_buf_handle_t *bufs, unsigned int count,
         /* Check for an error signal error signal */
         if (signal_test(&sigpair->odd))
             return -1;
+#ifdef BLM_BUF_DEBUG
+        for (i = 0; i < count; i++)
+            blm_buf_dbg_alloc(bufs[i]);
+#endif
     }
     return 0;
 }
@@ -74,8 +159,8 @@ blm_buf_alloc_bulk(__xread blm_buf_handle_t *bufs, unsigned int count,
     return __blm_buf_alloc_bulk(bufs, count, blq, &sigpair, ctx_swap);
 }
 
-__intrinsic void
-blm_buf_free(blm_buf_handle_t buf, unsigned int blq)
+static __intrinsic void
+_blm_buf_free_ring(blm_buf_handle_t buf, unsigned int blq)
 {
     mem_ring_addr_t raddr_hi;
     unsigned int rnum;
@@ -90,6 +175,35 @@ blm_buf_free(blm_buf_handle_t buf, unsigned int blq)
     mem_ring_journal_fast(rnum, raddr_hi, buf);
 }
 
+__intrinsic void
+blm_buf_free(blm_buf_handle_t buf, unsigned int blq)
+{
+#if (BLM_MAGAZINE_SIZE != 0)
+    __lmem struct blm_mag *mag = &blm_mags[blq];
+    __xwrite blm_buf_handle_t xbufs[BLM_MAGAZINE_BATCH];
+    unsigned int i;
+
+    try_ctassert(blq <= 3);
+    _blm_dbg_free(buf, blq);
+    blm_mags_stats[blq].frees++;
+
+    if (mag->count < BLM_MAGAZINE_SIZE) {
+        mag->bufs[mag->count++] = buf;
+        return;
+    }
+
+    /* Full: spill a batch, taken before the context swaps */
+    for (i = 0; i < BLM_MAGAZINE_BATCH; i++)
+        xbufs[i] = mag->bufs[--mag->count];
+    mag->bufs[mag->count++] = buf;
+    blm_mags_stats[blq].spills++;
+    blm_buf_free_bulk(xbufs, BLM_MAGAZINE_BATCH, blq);
+#else
+    _blm_dbg_free(buf, blq);
+    _blm_buf_free_ring(buf, blq);
+#endif
+}
+
 __intrinsic void
 __blm_buf_free_bulk(__xwrite blm_buf_handle_t *bufs, unsigned int count,
                     unsigned int blq, SIGNAL *sig, sync_t sync)
@@ -115,3 +229,122 @@ blm_buf_free_bulk(__xwrite blm_buf_handle_t *bufs, unsigned int count,
     SIGNAL sig;
     __blm_buf_free_bulk(bufs, count, blq, &sig, ctx_swap);
 }
+
+__intrinsic int
+blm_buf_blq(unsigned int size)
+{
+    unsigned int blq;
+    unsigned int best_size = 0;
+    int best = -1;
+
+    /* The BLQs are few, a linear search is the cheapest */
+    for (blq = 0; blq < BLM_NUM_BLQ; blq++) {
+        if (size <= BLM_BLQ_BUF_SIZE(blq) &&
+            (best < 0 || BLM_BLQ_BUF_SIZE(blq) < best_size)) {
+            best = blq;
+            best_size = BLM_BLQ_BUF_SIZE(blq);
+        }
+    }
+
+    return best;
+}
+
+__intrinsic int
+blm_buf_alloc_cached(blm_buf_handle_t *buf, unsigned int blq)
+{
+#if (BLM_MAGAZINE_SIZE != 0)
+    __lmem struct blm_mag *mag = &blm_mags[blq];
+    __xread blm_buf_handle_t xbufs[BLM_MAGAZINE_BATCH];
+    unsigned int i;
+
+    try_ctassert(blq <= 3);
+    blm_mags_stats[blq].allocs++;
+
+    if (mag->count == 0) {
+        if (blm_buf_alloc_bulk(xbufs, BLM_MAGAZINE_BATCH, blq) == 0) {
+            blm_mags_stats[blq].refills++;
+            /* Other contexts may have freed into the magazine meanwhile */
+            for (i = 1; i < BLM_MAGAZINE_BATCH; i++) {
+                if (mag->count < BLM_MAGAZINE_SIZE) {
+                    mag->bufs[mag->count++] = xbufs[i];
+                } else {
+                    blm_mags_stats[blq].ring_frees++;
+                    _blm_buf_free_ring(xbufs[i], blq);
+                }
+            }
+            *buf = xbufs[0];
+            return 0;
+        }
+
+        /* Less than a batch left on the ring, unless freed meanwhile */
+        if (mag->count == 0) {
+            blm_mags_stats[blq].ring_allocs++;
+            if (blm_buf_alloc(xbufs, blq) != 0)
+                return -1;
+            *buf = xbufs[0];
+            return 0;
+        }
+    }
+
+    *buf = mag->bufs[--mag->count];
+    /* Freed into the magazine, or tagged with the batch */
+    blm_buf_dbg_alloc(*buf);
+    return 0;
+#else
+    __xread blm_buf_handle_t xbuf;
+
+    if (blm_buf_alloc(&xbuf, blq) != 0)
+        return -1;
+    *buf = xbuf;
+    return 0;
+#endif
+}
+
+__intrinsic void
+blm_mag_init(void)
+{
+#if (BLM_MAGAZINE_SIZE != 0)
+    unsigned int blq;
+
+    for (blq = 0; blq < BLM_NUM_BLQ; blq++) {
+        blm_mags[blq].count = 0;
+        blm_mags_stats[blq].allocs = 0;
+        blm_mags_stats[blq].frees = 0;
+        blm_mags_stats[blq].refills = 0;
+        blm_mags_stats[blq].spills = 0;
+        blm_mags_stats[blq].ring_allocs = 0;
+        blm_mags_stats[blq].ring_frees = 0;
+    }
+#endif
+}
+
+__intrinsic void
+blm_mag_drain(unsigned int blq)
+{
+#if (BLM_MAGAZINE_SIZE != 0)
+    __lmem struct blm_mag *mag = &blm_mags[blq];
+
+    try_ctassert(blq <= 3);
+
+    while (mag->count != 0) {
+        blm_mags_stats[blq].ring_frees++;
+        _blm_buf_free_ring(mag->bufs[--mag->count], blq);
+    }
+#endif
+}
+
+__intrinsic void
+blm_mag_stats(unsigned int blq, struct blm_mag_stats *stats)
+{
+#if (BLM_MAGAZINE_SIZE != 0)
+    try_ctassert(blq <= 3);
+    *stats = blm_mags_stats[blq];
+#else
+    stats->allocs = 0;
+    stats->frees = 0;
+    stats->refills = 0;
+    stats->spills = 0;
+    stats->ring_allocs = 0;
+    stats->ring_frees = 0;
+#endif
+}
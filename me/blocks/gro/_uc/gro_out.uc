@@ -24,7 +24,7 @@
 #include <gro.uc>
 #include <gro_cfg.uc>
 
-#ifdef GRO_DEBUG
+#if (defined(GRO_DEBUG) || GRO_WD_TIMEOUT != 0)
 #include <journal.uc>
 #endif
 
@@ -53,6 +53,24 @@
 #define GRO_OUT_HANDLER_ILEN    64
 #define GRO_OUT_HANDLER_shf     (log2(GRO_OUT_HANDLER_ILEN))
 
+/* Instructions in the pieces of the handlers */
+#ifdef GRO_EVEN_NFD_OFFSETS_ONLY
+#define _GRO_NFD_DESC_NINST     6
+#else
+#define _GRO_NFD_DESC_NINST     7
+#endif
+
+#ifdef GRO_OUT_BATCH_STATS
+#define _GRO_BATCH_STAT_NINST   4
+#else
+#define _GRO_BATCH_STAT_NINST   0
+#endif
+
+// NFD 3.1 takes descriptors from a work queue, the others from a ring
+#if (defined(NFD_VERSION) && (NFD_VERSION == 0x03010000))
+#define _GRO_NFD_QADD_WORK
+#endif
+
 
 // Needed by both the dispatcher and worker context
 #define LM_XBUF_CSR             ACTIVE_LM_ADDR_0
@@ -107,6 +125,11 @@
 #define LM_CTX_BM_BASE_wrd      7       /* low 32 bits for BM mem */
 #define LM_CTX_BM_NEXT_wrd      8       /* low 32 bits for next BM mem to reset*/
 #define LM_CTX_BM_END_wrd       9       /* low 32 bits for BM mem to reset*/
+#define LM_CTX_WD_HEAD_wrd      10      /* Q_ADDRLO at the last watchdog visit */
+#define LM_CTX_WD_TS_wrd        11      /* start of the current hole, or 0 */
+#define LM_CTX_WD_LAT_wrd       12      /* average duration of a hole */
+#define LM_CTX_TM_HEAD_wrd      13      /* Q_ADDRLO at the last telemetry sample */
+#define LM_CTX_TM_TS_wrd        14      /* when the head was first sampled */
 #define LM_CTX_SIZE_LW          16
 #define LM_CTX_SIZE             (LM_CTX_SIZE_LW << 2)
 #define LM_CTX_shf              (log2(LM_CTX_SIZE))
@@ -121,6 +144,11 @@
 #define LM_CTX_BM_BASE          LM_CTX_PTR[LM_CTX_BM_BASE_wrd]
 #define LM_CTX_BM_NEXT          LM_CTX_PTR[LM_CTX_BM_NEXT_wrd]
 #define LM_CTX_BM_END           LM_CTX_PTR[LM_CTX_BM_END_wrd]
+#define LM_CTX_WD_HEAD          LM_CTX_PTR[LM_CTX_WD_HEAD_wrd]
+#define LM_CTX_WD_TS            LM_CTX_PTR[LM_CTX_WD_TS_wrd]
+#define LM_CTX_WD_LAT           LM_CTX_PTR[LM_CTX_WD_LAT_wrd]
+#define LM_CTX_TM_HEAD          LM_CTX_PTR[LM_CTX_TM_HEAD_wrd]
+#define LM_CTX_TM_TS            LM_CTX_PTR[LM_CTX_TM_TS_wrd]
 
 
 
@@ -504,6 +532,431 @@ dispatch_top#:
 #endm
 
 
+#if (GRO_OUT_VISIT)
+
+/*
+ * Invoked by the dispatcher between batches of release messages: branch
+ * to VISIT_LABEL if it is time to visit the next reorder context, with
+ * RTN_LABEL as the return address in out_rtn.
+ */
+#macro _gro_out_visit_test(io_last, out_rtn, VISIT_LABEL, RTN_LABEL)
+.begin
+    .reg now
+
+    local_csr_rd[TIMESTAMP_LOW]
+    immed[now, 0]
+    alu[now, now, -, io_last]
+    alu[--, --, B, now, >>GRO_WD_INTERVAL_shf]
+    beq[RTN_LABEL]
+    load_addr[out_rtn, RTN_LABEL]
+    br[VISIT_LABEL]
+.end
+#endm
+
+#endif /* GRO_OUT_VISIT */
+
+
+#if (GRO_TELEM != 0)
+
+/*
+ * Count in_val in bucket 1 + log2(in_val) of histogram HIST of reorder
+ * context in_ctx of the block, bucket 0 for 0 and the last bucket for
+ * anything from 2^(GRO_TELEM_NBUCKETS - 2).  Clobbers in_val.
+ */
+#macro _gro_out_telem_incr(in_ctx, HIST, in_val)
+.begin
+    .reg addr_hi
+    .reg addr_lo
+    .reg bkt
+    .reg tmp
+
+    immed[bkt, 0]
+    alu[--, --, B, in_val]
+    beq[telem_count#]
+    alu[tmp, --, B, in_val, >>(GRO_TELEM_NBUCKETS - 2)]
+    beq[telem_log2#]
+    br[telem_count#], defer[1]
+    immed[bkt, (GRO_TELEM_NBUCKETS - 1)]
+
+telem_log2#:
+    immed[bkt, 1]
+    #define_eval __SHF 8
+    #while (__SHF > 0)
+        alu[tmp, --, B, in_val, >>__SHF]
+        beq[telem_log2_/**/__SHF#]
+        alu[bkt, bkt, +, __SHF]
+        alu[in_val, --, B, tmp]
+telem_log2_/**/__SHF#:
+        #define_eval __SHF (__SHF / 2)
+    #endloop
+    #undef __SHF
+
+telem_count#:
+    move(addr_hi, (_gro_telem >> 8))
+    move(tmp, ((GRO_BLOCK_NUM * GRO_CTX_PER_BLOCK * GRO_TELEM_CTX_SIZE) + \
+               (HIST * GRO_TELEM_HIST_SIZE)))
+    alu[addr_lo, tmp, +, in_ctx, <<GRO_TELEM_CTX_SIZE_shf]
+    alu[addr_lo, addr_lo, +, bkt, <<2]
+    mem[incr, --, addr_hi, <<8, addr_lo]
+.end
+#endm
+
+
+/*
+ * Sample reorder context in_ctx of the block, whose LM_CTX_* is active,
+ * at time in_now.  The depth is the number of entries that the clients
+ * enqueued and whose tickets are not released yet, from _gro_cli_cntrs.
+ * While it is not 0 and the head does not move, the head blocks them:
+ * its wait is timed from the first visit that found it there.
+ */
+#macro _gro_out_telem(in_now, in_ctx)
+.begin
+    .reg addr_hi
+    .reg addr_lo
+    .reg depth
+    .reg head
+    .reg wait
+    .reg tmp
+
+    .reg read $telem_cntrs[3]
+    .xfer_order $telem_cntrs
+    .sig telem_sig
+
+    move(addr_hi, (_gro_cli_cntrs >> 8))
+    move(tmp, (GRO_BLOCK_NUM * GRO_CTX_PER_BLOCK * 16))
+    alu[addr_lo, tmp, +, in_ctx, <<4]
+    mem[read32, $telem_cntrs[0], addr_hi, <<8, addr_lo, 3], ctx_swap[telem_sig]
+
+    // enqueued - released, which a release racing the read can make < 0
+    alu[depth, --, B, $telem_cntrs[2]]
+    alu[depth, $telem_cntrs[0], -, depth]
+    bge[telem_head#]
+    immed[depth, 0]
+
+telem_head#:
+    alu[head, --, B, LM_CTX_Q_ADDRLO]
+    immed[wait, 0]
+    alu[--, --, B, depth]
+    beq[telem_head_moved#]
+    alu[--, head, -, LM_CTX_TM_HEAD]
+    bne[telem_head_moved#]
+    br[telem_sample#], defer[1]
+    alu[wait, in_now, -, LM_CTX_TM_TS]
+
+telem_head_moved#:
+    alu[LM_CTX_TM_HEAD, --, B, head]
+    alu[LM_CTX_TM_TS, --, B, in_now]
+
+telem_sample#:
+    _gro_out_telem_incr(in_ctx, GRO_TELEM_HIST_DEPTH, depth)
+    // Timestamp ticks are 16 cycles
+    alu[wait, --, B, wait, >>(GRO_TELEM_WAIT_shf - 4)]
+    _gro_out_telem_incr(in_ctx, GRO_TELEM_HIST_WAIT, wait)
+.end
+#endm
+
+#endif /* GRO_TELEM != 0 */
+
+
+#if (GRO_WD_TIMEOUT != 0)
+
+#macro _gro_out_wd_cntr_incr(in_ctx)
+.begin
+    .reg addr_hi
+    .reg addr_lo
+    .reg tmp
+
+    move(addr_hi, (_gro_wd_cntrs >> 8))
+    move(tmp, (GRO_BLOCK_NUM * GRO_CTX_PER_BLOCK * 8))
+    alu[addr_lo, tmp, +, in_ctx, <<3]
+
+    ; override length  = (1 << 7)
+    ; override dataref = (2 << 3)
+    ; length[2] = 1 for 64-bit operations = (1 << 10)
+    ; length[3] = 1 for to pull operand from dataref = (1 << 11)
+    ; dataref = 1 = (1 << 16)
+    move(tmp, ((2 << 3) | (1 << 7) | (1 << 10) | (1 << 11) | (1 << 16)))
+    alu[--, --, B, tmp]
+    mem[add64_imm, --, addr_hi, <<8, addr_lo], indirect_ref
+.end
+#endm
+
+
+/*
+ * Entries that the watchdog releases were enqueued by clients whose own
+ * releases were queued behind the hole:  count them as released, so that
+ * _gro_cli_cntrs still tells how many entries wait for their tickets.
+ */
+#macro _gro_out_wd_released_add(in_ctx, in_amt)
+.begin
+    .reg addr_hi
+    .reg addr_lo
+    .reg tmp
+
+    move(addr_hi, (_gro_cli_cntrs >> 8))
+    move(tmp, ((GRO_BLOCK_NUM * GRO_CTX_PER_BLOCK * 16) | 8))
+    alu[addr_lo, tmp, +, in_ctx, <<4]
+
+    ; override length  = (1 << 7)
+    ; override dataref = (2 << 3)
+    ; length[2] = 1 for 64-bit operations = (1 << 10)
+    ; length[3] = 1 for to pull operand from dataref = (1 << 11)
+    move(tmp, ((2 << 3) | (1 << 7) | (1 << 10) | (1 << 11)))
+    alu[--, tmp, OR, in_amt, <<16]
+    mem[add64_imm, --, addr_hi, <<8, addr_lo], indirect_ref
+.end
+#endm
+
+
+/*
+ * Lost sequence watchdog, see gro.uc, for reorder context in_ctx of the
+ * block, whose LM_CTX_* is active, at time in_now.  A hole is a head
+ * sequence number that the ticket tape waits for, either the ticket of
+ * the head entry or ticket 0 of its tape (the cascade from the previous
+ * tape), while later tickets of the tape or the next are released.  A
+ * hole that outlives the timeout has its ticket released here and the
+ * entries that this releases dispatched, without the hole itself.  The
+ * durations of the holes that fill by themselves are averaged to adapt
+ * the timeout.  The skipped entry holds GRO_META_WD_SKIP for its ticket.
+ */
+#macro _gro_out_wd(in_now, in_ctx)
+.begin
+    .reg off
+    .reg slot
+    .reg tape_addr
+    .reg tape_seq
+    .reg ticket
+    .reg nrel
+    .reg skipped
+    .reg timeout
+    .reg tmp
+    .reg wd_rel
+    .reg jval
+    .reg qaddr
+    .reg marker
+    .reg old_meta
+
+    .reg $wd_ticket
+    .reg $wd_meta
+    .reg read $wd_tape[3]
+    .xfer_order $wd_tape
+    .sig wd_sig
+
+    // If the head moved since the last visit, any hole filled by itself:
+    // lat += (duration - lat) / 2^GRO_WD_LAT_AVG_shf
+    alu[off, --, B, LM_CTX_Q_ADDRLO]
+    alu[--, off, -, LM_CTX_WD_HEAD]
+    beq[wd_test_hole#]
+    alu[LM_CTX_WD_HEAD, --, B, off]
+    alu[tmp, --, B, LM_CTX_WD_TS]
+    beq[wd_done#]
+    alu[tmp, in_now, -, tmp]
+    alu[tmp, tmp, -, LM_CTX_WD_LAT]
+    asr[tmp, tmp, >>GRO_WD_LAT_AVG_shf]
+    alu[LM_CTX_WD_LAT, LM_CTX_WD_LAT, +, tmp]
+    br[wd_done#], defer[1]
+    alu[LM_CTX_WD_TS, --, B, 0]
+
+wd_test_hole#:
+    // Ticket tape of the head and the head's position on it
+    alu[off, off, -, LM_CTX_Q_BASE]
+    alu[jval, --, B, off, >>(log2(GRO_META_SIZE))]
+    alu[slot, jval, AND, GRO_TICKET_msk]
+    alu[tape_addr, --, B, off, >>(log2(GRO_META_SIZE * GRO_TICKET_PER_TAPE))]
+    alu[tape_addr, --, B, tape_addr, <<GRO_TICKET_TAPE_SIZE_shf]
+    alu[tape_addr, tape_addr, +, LM_CTX_BM_BASE]
+    mem[atomic_read, $wd_tape[0], LM_CTX_BM_ADDRHI, <<8, tape_addr, 3], ctx_swap[wd_sig]
+
+    alu[tape_seq, $wd_tape[0], AND, GRO_TAPE_SEQ_msk]
+    alu[tmp, GRO_EPOCH_msk, AND, $wd_tape[0], >>GRO_EPOCH_TICKET_SEQ_shf]
+    alu[ticket, tape_seq, OR, tmp, <<GRO_EPOCH_TICKET_SEQ_shf]
+
+    // The tape must wait for the head or for the cascade into it ...
+    alu[tmp, slot, +, 1]
+    alu[--, tape_seq, -, tmp]
+    beq[wd_test_pending#]
+    alu[--, tape_seq, OR, slot]
+    bne[wd_no_hole#]
+
+wd_test_pending#:
+    // ... with later tickets released on it or on the next tape
+    alu[--, $wd_tape[1], OR, $wd_tape[2]]
+    bne[wd_hole#]
+    alu[tmp, tape_addr, +, GRO_TICKET_TAPE_SIZE]
+    alu[--, tmp, -, LM_CTX_BM_END]
+    bne[wd_read_next#]
+    alu[tmp, --, B, LM_CTX_BM_BASE]
+wd_read_next#:
+    mem[atomic_read, $wd_tape[0], LM_CTX_BM_ADDRHI, <<8, tmp, 3], ctx_swap[wd_sig]
+    alu[--, $wd_tape[1], OR, $wd_tape[2]]
+    bne[wd_hole#]
+
+wd_no_hole#:
+    br[wd_done#], defer[1]
+    alu[LM_CTX_WD_TS, --, B, 0]
+
+wd_hole#:
+    // Time the hole from the first visit that sees it
+    alu[tmp, --, B, LM_CTX_WD_TS]
+    bne[wd_stalled#]
+    br[wd_done#], defer[1]
+    alu[LM_CTX_WD_TS, in_now, OR, 1]
+
+wd_stalled#:
+    // timeout = lat * 2^GRO_WD_LAT_MUL_shf within the configured bounds
+    move(timeout, (GRO_WD_TIMEOUT_MAX >> GRO_WD_LAT_MUL_shf))
+    alu[--, timeout, -, LM_CTX_WD_LAT]
+    blt[wd_timeout_max#]
+    alu[timeout, --, B, LM_CTX_WD_LAT, <<GRO_WD_LAT_MUL_shf]
+    move(tmp, GRO_WD_TIMEOUT)
+    alu[--, timeout, -, tmp]
+    bge[wd_test_timeout#]
+    br[wd_test_timeout#], defer[1]
+    alu[timeout, --, B, tmp]
+wd_timeout_max#:
+    move(timeout, GRO_WD_TIMEOUT_MAX)
+wd_test_timeout#:
+    alu[tmp, in_now, -, LM_CTX_WD_TS]
+    alu[--, tmp, -, timeout]
+    blt[wd_done#]
+
+    // Skip the hole: release its ticket as if its entry had been sent.
+    // The entry gets the skip marker first, for a client that sends it
+    // late to tell the skip from a duplicate (see _gro_cli_send()).
+    immed[skipped, 0]
+    alu[--, --, B, tape_seq]
+    beq[wd_release#]
+    alu[qaddr, --, B, LM_CTX_Q_ADDRLO]
+    move(marker, GRO_META_WD_SKIP_SIG)
+    alu[marker, marker, OR, ticket, <<GRO_META_WD_SKIP_TICKET_shf]
+    alu[$wd_meta, --, B, marker]
+    mem[swap, $wd_meta, LM_CTX_Q_ADDRHI, <<8, qaddr, 1], ctx_swap[wd_sig]
+    alu[old_meta, --, B, $wd_meta]
+wd_release#:
+    alu[$wd_ticket, --, B, ticket]
+    mem[release_ticket, $wd_ticket, LM_CTX_BM_ADDRHI, <<8, tape_addr, 1], sig_done[wd_sig]
+    ctx_arb[wd_sig]
+
+    // The client released it after all, or the next tape is still in
+    // the skid: a later visit will see the cascade missing.
+    br=byte[$wd_ticket, 0, GRO_TICKET_ERROR, wd_release_error#]
+    alu[nrel, --, B, $wd_ticket]
+    beq[wd_release_error#]
+    immed[skipped, 1]
+
+    // Step over the skipped entry, which is never read
+    alu[--, --, B, tape_seq]
+    beq[wd_dispatch#]
+    alu[LM_CTX_Q_ADDRLO, LM_CTX_Q_ADDRLO, +, GRO_META_SIZE]
+    alu[off, --, B, LM_CTX_Q_ADDRLO]
+    alu[--, off, -, LM_CTX_Q_BM_RESET]
+    bne[wd_dispatch#]
+    reset_next_bitmap()
+    alu[--, off, -, LM_CTX_Q_END]
+    bne[wd_dispatch#]
+    alu[LM_CTX_Q_ADDRLO, --, B, LM_CTX_Q_BASE]
+
+wd_dispatch#:
+    // Dispatch the entries released after the hole or the cascade marker
+    alu[tape_seq, tape_seq, +, nrel]
+    alu[nrel, nrel, -, 1]
+    beq[wd_cascade#]
+    _gro_out_wd_released_add(in_ctx, nrel)
+    alu[wd_rel, in_ctx, OR, nrel, <<GRO_REL_NREL_shf]
+    gro_out_dispatch(wd_rel, wd_rel, --, wd_cascade#, --)
+
+wd_cascade#:
+    // Released through the end of the tape: release ticket 0 of the next
+    alu[--, tape_seq, -, (GRO_TICKET_PER_TAPE + 1)]
+    blt[wd_skipped#]
+    alu[tape_addr, tape_addr, +, GRO_TICKET_TAPE_SIZE]
+    alu[--, tape_addr, -, LM_CTX_BM_END]
+    bne[wd_cascade_next#]
+    alu[tape_addr, --, B, LM_CTX_BM_BASE]
+    alu[ticket, ticket, +, 1, <<GRO_EPOCH_TICKET_SEQ_shf]
+wd_cascade_next#:
+    alu[ticket, GRO_EPOCH_msk, AND, ticket, >>GRO_EPOCH_TICKET_SEQ_shf]
+    alu[ticket, --, B, ticket, <<GRO_EPOCH_TICKET_SEQ_shf]
+    br[wd_release#], defer[1]
+    immed[tape_seq, 0]
+
+wd_release_error#:
+    alu[--, --, B, skipped]
+    bne[wd_skipped#]
+    alu[--, --, B, tape_seq]
+    beq[wd_done#]
+
+    // The hole filled after all: put back the word that the marker
+    // replaced, or the client's own if it wrote the entry meanwhile
+    alu[$wd_meta, --, B, old_meta]
+    mem[swap, $wd_meta, LM_CTX_Q_ADDRHI, <<8, qaddr, 1], ctx_swap[wd_sig]
+    alu[--, marker, -, $wd_meta]
+    beq[wd_done#]
+    alu[$wd_meta, --, B, $wd_meta]
+    mem[write_atomic, $wd_meta, LM_CTX_Q_ADDRHI, <<8, qaddr, 1], ctx_swap[wd_sig]
+    br[wd_done#]
+
+wd_skipped#:
+    _gro_out_wd_cntr_incr(in_ctx)
+    alu[jval, jval, OR, in_ctx, <<24]
+    alu[jval, jval, OR, GRO_BLOCK_NUM, <<28]
+    journal(gro_wd, jval)
+    alu[off, --, B, LM_CTX_Q_ADDRLO]
+    alu[LM_CTX_WD_HEAD, --, B, off]
+    alu[LM_CTX_WD_TS, --, B, 0]
+
+wd_done#:
+.end
+#endm
+
+#endif /* GRO_WD_TIMEOUT != 0 */
+
+
+#if (GRO_OUT_VISIT)
+
+/*
+ * Visit reorder context io_ctx + 1 of the block:  sample its telemetry
+ * and run the lost sequence watchdog on it.  Returns to in_rtn.
+ */
+#macro _gro_out_visit(io_last, io_ctx, in_rtn)
+.begin
+    .reg now
+    .reg lma
+    .reg tmp
+
+    local_csr_rd[TIMESTAMP_LOW]
+    immed[now, 0]
+    alu[io_last, --, B, now]
+
+    alu[io_ctx, io_ctx, +, 1]
+    alu[io_ctx, io_ctx, AND, GRO_CTX_BLOCK_MASK]
+    alu[lma, g_ctx_lm_base, OR, io_ctx, <<LM_CTX_shf]
+    local_csr_wr[LM_CTX_CSR, lma]
+    nop
+    nop
+    nop
+
+    // Contexts that are not declared have no ticket tapes
+    alu[tmp, --, B, LM_CTX_BM_BASE]
+    alu[--, tmp, -, LM_CTX_BM_END]
+    beq[visit_done#]
+
+    #if (GRO_TELEM != 0)
+        _gro_out_telem(now, io_ctx)
+    #endif
+
+    #if (GRO_WD_TIMEOUT != 0)
+        _gro_out_wd(now, io_ctx)
+    #endif
+
+visit_done#:
+    rtn[in_rtn]
+.end
+#endm
+
+#endif /* GRO_OUT_VISIT */
+
+
 #define GRO_OUT_GETSAFE_NUM     8
 
 #macro gro_out_dispatcher_mem_ring(BLOCKNUM)
@@ -518,6 +971,12 @@ dispatch_top#:
     .reg volatile ring_lo
     .reg volatile ring_hi
 
+    #if (GRO_OUT_VISIT)
+        .reg volatile visit_last
+        .reg volatile visit_ctx
+        .reg volatile visit_rtn
+    #endif
+
     .reg read volatile $mem_ring0[GRO_OUT_GETSAFE_NUM]
     .xfer_order $mem_ring0
     .sig volatile mem_ring0_sig
@@ -538,7 +997,7 @@ dispatch_top#:
     .reg write volatile $xreset_epoch_3[GRO_TICKET_TAPE_SIZE_LW]
     .xfer_order $xreset_epoch_3
 
-    #define_eval __ISL (gro_release_isl_/**/BLOCKNUM)
+    #define_eval __ISL (GRO_RELEASE_ISL(BLOCKNUM))
     #define_eval __EMEM (__ISL - NFP6000_EMEM_ISL_BASE)
     .alloc_mem gro_release_ring_mem_/**/BLOCKNUM \
         emem/**/__EMEM/**/_cache_upper global \
@@ -574,7 +1033,12 @@ dispatch_top#:
     move(g_ctx_lm_base, gro_out_lm_ctx)
 
     move(ring_lo, gro_release_ring_/**/BLOCKNUM)
-    move(ring_hi, ((gro_release_isl_/**/BLOCKNUM | 0x80) << 24))
+    move(ring_hi, ((GRO_RELEASE_ISL(BLOCKNUM) | 0x80) << 24))
+
+    #if (GRO_OUT_VISIT)
+        immed[visit_last, 0]
+        immed[visit_ctx, 0]
+    #endif
 
     local_csr_wr[SAME_ME_SIGNAL,  ((&ordersig << 3) | (GRO_OUT_FIRST_WORKER << 0))]
 
@@ -590,6 +1054,10 @@ mem_ring0_last_no_input#:
     #endif /* GRO_DEBUG */
 
 wait_mem_ring0_input#:
+    #if (GRO_OUT_VISIT)
+        _gro_out_visit_test(visit_last, visit_rtn, gro_out_visit#, visit_ring0_rtn#)
+visit_ring0_rtn#:
+    #endif
     ctx_arb[mem_ring0_sig]
 
     mem[get_safe, $mem_ring1[0], ring_hi, <<8, ring_lo, 8], sig_done[mem_ring1_sig]
@@ -625,6 +1093,10 @@ mem_ring1_last_no_input#:
     #endif /* GRO_DEBUG */
 
 wait_mem_ring1_input#:
+    #if (GRO_OUT_VISIT)
+        _gro_out_visit_test(visit_last, visit_rtn, gro_out_visit#, visit_ring1_rtn#)
+visit_ring1_rtn#:
+    #endif
     ctx_arb[mem_ring1_sig]
 
     mem[get_safe, $mem_ring0[0], ring_hi, <<8, ring_lo, 8], sig_done[mem_ring0_sig]
@@ -652,6 +1124,11 @@ wait_mem_ring1_input#:
                          _gro_test_no_input_mem_ring,
                          wait_mem_ring0_input#, wait_mem_ring0_input#)
 
+    #if (GRO_OUT_VISIT)
+gro_out_visit#:
+        _gro_out_visit(visit_last, visit_ctx, visit_rtn)
+    #endif
+
     #undef __ISL
     #undef __EMEM
     #undef __LOOP
@@ -816,6 +1293,21 @@ wait_mem_ring1_input#:
 #endm
 
 
+// Add 1 to the CNTR counter of the destination of in_meta, see gro.uc
+#macro _gro_out_batch_stat(in_meta, CNTR)
+#ifdef GRO_OUT_BATCH_STATS
+.begin
+    .reg stat_off
+
+    alu[stat_off, GRO_OUT_BATCH_SLOT_msk, AND, in_meta[GRO_META_TYPE_wrd]]
+    alu[stat_off, CNTR, OR, stat_off, <<GRO_OUT_BATCH_SLOT_shf]
+    alu[--, --, B, g_stats_iref]
+    mem[add64_imm, --, g_stats_hi, <<8, stat_off], indirect_ref
+.end
+#endif
+#endm
+
+
 #macro gro_drop_seq(in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
 .begin
 
@@ -887,27 +1379,16 @@ wait_mem_ring1_input#:
 
 // TODO:  Use real offsets and add thorough documentation of what we're doing
 // here...
-#macro gro_nfd_xmit(in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+#macro _gro_nfd_desc(in_meta, out_xfer)
 .begin
     .reg word0
     .reg off
 
-    .reg addr_hi
-    .reg addr_lo
-
-    #if (!streq('TWO_REQ_LABEL', '--'))
-        #define_eval _GRO_H_NINST 16
-    #else
-        #define_eval _GRO_H_NINST 15
-        local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
-    #endif
-
     move(out_xfer[1], in_meta[1])
     move(out_xfer[3], in_meta[3])
 
     alu[off, (127 << 1), AND, in_meta[0], >>(GRO_META_W0_META_START_BIT - 1)]
     #ifdef GRO_EVEN_NFD_OFFSETS_ONLY
-        #define_eval _GRO_H_NINST (_GRO_H_NINST - 1)
         move(out_xfer[2], in_meta[2])
     #else
         alu[out_xfer[2], in_meta[2], OR, 1, <<31]
@@ -915,11 +1396,57 @@ wait_mem_ring1_input#:
     #endif
     alu[word0, in_meta[0], AND, g_hi18_mask]
     alu[out_xfer[0], word0, OR, off]
+.end
+#endm
+
+
+#macro gro_nfd_xmit(in_meta, out_xfer, in_meta2, out_xfer2, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+.begin
+    .reg addr_hi
+    .reg addr_lo
+
+    #if (!streq('TWO_REQ_LABEL', '--'))
+        #define_eval _GRO_H_NINST (9 + _GRO_NFD_DESC_NINST)
+    #else
+        #define_eval _GRO_H_NINST (8 + _GRO_NFD_DESC_NINST)
+        local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
+    #endif
+
+    #if (!streq('TWO_REQ_LABEL', '--') && !defined(_GRO_NFD_QADD_WORK))
+    .begin
+        .reg tmp
+
+        // Both packets of the buffer go to the same NFD ring:  put the two
+        // descriptors on it with a single journal command.
+        #define_eval _GRO_H_NINST (_GRO_H_NINST + 13 + (2 * _GRO_NFD_DESC_NINST) + _GRO_BATCH_STAT_NINST)
+        br_bclr[CUR_BUF[LM_XBUF_FLAGS_wrd], XBUF_FLAG_TWOPKTS_bit, one_desc#], defer[1]
+        alu[tmp, --, B, in_meta2[0]]
+        alu[tmp, tmp, XOR, in_meta[0]]
+        alu[--, (GRO_META_TYPE_msk | (GRO_META_DEST_msk << GRO_META_DEST_shf)), AND, tmp]
+        bne[one_desc#]
+
+        _gro_nfd_desc(in_meta, out_xfer)
+        _gro_nfd_desc(in_meta2, out_xfer2)
+        alu[addr_hi, LM_DEST_NFD3_RING_ENC, AND, 0xFF, <<24]
+        alu[addr_lo, g_ringlo_mask, AND, LM_DEST_NFD3_RING_ENC, >>GRO_DEST_NFD3_RINGLO_shf]
+        mem[journal, out_xfer[0], addr_hi, <<8, addr_lo, (GRO_OUT_XMIT_LEN * 2)], sig_done[OUTSIG]
+        _gro_out_batch_stat(in_meta, GRO_OUT_BATCH_CNTR_COALESCED)
+
+        alu[g_sigmask, CUR_BUF[LM_XBUF_SIGMASK_wrd], OR, mask(OUTSIG), <<(&OUTSIG)]
+        local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
+        ctx_arb[--], br[ONE_REQ_LABEL], defer[2]
+        alu[CUR_BUF[LM_XBUF_FLAGS_wrd], --, B, XBUF_FLAG_READY]
+        local_csr_wr[ACTIVE_CTX_WAKEUP_EVENTS, g_sigmask]
+    .end
+    #endif
+
+one_desc#:
+    _gro_nfd_desc(in_meta, out_xfer)
 
     alu[addr_hi, LM_DEST_NFD3_RING_ENC, AND, 0xFF, <<24]
     alu[addr_lo, g_ringlo_mask, AND, LM_DEST_NFD3_RING_ENC, >>GRO_DEST_NFD3_RINGLO_shf]
 
-    #if (defined(NFD_VERSION) && (NFD_VERSION == 0x03010000))
+    #ifdef _GRO_NFD_QADD_WORK
         mem[qadd_work, out_xfer[0], addr_hi, <<8, addr_lo, 4], sig_done[OUTSIG]
     #else
         mem[journal, out_xfer[0], addr_hi, <<8, addr_lo, 4], sig_done[OUTSIG]
@@ -950,7 +1477,7 @@ wait_mem_ring1_input#:
 #else /* NFD_USE_MOCKUP */
 
 
-#macro gro_nfd_xmit(in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+#macro gro_nfd_xmit(in_meta, out_xfer, in_meta2, out_xfer2, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
 .begin
     .reg w3
     .reg tmp
@@ -1006,7 +1533,7 @@ wait_mem_ring1_input#:
 #endif /* NFD_USE_MOCKUP */
 
 
-#macro gro_mem_ring_op(MEMOP, in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+#macro gro_mem_ring_op(MEMOP, in_meta, out_xfer, in_meta2, out_xfer2, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
 .begin
     .reg addr_hi
     .reg addr_lo
@@ -1021,6 +1548,64 @@ wait_mem_ring1_input#:
     #if (GRO_META_RINGHI_shf != 24 || GRO_META_RINGHI_msk != 0xFF)
         #error "Ring metadata format changed for addr hi:  optimization will not work"
     #endif
+
+    #if (!streq('TWO_REQ_LABEL', '--') && streq('MEMOP', 'journal'))
+    .begin
+        .reg tmp
+        .reg nw
+        .reg iref
+
+        // Both packets of the buffer go to the same ring with the same
+        // number of words:  put both entries on it with a single journal
+        // command.  The words of the second entry follow those of the
+        // first one in out_xfer/out_xfer2.
+        #define_eval _GRO_H_NINST (_GRO_H_NINST + 29 + _GRO_BATCH_STAT_NINST)
+        br_bclr[CUR_BUF[LM_XBUF_FLAGS_wrd], XBUF_FLAG_TWOPKTS_bit, one_entry#], defer[1]
+        alu[tmp, --, B, in_meta2[0]]
+        alu[tmp, tmp, XOR, in_meta[0]]
+        bne[one_entry#]
+
+        alu[addr_hi, in_meta[GRO_META_RINGHI_wrd], AND, 0xFF, <<24]
+        alu[addr_lo, g_ringlo_mask, AND, in_meta[GRO_META_RINGLO_wrd], >>GRO_META_RINGLO_shf]
+
+        // nw = words per entry - 1, see _gro_override_refcnt()
+        alu[nw, 0xF, AND, LM_DEST_MEM_RING_IREF, >>8]
+        alu[iref, nw, +, 1]
+        alu[iref, LM_DEST_MEM_RING_IREF, +, iref, <<8]
+
+        alu[out_xfer[0], --, B, in_meta[1]]
+        alu[out_xfer[1], --, B, in_meta[2]]
+        alu[out_xfer[2], --, B, in_meta[3]]
+        br=byte[nw, 0, 0, two_1word#]
+        br=byte[nw, 0, 1, two_2word#]
+
+        alu[out_xfer[3], --, B, in_meta2[1]]
+        alu[out_xfer2[0], --, B, in_meta2[2]]
+        alu[out_xfer2[1], --, B, in_meta2[3]]
+        br[two_send#]
+
+    two_2word#:
+        alu[out_xfer[2], --, B, in_meta2[1]]
+        alu[out_xfer[3], --, B, in_meta2[2]]
+        br[two_send#]
+
+    two_1word#:
+        alu[out_xfer[1], --, B, in_meta2[1]]
+
+    two_send#:
+        alu[--, --, B, iref]
+        mem[journal, out_xfer[0], addr_hi, <<8, addr_lo, max_6], sig_done[OUTSIG], indirect_ref
+        _gro_out_batch_stat(in_meta, GRO_OUT_BATCH_CNTR_COALESCED)
+
+        alu[g_sigmask, CUR_BUF[LM_XBUF_SIGMASK_wrd], OR, mask(OUTSIG), <<(&OUTSIG)]
+        local_csr_wr[SAME_ME_SIGNAL, g_sig_next_worker]
+        ctx_arb[--], br[ONE_REQ_LABEL], defer[2]
+        alu[CUR_BUF[LM_XBUF_FLAGS_wrd], --, B, XBUF_FLAG_READY]
+        local_csr_wr[ACTIVE_CTX_WAKEUP_EVENTS, g_sigmask]
+    .end
+    #endif
+
+one_entry#:
     alu[addr_hi, in_meta[GRO_META_RINGHI_wrd], AND, 0xFF, <<24]
 
     alu[addr_lo, g_ringlo_mask, AND, in_meta[GRO_META_RINGLO_wrd], >>GRO_META_RINGLO_shf]
@@ -1053,13 +1638,13 @@ wait_mem_ring1_input#:
 #endm
 
 
-#macro gro_workq_put(in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
-    gro_mem_ring_op(qadd_work, in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+#macro gro_workq_put(in_meta, out_xfer, in_meta2, out_xfer2, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+    gro_mem_ring_op(qadd_work, in_meta, out_xfer, in_meta2, out_xfer2, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
 #endm
 
 
-#macro gro_mem_ring_put(in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
-    gro_mem_ring_op(journal, in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+#macro gro_mem_ring_put(in_meta, out_xfer, in_meta2, out_xfer2, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+    gro_mem_ring_op(journal, in_meta, out_xfer, in_meta2, out_xfer2, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
 #endm
 
 
@@ -1175,7 +1760,7 @@ wait_mem_ring1_input#:
 #endm
 
 
-#macro gro_out_send_one(in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+#macro gro_out_send_one(in_meta, out_xfer, in_meta2, out_xfer2, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
 .begin
     .reg off
     .reg lm_dest_addr
@@ -1184,6 +1769,8 @@ wait_mem_ring1_input#:
         #error "GRO_META_DEST_shf != LM_DEST_shf: Optimization will not work"
     #endif
 
+    _gro_out_batch_stat(in_meta, GRO_OUT_BATCH_CNTR_CMDS)
+
     alu[off, g_handler_mask, AND, in_meta[GRO_META_TYPE_wrd], <<GRO_OUT_HANDLER_shf]
     jump[off, xmit_drop_seq#], defer[3],
         targets[xmit_drop_seq#, xmit_iface#, xmit_nfd#, xmit_workq#, xmit_mem_ring#,
@@ -1203,15 +1790,15 @@ xmit_iface#:
 
 xmit_nfd#:
     ; VERIFY: icount gro_nfd_xmit 64
-    gro_nfd_xmit(in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+    gro_nfd_xmit(in_meta, out_xfer, in_meta2, out_xfer2, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
 
 xmit_workq#:
     ; VERIFY: icount gro_workq_put 64
-    gro_workq_put(in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+    gro_workq_put(in_meta, out_xfer, in_meta2, out_xfer2, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
 
 xmit_mem_ring#:
     ; VERIFY: icount gro_mem_ring_put 64
-    gro_mem_ring_put(in_meta, out_xfer, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
+    gro_mem_ring_put(in_meta, out_xfer, in_meta2, out_xfer2, OUTSIG, CUR_BUF, ONE_REQ_LABEL, TWO_REQ_LABEL)
 
 xmit_drop_ctm_buf#:
     ; VERIFY: icount gro_drop_ctm_buf 64
@@ -1235,6 +1822,10 @@ xmit_drop_mu_buf#:
     .reg volatile g_handler_mask
     .reg volatile g_nbi_seq_incr
     .reg volatile g_nbi_seq_mask
+    #ifdef GRO_OUT_BATCH_STATS
+    .reg volatile g_stats_hi
+    .reg volatile g_stats_iref
+    #endif
     .reg ctx
     .reg next_ctx
     .reg osig
@@ -1248,12 +1839,11 @@ xmit_drop_mu_buf#:
         .xfer_order $meta_/**/__XBUF/**/_0 $meta_/**/__XBUF/**/_1
         .sig volatile insig_/**/__XBUF
 
+        // Contiguous so that two packets can be sent with one command
         .reg volatile write $out_/**/__XBUF/**/_0[GRO_OUT_XMIT_LEN]
-        .xfer_order $out_/**/__XBUF/**/_0
-        .sig volatile outsig_/**/__XBUF/**/_0
-
         .reg volatile write $out_/**/__XBUF/**/_1[GRO_OUT_XMIT_LEN]
-        .xfer_order $out_/**/__XBUF/**/_1
+        .xfer_order $out_/**/__XBUF/**/_0 $out_/**/__XBUF/**/_1
+        .sig volatile outsig_/**/__XBUF/**/_0
         .sig volatile outsig_/**/__XBUF/**/_1
 
         #define_eval __XBUF (__XBUF + 1)
@@ -1284,6 +1874,17 @@ xmit_drop_mu_buf#:
     move(g_nbi_seq_incr, 0x00010000)
     move(g_nbi_seq_mask, 0x3fffffff)
 
+    #ifdef GRO_OUT_BATCH_STATS
+    move(g_stats_hi, ((_gro_out_batch_cntrs +
+                       (GRO_BLOCK_NUM * GRO_OUT_BATCH_BLOCK_SIZE)) >> 8))
+    ; override length  = (1 << 7)
+    ; override dataref = (2 << 3)
+    ; length[2] = 1 for 64-bit operations = (1 << 10)
+    ; length[3] = 1 for to pull operand from dataref = (1 << 11)
+    ; dataref = 1 = (1 << 16)
+    move(g_stats_iref, ((2 << 3) | (1 << 7) | (1 << 10) | (1 << 11) | (1 << 16)))
+    #endif
+
     _gro_out_worker_init_xbufs(ctx, next_ctx, ORDERSIG, $meta_, insig_)
 
 worker_start#:
@@ -1301,12 +1902,14 @@ worker_start#:
         first_req_/**/__XBUF#:
             .set $meta_/**/__XBUF/**/_0[0] $meta_/**/__XBUF/**/_0[1]
             .set $meta_/**/__XBUF/**/_0[2] $meta_/**/__XBUF/**/_0[3]
+            .set $meta_/**/__XBUF/**/_1[0]
             .io_completed outsig_/**/__XBUF/**/_0
             #ifdef GRO_DEBUG
                 alu[@gro_nsent, @gro_nsent, +, 1]
                 local_csr_wr[MAILBOX0, @gro_nsent]
             #endif /* GRO_DEBUG */
             gro_out_send_one($meta_/**/__XBUF/**/_0, $out_/**/__XBUF/**/_0,
+                             $meta_/**/__XBUF/**/_1, $out_/**/__XBUF/**/_1,
                              outsig_/**/__XBUF/**/_0, __CUR_LMPTR,
                              first_req_/**/__XBUF_NXT#,
                              second_req_/**/__XBUF#)
@@ -1320,7 +1923,7 @@ worker_start#:
                 local_csr_wr[MAILBOX0, @gro_nsent]
             #endif /* GRO_DEBUG */
             gro_out_send_one($meta_/**/__XBUF/**/_1, $out_/**/__XBUF/**/_1,
-                             outsig_/**/__XBUF/**/_1, __CUR_LMPTR,
+                             --, --, outsig_/**/__XBUF/**/_1, __CUR_LMPTR,
                              first_req_/**/__XBUF_NXT#, --)
 
 
@@ -1339,6 +1942,10 @@ gro_out_main#:
 
     .sig volatile ordersig
 
+    #if (GRO_WD_TIMEOUT != 0)
+        journal_declare(gro_wd)
+    #endif
+
     #ifdef GRO_DEBUG
         journal_declare(debug)
 
@@ -26,13 +26,85 @@
 
 #define GRO_GLOBAL_CFG_NUM_BLOCKS_wrd           0
 #define GRO_GLOBAL_CFG_CTX_PER_BLOCK_wrd        1
-#define GRO_GLOBAL_CFG_SIZE_LW                  2
+#define GRO_GLOBAL_CFG_FLAGS_wrd                2
+#define GRO_GLOBAL_CFG_SIZE_LW                  3
 #define GRO_GLOBAL_CFG_SIZE                     (GRO_GLOBAL_CFG_SIZE_LW << 2)
 
+/* The GRO.OUT lost sequence watchdog is enabled */
+#define GRO_GLOBAL_CFG_FLAGS_WD_bit             0
+#define GRO_GLOBAL_CFG_FLAGS_WD                 (1 << GRO_GLOBAL_CFG_FLAGS_WD_bit)
+
+/* GRO.OUT keeps the telemetry histograms in _gro_telem */
+#define GRO_GLOBAL_CFG_FLAGS_TELEM_bit          1
+#define GRO_GLOBAL_CFG_FLAGS_TELEM              \
+    (1 << GRO_GLOBAL_CFG_FLAGS_TELEM_bit)
+
+/*
+ * Layout of _gro_telem:  for each context, numbered across all blocks,
+ * one histogram of GRO_TELEM_NBUCKETS 32-bit counters per
+ * GRO_TELEM_HIST_*.  Bucket 0 counts the samples of 0, bucket b the
+ * samples in [2^(b-1), 2^b) and the last bucket every sample from
+ * 2^(GRO_TELEM_NBUCKETS - 2).  Wait samples are in units of
+ * 2^GRO_TELEM_WAIT_shf cycles.
+ */
+#define GRO_TELEM_NBUCKETS                      16
+#define GRO_TELEM_HIST_DEPTH                    0
+#define GRO_TELEM_HIST_WAIT                     1
+#define GRO_TELEM_NUM_HIST                      2
+#define GRO_TELEM_HIST_SIZE                     (GRO_TELEM_NBUCKETS * 4)
+#define GRO_TELEM_CTX_SIZE_shf                  7
+#define GRO_TELEM_CTX_SIZE                      (1 << GRO_TELEM_CTX_SIZE_shf)
+#define GRO_TELEM_WAIT_shf                      8
+
+/* Flow spreading contexts are declared, _gro_flow_tbl is set up */
+#define GRO_GLOBAL_CFG_FLAGS_FLOW_bit           2
+#define GRO_GLOBAL_CFG_FLAGS_FLOW               \
+    (1 << GRO_GLOBAL_CFG_FLAGS_FLOW_bit)
+
+/*
+ * Flow spreading, see gro.uc.  _gro_flow_tbl holds the context, numbered
+ * across all blocks, of each of its GRO_FLOW_TBL_SIZE_LW entries,
+ * _gro_flow_cnt the packets mapped through each entry and _gro_flow_seq
+ * the next sequence number of each context.  The entry of a flow hash is
+ * GRO_FLOW_TBL_IDX(hash).
+ */
+#define GRO_FLOW_TBL_shf                        8
+#define GRO_FLOW_TBL_SIZE_LW                    (1 << GRO_FLOW_TBL_shf)
+#define GRO_FLOW_TBL_SIZE                       (GRO_FLOW_TBL_SIZE_LW << 2)
+#define GRO_FLOW_TBL_msk                        (GRO_FLOW_TBL_SIZE_LW - 1)
+#define GRO_FLOW_HASH_FOLD_shf                  16
+#define GRO_FLOW_TBL_IDX(_hash)                 \
+    (((_hash) ^ ((_hash) >> GRO_FLOW_HASH_FOLD_shf)) & GRO_FLOW_TBL_msk)
+
+/*
+ * An entry that is moving to another context holds GRO_FLOW_ENT_FENCE and
+ * the context it moves to in GRO_FLOW_ENT_NEXT, and once the move may
+ * complete GRO_FLOW_ENT_DRAIN as well.  Clients take bit 0 of the entry's
+ * word of _gro_flow_lock to map through a moving entry.
+ */
+#define GRO_FLOW_ENT_CTX_msk                    0xfff
+#define GRO_FLOW_ENT_NEXT_shf                   16
+#define GRO_FLOW_ENT_NEXT_msk                   0xfff
+#define GRO_FLOW_ENT_DRAIN_bit                  30
+#define GRO_FLOW_ENT_DRAIN                      (1 << GRO_FLOW_ENT_DRAIN_bit)
+#define GRO_FLOW_ENT_FENCE_bit                  31
+#define GRO_FLOW_ENT_FENCE                      0x80000000
+#define GRO_FLOW_ENT_NEXT_of(_ent)              \
+    (((_ent) >> GRO_FLOW_ENT_NEXT_shf) & GRO_FLOW_ENT_NEXT_msk)
+
+/* Cycles a client waits before trying again for a taken lock */
+#define GRO_FLOW_LOCK_BACKOFF                   256
+
 #ifndef __NFP_LANG_ASM
+/*
+ * The topology of the GRO blocks, _gro_global_config.  Contexts are
+ * numbered block by block, context N being context
+ * (N % ctx_per_block) of block (N / ctx_per_block).
+ */
 struct gro_global_config {
     uint32_t num_blocks;
     uint32_t ctx_per_block;
+    uint32_t flags;             /* GRO_GLOBAL_CFG_FLAGS_* */
 };
 #endif /* __NFP_LANG_ASM */
 
@@ -167,6 +239,16 @@ union gro_meta {
 #define GRO_DTYPE_DROP_CTM_BUF          5
 #define GRO_DTYPE_DROP_MU_BUF           6
 
+/*
+ * Word 0 of a queue entry that the GRO.OUT watchdog skipped:
+ * GRO_META_WD_SKIP_SIG | (ticket << GRO_META_WD_SKIP_TICKET_shf), with the
+ * ticket (ticket_seq | epoch << GRO_EPOCH_TICKET_SEQ_shf) of the entry.  A
+ * client that sends the entry late swaps it out to tell a skip from a
+ * duplicate.  It reads as a GRO_DTYPE_DROP_SEQ entry.
+ */
+#define GRO_META_WD_SKIP_SIG            0xA5C00000
+#define GRO_META_WD_SKIP_TICKET_shf     8
+
 #define GRO_META_TYPE_wrd               0
 #define GRO_META_TYPE_shf               0
 #define GRO_META_TYPE_msk               0x7
@@ -296,6 +378,9 @@ union gro_dstcfg {
 #define GRO_REL_VALID_msk               0x1
 #define GRO_REL_VALID_bit               31
 
+/* A release names the context within the block in GRO_REL_CTX */
+#define GRO_MAX_CTX_PER_BLOCK           (GRO_REL_CTX_msk + 1)
+
 #ifndef __NFP_LANG_ASM
 struct gro_release {
     union {
@@ -364,6 +449,45 @@ struct gro_client_ctx {
 #endif /* __NFP_LANG_ASM */
 
 
+/*
+ * The releases that non-blocking sends found no room for on the ingress
+ * ring of their block wait in a queue in the local memory of the client
+ * ME, see NON-BLOCKING SEND in gro.uc.  An entry holds the
+ * GRO_CLICTX_RING word of the context and the release, with the context
+ * numbered across all blocks in place of GRO_REL_CTX.
+ */
+#ifndef GRO_CLI_STAGE_DEPTH
+#define GRO_CLI_STAGE_DEPTH     8
+#endif
+#define GRO_CLI_STAGE_HEAD_wrd  0
+#define GRO_CLI_STAGE_COUNT_wrd 1
+#define GRO_CLI_STAGE_BUSY_wrd  2
+#define GRO_CLI_STAGE_HDR_LW    4
+#define GRO_CLI_STAGE_RING_wrd  0
+#define GRO_CLI_STAGE_REL_wrd   1
+#define GRO_CLI_STAGE_ENT_LW    2
+#define GRO_CLI_STAGE_ENT_shf   3
+#define GRO_CLI_STAGE_CTX_msk   0xFFFF
+#define GRO_CLI_STAGE_SIZE_LW   \
+    (GRO_CLI_STAGE_HDR_LW + (GRO_CLI_STAGE_DEPTH * GRO_CLI_STAGE_ENT_LW))
+#define GRO_CLI_STAGE_SIZE      (GRO_CLI_STAGE_SIZE_LW << 2)
+
+#ifndef __NFP_LANG_ASM
+struct gro_cli_stage_ent {
+    unsigned int ring;
+    unsigned int rel;
+};
+
+struct gro_cli_stage {
+    unsigned int head;          /* Oldest entry */
+    unsigned int count;
+    unsigned int busy;          /* A context is flushing */
+    unsigned int pad;
+    struct gro_cli_stage_ent ent[GRO_CLI_STAGE_DEPTH];
+};
+#endif /* __NFP_LANG_ASM */
+
+
 #define GRO_TICKET_PER_TAPE             64
 #define GRO_SEQSKID_VALUE               65
 #define GRO_TICKET_msk                  0x3F
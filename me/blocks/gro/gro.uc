@@ -64,6 +64,12 @@
  * larger than 65536 entries.  A typical size would probably be around
  * 8192 entries.  This requires a 2K bitmap and 128K of reorder queue memory.
  *
+ * user/tools/gro_model.c models the reorder algorithm on the host.  It
+ * replays a trace of packets, or a synthetic one, and reports the reorder
+ * queue occupancy, the release latency and the number of entries, skid and
+ * release ring depth the trace needed, with "-w" under the lost sequence
+ * watchdog.  "gro_model -T" is its self test.
+ *
  *
  * CLIENT API CALLS
  *
@@ -90,6 +96,14 @@
  *
  * - gro_cli_send() -- Send a GRO release request.
  *
+ * - gro_cli_send_nb() -- Send a GRO release request without waiting for
+ *      room on the ingress ring of the block.
+ *
+ * - gro_cli_flush() -- retry the releases that gro_cli_send_nb() staged.
+ *
+ * - gro_cli_flow_map() -- map a flow hash to a flow spreading context
+ *      and take its next sequence number.
+ *
  *
  * TYPICAL USE
  *
@@ -132,7 +146,10 @@
  * parameters.  The former determines the total number of GRO blocks in
  * the system (and by extension the number of RO.OUT MEs in the system).  The
  * latter parameter determines how many reorder contexts each such block
- * will manage and must be a power of 2.
+ * will manage and must be a power of 2 of at most GRO_MAX_CTX_PER_BLOCK.
+ * Both are published in _gro_global_config, from which microC clients
+ * (me/lib/gro) take them at gro_cli_init() time, so only the GRO blocks
+ * and microcode clients need rebuilding when they change.
  *
  * The structure of gro_config_block() should be roughly as follows:
  *
@@ -164,6 +181,110 @@
  *
  * #endm
  *
+ *
+ * LOST SEQUENCE WATCHDOG
+ *
+ * A sequence number that is never sent, because a client crashed or
+ * forgot to gro_cli_drop_seq() it, would block its reorder context for
+ * good.  The GRO.OUT dispatcher visits one of its contexts every
+ * 2^GRO_WD_INTERVAL_shf timestamp ticks (16 cycles each) and, when the
+ * head sequence number of the context has been missing while later ones
+ * were released for longer than the timeout, releases it itself and sends
+ * nothing for it.  The timeout is 2^GRO_WD_LAT_MUL_shf times the average
+ * time that such holes took to fill by themselves, bounded by
+ * GRO_WD_TIMEOUT and GRO_WD_TIMEOUT_MAX ticks, so it follows the release
+ * latency of the clients under load.  Skips are counted per context in
+ * _gro_wd_cntrs and journalled on the gro_wd journal as
+ * (block << 28) | (context << 24) | queue entry.  The skipped entry is
+ * marked with GRO_META_WD_SKIP, and clients test the ticket tape before
+ * they write an entry, so that a client that sends a skipped sequence
+ * number afterwards neither overwrites an entry that GRO.OUT reads a lap
+ * later nor is taken for a duplicate: it claims the marker, sends
+ * nothing, and the microC gro_cli_send() returns -1 so the caller can
+ * free the packet.  A duplicate, which finds no marker, still aborts.
+ * That test costs clients an extra atomic read per packet.  A client
+ * that passes the test just before the skip writes an entry that is
+ * stepped over, and reused only a lap later.  GRO_WD_TIMEOUT 0 disables
+ * the watchdog.
+ *
+ *
+ * TELEMETRY
+ *
+ * On the same visits, the GRO.OUT dispatcher samples two histograms per
+ * context in _gro_telem (see GRO_TELEM_* in gro.h):  the depth of the
+ * context, the entries that its clients enqueued whose tickets are not
+ * released yet, and the head-of-line wait, the time for which the head
+ * sequence number has held such entries back.  A sample costs a read of
+ * the client counters and two atomic increments, every
+ * 2^GRO_WD_INTERVAL_shf ticks for the block.  The histograms of all
+ * the contexts are read at once by user/tools/gro_stat.  GRO_TELEM 0
+ * disables them, and the visits too if the watchdog is disabled.
+ *
+ *
+ * FLOW SPREADING
+ *
+ * Reorder contexts usually map 1:1 to NBI sequencers, so that one busy
+ * port loads a single GRO.OUT ME.  When GRO_FLOW_CTX_PER_BLOCK is
+ * #defined, contexts GRO_FLOW_CTX_FIRST to GRO_FLOW_CTX_FIRST +
+ * GRO_FLOW_CTX_PER_BLOCK - 1 of every block are flow spreading contexts
+ * instead, which gro_config_block() must declare.  A client maps a hash
+ * of the flow key to one of them with gro_cli_flow_map(), through the
+ * GRO_FLOW_TBL_SIZE_LW entries of _gro_flow_tbl, initially dealt round
+ * robin over the blocks, and takes the sequence number from a counter per
+ * context in _gro_flow_seq.  gro_cli_flow_map() also counts the packets
+ * of each entry in _gro_flow_cnt.  The packets of a flow keep their order
+ * provided they are mapped in that order, e.g. in a single thread or in a
+ * critical section ordered by their NBI sequence numbers, and every
+ * sequence number taken must be sent or dropped.
+ *
+ * "gro_stat -r" rebalances the table on the load of the blocks and
+ * entries measured over an interval.  It does not move an entry from the
+ * busiest block to the least busy one at once, which would let the next
+ * packets of its flows overtake those still waiting in the old context:
+ * it fences the entry with GRO_FLOW_ENT_FENCE and the context it moves
+ * to, and at its next run, at least an interval later, sets
+ * GRO_FLOW_ENT_DRAIN.  Clients map through a fenced entry one at a time,
+ * under the entry's lock in _gro_flow_lock, and keep mapping to the old
+ * context until, with GRO_FLOW_ENT_DRAIN set, one of them finds that the
+ * old context has released every sequence number taken from it.  That
+ * client rewrites the entry to the new context and maps to it.  The
+ * interval covers the clients that read the entry before it was fenced
+ * and have yet to take their sequence numbers.  A busy old context may
+ * take a while to drain; the entry moves when it does.
+ * user/tools/gro_flow_model.c models the load of the blocks on the host.
+ *
+ *
+ * RELEASE BATCHING
+ *
+ * The GRO.OUT dispatcher hands the workers up to two consecutive released
+ * packets at a time.  When both go to the same NFD ring, or to the same
+ * EMEM ring with the same number of words, the worker puts them on it
+ * with one mem[journal] command rather than two.  NBI sends need no
+ * signal and are already issued back to back; work queue adds are never
+ * combined.  When GRO_OUT_BATCH_STATS is #defined each block counts, per
+ * destination type and index (bits 0-6 of word 0 of the metadata), the
+ * commands it issued and the packets that rode along in another packet's
+ * command, in _gro_out_batch_cntrs.  The average batch size for a
+ * destination is (commands + coalesced) / commands:  see grobatch.sh.
+ *
+ *
+ * NON-BLOCKING SEND
+ *
+ * gro_cli_send() waits for room on the ingress ring of the block for each
+ * release message it puts.  gro_cli_send_nb() puts it once and, if the
+ * ring is full, stages it instead in a queue of GRO_CLI_STAGE_DEPTH
+ * entries in the local memory of the client ME, gro_cli_stage, shared by
+ * its contexts.  The queue is retried, oldest first, at the start of the
+ * next gro_cli_send_nb() and by gro_cli_flush(), which a context with
+ * nothing else to do should call.  When the queue is still full
+ * gro_cli_send_nb() does nothing and branches to its BUSY_LABEL (the C
+ * client returns GRO_CLI_SEND_BUSY), so the caller can defer the packet
+ * and work on others.  A release message only grants GRO.OUT the next
+ * entries of the context, so the staged messages may reach the ring after
+ * later ones without reordering packets.  The packets of a staged message
+ * count as enqueued but not released until it reaches the ring.  The
+ * ticket error retries of a send that runs into the skid still wait.
+ *
  */
 
 #include <nfp_chipres.h>
@@ -193,6 +314,10 @@
 #error GRO_CTX_PER_BLOCK must be a power of 2
 #endif
 
+#if (GRO_CTX_PER_BLOCK > GRO_MAX_CTX_PER_BLOCK)
+#error "GRO_CTX_PER_BLOCK must be at most GRO_MAX_CTX_PER_BLOCK"
+#endif
+
 #define GRO_CTX_BLOCK_MASK (GRO_CTX_PER_BLOCK-1)
 
 #define GRO_TOTAL_CTX (GRO_NUM_BLOCKS * GRO_CTX_PER_BLOCK)
@@ -205,67 +330,108 @@
  */
 #define GRO_SEQ_OVERFLOW_TICKS      (2560 / 16)
 
-#macro gro_declare_block(BLOCKNUM)
+/*
+ * Lost sequence watchdog parameters, in timestamp ticks of 16 cycles.
+ * The default timeout is ~1ms at 1.2GHz.
+ */
+#ifndef GRO_WD_TIMEOUT
+#define GRO_WD_TIMEOUT              75000
+#endif
+
+#ifndef GRO_WD_TIMEOUT_MAX
+#define GRO_WD_TIMEOUT_MAX          (GRO_WD_TIMEOUT * 16)
+#endif
+
+#ifndef GRO_WD_INTERVAL_shf
+#define GRO_WD_INTERVAL_shf         8
+#endif
+
+#ifndef GRO_WD_LAT_MUL_shf
+#define GRO_WD_LAT_MUL_shf          3
+#endif
+
+/* Weight of a new hole duration in the average, 1/8 */
+#define GRO_WD_LAT_AVG_shf          3
 
-    #if (GRO_NUM_BLOCKS > 8)
-        #error "Currently, only 8 global reorder blocks supported"
+#ifndef GRO_TELEM
+#define GRO_TELEM                   1
+#endif
+
+#if (GRO_TELEM != 0)
+    #define GRO_TELEM_FLAGS         GRO_GLOBAL_CFG_FLAGS_TELEM
+#else
+    #define GRO_TELEM_FLAGS         0
+#endif
+
+#ifndef GRO_FLOW_CTX_PER_BLOCK
+#define GRO_FLOW_CTX_PER_BLOCK      0
+#endif
+
+#ifndef GRO_FLOW_CTX_FIRST
+#define GRO_FLOW_CTX_FIRST          0
+#endif
+
+#if ((GRO_CLI_STAGE_DEPTH & (GRO_CLI_STAGE_DEPTH - 1)) != 0)
+    #error "GRO_CLI_STAGE_DEPTH must be a power of 2"
+#endif
+
+#if (GRO_FLOW_CTX_PER_BLOCK != 0)
+    #if (GRO_FLOW_CTX_FIRST + GRO_FLOW_CTX_PER_BLOCK > GRO_CTX_PER_BLOCK)
+        #error "The flow spreading contexts must be within GRO_CTX_PER_BLOCK"
     #endif
-    #if (__nfp_has_island(25) && __nfp_has_island(26))
-        #define gro_release_mem_0 emem0
-        #define gro_release_isl_0 24
-        #define gro_release_mem_1 emem1
-        #define gro_release_isl_1 25
-        #define gro_release_mem_2 emem2
-        #define gro_release_isl_2 26
-        #define gro_release_mem_3 emem0
-        #define gro_release_isl_3 24
-        #define gro_release_mem_4 emem1
-        #define gro_release_isl_4 25
-        #define gro_release_mem_5 emem2
-        #define gro_release_isl_5 26
-        #define gro_release_mem_6 emem0
-        #define gro_release_isl_6 24
-        #define gro_release_mem_7 emem1
-        #define gro_release_isl_7 25
-    #elif (__nfp_has_island(25))
-        #define gro_release_mem_0 emem0
-        #define gro_release_isl_0 24
-        #define gro_release_mem_1 emem1
-        #define gro_release_isl_1 25
-        #define gro_release_mem_2 emem0
-        #define gro_release_isl_2 24
-        #define gro_release_mem_3 emem1
-        #define gro_release_isl_3 25
-        #define gro_release_mem_4 emem0
-        #define gro_release_isl_4 24
-        #define gro_release_mem_5 emem1
-        #define gro_release_isl_5 25
-        #define gro_release_mem_6 emem0
-        #define gro_release_isl_6 24
-        #define gro_release_mem_7 emem1
-        #define gro_release_isl_7 25
-    #else
-        #define gro_release_mem_0 emem0
-        #define gro_release_isl_0 24
-        #define gro_release_mem_1 emem0
-        #define gro_release_isl_1 24
-        #define gro_release_mem_2 emem0
-        #define gro_release_isl_2 24
-        #define gro_release_mem_3 emem0
-        #define gro_release_isl_3 24
-        #define gro_release_mem_4 emem0
-        #define gro_release_isl_4 24
-        #define gro_release_mem_5 emem0
-        #define gro_release_isl_5 24
-        #define gro_release_mem_6 emem0
-        #define gro_release_isl_6 24
-        #define gro_release_mem_7 emem0
-        #define gro_release_isl_7 24
+    #define GRO_FLOW_FLAGS          GRO_GLOBAL_CFG_FLAGS_FLOW
+#else
+    #define GRO_FLOW_FLAGS          0
+#endif
+
+/* The dispatcher visits its contexts for the watchdog or telemetry */
+#if (GRO_WD_TIMEOUT != 0 || GRO_TELEM != 0)
+    #define GRO_OUT_VISIT           1
+#else
+    #define GRO_OUT_VISIT           0
+#endif
+
+#if (GRO_WD_TIMEOUT != 0)
+    #if (GRO_WD_TIMEOUT_MAX < GRO_WD_TIMEOUT || GRO_WD_TIMEOUT_MAX >= (1 << 30))
+        #error "GRO_WD_TIMEOUT_MAX must be at least GRO_WD_TIMEOUT and below 2^30"
     #endif
+    #define GRO_WD_FLAGS            GRO_GLOBAL_CFG_FLAGS_WD
+#else
+    #define GRO_WD_FLAGS            0
+#endif
+
+/*
+ * Per destination release batching counters, 64 bits each, when
+ * GRO_OUT_BATCH_STATS is #defined.
+ */
+#define GRO_OUT_BATCH_CNTR_CMDS         0
+#define GRO_OUT_BATCH_CNTR_COALESCED    8
+#define GRO_OUT_BATCH_SLOT_shf          4
+#define GRO_OUT_BATCH_SLOT_msk          0x7F
+#define GRO_OUT_BATCH_BLOCK_SIZE        \
+    ((GRO_OUT_BATCH_SLOT_msk + 1) << GRO_OUT_BATCH_SLOT_shf)
+
+/*
+ * The release ring of each block is in an EMEM, spread round robin over
+ * those on the chip, so there is no limit on the number of blocks.
+ */
+#if (__nfp_has_island(25) && __nfp_has_island(26))
+    #define GRO_RELEASE_NUM_EMEM    3
+#elif (__nfp_has_island(25))
+    #define GRO_RELEASE_NUM_EMEM    2
+#else
+    #define GRO_RELEASE_NUM_EMEM    1
+#endif
+
+#define GRO_RELEASE_ISL(BLOCKNUM)   (24 + ((BLOCKNUM) % GRO_RELEASE_NUM_EMEM))
 
-    #define_eval __MEM 'gro_release_mem_/**/BLOCKNUM'
+#macro gro_declare_block(BLOCKNUM)
+
+    #define_eval __EMEM (BLOCKNUM % GRO_RELEASE_NUM_EMEM)
+    #define_eval __MEM 'emem/**/__EMEM'
     #define_eval __QRES '__MEM/**/_queues'
     .alloc_resource gro_release_ring_/**/BLOCKNUM __QRES global 1
+    #undef __EMEM
     #undef __MEM
     #undef __QRES
 
@@ -281,10 +447,46 @@
 
     .init _gro_global_config+0 GRO_NUM_BLOCKS
     .init _gro_global_config+4 GRO_CTX_PER_BLOCK
+    .init _gro_global_config+8 (GRO_WD_FLAGS | GRO_TELEM_FLAGS | GRO_FLOW_FLAGS)
 
     .alloc_mem _gro_cli_cntrs GRO_CNTR_MEM_UC global \
         (GRO_TOTAL_CTX * 16) 256
 
+    // Lost sequence watchdog skips, 64 bits per context
+    .alloc_mem _gro_wd_cntrs GRO_CNTR_MEM_UC global \
+        (GRO_TOTAL_CTX * 8) 256
+
+    #if (GRO_TELEM != 0)
+    .alloc_mem _gro_telem emem global \
+        (GRO_TOTAL_CTX * GRO_TELEM_CTX_SIZE) 256
+    #endif
+
+    .alloc_mem _gro_flow_tbl emem global GRO_FLOW_TBL_SIZE GRO_FLOW_TBL_SIZE
+    .alloc_mem _gro_flow_cnt emem global GRO_FLOW_TBL_SIZE 256
+    .alloc_mem _gro_flow_seq emem global (GRO_TOTAL_CTX * 4) 256
+    .alloc_mem _gro_flow_lock emem global GRO_FLOW_TBL_SIZE 256
+
+    // Deal the table entries of this block's flow spreading contexts
+    #if (GRO_FLOW_CTX_PER_BLOCK != 0)
+        #define_eval __FLOW_ENT BLOCKNUM
+        #while (__FLOW_ENT < GRO_FLOW_TBL_SIZE_LW)
+            #define_eval __FLOW_CTX ((BLOCKNUM * GRO_CTX_PER_BLOCK) + \
+                GRO_FLOW_CTX_FIRST + \
+                ((__FLOW_ENT / GRO_NUM_BLOCKS) % GRO_FLOW_CTX_PER_BLOCK))
+            #define_eval __FLOW_ADDR (__FLOW_ENT * 4)
+            .init _gro_flow_tbl+__FLOW_ADDR __FLOW_CTX
+            #define_eval __FLOW_ENT (__FLOW_ENT + GRO_NUM_BLOCKS)
+        #endloop
+        #undef __FLOW_ENT
+        #undef __FLOW_CTX
+        #undef __FLOW_ADDR
+    #endif
+
+    #ifdef GRO_OUT_BATCH_STATS
+    .alloc_mem _gro_out_batch_cntrs GRO_CNTR_MEM_UC global \
+        (GRO_NUM_BLOCKS * GRO_OUT_BATCH_BLOCK_SIZE) 256
+    #endif
+
 #endm
 
 
@@ -394,11 +596,15 @@
 
         #if (streq('CALLER', 'GRO_OUT'))
 
+            /* Next sequence number for gro_cli_flow_map() */
+            #define_eval __CFGADDR  (CTXNUM * 4)
+            .init _gro_flow_seq+__CFGADDR ISEQ
+
             /* Global Config */
             #define_eval __CFGADDR      (((BLOCKNUM * GRO_CTX_PER_BLOCK) + __BCTX) * GRO_CLICTX_SIZE)
             .init _gro_ctxcfg+__CFGADDR \
                 (((gro_release_ring_/**/BLOCKNUM & GRO_CLICTX_RING_LO_msk) << GRO_CLICTX_RING_LO_shf) |\
-                 (((gro_release_isl_/**/BLOCKNUM | 0x80) & GRO_CLICTX_RING_HI_msk) << GRO_CLICTX_RING_HI_shf))
+                 (((GRO_RELEASE_ISL(BLOCKNUM) | 0x80) & GRO_CLICTX_RING_HI_msk) << GRO_CLICTX_RING_HI_shf))
 
             #define_eval __CFGADDR (__CFGADDR + 4)
             .init _gro_ctxcfg+__CFGADDR    \
@@ -476,36 +682,78 @@
                 (((_gro_bm_/**/BLOCKNUM/**/_/**/__BCTX) & 0xFFFFFFFF) +
                  (NUMENT / GRO_TICKET_PER_TAPE * GRO_TICKET_TAPE_SIZE))
 
+            /* WD_HEAD */
+            #define_eval __CFGADDR (__CFGADDR + 4)
+            .init gro_out_lm_ctx+__CFGADDR \
+                ((_gro_q_/**/BLOCKNUM/**/_/**/__BCTX & 0xFFFFFFFF) + \
+                 (ISEQ * GRO_META_SIZE))
+
+            /* WD_TS */
+            #define_eval __CFGADDR (__CFGADDR + 4)
+            .init gro_out_lm_ctx+__CFGADDR 0
+
+            /* WD_LAT */
+            #define_eval __CFGADDR (__CFGADDR + 4)
+            .init gro_out_lm_ctx+__CFGADDR 0
+
+            /* TM_HEAD */
+            #define_eval __CFGADDR (__CFGADDR + 4)
+            .init gro_out_lm_ctx+__CFGADDR \
+                ((_gro_q_/**/BLOCKNUM/**/_/**/__BCTX & 0xFFFFFFFF) + \
+                 (ISEQ * GRO_META_SIZE))
+
+            /* TM_TS */
+            #define_eval __CFGADDR (__CFGADDR + 4)
+            .init gro_out_lm_ctx+__CFGADDR 0
+
 
             /* GRO bitmap initialization */
             #define_eval __BMOFF 0
             #define_eval __BMEND ((NUMENT / 64) * 16)
+            #define_eval __ITAPE (ISEQ / 64)
             #define_eval __IEPOCH (ISEQ / NUMENT % 8)
             #if (__IEPOCH > 0)
                 #define_eval __IEPOCH_MINUS1 (GRO_NUM_EPOCHS - 1)
             #else
                 #define_eval __IEPOCH_MINUS1 ((__IEPOCH - 1) & GRO_EPOCH_msk)
             #endif
+            #define_eval __IEPOCH_PLUS1 ((__IEPOCH + 1) & GRO_EPOCH_msk)
             #while (__BMOFF < __BMEND)
 
+                #define_eval __TAPE (__BMOFF / 16)
+
                 // NFP6xxx Databook 9.2.2.1.2.10
                 // First word contains the sequence number in the top 10 bits.
                 // Start all ticket tapes at sequence 0 except for the first
-                // tape which should start at sequence number 1.
-                #if (__BMOFF == (ISEQ/64))
+                // tape which should start at sequence number 1.  The tapes
+                // before the initial one are next used after the sequence
+                // wraps, in the next epoch.
+                #if (__TAPE == __ITAPE)
 
                     // Initial tape
                     .init _gro_bm_/**/BLOCKNUM/**/_/**/__BCTX+__BMOFF (((ISEQ % 64) + 1) + (__IEPOCH * GRO_EPOCH_TICKET_SEQ_mul))
                     // XXX IMPLIED 0x00000000 0x00000000 0x00000000
 
+                #elif ((SKIDLEN > 0) && (__TAPE < __ITAPE) && \
+                       ((__ITAPE < SKIDLEN/64) || (__TAPE >= (__ITAPE - SKIDLEN/64))))
+
+                    // In the tape skid, reset for the next epoch
+                    .init _gro_bm_/**/BLOCKNUM/**/_/**/__BCTX+__BMOFF (GRO_SEQSKID_VALUE | (__IEPOCH * GRO_EPOCH_TICKET_SEQ_mul))
+                    // XXX IMPLIED 0x00000000 0x00000000 0x00000000
+
                 #elif ((SKIDLEN > 0) && \
-                       ((__BMOFF < (ISEQ/64*16) && ((ISEQ/64 < SKIDLEN/64) || (__BMOFF >= (ISEQ/64 - SKIDLEN/64)*16))) || \
-                        ((ISEQ/64*64 + __SKIDOFF < NUMENT) && (__BMOFF >= (ISEQ/64 + __SKIDOFF/64)*16))))
+                       ((__ITAPE*64 + __SKIDOFF < NUMENT) && (__TAPE >= (__ITAPE + __SKIDOFF/64))))
 
                     // In the tape skid
                     .init _gro_bm_/**/BLOCKNUM/**/_/**/__BCTX+__BMOFF (GRO_SEQSKID_VALUE | (__IEPOCH_MINUS1 * GRO_EPOCH_TICKET_SEQ_mul))
                     // XXX IMPLIED 0x00000000 0x00000000 0x00000000
 
+                #elif (__TAPE < __ITAPE)
+
+                    // Not in the tape skid, used after the wrap
+                    .init _gro_bm_/**/BLOCKNUM/**/_/**/__BCTX+__BMOFF (__IEPOCH_PLUS1 * GRO_EPOCH_TICKET_SEQ_mul)
+                    // XXX IMPLIED 0x00000000 0x00000000 0x00000000
+
                 #elif (__IEPOCH != 0)
 
                     // Not in the tape skid, but initial epoch non-zero
@@ -522,6 +770,9 @@
                 #define_eval __BMOFF (__BMOFF + 16)
             #endloop
 
+            #undef __TAPE
+            #undef __ITAPE
+            #undef __IEPOCH_PLUS1
             #undef __IEPOCH
             #undef __IEPOCH_MINUS1
             #undef __BMOFF
@@ -534,7 +785,7 @@
             #define_eval __CFGADDR  (((BLOCKNUM * GRO_CTX_PER_BLOCK) + __BCTX) * GRO_CLICTX_SIZE)
             .init gro_cli_lm_ctx+__CFGADDR \
                 (((gro_release_ring_/**/BLOCKNUM & GRO_CLICTX_RING_LO_msk) << GRO_CLICTX_RING_LO_shf) |\
-                 (((gro_release_isl_/**/BLOCKNUM | 0x80)& GRO_CLICTX_RING_HI_msk) << GRO_CLICTX_RING_HI_shf))
+                 (((GRO_RELEASE_ISL(BLOCKNUM) | 0x80) & GRO_CLICTX_RING_HI_msk) << GRO_CLICTX_RING_HI_shf))
 
             #define_eval __CFGADDR (__CFGADDR + 4)
             .init gro_cli_lm_ctx+__CFGADDR \
@@ -698,6 +949,9 @@
     .alloc_mem gro_cli_lm_ctx lmem me (GRO_CLICTX_SIZE * GRO_TOTAL_CTX) \
         GRO_CLP2(GRO_CLICTX_SIZE * GRO_TOTAL_CTX)
 
+    .alloc_mem gro_cli_stage lmem me GRO_CLI_STAGE_SIZE \
+        GRO_CLP2(GRO_CLI_STAGE_SIZE)
+
     #define_eval __BLOCK 0
     #while (__BLOCK < GRO_NUM_BLOCKS)
 
@@ -712,6 +966,14 @@
 
 
 #macro _gro_cli_init(WAIT)
+    // Empty the staging queue of gro_cli_send_nb()
+    _gro_cli_stage_lm(0)
+    nop
+    nop
+    nop
+    alu[*l$index0[GRO_CLI_STAGE_HEAD_wrd], --, B, 0]
+    alu[*l$index0[GRO_CLI_STAGE_COUNT_wrd], --, B, 0]
+    alu[*l$index0[GRO_CLI_STAGE_BUSY_wrd], --, B, 0]
 #endm
 
 
@@ -720,7 +982,7 @@
  * be ready.  An ME should call this once at initialization
  * time within an ME and only within a single thread.  The ME MUST
  * invoke this call before calling any gro_nbi_send*() or
- * gro_nbi_drop_seq() calls.
+ * gro_nbi_drop_seq() calls.  This call uses local memory pointer 0.
  */
 #macro gro_cli_init()
     _gro_cli_init(1)
@@ -841,6 +1103,64 @@ again#:
 #endm
 
 
+/*
+ * As _gro_cli_release(), but stage the release if the ingress ring is
+ * full, unless the staging queue filled up since gro_cli_send_nb()
+ * checked it.  The client context in_clictx is read through LMPTR, which
+ * points back at it on return.
+ */
+#macro _gro_cli_release_nb(in_clictx, in_ctx, in_nrel, LMPTR)
+.begin
+    .reg ring
+    .reg addr_lo
+    .reg addr_hi
+    .reg tmp
+
+    .reg $gro_release
+    .sig release_sig
+
+    // leave addr_hi in place: don't shift
+    alu[ring, --, B, in_clictx[GRO_CLICTX_RING_HI_wrd]]
+    alu[addr_hi, ring, AND, GRO_CLICTX_RING_HI_msk, <<GRO_CLICTX_RING_HI_shf]
+    alu[addr_lo, ring, AND~, GRO_CLICTX_RING_HI_msk, <<GRO_CLICTX_RING_HI_shf]
+
+    #if (is_ct_const(in_ctx))
+        move(tmp, (in_ctx & (GRO_CTX_PER_BLOCK-1)))
+    #else
+        alu[tmp, in_ctx, AND, (GRO_CTX_PER_BLOCK-1)]
+    #endif
+    alu[tmp, tmp, OR, in_nrel, <<GRO_REL_NREL_shf]
+    alu[$gro_release, tmp, OR, 1, <<GRO_REL_VALID_bit]
+
+    mem[put, $gro_release, addr_hi, <<8, addr_lo, 1], sig_done[release_sig]
+    ctx_arb[release_sig]
+    br_bset[$gro_release, GRO_REL_VALID_bit, released#]
+
+    // The ring is full:  stage the release
+    _gro_cli_stage_push(ring, in_ctx, in_nrel, LMPTR, wait#)
+    br[restore#]
+
+wait#:
+    mem[put, $gro_release, addr_hi, <<8, addr_lo, 1], sig_done[release_sig]
+    ctx_arb[release_sig]
+    br_bclr[$gro_release, GRO_REL_VALID_bit, wait#]
+    _gro_cli_cntr_released_add(in_ctx, in_nrel)
+
+restore#:
+    _gro_cli_load_lm_ctx(in_ctx, LMPTR)
+    nop
+    nop
+    nop
+    br[done#]
+
+released#:
+    _gro_cli_cntr_released_add(in_ctx, in_nrel)
+
+done#:
+.end
+#endm
+
+
 #macro _gro_cli_reset_tape(in_clictx, in_ticket_tape, in_tape_xfer, TAPESIG)
 .begin
 
@@ -871,7 +1191,151 @@ again#:
 #endm
 
 
-#macro _gro_cli_test_ticket_error(in_addr_hi, in_addr_lo, in_ticket_seq, in_epoch, ERROR_LABEL)
+/*
+ * Point local memory pointer LMPTR at the staging queue header, or at
+ * entry in_idx of the queue.
+ *
+ * Need to wait 3 cycles between issuing these calls and using the data.
+ */
+#macro _gro_cli_stage_lm(LMPTR)
+.begin
+    .reg lma
+    immed[lma, gro_cli_stage]
+    local_csr_wr[ACTIVE_LM_ADDR_/**/LMPTR, lma]
+.end
+#endm
+
+
+#macro _gro_cli_stage_lm(in_idx, LMPTR)
+.begin
+    .reg lma
+    immed[lma, gro_cli_stage]
+    alu[lma, lma, +, (GRO_CLI_STAGE_HDR_LW << 2)]
+    alu[lma, lma, +, in_idx, <<GRO_CLI_STAGE_ENT_shf]
+    local_csr_wr[ACTIVE_LM_ADDR_/**/LMPTR, lma]
+.end
+#endm
+
+
+/*
+ * Stage a release that found the ingress ring full, or branch to
+ * FULL_LABEL if the staging queue is full too.  There is no context swap
+ * between the test and the update of the queue.  Leaves LMPTR pointing
+ * into the queue.
+ */
+#macro _gro_cli_stage_push(in_ring, in_ctx, in_nrel, LMPTR, FULL_LABEL)
+.begin
+    .reg count
+    .reg idx
+    .reg rel
+
+    _gro_cli_stage_lm(LMPTR)
+    #if (is_ct_const(in_ctx))
+        move(rel, in_ctx)
+        alu[rel, rel, OR, in_nrel, <<GRO_REL_NREL_shf]
+    #else
+        alu[rel, in_ctx, OR, in_nrel, <<GRO_REL_NREL_shf]
+        nop
+    #endif
+    nop
+
+    alu[count, --, B, *l$index/**/LMPTR[GRO_CLI_STAGE_COUNT_wrd]]
+    alu[--, count, -, GRO_CLI_STAGE_DEPTH]
+    bge[FULL_LABEL]
+    alu[idx, count, +, *l$index/**/LMPTR[GRO_CLI_STAGE_HEAD_wrd]]
+    alu[*l$index/**/LMPTR[GRO_CLI_STAGE_COUNT_wrd], count, +, 1]
+    alu[idx, idx, AND, (GRO_CLI_STAGE_DEPTH - 1)]
+
+    _gro_cli_stage_lm(idx, LMPTR)
+    nop
+    nop
+    nop
+    alu[*l$index/**/LMPTR[GRO_CLI_STAGE_RING_wrd], --, B, in_ring]
+    alu[*l$index/**/LMPTR[GRO_CLI_STAGE_REL_wrd], --, B, rel]
+.end
+#endm
+
+
+/*
+ * Retry the staged releases, oldest first, until one finds its ingress
+ * ring still full, and return the number still staged in out_count.
+ * One context flushes at a time, the others only add entries.  Uses
+ * local memory pointer LMPTR.
+ */
+#macro _gro_cli_stage_flush(out_count, LMPTR)
+.begin
+    .reg head
+    .reg ring
+    .reg rel
+    .reg nrel
+    .reg gctx
+    .reg addr_hi
+    .reg addr_lo
+    .reg tmp
+
+    .reg $gro_release
+    .sig release_sig
+
+    _gro_cli_stage_lm(LMPTR)
+    nop
+    nop
+    nop
+    alu[out_count, --, B, *l$index/**/LMPTR[GRO_CLI_STAGE_COUNT_wrd]]
+    beq[done#]
+    alu[--, --, B, *l$index/**/LMPTR[GRO_CLI_STAGE_BUSY_wrd]]
+    bne[done#]
+    alu[*l$index/**/LMPTR[GRO_CLI_STAGE_BUSY_wrd], --, B, 1]
+
+next#:
+    alu[head, --, B, *l$index/**/LMPTR[GRO_CLI_STAGE_HEAD_wrd]]
+    _gro_cli_stage_lm(head, LMPTR)
+    nop
+    nop
+    nop
+    alu[ring, --, B, *l$index/**/LMPTR[GRO_CLI_STAGE_RING_wrd]]
+    alu[rel, --, B, *l$index/**/LMPTR[GRO_CLI_STAGE_REL_wrd]]
+
+    // leave addr_hi in place: don't shift
+    alu[addr_hi, ring, AND, GRO_CLICTX_RING_HI_msk, <<GRO_CLICTX_RING_HI_shf]
+    alu[addr_lo, ring, AND~, GRO_CLICTX_RING_HI_msk, <<GRO_CLICTX_RING_HI_shf]
+    alu[gctx, rel, AND~, GRO_REL_NREL_msk, <<GRO_REL_NREL_shf]
+    alu[nrel, --, B, rel, >>GRO_REL_NREL_shf]
+    alu[tmp, gctx, AND, (GRO_CTX_PER_BLOCK - 1)]
+    alu[tmp, tmp, OR, nrel, <<GRO_REL_NREL_shf]
+    alu[$gro_release, tmp, OR, 1, <<GRO_REL_VALID_bit]
+    mem[put, $gro_release, addr_hi, <<8, addr_lo, 1], sig_done[release_sig]
+    ctx_arb[release_sig]
+    br_bclr[$gro_release, GRO_REL_VALID_bit, still_full#]
+
+    _gro_cli_cntr_released_add(gctx, nrel)
+
+    // Other contexts may have added entries meanwhile
+    _gro_cli_stage_lm(LMPTR)
+    alu[head, head, +, 1]
+    alu[head, head, AND, (GRO_CLI_STAGE_DEPTH - 1)]
+    nop
+    alu[*l$index/**/LMPTR[GRO_CLI_STAGE_HEAD_wrd], --, B, head]
+    alu[out_count, *l$index/**/LMPTR[GRO_CLI_STAGE_COUNT_wrd], -, 1]
+    alu[*l$index/**/LMPTR[GRO_CLI_STAGE_COUNT_wrd], --, B, out_count]
+    bne[next#]
+    br[idle#]
+
+still_full#:
+    _gro_cli_stage_lm(LMPTR)
+    nop
+    nop
+    nop
+    alu[out_count, --, B, *l$index/**/LMPTR[GRO_CLI_STAGE_COUNT_wrd]]
+
+idle#:
+    alu[*l$index/**/LMPTR[GRO_CLI_STAGE_BUSY_wrd], --, B, 0]
+
+done#:
+.end
+#endm
+
+
+#macro _gro_cli_test_ticket_error(in_addr_hi, in_addr_lo, in_ticket_seq, in_epoch, LATE_LABEL, ERROR_LABEL)
 .begin
 
     .reg skid_marker
@@ -895,10 +1359,11 @@ again#:
     alu[--, $tape[0], -, skid_marker]
     beq[no_error#]
 
-    // Otherwise if we are not in the same epoch, its definitely an error
+    // Otherwise if we are not in the same epoch, its definitely an error,
+    // or the watchdog skipped the ticket
     alu[tape_epoch, GRO_EPOCH_msk, AND, $tape[0], >>GRO_EPOCH_TICKET_SEQ_shf]
     alu[--, in_epoch, -, tape_epoch]
-    bne[ERROR_LABEL]
+    bne[LATE_LABEL]
 
     // If the ticket seq equals the tape seq, then the bitmap was just
     // de-skidded ... no error
@@ -907,8 +1372,8 @@ again#:
     beq[no_error#]
 
     // If the ticket seq is less than the tape seq, then it's definitely
-    // a duplicate.
-    blt[ERROR_LABEL]
+    // a duplicate, or the watchdog skipped the ticket.
+    blt[LATE_LABEL]
 
     // So we have:  tape_epoch == epoch && in_seq > tape_seq
     // We need to test to see if the bit for this seq is set in the bitmask.
@@ -931,7 +1396,7 @@ no_error#:
 #endm
 
 
-#macro _gro_cli_test_cascade_error(in_addr_hi, in_addr_lo, in_epoch, ERROR_LABEL)
+#macro _gro_cli_test_cascade_error(in_addr_hi, in_addr_lo, in_epoch, LATE_LABEL)
 .begin
 
     .reg skid_marker
@@ -950,17 +1415,68 @@ no_error#:
     alu[--, $tape_seq, -, skid_marker]
     beq[no_error#]
 
-    // If the tape is anything other than freshly reset for us: error
+    // If the tape is anything other than freshly reset for us: error,
+    // or the watchdog released the ticket for us
     alu[skid_marker, 0, OR, in_epoch, <<GRO_EPOCH_TICKET_SEQ_shf]
     alu[--, $tape_seq, -, skid_marker]
-    bne[ERROR_LABEL]
+    bne[LATE_LABEL]
 
 no_error#:
 .end
 #endm
 
 
-#macro _gro_cli_send(in_ctx, in_seq, in_meta, META_SIZE_LW, LMPTR)
+/*
+ * With the watchdog enabled, test before writing the queue entry at
+ * in_addr_hi/in_addr_lo whether the tape at in_bm_addr_hi/in_bm_addr_lo
+ * already passed its ticket.  If it did, claim the GRO_META_WD_SKIP
+ * marker of the entry and go to SKIPPED_LABEL, or to ERROR_LABEL for a
+ * duplicate, which finds no marker.
+ */
+#macro _gro_cli_test_skipped(in_addr_hi, in_addr_lo, in_bm_addr_hi, in_bm_addr_lo, in_ticket_seq, in_epoch, SKIPPED_LABEL, ERROR_LABEL)
+.begin
+
+    .reg prev_epoch
+    .reg tape_epoch
+    .reg tape_seq
+    .reg marker
+
+    .reg $tape_seq
+    .reg $claim
+
+    .sig test_sig
+
+    mem[atomic_read, $tape_seq, in_bm_addr_hi, <<8, in_bm_addr_lo, 1], ctx_swap[test_sig], defer[2]
+    alu[prev_epoch, in_epoch, -, 1]
+    alu[prev_epoch, prev_epoch, AND, GRO_EPOCH_msk]
+
+    // Not passed if still in the previous epoch or at its skid marker
+    alu[tape_epoch, GRO_EPOCH_msk, AND, $tape_seq, >>GRO_EPOCH_TICKET_SEQ_shf]
+    alu[--, tape_epoch, -, prev_epoch]
+    beq[not_passed#]
+    alu[--, tape_epoch, -, in_epoch]
+    bne[passed#]
+    alu[tape_seq, $tape_seq, AND, GRO_TAPE_SEQ_msk]
+    alu[--, tape_seq, -, in_ticket_seq]
+    ble[not_passed#]
+
+passed#:
+    // Only the first client to claim the marker finds it
+    alu[$claim, --, B, GRO_DTYPE_DROP_SEQ]
+    mem[swap, $claim, in_addr_hi, <<8, in_addr_lo, 1], ctx_swap[test_sig]
+    move(marker, GRO_META_WD_SKIP_SIG)
+    alu[tape_seq, in_ticket_seq, OR, in_epoch, <<GRO_EPOCH_TICKET_SEQ_shf]
+    alu[marker, marker, OR, tape_seq, <<GRO_META_WD_SKIP_TICKET_shf]
+    alu[--, marker, -, $claim]
+    beq[SKIPPED_LABEL]
+    br[ERROR_LABEL]
+
+not_passed#:
+.end
+#endm
+
+
+#macro _gro_cli_send(in_ctx, in_seq, in_meta, META_SIZE_LW, LMPTR, NB)
 .begin
 
     .reg epoch
@@ -974,6 +1490,10 @@ no_error#:
 
     .reg addr_hi
     .reg addr_lo
+    #if (GRO_WD_TIMEOUT != 0)
+        .reg bm_addr_hi
+        .reg bm_addr_lo
+    #endif
 
     .reg $ticket
 
@@ -1015,15 +1535,22 @@ no_error#:
     alu[seq_mask, seq_mask, -, 1]
     alu[ctx_seq, in_seq, AND, seq_mask]
 
+    // ticket_tape = ctx_seq / GRO_TICKET_PER_TAPE
+    alu[ticket_tape, --, B, ctx_seq, >>(log2(GRO_TICKET_PER_TAPE))]
+
     // Write the metadata to the appropriate location in the queue.
     // We must wait for this to finish before releasing the ticket.
     alu[addr_hi, __GRO_CTX[GRO_CLICTX_Q_HI_wrd], AND, GRO_CLICTX_Q_HI_msk, <<GRO_CLICTX_Q_HI_shf]
     alu[addr_lo, __GRO_CTX[GRO_CLICTX_Q_LO_wrd], OR, ctx_seq, <<(log2(GRO_META_SIZE))]
+    #if (GRO_WD_TIMEOUT != 0)
+        // A skipped entry must not be written: GRO.OUT reads it a lap later
+        alu[bm_addr_hi, __GRO_CTX[GRO_CLICTX_BM_HI_wrd], AND, GRO_CLICTX_BM_HI_msk, <<GRO_CLICTX_BM_HI_shf]
+        alu[bm_addr_lo, __GRO_CTX[GRO_CLICTX_BM_LO_wrd], AND~, GRO_CLICTX_BM_HI_msk, <<GRO_CLICTX_BM_HI_shf]
+        alu[bm_addr_lo, bm_addr_lo, OR, ticket_tape, <<GRO_TICKET_TAPE_SIZE_shf]
+        _gro_cli_test_skipped(addr_hi, addr_lo, bm_addr_hi, bm_addr_lo, ticket_seq, epoch, done#, ticket_error#)
+    #endif
     mem[write32, in_meta[0], addr_hi, <<8, addr_lo, META_SIZE_LW], ctx_swap[meta_sig]
 
-    // ticket_tape = ctx_seq / GRO_TICKET_PER_TAPE
-    alu[ticket_tape, --, B, ctx_seq, >>(log2(GRO_TICKET_PER_TAPE))]
-
     // addr = ctx.hi || (ctx.lo + ticket_tape * ticket_tape_size)
     alu[addr_hi, __GRO_CTX[GRO_CLICTX_BM_HI_wrd], AND, GRO_CLICTX_BM_HI_msk, <<GRO_CLICTX_BM_HI_shf]
     alu[addr_lo, __GRO_CTX[GRO_CLICTX_BM_LO_wrd], AND~, GRO_CLICTX_BM_HI_msk, <<GRO_CLICTX_BM_HI_shf]
@@ -1055,7 +1582,11 @@ release_first_ticket#:
     // Repeat this until we stop releasing through the end of blocks.
     .repeat
 
-        _gro_cli_release(__GRO_CTX, in_ctx, num_release)
+        #if (NB)
+            _gro_cli_release_nb(__GRO_CTX, in_ctx, num_release, LMPTR)
+        #else
+            _gro_cli_release(__GRO_CTX, in_ctx, num_release)
+        #endif
 
         // if ( ++tape >= ntapes) { tape = 0; epoch = (epoch + 1) % GRO_NUM_EPOCHS }
         alu[ticket_tape, ticket_tape, +, 1]
@@ -1096,13 +1627,23 @@ release_cascaded_ticket#:
     //
 ticket_error_seq#:
     // addr_lo and addr_hi should still refer to the tape address
-    // check for sequence skid marker
-    _gro_cli_test_ticket_error(addr_hi, addr_lo, ticket_seq, epoch, ticket_error#)
+    // check for sequence skid marker.  With the watchdog enabled, a ticket
+    // that the tape has passed since _gro_cli_test_skipped() was skipped:
+    // the release is dropped.
+    #if (GRO_WD_TIMEOUT != 0)
+        _gro_cli_test_ticket_error(addr_hi, addr_lo, ticket_seq, epoch, done#, ticket_error#)
+    #else
+        _gro_cli_test_ticket_error(addr_hi, addr_lo, ticket_seq, epoch, ticket_error#, ticket_error#)
+    #endif
     timestamp_sleep(GRO_SEQ_OVERFLOW_TICKS)
     br[release_first_ticket#]
 
 ticket_error_cascade#:
-    _gro_cli_test_cascade_error(addr_hi, addr_lo, epoch, cascade_error#)
+    #if (GRO_WD_TIMEOUT != 0)
+        _gro_cli_test_cascade_error(addr_hi, addr_lo, epoch, done#)
+    #else
+        _gro_cli_test_cascade_error(addr_hi, addr_lo, epoch, cascade_error#)
+    #endif
     timestamp_sleep(GRO_SEQ_OVERFLOW_TICKS)
     br[release_cascaded_ticket#]
 
@@ -1132,7 +1673,11 @@ tape_error#:
     // Send last release message
     //
 final_release#:
-    _gro_cli_release(__GRO_CTX, in_ctx, num_release)
+    #if (NB)
+        _gro_cli_release_nb(__GRO_CTX, in_ctx, num_release, LMPTR)
+    #else
+        _gro_cli_release(__GRO_CTX, in_ctx, num_release)
+    #endif
 
 done#:
 
@@ -1159,7 +1704,209 @@ done#:
  *                      (must be an integer).
  */
 #macro gro_cli_send(in_ctx, in_seq, in_meta, LMPTR)
-    _gro_cli_send(in_ctx, in_seq, in_meta, GRO_META_SIZE_LW, LMPTR)
+    _gro_cli_send(in_ctx, in_seq, in_meta, GRO_META_SIZE_LW, LMPTR, 0)
+#endm
+
+
+/**
+ * Release a packet as gro_cli_send(), but stage the release request in
+ * local memory rather than wait if the ingress ring of the block is full.
+ * The staged requests are retried first, see NON-BLOCKING SEND.
+ *
+ * @param in_ctx        The reorder context of the packet.
+ * @param in_seq        The sequence number of the packet.
+ * @param in_meta       Write transfer registers containing the
+ *                      metadata of the packet built with gro_cli_build*
+ * @param LMPTR         The index of the local memory pointer to use
+ *                      to look up reorder context information.
+ *                      (must be an integer).
+ * @param BUSY_LABEL    Where to branch, having done nothing, if the
+ *                      staging queue is full.  The caller must send the
+ *                      packet again later.
+ */
+#macro gro_cli_send_nb(in_ctx, in_seq, in_meta, LMPTR, BUSY_LABEL)
+.begin
+    .reg staged
+
+    _gro_cli_stage_flush(staged, LMPTR)
+    alu[--, staged, -, GRO_CLI_STAGE_DEPTH]
+    bge[BUSY_LABEL]
+    _gro_cli_send(in_ctx, in_seq, in_meta, GRO_META_SIZE_LW, LMPTR, 1)
+.end
+#endm
+
+
+/**
+ * Retry the release requests that gro_cli_send_nb() staged, oldest first,
+ * until one finds its ingress ring still full.  A context with nothing
+ * else to do should call this so that they do not wait for the next send.
+ *
+ * @param out_count     GPR to return the number still staged in.
+ * @param LMPTR         The index of the local memory pointer to use
+ *                      (must be an integer).
+ */
+#macro gro_cli_flush(out_count, LMPTR)
+    _gro_cli_stage_flush(out_count, LMPTR)
+#endm
+
+
+/*
+ * Go to DRAINED_LABEL if flow spreading context in_ctx has released every
+ * sequence number taken from its _gro_flow_seq counter, that is if the
+ * tape of the next one has reached it.
+ */
+#macro _gro_cli_flow_drained(in_ctx, DRAINED_LABEL, LMPTR)
+.begin
+
+    .reg next_seq
+    .reg prev_ticket
+    .reg ticket_tape
+    .reg seq_mask
+    .reg epoch
+    .reg prev_epoch
+    .reg tape_epoch
+    .reg tape_seq
+    .reg addr_hi
+    .reg addr_lo
+
+    .reg $flow_seq
+    .reg $tape_seq
+
+    .sig drain_sig
+
+    #define_eval __GRO_CTX '*l$index/**/LMPTR'
+
+    // Load the reorder context information: Need to wait 3 cycles before use
+    _gro_cli_load_lm_ctx(in_ctx, LMPTR)
+    move(addr_hi, (_gro_flow_seq >> 8))
+    alu[addr_lo, --, B, in_ctx, <<2]
+    mem[atomic_read, $flow_seq, addr_hi, <<8, addr_lo, 1], ctx_swap[drain_sig]
+
+    // The epoch and tape of the next sequence number, as in _gro_cli_send(),
+    // and the ticket before it on that tape
+    alu[prev_ticket, GRO_TICKET_msk, AND, $flow_seq]
+    alu[--, __GRO_CTX[GRO_CLICTX_Q_SIZE_wrd], OR, 0]
+    alu[epoch, GRO_EPOCH_msk, AND, $flow_seq, >>indirect]
+    alu[--, __GRO_CTX[GRO_CLICTX_Q_SIZE_wrd], OR, 0]
+    alu[seq_mask, --, B, 1, <<indirect]
+    alu[seq_mask, seq_mask, -, 1]
+    alu[next_seq, $flow_seq, AND, seq_mask]
+    alu[ticket_tape, --, B, next_seq, >>(log2(GRO_TICKET_PER_TAPE))]
+    alu[addr_hi, __GRO_CTX[GRO_CLICTX_BM_HI_wrd], AND, GRO_CLICTX_BM_HI_msk, <<GRO_CLICTX_BM_HI_shf]
+    alu[addr_lo, __GRO_CTX[GRO_CLICTX_BM_LO_wrd], AND~, GRO_CLICTX_BM_HI_msk, <<GRO_CLICTX_BM_HI_shf]
+    alu[addr_lo, addr_lo, OR, ticket_tape, <<GRO_TICKET_TAPE_SIZE_shf]
+    mem[atomic_read, $tape_seq, addr_hi, <<8, addr_lo, 1], ctx_swap[drain_sig], defer[2]
+    alu[prev_epoch, epoch, -, 1]
+    alu[prev_epoch, prev_epoch, AND, GRO_EPOCH_msk]
+
+    // Not drained if the tape is still in the previous epoch, drained if
+    // it is in a later one or past the ticket before the next
+    alu[tape_epoch, GRO_EPOCH_msk, AND, $tape_seq, >>GRO_EPOCH_TICKET_SEQ_shf]
+    alu[--, tape_epoch, -, prev_epoch]
+    beq[not_drained#]
+    alu[--, tape_epoch, -, epoch]
+    bne[DRAINED_LABEL]
+    alu[tape_seq, $tape_seq, AND, GRO_TAPE_SEQ_msk]
+    alu[--, tape_seq, -, prev_ticket]
+    bgt[DRAINED_LABEL]
+
+not_drained#:
+    #undef __GRO_CTX
+
+.end
+#endm
+
+
+/**
+ * Map a flow hash to a flow spreading reorder context and take the next
+ * sequence number of the context, see FLOW SPREADING.  The packet is
+ * counted against the table entry.  An entry that is moving maps to its
+ * old context until that has drained, one client at a time.
+ *
+ * @param out_ctx       GPR to return the reorder context in, numbered
+ *                      across all blocks.
+ *
+ * @param out_seq       GPR to return the sequence number in.
+ *
+ * @param in_hash       A hash of the flow key, e.g. the NBI flow hash.
+ *
+ * @param LMPTR         Local memory pointer to use (0 or 1) to test
+ *                      whether the old context of a moving entry drained.
+ */
+#macro gro_cli_flow_map(out_ctx, out_seq, in_hash, LMPTR)
+.begin
+
+    .reg ent_off
+    .reg locked
+    .reg addr_hi
+    .reg addr_lo
+
+    .reg $flow_ent
+    .reg $flow_lock
+    .reg $flow_seq
+
+    .sig flow_sig
+
+    alu[ent_off, --, B, in_hash, >>GRO_FLOW_HASH_FOLD_shf]
+    alu[ent_off, ent_off, XOR, in_hash]
+    alu[ent_off, ent_off, AND, GRO_FLOW_TBL_msk]
+    alu[ent_off, --, B, ent_off, <<2]
+    move(addr_hi, (_gro_flow_cnt >> 8))
+    mem[incr, --, addr_hi, <<8, ent_off]
+    move(addr_hi, (_gro_flow_tbl >> 8))
+    mem[read32, $flow_ent, addr_hi, <<8, ent_off, 1], ctx_swap[flow_sig]
+    immed[locked, 0]
+    alu[out_ctx, --, B, $flow_ent]
+    bge[take_seq#]
+
+    // The entry is moving: one client at a time maps through it
+    move(addr_hi, (_gro_flow_lock >> 8))
+lock#:
+    immed[$flow_lock, 1]
+    mem[test_set, $flow_lock, addr_hi, <<8, ent_off, 1], sig_done[flow_sig]
+    ctx_arb[flow_sig]
+    alu[--, --, B, $flow_lock]
+    beq[locked#]
+    timestamp_sleep((GRO_FLOW_LOCK_BACKOFF / 16))
+    br[lock#]
+
+locked#:
+    // The client before may have completed the move
+    immed[locked, 1]
+    move(addr_hi, (_gro_flow_tbl >> 8))
+    mem[read32, $flow_ent, addr_hi, <<8, ent_off, 1], ctx_swap[flow_sig]
+    // out_ctx = ent & GRO_FLOW_ENT_CTX_msk
+    alu[out_ctx, --, B, $flow_ent, <<20]
+    alu[out_ctx, --, B, out_ctx, >>20]
+    br_bclr[$flow_ent, GRO_FLOW_ENT_DRAIN_bit, take_seq#]
+    _gro_cli_flow_drained(out_ctx, drained#, LMPTR)
+    br[take_seq#]
+
+drained#:
+    // Complete the move: the entry now holds the new context alone
+    // out_ctx = GRO_FLOW_ENT_NEXT_of(ent)
+    alu[out_ctx, --, B, $flow_ent, <<4]
+    alu[out_ctx, --, B, out_ctx, >>20]
+    alu[$flow_ent, --, B, out_ctx]
+    mem[write32, $flow_ent, addr_hi, <<8, ent_off, 1], ctx_swap[flow_sig]
+
+take_seq#:
+    move(addr_hi, (_gro_flow_seq >> 8))
+    alu[addr_lo, --, B, out_ctx, <<2]
+    immed[$flow_seq, 1]
+    mem[test_add, $flow_seq, addr_hi, <<8, addr_lo, 1], sig_done[flow_sig]
+    ctx_arb[flow_sig]
+    alu[out_seq, --, B, $flow_seq]
+
+    // Release the lock once the sequence number is taken
+    alu[--, --, B, locked]
+    beq[done#]
+    move(addr_hi, (_gro_flow_lock >> 8))
+    immed[$flow_lock, 0]
+    mem[write32, $flow_lock, addr_hi, <<8, ent_off, 1], ctx_swap[flow_sig]
+
+done#:
+.end
 #endm
 
 
@@ -1439,7 +2186,7 @@ done#:
     .xfer_order $drop_meta
 
     immed[$drop_meta[0], (GRO_DTYPE_DROP_SEQ << GRO_META_TYPE_shf)]
-    _gro_cli_send(in_ctx, in_seq, $drop_meta, 1, LMPTR)
+    _gro_cli_send(in_ctx, in_seq, $drop_meta, 1, LMPTR, 0)
 
 .end
 #endm
@@ -1575,7 +2322,7 @@ done#:
     .xfer_order $drop_meta
 
     gro_cli_build_drop_ctm_buf_meta($drop_meta, in_isl, in_pkt_num)
-    _gro_cli_send(in_ctx, in_seq, $drop_meta, 2, LMPTR)
+    _gro_cli_send(in_ctx, in_seq, $drop_meta, 2, LMPTR, 0)
 
 .end
 #endm
@@ -1610,7 +2357,7 @@ done#:
     .xfer_order $drop_meta
 
     gro_cli_build_drop_mu_buf_meta($drop_meta, in_ring_hi, in_ring_num, in_buf_handle)
-    _gro_cli_send(in_ctx, in_seq, $drop_meta, 4, LMPTR)
+    _gro_cli_send(in_ctx, in_seq, $drop_meta, 4, LMPTR, 0)
 
 .end
 #endm
@@ -0,0 +1,58 @@
+#!/bin/bash
+
+#
+# Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# @file          me/blocks/gro/scripts/grobatch.sh
+#
+# Print the release batching counters of a GRO block, see RELEASE BATCHING
+# in gro.uc.  Needs GRO built with GRO_OUT_BATCH_STATS.
+#
+
+NETRONOME_DIR=${NETRONOME_DIR:-/opt/netronome}
+NETRONOME_BIN=${NETRONOME_BIN:-${NETRONOME_DIR}/bin}
+
+# See GRO_OUT_BATCH_* in gro.uc
+SLOTS=128
+SLOT_SIZE=16
+BLOCK_SIZE=$(($SLOTS * $SLOT_SIZE))
+
+TYPES=(drop_seq iface nfd workq mem_ring drop_ctm drop_mu unknown)
+
+[ $# -lt 1 -o "$1" = "-h" ] && echo usage $0 GRO_BLOCK >&2 && exit 1
+
+if ! $NETRONOME_BIN/nfp-rtsym -L 2>/dev/null | \
+        grep -q _gro_out_batch_cntrs ; then
+    echo GRO was not built with GRO_OUT_BATCH_STATS >&2
+    exit 1
+fi
+
+BASE=$(($1 * $BLOCK_SIZE))
+
+# One line per 64-bit word: offset, low word, high word
+$NETRONOME_BIN/nfp-rtsym -l $BLOCK_SIZE _gro_out_batch_cntrs:$BASE | \
+    awk '{ for (i = 2; i <= NF; i++) print $i }' | \
+    { S=0
+      printf "%-10s %4s %16s %16s %8s\n" TYPE DEST COMMANDS COALESCED AVG
+      while read C0 && read C1 && read P0 && read P1 ; do
+          CMDS=$(($C1 << 32 | $C0))
+          COAL=$(($P1 << 32 | $P0))
+          if [ $CMDS -ne 0 ] ; then
+              AVG=$(awk "BEGIN { printf \"%.3f\", ($CMDS + $COAL) / $CMDS }")
+              printf "%-10s %4d %16d %16d %8s\n" ${TYPES[$(($S & 7))]} \
+                  $(($S >> 3)) $CMDS $COAL $AVG
+          fi
+          S=$(($S + 1))
+      done }
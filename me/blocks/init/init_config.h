@@ -137,6 +137,9 @@
  *     Buffer Pool 6: Unused
  *     Buffer Pool 7: Drop
  *
+ * With the default targets, BLQs 2 and 3 take the packets > 1984B and
+ * BLM_SIZE_CLASSES (see blm_cfg.h) gives them buffers sized for those.
+ *
  *     Syntax:
  *     <Primary Buffer List, Secondary Buffer List>
  */
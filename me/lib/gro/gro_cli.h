@@ -22,33 +22,34 @@
 #include <nfp.h>
 #include "gro.h"
 
-/* TODO: these can be loaded at run-time from the global config */
-/* should they be?  It will come at the cost of some global state. */
-
-#ifndef GRO_NUM_BLOCKS
-#error "GRO_NUM_BLOCKS must be #defined"
+/*
+ * The number of blocks and of contexts per block are read from
+ * gro_global_config by gro_cli_init(), so a client need not be rebuilt
+ * when the GRO blocks are.  GRO_CLI_MAX_CTX bounds the total number of
+ * contexts the client can use, and sizes the copy of their configuration
+ * it keeps in local memory.  It defaults to the GRO_NUM_BLOCKS and
+ * GRO_CTX_PER_BLOCK of the build if they are #defined.
+ */
+#ifndef GRO_CLI_MAX_CTX
+#if (defined(GRO_NUM_BLOCKS) && defined(GRO_CTX_PER_BLOCK))
+#define GRO_CLI_MAX_CTX (GRO_NUM_BLOCKS * GRO_CTX_PER_BLOCK)
+#else
+#define GRO_CLI_MAX_CTX 32
 #endif
-
-#ifndef GRO_CTX_PER_BLOCK
-#error "GRO_CTX_PER_BLOCK must be #defined"
 #endif
 
 
-#if ((GRO_CTX_PER_BLOCK & (GRO_CTX_PER_BLOCK - 1)) != 0)
-#error GRO_CTX_PER_BLOCK must be a power of 2
-#endif
-
-#define GRO_CTX_BLOCK_MASK (GRO_CTX_PER_BLOCK-1)
-
-#define GRO_TOTAL_CTX (GRO_NUM_BLOCKS * GRO_CTX_PER_BLOCK)
-
-
 /**
  * gro_cli_init()
  *
  * Initialize local state for a GRO client.  Must be called once by
  * one context before any other context in the ME calls gro_cli_send().
  *
+ * The configuration of all the contexts in gro_global_config is loaded.
+ * The ME halts with 0xC0F16E44 in mailbox 0, the number of blocks and of
+ * contexts per block in mailboxes 1 and 2 and GRO_CLI_MAX_CTX in mailbox 3
+ * if the contexts do not fit in GRO_CLI_MAX_CTX, or if the contexts per
+ * block are not a power of 2 of at most GRO_MAX_CTX_PER_BLOCK.
  */
 __intrinsic void gro_cli_init(void);
 
@@ -269,16 +270,88 @@ __intrinsic void gro_cli_nfd_desc2meta(__xwrite struct gro_meta_nfd3 *meta,
 
 
 
+/* Result of gro_cli_send() for a context out of range */
+#define GRO_CLI_SEND_BADCTX     -3
+
 /**
  * gro_cli_send()
  *
  * Enqueue a packet/block of data to GRO to send.
  *
  * @param meta          The GRO metadata to send
- * @param ctx           The GRO reorder context
+ * @param ctx           The GRO reorder context, numbered across all blocks
+ * @param seq           The GRO sequence number
+ *
+ * @return 0, -1 if the GRO.OUT watchdog already skipped @seq as lost, or
+ *      GRO_CLI_SEND_BADCTX if @ctx is not one of the contexts read by
+ *      gro_cli_init().  Nothing is sent for @meta on an error, so the
+ *      caller must free any buffer it refers to.
+ */
+__intrinsic int gro_cli_send(__xwrite void *meta, unsigned int ctx,
+                             unsigned int seq);
+
+
+/* Results of gro_cli_send_nb(), besides those of gro_cli_send() */
+#define GRO_CLI_SEND_STAGED     1
+#define GRO_CLI_SEND_BUSY       -2
+
+#if ((GRO_CLI_STAGE_DEPTH & (GRO_CLI_STAGE_DEPTH - 1)) != 0)
+    #error "GRO_CLI_STAGE_DEPTH must be a power of 2"
+#endif
+
+/**
+ * gro_cli_send_nb()
+ *
+ * Enqueue a packet/block of data to GRO to send, without waiting for
+ * room on the ingress ring of the block.  Releases that find the ring
+ * full are staged in a queue of GRO_CLI_STAGE_DEPTH entries in local
+ * memory, shared by the contexts of the ME, which this call and
+ * gro_cli_flush() retry.  See NON-BLOCKING SEND in gro.uc.
+ *
+ * @param meta          The GRO metadata to send
+ * @param ctx           The GRO reorder context, numbered across all blocks
  * @param seq           The GRO sequence number
+ *
+ * @return as gro_cli_send(), or GRO_CLI_SEND_STAGED if a release
+ *      was staged, or GRO_CLI_SEND_BUSY if the staging queue is full.
+ *      Nothing is done with a busy queue:  the caller must call again
+ *      later with the same @meta, @ctx and @seq, e.g. after working on
+ *      other packets, and the reorder context waits for @seq meanwhile.
+ */
+__intrinsic int gro_cli_send_nb(__xwrite void *meta, unsigned int ctx,
+                                unsigned int seq);
+
+
+/**
+ * gro_cli_flush()
+ *
+ * Retry the staged releases of gro_cli_send_nb(), oldest first, until
+ * one finds its ingress ring still full.  A context of the ME with
+ * nothing else to do should call this so that staged releases do not
+ * wait for the next send.
+ *
+ * @return the number of releases still staged.
+ */
+__intrinsic unsigned int gro_cli_flush(void);
+
+
+/**
+ * gro_cli_flow_map()
+ *
+ * Map a flow hash to a flow spreading reorder context, through
+ * _gro_flow_tbl, count the packet in _gro_flow_cnt and take the next
+ * sequence number of the context.  The GRO blocks must be built with
+ * GRO_FLOW_CTX_PER_BLOCK, see FLOW SPREADING in gro.uc.  The packets of a
+ * flow must be mapped in the order in which they are to leave, and each
+ * sequence number must be passed to gro_cli_send().  An entry that the
+ * host is moving keeps mapping to its old context until that has drained.
+ *
+ * @param hash          A hash of the flow key, e.g. the NBI flow hash
+ * @param seq           Returns the sequence number
+ *
+ * @return the reorder context, numbered across all blocks.
  */
-__intrinsic void gro_cli_send(__xwrite void *meta, unsigned int ctx,
-                              unsigned int seq);
+__intrinsic unsigned int gro_cli_flow_map(unsigned int hash,
+                                          unsigned int *seq);
 
 #endif /* __GRO_CLI_H */
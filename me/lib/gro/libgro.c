@@ -31,130 +31,93 @@
 
 #define GRO_DIRECT_ACCESS       0x80
 
-#if (GRO_NUM_BLOCKS > 8)
-    #error "Currently, only 8 global reorder blocks supported"
-#endif
-#if (_nfp_has_island("emem1") && _nfp_has_island("emem2"))
-    #define gro_release_mem_0 emem0
-    #define gro_release_isl_0 24
-    #define gro_release_mem_1 emem1
-    #define gro_release_isl_1 25
-    #define gro_release_mem_2 emem2
-    #define gro_release_isl_2 26
-    #define gro_release_mem_3 emem0
-    #define gro_release_isl_3 24
-    #define gro_release_mem_4 emem1
-    #define gro_release_isl_4 25
-    #define gro_release_mem_5 emem2
-    #define gro_release_isl_5 26
-    #define gro_release_mem_6 emem0
-    #define gro_release_isl_6 24
-    #define gro_release_mem_7 emem1
-    #define gro_release_isl_7 25
-#elif (_nfp_has_island("emem1"))
-    #define gro_release_mem_0 emem0
-    #define gro_release_isl_0 24
-    #define gro_release_mem_1 emem1
-    #define gro_release_isl_1 25
-    #define gro_release_mem_2 emem0
-    #define gro_release_isl_2 24
-    #define gro_release_mem_3 emem1
-    #define gro_release_isl_3 25
-    #define gro_release_mem_4 emem0
-    #define gro_release_isl_4 24
-    #define gro_release_mem_5 emem1
-    #define gro_release_isl_5 25
-    #define gro_release_mem_6 emem0
-    #define gro_release_isl_6 24
-    #define gro_release_mem_7 emem1
-    #define gro_release_isl_7 25
-#else
-    #define gro_release_mem_0 emem0
-    #define gro_release_isl_0 24
-    #define gro_release_mem_1 emem0
-    #define gro_release_isl_1 24
-    #define gro_release_mem_2 emem0
-    #define gro_release_isl_2 24
-    #define gro_release_mem_3 emem0
-    #define gro_release_isl_3 24
-    #define gro_release_mem_4 emem0
-    #define gro_release_isl_4 24
-    #define gro_release_mem_5 emem0
-    #define gro_release_isl_5 24
-    #define gro_release_mem_6 emem0
-    #define gro_release_isl_6 24
-    #define gro_release_mem_7 emem0
-    #define gro_release_isl_7 24
-#endif
+/* What a ticket release error means, see ticket_error_check() */
+#define TICKET_ERR_RETRY        0
+#define TICKET_ERR_FATAL        1
+#define TICKET_ERR_SKIPPED      2
 
 
-__import __shared __emem struct gro_client_ctx gro_ctxcfg[GRO_TOTAL_CTX];
+__import __shared __emem struct gro_global_config gro_global_config;
 
-__shared __lmem struct gro_client_ctx gro_cli_lm_ctx[GRO_TOTAL_CTX];
-
-__import __shared GRO_CNTR_MEM_MICROC __align256
-    uint64_t gro_cli_cntrs[GRO_TOTAL_CTX*2];
+__import __shared __emem struct gro_client_ctx gro_ctxcfg[GRO_CLI_MAX_CTX];
 
+__shared __lmem struct gro_client_ctx gro_cli_lm_ctx[GRO_CLI_MAX_CTX];
 
-__intrinsic static int
-log2(unsigned int x)
-{
-    int l2;
-    __asm ffs[l2, x];
-    return l2;
-}
+/* Contexts per block - 1, from gro_global_config */
+__shared __gpr unsigned int gro_cli_ctx_mask;
 
+/* GRO_GLOBAL_CFG_FLAGS_*, from gro_global_config */
+__shared __lmem unsigned int gro_cli_flags;
 
-#define ASM(_str) __asm{_str}
+/* Contexts across all blocks, read by gro_cli_init() */
+__shared __lmem unsigned int gro_cli_num_ctx;
 
-#define _link_sym(_s) __link_sym(#_s)
+/* Releases of gro_cli_send_nb() waiting for room on an ingress ring */
+__shared __lmem struct gro_cli_stage gro_cli_stage;
 
-#define GRO_RING_DECLARE2(_ringname, _memname) \
-    ASM(.alloc_resource _ringname _memname##_queues global 1)
-#define GRO_RING_DECLARE1(_ringname, _memname) \
-    GRO_RING_DECLARE2(_ringname, _memname)
-#define GRO_RING_DECLARE(block) \
-    GRO_RING_DECLARE1(gro_release_ring_##block, gro_release_mem_##block)
+__import __shared GRO_CNTR_MEM_MICROC __align256
+    uint64_t gro_cli_cntrs[GRO_CLI_MAX_CTX*2];
 
-#if GRO_NUM_BLOCKS > 0
-    GRO_RING_DECLARE(0)
-#endif
+__import __shared __emem uint32_t gro_flow_tbl[GRO_FLOW_TBL_SIZE_LW];
 
-#if GRO_NUM_BLOCKS > 1
-    GRO_RING_DECLARE(1)
-#endif
+__import __shared __emem uint32_t gro_flow_cnt[GRO_FLOW_TBL_SIZE_LW];
 
-#if GRO_NUM_BLOCKS > 2
-    GRO_RING_DECLARE(2)
-#endif
+__import __shared __emem uint32_t gro_flow_seq[GRO_CLI_MAX_CTX];
 
-#if GRO_NUM_BLOCKS > 3
-    GRO_RING_DECLARE(3)
-#endif
+__import __shared __emem uint32_t gro_flow_lock[GRO_FLOW_TBL_SIZE_LW];
 
-#if GRO_NUM_BLOCKS > 4
-    GRO_RING_DECLARE(4)
-#endif
 
-#if GRO_NUM_BLOCKS > 5
-    GRO_RING_DECLARE(5)
-#endif
+__intrinsic static int
+log2(unsigned int x)
+{
+    int l2;
+    __asm ffs[l2, x];
+    return l2;
+}
 
-#if GRO_NUM_BLOCKS > 6
-    GRO_RING_DECLARE(6)
-#endif
 
-#if GRO_NUM_BLOCKS > 7
-    GRO_RING_DECLARE(7)
-#endif
+static __intrinsic void
+gro_cli_abort_config(unsigned int num_blocks, unsigned int ctx_per_block)
+{
+    local_csr_write(local_csr_mailbox_0, 0xC0F16E44);
+    local_csr_write(local_csr_mailbox_1, num_blocks);
+    local_csr_write(local_csr_mailbox_2, ctx_per_block);
+    local_csr_write(local_csr_mailbox_3, GRO_CLI_MAX_CTX);
+    __asm {
+        ctx_arb[bpt]
+        alu[--, --, B, 0]
+forever:
+        beq[forever]
+    }
+}
 
 
 __intrinsic void
 gro_cli_init(void)
 {
+    __xread struct gro_global_config xcfg;
     __xread struct gro_client_ctx xctx;
-    int i;
-    for (i = 0; i < GRO_TOTAL_CTX; i++) {
+    unsigned int num_blocks;
+    unsigned int ctx_per_block;
+    unsigned int i;
+
+    mem_read32(&xcfg, &gro_global_config, sizeof(xcfg));
+    num_blocks = xcfg.num_blocks;
+    ctx_per_block = xcfg.ctx_per_block;
+
+    if (ctx_per_block == 0 || ctx_per_block > GRO_MAX_CTX_PER_BLOCK ||
+        (ctx_per_block & (ctx_per_block - 1)) != 0 ||
+        num_blocks > GRO_CLI_MAX_CTX / ctx_per_block)
+        gro_cli_abort_config(num_blocks, ctx_per_block);
+
+    gro_cli_ctx_mask = ctx_per_block - 1;
+    gro_cli_flags = xcfg.flags;
+    gro_cli_num_ctx = num_blocks * ctx_per_block;
+    gro_cli_stage.head = 0;
+    gro_cli_stage.count = 0;
+    gro_cli_stage.busy = 0;
+
+    for (i = 0; i < num_blocks * ctx_per_block; i++) {
         mem_read64(&xctx, &gro_ctxcfg[i], sizeof(xctx));
         gro_cli_lm_ctx[i] = xctx;
     }
@@ -431,9 +394,9 @@ _gro_cli_cntr_released_add(unsigned int ctx, unsigned int amt)
 }
 
 
-__intrinsic void
-_gro_cli_release(__lmem struct gro_client_ctx *clictx, unsigned int ctx,
-                 unsigned int nrel)
+/* Put a release on the ingress ring of a block, 0 if the ring is full */
+static __intrinsic int
+_gro_cli_release_put(unsigned int ring, unsigned int ctx, unsigned int nrel)
 {
     unsigned int addr_hi;
     unsigned int addr_lo;
@@ -442,22 +405,95 @@ _gro_cli_release(__lmem struct gro_client_ctx *clictx, unsigned int ctx,
     SIGNAL_PAIR putsig;
 
     rel.__raw = 0;
-    rel.ctx = ctx % GRO_CTX_PER_BLOCK;
+    rel.ctx = ctx & gro_cli_ctx_mask;
     rel.nrel = nrel;
     rel.valid = 1;
     xrel = rel;
 
-    addr_hi = clictx->ring_addr_hi << 24;
-    addr_lo = clictx->ring_addr_lo;
+    addr_hi = ring & (GRO_CLICTX_RING_HI_msk << GRO_CLICTX_RING_HI_shf);
+    addr_lo = ring & GRO_CLICTX_RING_LO_msk;
 
-    do {
-        __asm {
-            mem[put, xrel, addr_hi, <<8, addr_lo, 1], sig_done[putsig]
-            ctx_arb[putsig]
-        }
-    } while (!xrel.valid);
+    __asm {
+        mem[put, xrel, addr_hi, <<8, addr_lo, 1], sig_done[putsig]
+        ctx_arb[putsig]
+    }
+    if (!xrel.valid)
+        return 0;
 
     _gro_cli_cntr_released_add(ctx, nrel);
+    return 1;
+}
+
+
+__intrinsic void
+_gro_cli_release(__lmem struct gro_client_ctx *clictx, unsigned int ctx,
+                 unsigned int nrel)
+{
+    unsigned int ring;
+
+    ring = (clictx->ring_addr_hi << 24) | clictx->ring_addr_lo;
+    while (!_gro_cli_release_put(ring, ctx, nrel))
+        ;
+}
+
+
+/*
+ * Put a release on the ingress ring of its block or, if the ring is full,
+ * stage it.  Returns 1 if the release was staged.  A release only waits
+ * for the ring if the staging queue filled up since gro_cli_send_nb()
+ * checked it.
+ */
+static __intrinsic int
+_gro_cli_release_nb(__lmem struct gro_client_ctx *clictx, unsigned int ctx,
+                    unsigned int nrel)
+{
+    unsigned int ring;
+    unsigned int idx;
+
+    ring = (clictx->ring_addr_hi << 24) | clictx->ring_addr_lo;
+    if (_gro_cli_release_put(ring, ctx, nrel))
+        return 0;
+
+    /* No context swap from here to the update of the count */
+    if (gro_cli_stage.count < GRO_CLI_STAGE_DEPTH) {
+        idx = (gro_cli_stage.head + gro_cli_stage.count) &
+              (GRO_CLI_STAGE_DEPTH - 1);
+        gro_cli_stage.ent[idx].ring = ring;
+        gro_cli_stage.ent[idx].rel = ctx | (nrel << GRO_REL_NREL_shf);
+        gro_cli_stage.count++;
+        return 1;
+    }
+
+    while (!_gro_cli_release_put(ring, ctx, nrel))
+        ;
+    return 0;
+}
+
+
+__intrinsic unsigned int
+gro_cli_flush(void)
+{
+    unsigned int ring;
+    unsigned int rel;
+
+    /* One context flushes at a time, the others only add entries */
+    if (gro_cli_stage.count == 0 || gro_cli_stage.busy)
+        return gro_cli_stage.count;
+    gro_cli_stage.busy = 1;
+
+    while (gro_cli_stage.count != 0) {
+        ring = gro_cli_stage.ent[gro_cli_stage.head].ring;
+        rel = gro_cli_stage.ent[gro_cli_stage.head].rel;
+        if (!_gro_cli_release_put(ring, rel & GRO_CLI_STAGE_CTX_msk,
+                                  rel >> GRO_REL_NREL_shf))
+            break;
+        gro_cli_stage.head = (gro_cli_stage.head + 1) &
+                             (GRO_CLI_STAGE_DEPTH - 1);
+        gro_cli_stage.count--;
+    }
+
+    gro_cli_stage.busy = 0;
+    return gro_cli_stage.count;
 }
 
 
@@ -494,10 +530,19 @@ forever:
 }
 
 
+/*
+ * A ticket that the tape has already passed is a duplicate, unless the
+ * GRO.OUT watchdog is enabled, in which case _gro_cli_send() found the
+ * tape short of it before writing the entry: the watchdog skipped it
+ * since, or a duplicate sent at the same time as the original lost the
+ * race.  A ticket whose bit is already set is always a duplicate.
+ */
 static __intrinsic int
-ticket_error_is_fatal(unsigned int addr_hi, unsigned int addr_lo,
-                      unsigned int ticket_seq, unsigned int epoch)
+ticket_error_check(unsigned int addr_hi, unsigned int addr_lo,
+                   unsigned int ticket_seq, unsigned int epoch)
 {
+    int passed = (gro_cli_flags & GRO_GLOBAL_CFG_FLAGS_WD) ?
+                 TICKET_ERR_SKIPPED : TICKET_ERR_FATAL;
     unsigned int prev_epoch = (epoch == 0) ? (GRO_NUM_EPOCHS - 1) : epoch - 1;
     unsigned int skid_marker = GRO_SEQSKID_VALUE |
                                (prev_epoch << GRO_EPOCH_TICKET_SEQ_shf);
@@ -512,30 +557,81 @@ ticket_error_is_fatal(unsigned int addr_hi, unsigned int addr_lo,
     __asm { mem[read_atomic, ticket_tape, addr_hi, <<8, addr_lo, 3], ctx_swap[tape_read_sig] }
 
     if (ticket_tape[0] == skid_marker)
-        return 0;
+        return TICKET_ERR_RETRY;
 
     tape_epoch = (ticket_tape[0] >> GRO_EPOCH_TICKET_SEQ_shf) & GRO_EPOCH_msk;
     if (tape_epoch != epoch)
-        return 1;
+        return passed;
 
     tape_seq = ticket_tape[0] & GRO_TAPE_SEQ_msk;
     if (tape_seq == ticket_seq)
-        return 0;
+        return TICKET_ERR_RETRY;
 
     if (tape_seq > ticket_seq)
-        return 1;
+        return passed;
 
     rel_seq = ticket_seq - tape_seq - 1;
     if (rel_seq < 32) {
         if (ticket_tape[1] & (1 << rel_seq))
-            return 1;
+            return TICKET_ERR_FATAL;
     } else {
         rel_seq -= 32;
         if (ticket_tape[2] & (1 << rel_seq))
-            return 1;
+            return TICKET_ERR_FATAL;
     }
 
-    return 0;
+    return TICKET_ERR_RETRY;
+}
+
+
+/*
+ * Whether the tape has already moved past ticket_seq of epoch.  A tape that
+ * is still in the previous epoch, or at its skid marker, has not.
+ */
+static __intrinsic int
+ticket_passed(unsigned int addr_hi, unsigned int addr_lo,
+              unsigned int ticket_seq, unsigned int epoch)
+{
+    unsigned int prev_epoch = (epoch == 0) ? (GRO_NUM_EPOCHS - 1) : epoch - 1;
+    unsigned int tape_epoch;
+
+    SIGNAL tape_read_sig;
+
+    __xread unsigned int tape_seq;
+
+    __asm { mem[read_atomic, tape_seq, addr_hi, <<8, addr_lo, 1], ctx_swap[tape_read_sig] }
+
+    tape_epoch = (tape_seq >> GRO_EPOCH_TICKET_SEQ_shf) & GRO_EPOCH_msk;
+    if (tape_epoch == prev_epoch)
+        return 0;
+    if (tape_epoch != epoch)
+        return 1;
+
+    return (tape_seq & GRO_TAPE_SEQ_msk) > ticket_seq;
+}
+
+
+/*
+ * Claim the GRO_META_WD_SKIP marker of ticket from its queue entry, for a
+ * ticket that the tape has passed.  Only the first client to send the
+ * entry after the watchdog skipped it finds the marker: a duplicate finds
+ * the claim instead.
+ */
+static __intrinsic int
+wd_skip_claim(unsigned int addr_hi, unsigned int addr_lo, unsigned int ticket)
+{
+    SIGNAL_PAIR claim_sig;
+
+    __xrw uint32_t claim;
+
+    claim = GRO_DTYPE_DROP_SEQ;
+    __asm {
+        mem[swap, claim, addr_hi, <<8, addr_lo, 1], sig_done[claim_sig]
+        ctx_arb[claim_sig]
+    }
+
+    return claim == (GRO_META_WD_SKIP_SIG |
+                     (ticket << GRO_META_WD_SKIP_TICKET_shf));
 }
 
 
@@ -561,9 +657,14 @@ cascaded_ticket_error_is_fatal(unsigned int addr_hi, unsigned int addr_lo,
 }
 
 
-__intrinsic void
-gro_cli_send(__xwrite void *meta, unsigned int ctx, unsigned int seq)
+/* gro_cli_send() and, with nb, gro_cli_send_nb() */
+static __intrinsic int
+_gro_cli_send(__xwrite void *meta, unsigned int ctx, unsigned int seq,
+              int nb)
 {
+    int ret = 0;
+    int staged = 0;
+    int err;
     unsigned int adj_seq;
     int nrel;
     unsigned int tape;
@@ -571,6 +672,8 @@ gro_cli_send(__xwrite void *meta, unsigned int ctx, unsigned int seq)
     unsigned int rel_ctx;
     unsigned int addr_hi;
     unsigned int addr_lo;
+    unsigned int q_addr_hi;
+    unsigned int q_addr_lo;
     unsigned int ntapes;
     unsigned int epoch;
 
@@ -581,30 +684,52 @@ gro_cli_send(__xwrite void *meta, unsigned int ctx, unsigned int seq)
     SIGNAL meta_sig;
     SIGNAL_PAIR ticket_sig;
 
+    /* gro_cli_lm_ctx[] only holds the contexts of the blocks */
+    if (ctx >= gro_cli_num_ctx)
+        return GRO_CLI_SEND_BADCTX;
+
     clictx = &gro_cli_lm_ctx[ctx];
     epoch = (seq >> clictx->q_size) % GRO_NUM_EPOCHS;
     ticket_seq = (seq & GRO_TICKET_msk) + 1;
     ticket = ticket_seq | (epoch << GRO_EPOCH_TICKET_SEQ_shf);
+    adj_seq = seq & ((1 << clictx->q_size) - 1);
+    tape = adj_seq / GRO_TICKET_PER_TAPE;
+    q_addr_hi = clictx->q_addr_hi << 24;
+    q_addr_lo = clictx->q_addr_lo | (adj_seq * GRO_META_SIZE);
+    addr_hi = clictx->bm_addr_hi << 24;
+    addr_lo = clictx->bm_addr_lo | (tape * GRO_TICKET_TAPE_SIZE);
+
+    /* The watchdog may have skipped the entry: writing it now would */
+    /* clobber whatever GRO.OUT reads there a lap later.  A ticket the */
+    /* tape has passed without a skip marker is a duplicate. */
+    if ((gro_cli_flags & GRO_GLOBAL_CFG_FLAGS_WD) &&
+        ticket_passed(addr_hi, addr_lo, ticket_seq, epoch)) {
+        if (!wd_skip_claim(q_addr_hi, q_addr_lo, ticket))
+            gro_cli_abort_ticket(ctx, tape, seq);
+        ret = -1;
+        goto out;
+    }
 
     /* Write the metadata */
-    adj_seq = seq & ((1 << clictx->q_size) - 1);
-    addr_hi = clictx->q_addr_hi << 24;
-    addr_lo = clictx->q_addr_lo | (adj_seq * GRO_META_SIZE);
     __asm {
-        mem[write32, *meta, addr_hi, <<8, addr_lo, GRO_META_SIZE_LW], ctx_swap[meta_sig]
+        mem[write32, *meta, q_addr_hi, <<8, q_addr_lo, GRO_META_SIZE_LW], ctx_swap[meta_sig]
     }
 
     /* Release the ticket */
-    tape = adj_seq / GRO_TICKET_PER_TAPE;
-    addr_hi = clictx->bm_addr_hi << 24;
-    addr_lo = clictx->bm_addr_lo | (tape * GRO_TICKET_TAPE_SIZE);
     __asm {
         mem[release_ticket, ticket, addr_hi, <<8, addr_lo, 1], sig_done[ticket_sig]
         ctx_arb[ticket_sig]
     }
 
     while (ticket == GRO_TICKET_ERROR) {
-        if (ticket_error_is_fatal(addr_hi, addr_lo, ticket_seq, epoch))
+        err = ticket_error_check(addr_hi, addr_lo, ticket_seq, epoch);
+        if (err == TICKET_ERR_SKIPPED) {
+            /* The watchdog skipped it after the check above: GRO.OUT */
+            /* stepped over the entry, so the metadata is never read */
+            ret = -1;
+            goto out;
+        }
+        if (err == TICKET_ERR_FATAL)
             gro_cli_abort_ticket(ctx, tape, seq);
         /* Assume 40 cycles/pkt * 64 pkt/bm = 2560 cycles/bm.  Sleep that */
         /* before trying again to give the GRO.OUT MEs time to catch up. */
@@ -625,7 +750,10 @@ gro_cli_send(__xwrite void *meta, unsigned int ctx, unsigned int seq)
 
     if (ticket != 0) {
 
-        _gro_cli_release(clictx, ctx, ticket);
+        if (nb)
+            staged |= _gro_cli_release_nb(clictx, ctx, ticket);
+        else
+            _gro_cli_release(clictx, ctx, ticket);
 
         if (ticket + ticket_seq > GRO_TICKET_PER_TAPE) {
             ntapes = 1 << (clictx->q_size - GRO_TICKET_TAPE_SEQ_shf);
@@ -649,8 +777,13 @@ gro_cli_send(__xwrite void *meta, unsigned int ctx, unsigned int seq)
                     if (ticket != GRO_TICKET_ERROR)
                         break;
 
-                    if (cascaded_ticket_error_is_fatal(addr_hi, addr_lo, epoch))
+                    if (cascaded_ticket_error_is_fatal(addr_hi, addr_lo,
+                                                       epoch)) {
+                        /* The watchdog released the tape for us */
+                        if (gro_cli_flags & GRO_GLOBAL_CFG_FLAGS_WD)
+                            goto out;
                         gro_cli_abort_ticket(ctx, tape, seq | (1 << 31));
+                    }
 
                     sleep(2560);
                 }
@@ -659,14 +792,130 @@ gro_cli_send(__xwrite void *meta, unsigned int ctx, unsigned int seq)
                     gro_cli_abort_tape(ctx, tape, ticket);
 
                 nrel = ticket - 1;
-                if (nrel > 0)
+                if (nrel > 0 && nb)
+                    staged |= _gro_cli_release_nb(clictx, ctx, nrel);
+                else if (nrel > 0)
                     _gro_cli_release(clictx, ctx, nrel);
 
             } while (nrel >= GRO_TICKET_PER_TAPE);
         }
     }
 
+out:
     __implicit_read(meta, GRO_META_SIZE);
+    if (ret == 0 && staged)
+        ret = GRO_CLI_SEND_STAGED;
+    return ret;
+}
+
+
+__intrinsic int
+gro_cli_send(__xwrite void *meta, unsigned int ctx, unsigned int seq)
+{
+    return _gro_cli_send(meta, ctx, seq, 0);
+}
+
+
+__intrinsic int
+gro_cli_send_nb(__xwrite void *meta, unsigned int ctx, unsigned int seq)
+{
+    if (gro_cli_stage.count != 0 &&
+        gro_cli_flush() >= GRO_CLI_STAGE_DEPTH)
+        return GRO_CLI_SEND_BUSY;
+
+    return _gro_cli_send(meta, ctx, seq, 1);
+}
+
+
+/* Take the next sequence number of flow spreading context ctx */
+static __intrinsic unsigned int
+flow_seq_take(unsigned int ctx)
+{
+    __xrw uint32_t seq = 1;
+
+    mem_test_add(&seq, &gro_flow_seq[ctx], sizeof(seq));
+    return seq;
+}
+
+
+/*
+ * Whether flow spreading context ctx has released every sequence number
+ * taken from its gro_flow_seq counter, that is whether the tape of the
+ * next one has passed the ticket before it.
+ */
+static __intrinsic int
+flow_ctx_drained(unsigned int ctx)
+{
+    __lmem struct gro_client_ctx *clictx;
+    __xread uint32_t next;
+    unsigned int epoch;
+    unsigned int tape;
+    unsigned int addr_hi;
+    unsigned int addr_lo;
+
+    mem_read_atomic(&next, &gro_flow_seq[ctx], sizeof(next));
+
+    clictx = &gro_cli_lm_ctx[ctx];
+    epoch = (next >> clictx->q_size) % GRO_NUM_EPOCHS;
+    tape = (next & ((1 << clictx->q_size) - 1)) / GRO_TICKET_PER_TAPE;
+    addr_hi = clictx->bm_addr_hi << 24;
+    addr_lo = clictx->bm_addr_lo | (tape * GRO_TICKET_TAPE_SIZE);
+
+    return ticket_passed(addr_hi, addr_lo, next & GRO_TICKET_msk, epoch);
+}
+
+
+/*
+ * Map through table entry idx, which is moving, holding its lock until the
+ * sequence number is taken.  The first client to find the old context
+ * drained once the host allowed the move completes it.
+ */
+static __intrinsic unsigned int
+flow_map_moving(unsigned int idx, unsigned int *seq)
+{
+    __xrw uint32_t lock;
+    __xread uint32_t ent;
+    __xwrite uint32_t new_ent;
+    unsigned int ctx;
+
+    for (;;) {
+        lock = 1;
+        mem_test_set(&lock, &gro_flow_lock[idx], sizeof(lock));
+        if (lock == 0)
+            break;
+        sleep(GRO_FLOW_LOCK_BACKOFF);
+    }
+
+    /* The client before may have completed the move */
+    mem_read32(&ent, &gro_flow_tbl[idx], sizeof(ent));
+    ctx = ent & GRO_FLOW_ENT_CTX_msk;
+    if ((ent & GRO_FLOW_ENT_DRAIN) && flow_ctx_drained(ctx)) {
+        ctx = GRO_FLOW_ENT_NEXT_of(ent);
+        new_ent = ctx;
+        mem_write32(&new_ent, &gro_flow_tbl[idx], sizeof(new_ent));
+    }
+
+    *seq = flow_seq_take(ctx);
+
+    lock = 0;
+    mem_write32(&lock, &gro_flow_lock[idx], sizeof(lock));
+    return ctx;
+}
+
+
+__intrinsic unsigned int
+gro_cli_flow_map(unsigned int hash, unsigned int *seq)
+{
+    __xread uint32_t ent;
+    unsigned int idx = GRO_FLOW_TBL_IDX(hash);
+
+    mem_incr32(&gro_flow_cnt[idx]);
+    mem_read32(&ent, &gro_flow_tbl[idx], sizeof(ent));
+    if (ent & GRO_FLOW_ENT_FENCE)
+        return flow_map_moving(idx, seq);
+
+    *seq = flow_seq_take(ent);
+    return ent;
 }
 
 
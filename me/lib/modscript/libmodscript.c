@@ -60,30 +60,86 @@
 * 14=120            128, 129, .. 137, 138 .. 248
 */
 
+#if MODSCRIPT_CACHE_SIZE
+/*
+* Cache of scripts per ME, keyed by the packet offset and the edit.  For
+* modscript_write() the value is the modscript_tbl row, for edits it is the
+* script header word, the script offset and the script length.  Lookups
+* and fills have no context swap between them, so the contexts of the ME
+* share the cache without a lock.  modscript_cache_init() empties it.
+*/
+struct modscript_cache_entry {
+    uint32_t key;
+    uint32_t value[4];
+};
+
+__shared __lmem struct modscript_cache_entry
+    modscript_cache[MODSCRIPT_CACHE_SIZE];
+
+/* Bit 31 is set so that a zeroed entry never matches */
+#define MODSCRIPT_CACHE_KEY(_off, _act, _at, _len) \
+    ((1 << 31) | ((_act) << 29) | ((_len) << 24) | ((_at) << 16) | (_off))
+
+#define MODSCRIPT_CACHE_IDX(_off, _act, _at) \
+    (((_off) + ((_off) >> 3) + (_act) + (_at)) & (MODSCRIPT_CACHE_SIZE - 1))
+#endif
+
+__intrinsic void
+modscript_cache_init(void)
+{
+#if MODSCRIPT_CACHE_SIZE
+    unsigned int i;
+
+    for (i = 0; i < MODSCRIPT_CACHE_SIZE; i++)
+        modscript_cache[i].key = 0;
+#endif
+}
+
 __intrinsic struct pkt_ms_info
-__modscript_write(__mem40  void *pbuf,
-        unsigned char off, __xwrite modscript_struct_t *pwrite,
-        __xread uint32_t *rdback, SIGNAL *sig1,
-        SIGNAL *sig2)
+modscript_lookup(unsigned char off, __gpr modscript_struct_t *script)
 {
-    SIGNAL wr_sig,  rd_sig;
     __xread modscript_struct_t rd_xfer;
     __gpr uint32_t script_idx = off - PKTIO_MIN_NBI_TX_OFFSET;
     __gpr struct pkt_ms_info msi;
-    __mem40 unsigned char *mem_ptr;
+#if MODSCRIPT_CACHE_SIZE
+    __gpr uint32_t key, idx;
+#endif
 
     msi.off_enc = 0;
     script_idx = script_idx/1;
 
     if (script_idx < NUM_ENTRIES) {
+#if MODSCRIPT_CACHE_SIZE
+        key = MODSCRIPT_CACHE_KEY(off, MODSCRIPT_ACT_NONE, 0, 0);
+        idx = MODSCRIPT_CACHE_IDX(off, MODSCRIPT_ACT_NONE, 0);
+
+        if (modscript_cache[idx].key == key) {
+            script->value[0] = modscript_cache[idx].value[0];
+            script->value[1] = modscript_cache[idx].value[1];
+            script->value[2] = modscript_cache[idx].value[2];
+            script->value[3] = modscript_cache[idx].value[3];
+        } else {
+            cls_read(&rd_xfer, (__cls void *)&modscript_tbl[script_idx][0],
+                     sizeof(modscript_struct_t));
+            *script = rd_xfer;
+
+            modscript_cache[idx].key = key;
+            modscript_cache[idx].value[0] = script->value[0];
+            modscript_cache[idx].value[1] = script->value[1];
+            modscript_cache[idx].value[2] = script->value[2];
+            modscript_cache[idx].value[3] = script->value[3];
+        }
+#else
         cls_read(&rd_xfer, (__cls void *)&modscript_tbl[script_idx][0],
                  sizeof(modscript_struct_t));
+        *script = rd_xfer;
+#endif
 
         /*
          * Set the encoding:
          * 3=32, 4=40, 5=48, 6=56, 11=96, 12=104, 13=112, 14=120
          */
-        msi.off_enc = (rd_xfer.prepend_offset >> 3) - 1;
+        msi.off_enc = (script->prepend_offset >> 3) - 1;
 
         /* If encoding invalid, return 0. */
         if (msi.off_enc < 3 || msi.off_enc > 14) {
@@ -91,19 +147,35 @@ __modscript_write(__mem40  void *pbuf,
             return msi;
         }
 
+        /* Set the length adjustment to point to the start of packet. */
+        msi.len_adj = off;
+    }
+    return msi;
+}
+
+__intrinsic struct pkt_ms_info
+__modscript_write(__mem40  void *pbuf,
+        unsigned char off, __xwrite modscript_struct_t *pwrite,
+        __xread uint32_t *rdback, SIGNAL *sig1,
+        SIGNAL *sig2)
+{
+    __gpr modscript_struct_t script;
+    __gpr struct pkt_ms_info msi;
+    __mem40 unsigned char *mem_ptr;
+
+    msi = modscript_lookup(off, &script);
+
+    if (msi.off_enc != 0) {
         __critical_path();
 
-        reg_cp(&pwrite->value[0], &rd_xfer.value[0], sizeof(rd_xfer));
+        reg_cp(&pwrite->value[0], &script.value[0], sizeof(script));
 
-        mem_ptr = (__mem40 unsigned char *)pbuf + rd_xfer.prepend_offset;
+        mem_ptr = (__mem40 unsigned char *)pbuf + script.prepend_offset;
 
         __mem_write32(&pwrite->value[0], (__mem40 void *)mem_ptr,
-                      rd_xfer.prepend_len0 << 2, 4 << 2, sig_done, sig1);
+                      script.prepend_len0 << 2, 4 << 2, sig_done, sig1);
         __mem_read32(rdback, (__mem40 void *)mem_ptr, 1 << 2,
                     1 << 2, sig_done, sig2);
-
-        /* Set the length adjustment to point to the start of packet. */
-        msi.len_adj = off;
     }
     return msi;
 }
@@ -122,3 +194,136 @@ modscript_write(__mem40 void *pbuf, unsigned char off)
     wait_for_all(&wr_sig, &rd_sig);
     return msi;
 }
+
+/*
+* Direct edit scripts.  The script sits at an 8B aligned offset ms_off and
+* the packet data the modifier works on starts right after it, so:
+*
+* - Replace and insert: header word, data, padding to 8B, ending at off.
+* - Delete: header word and a pad word.  At offset 0 the delete also
+*   covers the bytes between the script and an unaligned off, which is how
+*   __pkt_msd_write() handles unaligned packets.
+*
+* The instruction bytes field encodes len - 1, so len is 1 to 16.
+*/
+__intrinsic struct pkt_ms_info
+__modscript_edit_write(__mem40 void *pbuf, unsigned char off,
+        unsigned int act, unsigned int at, unsigned int len,
+        __lmem uint32_t *data, __xwrite uint32_t *pwrite,
+        __xread uint32_t *rdback, SIGNAL *sig1, SIGNAL *sig2)
+{
+    __gpr struct pkt_ms_info msi;
+    __gpr uint32_t hdr;
+    __gpr uint32_t ms_off;
+    __gpr uint32_t ms_len;
+    __gpr uint32_t del;
+    __mem40 unsigned char *mem_ptr;
+#if MODSCRIPT_CACHE_SIZE
+    __gpr uint32_t key, idx;
+#endif
+
+    msi.off_enc = 0;
+
+    if (len == 0 || len > MODSCRIPT_EDIT_MAX_LEN ||
+        at > MODSCRIPT_EDIT_MAX_AT)
+        return msi;
+
+#if MODSCRIPT_CACHE_SIZE
+    key = MODSCRIPT_CACHE_KEY(off, act, at, len);
+    idx = MODSCRIPT_CACHE_IDX(off, act, at);
+
+    if (modscript_cache[idx].key == key) {
+        hdr = modscript_cache[idx].value[0];
+        ms_off = modscript_cache[idx].value[1];
+        ms_len = modscript_cache[idx].value[2];
+    } else
+#endif
+    {
+        if (act == MODSCRIPT_ACT_DELETE) {
+            ms_len = 8;
+            del = len;
+            if (at == 0) {
+                ms_off = (off & ~7) - ms_len;
+                del += off - ms_off - ms_len;
+            } else {
+                ms_off = off - ms_len;
+            }
+            if (del > MODSCRIPT_EDIT_MAX_LEN)
+                return msi;
+
+            hdr = NBI_PM_OPCODE(NBI_PKT_MS_INSTRUCT_DELETE, del, 0);
+        } else if (act == MODSCRIPT_ACT_REPLACE ||
+                   act == MODSCRIPT_ACT_INSERT) {
+            ms_len = (4 + len + 7) & ~7;
+            ms_off = off - ms_len;
+
+            if (act == MODSCRIPT_ACT_REPLACE)
+                hdr = NBI_PM_OPCODE(NBI_PKT_MS_INSTRUCT_REPLACE, len, 0);
+            else
+                hdr = NBI_PM_OPCODE(NBI_PKT_MS_INSTRUCT_INSERT, len, 0);
+            hdr |= len << MODSCRIPT_DIRECT_RDATA_shf;
+        } else {
+            return msi;
+        }
+
+        /* Unless it is a delete at 0, the script ends at the packet, so
+         * this fails for an unaligned off, and for off < ms_len as ms_off
+         * wraps */
+        if ((ms_off & 7) != 0 || ms_off < 8 || ms_off > MODSCRIPT_MAX_OFF)
+            return msi;
+
+        hdr |= (1 << MODSCRIPT_DIRECT_shf) |
+               (at << MODSCRIPT_DIRECT_OFFSET_shf);
+
+#if MODSCRIPT_CACHE_SIZE
+        modscript_cache[idx].key = key;
+        modscript_cache[idx].value[0] = hdr;
+        modscript_cache[idx].value[1] = ms_off;
+        modscript_cache[idx].value[2] = ms_len;
+#endif
+    }
+
+    __critical_path();
+
+    /* Only the words up to ms_len are written, a delete writes a pad */
+    pwrite[0] = hdr;
+    if (act == MODSCRIPT_ACT_DELETE) {
+        pwrite[1] = 0;
+    } else {
+        pwrite[1] = data[0];
+        pwrite[2] = data[1];
+        pwrite[3] = data[2];
+        pwrite[4] = data[3];
+        pwrite[5] = 0;
+    }
+
+    mem_ptr = (__mem40 unsigned char *)pbuf + ms_off;
+
+    __mem_write32(pwrite, (__mem40 void *)mem_ptr, ms_len,
+                  MODSCRIPT_EDIT_MAX_SZ, sig_done, sig1);
+    __mem_read32(rdback, (__mem40 void *)mem_ptr, 1 << 2,
+                 1 << 2, sig_done, sig2);
+
+    msi.off_enc = (ms_off >> 3) - 1;
+    /* Set the length adjustment to point to the start of packet. */
+    msi.len_adj = off;
+
+    return msi;
+}
+
+__intrinsic struct pkt_ms_info
+modscript_edit_write(__mem40 void *pbuf, unsigned char off,
+        unsigned int act, unsigned int at, unsigned int len,
+        __lmem uint32_t *data)
+{
+    SIGNAL wr_sig, rd_sig;
+    __gpr struct pkt_ms_info msi;
+    __xread uint32_t rd_xfer;
+    __xwrite uint32_t wr_xfer[MODSCRIPT_EDIT_MAX_SZ / 4];
+
+    msi = __modscript_edit_write(pbuf, off, act, at, len, data, wr_xfer,
+                                 &rd_xfer, &wr_sig, &rd_sig);
+    if (msi.off_enc != 0)
+        wait_for_all(&wr_sig, &rd_sig);
+    return msi;
+}
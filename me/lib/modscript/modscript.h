@@ -13,7 +13,7 @@
 #define __MODSCRIPT_H__
 
 #include <nfp.h>
-#include <modscript/modscript.h>
+#include <pkt/pkt.h>
 
 
 /* Only supported in B0 */
@@ -31,6 +31,44 @@
 /* This is the max allowable offset for packet to start. */
 #define PKTIO_MAX_NBI_TX_OFFSET  248
 
+/*
+ * Scripts looked up or built recently are kept in a small LMEM cache per
+ * ME, which saves the CLS read of modscript_write() for the few packet
+ * offsets an ME sends at.  Define to 0 to disable, otherwise a power of 2.
+ */
+#ifndef MODSCRIPT_CACHE_SIZE
+#define MODSCRIPT_CACHE_SIZE    8
+#endif
+
+#if (MODSCRIPT_CACHE_SIZE & (MODSCRIPT_CACHE_SIZE - 1))
+#error "MODSCRIPT_CACHE_SIZE must be 0 or a power of 2"
+#endif
+
+/* Edits of modscript_edit_write(), MODSCRIPT_ACT_NONE is modscript_write() */
+#define MODSCRIPT_ACT_NONE      0
+#define MODSCRIPT_ACT_DELETE    1
+#define MODSCRIPT_ACT_REPLACE   2
+#define MODSCRIPT_ACT_INSERT    3
+
+/* Largest edit of one script, in bytes, and largest offset of an edit */
+#define MODSCRIPT_EDIT_MAX_LEN  16
+#define MODSCRIPT_EDIT_MAX_AT   255
+
+/* Largest direct script: a header word and the data, in 8B units */
+#define MODSCRIPT_EDIT_MAX_SZ   24
+
+/* Highest offset of a script in the buffer, 8B aligned */
+#define MODSCRIPT_MAX_OFF       120
+
+/*
+ * First word of a direct script, the data of a replace or insert follows
+ * in the script from byte 4.  See NFP 6xxx Databook Section 7.2.4.1.
+ */
+#define MODSCRIPT_DIRECT_shf        31
+#define MODSCRIPT_DIRECT_OPCODE_shf 16
+#define MODSCRIPT_DIRECT_OFFSET_shf 8
+#define MODSCRIPT_DIRECT_RDATA_shf  0
+
 /**
  * Packet modifier rewrite script details to write to packet:
  * what to write (indirect script)
@@ -66,6 +104,31 @@ typedef union modscript_struct_t {
 } modscript_struct_t;
 
 
+/**
+* Empty the script cache of the ME.
+*
+* Local memory is not cleared at load, so this must be called by one
+* context of each ME before any context of the ME looks up or writes a
+* script.  pktio_tx_init() does this for pktio users.  Does nothing if
+* MODSCRIPT_CACHE_SIZE is 0.
+*/
+__intrinsic void modscript_cache_init(void);
+
+
+/**
+* Lookup the appropriate rewrite script from pkt_mod_script_tbl using the
+* provided offset without writing it.  The script goes to
+* script->prepend_offset in the packet buffer and is
+* script->prepend_len0 words long, so one lookup serves every packet at
+* the same offset.
+*
+* @param off    Start of data in pbuf (used to calculate modifier script)
+* @param script The script and where to write it
+* @return       Returns pkt_msi_info, off_enc is 0 if off is unsupported
+*/
+__intrinsic struct pkt_ms_info modscript_lookup(unsigned char off,
+                    __gpr modscript_struct_t *script);
+
 
 /**
 * Lookup the appropriate rewrite script from pkt_mod_script_tbl using the
@@ -97,5 +160,64 @@ __intrinsic struct pkt_ms_info __modscript_write(__mem40 void *pbuf,
                     __xread unsigned int *rdback, SIGNAL *sig1,
                     SIGNAL *sig2);
 
+
+/**
+* Build a direct script making one edit to the packet and write it to pbuf
+* in front of the packet.
+*
+* @param pbuf   Packet buffer
+* @param off    Start of data in pbuf, as for modscript_write()
+* @param act    MODSCRIPT_ACT_DELETE, MODSCRIPT_ACT_REPLACE or
+*               MODSCRIPT_ACT_INSERT
+* @param at     Offset of the edit from the start of data
+* @param len    Bytes to delete, replace or insert, 1 to
+*               MODSCRIPT_EDIT_MAX_LEN
+* @param data   Bytes to replace or insert, MODSCRIPT_EDIT_MAX_LEN bytes
+*               as big endian words of which the first len are used
+* @return       Returns pkt_msi_info, off_enc is 0 if the edit is not
+*               supported at this offset
+*
+* The packet modifier removes, overwrites or inserts the bytes at egress,
+* so headers such as VLAN tags, MPLS labels or small tunnel headers can be
+* pushed, popped or rewritten without moving the packet data.  The script
+* is a header word followed by the data, padded to 8B, and ends where the
+* packet starts, so a replace or insert needs off to be 8B aligned.  A
+* delete at offset 0 also removes the bytes between an 8B aligned script
+* and an unaligned off, which must total no more than
+* MODSCRIPT_EDIT_MAX_LEN.  Edits further into the packet than
+* MODSCRIPT_EDIT_MAX_AT, or that need the script above MODSCRIPT_MAX_OFF
+* or below offset 8, are not supported.
+*
+* Larger edits, e.g. pushing a VXLAN header, are left to the ME: unlike an
+* edit in the middle of the packet, a prepend needs no data to move when
+* off leaves room for it.
+*/
+__intrinsic struct pkt_ms_info modscript_edit_write(__mem40 void *pbuf,
+                    unsigned char off, unsigned int act, unsigned int at,
+                    unsigned int len, __lmem uint32_t *data);
+
+/**
+* Build a direct script making one edit to the packet and write it to pbuf.
+* All signals are passed to calling function for optimisation.
+*
+* @param pbuf   Packet buffer
+* @param off    Start of data in pbuf
+* @param act    Edit, see modscript_edit_write()
+* @param at     Offset of the edit from the start of data
+* @param len    Bytes to delete, replace or insert
+* @param data   Bytes to replace or insert, as big endian words
+* @param pwrite The script write xfer, MODSCRIPT_EDIT_MAX_SZ bytes
+* @param rdback The read value
+* @param sig1   The write signal to use
+* @param sig2   The read back signal to use
+* @return       Returns pkt_msi_info, off_enc is 0 if not supported, in
+*               which case no signal is raised
+*/
+__intrinsic struct pkt_ms_info __modscript_edit_write(__mem40 void *pbuf,
+                    unsigned char off, unsigned int act, unsigned int at,
+                    unsigned int len, __lmem uint32_t *data,
+                    __xwrite uint32_t *pwrite, __xread unsigned int *rdback,
+                    SIGNAL *sig1, SIGNAL *sig2);
+
 #endif /* __MODSCRIPT_H__ */
 
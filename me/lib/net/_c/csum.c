@@ -24,11 +24,48 @@
 #include <std/reg_utils.h>
 #include <net/ip.h>
 #include <net/csum.h>
+#include <net/sctp.h>
+#include <nfp/me.h>
 #include <nfp/mem_bulk.h>
 
 #define UINT32_REG(_a) ((__is_in_lmem(_a)) ? ((__lmem uint32_t *)_a)        \
                                            : ((__gpr  uint32_t *)_a))
 
+/* Swap the two bytes of a folded 16 bit one's complement sum */
+#define ONES_SUM_SWAP16(_s) ((((_s) << 8) | ((_s) >> 8)) & 0xFFFF)
+
+/* Reverse the bit order within each byte of a 32 bit word */
+#define CSUM_BITREV8X4(_v)                                                  \
+do {                                                                        \
+    _v = ((_v >> 4) & 0x0F0F0F0F) | ((_v & 0x0F0F0F0F) << 4);               \
+    _v = ((_v >> 2) & 0x33333333) | ((_v & 0x33333333) << 2);               \
+    _v = ((_v >> 1) & 0x55555555) | ((_v & 0x55555555) << 1);               \
+} while (0)
+
+/*
+ * Skip the first _skip bytes of a packet which is split between a CTM
+ * buffer and a memory buffer.  _mem_off is set to the offset of the first
+ * remaining memory byte relative to the start of the original stream.
+ */
+#define CSUM_SPLIT_SKIP(_ctm, _ctm_len, _mem, _mem_len, _skip, _mem_off)    \
+do {                                                                        \
+    _mem_off = _ctm_len;                                                    \
+    if (_skip >= _ctm_len) {                                                \
+        _skip -= _ctm_len;                                                  \
+        _ctm_len = 0;                                                       \
+        if (_skip >= _mem_len) {                                            \
+            _mem_len = 0;                                                   \
+        } else {                                                            \
+            _mem_len -= _skip;                                              \
+            ((__mem40 uint8_t *)_mem) += _skip;                             \
+            _mem_off += _skip;                                              \
+        }                                                                   \
+    } else {                                                                \
+        _ctm_len -= _skip;                                                  \
+        ((__mem40 uint8_t *)_ctm) += _skip;                                 \
+    }                                                                       \
+} while (0)
+
 __intrinsic uint32_t
 ones_sum_add(uint32_t sum1, uint32_t sum2)
 {
@@ -158,34 +195,190 @@ ones_sum_warr(__xread uint32_t *buf, uint32_t len)
     return sum;
 }
 
+/*
+ * Issue a read of the next chunk (up to 64B) of a memory region into one of
+ * the ones_sum_mem() transfer register buffers.
+ */
+#define ONES_SUM_MEM_ISSUE(_buf, _ptr, _len, _chunk, _sig)                   \
+do {                                                                        \
+    if (_len > sizeof(_buf))                                                \
+        _chunk = sizeof(_buf);                                              \
+    else                                                                    \
+        _chunk = _len;                                                      \
+    /* The read size must be a mult of 8 bytes */                           \
+    __mem_read64(_buf, _ptr, ((_chunk + 7) & 0x78), sizeof(_buf),           \
+                 sig_done, &_sig);                                          \
+    ((__mem40 uint8_t*)_ptr) += _chunk;                                     \
+    _len -= _chunk;                                                         \
+} while (0)
+
 /* computes the checksum over a memory region */
 /* len can be arbitrary */
 __intrinsic uint32_t
 ones_sum_mem(__mem40 void *mem, int32_t len)
+{
+    __xread uint32_t pkt_cache0[16];
+    __xread uint32_t pkt_cache1[16];
+    __gpr int len0;
+    __gpr int len1;
+    __mem40 void* pkt_ptr;
+    SIGNAL read_sig0;
+    SIGNAL read_sig1;
+    __gpr uint32_t sum = 0;
+
+    if (len <= 0)
+        return sum;
+
+    /*
+     * Double buffered: the read for the next chunk is always in flight
+     * while the current chunk is being summed, so the memory latency is
+     * only exposed once per region rather than once per chunk.
+     */
+    pkt_ptr = mem;
+    ONES_SUM_MEM_ISSUE(pkt_cache0, pkt_ptr, len, len0, read_sig0);
+    for (;;) {
+        len1 = 0;
+        if (len > 0)
+            ONES_SUM_MEM_ISSUE(pkt_cache1, pkt_ptr, len, len1, read_sig1);
+
+        wait_for_all(&read_sig0);
+        sum = ones_sum_add(sum, ones_sum_warr(pkt_cache0, len0));
+        __implicit_read(pkt_cache0);
+        if (len1 == 0)
+            break;
+
+        len0 = 0;
+        if (len > 0)
+            ONES_SUM_MEM_ISSUE(pkt_cache0, pkt_ptr, len, len0, read_sig0);
+
+        wait_for_all(&read_sig1);
+        sum = ones_sum_add(sum, ones_sum_warr(pkt_cache1, len1));
+        __implicit_read(pkt_cache1);
+        if (len0 == 0)
+            break;
+    }
+
+    return sum;
+}
+
+/* computes the checksum over a packet split between CTM and memory */
+__intrinsic uint32_t
+ones_sum_split(__mem40 void *pkt_ctm, uint32_t ctm_len,
+               __mem40 void *pkt_mem, uint32_t mem_len, uint32_t skip)
+{
+    __gpr uint32_t sum = 0;
+    __gpr uint32_t mem_sum;
+    __gpr uint32_t mem_off;
+
+    CSUM_SPLIT_SKIP(pkt_ctm, ctm_len, pkt_mem, mem_len, skip, mem_off);
+
+    if (ctm_len > 0)
+        sum = ones_sum_mem(pkt_ctm, ctm_len);
+
+    if (mem_len > 0) {
+        mem_sum = ones_sum_mem(pkt_mem, mem_len);
+
+        /* If the memory part starts at an odd offset, its bytes fall in
+         * the opposite lanes of the 16 bit sum (RFC1071, section 2.B). */
+        if (mem_off & 1)
+            mem_sum = ONES_SUM_SWAP16(ones_sum_fold16(mem_sum));
+
+        sum = ones_sum_add(sum, mem_sum);
+    }
+
+    return sum;
+}
+
+/*
+ * Feed a word array into the CRC unit using the CRC-32c polynomial,
+ * bit-swapping each byte on the way in to get the reflected CRC used by
+ * SCTP.  len must be <= 64.  The CRC remainder CSR is shared by all
+ * contexts, so it is loaded and returned explicitly.
+ */
+__intrinsic static uint32_t
+crc32c_refl_warr(__xread uint32_t *buf, uint32_t len, uint32_t rem)
+{
+    __gpr uint32_t t_val;
+    __gpr uint32_t val;
+    __gpr uint32_t tail;
+    __gpr uint32_t nwords;
+    __gpr uint32_t nskip;
+
+    t_val = ((__ctx() << 5) | __xfer_reg_number(buf)) << 2;
+    __asm local_csr_wr[t_index, t_val]
+
+    crc_write(rem);
+
+    __asm __attribute(ASM_HAS_JUMP)
+    {
+        alu[nwords, --, B, len, >>2]
+        alu[nskip, 16, -, nwords]
+        jump[nskip, crc16w], targets[crc16w, crc15w, crc14w, crc13w,\
+                                     crc12w, crc11w, crc10w, crc09w,\
+                                     crc08w, crc07w, crc06w, crc05w,\
+                                     crc04w, crc03w, crc02w, crc01w,\
+                                     crc00w] , defer[1]
+            alu[--, --, B, 0]
+
+        crc16w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc15w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc14w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc13w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc12w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc11w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc10w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc09w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc08w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc07w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc06w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc05w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc04w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc03w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc02w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc01w:  crc_be[crc_iscsi, val, *$index++], bytes_0_3, bit_swap
+        crc00w:  alu[--, --, B, 0]
+    }
+
+    tail = len & 3;
+    if (tail > 0) {
+        __asm alu[val, --, B, *$index]
+        if (tail == 1) {
+            __asm crc_be[crc_iscsi, val, val], byte_0, bit_swap
+        } else if (tail == 2) {
+            __asm crc_be[crc_iscsi, val, val], bytes_0_1, bit_swap
+        } else {
+            __asm crc_be[crc_iscsi, val, val], bytes_0_2, bit_swap
+        }
+    }
+
+    return crc_read();
+}
+
+/* computes the reflected CRC-32c remainder over a memory region */
+__intrinsic static uint32_t
+crc32c_refl_mem(__mem40 void *mem, int32_t len, uint32_t rem)
 {
     __xread uint32_t pkt_cache[16];
     __gpr int curr_len;
     __mem40 void* pkt_ptr;
     SIGNAL read_sig;
-    __gpr uint32_t sum = 0;
 
-    if (len > 0) {
-        pkt_ptr = mem;
-        while (len > 0) {
-            if (len > sizeof(pkt_cache))
-                curr_len = sizeof(pkt_cache);
-            else
-                curr_len = len;
-            /* The read size must be a mult of 8 bytes */
-            __mem_read64(pkt_cache, pkt_ptr, ((curr_len + 7) & 0x78),
-                         sizeof(pkt_cache), ctx_swap, &read_sig);
-            sum = ones_sum_add(sum, ones_sum_warr(pkt_cache, curr_len));
-            __implicit_read(pkt_cache);
-            ((__mem40 uint8_t*)pkt_ptr) += curr_len;
-            len -= curr_len;
-        }
+    pkt_ptr = mem;
+    while (len > 0) {
+        if (len > sizeof(pkt_cache))
+            curr_len = sizeof(pkt_cache);
+        else
+            curr_len = len;
+        /* The read size must be a mult of 8 bytes */
+        __mem_read64(pkt_cache, pkt_ptr, ((curr_len + 7) & 0x78),
+                     sizeof(pkt_cache), ctx_swap, &read_sig);
+        rem = crc32c_refl_warr(pkt_cache, curr_len, rem);
+        __implicit_read(pkt_cache);
+        ((__mem40 uint8_t*)pkt_ptr) += curr_len;
+        len -= curr_len;
     }
-    return sum;
+
+    return rem;
 }
 
 __intrinsic uint16_t
@@ -252,8 +445,8 @@ net_csum_l4_ip(uint32_t ip_type, uint32_t protocol,
                __mem40 void* pkt_mem, uint32_t mem_len)
 {
     __gpr uint32_t sum = 0;
-    __gpr uint32_t tmp;
     __gpr uint32_t l4_len;
+    __gpr uint32_t hdr_len;
 
     ctassert(__is_in_reg_or_lmem(ip));
     ctassert(__is_in_reg_or_lmem(l4_hdr));
@@ -264,33 +457,19 @@ net_csum_l4_ip(uint32_t ip_type, uint32_t protocol,
         } else {
             l4_len = ((__gpr struct udp_hdr*)l4_hdr)->len;
         }
-        /* Skip UDP header */
-        if (ctm_len > 0) {
-            ctm_len -= sizeof(struct udp_hdr);
-            ((__mem40 uint8_t*)pkt_ctm) += sizeof(struct udp_hdr);
-        } else {
-            mem_len -= sizeof(struct udp_hdr);
-            ((__mem40 uint8_t*)pkt_mem) += sizeof(struct udp_hdr);
-        }
+        hdr_len = sizeof(struct udp_hdr);
     } else {
         l4_len = ctm_len + mem_len;
-
-        /* Skip basic TCP header */
-        if (ctm_len > 0) {
-            ctm_len -= sizeof(struct tcp_hdr);
-            ((__mem40 uint8_t*)pkt_ctm) += sizeof(struct tcp_hdr);
-        } else {
-            mem_len -= sizeof(struct tcp_hdr);
-            ((__mem40 uint8_t*)pkt_mem) += sizeof(struct tcp_hdr);
-        }
+        /* Basic TCP header only, any options are summed from the packet */
+        hdr_len = sizeof(struct tcp_hdr);
     }
 
     sum = ones_sum_pseudo(ip_type, protocol, ip, l4_hdr, l4_len);
 
-    if (ctm_len + mem_len  > 0) {
-        sum = ones_sum_add(sum, ones_sum_mem(pkt_ctm, ctm_len));
-        sum = ones_sum_add(sum, ones_sum_mem(pkt_mem, mem_len));
-    }
+    /* The L4 header is summed from registers above, skip it in the packet
+     * wherever it lies, including when it straddles the CTM/MU split. */
+    sum = ones_sum_add(sum, ones_sum_split(pkt_ctm, ctm_len, pkt_mem, mem_len,
+                                           hdr_len));
 
     return ~ones_sum_fold16(sum);
 }
@@ -342,3 +521,77 @@ net_csum_ipv6_tcp(void *ip, void *tcp,
     return net_csum_l4_ip(NET_ETH_TYPE_IPV6, NET_IP_PROTO_TCP, ip, tcp,
                           pkt_ctm, ctm_len, pkt_mem, mem_len);
 }
+
+__intrinsic uint16_t
+net_csum_icmp(__mem40 void *pkt_ctm, uint32_t ctm_len,
+              __mem40 void *pkt_mem, uint32_t mem_len)
+{
+    return ~ones_sum_fold16(ones_sum_split(pkt_ctm, ctm_len,
+                                           pkt_mem, mem_len, 0));
+}
+
+__intrinsic uint16_t
+net_csum_icmp6(void *ip,
+               __mem40 void *pkt_ctm, uint32_t ctm_len,
+               __mem40 void *pkt_mem, uint32_t mem_len)
+{
+    __gpr uint32_t sum = 0;
+
+    ctassert(__is_in_reg_or_lmem(ip));
+
+    /* Pseudo header: addresses, upper-layer length and next header */
+    sum = ones_sum_add(sum, UINT32_REG(ip)[2]);
+    sum = ones_sum_add(sum, UINT32_REG(ip)[3]);
+    sum = ones_sum_add(sum, UINT32_REG(ip)[4]);
+    sum = ones_sum_add(sum, UINT32_REG(ip)[5]);
+    sum = ones_sum_add(sum, UINT32_REG(ip)[6]);
+    sum = ones_sum_add(sum, UINT32_REG(ip)[7]);
+    sum = ones_sum_add(sum, UINT32_REG(ip)[8]);
+    sum = ones_sum_add(sum, UINT32_REG(ip)[9]);
+    sum = ones_sum_add(sum, ctm_len + mem_len);
+    sum = ones_sum_add(sum, NET_IP_PROTO_ICMPV6);
+
+    sum = ones_sum_add(sum, ones_sum_split(pkt_ctm, ctm_len,
+                                           pkt_mem, mem_len, 0));
+
+    return ~ones_sum_fold16(sum);
+}
+
+__intrinsic uint32_t
+net_csum_sctp(void *sctp,
+              __mem40 void *pkt_ctm, uint32_t ctm_len,
+              __mem40 void *pkt_mem, uint32_t mem_len)
+{
+    __gpr uint32_t rem = 0xFFFFFFFF;
+    __gpr uint32_t skip = NET_SCTP_LEN;
+    __gpr uint32_t mem_off;
+    __gpr uint32_t val;
+
+    ctassert(__is_in_reg_or_lmem(sctp));
+
+    /* The common header comes from registers, with the checksum field
+     * taken as zero so that a received packet can be verified in place. */
+    crc_write(rem);
+    val = UINT32_REG(sctp)[0];
+    __asm crc_be[crc_iscsi, val, val], bytes_0_3, bit_swap
+    val = UINT32_REG(sctp)[1];
+    __asm crc_be[crc_iscsi, val, val], bytes_0_3, bit_swap
+    __asm crc_be[crc_iscsi, val, 0], bytes_0_3, bit_swap
+    rem = crc_read();
+
+    CSUM_SPLIT_SKIP(pkt_ctm, ctm_len, pkt_mem, mem_len, skip, mem_off);
+
+    if (ctm_len > 0)
+        rem = crc32c_refl_mem(pkt_ctm, ctm_len, rem);
+    if (mem_len > 0)
+        rem = crc32c_refl_mem(pkt_mem, mem_len, rem);
+
+    /* The CRC unit produces the remainder MSB first.  The reflected CRC is
+     * its full bit reversal, which SCTP stores least significant byte
+     * first, so as a big-endian word only the bits within each byte need
+     * reversing. */
+    rem = ~rem;
+    CSUM_BITREV8X4(rem);
+
+    return rem;
+}
@@ -25,16 +25,21 @@
 
 /**
  * This file contains API for 16bit one's complement checksum calculations.
- * Currently supporting IPv4 header checksum and TCP/UDP checksum for both
- * IPv4 and IPv6.
- * No current support for ICMP or ICMPv6 checksum.
+ * Currently supporting IPv4 header checksum, TCP/UDP checksum for both
+ * IPv4 and IPv6, ICMP and ICMPv6 checksum, and the SCTP CRC-32c checksum
+ * (computed using the ME CRC unit).
+ *
+ * Packets are described by a CTM part and an External memory part, and the
+ * calculations stream across the boundary between the two, so there is no
+ * need to DMA the remainder of a large packet back into CTM first.  The L4
+ * header may straddle the split; the part of the packet covered by a header
+ * passed in registers is skipped wherever it lies.  If the CTM part ends on
+ * an odd byte, the sum of the External memory part is byte swapped before
+ * being accumulated (RFC1071).
  *
  * Few assumptions and limitations :
  * - The pkt buffer pointers (for both CTM and External memory) are assumed
  *   to be pointing to a 2 byte aligned address.
- * - L4 headers should not split between the CTM and External memory parts.
- * - If CTM buffer exists it is assumed that the packet headers are placed
- *   in CTM.
  */
 
 /**
@@ -83,9 +88,29 @@ __intrinsic uint32_t ones_sum_warr(__xread uint32_t *buf, uint32_t len);
  * @param buf   The buffer of 32 bits words
  * @param len   The length (in bytes) of the memory region, can be arbitrary
  * @return A 32 bits sum of the entire array
+ *
+ * The region is read in 64B chunks into two sets of 16 transfer registers,
+ * with the read of the next chunk issued before the current one is summed.
  */
 __intrinsic uint32_t ones_sum_mem(__mem40 void *mem, int32_t len);
 
+/**
+ * Compute checksum over a packet split between CTM and External memory.
+ * @param pkt_ctm   Address of the start of the region in CTM
+ * @param ctm_len   The length of the region in CTM (can be 0)
+ * @param pkt_mem   Memory Unit Address of the remainder of the region
+ * @param mem_len   The length of the region in External memory (can be 0)
+ * @param skip      Number of bytes at the start of the region to leave out
+ *                  of the sum, may extend beyond the CTM part
+ * @return A 32 bits sum of the region, excluding the first @skip bytes
+ *
+ * The region is treated as a single byte stream made of the CTM part
+ * followed by the External memory part.  @skip must be even.
+ */
+__intrinsic uint32_t ones_sum_split(__mem40 void *pkt_ctm, uint32_t ctm_len,
+                                    __mem40 void *pkt_mem, uint32_t mem_len,
+                                    uint32_t skip);
+
 /**
  * Recalculate the checksum based on a single 16 bit value change.
  * @param orig_csum Original header checksum
@@ -154,15 +179,13 @@ __intrinsic uint16_t __net_csum_ipv4(void *ip, __mem40 void *pkt_ptr,
  * @param l4_hdr    Pointer to the L4 header
  * @param pkt_ctm   Address of the start of the L4 header in CTM
  * @param ctm_len   The length of the L4 header + payload in CTM (can be 0).
- *                  Must be at least 8 for UDP and 20 for TCP if there is
- *                  a CTM buffer.
  * @param pkt_mem   Memory Unit Address of the remainder of the packet
- *                  contents not in CTM. May include the UDP/TCP header if
- *                  there is no CTM buffer.
- * @param mem_len   The length of the payload (and optionally L4 header if no
- *                  CTM) in external memory (can be 0).
- *                  Must be at least 8 for UDP and 20 for TCP if there is
- *                  no CTM buffer.
+ *                  contents not in CTM. May include all or part of the
+ *                  UDP/TCP header.
+ * @param mem_len   The length of the payload (and any part of the L4 header
+ *                  not in CTM) in external memory (can be 0).
+ *                  @ctm_len + @mem_len must be at least 8 for UDP and 20
+ *                  for TCP.
  * @return The calculated checksum
  *
  * @ip and @l4_hdr must be located in LMEM or GPRs.
@@ -195,13 +218,12 @@ __intrinsic uint16_t net_csum_l4_ip(uint32_t ip_type, uint32_t protocol,
  * @param udp       Pointer to the UDP header
  * @param pkt_ctm   Address of the start of the L4 header in CTM
  * @param ctm_len   The length of the L4 header + payload in CTM (can be 0).
- *                  Must be at least 8 if there is a CTM buffer.
  * @param pkt_mem   Memory Unit Address of the remainder of the packet
- *                  contents not in CTM. May include the UDP header if there
- *                  is no CTM buffer.
- * @param mem_len   The length of the payload (and optionally L4 header if no
- *                  CTM) in external memory (can be 0).
- *                  Must be at least 8 if there is no CTM buffer.
+ *                  contents not in CTM. May include all or part of the
+ *                  UDP header.
+ * @param mem_len   The length of the payload (and any part of the L4 header
+ *                  not in CTM) in external memory (can be 0).
+ *                  @ctm_len + @mem_len must be at least 8.
  * @return The calculated checksum
  *
  * @ip (struct ip4_hdr) and @udp (struct udp_hdr) must be located in LMEM
@@ -231,13 +253,12 @@ __intrinsic uint16_t net_csum_ipv4_udp(void *ip, void *udp,
  * @param pkt_ctm   Address of the start of the L4 header in CTM
  * @param ctm_len   The length of the L4 header (including optional TCP
  *                  options) + payload in CTM (can be 0).
- *                  Must be at least 20 if there is a CTM buffer.
  * @param pkt_mem   Memory Unit Address of the remainder of the packet
- *                  contents not in CTM. May include the TCP header if there
- *                  is no CTM buffer.
- * @param mem_len   The length of the payload (and optionally L4 header if no
- *                  CTM) in external memory (can be 0).
- *                  Must be at least 20 if there is no CTM buffer.
+ *                  contents not in CTM. May include all or part of the
+ *                  TCP header.
+ * @param mem_len   The length of the payload (and any part of the L4 header
+ *                  not in CTM) in external memory (can be 0).
+ *                  @ctm_len + @mem_len must be at least 20.
  * @return The calculated checksum
  *
  * @ip (struct ip4_hdr) and @tcp (struct tcp_hdr) must be located in
@@ -265,13 +286,12 @@ __intrinsic uint16_t net_csum_ipv4_tcp(void *ip, void *tcp,
  * @param udp       Pointer to the UDP header
  * @param pkt_ctm   Address of the start of the L4 header in CTM
  * @param ctm_len   The length of the L4 header + payload in CTM (can be 0).
- *                  Must be at least 8 if there is a CTM buffer.
  * @param pkt_mem   Memory Unit Address of the remainder of the packet
- *                  contents not in CTM. May include the UDP header if there
- *                  is no CTM buffer.
- * @param mem_len   The length of the payload (and optionally L4 header if no
- *                  CTM) in external memory (can be 0).
- *                  Must be at least 8 if there is no CTM buffer.
+ *                  contents not in CTM. May include all or part of the
+ *                  UDP header.
+ * @param mem_len   The length of the payload (and any part of the L4 header
+ *                  not in CTM) in external memory (can be 0).
+ *                  @ctm_len + @mem_len must be at least 8.
  * @return The calculated checksum
  *
  * @ip (struct ip6_hdr) and @udp (struct udp_hdr) must be located in
@@ -301,13 +321,12 @@ __intrinsic uint16_t net_csum_ipv6_udp(void *ip, void *udp,
  * @param pkt_ctm   Address of the start of the L4 header in CTM
  * @param ctm_len   The length of the L4 header (including optional TCP
  *                  options) + payload in CTM (can be 0).
- *                  Must be at least 20 if there is a CTM buffer.
  * @param pkt_mem   Memory Unit Address of the remainder of the packet
- *                  contents not in CTM. May include the TCP header if there
- *                  is no CTM buffer.
- * @param mem_len   The length of the payload (and optionally L4 header if no
- *                  CTM) in external memory (can be 0).
- *                  Must be at least 20 if there is no CTM buffer.
+ *                  contents not in CTM. May include all or part of the
+ *                  TCP header.
+ * @param mem_len   The length of the payload (and any part of the L4 header
+ *                  not in CTM) in external memory (can be 0).
+ *                  @ctm_len + @mem_len must be at least 20.
  * @return The calculated checksum
  *
  * @ip (struct ip6_hdr) and @tcp (struct tcp_hdr) must be located in
@@ -329,4 +348,64 @@ __intrinsic uint16_t net_csum_ipv6_tcp(void *ip, void *tcp,
                                        __mem40 void *pkt_mem,
                                        uint32_t mem_len);
 
-#endif /* _PKT_CSUM_H_ */
+/**
+ * Calculate the checksum of an ICMP message.
+ * @param pkt_ctm   Address of the start of the ICMP header in CTM
+ * @param ctm_len   The length of the ICMP message in CTM (can be 0)
+ * @param pkt_mem   Memory Unit Address of the remainder of the message
+ * @param mem_len   The length of the ICMP message in External memory
+ *                  (can be 0)
+ * @return The calculated checksum
+ *
+ * The ICMP header is read from the packet.  For checksum calculation the
+ * user must zero the checksum field in the ICMP header.  For checksum
+ * verification 0 will be returned if the checksum value is correct.
+ */
+__intrinsic uint16_t net_csum_icmp(__mem40 void *pkt_ctm, uint32_t ctm_len,
+                                   __mem40 void *pkt_mem, uint32_t mem_len);
+
+/**
+ * Calculate the checksum of an ICMPv6 message.
+ * @param ip        Pointer to the IPv6 header
+ * @param pkt_ctm   Address of the start of the ICMPv6 header in CTM
+ * @param ctm_len   The length of the ICMPv6 message in CTM (can be 0)
+ * @param pkt_mem   Memory Unit Address of the remainder of the message
+ * @param mem_len   The length of the ICMPv6 message in External memory
+ *                  (can be 0)
+ * @return The calculated checksum
+ *
+ * @ip (struct ip6_hdr) must be located in LMEM or GPRs.
+ *
+ * The pseudo header uses @ctm_len + @mem_len as the upper-layer packet
+ * length, so any IPv6 extension headers must not be included in the
+ * message.  The checksum field is handled as for net_csum_icmp().
+ */
+__intrinsic uint16_t net_csum_icmp6(void *ip,
+                                    __mem40 void *pkt_ctm, uint32_t ctm_len,
+                                    __mem40 void *pkt_mem, uint32_t mem_len);
+
+/**
+ * Calculate the CRC-32c checksum of an SCTP packet.
+ * @param sctp      Pointer to the SCTP common header
+ * @param pkt_ctm   Address of the start of the SCTP header in CTM
+ * @param ctm_len   The length of the SCTP packet in CTM (can be 0)
+ * @param pkt_mem   Memory Unit Address of the remainder of the packet
+ * @param mem_len   The length of the SCTP packet in External memory
+ *                  (can be 0)
+ * @return The checksum, in the form to be stored in sctp_hdr.sum
+ *
+ * @sctp (struct sctp_hdr) must be located in LMEM or GPRs.
+ *
+ * The checksum field of @sctp is treated as zero, as required by RFC4960,
+ * so the packet does not need to be modified for verification: compare
+ * the return value against the received sctp_hdr.sum instead.
+ *
+ * The calculation uses the ME CRC unit.  The CRC remainder CSR is shared
+ * between contexts and is saved around every memory access, so this is
+ * safe to use from multiple contexts.
+ */
+__intrinsic uint32_t net_csum_sctp(void *sctp,
+                                   __mem40 void *pkt_ctm, uint32_t ctm_len,
+                                   __mem40 void *pkt_mem, uint32_t mem_len);
+
+#endif /* _NET_CSUM_H_ */
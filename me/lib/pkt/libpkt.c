@@ -434,6 +434,54 @@ pkt_nbi_send_dont_free(unsigned char isl, unsigned int pnum,
 }
 
 
+__intrinsic void
+pkt_nbi_send_free_on_last(unsigned char isl, unsigned int pnum,
+                          __gpr const struct pkt_ms_info *msi,
+                          unsigned int len, unsigned int nbi,
+                          unsigned int txq, unsigned int seqr,
+                          unsigned int seq, enum PKT_CTM_SIZE ctm_buf_size)
+{
+    __gpr unsigned int addr_hi;
+    __gpr unsigned int addr_lo;
+    __gpr struct pkt_iref_csr0 csr0;
+    __gpr struct pkt_iref_palu palu;
+
+    /*
+     * The "packet ready" commands require a special encoding in the address
+     * field, which include the length, or _ending_offset_, of the packet.
+     * To get the ending offset, we add the packet length to the starting
+     * offset of the packet, including any MAC egress command word.  The
+     * starting offset is encoded in the 'msi->len_adj' field.
+     *
+     * See NFP 6xxx Databook Section 9.2.2.7.9 "Packet Processing Complete
+     * Target Command and Packet Ready Master Command"
+     */
+    addr_hi = PKT_READY_ADDR_HI_FIELDS(nbi, isl, __ME());
+    addr_lo = PKT_READY_ADDR_LO_FIELDS(pnum, len + msi->len_adj);
+
+    csr0.__raw = 0;
+    csr0.seqr = seqr;
+    csr0.seq = seq;
+    local_csr_write(local_csr_cmd_indirect_ref_0, csr0.__raw);
+
+    /*
+     * XXX We clear the reserved bits of the previous ALU instruction
+     * structure by assigning the whole 32-bit value the MAGIC constant.
+     * This constant starts at bit 0 of the structure anyways.
+     */
+    palu.__raw = PKT_IREF_PALU_MAGIC;
+    palu.nbi = (unsigned int)ctm_buf_size;
+    palu.txq = txq;
+    palu.ms_off = msi->off_enc;
+
+    __asm {
+        alu[--, --, B, palu.__raw];
+        nbi[packet_ready_multicast_free_on_last, --, addr_hi, <<8, addr_lo], \
+            indirect_ref;
+    }
+}
+
+
 __intrinsic void
 pkt_nbi_drop_seq(unsigned char isl, unsigned int pnum,
                  __gpr const struct pkt_ms_info *msi,
@@ -611,3 +659,153 @@ pkt_ctm_get_credits(__cls struct ctm_pkt_credits *credits,
             ctx_swap[sig_cls];
     }
 }
+
+/* Return the credits of a per-ME cache above 'keep' to the island */
+__intrinsic static void
+pkt_ctm_cache_trim(__cls struct ctm_pkt_credits *credits,
+                   __shared __lmem struct ctm_pkt_credits *cache,
+                   unsigned int keep)
+{
+    __xwrite struct ctm_pkt_credits credits_add_back;
+    SIGNAL sig_cls;
+    unsigned int pkts = 0;
+    unsigned int bufs = 0;
+
+    /* Take the credits out of the cache before swapping out */
+    if (cache->pkts > keep) {
+        pkts = cache->pkts - keep;
+        cache->pkts = keep;
+    }
+    if (cache->bufs > keep) {
+        bufs = cache->bufs - keep;
+        cache->bufs = keep;
+    }
+
+    if (pkts == 0 && bufs == 0)
+        return;
+
+    credits_add_back.pkts = pkts;
+    credits_add_back.bufs = bufs;
+    __asm cls[add, credits_add_back, credits, 0, 2], ctx_swap[sig_cls];
+}
+
+/* Add credits returned by the PE to a per-ME cache */
+__intrinsic static void
+pkt_ctm_cache_add(__cls struct ctm_pkt_credits *credits,
+                  __shared __lmem struct ctm_pkt_credits *cache,
+                  unsigned int pkts, unsigned int bufs)
+{
+    cache->pkts += pkts;
+    cache->bufs += bufs;
+
+    if (cache->pkts > PKT_CTM_CREDIT_CACHE_MAX ||
+        cache->bufs > PKT_CTM_CREDIT_CACHE_MAX)
+        pkt_ctm_cache_trim(credits, cache, PKT_CTM_CREDIT_BATCH);
+}
+
+/* Take one packet and one buffer credit from a per-ME cache */
+__intrinsic static void
+pkt_ctm_cache_get_credit(__cls struct ctm_pkt_credits *credits,
+                         __shared __lmem struct ctm_pkt_credits *cache,
+                         int replenish_credits)
+{
+    __xrw struct ctm_pkt_credits credits_update;
+    SIGNAL sig_cls;
+    unsigned int pkts;
+    unsigned int bufs;
+
+    while (cache->pkts == 0 || cache->bufs == 0) {
+        /* Refill what ran out with a batch from the island.  The subtract
+         * saturates, so if the island has less than a batch left we get
+         * what it has (the value before the sub). */
+        pkts = (cache->pkts == 0) ? PKT_CTM_CREDIT_BATCH : 0;
+        bufs = (cache->bufs == 0) ? PKT_CTM_CREDIT_BATCH : 0;
+        credits_update.pkts = pkts;
+        credits_update.bufs = bufs;
+        __asm cls[test_subsat, credits_update, credits, 0, 2], \
+            ctx_swap[sig_cls];
+
+        if (credits_update.pkts < pkts)
+            pkts = credits_update.pkts;
+        if (credits_update.bufs < bufs)
+            bufs = credits_update.bufs;
+        cache->pkts += pkts;
+        cache->bufs += bufs;
+
+        if (cache->pkts != 0 && cache->bufs != 0)
+            break;
+
+        /* The island ran out of packet or buffer credits.  Return the
+         * other kind, so that MEs do not each hold what the other needs,
+         * and wait for both */
+        pkt_ctm_cache_trim(credits, cache, 0);
+        sleep(PKT_CTM_CRED_ALLOC_FAIL_SLEEP);
+
+        if (replenish_credits)
+            pkt_ctm_cache_poll_pe_credit(credits, cache);
+    }
+
+    cache->pkts--;
+    cache->bufs--;
+}
+
+__intrinsic unsigned int
+pkt_ctm_cache_alloc(__cls struct ctm_pkt_credits *credits,
+                    __shared __lmem struct ctm_pkt_credits *cache,
+                    unsigned char isl, enum PKT_CTM_SIZE size,
+                    int replenish_credits)
+{
+    __gpr unsigned int addr_hi = 0;
+    __gpr unsigned int addr_lo = 0;
+    __gpr unsigned int ind;
+    __xread struct pe_pkt_alloc_res pe_res;
+    SIGNAL sig_alloc;
+    __gpr unsigned int pnum;
+
+    pkt_ctm_cache_get_credit(credits, cache, replenish_credits);
+
+    if (isl != 0)
+        addr_hi = (0x80 | isl) << 24;
+
+    ind = size << NFP_MECSR_PREV_ALU_LENGTH_shift;
+    __asm {
+        alu[ind, ind, OR, 1, <<NFP_MECSR_PREV_ALU_OV_LEN_bit];
+        mem[packet_alloc_poll, pe_res, addr_hi, <<8, addr_lo, 1],\
+            indirect_ref, ctx_swap[sig_alloc];
+    }
+
+    /* An all 1s response indicates failure to allocate */
+    if (pe_res.__raw == 0xffffffff) {
+        pnum = 0xffffffff;
+    } else {
+        pnum = pe_res.pnum;
+        if ((pe_res.pkt_credit > 0) || (pe_res.buf_credit > 0))
+            pkt_ctm_cache_add(credits, cache, pe_res.pkt_credit,
+                              pe_res.buf_credit);
+    }
+
+    return pnum;
+}
+
+__intrinsic void
+pkt_ctm_cache_poll_pe_credit(__cls struct ctm_pkt_credits *credits,
+                             __shared __lmem struct ctm_pkt_credits *cache)
+{
+    __xread struct pe_credit_get_res pe_res;
+    SIGNAL sig_pe;
+    __gpr unsigned int master = 0;
+
+    /* poll for returned credits */
+    __asm mem[packet_credit_get, pe_res, 0, <<8, master, 1], ctx_swap[sig_pe];
+
+    if ((pe_res.pkt_credit > 0) || (pe_res.buf_credit > 0))
+        pkt_ctm_cache_add(credits, cache, pe_res.pkt_credit,
+                          pe_res.buf_credit);
+}
+
+__intrinsic void
+pkt_ctm_cache_put_credits(__cls struct ctm_pkt_credits *credits,
+                          __shared __lmem struct ctm_pkt_credits *cache)
+{
+    pkt_ctm_cache_trim(credits, cache, 0);
+}
@@ -530,6 +530,21 @@ struct ctm_pkt_credits {
 #define PKT_CTM_CRED_ALLOC_FAIL_SLEEP 1000
 #endif
 
+/* Credits taken at a time by pkt_ctm_cache_alloc() from the island */
+#ifndef PKT_CTM_CREDIT_BATCH
+#define PKT_CTM_CREDIT_BATCH 8
+#endif
+
+/* Credits held by a per-ME cache above which it returns all but a batch */
+#ifndef PKT_CTM_CREDIT_CACHE_MAX
+#define PKT_CTM_CREDIT_CACHE_MAX (4 * PKT_CTM_CREDIT_BATCH)
+#endif
+
+#if (PKT_CTM_CREDIT_BATCH == 0 || \
+     PKT_CTM_CREDIT_CACHE_MAX < 2 * PKT_CTM_CREDIT_BATCH)
+#error "PKT_CTM_CREDIT_CACHE_MAX must be at least 2 * PKT_CTM_CREDIT_BATCH"
+#endif
+
 /**
  * Packet Engine response for packet_alloc commands.
  */
@@ -824,6 +839,30 @@ __intrinsic void pkt_nbi_send_dont_free(unsigned char isl, unsigned int pnum,
                                         unsigned int seq,
                                         enum PKT_CTM_SIZE ctm_buf_size);
 
+/**
+ * Send a packet to an NBI port as the last of a multicast, after sending it
+ * with pkt_nbi_send_dont_free() to the other ports.  Notifies sequencer.
+ * The packet is freed once every multicast send of it has been transmitted.
+ * @param isl           Island of the CTM packet
+ * @param pnum          Packet number of the CTM packet
+ * @param msi           Modification script info required for transmission
+ * @param len           Length of the packet from the start of the
+ *                      packet data (which immediately follows the rewrite
+ *                      script plus padding)
+ * @param nbi           NBI TM to send the packet to
+ * @param txq           NBI TM TX queue to send the packet to
+ * @param seqr          NBI TM sequencer to send the packet to
+ * @param seq           NBI TM sequence number of the packet
+ * @param ctm_buf_size  Encoded CTM buffer size
+ */
+__intrinsic void pkt_nbi_send_free_on_last(unsigned char isl,
+                                           unsigned int pnum,
+                                           __gpr const struct pkt_ms_info *msi,
+                                           unsigned int len, unsigned int nbi,
+                                           unsigned int txq, unsigned int seqr,
+                                           unsigned int seq,
+                                           enum PKT_CTM_SIZE ctm_buf_size);
+
 /**
  * Drop a packet sequence from an NBI port. Needed to keep sequencer happy.
  * @param isl           Island of the CTM packet
@@ -877,6 +916,33 @@ __intrinsic void pkt_nbi_drop_seq(unsigned char isl, unsigned int pnum,
  *
  *  6. Free CTM packets (using pkt_num from stage 4).
  *      pkt_ctm_free(isl_num, pkt_num);
+ *
+ *  Allocating with the credits of the island costs a CLS test_subsat
+ *  per packet, which all MEs of the island contend for.  An ME can
+ *  instead keep a cache of credits in local memory, taken from the
+ *  island PKT_CTM_CREDIT_BATCH at a time, and add the credits the PE
+ *  returns to it:
+ *
+ *  1. Allocate the cache, shared by the contexts of the ME, and empty it
+ *     from one context before the others use it, as local memory is not
+ *     cleared at load.
+ *      __shared __lmem struct ctm_pkt_credits my_cache;
+ *      my_cache.pkts = 0;
+ *      my_cache.bufs = 0;
+ *
+ *  2. Allocate packets with credits from the cache.
+ *      pkt_num = pkt_ctm_cache_alloc(&my_credits, &my_cache, isl_num,
+ *                                    PKT_CTM_SIZE_256, 1);
+ *
+ *  3. From one context, periodically poll the PE for credits.  Credits
+ *     go to the cache until it holds PKT_CTM_CREDIT_CACHE_MAX, then it
+ *     returns all but PKT_CTM_CREDIT_BATCH to the island.  The gap
+ *     between the two keeps the cache from taking and returning credits
+ *     on alternate packets.
+ *      pkt_ctm_cache_poll_pe_credit(&my_credits, &my_cache);
+ *
+ *  4. When the ME goes idle, return the cached credits to the island.
+ *      pkt_ctm_cache_put_credits(&my_credits, &my_cache);
  */
 
 /**
@@ -961,6 +1027,48 @@ __intrinsic void pkt_ctm_get_credits(__cls struct ctm_pkt_credits *credits,
                                      unsigned int buf_credits,
                                      int replenish_credits);
 
+/**
+ * Allocate a CTM packet buffer with credits from a per-ME cache.
+ * @param credits           Credits management struct of the island
+ * @param cache             Credits cached by the ME
+ * @param isl               Island of the CTM packet
+ * @param size              CTM buffer size (PKT_CTM_SIZE_*)
+ * @param replenish_credits Poll the PE for credits if the island has none
+ * @return the allocated packet number on success, 0xffffffff on failure
+ *
+ * Takes one packet and one buffer credit from @cache, refilling it with up
+ * to PKT_CTM_CREDIT_BATCH credits from @credits when empty, and blocks
+ * like pkt_ctm_get_credits() until credits are available.  Credits
+ * returned by the PE are added to @cache, which returns all but
+ * PKT_CTM_CREDIT_BATCH to @credits when it holds more than
+ * PKT_CTM_CREDIT_CACHE_MAX.
+ */
+__intrinsic unsigned int pkt_ctm_cache_alloc(
+    __cls struct ctm_pkt_credits *credits,
+    __shared __lmem struct ctm_pkt_credits *cache,
+    unsigned char isl, enum PKT_CTM_SIZE size, int replenish_credits);
+
+/**
+ * Poll for credits from the Packet Engine into a per-ME cache.
+ * @param credits   Credits management struct of the island
+ * @param cache     Credits cached by the ME
+ *
+ * Adds the polled credits to @cache, trimming it as pkt_ctm_cache_alloc()
+ * does.  Should be run periodically by one context of the ME.
+ */
+__intrinsic void pkt_ctm_cache_poll_pe_credit(
+    __cls struct ctm_pkt_credits *credits,
+    __shared __lmem struct ctm_pkt_credits *cache);
+
+/**
+ * Return all credits of a per-ME cache to the island.
+ * @param credits   Credits management struct of the island
+ * @param cache     Credits cached by the ME
+ */
+__intrinsic void pkt_ctm_cache_put_credits(
+    __cls struct ctm_pkt_credits *credits,
+    __shared __lmem struct ctm_pkt_credits *cache);
+
 #endif /* __NFP_LANG_MICROC */
 
 #endif /* !_PKT__PKT_H_ */
@@ -14,31 +14,178 @@
  * limitations under the License.
  *
  * @file        /lib/pktdma/libpktdma.c
- * @brief       Memory Unit Packet Engine DMA with semaphore protection
+ * @brief       Memory Unit Packet Engine DMA with DMA slot accounting
  */
 
 #include <nfp.h>
 #include <stdint.h>
 #include <types.h>
 
+#include <nfp/cls.h>
+#include <std/reg_utils.h>
 #include <std/synch.h>
+#include <nfp/me.h>
+#include <nfp/mem_bulk.h>
 #include <nfp/mem_pe.h>
 #include <nfp/mem_atomic.h>
 
+#include <pktdma/pktdma.h>
+
 /* You may have no more than 16 outstanding DMA commands per CTM. */
 #define DMA_CMDS_PER_CTM   16
 
+#ifdef PKTDMA_SLOT_PARTS_ENABLED
+
+/*
+ * With PKTDMA_SLOT_PARTS_ENABLED, the DMA slots of the CTM are counted in
+ * PKTDMA_SLOT_PARTS partitions of free slots in CLS instead of by the
+ * semaphore.  An ME takes slots from its own partition with a
+ * saturating subtract, and steals from the other partitions when its own
+ * runs short.  Slots are returned to the partition of the ME returning
+ * them, so free slots drift to the MEs using them.  The sum of the free
+ * slots and the slots taken is always DMA_CMDS_PER_CTM, and the counts
+ * never go below zero, so no more than DMA_CMDS_PER_CTM commands are ever
+ * outstanding.
+ *
+ * A claim that cannot be met returns the slots it got, so that claims do
+ * not hold each other up.  That alone lets small claims starve large
+ * ones, so after PKTDMA_SLOT_STARVE failed attempts a claim tries to take
+ * the hoard token.  While it is held, the holder keeps its slots across
+ * attempts and other claims do not take any, so the holder gathers slots
+ * as they are returned.  Only one claim holds the token at a time.
+ *
+ * user/tools/pktdma_slots_model.c measures both schemes.  The partitions
+ * serve claims at several times the rate of the semaphore, but the
+ * longest wait of a claim is several times as long, so the semaphore
+ * remains the default.
+ */
+#define PKTDMA_SLOT_PARTS       4
+#define PKTDMA_SLOTS_PER_PART   (DMA_CMDS_PER_CTM / PKTDMA_SLOT_PARTS)
+
+__export __shared __cls uint32_t pktdma_slots[PKTDMA_SLOT_PARTS] = {
+    PKTDMA_SLOTS_PER_PART, PKTDMA_SLOTS_PER_PART,
+    PKTDMA_SLOTS_PER_PART, PKTDMA_SLOTS_PER_PART};
+
+/* Set while a starving claim keeps the slots it has got */
+__export __shared __cls uint32_t pktdma_slots_hoard;
+
+/* Failed attempts before a claim tries to take the hoard token */
+#ifndef PKTDMA_SLOT_STARVE
+#define PKTDMA_SLOT_STARVE      4
+#endif
+
+/* Partition of this ME */
+#define PKTDMA_SLOT_PART    ((__MEID & 0xf) % PKTDMA_SLOT_PARTS)
+
+/* Take up to n free slots of a partition, return the number taken */
+__intrinsic static unsigned int
+pktdma_slots_take_part(unsigned int part, unsigned int n)
+{
+    __cls uint32_t *addr = &pktdma_slots[part];
+    __xrw uint32_t slots_xrw = n;
+    SIGNAL sig;
+
+    /* The subtract saturates, the value before it tells what we got */
+    __asm cls[test_subsat, slots_xrw, addr, 0, 1], ctx_swap[sig];
+
+    return (slots_xrw < n) ? slots_xrw : n;
+}
+
+/* Return slots to the partition of this ME */
+__intrinsic static void
+pktdma_slots_give(unsigned int n)
+{
+    __cls uint32_t *addr = &pktdma_slots[PKTDMA_SLOT_PART];
+    __xwrite uint32_t slots_xw = n;
+    SIGNAL sig;
+
+    __asm cls[add, slots_xw, addr, 0, 1], ctx_swap[sig];
+}
+
+/* Take n slots, n <= DMA_CMDS_PER_CTM */
+__intrinsic static void
+pktdma_slots_take(unsigned int n, uint32_t poll_int)
+{
+    __xrw uint32_t hoard_xrw;
+    __xread uint32_t hoard_xr;
+    __xwrite uint32_t hoard_xw;
+    unsigned int got = 0;
+    unsigned int tries = 0;
+    unsigned int hoard = 0;
+    unsigned int i;
+
+    for (;;) {
+        /* Leave returned slots to a starving claim */
+        if (!hoard) {
+            cls_read(&hoard_xr, &pktdma_slots_hoard, sizeof(hoard_xr));
+            if (hoard_xr != 0) {
+                sleep(poll_int);
+                continue;
+            }
+        }
+
+        for (i = 0; got < n && i < PKTDMA_SLOT_PARTS; i++)
+            got += pktdma_slots_take_part(
+                (PKTDMA_SLOT_PART + i) % PKTDMA_SLOT_PARTS, n - got);
+
+        if (got == n)
+            break;
+
+        if (!hoard && ++tries >= PKTDMA_SLOT_STARVE) {
+            hoard_xrw = 1;
+            cls_test_set(&hoard_xrw, &pktdma_slots_hoard, sizeof(hoard_xrw));
+            hoard = (hoard_xrw & 1) == 0;
+        }
+
+        /* Not enough slots are free: unless starving, return the ones we
+         * got rather than hold them while others could complete with them */
+        if (!hoard && got != 0) {
+            pktdma_slots_give(got);
+            got = 0;
+        }
+        sleep(poll_int);
+    }
+
+    if (hoard) {
+        hoard_xw = 0;
+        cls_write(&hoard_xw, &pktdma_slots_hoard, sizeof(hoard_xw));
+    }
+}
+
+#else /* PKTDMA_SLOT_PARTS_ENABLED */
+
+/*
+ * The DMA slots of the CTM are the credits of a ticketed semaphore in CLS.
+ * A claim takes all its credits with one operation and claims are served
+ * in order, so no claim waits for ever.
+ */
 SEM_CLS_DECLARE(libpktdma_sem, DMA_CMDS_PER_CTM);
 
+/* Take n slots, n <= DMA_CMDS_PER_CTM */
+__intrinsic static void
+pktdma_slots_take(unsigned int n, uint32_t poll_int)
+{
+    SEM_WAIT_N(libpktdma_sem, n, poll_int);
+}
+
+/* Return n slots */
+__intrinsic static void
+pktdma_slots_give(unsigned int n)
+{
+    SEM_POST_N(libpktdma_sem, n);
+}
+
+#endif /* PKTDMA_SLOT_PARTS_ENABLED */
+
 __intrinsic void
 __pktdma_mu_to_ctm(__ctm40 void* ctm_addr, __mem40 void* mem_addr, size_t size,
                    uint32_t poll_int)
 {
-    SEM_WAIT(libpktdma_sem, poll_int);
+    pktdma_slots_take(1, poll_int);
 
     mem_pe_dma_mu_to_ctm(ctm_addr, mem_addr, size);
 
-    SEM_POST(libpktdma_sem);
+    pktdma_slots_give(1);
 }
 
 __intrinsic void
@@ -51,11 +198,11 @@ __intrinsic void
 __pktdma_ctm_to_mu(__mem40 void* mem_addr, __ctm40 void* ctm_addr, size_t size,
                    uint32_t poll_int)
 {
-    SEM_WAIT(libpktdma_sem, poll_int);
+    pktdma_slots_take(1, poll_int);
 
     mem_pe_dma_ctm_to_mu(mem_addr, ctm_addr, size);
 
-    SEM_POST(libpktdma_sem);
+    pktdma_slots_give(1);
 }
 
 __intrinsic void
@@ -63,3 +210,211 @@ pktdma_ctm_to_mu(__mem40 void* mem_addr, __ctm40 void* ctm_addr, size_t size)
 {
     __pktdma_ctm_to_mu(mem_addr, ctm_addr, size, SYNCH_SEM_DEFAULT_POLL);
 }
+
+/* Largest DMA command, and the alignment of the MU address and size */
+#define PKTDMA_CMD_MAX      2048
+#define PKTDMA_CMD_ALIGN    64
+
+/* 40-bit address of a local CTM real address, for bulk reads and writes */
+#define PKTDMA_CTM_PTR40(_addr) \
+    ((__mem40 uint8_t *)(((uint64_t)(0x80 | __ISLAND) << 32) | (_addr)))
+
+/* Split of a scatter list entry into head, DMA body and tail */
+__intrinsic static void
+pktdma_sg_split(__lmem struct pktdma_sg *ent, unsigned int *head,
+                unsigned int *body)
+{
+    unsigned int mem_lo = (unsigned int)ent->mem_addr;
+
+    /* The PE moves CTM data at an 8B granularity */
+    if (((mem_lo ^ ent->ctm_addr) & 0x7) != 0) {
+        *head = ent->size;
+        *body = 0;
+        return;
+    }
+
+    *head = (PKTDMA_CMD_ALIGN - mem_lo) & (PKTDMA_CMD_ALIGN - 1);
+    if (*head >= ent->size) {
+        *head = ent->size;
+        *body = 0;
+    } else {
+        *body = (ent->size - *head) & ~(PKTDMA_CMD_ALIGN - 1);
+    }
+}
+
+/* Copy bytes between MU and CTM with bulk reads and writes */
+__intrinsic static void
+pktdma_bulk_copy(__mem40 uint8_t *dst, __mem40 uint8_t *src,
+                 unsigned int size)
+{
+    __xread uint32_t buf_xr[8];
+    __xwrite uint32_t buf_xw[8];
+    SIGNAL sig;
+    unsigned int n;
+
+    for (; size > 0; size -= n, src += n, dst += n) {
+        n = size;
+        if (n > sizeof(buf_xr))
+            n = sizeof(buf_xr);
+        __mem_read8(buf_xr, src, n, sizeof(buf_xr), ctx_swap, &sig);
+        reg_cp(buf_xw, buf_xr, sizeof(buf_xw));
+        __mem_write8(buf_xw, dst, n, sizeof(buf_xw), ctx_swap, &sig);
+    }
+}
+
+/* Issue DMA command _i of a scatter list on its own signal */
+#define _PKTDMA_SG_CMD(_i)                                                  \
+    case _i:                                                                \
+        if (to_mu)                                                          \
+            __mem_pe_dma_ctm_to_mu(mem_addr, ctm_addr, n, sig_done,         \
+                                   &dma_sig##_i);                           \
+        else                                                                \
+            __mem_pe_dma_mu_to_ctm(ctm_addr, mem_addr, n, sig_done,         \
+                                   &dma_sig##_i);                           \
+        sig_mask |= 1 << __signal_number(&dma_sig##_i);                     \
+        break;
+
+__intrinsic static int
+pktdma_sg(__lmem struct pktdma_sg *sg, unsigned int num, int to_mu,
+          uint32_t poll_int)
+{
+    SIGNAL dma_sig0, dma_sig1, dma_sig2, dma_sig3;
+    SIGNAL dma_sig4, dma_sig5, dma_sig6, dma_sig7;
+    SIGNAL_MASK sig_mask = 0;
+    __mem40 void *mem_addr;
+    __ctm40 void *ctm_addr;
+    unsigned int head, body, tail;
+    unsigned int cmds = 0;
+    unsigned int cmd = 0;
+    unsigned int off, n;
+    unsigned int i;
+
+    ctassert(__is_ct_const(to_mu));
+
+    for (i = 0; i < num; i++) {
+        pktdma_sg_split(&sg[i], &head, &body);
+        cmds += (body + PKTDMA_CMD_MAX - 1) / PKTDMA_CMD_MAX;
+    }
+    if (cmds > PKTDMA_SG_MAX_CMDS)
+        return -1;
+
+    if (cmds != 0)
+        pktdma_slots_take(cmds, poll_int);
+
+    /* Issue all DMA commands before waiting for any */
+    for (i = 0; i < num; i++) {
+        pktdma_sg_split(&sg[i], &head, &body);
+        for (off = head; off < head + body; off += n) {
+            n = head + body - off;
+            if (n > PKTDMA_CMD_MAX)
+                n = PKTDMA_CMD_MAX;
+            mem_addr = (__mem40 void *)(sg[i].mem_addr + off);
+            ctm_addr = (__ctm40 void *)(sg[i].ctm_addr + off);
+
+            switch (cmd) {
+            _PKTDMA_SG_CMD(0)
+            _PKTDMA_SG_CMD(1)
+            _PKTDMA_SG_CMD(2)
+            _PKTDMA_SG_CMD(3)
+            _PKTDMA_SG_CMD(4)
+            _PKTDMA_SG_CMD(5)
+            _PKTDMA_SG_CMD(6)
+            _PKTDMA_SG_CMD(7)
+            }
+            cmd++;
+        }
+    }
+
+    /* Copy the unaligned head and tail bytes while the DMAs run */
+    for (i = 0; i < num; i++) {
+        pktdma_sg_split(&sg[i], &head, &body);
+        tail = sg[i].size - head - body;
+        if (to_mu) {
+            pktdma_bulk_copy((__mem40 uint8_t *)sg[i].mem_addr,
+                             PKTDMA_CTM_PTR40(sg[i].ctm_addr), head);
+            pktdma_bulk_copy((__mem40 uint8_t *)sg[i].mem_addr + head + body,
+                             PKTDMA_CTM_PTR40(sg[i].ctm_addr + head + body),
+                             tail);
+        } else {
+            pktdma_bulk_copy(PKTDMA_CTM_PTR40(sg[i].ctm_addr),
+                             (__mem40 uint8_t *)sg[i].mem_addr, head);
+            pktdma_bulk_copy(PKTDMA_CTM_PTR40(sg[i].ctm_addr + head + body),
+                             (__mem40 uint8_t *)sg[i].mem_addr + head + body,
+                             tail);
+        }
+    }
+
+    if (cmds != 0) {
+        /* One wait for the completion of all DMA commands */
+        wait_sig_mask(sig_mask);
+        __implicit_read(&dma_sig0);
+        __implicit_read(&dma_sig1);
+        __implicit_read(&dma_sig2);
+        __implicit_read(&dma_sig3);
+        __implicit_read(&dma_sig4);
+        __implicit_read(&dma_sig5);
+        __implicit_read(&dma_sig6);
+        __implicit_read(&dma_sig7);
+
+        pktdma_slots_give(cmds);
+    }
+
+    return 0;
+}
+
+__intrinsic int
+__pktdma_mu_to_ctm_sg(__lmem struct pktdma_sg *sg, unsigned int num,
+                      uint32_t poll_int)
+{
+    return pktdma_sg(sg, num, 0, poll_int);
+}
+
+__intrinsic int
+pktdma_mu_to_ctm_sg(__lmem struct pktdma_sg *sg, unsigned int num)
+{
+    return pktdma_sg(sg, num, 0, SYNCH_SEM_DEFAULT_POLL);
+}
+
+__intrinsic int
+__pktdma_ctm_to_mu_sg(__lmem struct pktdma_sg *sg, unsigned int num,
+                      uint32_t poll_int)
+{
+    return pktdma_sg(sg, num, 1, poll_int);
+}
+
+__intrinsic int
+pktdma_ctm_to_mu_sg(__lmem struct pktdma_sg *sg, unsigned int num)
+{
+    return pktdma_sg(sg, num, 1, SYNCH_SEM_DEFAULT_POLL);
+}
+
+__intrinsic int
+pktdma_sg_chain(__lmem struct pktdma_sg *sg, unsigned int max,
+                __lmem uint32_t *bufs, unsigned int nbufs, uint32_t off,
+                uint32_t ctm_addr, uint32_t size)
+{
+    unsigned int n = 0;
+    uint32_t boff, chunk;
+
+    while (size > 0) {
+        boff = off & (PKTDMA_CHAIN_BUF_SZ - 1);
+        if (n >= max || off / PKTDMA_CHAIN_BUF_SZ >= nbufs)
+            return -1;
+
+        chunk = PKTDMA_CHAIN_BUF_SZ - boff;
+        if (chunk > size)
+            chunk = size;
+
+        sg[n].mem_addr = ((uint64_t)bufs[off / PKTDMA_CHAIN_BUF_SZ] << 11) +
+            boff;
+        sg[n].ctm_addr = ctm_addr;
+        sg[n].size = chunk;
+
+        off += chunk;
+        ctm_addr += chunk;
+        size -= chunk;
+        n++;
+    }
+
+    return n;
+}
@@ -14,7 +14,19 @@
  * limitations under the License.
  *
  * @file          lib/pktdma/pktdma.h
- * @brief         Memory Unit Packet Engine DMA with semaphore protection
+ * @brief         Memory Unit Packet Engine DMA with DMA slot accounting
+ *
+ * No more than 16 DMA commands may be outstanding per CTM.  The functions
+ * below take a DMA slot per command from a ticketed semaphore in CLS,
+ * polling every poll_int cycles until their turn comes.
+ *
+ * With PKTDMA_SLOT_PARTS_ENABLED defined, the slots are instead counted
+ * in per-ME partitions without a lock: an ME takes from its own share of
+ * the slots and steals from the other shares when its own runs out.  If
+ * not enough slots are free, it returns the ones it got and waits
+ * poll_int cycles before trying again.  This serves more claims per
+ * second under contention, but a single claim can wait far longer than
+ * with the semaphore.
  */
 #ifndef _PKTDMA__PKTDMA_H_
 #define _PKTDMA__PKTDMA_H_
@@ -24,7 +36,7 @@
 #include <types.h>
 
 /**
- * DMA from MU to CTM with semaphore protection.
+ * DMA from MU to CTM with DMA slot accounting.
  *
  * @param ctm_addr  32-bit pointer to the CTM start address
  * @param mem_addr  40-bit pointer to the MU start address
@@ -45,7 +57,7 @@ __intrinsic void
 pktdma_mu_to_ctm(__ctm40 void* ctm_addr, __mem40 void* mem_addr, size_t size);
 
 /**
- * DMA from CTM to MU with semaphore protection.
+ * DMA from CTM to MU with DMA slot accounting.
  *
  * @param mem_addr  40-bit pointer to the MU start address
  * @param ctm_addr  32-bit pointer to the CTM start address
@@ -65,4 +77,94 @@ __pktdma_ctm_to_mu(__mem40 void* mem_addr, __ctm40 void* ctm_addr, size_t size,
 __intrinsic void
 pktdma_ctm_to_mu(__mem40 void* mem_addr, __ctm40 void* ctm_addr, size_t size);
 
+/**
+ * Maximum number of DMA commands issued by one scatter-gather call.  Each
+ * entry of a scatter list needs one command per 2048B of its body (see
+ * below), so a list can move up to 16KB.
+ */
+#define PKTDMA_SG_MAX_CMDS  8
+
+/**
+ * Scatter list entry: a region of MU and the region of CTM to move it
+ * to or from.
+ */
+struct pktdma_sg {
+    uint64_t mem_addr;      /**< 40-bit MU address */
+    uint32_t ctm_addr;      /**< CTM address, real-address mode */
+    uint32_t size;          /**< Bytes to move, any size */
+};
+
+/**
+ * DMA a scatter list from MU to CTM with DMA slot accounting.
+ *
+ * @param sg        Scatter list
+ * @param num       Number of entries in @sg
+ * @param poll_int  Cycles to wait if no credits are available
+ * @return 0 on success, -1 if the list needs more than PKTDMA_SG_MAX_CMDS
+ *         DMA commands, in which case nothing is moved
+ *
+ * Each entry is split into an unaligned head up to the first 64B aligned
+ * MU address, a body of up to 2048B per DMA command, and a tail of less
+ * than 64B.  The DMA slots for all commands of the list are taken and
+ * returned together, all commands are issued before waiting, and the
+ * head and tail bytes are copied with bulk reads and writes while the
+ * DMAs are in flight.  Entries whose MU and CTM addresses differ in
+ * alignment within 8B cannot be moved by DMA and are copied entirely with
+ * bulk reads and writes.
+ *
+ * @note poll_int must be less than 0x00100000 (1<<20), see sleep().
+ * @note Use the real-address mode for ctm_addr, not the packet-address mode
+ */
+__intrinsic int
+__pktdma_mu_to_ctm_sg(__lmem struct pktdma_sg *sg, unsigned int num,
+                      uint32_t poll_int);
+
+__intrinsic int
+pktdma_mu_to_ctm_sg(__lmem struct pktdma_sg *sg, unsigned int num);
+
+/**
+ * DMA a scatter list from CTM to MU with DMA slot accounting.
+ *
+ * @param sg        Scatter list
+ * @param num       Number of entries in @sg
+ * @param poll_int  Cycles to wait if no credits are available
+ * @return 0 on success, -1 if the list needs more than PKTDMA_SG_MAX_CMDS
+ *         DMA commands, in which case nothing is moved
+ *
+ * See __pktdma_mu_to_ctm_sg().
+ */
+__intrinsic int
+__pktdma_ctm_to_mu_sg(__lmem struct pktdma_sg *sg, unsigned int num,
+                      uint32_t poll_int);
+
+__intrinsic int
+pktdma_ctm_to_mu_sg(__lmem struct pktdma_sg *sg, unsigned int num);
+
+/* Size of each MU buffer of a chained packet, see pktio.h */
+#define PKTDMA_CHAIN_BUF_SZ 2048
+
+/**
+ * Build a scatter list moving a region of a chain of MU buffers.
+ *
+ * @param sg        Scatter list to fill
+ * @param max       Number of entries available in @sg
+ * @param bufs      MU buffer handles (address >> 11) of the chain, buffer
+ *                  n holding offsets n * PKTDMA_CHAIN_BUF_SZ onwards
+ * @param nbufs     Number of buffers in @bufs
+ * @param off       Offset of the region in the chain
+ * @param ctm_addr  CTM address of the region, real-address mode
+ * @param size      Bytes to move
+ * @return the number of entries filled, or -1 if the region is past the
+ *         end of the chain or needs more than @max entries
+ *
+ * The region is split at the buffer boundaries, one entry per buffer, so
+ * the list can be passed to pktdma_mu_to_ctm_sg() or
+ * pktdma_ctm_to_mu_sg().  pktio_chain_bufs() returns @bufs for the
+ * current packet.
+ */
+__intrinsic int
+pktdma_sg_chain(__lmem struct pktdma_sg *sg, unsigned int max,
+                __lmem uint32_t *bufs, unsigned int nbufs, uint32_t off,
+                uint32_t ctm_addr, uint32_t size);
+
 #endif  /*_PKTDMA__PKTDMA_H_*/
@@ -34,6 +34,7 @@
 
 /* Library Includes */
 #include <nfp/me.h>
+#include <nfp/mem_atomic.h>
 #include <nfp/mem_bulk.h>
 #include <nfp/mem_ring.h>
 #include <nfp/cls.h>
@@ -57,6 +58,16 @@
 #include <pktio/pktio.h>
 #include <modscript/modscript.h>
 
+#ifdef PKTIO_LSO_ENABLED
+#include <net/csum.h>
+#include <net/ip.h>
+#include <net/tcp.h>
+#endif
+
+#ifdef PKTIO_CHAIN_ENABLED
+#include <net/csum.h>
+#endif
+
 #if (__REVISION_MAX < __REVISION_B0)
 #error "Unsupported chip type"
 #endif
@@ -192,15 +203,26 @@ struct pktio_handle {
     #define PKTIO_CNTR_ERR_TO_WIRE          8
     #define PKTIO_CNTR_ERR_MAC_PORT_PAUSED  9
     #define PKTIO_CNTR_INVALID_METADATA_FROM_WIRE 10
+    #define PKTIO_CNTR_TX_REPL              11
+    #define PKTIO_CNTR_ERR_REPL             12
+    #define PKTIO_CNTR_TX_LSO               13
+    #define PKTIO_CNTR_ERR_LSO              14
+    #define PKTIO_CNTR_ERR_CHAIN            15
+    #define PKTIO_CNTR_CAP                  16
+    #define PKTIO_CNTR_ERR_CAP              17
+    #define PKTIO_CNTR_ERR_GRO_LATE         18
 
 __shared __gpr uint32_t pktio_cntrs_base;
     CNTRS64_DECLARE(vr_pktio_cntrs_base, 32, __emem);
     #define PKTIO_CNTR_INC(_cntr) \
                     cntr64_incr(pktio_cntrs_base, _cntr)
+    #define PKTIO_CNTR_ADD(_cntr, _n) \
+                    cntr64_add(pktio_cntrs_base, _cntr, _n)
     #define PKTIO_CNTRS_SET_BASE(_base)  \
                     (_base) = cntr64_get_addr(vr_pktio_cntrs_base)
 #else
     #define PKTIO_CNTR_INC(_cntr)
+    #define PKTIO_CNTR_ADD(_cntr, _n)
     #define PKTIO_CNTRS_SET_BASE(_base)
 #endif
 
@@ -220,6 +242,17 @@ __shared __gpr uint32_t pktio_cntrs_base;
 
 #define NFD_CTM_SIZE (256 << NFD_CTM_TYPE)
 
+/* The MU buffer holds the rest of a split packet at the same offsets the
+ * packet would have in one buffer */
+#define PKTIO_MU_PTR40(_muptr, _off) \
+    ((__mem40 void *)(((uint64_t)(_muptr) << 11) + (_off)))
+
+#ifdef PKTIO_CHAIN_ENABLED
+#define PKTIO_CHAINED(_p)       ((_p).p_chained)
+#else
+#define PKTIO_CHAINED(_p)       0
+#endif
+
 
 /* CTM credit management, required for RX from host. Use all of CTM RX */
 #define CTM_ALLOC_ERR                   0xffffffff
@@ -227,6 +260,19 @@ __shared __gpr uint32_t pktio_cntrs_base;
 __export __shared __cls struct ctm_pkt_credits ctm_credits =
     {ME_CTM_ALLOC_MAX_PKT_CREDITS, ME_CTM_ALLOC_MAX_BUF_CREDITS};
 
+#ifdef PKTIO_CTM_CREDIT_CACHE
+/* Credits taken from ctm_credits in batches by the contexts of this ME,
+ * emptied by pktio_rx_init() and pktio_tx_init() as LMEM is not cleared
+ * at load */
+__shared __lmem struct ctm_pkt_credits pktio_ctm_cache;
+
+#define PKTIO_CTM_ALLOC(_size) \
+    pkt_ctm_cache_alloc(&ctm_credits, &pktio_ctm_cache, __ISLAND, _size, 1)
+#else
+#define PKTIO_CTM_ALLOC(_size) \
+    pkt_ctm_alloc(&ctm_credits, __ISLAND, _size, 1, 1)
+#endif
+
 /* Declaration of pkt */
 PKTIO_META_TYPE struct pktio_meta pkt;
 
@@ -297,11 +343,60 @@ compute_ctm_size(__xread struct pktio_nbi_meta *rxd)
 }
 
 
+#ifdef PKTIO_CHAIN_ENABLED
+/*
+ * Address of an offset of the buffer of a chained packet whose head MU
+ * buffer is muptr.  Offsets past the head buffer are looked up in the
+ * chain descriptor, word n of which is the handle of buffer n.
+ */
+__intrinsic static __mem40 void *
+pktio_chain_ptr40(uint32_t muptr, unsigned int boff)
+{
+    __xread uint32_t xbuf;
+    unsigned int n = boff / PKTIO_CHAIN_BUF_SZ;
+
+    if (n == 0)
+        return PKTIO_MU_PTR40(muptr, boff);
+
+    mem_read32(&xbuf, (__mem40 uint8_t *)PKTIO_MU_PTR40(muptr, 0) + (n << 2),
+               sizeof(xbuf));
+    return PKTIO_MU_PTR40(xbuf, boff & (PKTIO_CHAIN_BUF_SZ - 1));
+}
+
+/* Return the buffers chained to a head MU buffer to the BLM */
+__intrinsic static void
+pktio_chain_free(uint32_t muptr, unsigned int bls)
+{
+    __xread struct pktio_chain xchain;
+    __xwrite uint32_t xbufs[PKTIO_CHAIN_BUFS];
+    unsigned int num;
+
+    mem_read32(&xchain, PKTIO_MU_PTR40(muptr, 0), sizeof(xchain));
+    num = xchain.num;
+    if (num > 1 && num <= PKTIO_CHAIN_BUFS) {
+        reg_cp(xbufs, xchain.__raw, sizeof(xbufs));
+        blm_buf_free_bulk(&xbufs[1], num - 1, bls);
+    }
+}
+#endif
+
+/*
+ * blm_buf_free() may swap context when the BLM magazine spills, see
+ * blm.h.  Only the context's own pkt, GPRs and transfer registers are
+ * live across it, here and in the other callers, so nothing needs to be
+ * held for other contexts.
+ */
 #ifdef PKTIO_GRO_ENABLED
 __intrinsic void
 drop_packet(__xwrite struct gro_meta_drop *gmeta)
 {
-    blm_buf_free(pkt.p_muptr, pkt.p_bls);
+#ifdef PKTIO_CHAIN_ENABLED
+    if (pkt.p_chained)
+        pktio_chain_free(pkt.p_muptr, pkt.p_bls);
+#endif
+    /* Packets built in CTM (pktio_gen(), copies) have no MU buffer */
+    if (pkt.p_muptr != 0)
+        blm_buf_free(pkt.p_muptr, pkt.p_bls);
     pkt_ctm_free(pkt.p_isl, pkt.p_pnum);
 
     /* If packet has to be reordered, drop with GRO if enabled otherwise
@@ -333,7 +428,13 @@ drop_packet(__xwrite struct gro_meta_drop *gmeta)
 __intrinsic void
 drop_packet()
 {
-    blm_buf_free(pkt.p_muptr, pkt.p_bls);
+#ifdef PKTIO_CHAIN_ENABLED
+    if (pkt.p_chained)
+        pktio_chain_free(pkt.p_muptr, pkt.p_bls);
+#endif
+    /* Packets built in CTM (pktio_gen(), copies) have no MU buffer */
+    if (pkt.p_muptr != 0)
+        blm_buf_free(pkt.p_muptr, pkt.p_bls);
     pkt_ctm_free(pkt.p_isl, pkt.p_pnum);
 
     /* If ordered packet, drop with seq number in NBI. */
@@ -484,7 +585,7 @@ pktio_rx_host_issue(__xread struct nfd_in_pkt_desc *nfd_rxd, sync_t sync,
      * get one the thread hangs but nothing is in-process yet anyway,
      * which is why we do this before actually receiving the packet. */
     for (ctm_pnum = CTM_ALLOC_ERR; ctm_pnum == CTM_ALLOC_ERR;) {
-        ctm_pnum = pkt_ctm_alloc(&ctm_credits, __ISLAND, NFD_CTM_TYPE, 1, 1);
+        ctm_pnum = PKTIO_CTM_ALLOC(NFD_CTM_TYPE);
     }
 
     /* now receive the next packet from host */
@@ -598,7 +699,7 @@ pktio_rx_host_process(__xread struct nfd_in_pkt_desc *nfd_rxd, int ctm_pnum)
      * Also might want to overlap next read with previous write I/O. */
     for (i = cpy_start; i < cpy_end; i += sizeof(buf_xr)) {
         /* get a handle to both the mu and ctm pkt pointers */
-        mu_ptr = (__mem40 void *)(((uint64_t)pkt.p_muptr << 11) | i);
+        mu_ptr = PKTIO_MU_PTR40(pkt.p_muptr, i);
         ctm_ptr = pkt_ctm_ptr40(__ISLAND, ctm_pnum, i);
 
         mem_read64(buf_xr, mu_ptr, sizeof(buf_xr));
@@ -644,6 +745,439 @@ pktio_rx_wq(int ring_num, mem_ring_addr_t ring_addr)
     pkt.p_dst = PKT_DROP;
 }
 
+#ifdef PKTIO_RX_SCHED_ENABLED
+
+#ifndef PKTIO_RX_SCHED_WIRE_WEIGHT
+#define PKTIO_RX_SCHED_WIRE_WEIGHT 1
+#endif
+
+#ifndef PKTIO_RX_SCHED_HOST_WEIGHT
+#define PKTIO_RX_SCHED_HOST_WEIGHT 1
+#endif
+
+#if (PKTIO_RX_SCHED_WIRE_WEIGHT < 1 || PKTIO_RX_SCHED_WIRE_WEIGHT > 255 || \
+     PKTIO_RX_SCHED_HOST_WEIGHT < 1 || PKTIO_RX_SCHED_HOST_WEIGHT > 255)
+#error "PKTIO_RX_SCHED_*_WEIGHT must be in the range 1..255"
+#endif
+
+/* Sources the scheduler keeps requests outstanding on */
+#define PKTIO_RX_SCHED_SRC_NUM      2
+#define PKTIO_RX_SCHED_SRC_MASK     (PKTIO_RX_SRC_MASK_WIRE | \
+                                     PKTIO_RX_SRC_MASK_HOST)
+
+#ifdef PKTIO_GRO_ENABLED
+    #if !defined(PKTIO_RX_SCHED_NUM_THREADS) || \
+        !defined(PKTIO_RX_SCHED_RO_WINDOW)
+    #error "PKTIO_RX_SCHED_NUM_THREADS and PKTIO_RX_SCHED_RO_WINDOW must be defined to use the rx scheduler with GRO"
+    #endif
+
+    /* Every scheduled thread may hold one packet per source; on top of
+     * that GRO releases tickets a whole tape at a time. */
+    #if ((PKTIO_RX_SCHED_NUM_THREADS * PKTIO_RX_SCHED_SRC_NUM) + \
+         GRO_TICKET_PER_TAPE) > PKTIO_RX_SCHED_RO_WINDOW
+    #error "rx scheduler can hold more packets than the GRO reorder window"
+    #endif
+#endif
+
+/* Maximum number of contexts per ME */
+#define PKTIO_RX_SCHED_CTX_MAX      8
+
+struct pktio_rx_sched_state {
+    union {
+        struct {
+            uint8_t enabled;            /* Sources enabled for the thread */
+            uint8_t pending;            /* Sources with a request issued */
+            uint8_t ready;              /* Sources with a packet received */
+            uint8_t last;               /* Source served last */
+
+            uint8_t wire_credit;        /* Remaining WRR credit for wire */
+            uint8_t host_credit;        /* Remaining WRR credit for host */
+            uint16_t ctm_pnum;          /* CTM buffer claimed for host rx */
+        };
+        uint32_t __raw[2];
+    };
+};
+
+__shared __lmem struct pktio_rx_sched_state
+    pktio_rx_sched_st[PKTIO_RX_SCHED_CTX_MAX];
+
+/* Per-thread transfer registers and signals for the outstanding requests */
+__xread struct pktio_nbi_meta pktio_rx_sched_nbi_rxd;
+SIGNAL pktio_rx_sched_nbi_sig;
+#ifdef PKTIO_NFD_ENABLED
+__xread struct nfd_in_pkt_desc pktio_rx_sched_nfd_rxd;
+SIGNAL pktio_rx_sched_nfd_sig;
+#endif
+
+int
+pktio_rx_sched_init(unsigned int src_mask)
+{
+    __lmem struct pktio_rx_sched_state *st = &pktio_rx_sched_st[__ctx()];
+
+#ifndef PKTIO_NFD_ENABLED
+    src_mask &= ~PKTIO_RX_SRC_MASK_HOST;
+#endif
+    src_mask &= PKTIO_RX_SCHED_SRC_MASK;
+
+    /* LMEM is not cleared at load, stale pending/ready bits would leave a
+     * source never issued */
+    reg_zero((void *)st->__raw, sizeof(*st));
+    st->wire_credit = PKTIO_RX_SCHED_WIRE_WEIGHT;
+    st->host_credit = PKTIO_RX_SCHED_HOST_WEIGHT;
+    st->last = PKTIO_RX_SRC_HOST;
+
+    /* With no source, pktio_rx_sched() would wait forever */
+    if (src_mask == 0)
+        return -1;
+
+    st->enabled = src_mask;
+    return 0;
+}
+
+int
+pktio_rx_sched_set_src(unsigned int src_mask)
+{
+    __lmem struct pktio_rx_sched_state *st = &pktio_rx_sched_st[__ctx()];
+
+#ifndef PKTIO_NFD_ENABLED
+    src_mask &= ~PKTIO_RX_SRC_MASK_HOST;
+#endif
+    src_mask &= PKTIO_RX_SCHED_SRC_MASK;
+
+    if (src_mask == 0)
+        return -1;
+
+    st->enabled = src_mask;
+    return 0;
+}
+
+__intrinsic int
+pktio_rx_sched(void)
+{
+    __lmem struct pktio_rx_sched_state *st = &pktio_rx_sched_st[__ctx()];
+    __gpr uint32_t idle;
+    __gpr uint32_t src;
+
+    /* Keep one request outstanding on every enabled source.  Requests are
+     * only issued here, never while a packet is being processed. */
+    idle = st->enabled & ~st->pending;
+    if (idle & PKTIO_RX_SRC_MASK_WIRE) {
+        pktio_rx_wire_issue(&pktio_rx_sched_nbi_rxd,
+                            sizeof(pktio_rx_sched_nbi_rxd),
+                            sig_done, &pktio_rx_sched_nbi_sig);
+        st->pending |= PKTIO_RX_SRC_MASK_WIRE;
+    }
+#ifdef PKTIO_NFD_ENABLED
+    if (idle & PKTIO_RX_SRC_MASK_HOST) {
+        st->ctm_pnum = pktio_rx_host_issue(&pktio_rx_sched_nfd_rxd, sig_done,
+                                           &pktio_rx_sched_nfd_sig);
+        st->pending |= PKTIO_RX_SRC_MASK_HOST;
+    }
+#endif
+
+    /* Wait for at least one source to deliver */
+    for (;;) {
+        if ((st->pending & ~st->ready & PKTIO_RX_SRC_MASK_WIRE) &&
+            signal_test(&pktio_rx_sched_nbi_sig))
+            st->ready |= PKTIO_RX_SRC_MASK_WIRE;
+#ifdef PKTIO_NFD_ENABLED
+        if ((st->pending & ~st->ready & PKTIO_RX_SRC_MASK_HOST) &&
+            signal_test(&pktio_rx_sched_nfd_sig))
+            st->ready |= PKTIO_RX_SRC_MASK_HOST;
+#endif
+        if (st->ready)
+            break;
+#ifdef PKTIO_NFD_ENABLED
+        wait_for_any(&pktio_rx_sched_nbi_sig, &pktio_rx_sched_nfd_sig);
+#else
+        /* Wire is the only source, so it is always pending here */
+        wait_for_all(&pktio_rx_sched_nbi_sig);
+        st->ready |= PKTIO_RX_SRC_MASK_WIRE;
+#endif
+    }
+
+    /* Pick a source: work conserving weighted round robin */
+    if (st->ready == PKTIO_RX_SCHED_SRC_MASK) {
+        if (st->wire_credit == 0 && st->host_credit == 0) {
+            st->wire_credit = PKTIO_RX_SCHED_WIRE_WEIGHT;
+            st->host_credit = PKTIO_RX_SCHED_HOST_WEIGHT;
+        }
+        if (st->wire_credit != 0 &&
+            (st->last == PKTIO_RX_SRC_HOST || st->host_credit == 0)) {
+            src = PKTIO_RX_SRC_WIRE;
+            st->wire_credit--;
+        } else {
+            src = PKTIO_RX_SRC_HOST;
+            st->host_credit--;
+        }
+    } else if (st->ready & PKTIO_RX_SRC_MASK_WIRE) {
+        src = PKTIO_RX_SRC_WIRE;
+    } else {
+        src = PKTIO_RX_SRC_HOST;
+    }
+
+    st->ready &= ~(1 << src);
+    st->pending &= ~(1 << src);
+    st->last = src;
+
+#ifdef PKTIO_NFD_ENABLED
+    if (src == PKTIO_RX_SRC_HOST) {
+        __implicit_write(&pktio_rx_sched_nfd_rxd);
+        return pktio_rx_host_process(&pktio_rx_sched_nfd_rxd, st->ctm_pnum);
+    }
+#endif
+
+    __implicit_write(&pktio_rx_sched_nbi_rxd);
+    return pktio_rx_wire_process(&pktio_rx_sched_nbi_rxd);
+}
+
+#endif /* PKTIO_RX_SCHED_ENABLED */
+
+#ifdef PKTIO_RX_ADAPT_ENABLED
+
+/* Rebalance interval in timestamp ticks (16 ME cycles each) */
+#ifndef PKTIO_RX_ADAPT_INTERVAL
+#define PKTIO_RX_ADAPT_INTERVAL     (1 << 20)
+#endif
+
+/* Minimum idle share difference to move a context, as a shift */
+#ifndef PKTIO_RX_ADAPT_HYST_SHF
+#define PKTIO_RX_ADAPT_HYST_SHF     3
+#endif
+
+#if (PKTIO_RX_ADAPT_INTERVAL > (1 << 22))
+#error "PKTIO_RX_ADAPT_INTERVAL is too large for the idle counters"
+#endif
+
+/* Maximum number of contexts per ME */
+#define PKTIO_RX_ADAPT_CTX_MAX      8
+
+struct pktio_rx_adapt_state {
+    uint32_t arrivals[PKTIO_RX_SRC_NUM];    /* Packets this interval */
+    uint32_t idle[PKTIO_RX_SRC_NUM];        /* Ticks spent waiting */
+    uint32_t nthr[PKTIO_RX_SRC_NUM];        /* Scratch for rebalancing */
+    uint32_t wait_start[PKTIO_RX_ADAPT_CTX_MAX];
+    uint32_t next_update;                   /* Timestamp of next rebalance */
+    uint32_t enabled;                       /* Sources in use on the ME */
+    uint32_t active;                        /* Contexts that joined */
+    uint32_t waiting;                       /* Contexts in a receive call */
+};
+
+__shared __lmem uint32_t pktio_rx_adapt_part;
+__shared __lmem struct pktio_rx_adapt_state pktio_rx_adapt_st;
+
+/* Raised in the other contexts once context 0 has set up the state */
+SIGNAL pktio_rx_adapt_init_sig;
+
+__intrinsic static uint32_t
+pktio_rx_adapt_ticks(uint32_t start, uint32_t now)
+{
+    uint32_t ticks = now - start;
+
+    if (ticks > PKTIO_RX_ADAPT_INTERVAL)
+        ticks = PKTIO_RX_ADAPT_INTERVAL;
+    return ticks;
+}
+
+void
+pktio_rx_adapt_init(unsigned int src_mask)
+{
+    uint32_t ctx;
+    uint32_t i;
+
+    if (__ctx() != 0) {
+        __implicit_write(&pktio_rx_adapt_init_sig);
+        wait_for_all(&pktio_rx_adapt_init_sig);
+        return;
+    }
+
+#ifndef PKTIO_NFD_ENABLED
+    src_mask &= ~PKTIO_RX_SRC_MASK_HOST;
+#endif
+    src_mask &= PKTIO_RX_SRC_MASK_ALL;
+    if (src_mask == 0)
+        src_mask = PKTIO_RX_SRC_MASK_WIRE;
+
+    /* Larger than reg_zero() takes */
+    for (i = 0; i < sizeof(pktio_rx_adapt_st) / sizeof(uint32_t); i++)
+        ((__lmem uint32_t *)&pktio_rx_adapt_st)[i] = 0;
+    pktio_rx_adapt_st.enabled = src_mask;
+    pktio_rx_adapt_st.next_update = local_csr_read(local_csr_timestamp_low) +
+                                    PKTIO_RX_ADAPT_INTERVAL;
+    pktio_rx_adapt_part = 0;
+
+    for (ctx = 1; ctx < PKTIO_RX_ADAPT_CTX_MAX; ctx++)
+        signal_ctx(ctx, __signal_number(&pktio_rx_adapt_init_sig));
+}
+
+/* Count the active contexts assigned to each source */
+static void
+pktio_rx_adapt_count(uint32_t part)
+{
+    uint32_t ctx;
+    uint32_t src;
+
+    for (src = 0; src < PKTIO_RX_SRC_NUM; src++)
+        pktio_rx_adapt_st.nthr[src] = 0;
+
+    for (ctx = 0; ctx < PKTIO_RX_ADAPT_CTX_MAX; ctx++) {
+        if (pktio_rx_adapt_st.active & (1 << ctx))
+            pktio_rx_adapt_st.nthr[PKTIO_RX_ADAPT_SRC_of(part, ctx)]++;
+    }
+}
+
+/* Assign a newly seen context to the source with the fewest contexts */
+static void
+pktio_rx_adapt_join(uint32_t ctx)
+{
+    uint32_t part = pktio_rx_adapt_part;
+    uint32_t best = PKTIO_RX_SRC_NUM;
+    uint32_t src;
+
+    pktio_rx_adapt_count(part);
+
+    for (src = 0; src < PKTIO_RX_SRC_NUM; src++) {
+        if (!(pktio_rx_adapt_st.enabled & (1 << src)))
+            continue;
+        if (best == PKTIO_RX_SRC_NUM ||
+            pktio_rx_adapt_st.nthr[src] < pktio_rx_adapt_st.nthr[best])
+            best = src;
+    }
+
+    part &= ~(PKTIO_RX_ADAPT_CTX_MSK << (ctx * PKTIO_RX_ADAPT_CTX_BITS));
+    part |= best << (ctx * PKTIO_RX_ADAPT_CTX_BITS);
+    pktio_rx_adapt_part = part;
+    pktio_rx_adapt_st.active |= 1 << ctx;
+}
+
+static void
+pktio_rx_adapt_rebalance(uint32_t now)
+{
+    uint32_t part = pktio_rx_adapt_part;
+    uint32_t donor = PKTIO_RX_SRC_NUM;
+    uint32_t recv = PKTIO_RX_SRC_NUM;
+    uint32_t nd, nr;
+    uint32_t hi, lo;
+    uint32_t move;
+    uint32_t ctx;
+    uint32_t src;
+
+    /* Account for contexts still blocked in a receive call, they are the
+     * idlest of all if their source has gone quiet. */
+    for (ctx = 0; ctx < PKTIO_RX_ADAPT_CTX_MAX; ctx++) {
+        if (pktio_rx_adapt_st.waiting & (1 << ctx)) {
+            src = PKTIO_RX_ADAPT_SRC_of(part, ctx);
+            pktio_rx_adapt_st.idle[src] += pktio_rx_adapt_ticks(
+                pktio_rx_adapt_st.wait_start[ctx], now);
+            pktio_rx_adapt_st.wait_start[ctx] = now;
+        }
+    }
+
+    pktio_rx_adapt_count(part);
+
+    /*
+     * The donor is the source whose contexts were idle for the largest
+     * share of the interval and which can spare one.  The receiver is the
+     * busiest source that received traffic.  idle[a] / nthr[a] is compared
+     * with idle[b] / nthr[b] by cross multiplying.
+     */
+    for (src = 0; src < PKTIO_RX_SRC_NUM; src++) {
+        if (!(pktio_rx_adapt_st.enabled & (1 << src)) ||
+            pktio_rx_adapt_st.nthr[src] == 0)
+            continue;
+
+        if (pktio_rx_adapt_st.nthr[src] > 1 &&
+            (donor == PKTIO_RX_SRC_NUM ||
+             pktio_rx_adapt_st.idle[src] * pktio_rx_adapt_st.nthr[donor] >
+             pktio_rx_adapt_st.idle[donor] * pktio_rx_adapt_st.nthr[src]))
+            donor = src;
+
+        if (pktio_rx_adapt_st.arrivals[src] != 0 &&
+            (recv == PKTIO_RX_SRC_NUM ||
+             pktio_rx_adapt_st.idle[src] * pktio_rx_adapt_st.nthr[recv] <
+             pktio_rx_adapt_st.idle[recv] * pktio_rx_adapt_st.nthr[src]))
+            recv = src;
+    }
+
+    if (donor != PKTIO_RX_SRC_NUM && recv != PKTIO_RX_SRC_NUM &&
+        donor != recv) {
+        nd = pktio_rx_adapt_st.nthr[donor];
+        nr = pktio_rx_adapt_st.nthr[recv];
+        hi = pktio_rx_adapt_st.idle[donor] * nr;
+        lo = pktio_rx_adapt_st.idle[recv] * nd;
+
+        if (hi > lo && (hi - lo) > ((nd * nr * PKTIO_RX_ADAPT_INTERVAL) >>
+                                    PKTIO_RX_ADAPT_HYST_SHF)) {
+            /* Prefer a context that is not blocked on the donor source, it
+             * will pick up the new assignment straight away. */
+            move = PKTIO_RX_ADAPT_CTX_MAX;
+            for (ctx = 0; ctx < PKTIO_RX_ADAPT_CTX_MAX; ctx++) {
+                if (!(pktio_rx_adapt_st.active & (1 << ctx)) ||
+                    PKTIO_RX_ADAPT_SRC_of(part, ctx) != donor)
+                    continue;
+                if (move == PKTIO_RX_ADAPT_CTX_MAX ||
+                    !(pktio_rx_adapt_st.waiting & (1 << ctx)))
+                    move = ctx;
+            }
+
+            part &= ~(PKTIO_RX_ADAPT_CTX_MSK <<
+                      (move * PKTIO_RX_ADAPT_CTX_BITS));
+            part |= recv << (move * PKTIO_RX_ADAPT_CTX_BITS);
+            pktio_rx_adapt_part = part;
+        }
+    }
+
+    for (src = 0; src < PKTIO_RX_SRC_NUM; src++) {
+        pktio_rx_adapt_st.arrivals[src] = 0;
+        pktio_rx_adapt_st.idle[src] = 0;
+    }
+    pktio_rx_adapt_st.next_update = now + PKTIO_RX_ADAPT_INTERVAL;
+}
+
+__intrinsic int
+pktio_rx_adapt(int ring_num, mem_ring_addr_t ring_addr)
+{
+    __gpr uint32_t ctx = __ctx();
+    __gpr uint32_t src;
+    __gpr uint32_t now;
+    int ret = 0;
+
+    if (!(pktio_rx_adapt_st.active & (1 << ctx)))
+        pktio_rx_adapt_join(ctx);
+
+    src = PKTIO_RX_ADAPT_SRC_of(pktio_rx_adapt_part, ctx);
+
+    pktio_rx_adapt_st.wait_start[ctx] =
+        local_csr_read(local_csr_timestamp_low);
+    pktio_rx_adapt_st.waiting |= 1 << ctx;
+
+    if (src == PKTIO_RX_SRC_WIRE) {
+        ret = pktio_rx_wire();
+    }
+#ifdef PKTIO_NFD_ENABLED
+    else if (src == PKTIO_RX_SRC_HOST) {
+        ret = pktio_rx_host();
+    }
+#endif
+    else {
+        pktio_rx_wq(ring_num, ring_addr);
+    }
+
+    /* No context swaps from here on, so the shared state is consistent */
+    now = local_csr_read(local_csr_timestamp_low);
+    pktio_rx_adapt_st.waiting &= ~(1 << ctx);
+    pktio_rx_adapt_st.idle[src] +=
+        pktio_rx_adapt_ticks(pktio_rx_adapt_st.wait_start[ctx], now);
+    pktio_rx_adapt_st.arrivals[src]++;
+
+    if ((int32_t)(now - pktio_rx_adapt_st.next_update) >= 0)
+        pktio_rx_adapt_rebalance(now);
+
+    return ret;
+}
+
+#endif /* PKTIO_RX_ADAPT_ENABLED */
+
 __intrinsic int
 pktio_tx_with_meta(unsigned short app_nfd_flags, unsigned short meta_len)
 {
@@ -664,6 +1198,7 @@ pktio_tx_with_meta(unsigned short app_nfd_flags, unsigned short meta_len)
     int dst_q = PKT_PORT_QUEUE_of(pkt.p_dst);
 #ifdef PKTIO_GRO_ENABLED
     __xwrite union gro_meta gmeta;
+    int dropped = 0;
 #endif
 
     /*
@@ -672,6 +1207,16 @@ pktio_tx_with_meta(unsigned short app_nfd_flags, unsigned short meta_len)
      * Therefore; it is called at the end of the function in the case where
      * GRO reordering is enabled for the packet. */
 
+#ifdef PKTIO_CHAIN_ENABLED
+    /* Neither the NBI nor NFD can send from more than one MU buffer */
+    if (pkt.p_chained && (PKT_PORT_TYPE_of(pkt.p_dst) == PKT_PTYPE_WIRE ||
+                          PKT_PORT_TYPE_of(pkt.p_dst) == PKT_PTYPE_HOST)) {
+        PKTIO_CNTR_INC(PKTIO_CNTR_ERR_CHAIN);
+        ret = -4;
+        goto drop;
+    }
+#endif
+
     switch(PKT_PORT_TYPE_of(pkt.p_dst)) {
         case PKT_PTYPE_WIRE: {
             volatile __xwrite struct nbi_meta_pkt_info  info;
@@ -859,6 +1404,7 @@ pktio_tx_with_meta(unsigned short app_nfd_flags, unsigned short meta_len)
 drop:
 #ifdef PKTIO_GRO_ENABLED
             drop_packet(&gmeta.drop);
+            dropped = 1;
 #else
             drop_packet();
 #endif
@@ -867,7 +1413,14 @@ drop:
 #ifdef PKTIO_GRO_ENABLED
     if (pkt.p_is_gro_seq) {
         __critical_path();
-        gro_cli_send(&gmeta, pkt.p_ro_ctx, pkt.p_seq);
+        if (gro_cli_send(&gmeta, pkt.p_ro_ctx, pkt.p_seq) < 0) {
+            /* Too late: GRO skipped the sequence number, nothing is sent */
+            PKTIO_CNTR_INC(PKTIO_CNTR_ERR_GRO_LATE);
+            if (!dropped) {
+                drop_packet(&gmeta.drop);
+                ret = -5;
+            }
+        }
     }
 #endif
 
@@ -881,43 +1434,1487 @@ pktio_tx(void)
     return pktio_tx_with_meta(0, 0);
 }
 
-void
-pktio_tx_drop(void)
+__intrinsic unsigned int
+pktio_ctm_len(void)
 {
-#ifdef PKTIO_GRO_ENABLED
-    __xwrite union gro_meta gmeta;
+    return pkt_ctm_data_size(pkt.p_len, pkt.p_offset, pkt.p_ctm_size);
+}
 
-    drop_packet(&gmeta.drop);
-#else
-    drop_packet();
+__intrinsic __mem40 void *
+pktio_pkt_ptr40(unsigned int off)
+{
+    if (off < pktio_ctm_len())
+        return pkt_ctm_ptr40(pkt.p_isl, pkt.p_pnum, pkt.p_offset + off);
+
+#ifdef PKTIO_CHAIN_ENABLED
+    if (pkt.p_chained)
+        return pktio_chain_ptr40(pkt.p_muptr, pkt.p_offset + off);
 #endif
-    PKTIO_CNTR_INC(PKTIO_CNTR_TX_DROP);
+    return PKTIO_MU_PTR40(pkt.p_muptr, pkt.p_offset + off);
+}
 
-#ifdef PKTIO_GRO_ENABLED
-    if (pkt.p_is_gro_seq) {
-        gro_cli_send(&gmeta, pkt.p_ro_ctx, pkt.p_seq);
+/* Set an iterator to the region starting at buffer offset boff */
+__intrinsic static int
+pktio_pkt_iter_at(unsigned int boff, __gpr struct pktio_pkt_iter *it)
+{
+    unsigned int ctm_end = pkt.p_offset + pktio_ctm_len();
+    unsigned int end = pkt.p_offset + pkt.p_len;
+
+    if (boff >= end) {
+        it->len = 0;
+        return -1;
     }
+
+    if (boff < ctm_end) {
+        it->ptr = pkt_ctm_ptr40(pkt.p_isl, pkt.p_pnum, boff);
+        it->next = ctm_end;
+    } else {
+#ifdef PKTIO_CHAIN_ENABLED
+        if (pkt.p_chained) {
+            it->ptr = pktio_chain_ptr40(pkt.p_muptr, boff);
+            it->next = (boff + PKTIO_CHAIN_BUF_SZ) &
+                ~(PKTIO_CHAIN_BUF_SZ - 1);
+            if (it->next > end)
+                it->next = end;
+        } else
 #endif
-    return;
+        {
+            it->ptr = PKTIO_MU_PTR40(pkt.p_muptr, boff);
+            it->next = end;
+        }
+    }
+
+    it->len = it->next - boff;
+    return 0;
 }
 
-void
-pktio_rx_init()
+__intrinsic int
+pktio_pkt_iter_first(unsigned int off, __gpr struct pktio_pkt_iter *it)
 {
-#ifdef PKTIO_NFD_ENABLED
-    nfd_in_recv_init();
-#endif
+    return pktio_pkt_iter_at(pkt.p_offset + off, it);
 }
 
+__intrinsic int
+pktio_pkt_iter_next(__gpr struct pktio_pkt_iter *it)
+{
+    return pktio_pkt_iter_at(it->next, it);
+}
 
-void
-pktio_tx_init()
+__intrinsic int
+pktio_pkt_regions(unsigned int off, __gpr struct pktio_pkt_regions *r)
 {
-    PKTIO_CNTRS_SET_BASE(pktio_cntrs_base);
-#ifdef PKTIO_NFD_ENABLED
-    nfd_out_send_init();
-#endif
+    unsigned int ctm_len = pktio_ctm_len();
+
+    /* The MU part of a chained packet is not contiguous */
+    if (pkt.p_chained)
+        return -1;
+
+    if (off < ctm_len) {
+        r->ctm_ptr = pkt_ctm_ptr40(pkt.p_isl, pkt.p_pnum, pkt.p_offset + off);
+        r->ctm_len = ctm_len - off;
+        r->mu_ptr = PKTIO_MU_PTR40(pkt.p_muptr, pkt.p_offset + ctm_len);
+        r->mu_len = pkt.p_len - ctm_len;
+    } else {
+        r->ctm_ptr = pkt_ctm_ptr40(pkt.p_isl, pkt.p_pnum, pkt.p_offset + off);
+        r->ctm_len = 0;
+        r->mu_ptr = PKTIO_MU_PTR40(pkt.p_muptr, pkt.p_offset + off);
+        r->mu_len = pkt.p_len - off;
+    }
+    return 0;
+}
+
+#ifdef PKTIO_CHAIN_ENABLED
+
+int
+pktio_chain_extend(unsigned int len)
+{
+    __xread struct pktio_chain xchain;
+    __xread blm_buf_handle_t xnew[PKTIO_CHAIN_BUFS - 1];
+    __xwrite uint32_t xw[PKTIO_CHAIN_BUFS - 1];
+    __xwrite uint32_t xhdr;
+    __mem40 uint8_t *desc;
+    unsigned int num, need;
+    unsigned int i;
+
+    if (pkt.p_muptr == 0)
+        return -1;
+
+    need = (pkt.p_offset + len + PKTIO_CHAIN_BUF_SZ - 1) / PKTIO_CHAIN_BUF_SZ;
+    if (need > PKTIO_CHAIN_BUFS)
+        return -1;
+
+    desc = PKTIO_MU_PTR40(pkt.p_muptr, 0);
+    num = 1;
+    if (pkt.p_chained) {
+        mem_read32(&xchain, desc, sizeof(xchain));
+        num = xchain.num;
+    }
+    if (need <= num)
+        return 0;
+
+    /* The descriptor overwrites the start of the head MU buffer, which
+     * must hold no packet data: the CTM part of the packet at its new
+     * length must cover it */
+    if (pkt.p_offset + pkt_ctm_data_size(len, pkt.p_offset, pkt.p_ctm_size) <
+        sizeof(struct pktio_chain))
+        return -1;
+
+    if (blm_buf_alloc_bulk(xnew, need - num, pkt.p_bls) != 0)
+        return -1;
+
+    /* The new handles go to words num to need - 1, then the count.  Only
+     * the need - num handles allocated are valid. */
+    for (i = 0; i < PKTIO_CHAIN_BUFS - 1; i++) {
+        if (i < need - num)
+            xw[i] = xnew[i];
+    }
+    mem_write32(xw, desc + (num << 2), (need - num) << 2);
+    xhdr = need << 24;
+    mem_write32(&xhdr, desc, sizeof(xhdr));
+
+    /* The packet now runs past its CTM part into the chain */
+    pkt.p_is_split = 1;
+    pkt.p_chained = 1;
+    return 0;
+}
+
+__intrinsic unsigned int
+pktio_chain_bufs(__lmem uint32_t *bufs)
+{
+    __xread struct pktio_chain xchain;
+
+    if (pkt.p_muptr == 0)
+        return 0;
+
+    bufs[0] = pkt.p_muptr;
+    if (!pkt.p_chained)
+        return 1;
+
+    mem_read32(&xchain, PKTIO_MU_PTR40(pkt.p_muptr, 0), sizeof(xchain));
+    *(__lmem struct pktio_chain *)bufs = xchain;
+    bufs[0] = pkt.p_muptr;
+
+    return ((__lmem struct pktio_chain *)bufs)->num;
+}
+
+__intrinsic uint32_t
+pktio_pkt_ones_sum(unsigned int off)
+{
+    __gpr struct pktio_pkt_iter it;
+    uint32_t sum = 0;
+    uint32_t part;
+    uint32_t pos = 0;
+
+    if (pktio_pkt_iter_first(off, &it) != 0)
+        return 0;
+
+    do {
+        part = ones_sum_mem(it.ptr, it.len);
+
+        /* A region at an odd position has its bytes in the opposite lanes
+         * of the 16 bit sum (RFC1071) */
+        if (pos & 1) {
+            part = ones_sum_fold16(part);
+            part = ((part >> 8) | (part << 8)) & 0xffff;
+        }
+        sum = ones_sum_add(sum, part);
+        pos += it.len;
+    } while (pktio_pkt_iter_next(&it) == 0);
+
+    return sum;
+}
+
+#endif /* PKTIO_CHAIN_ENABLED */
+
+#ifdef PKTIO_TX_BURST_ENABLED
+
+/* Whether a packet of a burst can share the writes of a chunk */
 #ifdef PKTIO_GRO_ENABLED
-    gro_cli_init();
+#define PKTIO_TX_BURST_FAST(_p) \
+    (PKT_PORT_TYPE_of((_p).p_dst) == PKT_PTYPE_WIRE && \
+     !(_p).p_is_gro_seq && !PKTIO_CHAINED(_p))
+#else
+#define PKTIO_TX_BURST_FAST(_p) \
+    (PKT_PORT_TYPE_of((_p).p_dst) == PKT_PTYPE_WIRE && !PKTIO_CHAINED(_p))
+#endif
+
+#ifdef MAC_EGRESS_PREPEND_ENABLE
+#define PKTIO_TX_BURST_CSUM(_p) \
+    (((_p).p_tx_l3_csum ? MAC_EGR_CMD_L3_CSUM_EN : 0) | \
+     ((_p).p_tx_l4_csum ? MAC_EGR_CMD_L4_CSUM_EN : 0))
+#define _PKTIO_TX_BURST_MAC \
+    __asm { mem[write32, xmac, hi, <<8, mac_off, 1] }
+#else
+#define PKTIO_TX_BURST_CSUM(_p)     0
+#define _PKTIO_TX_BURST_MAC
+#endif
+
+/*
+ * Writes of packet _i of a chunk, all unsignalled: the NBI metadata if
+ * the packet did not come from the wire, and the MAC egress command and
+ * script shared by the chunk.  CTM completes the writes of an ME in order,
+ * so the signalled read back of the script covers all of them.
+ */
+#define _PKTIO_TX_BURST_WRITE(_i)                                           \
+    case _i:                                                                \
+        if (PKT_PORT_TYPE_of(pkts[k].p_src) != PKT_PTYPE_WIRE) {            \
+            meta_xw##_i = pkts[k].p_nbi;                                    \
+            __asm { mem[write, meta_xw##_i, hi, <<8, 0, 1] }                \
+        }                                                                   \
+        _PKTIO_TX_BURST_MAC                                                 \
+        if (ms_lw == 2) {                                                   \
+            __asm { mem[write32, ms_xw, hi, <<8, ms_off, 2] }               \
+        } else {                                                            \
+            __asm { mem[write32, ms_xw, hi, <<8, ms_off, 4] }               \
+        }                                                                   \
+        __mem_read32(&rdback##_i, (__mem40 uint8_t *)ctm_ptr + ms_off,      \
+                     sizeof(rdback##_i), sizeof(rdback##_i), sig_done,      \
+                     &rd_sig##_i);                                          \
+        sig_mask |= 1 << __signal_number(&rd_sig##_i);                      \
+        break;
+
+int
+pktio_tx_burst(__lmem struct pktio_meta *pkts, unsigned int num)
+{
+    volatile __xwrite struct nbi_meta_pkt_info meta_xw0, meta_xw1;
+    volatile __xwrite struct nbi_meta_pkt_info meta_xw2, meta_xw3;
+    volatile __xwrite uint32_t ms_xw[4];
+    volatile __xwrite uint32_t xmac;
+    __xread uint32_t rdback0, rdback1, rdback2, rdback3;
+    SIGNAL rd_sig0, rd_sig1, rd_sig2, rd_sig3;
+    SIGNAL_MASK sig_mask;
+    __gpr modscript_struct_t script;
+    __gpr struct pkt_ms_info msi;
+    __mem40 void *ctm_ptr;
+    uint32_t hi;
+    uint32_t off, csum;
+    uint32_t ms_off, ms_lw, mac_len;
+#ifdef MAC_EGRESS_PREPEND_ENABLE
+    uint32_t mac_off;
+#endif
+    unsigned int first, n, i, k;
+    unsigned int sent = 0;
+    int ret = 0;
+
+    k = 0;
+    while (k < num) {
+        off = pkts[k].p_offset;
+        csum = PKTIO_TX_BURST_CSUM(pkts[k]);
+        msi.off_enc = 0;
+
+        if (PKTIO_TX_BURST_FAST(pkts[k])) {
+            /* One script for all packets of the chunk */
+            mac_len = 0;
+#ifdef MAC_EGRESS_PREPEND_ENABLE
+            mac_off = off - 4;
+            xmac = csum;
+            mac_len = 4;
+#endif
+            msi = modscript_lookup(off - mac_len, &script);
+        }
+
+        /* Anything else goes out on its own */
+        if (msi.off_enc == 0) {
+            pkt = pkts[k];
+            if (pktio_tx() != 0)
+                ret++;
+            k++;
+            continue;
+        }
+
+        ms_off = script.prepend_offset;
+        ms_lw = script.prepend_len0;
+        ms_xw[0] = script.value[0];
+        ms_xw[1] = script.value[1];
+        ms_xw[2] = script.value[2];
+        ms_xw[3] = script.value[3];
+
+        /* Issue the writes of the chunk before waiting for any */
+        sig_mask = 0;
+        first = k;
+        for (n = 0; n < PKTIO_TX_BURST_PIPE && k < num; n++, k++) {
+            if (!PKTIO_TX_BURST_FAST(pkts[k]) || pkts[k].p_offset != off ||
+                PKTIO_TX_BURST_CSUM(pkts[k]) != csum)
+                break;
+
+            ctm_ptr = pkt_ctm_ptr40(pkts[k].p_isl, pkts[k].p_pnum, 0);
+            hi = (uint64_t)ctm_ptr >> 8;
+
+            switch (n) {
+            _PKTIO_TX_BURST_WRITE(0)
+            _PKTIO_TX_BURST_WRITE(1)
+            _PKTIO_TX_BURST_WRITE(2)
+            _PKTIO_TX_BURST_WRITE(3)
+            }
+        }
+
+        /* One wait for the writes of the whole chunk */
+        wait_sig_mask(sig_mask);
+        __implicit_read(&rd_sig0);
+        __implicit_read(&rd_sig1);
+        __implicit_read(&rd_sig2);
+        __implicit_read(&rd_sig3);
+        __implicit_read(&meta_xw0);
+        __implicit_read(&meta_xw1);
+        __implicit_read(&meta_xw2);
+        __implicit_read(&meta_xw3);
+        __implicit_read(ms_xw);
+        __implicit_read(&xmac);
+
+        for (i = first; i < k; i++) {
+            pkt_nbi_send(pkts[i].p_isl,
+                         pkts[i].p_pnum,
+                         &msi,
+                         pkts[i].p_len + mac_len,
+                         PKT_PORT_SUBSYS_of(pkts[i].p_dst),
+                         CHANNEL_TO_TMQ(PKT_PORT_QUEUE_of(pkts[i].p_dst)),
+                         pkts[i].p_ro_ctx,
+                         pkts[i].p_seq,
+                         pkts[i].p_ctm_size);
+        }
+        sent += n;
+    }
+
+    PKTIO_CNTR_ADD(PKTIO_CNTR_TX_TO_WIRE, sent);
+    return ret;
+}
+
+#endif /* PKTIO_TX_BURST_ENABLED */
+
+#ifdef PKTIO_GEN_ENABLED
+
+#ifndef PKTIO_GEN_OFFSET
+#define PKTIO_GEN_OFFSET    64
+#endif
+
+#if (PKTIO_GEN_OFFSET < PKTIO_MIN_NBI_TX_OFFSET + 4 || \
+     PKTIO_GEN_OFFSET > PKTIO_MAX_NBI_TX_OFFSET || (PKTIO_GEN_OFFSET & 0x3))
+#error "PKTIO_GEN_OFFSET must be a multiple of 4 in 44..248"
+#endif
+
+/* Fields of the first word of a struct pktio_gen_tmpl */
+#define PKTIO_GEN_LEN_of(_ctl)          ((_ctl) >> 16)
+#define PKTIO_GEN_TMPL_LEN_of(_ctl)     (((_ctl) >> 8) & 0xff)
+#define PKTIO_GEN_STAMP_OFF_of(_ctl)    ((_ctl) & 0xff)
+
+int
+pktio_gen(__mem40 struct pktio_gen_tmpl *tmpl, uint32_t seq)
+{
+    __xread uint32_t tmpl_xr[16];
+    __xwrite uint32_t buf_xw[16];
+    __xwrite uint32_t stamp_xw[3];
+    __mem40 uint8_t *pkt_ptr;
+    SIGNAL sig;
+    uint64_t tsc;
+    uint32_t ctl, fill;
+    uint32_t len, tmpl_len, stamp_off, end;
+    uint32_t off, n, i;
+    unsigned int ctm_size;
+    unsigned int pnum;
+
+    mem_read32(tmpl_xr, tmpl, 8);
+    ctl = tmpl_xr[0];
+    fill = tmpl_xr[1];
+    len = PKTIO_GEN_LEN_of(ctl);
+    tmpl_len = PKTIO_GEN_TMPL_LEN_of(ctl);
+    stamp_off = PKTIO_GEN_STAMP_OFF_of(ctl);
+
+    if (len == 0 || len > 2048 - PKTIO_GEN_OFFSET || tmpl_len > len ||
+        tmpl_len > PKTIO_GEN_TMPL_LW * 4 || ((tmpl_len | stamp_off) & 0x3) ||
+        (stamp_off != 0 && stamp_off + PKTIO_GEN_STAMP_SZ > len))
+        return -1;
+
+    if (len + PKTIO_GEN_OFFSET <= 256)
+        ctm_size = PKT_CTM_SIZE_256;
+    else if (len + PKTIO_GEN_OFFSET <= 512)
+        ctm_size = PKT_CTM_SIZE_512;
+    else if (len + PKTIO_GEN_OFFSET <= 1024)
+        ctm_size = PKT_CTM_SIZE_1024;
+    else
+        ctm_size = PKT_CTM_SIZE_2048;
+
+    pnum = PKTIO_CTM_ALLOC(ctm_size);
+    if (pnum == CTM_ALLOC_ERR)
+        return -1;
+    pkt_ptr = pkt_ctm_ptr40(__ISLAND, pnum, PKTIO_GEN_OFFSET);
+
+    /* Template data, up to 64B per write */
+    for (off = 0; off < tmpl_len; off += sizeof(buf_xw)) {
+        n = tmpl_len - off;
+        if (n > sizeof(buf_xw))
+            n = sizeof(buf_xw);
+        __mem_read32(tmpl_xr, &tmpl->data[off >> 2], n, sizeof(tmpl_xr),
+                     ctx_swap, &sig);
+        reg_cp(buf_xw, tmpl_xr, sizeof(buf_xw));
+        __mem_write32(buf_xw, pkt_ptr + off, n, sizeof(buf_xw),
+                      ctx_swap, &sig);
+    }
+
+    /* Fill pattern for the rest, without going past the packet end as the
+     * smallest buffer may end there */
+    for (i = 0; i < 16; i++)
+        buf_xw[i] = fill;
+    end = (len + 3) & ~0x3;
+    for (off = tmpl_len; off < end; off += sizeof(buf_xw)) {
+        n = end - off;
+        if (n > sizeof(buf_xw))
+            n = sizeof(buf_xw);
+        __mem_write32(buf_xw, pkt_ptr + off, n, sizeof(buf_xw),
+                      ctx_swap, &sig);
+    }
+
+    if (stamp_off != 0) {
+        tsc = me_tsc_read();
+        stamp_xw[0] = seq;
+        stamp_xw[1] = tsc >> 32;
+        stamp_xw[2] = tsc;
+        mem_write32(stamp_xw, pkt_ptr + stamp_off, sizeof(stamp_xw));
+    }
+
+    reg_zero((void *)pkt.__raw, sizeof(pkt));
+    pkt.p_isl = __ISLAND;
+    pkt.p_pnum = pnum;
+    pkt.p_len = len;
+    pkt.p_orig_len = len;
+    pkt.p_offset = PKTIO_GEN_OFFSET;
+    pkt.p_ctm_size = ctm_size;
+    pkt.p_src = PKT_NOTX;
+    pkt.p_dst = PKT_DROP;
+
+    return 0;
+}
+
+#endif /* PKTIO_GEN_ENABLED */
+
+#ifdef PKTIO_CAP_ENABLED
+
+/* Rings of free and captured record slots, 512 entries */
+MEM_RING_INIT(pktio_cap_free, 2048);
+MEM_RING_INIT(pktio_cap_ring, 2048);
+
+#define PKTIO_CAP_RING_ARGS(_name) \
+    MEM_RING_GET_NUM(_name), MEM_RING_GET_MEMADDR(_name)
+
+__export __emem struct pktio_cap_ctl pktio_cap_ctl = {0};
+__export __emem __align(PKTIO_CAP_SLOT_SZ)
+    uint32_t pktio_cap_slots[PKTIO_CAP_SLOTS][PKTIO_CAP_SLOT_SZ / 4];
+__export __emem uint32_t pktio_cap_idx[PKTIO_CAP_SLOTS];
+
+/* Set by the first pktio_cap_init(), which fills the free ring */
+__export __emem uint32_t pktio_cap_filled = 0;
+
+/* Per ME copy of the configuration, re-read every PKTIO_CAP_REFRESH calls.
+ * The per ME state is reset by pktio_cap_init(), as LMEM is not cleared
+ * at load. */
+__shared __lmem struct pktio_cap_ctl pktio_cap_cfg;
+__shared __lmem uint32_t pktio_cap_calls;
+
+/* State of the context calling pktio_cap_drain() */
+__shared __lmem uint32_t pktio_cap_prod;
+__shared __lmem uint32_t pktio_cap_freed;
+
+void
+pktio_cap_init(void)
+{
+    __xrw uint32_t filled_xrw;
+    __xrw uint32_t slot_xrw;
+    uint32_t slot;
+
+    /* sample == 0 captures nothing until the configuration is read, which
+     * the first pktio_cap() does as pktio_cap_calls is 0 */
+    for (slot = 0; slot < PKTIO_CAP_CFG_LW; slot++)
+        pktio_cap_cfg.__raw[slot] = 0;
+    pktio_cap_calls = 0;
+    pktio_cap_prod = 0;
+    pktio_cap_freed = 0;
+
+    filled_xrw = 1;
+    mem_test_set(&filled_xrw, &pktio_cap_filled, sizeof(filled_xrw));
+    if (filled_xrw != 0)
+        return;
+
+    for (slot = 0; slot < PKTIO_CAP_SLOTS; slot++) {
+        slot_xrw = slot;
+        mem_ring_put(PKTIO_CAP_RING_ARGS(pktio_cap_free), &slot_xrw,
+                     sizeof(slot_xrw));
+    }
+}
+
+int
+pktio_cap(unsigned int point)
+{
+    __xread uint32_t buf_xr[16];
+    __xwrite uint32_t buf_xw[16];
+    __xrw uint32_t slot_xrw;
+    __gpr struct pktio_cap_hdr hdr;
+    __mem40 uint8_t *src;
+    __mem40 uint8_t *dst;
+    SIGNAL sig;
+    uint64_t tsc;
+    uint32_t slot, snap;
+    uint32_t off, end, ctm_end, n;
+
+    if ((pktio_cap_calls++ & (PKTIO_CAP_REFRESH - 1)) == 0) {
+        mem_read32(buf_xr, &pktio_cap_ctl, PKTIO_CAP_CFG_LW * 4);
+        pktio_cap_cfg.__raw[0] = buf_xr[0];
+        pktio_cap_cfg.__raw[1] = buf_xr[1];
+        pktio_cap_cfg.__raw[2] = buf_xr[2];
+        pktio_cap_cfg.__raw[3] = buf_xr[3];
+        pktio_cap_cfg.__raw[4] = buf_xr[4];
+        pktio_cap_cfg.__raw[5] = buf_xr[5];
+    }
+
+    if (pktio_cap_cfg.sample == 0 || point > 31 ||
+        !((pktio_cap_cfg.points >> point) & 1))
+        return 0;
+
+    if (((pkt.p_src ^ pktio_cap_cfg.src_val) & pktio_cap_cfg.src_mask) ||
+        ((pkt.p_dst ^ pktio_cap_cfg.dst_val) & pktio_cap_cfg.dst_mask) ||
+        pkt.p_len < pktio_cap_cfg.len_min ||
+        pkt.p_len > pktio_cap_cfg.len_max)
+        return 0;
+
+    if (pktio_cap_cfg.sample < PKTIO_CAP_SAMPLE_ALL &&
+        (local_csr_read(local_csr_pseudo_random_number) & 0xffff) >=
+        pktio_cap_cfg.sample)
+        return 0;
+
+    tsc = me_tsc_read();
+
+    /* An empty free ring fails straight away: the host is behind */
+    if (mem_ring_get(PKTIO_CAP_RING_ARGS(pktio_cap_free), buf_xr,
+                     sizeof(uint32_t)) != 0) {
+        PKTIO_CNTR_INC(PKTIO_CNTR_ERR_CAP);
+        return -1;
+    }
+    slot = buf_xr[0] & (PKTIO_CAP_SLOTS - 1);
+
+    snap = pkt.p_len;
+    if (snap > pktio_cap_cfg.snaplen)
+        snap = pktio_cap_cfg.snaplen;
+    if (snap > PKTIO_CAP_SNAP_MAX)
+        snap = PKTIO_CAP_SNAP_MAX;
+
+    /* Copy whole words from the 4B aligned offset at or before the packet.
+     * The CTM part of a split packet ends on a 256B boundary, so copies
+     * from MU never cross a buffer of a chain either. */
+    ctm_end = pkt.p_offset + pktio_ctm_len();
+    end = (pkt.p_offset + snap + 3) & ~0x3;
+    dst = (__mem40 uint8_t *)pktio_cap_slots[slot] + PKTIO_CAP_HDR_SZ;
+    for (off = pkt.p_offset & ~0x3; off < end; off += n) {
+        n = end - off;
+        if (n > sizeof(buf_xr))
+            n = sizeof(buf_xr);
+        if (off < ctm_end || !pkt.p_is_split) {
+            if (pkt.p_is_split && off + n > ctm_end)
+                n = ctm_end - off;
+            src = pkt_ctm_ptr40(pkt.p_isl, pkt.p_pnum, off);
+        } else {
+            src = pktio_pkt_ptr40(off - pkt.p_offset);
+        }
+
+        __mem_read32(buf_xr, src, n, sizeof(buf_xr), ctx_swap, &sig);
+        reg_cp(buf_xw, buf_xr, sizeof(buf_xw));
+        __mem_write32(buf_xw, dst, n, sizeof(buf_xw), ctx_swap, &sig);
+        dst += n;
+    }
+
+    hdr.tsc_hi = tsc >> 32;
+    hdr.tsc_lo = tsc;
+    hdr.point = point;
+    hdr.pad = pkt.p_offset & 0x3;
+    hdr.snap = snap;
+    hdr.len = pkt.p_len;
+    hdr.src = pkt.p_src;
+    hdr.dst = pkt.p_dst;
+    buf_xw[0] = hdr.__raw[0];
+    buf_xw[1] = hdr.__raw[1];
+    buf_xw[2] = hdr.__raw[2];
+    buf_xw[3] = hdr.__raw[3];
+    mem_write32(buf_xw, pktio_cap_slots[slot], PKTIO_CAP_HDR_SZ);
+
+    /* The ring has an entry for every slot, so this cannot fail */
+    slot_xrw = slot;
+    mem_ring_put(PKTIO_CAP_RING_ARGS(pktio_cap_ring), &slot_xrw,
+                 sizeof(slot_xrw));
+
+    PKTIO_CNTR_INC(PKTIO_CNTR_CAP);
+    return 1;
+}
+
+void
+pktio_cap_drain(void)
+{
+    __xread uint32_t xr;
+    __xwrite uint32_t xw;
+    __xrw uint32_t slot_xrw;
+    uint32_t prod = pktio_cap_prod;
+    uint32_t freed = pktio_cap_freed;
+    uint32_t cons, n;
+
+    /* Return the slots of the records the host has consumed */
+    mem_read32(&xr, &pktio_cap_ctl.cons, sizeof(xr));
+    cons = xr;
+    if (cons - freed > prod - freed)
+        cons = prod;
+    for (; freed != cons; freed++) {
+        mem_read32(&xr, &pktio_cap_idx[freed & (PKTIO_CAP_SLOTS - 1)],
+                   sizeof(xr));
+        slot_xrw = xr;
+        mem_ring_put(PKTIO_CAP_RING_ARGS(pktio_cap_free), &slot_xrw,
+                     sizeof(slot_xrw));
+    }
+
+    /* Hand the captured records to the host, publishing them once their
+     * entries of pktio_cap_idx[] are written */
+    for (n = 0; n < PKTIO_CAP_DRAIN_MAX &&
+             prod - freed < PKTIO_CAP_SLOTS; n++) {
+        if (mem_ring_get(PKTIO_CAP_RING_ARGS(pktio_cap_ring), &xr,
+                         sizeof(xr)) != 0)
+            break;
+        xw = xr;
+        mem_write32(&xw, &pktio_cap_idx[prod & (PKTIO_CAP_SLOTS - 1)],
+                    sizeof(xw));
+        prod++;
+    }
+    if (n != 0) {
+        xw = prod;
+        mem_write32(&xw, &pktio_cap_ctl.prod, sizeof(xw));
+    }
+
+    pktio_cap_prod = prod;
+    pktio_cap_freed = freed;
+}
+
+#endif /* PKTIO_CAP_ENABLED */
+
+#ifdef PKTIO_REPL_ENABLED
+
+/* Fields of the first word of a struct pktio_repl_dst */
+#define PKTIO_REPL_DST_of(_ctl)         ((_ctl) >> 16)
+#define PKTIO_REPL_HDR_OFF_of(_ctl)     (((_ctl) >> 8) & 0xff)
+#define PKTIO_REPL_HDR_LEN_of(_ctl)     ((_ctl) & 0xff)
+
+/* How pktio_tx_repl_wire() sends a packet */
+#define PKTIO_REPL_SEND_COPY    0   /* A copy, freed by the NBI once sent */
+#define PKTIO_REPL_SEND_MIRROR  1   /* The original to a mirror, not freed */
+#define PKTIO_REPL_SEND_LAST    2   /* The original in sequence, freed once
+                                     * its mirrors have been sent too */
+
+/*
+ * Write the MAC egress command and modification script of a packet that is
+ * ready in CTM and send it to the wire as 'how', unordered unless it is
+ * PKTIO_REPL_SEND_LAST.  Returns 0 on success or -2 if the packet offset is
+ * not supported by the packet modifier.
+ */
+__intrinsic static int
+pktio_tx_repl_wire(unsigned int isl, unsigned int pnum, unsigned int dst,
+                   unsigned int how)
+{
+    __mem40 void *ctm_ptr;
+    SIGNAL mac_write_sig;
+    SIGNAL pms_sig1;
+    SIGNAL pms_sig2;
+    __xwrite modscript_struct_t pms_write;
+    __xread uint32_t pms_readback;
+    __gpr struct pkt_ms_info msi;
+    uint32_t offset;
+    uint32_t len;
+    int dst_subsys = PKT_PORT_SUBSYS_of(dst);
+    int dst_q = CHANNEL_TO_TMQ(PKT_PORT_QUEUE_of(dst));
+
+    ctm_ptr = pkt_ctm_ptr40(isl, pnum, 0);
+    offset = pkt.p_offset;
+    len = pkt.p_len;
+
+#ifdef MAC_EGRESS_PREPEND_ENABLE
+    {
+        __xwrite uint32_t xmac;
+        __pkt_mac_egress_cmd_write(ctm_ptr, offset, pkt.p_tx_l3_csum,
+                                   pkt.p_tx_l4_csum, &xmac, sig_done,
+                                   &mac_write_sig);
+        offset -= 4;
+        len += 4;
+    }
+#endif
+
+    msi = __modscript_write(ctm_ptr, offset, &pms_write, &pms_readback,
+                            &pms_sig1, &pms_sig2);
+    wait_for_all(&pms_sig1, &pms_sig2, &mac_write_sig);
+
+    if (msi.off_enc == 0)
+        return -2;
+
+    if (how == PKTIO_REPL_SEND_COPY)
+        pkt_nbi_send(isl, pnum, &msi, len, dst_subsys, dst_q,
+                     0, 0, pkt.p_ctm_size);
+    else if (how == PKTIO_REPL_SEND_MIRROR)
+        pkt_nbi_send_dont_free(isl, pnum, &msi, len, dst_subsys, dst_q,
+                               0, 0, pkt.p_ctm_size);
+    else
+        pkt_nbi_send_free_on_last(isl, pnum, &msi, len, dst_subsys, dst_q,
+                                  pkt.p_ro_ctx, pkt.p_seq, pkt.p_ctm_size);
+
+    return 0;
+}
+
+/*
+ * Write the header rewrite of a replication group entry over a packet in
+ * CTM.  The caller has checked the entry against the packet.
+ */
+__intrinsic static void
+pktio_tx_repl_hdr(__mem40 struct pktio_repl_dst *ent, unsigned int hdr_off,
+                  unsigned int hdr_len, __mem40 void *pkt_ptr)
+{
+    __xread uint32_t hdr_xr[PKTIO_REPL_HDR_LW];
+    __xwrite uint32_t hdr_xw[PKTIO_REPL_HDR_LW];
+    SIGNAL sig;
+
+    mem_read32(hdr_xr, ent->hdr, sizeof(hdr_xr));
+    reg_cp(hdr_xw, hdr_xr, sizeof(hdr_xw));
+    __mem_write32(hdr_xw, (__mem40 uint8_t *)pkt_ptr + hdr_off, hdr_len,
+                  sizeof(hdr_xw), ctx_swap, &sig);
+}
+
+/* Copy the 64B blocks covering [start, end) from one buffer to another */
+__intrinsic static void
+pktio_tx_repl_blocks(__mem40 uint8_t *src, __mem40 uint8_t *dst,
+                     unsigned int start, unsigned int end)
+{
+    __xread uint64_t buf_xr[8];
+    __xwrite uint64_t buf_xw[8];
+    unsigned int i;
+
+    for (i = start & ~0x3F; i < end; i += sizeof(buf_xr)) {
+        mem_read64(buf_xr, src + i, sizeof(buf_xr));
+        reg_cp(buf_xw, buf_xr, sizeof(buf_xw));
+        mem_write64(buf_xw, dst + i, sizeof(buf_xw));
+    }
+}
+
+/*
+ * Make a copy of the packet in a new CTM buffer, and for a split packet of
+ * its MU part in a new buffer of the same BLQ, apply the header rewrite of
+ * the entry and send it to the wire.  The copy shares nothing with the
+ * original: the NBI frees the MU buffer of every CTM packet it sends, so
+ * only sends of the same CTM packet can share one.  The copy is freed by
+ * the NBI once sent, whenever the original is.
+ */
+__intrinsic static int
+pktio_tx_repl_copy(__mem40 struct pktio_repl_dst *ent, unsigned int dst,
+                   unsigned int hdr_off, unsigned int hdr_len,
+                   unsigned int ctm_len)
+{
+    __xwrite struct nbi_meta_pkt_info xinfo;
+    __gpr struct nbi_meta_pkt_info info;
+    __xread blm_buf_handle_t xmu;
+    unsigned int pnum;
+    unsigned int mu = 0;
+
+    pnum = PKTIO_CTM_ALLOC(pkt.p_ctm_size);
+    if (pnum == CTM_ALLOC_ERR)
+        return -1;
+
+    if (pkt.p_is_split) {
+        if (blm_buf_alloc(&xmu, pkt.p_bls) != 0) {
+            pkt_ctm_free(__ISLAND, pnum);
+            return -1;
+        }
+        mu = xmu;
+        pktio_tx_repl_blocks(PKTIO_MU_PTR40(pkt.p_muptr, 0),
+                             PKTIO_MU_PTR40(mu, 0),
+                             pkt.p_offset + ctm_len, pkt.p_offset + pkt.p_len);
+    }
+
+    pktio_tx_repl_blocks(pkt_ctm_ptr40(pkt.p_isl, pkt.p_pnum, 0),
+                         pkt_ctm_ptr40(__ISLAND, pnum, 0),
+                         pkt.p_offset, pkt.p_offset + ctm_len);
+
+    /* The metadata in front of the copy names the copy's buffers, and is
+     * written after the data in case the first 64B block of the copy
+     * overlapped it.  An unsplit copy carries no MU buffer. */
+    info = pkt.p_nbi;
+    info.isl = __ISLAND;
+    info.pnum = pnum;
+    if (!pkt.p_is_split) {
+        info.bls = 0;
+        info.split = 0;
+    }
+    info.muptr = mu;
+    xinfo = info;
+    mem_write64(&xinfo, pkt_ctm_ptr40(__ISLAND, pnum, 0), sizeof(xinfo));
+
+    if (hdr_len != 0)
+        pktio_tx_repl_hdr(ent, hdr_off, hdr_len,
+                          pkt_ctm_ptr40(__ISLAND, pnum, pkt.p_offset));
+
+    if (pktio_tx_repl_wire(__ISLAND, pnum, dst, PKTIO_REPL_SEND_COPY) != 0) {
+        if (mu != 0)
+            blm_buf_free(mu, pkt.p_bls);
+        pkt_ctm_free(__ISLAND, pnum);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Check that the header rewrite of an entry can be applied to the packet:
+ * aligned, at most PKTIO_REPL_HDR_LW words, and in the CTM part of the
+ * packet.
+ */
+__intrinsic static int
+pktio_tx_repl_hdr_ok(unsigned int hdr_off, unsigned int hdr_len,
+                     unsigned int ctm_len)
+{
+    if (((pkt.p_offset + hdr_off) | hdr_len) & 0x3)
+        return 0;
+    if (hdr_len > PKTIO_REPL_HDR_LW * 4)
+        return 0;
+    if (hdr_off + hdr_len > ctm_len)
+        return 0;
+    return 1;
+}
+
+/*
+ * Send the original to every mirror of the group other than 'orig' and
+ * then to 'orig', in sequence, all from its own buffers, which the NBI
+ * frees after the last of these sends.  'ret' is the result of the copies.
+ */
+__intrinsic static int
+pktio_tx_repl_mirrors(__mem40 struct pktio_repl_dst *grp, unsigned int num,
+                      unsigned int orig, int ret)
+{
+    __xwrite struct nbi_meta_pkt_info xinfo;
+    __xread uint32_t xctl;
+    unsigned int dst;
+    unsigned int i;
+
+    /* The NBI reads the buffers from the metadata in front of the packet */
+    if (PKT_PORT_TYPE_of(pkt.p_src) != PKT_PTYPE_WIRE) {
+        xinfo = pkt.p_nbi;
+        mem_write64(&xinfo, pkt_ctm_ptr40(pkt.p_isl, pkt.p_pnum, 0),
+                    sizeof(xinfo));
+    }
+
+    for (i = 0; i < num; i++) {
+        mem_read32(&xctl, &grp[i], sizeof(xctl));
+        if (i == orig || PKTIO_REPL_HDR_LEN_of(xctl) != 0)
+            continue;
+
+        /* The script is the same for all the sends: if one fails, so do
+         * the others and the last, which drops the packet */
+        dst = PKTIO_REPL_DST_of(xctl);
+        if (PKT_PORT_TYPE_of(dst) != PKT_PTYPE_WIRE ||
+            pktio_tx_repl_wire(pkt.p_isl, pkt.p_pnum, dst,
+                               PKTIO_REPL_SEND_MIRROR) != 0) {
+            PKTIO_CNTR_INC(PKTIO_CNTR_ERR_REPL);
+            ret = -1;
+            continue;
+        }
+        PKTIO_CNTR_INC(PKTIO_CNTR_TX_REPL);
+    }
+
+    mem_read32(&xctl, &grp[orig], sizeof(xctl));
+    pkt.p_dst = PKTIO_REPL_DST_of(xctl);
+    if (pktio_tx_repl_wire(pkt.p_isl, pkt.p_pnum, pkt.p_dst,
+                           PKTIO_REPL_SEND_LAST) != 0) {
+        PKTIO_CNTR_INC(PKTIO_CNTR_ERR_TO_WIRE);
+        pktio_tx_drop();
+        return -2;
+    }
+    PKTIO_CNTR_INC(PKTIO_CNTR_TX_TO_WIRE);
+
+    return ret;
+}
+
+int
+pktio_tx_replicate(__mem40 struct pktio_repl_dst *grp, unsigned int num)
+{
+    __xread uint32_t xctl;
+    uint32_t ctl;
+    unsigned int dst, hdr_off, hdr_len;
+    unsigned int ctm_len;
+    unsigned int orig = num - 1;
+    unsigned int mirrors = 0;
+    unsigned int i;
+    int share;
+    int tx_ret;
+    int ret = 0;
+
+    if (num == 0) {
+        pktio_tx_drop();
+        return -1;
+    }
+
+#ifdef PKTIO_CHAIN_ENABLED
+    /* Copies are made from the CTM and head MU buffer only */
+    if (pkt.p_chained) {
+        PKTIO_CNTR_INC(PKTIO_CNTR_ERR_CHAIN);
+        pktio_tx_drop();
+        return -1;
+    }
+#endif
+
+    ctm_len = pktio_ctm_len();
+
+    /* The original goes to the last mirror, or to the last entry rewritten
+     * in place if there are no mirrors */
+    for (i = 0; i < num; i++) {
+        mem_read32(&xctl, &grp[i], sizeof(xctl));
+        if (PKTIO_REPL_HDR_LEN_of(xctl) == 0) {
+            orig = i;
+            mirrors++;
+        }
+    }
+
+    /* The other mirrors are sent from the original's own buffers if the
+     * original goes to the wire in NBI order: the NBI frees them after the
+     * last of those sends.  Reordered by GRO, the original is sent by
+     * GRO.OUT, so the mirrors get copies like the rewritten entries. */
+    mem_read32(&xctl, &grp[orig], sizeof(xctl));
+    share = (mirrors > 1 &&
+             PKT_PORT_TYPE_of(PKTIO_REPL_DST_of(xctl)) == PKT_PTYPE_WIRE);
+#ifdef PKTIO_GRO_ENABLED
+    if (pkt.p_is_gro_seq)
+        share = 0;
+#endif
+
+    /* Every other entry gets a copy, made before the original is sent or
+     * rewritten.  Nothing tracks when the NBI has sent a packet, so no
+     * copy may use a buffer that the original frees. */
+    for (i = 0; i < num; i++) {
+        if (i == orig)
+            continue;
+
+        mem_read32(&xctl, &grp[i], sizeof(xctl));
+        ctl = xctl;
+        dst = PKTIO_REPL_DST_of(ctl);
+        hdr_off = PKTIO_REPL_HDR_OFF_of(ctl);
+        hdr_len = PKTIO_REPL_HDR_LEN_of(ctl);
+        if (share && hdr_len == 0)
+            continue;
+
+        if (PKT_PORT_TYPE_of(dst) != PKT_PTYPE_WIRE ||
+            (hdr_len != 0 && !pktio_tx_repl_hdr_ok(hdr_off, hdr_len,
+                                                   ctm_len)) ||
+            pktio_tx_repl_copy(&grp[i], dst, hdr_off, hdr_len,
+                               ctm_len) != 0) {
+            PKTIO_CNTR_INC(PKTIO_CNTR_ERR_REPL);
+            ret = -1;
+            continue;
+        }
+        PKTIO_CNTR_INC(PKTIO_CNTR_TX_REPL);
+    }
+
+    if (share)
+        return pktio_tx_repl_mirrors(grp, num, orig, ret);
+
+    /* pktio_tx() releases the sequence number and the buffers */
+    mem_read32(&xctl, &grp[orig], sizeof(xctl));
+    ctl = xctl;
+    hdr_off = PKTIO_REPL_HDR_OFF_of(ctl);
+    hdr_len = PKTIO_REPL_HDR_LEN_of(ctl);
+    if (hdr_len != 0) {
+        if (!pktio_tx_repl_hdr_ok(hdr_off, hdr_len, ctm_len)) {
+            PKTIO_CNTR_INC(PKTIO_CNTR_ERR_REPL);
+            pktio_tx_drop();
+            return -1;
+        }
+        pktio_tx_repl_hdr(&grp[orig], hdr_off, hdr_len,
+                          pkt_ctm_ptr40(pkt.p_isl, pkt.p_pnum, pkt.p_offset));
+    }
+
+    pkt.p_dst = PKTIO_REPL_DST_of(ctl);
+    tx_ret = pktio_tx();
+    if (tx_ret != 0)
+        return tx_ret;
+    return ret;
+}
+
+#endif /* PKTIO_REPL_ENABLED */
+
+#ifdef PKTIO_LSO_ENABLED
+
+#ifndef PKTIO_LSO_HDR_MAX
+#define PKTIO_LSO_HDR_MAX   96
+#endif
+
+#if (PKTIO_LSO_HDR_MAX > 128 || (PKTIO_LSO_HDR_MAX & 0x3))
+#error "PKTIO_LSO_HDR_MAX must be a multiple of 4 up to 128"
+#endif
+
+#ifndef PKTIO_LSO_OFFSET
+#define PKTIO_LSO_OFFSET    64
+#endif
+
+#if (PKTIO_LSO_OFFSET < PKTIO_MIN_NBI_TX_OFFSET + 4 || \
+     PKTIO_LSO_OFFSET + 7 > PKTIO_MAX_NBI_TX_OFFSET)
+#error "PKTIO_LSO_OFFSET must be in 44..241"
+#endif
+
+/*
+ * Largest segment, headers and payload.  A segment gets at most a 2048B
+ * CTM buffer and starts up to 7 bytes past PKTIO_LSO_OFFSET, which leaves
+ * room in front of it for the packet modifier script and MAC prepend.
+ */
+#define PKTIO_LSO_CTM_BUF_SZ    2048
+#define PKTIO_LSO_SEG_LEN_MAX   (PKTIO_LSO_CTM_BUF_SZ - (PKTIO_LSO_OFFSET + 7))
+
+#ifdef PKTIO_GRO_ENABLED
+#ifndef PKTIO_LSO_WQ
+#error "PKTIO_LSO_WQ must be #defined if PKTIO_GRO_ENABLED is"
+#endif
+#endif
+
+/* Headers of the packet being segmented, per context */
+#define PKTIO_LSO_HDR_LW    (((PKTIO_LSO_HDR_MAX + 63) & ~63) >> 2)
+__lmem uint32_t pktio_lso_hdr[PKTIO_LSO_HDR_LW];
+
+/* Metadata of the packet being segmented, per context */
+__lmem struct pktio_meta pktio_lso_orig;
+
+/* 16-bit field at an even offset of the headers */
+#define PKTIO_LSO_HDR16(_off) \
+    (((__lmem uint16_t *)pktio_lso_hdr)[(_off) >> 1])
+#define PKTIO_LSO_HDR8(_off) \
+    (((__lmem uint8_t *)pktio_lso_hdr)[_off])
+
+/* Sum of the 16-bit words of len bytes of the headers, len even */
+__intrinsic static uint32_t
+pktio_lso_hdr_sum(unsigned int off, unsigned int len)
+{
+    uint32_t sum = 0;
+
+    for (; len > 0; len -= 2, off += 2)
+        sum += PKTIO_LSO_HDR16(off);
+
+    return sum;
+}
+
+/* Read len bytes of headers from a packet into pktio_lso_hdr */
+__intrinsic static void
+pktio_lso_hdr_read(__mem40 void *pkt_ptr, unsigned int len)
+{
+    __xread uint32_t hdr_xr[16];
+    SIGNAL sig;
+    unsigned int off, n, i;
+
+    for (off = 0; off < len; off += sizeof(hdr_xr)) {
+        n = (len - off + 3) & ~0x3;
+        if (n > sizeof(hdr_xr))
+            n = sizeof(hdr_xr);
+        __mem_read32(hdr_xr, (__mem40 uint8_t *)pkt_ptr + off, n,
+                     sizeof(hdr_xr), ctx_swap, &sig);
+        for (i = 0; i < 16; i++)
+            pktio_lso_hdr[(off >> 2) + i] = hdr_xr[i];
+    }
+}
+
+/* Write len bytes of pktio_lso_hdr to a segment, which may be unaligned */
+__intrinsic static void
+pktio_lso_hdr_write(__mem40 void *seg_ptr, unsigned int len)
+{
+    __xwrite uint32_t hdr_xw[8];
+    SIGNAL sig;
+    unsigned int off, n, i;
+
+    for (off = 0; off < len; off += sizeof(hdr_xw)) {
+        n = len - off;
+        if (n > sizeof(hdr_xw))
+            n = sizeof(hdr_xw);
+        for (i = 0; i < 8; i++)
+            hdr_xw[i] = pktio_lso_hdr[(off >> 2) + i];
+        __mem_write8(hdr_xw, (__mem40 uint8_t *)seg_ptr + off, n,
+                     sizeof(hdr_xw), ctx_swap, &sig);
+    }
+}
+
+/*
+ * Copy len bytes at offset src of the original packet buffers (CTM up to
+ * ctm_end, MU after it) to offset dst of a segment's CTM buffer.  src and
+ * dst have the same alignment within 8B and whole 8B words are copied, so
+ * up to 7 bytes either side of the region are overwritten in the segment.
+ */
+__intrinsic static void
+pktio_lso_copy(__gpr struct nbi_meta_pkt_info *orig, unsigned int ctm_end,
+               unsigned int chained, unsigned int src, unsigned int seg_pnum,
+               unsigned int dst, unsigned int len)
+{
+    __xread uint64_t buf_xr[8];
+    __xwrite uint64_t buf_xw[8];
+    __mem40 void *src_ptr;
+    SIGNAL sig;
+    unsigned int off, end, n;
+
+    end = (src + len + 7) & ~0x7;
+    dst = dst - (src & 0x7);
+    for (off = src & ~0x7; off < end; off += n) {
+        n = end - off;
+        if (n > sizeof(buf_xr))
+            n = sizeof(buf_xr);
+        if (off < ctm_end) {
+            if (off + n > ctm_end)
+                n = ctm_end - off;
+            src_ptr = pkt_ctm_ptr40(orig->isl, orig->pnum, off);
+        } else {
+#ifdef PKTIO_CHAIN_ENABLED
+            if (chained) {
+                /* Reads stop at the end of each chained buffer */
+                if ((off & (PKTIO_CHAIN_BUF_SZ - 1)) + n > PKTIO_CHAIN_BUF_SZ)
+                    n = PKTIO_CHAIN_BUF_SZ - (off & (PKTIO_CHAIN_BUF_SZ - 1));
+                src_ptr = pktio_chain_ptr40(orig->muptr, off);
+            } else
+#endif
+            src_ptr = PKTIO_MU_PTR40(orig->muptr, off);
+        }
+
+        __mem_read64(buf_xr, src_ptr, n, sizeof(buf_xr), ctx_swap, &sig);
+        reg_cp(buf_xw, buf_xr, sizeof(buf_xw));
+        __mem_write64(buf_xw, pkt_ctm_ptr40(__ISLAND, seg_pnum, dst),
+                      n, sizeof(buf_xw), ctx_swap, &sig);
+        dst += n;
+    }
+}
+
+/* Make pkt the packet being segmented again */
+__intrinsic static void
+pktio_lso_orig_meta(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < PKTIO_NBI_META_LW; i++)
+        pkt.__raw[i] = pktio_lso_orig.__raw[i];
+}
+
+/* Make pkt a built segment, a CTM-only packet with the original's metadata */
+__intrinsic static void
+pktio_lso_seg_meta(unsigned int pnum, unsigned int ctm_size,
+                   unsigned int off, unsigned int len)
+{
+    pktio_lso_orig_meta();
+    pkt.p_isl = __ISLAND;
+    pkt.p_pnum = pnum;
+    pkt.p_len = len;
+    pkt.p_offset = off;
+    pkt.p_ctm_size = ctm_size;
+    pkt.p_bls = 0;
+    pkt.p_is_split = 0;
+    pkt.p_muptr = 0;
+    pkt.p_src = PKT_NOTX;
+    pkt.p_tx_lso = 0;
+#ifdef PKTIO_CHAIN_ENABLED
+    pkt.p_chained = 0;
+#endif
+    pkt.p_ro_ctx = 0;
+    pkt.p_is_gro_seq = 0;
+}
+
+#ifdef PKTIO_GRO_ENABLED
+/*
+ * Release a GRO sequence number to the work queue of the context and wait
+ * until GRO has put it there, i.e. until every packet with a lower
+ * sequence number has been released.  Returns 0, or -1 if GRO had already
+ * skipped the sequence number.
+ */
+__intrinsic static int
+pktio_lso_gro_wait(unsigned int ro_ctx, unsigned int seq)
+{
+    __xwrite union gro_meta gmeta;
+    __xread uint32_t wq_xr;
+    unsigned int muid = PKT_PORT_MUID_of(PKTIO_LSO_WQ);
+    unsigned int qnum = PKT_PORT_WQNUM_of(PKTIO_LSO_WQ) + ctx();
+
+    gro_cli_build_workq_meta1(&gmeta.memq, MUID_TO_ISL(muid), qnum, seq);
+    if (gro_cli_send(&gmeta, ro_ctx, seq) < 0)
+        return -1;
+
+    mem_workq_add_thread(qnum, MUID_TO_MEM_RING_ADDR(muid), &wq_xr,
+                         sizeof(wq_xr));
+    return 0;
+}
+#endif
+
+int
+pktio_tx_lso(unsigned int l3_off, unsigned int l4_off, unsigned int mss)
+{
+    __gpr struct nbi_meta_pkt_info orig;
+    uint32_t orig_offset = pkt.p_offset;
+    uint32_t ro_ctx = pkt.p_ro_ctx;
+#ifdef PKTIO_GRO_ENABLED
+    uint32_t is_gro_seq = pkt.p_is_gro_seq;
+#endif
+    uint32_t chained = PKTIO_CHAINED(pkt);
+    uint32_t ctm_len, ctm_end;
+    uint32_t hdr_len, pay_off, pay_len, seg_len;
+    uint32_t src, seg_off, seg_end;
+    uint32_t is_ipv4, sw_l4;
+    uint32_t ip_len0 = 0, ip_id0 = 0, ip_csum0 = 0, ip_id;
+    uint32_t tcp_seq0, tcp_seq, tcp_flags0, tcp_flags;
+    uint32_t hdr_sum = 0, sum;
+    uint32_t first, last;
+    unsigned int ctm_size;
+    unsigned int seg_pnum;
+    unsigned int i;
+    int ret = -1;
+
+    for (i = 0; i < PKTIO_NBI_META_LW; i++)
+        pktio_lso_orig.__raw[i] = pkt.__raw[i];
+    orig = pkt.p_nbi;
+    ctm_len = pkt_ctm_data_size(pkt.p_len, pkt.p_offset, pkt.p_ctm_size);
+    ctm_end = orig_offset + ctm_len;
+
+    if (mss == 0 || ((mss | l3_off | l4_off) & 1) || l4_off <= l3_off ||
+        l4_off + sizeof(struct tcp_hdr) > ctm_len ||
+        l4_off + sizeof(struct tcp_hdr) > PKTIO_LSO_HDR_MAX ||
+        (pkt.p_is_split && (ctm_end & 0x7)))
+        goto err;
+
+    pktio_lso_hdr_read(pkt_ctm_ptr40(orig.isl, orig.pnum, orig_offset),
+                       (ctm_len < PKTIO_LSO_HDR_MAX) ? ctm_len
+                                                     : PKTIO_LSO_HDR_MAX);
+
+    hdr_len = l4_off + ((PKTIO_LSO_HDR8(l4_off + 12) >> 4) << 2);
+    if (hdr_len > PKTIO_LSO_HDR_MAX || hdr_len > ctm_len ||
+        hdr_len >= orig.len || hdr_len + mss > PKTIO_LSO_SEG_LEN_MAX)
+        goto err;
+
+    is_ipv4 = (PKTIO_LSO_HDR8(l3_off) >> 4) == 4;
+    if (is_ipv4) {
+        if (PKTIO_LSO_HDR8(l3_off + 9) != NET_IP_PROTO_TCP ||
+            l4_off < l3_off + sizeof(struct ip4_hdr))
+            goto err;
+        ip_len0 = PKTIO_LSO_HDR16(l3_off + 2);
+        ip_id0 = PKTIO_LSO_HDR16(l3_off + 4);
+        ip_csum0 = PKTIO_LSO_HDR16(l3_off + 10);
+    } else {
+        if ((PKTIO_LSO_HDR8(l3_off) >> 4) != 6 ||
+            PKTIO_LSO_HDR8(l3_off + 6) != NET_IP_PROTO_TCP ||
+            l4_off != l3_off + sizeof(struct ip6_hdr))
+            goto err;
+    }
+
+    tcp_seq0 = (PKTIO_LSO_HDR16(l4_off + 4) << 16) |
+               PKTIO_LSO_HDR16(l4_off + 6);
+    tcp_flags0 = PKTIO_LSO_HDR16(l4_off + 12);
+
+    /* Sum of the pseudo header addresses and protocol and of the TCP
+     * header without checksum, updated incrementally per segment */
+    sw_l4 = 1;
+#ifdef MAC_EGRESS_PREPEND_ENABLE
+    if (pkt.p_tx_l4_csum)
+        sw_l4 = 0;
+#endif
+    if (sw_l4) {
+        PKTIO_LSO_HDR16(l4_off + 16) = 0;
+        hdr_sum = pktio_lso_hdr_sum(l4_off, hdr_len - l4_off);
+        if (is_ipv4)
+            hdr_sum += pktio_lso_hdr_sum(l3_off + 12, 8);
+        else
+            hdr_sum += pktio_lso_hdr_sum(l3_off + 8, 32);
+        hdr_sum += NET_IP_PROTO_TCP;
+    }
+
+    ip_id = ip_id0;
+    tcp_seq = tcp_seq0;
+    first = 1;
+    for (pay_off = hdr_len; ; pay_off += mss) {
+        pay_len = orig.len - pay_off;
+        last = (pay_len <= mss);
+        if (!last)
+            pay_len = mss;
+        seg_len = hdr_len + pay_len;
+
+        /* Place the segment so that its payload has the alignment of the
+         * original's within 8B, then size the buffer for whole words */
+        src = orig_offset + pay_off;
+        seg_off = PKTIO_LSO_OFFSET +
+            ((src - PKTIO_LSO_OFFSET - hdr_len) & 0x7);
+        seg_end = (seg_off + seg_len + 7) & ~0x7;
+        if (seg_end <= 256)
+            ctm_size = PKT_CTM_SIZE_256;
+        else if (seg_end <= 512)
+            ctm_size = PKT_CTM_SIZE_512;
+        else if (seg_end <= 1024)
+            ctm_size = PKT_CTM_SIZE_1024;
+        else
+            ctm_size = PKT_CTM_SIZE_2048;
+
+        /* Sending the segments after a missing one would leave a hole
+         * in the TCP sequence space, so drop the rest of the packet */
+        seg_pnum = PKTIO_CTM_ALLOC(ctm_size);
+        if (seg_pnum == CTM_ALLOC_ERR)
+            goto err;
+
+        pktio_lso_copy(&orig, ctm_end, chained, src, seg_pnum,
+                       seg_off + hdr_len, pay_len);
+
+        /* Per segment header rewrites */
+        if (is_ipv4) {
+            PKTIO_LSO_HDR16(l3_off + 2) = seg_len - l3_off;
+            PKTIO_LSO_HDR16(l3_off + 4) = ip_id;
+            PKTIO_LSO_HDR16(l3_off + 10) =
+                net_csum_mod(net_csum_mod(ip_csum0, ip_len0,
+                                          seg_len - l3_off),
+                             ip_id0, ip_id);
+        } else {
+            PKTIO_LSO_HDR16(l3_off + 4) =
+                seg_len - l3_off - sizeof(struct ip6_hdr);
+        }
+
+        tcp_flags = tcp_flags0;
+        if (!last)
+            tcp_flags &= ~(NET_TCP_FLAG_FIN | NET_TCP_FLAG_PSH);
+        if (!first)
+            tcp_flags &= ~NET_TCP_FLAG_CWR;
+        PKTIO_LSO_HDR16(l4_off + 4) = tcp_seq >> 16;
+        PKTIO_LSO_HDR16(l4_off + 6) = tcp_seq;
+        PKTIO_LSO_HDR16(l4_off + 12) = tcp_flags;
+
+        if (sw_l4) {
+            sum = hdr_sum;
+            sum = ones_sum_add(sum, (~tcp_seq0 >> 16) + (tcp_seq >> 16));
+            sum = ones_sum_add(sum, (~tcp_seq0 & 0xffff) +
+                               (tcp_seq & 0xffff));
+            sum = ones_sum_add(sum, (~tcp_flags0 & 0xffff) + tcp_flags);
+            sum = ones_sum_add(sum, seg_len - l4_off);
+            sum = ones_sum_add(sum, ones_sum_mem(
+                pkt_ctm_ptr40(__ISLAND, seg_pnum, seg_off + hdr_len),
+                pay_len));
+            PKTIO_LSO_HDR16(l4_off + 16) = ~ones_sum_fold16(sum);
+        }
+
+        pktio_lso_hdr_write(pkt_ctm_ptr40(__ISLAND, seg_pnum, seg_off),
+                            hdr_len);
+
+#ifdef PKTIO_GRO_ENABLED
+        /* Only send the first segment once GRO has released the sequence
+         * number, so that it leaves after every packet with a lower one.
+         * The context holds just that segment while it waits. */
+        if (is_gro_seq) {
+            is_gro_seq = 0;
+            pktio_lso_orig.p_is_gro_seq = 0;
+            pktio_lso_orig.p_ro_ctx = 0;
+            if (pktio_lso_gro_wait(ro_ctx, pktio_lso_orig.p_seq) != 0) {
+                PKTIO_CNTR_INC(PKTIO_CNTR_ERR_GRO_LATE);
+                pkt_ctm_free(__ISLAND, seg_pnum);
+                ret = -5;
+                goto drop;
+            }
+            ro_ctx = 0;
+        }
+#endif
+
+        /* Send the segment as soon as it is built, so that at most one
+         * CTM buffer is held.  An NBI sequence number goes with the last
+         * segment, which is sent once the original is freed. */
+        pktio_lso_seg_meta(seg_pnum, ctm_size, seg_off, seg_len);
+        if (last)
+            break;
+        if (pktio_tx() != 0)
+            goto err;
+        PKTIO_CNTR_INC(PKTIO_CNTR_TX_LSO);
+
+        ip_id = (ip_id + 1) & 0xffff;
+        tcp_seq += mss;
+        first = 0;
+    }
+
+    /* The original is no longer needed */
+#ifdef PKTIO_CHAIN_ENABLED
+    if (chained)
+        pktio_chain_free(orig.muptr, orig.bls);
+#endif
+    if (orig.muptr != 0)
+        blm_buf_free(orig.muptr, orig.bls);
+    pkt_ctm_free(orig.isl, orig.pnum);
+
+    pkt.p_ro_ctx = ro_ctx;
+    ret = pktio_tx();
+    if (ret == 0)
+        PKTIO_CNTR_INC(PKTIO_CNTR_TX_LSO);
+    return ret;
+
+err:
+    PKTIO_CNTR_INC(PKTIO_CNTR_ERR_LSO);
+drop:
+    /* Drop the original, with its sequence number unless GRO has taken
+     * it.  Segments already sent are a prefix of the packet. */
+    pktio_lso_orig_meta();
+    pktio_tx_drop();
+    return ret;
+}
+
+#endif /* PKTIO_LSO_ENABLED */
+
+void
+pktio_tx_drop(void)
+{
+#ifdef PKTIO_GRO_ENABLED
+    __xwrite union gro_meta gmeta;
+
+    drop_packet(&gmeta.drop);
+#else
+    drop_packet();
+#endif
+    PKTIO_CNTR_INC(PKTIO_CNTR_TX_DROP);
+
+#ifdef PKTIO_GRO_ENABLED
+    if (pkt.p_is_gro_seq) {
+        if (gro_cli_send(&gmeta, pkt.p_ro_ctx, pkt.p_seq) < 0)
+            PKTIO_CNTR_INC(PKTIO_CNTR_ERR_GRO_LATE);
+    }
+#endif
+    return;
+}
+
+#ifdef PKTIO_CTM_CREDIT_CACHE
+
+__intrinsic void
+pktio_ctm_credit_poll(void)
+{
+    pkt_ctm_cache_poll_pe_credit(&ctm_credits, &pktio_ctm_cache);
+}
+
+__intrinsic void
+pktio_ctm_credit_release(void)
+{
+    pkt_ctm_cache_put_credits(&ctm_credits, &pktio_ctm_cache);
+}
+
+#endif /* PKTIO_CTM_CREDIT_CACHE */
+
+void
+pktio_rx_init()
+{
+#ifdef PKTIO_CTM_CREDIT_CACHE
+    pktio_ctm_cache.pkts = 0;
+    pktio_ctm_cache.bufs = 0;
+#endif
+#ifdef PKTIO_NFD_ENABLED
+    nfd_in_recv_init();
+#endif
+}
+
+
+void
+pktio_tx_init()
+{
+    PKTIO_CNTRS_SET_BASE(pktio_cntrs_base);
+#ifdef PKTIO_CTM_CREDIT_CACHE
+    pktio_ctm_cache.pkts = 0;
+    pktio_ctm_cache.bufs = 0;
+#endif
+    modscript_cache_init();
+#ifdef PKTIO_NFD_ENABLED
+    nfd_out_send_init();
+#endif
+#ifdef PKTIO_GRO_ENABLED
+    /* p_ro_ctx cannot name more reorder contexts */
+    ctassert(GRO_CLI_MAX_CTX <= PKTIO_GRO_MAX_CTX);
+    gro_cli_init();
+#endif
+#if (BLM_MAGAZINE_SIZE != 0)
+    blm_mag_init();
 #endif
 }
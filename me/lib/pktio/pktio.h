@@ -73,9 +73,14 @@
  *   - emem work queues (wq)
  * The user may also, of course, drop packets (which takes more effort
  * than one might think) which the library handles by passing the packet
- * to pktio_tx() with a destination of PKT_DROP.  It does not yet provide
- * nice functions for generating packets from scratch nor for cloning
- * packets.  The user must currently write such themselves.
+ * to pktio_tx() with a destination of PKT_DROP.  Packets can be built
+ * from scratch with pktio_gen(), see PACKET GENERATION below, sent to
+ * several destinations with pktio_tx_replicate(), see PACKET REPLICATION
+ * below, and TCP packets from the host can be segmented with
+ * pktio_tx_lso(), see TCP SEGMENTATION below.  Packets collected in an
+ * array can be sent together with pktio_tx_burst(), see BURST TRANSMIT
+ * below, and samples of the traffic can be captured for the host with
+ * pktio_cap(), see PACKET CAPTURE below.
  *
  * A typical packet loop for a general purpose run-to-completion working
  * using this library would usually look something like this:
@@ -181,9 +186,8 @@
  * traffic from the wire, from the host and from a single work queue at
  * the same time, it would have to commit 8 + 4 + 4 == 16 of its 32
  * read-transfer registers and three out of 15 signals to the task.
- * Thus far, this has proven too high a cost for too little benefit for
- * this library to support.  So, thus far, there are no API calls for
- * supporting asynchronous packet reception.
+ * This is too high a cost to impose on every user of the library, so
+ * asynchronous reception is an opt-in feature: see RX SCHEDULER below.
  *
  * An alternative to static partitioning is to factor some notion of the
  * current traffic mix to move threads among input sources.  However, it
@@ -192,6 +196,331 @@
  * the system will stall processing packets entirely.
  *
  *
+ * ADAPTIVE PARTITIONING
+ *
+ * Defining PKTIO_RX_ADAPT_ENABLED provides such a scheme.  Threads call
+ * pktio_rx_adapt() in place of the per-source receive calls and receive
+ * from the source currently assigned to them.  The assignment of every
+ * context on the ME is held in a single shared LMEM word,
+ * pktio_rx_adapt_part, with PKTIO_RX_ADAPT_CTX_BITS bits per context
+ * holding an enum pktio_rx_src value.  The library counts per-source
+ * arrivals and the time threads spend waiting in the receive calls.  Every
+ * PKTIO_RX_ADAPT_INTERVAL timestamp ticks (16 ME cycles each) the first
+ * thread to notice rebalances: if the threads on one source have been idle
+ * for a larger share of the interval than those on another source which
+ * received traffic, by at least 1/2^PKTIO_RX_ADAPT_HYST_SHF of the
+ * interval, one context moves from the former to the latter.  Moving one
+ * context per interval, with that margin, keeps the partition from
+ * oscillating.  A source is never left without a thread.  A context picks
+ * up its new assignment on its next call to pktio_rx_adapt(), i.e. after
+ * its current receive completes.
+ *
+ *   pktio_rx_adapt_init(PKTIO_RX_SRC_MASK_WIRE | PKTIO_RX_SRC_MASK_HOST);
+ *   for (;;) {
+ *       if (pktio_rx_adapt(wq_num, wq_addr) < 0) {
+ *           pktio_tx_drop();
+ *           continue;
+ *       }
+ *
+ *       PACKET PROCESSING HERE
+ *
+ *       pktio_tx();
+ *   }
+ *
+ *
+ * RX SCHEDULER
+ *
+ * Defining PKTIO_RX_SCHED_ENABLED provides pktio_rx_sched(), which
+ * implements the issue/process pattern above inside the library.  Each
+ * thread keeps one outstanding request on every source enabled for it
+ * with pktio_rx_sched_init() (wire and, with PKTIO_NFD_ENABLED, host),
+ * which refuses a mask with none of them.  When more than one source has
+ * a packet ready, the source is selected by weighted round robin using
+ * PKTIO_RX_SCHED_WIRE_WEIGHT and PKTIO_RX_SCHED_HOST_WEIGHT (both default
+ * to 1).  A thread with a single source ready never waits for the other,
+ * so no thread sits idle while any source has traffic.  The per-thread
+ * cost is one pktio_nbi_meta and one nfd_in_pkt_desc worth of read
+ * transfer registers and two signals.
+ *
+ *   pktio_rx_sched_init(PKTIO_RX_SRC_MASK_ALL);
+ *   for (;;) {
+ *       if (pktio_rx_sched() < 0) {
+ *           pktio_tx_drop();
+ *           continue;
+ *       }
+ *
+ *       PACKET PROCESSING HERE (source type in Pkt.p_src)
+ *
+ *       pktio_tx();
+ *   }
+ *
+ * Requests are only ever re-issued from within pktio_rx_sched(), so while
+ * a thread is processing a packet it holds at most one further packet per
+ * other source in its transfer registers.  This is what bounds the
+ * deadlock described above: a thread can only block in reordering when
+ * its packet is a full reorder queue ahead of the oldest packet in its
+ * context, and the packets in between are, at worst, held by threads.
+ * With GRO, PKTIO_RX_SCHED_NUM_THREADS (the number of threads calling
+ * pktio_rx_sched() across the firmware) and PKTIO_RX_SCHED_RO_WINDOW (the
+ * smallest GRO reorder queue, in packets, fed by those threads) must be
+ * defined, and the library refuses to build if the packets that may be
+ * held in flight could fill that window.
+ *
+ *
+ * PACKET REPLICATION
+ *
+ * Defining PKTIO_REPL_ENABLED provides pktio_tx_replicate(), which sends
+ * the current packet to every entry of a replication group (e.g. a
+ * multicast group or a set of mirror ports) held in memory as an array of
+ * struct pktio_repl_dst.  Each entry names a destination and, optionally,
+ * up to PKTIO_REPL_HDR_LW words to write over the packet headers for that
+ * copy.  The original itself goes through pktio_tx(), which releases the
+ * sequence number and frees its buffers, to the last entry with no header
+ * rewrite (a "mirror"), or if there is none to the last entry, rewritten
+ * in place.
+ *
+ * The other mirrors are sent from the original's own buffers, with no
+ * copy, when the original goes to the wire unreordered by GRO: they are
+ * multicast sends of the original (pkt_nbi_send_dont_free()), and the
+ * original goes last, in sequence, with pkt_nbi_send_free_on_last(), so
+ * that the NBI frees its buffers once all of them have been sent.
+ *
+ * Every other entry gets a copy in its own buffers: a CTM buffer from
+ * pkt_ctm_alloc() holding the CTM part of the packet and, for a split
+ * packet, a buffer of the same BLQ from blm_buf_alloc() holding the MU
+ * part, with the rewrite and the copy's own packet modifier script
+ * applied.  The NBI frees each copy once it is sent.  A copy cannot share
+ * the MU part with the original: the NBI frees the MU buffer of every CTM
+ * packet it sends, and only sends of the same CTM packet are counted for
+ * free-on-last, while nothing tells the library when a packet queued on
+ * one port has left.  So a rewritten copy costs a CTM buffer and a copy
+ * of the packet, and so do mirrors when the original goes to GRO.
+ *
+ * Copies other than the original are not reordered and must go to the
+ * wire.  Header rewrites are written with 32-bit writes, so the packet
+ * offset plus 'hdr_off' and 'hdr_len' must be multiples of 4 and the
+ * rewrite must lie in the CTM part of the packet.
+ *
+ *   __export __emem struct pktio_repl_dst mcast_grp[NUM_GRPS][GRP_SZ];
+ *   ...
+ *   grp = PACKET PROCESSING PICKS THE GROUP HERE
+ *   pktio_tx_replicate(mcast_grp[grp], mcast_grp_len[grp]);
+ *
+ *
+ * PACKET GENERATION
+ *
+ * Defining PKTIO_GEN_ENABLED provides pktio_gen(), which builds a new
+ * packet in a CTM buffer from a template held in memory (struct
+ * pktio_gen_tmpl) and makes it the current packet, as if it had been
+ * received.  The template holds the first bytes of the packet (typically
+ * the headers); the rest of the packet is filled with a 32-bit pattern.
+ * The template may ask for a 12B stamp holding a sequence number and the
+ * ME timestamp counter (me_tsc_read()) to be written into each packet,
+ * which lets a receiver measure loss, reordering and latency.  The packet
+ * starts at PKTIO_GEN_OFFSET (default 64) in the smallest CTM buffer that
+ * holds it, has no MU buffer, a source of PKT_NOTX and a destination of
+ * PKT_DROP.  Packets are therefore limited to 2048 - PKTIO_GEN_OFFSET
+ * bytes.
+ *
+ *   for (;;) {
+ *       if (pktio_gen(&tmpl, seq++) < 0)
+ *           continue;
+ *       Pkt.p_dst = PKT_WIRE_PORT(0, port);
+ *       pktio_tx();
+ *   }
+ *
+ * See me/apps/pktgen for a rate-controlled generator built on this.
+ *
+ *
+ * TCP SEGMENTATION
+ *
+ * With PKTIO_LSO_ENABLED, pktio_tx_lso() sends the current packet, an
+ * IPv4 or IPv6 TCP packet of up to the maximum packet length (typically a
+ * host packet with Pkt.p_tx_lso set), as segments of at most 'mss' bytes
+ * of TCP payload.  Each segment gets its own CTM buffer from
+ * pkt_ctm_alloc(): the headers of the original are written to it with the
+ * IPv4 total length or IPv6 payload length, the IPv4 ID (incremented per
+ * segment) and the TCP sequence number updated, FIN and PSH cleared on
+ * all but the last segment and CWR cleared on all but the first.  The
+ * payload is copied straight from the original's CTM and MU buffers, as
+ * the NBI cannot send a packet from an arbitrary offset of a shared
+ * buffer.  The IPv4 header checksum is updated incrementally from the
+ * original's, and the TCP checksum of each segment is computed from an
+ * incremental update of the header sum and a sum of the payload, unless
+ * the MAC is asked to compute it (Pkt.p_tx_l4_csum with
+ * MAC_EGRESS_PREPEND_ENABLE).
+ *
+ * Each segment is sent with pktio_tx() as soon as it is built, so that
+ * a context holds at most one segment's CTM buffer, and the original's
+ * buffers are freed before the last one is sent.  If a segment's buffer
+ * cannot be allocated, or pktio_tx() fails for a segment, the rest of the
+ * packet is dropped:  the segments already sent are a prefix of it, with
+ * no hole in the TCP sequence space.  With PKTIO_GRO_ENABLED, a packet
+ * with a GRO sequence number releases it to GRO with one work queue entry
+ * for the context on PKTIO_LSO_WQ once the first segment is built, and
+ * the context waits on that work queue until GRO puts the entry there,
+ * after every packet with a lower sequence number, before it sends the
+ * segments.  GRO then moves on, so packets with a higher sequence number
+ * may overtake the segments after the first.  Without GRO, the last
+ * segment carries the original's NBI sequence number and the others are
+ * sent unordered before it.
+ *
+ *   if (Pkt.p_tx_lso) {
+ *       Pkt.p_dst = PKT_WIRE_PORT(0, port);
+ *       pktio_tx_lso(l3_off, l4_off, Pkt.p_tx_mss);
+ *   }
+ *
+ * The headers must be in the CTM part of the packet and at most
+ * PKTIO_LSO_HDR_MAX bytes long, which sets the size of a per context
+ * LMEM buffer holding them.  The segments start up to 7 bytes past
+ * PKTIO_LSO_OFFSET (default 64), which leaves room in front of them for
+ * the modification script and MAC prepend, in a CTM-only buffer of at
+ * most 2048 bytes, so the headers and 'mss' together are limited to
+ * PKTIO_LSO_SEG_LEN_MAX, 2048 - (PKTIO_LSO_OFFSET + 7) bytes.  'mss' must
+ * be even.  The library uses the checksum functions of me/lib/net
+ * (libnet.c).
+ *
+ *
+ * BURST TRANSMIT
+ *
+ * With PKTIO_TX_BURST_ENABLED, pktio_tx_burst() sends an array of packet
+ * metadata, e.g. packets an application has collected in LMEM before
+ * sending them on.  Consecutive packets to the wire at the same offset and
+ * with the same checksum offload flags share one modification script
+ * lookup and one MAC egress command word.  The writes of up to
+ * PKTIO_TX_BURST_PIPE (4) such packets are issued together without
+ * signals, followed by a read back of each packet's script, and a single
+ * wait for the read backs covers them all before the packets are sent
+ * with one pkt_nbi_send() each.  The TX counter is updated once per
+ * burst.
+ *
+ * Packets to other destinations, packets reordered by GRO and packets at
+ * an offset the packet modifier does not support are sent in turn with
+ * pktio_tx(), which uses Pkt, so Pkt is overwritten by the burst.  The
+ * packets leave in the order of the array.
+ *
+ *   __lmem struct pktio_meta burst[8];
+ *
+ *   for (n = 0; n < 8; n++) {
+ *       pktio_rx_wire();
+ *       Pkt.p_dst = PKT_WIRE_PORT(0, port);
+ *       burst[n] = Pkt;
+ *   }
+ *   pktio_tx_burst(burst, n);
+ *
+ *
+ * HEADER-ONLY PACKETS
+ *
+ * A packet larger than its CTM buffer is split: the CTM buffer holds the
+ * start of the packet and the MU buffer referenced by Pkt.p_muptr the
+ * rest, at the offsets it would have in one contiguous buffer.  Setting
+ * SPLIT_LENGTH (and the NBI DMA split length) to 0 and leaving
+ * NFD_PKT_CTM_SIZE at its default of PKT_CTM_SIZE_256 makes every packet
+ * larger than 256 - Pkt.p_offset bytes such a header-only packet.  Only
+ * the headers then take CTM, so the same CTM holds many more packets in
+ * flight, and the payload is never copied back from MU:
+ *
+ *   - pktio_rx_host() copies only the CTM part from the host's MU buffer
+ *   - pktio_tx() and pktio_tx_burst() send to the wire straight from both
+ *     buffers, and the NBI frees both
+ *   - pktio_tx() to the host and GRO pass the split on in their
+ *     descriptors
+ *   - modification scripts sit in CTM in front of the packet
+ *   - pktio_tx_lso() reads segment payloads from either buffer
+ *
+ * pktio_ctm_len() is the number of bytes of the packet in CTM, which the
+ * headers an application parses must fit in.  pktio_pkt_ptr40() returns
+ * the address of any byte of the packet, and pktio_pkt_regions() the two
+ * parts of the packet from an offset on, as taken by the checksum
+ * functions of me/lib/net (csum.h), which stream across the split:
+ *
+ *   __gpr struct pktio_pkt_regions r;
+ *
+ *   if (pktio_pkt_regions(l4_off, &r) == 0)
+ *       csum = net_csum_ipv4_tcp(&ip, &tcp, r.ctm_ptr, r.ctm_len,
+ *                                r.mu_ptr, r.mu_len);
+ *
+ * Header rewrites of pktio_tx_replicate() must fall in the CTM part, and
+ * each rewritten copy of a split packet carries a copy of the MU part.
+ *
+ * pktio_pkt_iter_first() and pktio_pkt_iter_next() walk the packet from
+ * an offset to its end as regions contiguous in memory, which also covers
+ * chained packets (see below).
+ *
+ *
+ * CHAINED MU BUFFERS
+ *
+ * With PKTIO_CHAIN_ENABLED, a packet built by the application, e.g. a
+ * reassembled jumbo frame, can span several 2048B MU buffers of its BLQ
+ * rather than needing one large buffer from a jumbo BLQ.  The buffers are
+ * linked by a struct pktio_chain descriptor at the start of the head
+ * buffer (Pkt.p_muptr), which holds no packet data as a chained packet is
+ * always split.  Buffer n of the chain holds the bytes at offsets
+ * n * 2048 to n * 2048 + 2047 of the packet buffer, so the offsets are
+ * those of one contiguous buffer, as for split packets.
+ * pktio_chain_extend() allocates the buffers to hold a given length and
+ * sets Pkt.p_chained and Pkt.p_is_split.  It refuses a packet whose CTM
+ * part would not cover the descriptor, as the packet would then have data
+ * at the start of the head MU buffer.
+ *
+ *   if (pktio_chain_extend(len) == 0) {
+ *       Pkt.p_len = len;
+ *       for (pktio_pkt_iter_first(off, &it); it.len != 0;
+ *            pktio_pkt_iter_next(&it))
+ *           ... write it.len bytes at it.ptr ...
+ *   }
+ *
+ * pktio_pkt_ptr40() and the packet iterator follow the chain,
+ * pktio_pkt_regions() fails on a chained packet.  pktio_pkt_ones_sum() sums the packet from
+ * an offset on, to be combined with ones_sum_pseudo() and the header sums
+ * of net/csum.h for checksums over the whole chain.  pktio_chain_bufs()
+ * lists the buffers for pktdma_sg_chain() (me/lib/pktdma), which builds
+ * the scatter list to DMA any part of the packet to or from CTM.
+ * Dropping the packet returns every buffer of the chain to the BLM with
+ * blm_buf_free_bulk(), also when GRO releases the sequence number of a
+ * dropped packet.
+ *
+ * Neither the NBI nor NFD can send from more than one MU buffer, so
+ * pktio_tx() drops chained packets sent to the wire or the host, and
+ * pktio_tx_replicate() refuses them.  They can be passed on through work
+ * queues, and pktio_tx_lso() segments them into packets that fit one
+ * buffer, freeing the chain once the last segment is built.
+ *
+ *
+ * PACKET CAPTURE
+ *
+ * With PKTIO_CAP_ENABLED, pktio_cap() is a tap the application calls at
+ * the points of its pipeline it wants to watch (e.g. after pktio_rx_*()
+ * and before pktio_tx()), each given a number from 0 to 31.  The tap is
+ * configured at run time by the host through the pktio_cap_ctl symbol
+ * (struct pktio_cap_ctl): the tap points to capture, a filter on the
+ * source and destination ports and length of the packet, the fraction of
+ * the matching packets to sample and the number of bytes to keep of each,
+ * up to PKTIO_CAP_SNAP_MAX.  A sampled packet is copied with a 64-bit
+ * timestamp (me_tsc_read()) and its metadata into one of PKTIO_CAP_SLOTS
+ * record slots of EMEM, pktio_cap_slots[], taken from the pktio_cap_free
+ * ring, and the slot is put on the pktio_cap_ring ring.  Both are EMEM
+ * rings initialised at load time (MEM_RING_INIT), and neither operation
+ * waits for anything but its own completion: if no slot is free, the
+ * sample is dropped and counted.  The packet itself is not modified.
+ *
+ *   pktio_rx_wire();
+ *   pktio_cap(0);
+ *   PACKET PROCESSING HERE
+ *   pktio_cap(1);
+ *   pktio_tx();
+ *
+ * The host cannot pop a queue engine ring, so pktio_cap_drain(), called
+ * periodically by one context of the firmware, moves the slots of the
+ * ring to pktio_cap_idx[], a ring of slot numbers the host reads, and
+ * returns the slots the host has finished with to the free ring.  The
+ * host follows pktio_cap_ctl.prod and advances pktio_cap_ctl.cons, see
+ * user/tools/pktcap_dump.c, which writes the records out as pcapng.  The
+ * configuration is re-read by each ME every PKTIO_CAP_REFRESH calls of
+ * pktio_cap(), and pktio_cap_init() must be called by one context of
+ * each ME using the tap, before the first capture or drain.
+ *
+ *
  * PACKET METADATA
  *
  * The global metadata for the (currently active) packet is stored in a
@@ -335,11 +664,39 @@
  * If only one PCI island or NBI is used, the _pci or _nbi parameter in the
  * macros above can be unused in the actual definition.
  *
+ * The GRO reorder context of a packet is kept in the 5 bits of p_ro_ctx,
+ * so pktio uses at most PKTIO_GRO_MAX_CTX (32) GRO contexts across all
+ * blocks.  GRO_CLI_MAX_CTX must not be larger when PKTIO_GRO_ENABLED is
+ * defined.
+ *
  * OPTIONAL DEFINES
  *
  * PKTIO_NFD_CPY_START      Specifies the offset to start copying host packet
  *                          data from in MU into CTM.  Must be 64B aligned.
  *                          Defaults to "NFD_IN_DATA_OFFSET & ~0x3F".
+ *
+ * PKTIO_LSO_HDR_MAX        Largest headers pktio_tx_lso() segments, a
+ *                          multiple of 4 up to 128.  Defaults to 96.
+ *
+ * PKTIO_LSO_OFFSET         Offset of the segments of pktio_tx_lso() in
+ *                          their CTM buffers, up to 7 bytes more to align
+ *                          the payload with the original.  Defaults to 64.
+ *
+ * PKTIO_LSO_WQ             Work queue on which context 0 of the ME waits
+ *                          for GRO to release the sequence number of a
+ *                          packet pktio_tx_lso() segments, as a
+ *                          PKT_WQ_PORT() or PKT_WQ_PORT_BYNAME();
+ *                          context n uses the queue n after it.  The
+ *                          queues must not be used by anything else, nor
+ *                          by another ME.  Required with PKTIO_LSO_ENABLED
+ *                          and PKTIO_GRO_ENABLED.
+ *
+ * PKTIO_CTM_CREDIT_CACHE   Allocate CTM buffers with credits cached by the
+ *                          ME (pkt_ctm_cache_alloc()) rather than taking
+ *                          them from the island's ctm_credits for each
+ *                          packet.  One context of the ME should call
+ *                          pktio_ctm_credit_poll() periodically and
+ *                          pktio_ctm_credit_release() when going idle.
  */
 
 #ifndef __PKTIO_H__
@@ -512,6 +869,9 @@ struct pktio_nbi_meta {
 
 #define PKTIO_NBI_META_LW (5 + PKTIO_NBI_META_LW_VLAN + PKTIO_NBI_META_LW_LSO)
 
+/* GRO reorder contexts p_ro_ctx can hold */
+#define PKTIO_GRO_MAX_CTX   32
+
 /**
  * Global packet metadata.
  */
@@ -530,7 +890,8 @@ struct pktio_meta {
 
             unsigned int p_seq:16;              /**< Sequence number */
             unsigned int p_ro_ctx:5;            /**< Reorder context mapped
-                                                  *  from NBI or NFD seqr */
+                                                  *  from NBI or NFD seqr,
+                                                  *  < PKTIO_GRO_MAX_CTX */
             unsigned int p_is_gro_seq:1;        /**< Is pkt to be reordered
                                                   *  with GRO? */
             unsigned int p_rx_ipv4_csum_ok:1;   /**< Set if IP csum was ok */
@@ -549,12 +910,15 @@ struct pktio_meta {
              *    to setup the MAC CSUM offload processing.
              */
             unsigned int p_tunnel:1;            /**< A tunnel packet */
-            unsigned int resv4:1;               /**< Reserved */
+            unsigned int p_chained:1;           /**< MU buffers chained, see
+                                                  *  CHAINED MU BUFFERS */
             unsigned int p_tx_l3_csum:1;        /**< Req L3 csum TX offload */
             unsigned int p_tx_l4_csum:1;        /**< Req L4 csum TX offload */
 #else
             unsigned int p_tunnel:1;            /**< A tunnel packet */
-            unsigned int resv4:3;               /**< Reserved */
+            unsigned int p_chained:1;           /**< MU buffers chained, see
+                                                  *  CHAINED MU BUFFERS */
+            unsigned int resv4:2;               /**< Reserved */
 #endif
 
             union {
@@ -769,6 +1133,106 @@ pktio_rx_host_process(__xread struct nfd_in_pkt_desc *nfd_rxd, int ctm_pnum);
  */
 __intrinsic void pktio_rx_wq(int ring_num, mem_ring_addr_t ring_addr);
 
+/**
+ * Packet sources handled by pktio_rx_sched() and pktio_rx_adapt()
+ */
+enum pktio_rx_src {
+    PKTIO_RX_SRC_WIRE   = 0,
+    PKTIO_RX_SRC_HOST   = 1,
+    PKTIO_RX_SRC_WQ     = 2,
+    PKTIO_RX_SRC_NUM
+};
+
+#define PKTIO_RX_SRC_MASK_WIRE  (1 << PKTIO_RX_SRC_WIRE)
+#define PKTIO_RX_SRC_MASK_HOST  (1 << PKTIO_RX_SRC_HOST)
+#define PKTIO_RX_SRC_MASK_WQ    (1 << PKTIO_RX_SRC_WQ)
+#define PKTIO_RX_SRC_MASK_ALL   ((1 << PKTIO_RX_SRC_NUM) - 1)
+
+#ifdef PKTIO_RX_SCHED_ENABLED
+/**
+ * Select the packet sources the calling thread receives from.
+ *
+ * @param src_mask      Mask of PKTIO_RX_SRC_MASK_* values
+ *
+ * Must be called once by every thread using pktio_rx_sched() before its
+ * first call, it clears the thread's scheduler state.  Work queues are not
+ * supported by the scheduler, and sources that are not compiled in (e.g.
+ * host without PKTIO_NFD_ENABLED) are ignored.  Use
+ * pktio_rx_sched_set_src() to change the mask later.
+ *
+ * @return 0, or -1 if no source of @src_mask is supported, in which case
+ * the thread must not call pktio_rx_sched(), as it would wait forever.
+ */
+int pktio_rx_sched_init(unsigned int src_mask);
+
+/**
+ * Change the packet sources the calling thread receives from.
+ *
+ * @param src_mask      Mask of PKTIO_RX_SRC_MASK_* values
+ *
+ * Requests already outstanding on a source removed from the mask are
+ * still completed by the next calls to pktio_rx_sched().
+ *
+ * @return 0, or -1 and the mask unchanged if no source of @src_mask is
+ * supported.
+ */
+int pktio_rx_sched_set_src(unsigned int src_mask);
+
+/**
+ * Receive a packet from whichever enabled source has one ready and
+ * populate the packet metadata.
+ *
+ * @return -1 on error and 0 otherwise
+ *
+ * On a return value of -1, the caller should call pktio_tx_drop() to free the
+ * packet buffers.  The source of the packet can be found from Pkt.p_src.
+ */
+__intrinsic int pktio_rx_sched(void);
+#endif /* PKTIO_RX_SCHED_ENABLED */
+
+#ifdef PKTIO_RX_ADAPT_ENABLED
+
+/* Bits of pktio_rx_adapt_part used for each context */
+#define PKTIO_RX_ADAPT_CTX_BITS     4
+#define PKTIO_RX_ADAPT_CTX_MSK      ((1 << PKTIO_RX_ADAPT_CTX_BITS) - 1)
+
+/**
+ * Source assigned to context _ctx, from a value of pktio_rx_adapt_part.
+ */
+#define PKTIO_RX_ADAPT_SRC_of(_part, _ctx) \
+    (((_part) >> ((_ctx) * PKTIO_RX_ADAPT_CTX_BITS)) & PKTIO_RX_ADAPT_CTX_MSK)
+
+/**
+ * Initialise the adaptive partitioning of the ME's contexts.
+ *
+ * @param src_mask      Mask of PKTIO_RX_SRC_MASK_* sources in use on the ME
+ *
+ * Must be called by every context of the ME, context 0 included, before
+ * it calls pktio_rx_adapt().  Context 0 sets up the shared state from its
+ * @src_mask and then signals the other contexts, which wait in this call
+ * until it has, so none can see the state half initialised.  The contexts
+ * are initially spread round robin over the sources in @src_mask.  The ME
+ * must run at least one context per source.
+ */
+void pktio_rx_adapt_init(unsigned int src_mask);
+
+/**
+ * Receive a packet from the source currently assigned to the calling
+ * context and populate the packet metadata.
+ *
+ * @param ring_num      The work queue ring number, if work queues are used
+ * @param ring_addr     The work queue ring mem address
+ *
+ * @return -1 on error and 0 otherwise
+ *
+ * On a return value of -1, the caller should call pktio_tx_drop() to free the
+ * packet buffers.  This may also rebalance the contexts between sources,
+ * see ADAPTIVE PARTITIONING above.
+ */
+__intrinsic int pktio_rx_adapt(int ring_num, mem_ring_addr_t ring_addr);
+
+#endif /* PKTIO_RX_ADAPT_ENABLED */
+
 
 /**
  * Send a packet to the destination set in Pkt.destination.  This will include
@@ -788,11 +1252,248 @@ __intrinsic void pktio_rx_wq(int ring_num, mem_ring_addr_t ring_addr);
  *      return -1 if no NFD credits
  *      return -2 if packet modifier script error
  *      return -3 if MAC port is paused (on wire)
+ *      return -4 if a chained packet is sent to wire or host
+ *      return -5 if GRO had already skipped the packet's sequence number
  */
 __intrinsic int pktio_tx_with_meta(unsigned short app_nfd_flags,
                                    unsigned short meta_len);
 __intrinsic int pktio_tx(void);
 
+#ifdef PKTIO_GEN_ENABLED
+
+/* Words of packet data in a packet template */
+#define PKTIO_GEN_TMPL_LW   30
+
+/* Size of the per-packet stamp: sequence number and 64-bit timestamp */
+#define PKTIO_GEN_STAMP_SZ  12
+
+/**
+ * Packet template for pktio_gen(), 128B.
+ */
+struct pktio_gen_tmpl {
+    union {
+        struct {
+            unsigned int len:16;        /**< Length of the packets */
+            unsigned int tmpl_len:8;    /**< Bytes of data at the start of
+                                          *  the packets, multiple of 4 */
+            unsigned int stamp_off:8;   /**< Offset of the stamp from the
+                                          *  start of the packets, multiple
+                                          *  of 4, or 0 for no stamp */
+            uint32_t fill;              /**< Pattern for the bytes after
+                                          *  the template data */
+            uint32_t data[PKTIO_GEN_TMPL_LW]; /**< Template data */
+        };
+        uint32_t __raw[PKTIO_GEN_TMPL_LW + 2];
+    };
+};
+
+/**
+ * Build a packet from a template and make it the current packet.
+ *
+ * @param tmpl          Packet template
+ * @param seq           Sequence number to stamp into the packet
+ *
+ * @return 0 on success or -1 if the template is invalid or no CTM buffer
+ *      could be allocated, in which case there is no current packet.
+ *
+ * The stamp is written in network byte order as the 32-bit @seq followed
+ * by the 64-bit value of me_tsc_read().
+ */
+int pktio_gen(__mem40 struct pktio_gen_tmpl *tmpl, uint32_t seq);
+
+#endif /* PKTIO_GEN_ENABLED */
+
+#ifdef PKTIO_CAP_ENABLED
+
+/* Number of capture record slots, a power of 2 of at most 512 */
+#ifndef PKTIO_CAP_SLOTS
+#define PKTIO_CAP_SLOTS     256
+#endif
+
+#if (PKTIO_CAP_SLOTS & (PKTIO_CAP_SLOTS - 1)) || PKTIO_CAP_SLOTS > 512
+#error "PKTIO_CAP_SLOTS must be a power of 2 of at most 512"
+#endif
+
+/* Calls of pktio_cap() per ME between reads of the configuration */
+#ifndef PKTIO_CAP_REFRESH
+#define PKTIO_CAP_REFRESH   1024
+#endif
+
+/* Most slots moved by one call of pktio_cap_drain() */
+#ifndef PKTIO_CAP_DRAIN_MAX
+#define PKTIO_CAP_DRAIN_MAX 32
+#endif
+
+/* Size of a record slot, of its header and most packet bytes kept */
+#define PKTIO_CAP_SLOT_SZ   128
+#define PKTIO_CAP_HDR_SZ    16
+#define PKTIO_CAP_SNAP_MAX  108
+
+/* Value of pktio_cap_ctl.sample to capture every matching packet */
+#define PKTIO_CAP_SAMPLE_ALL 65536
+
+/**
+ * Capture configuration and host ring indices, the pktio_cap_ctl symbol.
+ */
+struct pktio_cap_ctl {
+    union {
+        struct {
+            uint32_t sample;            /**< Packets captured per 65536
+                                          *  matching ones, 0 to disable */
+            uint32_t snaplen;           /**< Bytes kept of each packet */
+            uint32_t points;            /**< Mask of tap points captured */
+            unsigned int src_mask:16;   /**< Bits of Pkt.p_src compared */
+            unsigned int src_val:16;    /**< Value of those bits */
+            unsigned int dst_mask:16;   /**< Bits of Pkt.p_dst compared */
+            unsigned int dst_val:16;    /**< Value of those bits */
+            unsigned int len_min:16;    /**< Smallest Pkt.p_len captured */
+            unsigned int len_max:16;    /**< Largest Pkt.p_len captured */
+            uint32_t prod;              /**< Entries of pktio_cap_idx[]
+                                          *  written by pktio_cap_drain() */
+            uint32_t cons;              /**< Entries consumed, written by
+                                          *  the host */
+        };
+        uint32_t __raw[8];
+    };
+};
+
+/* Words of struct pktio_cap_ctl read by pktio_cap() */
+#define PKTIO_CAP_CFG_LW    6
+
+/**
+ * Header of a capture record, followed in the slot by the packet bytes
+ * from the 4B aligned offset at or before the start of the packet.
+ */
+struct pktio_cap_hdr {
+    union {
+        struct {
+            uint32_t tsc_hi;            /**< me_tsc_read() at capture */
+            uint32_t tsc_lo;
+            unsigned int point:8;       /**< Tap point */
+            unsigned int pad:2;         /**< Bytes before the packet */
+            unsigned int snap:7;        /**< Packet bytes kept */
+            unsigned int len:15;        /**< Pkt.p_len */
+            unsigned int src:16;        /**< Pkt.p_src */
+            unsigned int dst:16;        /**< Pkt.p_dst */
+        };
+        uint32_t __raw[PKTIO_CAP_HDR_SZ / 4];
+    };
+};
+
+/**
+ * Reset the capture state of the ME, and put the capture record slots on
+ * the free ring if no ME has yet.
+ *
+ * Must be called by one context of each ME that calls pktio_cap() or
+ * pktio_cap_drain(), before any context of the ME calls them.
+ */
+void pktio_cap_init(void);
+
+/**
+ * Capture the current packet if the configuration selects it.
+ *
+ * @param point         Tap point, 0 to 31
+ *
+ * @return 1 if the packet was captured, 0 if not selected, or -1 if it
+ *      was selected but no record slot was free.
+ */
+int pktio_cap(unsigned int point);
+
+/**
+ * Pass captured records on to the host and recycle the slots it has
+ * finished with.
+ *
+ * Must only be called by one context of the firmware.  Moves at most
+ * PKTIO_CAP_DRAIN_MAX records per call.
+ */
+void pktio_cap_drain(void);
+
+#endif /* PKTIO_CAP_ENABLED */
+
+#ifdef PKTIO_REPL_ENABLED
+
+/* Words of replacement header data in a replication group entry */
+#define PKTIO_REPL_HDR_LW   15
+
+/**
+ * Replication group entry, 64B.
+ */
+struct pktio_repl_dst {
+    union {
+        struct {
+            unsigned int dst:16;        /**< Destination, see Pkt.p_dst */
+            unsigned int hdr_off:8;     /**< Offset of the rewrite from the
+                                          *  start of the packet */
+            unsigned int hdr_len:8;     /**< Bytes of hdr to write,
+                                          *  0 to mirror the packet */
+            uint32_t hdr[PKTIO_REPL_HDR_LW]; /**< Replacement header bytes */
+        };
+        uint32_t __raw[PKTIO_REPL_HDR_LW + 1];
+    };
+};
+
+/**
+ * Send the packet to every entry of a replication group.
+ *
+ * @param grp           Array of replication group entries
+ * @param num           Number of entries in @grp, at least 1
+ *
+ * @return 0 if all copies were sent, -1 if one or more copies other than
+ *      the original could not be sent (no CTM or MU buffer, a destination
+ *      that is not the wire or an unsupported header rewrite), or the
+ *      return value of pktio_tx() for the original, -2 for an unsupported
+ *      packet offset if it was sent with its mirrors.
+ *
+ * The packet is consumed in all cases, see PACKET REPLICATION above.
+ */
+int pktio_tx_replicate(__mem40 struct pktio_repl_dst *grp, unsigned int num);
+
+#endif /* PKTIO_REPL_ENABLED */
+
+#ifdef PKTIO_LSO_ENABLED
+
+/**
+ * Send the current TCP packet as segments of at most @mss bytes of payload.
+ *
+ * @param l3_off        Offset of the IPv4 or IPv6 header from the start of
+ *                      the packet
+ * @param l4_off        Offset of the TCP header from the start of the
+ *                      packet
+ * @param mss           Maximum TCP payload per segment, typically
+ *                      Pkt.p_tx_mss
+ *
+ * @return 0 if all segments were sent, -1 if the packet could not be
+ *      segmented or a segment other than the last could not be built or
+ *      sent (the rest of the packet is then dropped), -5 if GRO had
+ *      already skipped the packet's sequence number (nothing is sent), or
+ *      the return value of pktio_tx() for the last segment.
+ *
+ * The packet is consumed in all cases, see TCP SEGMENTATION above.
+ */
+int pktio_tx_lso(unsigned int l3_off, unsigned int l4_off, unsigned int mss);
+
+#endif /* PKTIO_LSO_ENABLED */
+
+#ifdef PKTIO_TX_BURST_ENABLED
+
+/* Wire packets whose writes are in flight together */
+#define PKTIO_TX_BURST_PIPE 4
+
+/**
+ * Send an array of packets, see BURST TRANSMIT above.
+ *
+ * @param pkts          Metadata of the packets, with p_dst set
+ * @param num           Number of packets in @pkts
+ *
+ * @return the number of packets dropped on an error, i.e. for which
+ *      pktio_tx() would have returned non-zero, or 0.
+ *
+ * All packets are consumed and Pkt is overwritten.
+ */
+int pktio_tx_burst(__lmem struct pktio_meta *pkts, unsigned int num);
+
+#endif /* PKTIO_TX_BURST_ENABLED */
+
 /**
  * Drop a packet.
  * A packet is dropped regardless of Pkt.p_dst (destination).
@@ -805,12 +1506,161 @@ __intrinsic int pktio_tx(void);
  */
 void pktio_tx_drop(void);
 
+/**
+ * The parts of the current packet from an offset on, see HEADER-ONLY
+ * PACKETS above.
+ */
+struct pktio_pkt_regions {
+    __mem40 void *ctm_ptr;              /**< Start in CTM */
+    uint32_t ctm_len;                   /**< Bytes in CTM, can be 0 */
+    __mem40 void *mu_ptr;               /**< Start of the rest in MU */
+    uint32_t mu_len;                    /**< Bytes in MU, can be 0 */
+};
+
+/**
+ * Number of bytes of the current packet in its CTM buffer.
+ */
+__intrinsic unsigned int pktio_ctm_len(void);
+
+/**
+ * Address of a byte of the current packet, in CTM or MU.
+ *
+ * @param off           Offset from the start of the packet
+ */
+__intrinsic __mem40 void *pktio_pkt_ptr40(unsigned int off);
+
+/**
+ * Split the current packet from an offset to its end into its CTM and MU
+ * parts.
+ *
+ * @param off           Offset from the start of the packet, at most
+ *                      Pkt.p_len
+ * @param r             Returned parts
+ *
+ * @return 0, or -1 and @r unset if the packet is chained (Pkt.p_chained),
+ * as its MU part is not contiguous:  walk it with pktio_pkt_iter_first()
+ * or sum it with pktio_pkt_ones_sum() instead.
+ */
+__intrinsic int pktio_pkt_regions(unsigned int off,
+                                  __gpr struct pktio_pkt_regions *r);
+
+/**
+ * Iterator over the regions of the current packet that are contiguous in
+ * memory.
+ */
+struct pktio_pkt_iter {
+    __mem40 void *ptr;                  /**< Start of the region */
+    uint32_t len;                       /**< Bytes in the region, 0 at the
+                                          *  end of the packet */
+    uint32_t next;                      /**< Buffer offset of the next
+                                          *  region */
+};
+
+/**
+ * Start iterating over the current packet.
+ *
+ * @param off           Offset from the start of the packet
+ * @param it            Iterator, set to the region holding @off
+ *
+ * @return 0, or -1 if @off is not below Pkt.p_len.
+ */
+__intrinsic int pktio_pkt_iter_first(unsigned int off,
+                                     __gpr struct pktio_pkt_iter *it);
+
+/**
+ * Move an iterator to the next region of the current packet.
+ *
+ * @param it            Iterator
+ *
+ * @return 0, or -1 and it->len 0 past the end of the packet.
+ */
+__intrinsic int pktio_pkt_iter_next(__gpr struct pktio_pkt_iter *it);
+
+#ifdef PKTIO_CHAIN_ENABLED
+
+/* Most MU buffers of a chained packet, the head buffer included */
+#define PKTIO_CHAIN_BUFS    8
+
+/* Bytes of packet buffer held by each MU buffer of a chain */
+#define PKTIO_CHAIN_BUF_SZ  2048
+
+/**
+ * Chain descriptor, at offset 0 of the head MU buffer of a chained
+ * packet.  Word n is the handle of buffer n, n >= 1.
+ */
+struct pktio_chain {
+    union {
+        struct {
+            unsigned int num:8;         /**< Buffers, the head included */
+            unsigned int resv:24;       /**< Reserved */
+            uint32_t bufs[PKTIO_CHAIN_BUFS - 1]; /**< Buffers 1 on */
+        };
+        uint32_t __raw[PKTIO_CHAIN_BUFS];
+    };
+};
+
+/**
+ * Make the MU buffers of the current packet hold @len bytes of packet,
+ * chaining buffers of Pkt.p_bls to the head buffer as needed.
+ *
+ * @param len           Length the packet is to have
+ *
+ * @return 0 on success, or -1 if the packet has no MU buffer, @len needs
+ *      more than PKTIO_CHAIN_BUFS buffers, the CTM part of the packet
+ *      would not cover the chain descriptor at the start of the head MU
+ *      buffer or no buffers could be allocated, in which case the packet
+ *      is unchanged.
+ *
+ * Pkt.p_len is left for the caller to set once the data is written.
+ * Pkt.p_is_split is set with Pkt.p_chained.
+ */
+int pktio_chain_extend(unsigned int len);
+
+/**
+ * List the MU buffer handles of the current packet.
+ *
+ * @param bufs          Returned handles, PKTIO_CHAIN_BUFS entries, the
+ *                      head buffer first
+ *
+ * @return the number of buffers, 0 if the packet has no MU buffer.
+ */
+__intrinsic unsigned int pktio_chain_bufs(__lmem uint32_t *bufs);
+
+/**
+ * 32-bit ones complement sum of the current packet from @off to its end.
+ *
+ * @param off           Even offset from the start of the packet
+ *
+ * Fold with ones_sum_fold16() (me/lib/net/csum.h) to get the checksum.
+ */
+__intrinsic uint32_t pktio_pkt_ones_sum(unsigned int off);
+
+#endif /* PKTIO_CHAIN_ENABLED */
+
+
+#ifdef PKTIO_CTM_CREDIT_CACHE
+/**
+ * Poll the Packet Engine for CTM credits into the ME's credit cache.
+ *
+ * Should be called periodically by one context of the ME, in place of the
+ * polling done by each context when the island runs out of credits.
+ */
+__intrinsic void pktio_ctm_credit_poll(void);
+
+/**
+ * Return the CTM credits cached by the ME to the island.
+ */
+__intrinsic void pktio_ctm_credit_release(void);
+#endif
+
 
 /**
  * Give the packet source an opportunity to be initialised.
  *
  * Will not relinquish context until completed. This should be called by a
- * single context on each ME intending to use pktio_rx_*
+ * single context on each ME intending to use pktio_rx_*, before the other
+ * contexts use pktio.  It also empties the ME's CTM credit cache if
+ * PKTIO_CTM_CREDIT_CACHE is defined.
  */
 void pktio_rx_init(void);
 
@@ -819,7 +1669,10 @@ void pktio_rx_init(void);
  * Give the packet destination an opportunity to be initialised.
  *
  * Will not relinquish context until completed. This should be called by a
- * single context on each ME intending to use pktio_tx
+ * single context on each ME intending to use pktio_tx, before the other
+ * contexts use pktio.  It also empties the ME's modscript cache, the
+ * ME's CTM credit cache if PKTIO_CTM_CREDIT_CACHE is defined, and the
+ * ME's BLM magazines if BLM_MAGAZINE_SIZE is non-zero, see blm.h.
  */
 void pktio_tx_init(void);
 
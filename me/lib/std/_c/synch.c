@@ -89,4 +89,37 @@ sem_cls_post(__cls struct sem *s)
     cls_incr(&s->last_complete);
 }
 
+__intrinsic void
+sem_cls_wait_n(__cls struct sem *s, const uint32_t max_credits, uint32_t n,
+               uint32_t poll_interval)
+{
+    __xrw struct sem xrw;
+    __gpr int32_t my_credit;
+
+    xrw.next_credit = n;    /* Take n credits */
+    xrw.last_complete = 0;  /* Zero lets us read without changing the value */
+
+    /* test_add will read the current credit number, then add n */
+    cls_test_add(&xrw, s, sizeof(struct sem));
+    my_credit = xrw.next_credit;
+
+    /* Our credits are my_credit .. my_credit + n - 1 */
+    for (;;) {
+        if (my_credit + n - xrw.last_complete > max_credits) {
+            sleep(poll_interval);
+            cls_read(&xrw.last_complete, &s->last_complete, sizeof(int32_t));
+        } else {
+            break;
+        }
+    }
+}
+
+__intrinsic void
+sem_cls_post_n(__cls struct sem *s, uint32_t n)
+{
+    __xrw int32_t xrw = n;
+
+    cls_test_add(&xrw, &s->last_complete, sizeof(xrw));
+}
+
 #endif /* !_STD__SYNCH_C_ */
@@ -75,6 +75,24 @@ struct sem {
 #define SEM_POST(_name)     \
     sem_cls_post(&SYNCH_SEM_NAME(_name));
 
+/**
+ * Wrapper to take several credits of a semaphore at once.
+ * @param _name             Name of the semaphore
+ * @param _n                Number of credits, at most the max of the semaphore
+ * @param _poll_interval    Cycles to wait if no credits are available
+ */
+#define SEM_WAIT_N(_name, _n, _poll_interval)                       \
+    sem_cls_wait_n(&SYNCH_SEM_NAME(_name), SYNCH_CRED_NAME(_name),  \
+                   _n, _poll_interval);
+
+/**
+ * Wrapper to give several credits of a semaphore at once.
+ * @param _name     Name of the semaphore
+ * @param _n        Number of credits, as taken with SEM_WAIT_N()
+ */
+#define SEM_POST_N(_name, _n)     \
+    sem_cls_post_n(&SYNCH_SEM_NAME(_name), _n);
+
 /**
  * Reset DRAM synch counter.
  * @param s     Synch counter
@@ -124,4 +142,27 @@ __intrinsic void sem_cls_wait(__cls struct sem *sem, const uint32_t max_credits,
  */
 __intrinsic void sem_cls_post(__cls struct sem *sem);
 
+/**
+ * Take several credits of a semaphore in one operation.  Users should use
+ * the SEM_WAIT_N() macro.
+ * @param sem               Semaphore handle
+ * @param max_credits       Max number of credits available
+ * @param n                 Number of credits to take, <= max_credits
+ * @param poll_interval     Cycles to wait if no credits are available
+ *
+ * @note Claims are handled in order, as for sem_cls_wait(), so a large
+ *       claim is not starved by smaller ones behind it.
+ */
+__intrinsic void sem_cls_wait_n(__cls struct sem *sem,
+                                const uint32_t max_credits, uint32_t n,
+                                uint32_t poll_interval);
+
+/**
+ * Give several credits of a semaphore in one operation.  Users should use
+ * the SEM_POST_N() macro.
+ * @param sem   Semaphore handle
+ * @param n     Number of credits taken with sem_cls_wait_n()
+ */
+__intrinsic void sem_cls_post_n(__cls struct sem *sem, uint32_t n);
+
 #endif /* !_STD__SYNCH_H_ */
@@ -0,0 +1,351 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_atomic.h>
+#include <nfp/mem_ring.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/blocks/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 200000
+# The step interval when running the simulator
+          stepsize: 200
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_blm_dbg_alloc_free(void);
+int32_t utfe_blm_dbg_double_free(void);
+int32_t utfe_blm_dbg_sig_done(void);
+
+#ifdef ALL_TEST
+    #define UTFE_BLM_DBG_ALLOC_FREE
+    #define UTFE_BLM_DBG_DOUBLE_FREE
+    #define UTFE_BLM_DBG_SIG_DONE
+#endif
+
+
+// tags for 1K handle keys, without the magazine
+#define BLM_BUF_DEBUG
+#define BLM_BUF_DEBUG_KEY_BITS      10
+
+#include "../me/blocks/blm/libblm.c"
+
+
+
+/* globals */
+
+/*
+ * No BLM ME runs in the test: it allocates the tag symbols of blm_main.uc
+ * itself, sets up the ring of BLQ 0 and puts DBG_BUFS made up handles on
+ * it, untagged.  The handles are never used as buffers.  Each test leaves
+ * all the handles on the ring.  The tests have not been run yet.
+ */
+__export __shared __emem unsigned int
+    blm_dbg_tags[1 << BLM_BUF_DEBUG_KEY_BITS];
+__export __shared __emem unsigned int blm_dbg_gen[2];
+__export __shared __emem struct blm_dbg_err blm_dbg_err;
+
+#define DBG_BLQ             0
+#define DBG_BUFS            8
+#define DBG_HANDLE_BASE     0x100
+#define DBG_GEN             5
+
+
+/* The tag of a handle */
+uint32_t
+dbg_tag(blm_buf_handle_t buf)
+{
+    __xread uint32_t tag;
+
+    mem_read_atomic(&tag, &blm_dbg_tags[buf & BLM_DBG_KEY_MASK],
+                    sizeof(tag));
+    return tag;
+}
+
+
+/* main test loop */
+void main(void)
+{
+    __xwrite uint32_t zero[4];
+    __xwrite uint32_t gen;
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+    uint32_t i;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+    for (i = 0; i < 4; i++)
+        zero[i] = 0;
+    mem_write_atomic(zero, &blm_dbg_err, sizeof(zero));
+    gen = DBG_GEN;
+    mem_write_atomic(&gen, blm_dbg_gen, sizeof(gen));
+
+    mem_ring_setup(BLM_EMU_RING_ID(8,0),
+                   (__dram void *)BLM_NBI8_BLQ0_EMU_Q_BASE,
+                   BLM_NBI8_BLQ0_Q_SIZE);
+    for (i = 0; i < DBG_BUFS; i++) {
+        mem_write_atomic(zero, &blm_dbg_tags[DBG_HANDLE_BASE + i],
+                         sizeof(zero[0]));
+        _blm_buf_free_ring(DBG_HANDLE_BASE + i, DBG_BLQ);
+    }
+
+#ifdef UTFE_BLM_DBG_ALLOC_FREE
+    if (utfe_blm_dbg_alloc_free() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_BLM_DBG_DOUBLE_FREE
+    if (utfe_blm_dbg_double_free() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_BLM_DBG_SIG_DONE
+    if (utfe_blm_dbg_sig_done() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
+
+
+/*
+<yaml>
+  - name: utfe_blm_dbg_alloc_free
+    info: Tags of blm_buf_alloc and blm_buf_free
+    summary: the buffer is tagged out, then free, with the generation
+    defs:
+        - UTFE_BLM_DBG_ALLOC_FREE
+</yaml>
+*/
+int32_t utfe_blm_dbg_alloc_free(void)
+{
+    __xread blm_buf_handle_t xbuf;
+    struct blm_dbg_err err;
+    blm_buf_handle_t buf;
+    uint32_t tag;
+
+    if (blm_buf_alloc(&xbuf, DBG_BLQ) != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 1);             // step
+        return 1;
+    }
+    buf = xbuf;
+
+    tag = dbg_tag(buf);
+    if (tag != (DBG_GEN << BLM_DBG_TAG_GEN_shf)) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 2);             // step
+        local_csr_write(local_csr_mailbox3, tag);           // actual
+        return 1;
+    }
+
+    blm_buf_free(buf, DBG_BLQ);
+
+    tag = dbg_tag(buf);
+    if (tag != ((DBG_GEN << BLM_DBG_TAG_GEN_shf) | BLM_DBG_TAG_FREE)) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 3);             // step
+        local_csr_write(local_csr_mailbox3, tag);           // actual
+        return 1;
+    }
+
+    blm_dbg_errs(&err);
+    if (err.double_frees != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 4);             // step
+        local_csr_write(local_csr_mailbox3, err.double_frees);
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_blm_dbg_double_free
+    info: Free a buffer that is already free
+    summary: one double free is counted with the handle, BLQ and tag
+    defs:
+        - UTFE_BLM_DBG_DOUBLE_FREE
+</yaml>
+*/
+int32_t utfe_blm_dbg_double_free(void)
+{
+    __xread blm_buf_handle_t xbuf;
+    struct blm_dbg_err before;
+    struct blm_dbg_err err;
+    blm_buf_handle_t buf;
+
+    blm_dbg_errs(&before);
+
+    if (blm_buf_alloc(&xbuf, DBG_BLQ) != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 1);             // step
+        return 1;
+    }
+    buf = xbuf;
+    blm_buf_free(buf, DBG_BLQ);
+
+    // tag the second free only, so the ring holds the handle once
+    _blm_dbg_free(buf, DBG_BLQ);
+
+    blm_dbg_errs(&err);
+    if (err.double_frees != before.double_frees + 1 ||
+        err.last_handle != buf || err.last_blq != DBG_BLQ ||
+        err.last_tag != ((DBG_GEN << BLM_DBG_TAG_GEN_shf) |
+                         BLM_DBG_TAG_FREE)) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 2);             // step
+        local_csr_write(local_csr_mailbox2, err.last_handle);
+        local_csr_write(local_csr_mailbox3, err.double_frees);
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_blm_dbg_sig_done
+    info: Allocate with __blm_buf_alloc and sig_done, then free
+    summary: the buffer stays tagged free until blm_buf_dbg_alloc, and
+             freeing it after that is not a double free
+    defs:
+        - UTFE_BLM_DBG_SIG_DONE
+</yaml>
+*/
+int32_t utfe_blm_dbg_sig_done(void)
+{
+    __xread blm_buf_handle_t xbuf;
+    struct blm_dbg_err before;
+    struct blm_dbg_err err;
+    blm_buf_handle_t buf;
+    SIGNAL_PAIR sigpair;
+    uint32_t tag;
+
+    blm_dbg_errs(&before);
+
+    __blm_buf_alloc(&xbuf, DBG_BLQ, &sigpair, sig_done);
+    wait_for_all_single(&sigpair.even);
+    if (signal_test(&sigpair.odd)) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 1);             // step
+        return 1;
+    }
+    buf = xbuf;
+
+    // freed onto the ring by the previous tests or set up untagged
+    tag = dbg_tag(buf);
+    if (tag != 0 && !(tag & BLM_DBG_TAG_FREE)) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 2);             // step
+        local_csr_write(local_csr_mailbox3, tag);           // actual
+        return 1;
+    }
+
+    blm_buf_dbg_alloc(buf);
+
+    tag = dbg_tag(buf);
+    if (tag != (DBG_GEN << BLM_DBG_TAG_GEN_shf)) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 3);             // step
+        local_csr_write(local_csr_mailbox3, tag);           // actual
+        return 1;
+    }
+
+    blm_buf_free(buf, DBG_BLQ);
+
+    blm_dbg_errs(&err);
+    if (err.double_frees != before.double_frees) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 4);             // step
+        local_csr_write(local_csr_mailbox3, err.double_frees);
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
@@ -0,0 +1,427 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_ring.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/blocks/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 200000
+# The step interval when running the simulator
+          stepsize: 200
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_blm_mag_alloc(void);
+int32_t utfe_blm_mag_refill(void);
+int32_t utfe_blm_mag_spill(void);
+int32_t utfe_blm_mag_drain(void);
+
+#ifdef ALL_TEST
+    #define UTFE_BLM_MAG_ALLOC
+    #define UTFE_BLM_MAG_REFILL
+    #define UTFE_BLM_MAG_SPILL
+    #define UTFE_BLM_MAG_DRAIN
+#endif
+
+
+// a small magazine, so that the tests spill and refill it
+#define BLM_MAGAZINE_SIZE           16
+#define BLM_MAGAZINE_BATCH          4
+
+#include "../me/blocks/blm/libblm.c"
+
+
+
+/* globals */
+
+/*
+ * No BLM ME runs in the test: it sets up the ring of BLQ 0 itself and
+ * puts MAG_BUFS made up handles on it.  The handles are never used as
+ * buffers.  Each test starts with an empty magazine and leaves all the
+ * handles on the ring.  The tests have not been run yet.
+ */
+#define MAG_BLQ             0
+#define MAG_BUFS            32
+#define MAG_HANDLE_BASE     0x100
+
+// enough handles to overflow the magazine
+#define MAG_HELD            (BLM_MAGAZINE_SIZE + 1)
+
+__lmem blm_buf_handle_t mag_held[MAG_HELD];
+
+
+/* Allocate num handles into mag_held[], each one only once */
+int32_t
+mag_alloc(uint32_t num)
+{
+    blm_buf_handle_t buf;
+    uint32_t seen = 0;
+    uint32_t bit;
+    uint32_t i;
+
+    for (i = 0; i < num; i++) {
+        if (blm_buf_alloc_cached(&buf, MAG_BLQ) != 0)
+            return -1;
+        mag_held[i] = buf;
+
+        bit = buf - MAG_HANDLE_BASE;
+        if (bit >= MAG_BUFS || (seen & (1 << bit)))
+            return -1;
+        seen |= 1 << bit;
+    }
+
+    return 0;
+}
+
+
+/* Free the handles in mag_held[] and return the magazine to the ring */
+void
+mag_release(uint32_t num)
+{
+    uint32_t i;
+
+    for (i = 0; i < num; i++)
+        blm_buf_free(mag_held[i], MAG_BLQ);
+    blm_mag_drain(MAG_BLQ);
+}
+
+
+/* main test loop */
+void main(void)
+{
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+    uint32_t i;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+    mem_ring_setup(BLM_EMU_RING_ID(8,0),
+                   (__dram void *)BLM_NBI8_BLQ0_EMU_Q_BASE,
+                   BLM_NBI8_BLQ0_Q_SIZE);
+    for (i = 0; i < MAG_BUFS; i++)
+        _blm_buf_free_ring(MAG_HANDLE_BASE + i, MAG_BLQ);
+
+#ifdef UTFE_BLM_MAG_ALLOC
+    if (utfe_blm_mag_alloc() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_BLM_MAG_REFILL
+    if (utfe_blm_mag_refill() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_BLM_MAG_SPILL
+    if (utfe_blm_mag_spill() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_BLM_MAG_DRAIN
+    if (utfe_blm_mag_drain() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
+
+
+/*
+<yaml>
+  - name: utfe_blm_mag_alloc
+    info: Allocate a batch with blm_buf_alloc_cached
+    summary: one refill from the ring, the rest of the batch from the magazine
+    defs:
+        - UTFE_BLM_MAG_ALLOC
+</yaml>
+*/
+int32_t utfe_blm_mag_alloc(void)
+{
+    struct blm_mag_stats stats;
+
+    blm_mag_init();
+
+    if (mag_alloc(BLM_MAGAZINE_BATCH) != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 1);             // step
+        return 1;
+    }
+
+    blm_mag_stats(MAG_BLQ, &stats);
+    if (stats.allocs != BLM_MAGAZINE_BATCH || stats.refills != 1 ||
+        stats.ring_allocs != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 2);             // step
+        local_csr_write(local_csr_mailbox3, stats.refills); // actual
+        return 1;
+    }
+
+    mag_release(BLM_MAGAZINE_BATCH);
+
+    blm_mag_stats(MAG_BLQ, &stats);
+    if (stats.frees != BLM_MAGAZINE_BATCH || stats.spills != 0 ||
+        stats.ring_frees != BLM_MAGAZINE_BATCH) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 3);             // step
+        local_csr_write(local_csr_mailbox3, stats.ring_frees);
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_blm_mag_refill
+    info: Allocate more than a batch with blm_buf_alloc_cached
+    summary: the empty magazine is refilled once per batch
+    defs:
+        - UTFE_BLM_MAG_REFILL
+</yaml>
+*/
+int32_t utfe_blm_mag_refill(void)
+{
+    struct blm_mag_stats stats;
+
+    blm_mag_init();
+
+    if (mag_alloc(2 * BLM_MAGAZINE_BATCH + 1) != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 1);             // step
+        return 1;
+    }
+
+    blm_mag_stats(MAG_BLQ, &stats);
+    if (stats.allocs != 2 * BLM_MAGAZINE_BATCH + 1 || stats.refills != 3 ||
+        stats.ring_allocs != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 2);             // step
+        local_csr_write(local_csr_mailbox3, stats.refills); // actual
+        return 1;
+    }
+
+    // the magazine holds what is left of the last batch and the frees
+    mag_release(2 * BLM_MAGAZINE_BATCH + 1);
+
+    blm_mag_stats(MAG_BLQ, &stats);
+    if (stats.spills != 0 || stats.ring_frees != 3 * BLM_MAGAZINE_BATCH) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 3);             // step
+        local_csr_write(local_csr_mailbox3, stats.ring_frees);
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_blm_mag_spill
+    info: Free more handles than the magazine holds with blm_buf_free
+    summary: the full magazine spills one batch to the ring
+    defs:
+        - UTFE_BLM_MAG_SPILL
+</yaml>
+*/
+int32_t utfe_blm_mag_spill(void)
+{
+    struct blm_mag_stats stats;
+    uint32_t left;
+    uint32_t i;
+
+    blm_mag_init();
+
+    if (mag_alloc(MAG_HELD) != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 1);             // step
+        return 1;
+    }
+
+    // start the frees with an empty magazine
+    blm_mag_stats(MAG_BLQ, &stats);
+    left = stats.refills * BLM_MAGAZINE_BATCH - MAG_HELD;
+    blm_mag_drain(MAG_BLQ);
+
+    for (i = 0; i < BLM_MAGAZINE_SIZE; i++)
+        blm_buf_free(mag_held[i], MAG_BLQ);
+
+    blm_mag_stats(MAG_BLQ, &stats);
+    if (stats.spills != 0 || stats.ring_frees != left) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 2);             // step
+        local_csr_write(local_csr_mailbox3, stats.spills);  // actual
+        return 1;
+    }
+
+    blm_buf_free(mag_held[BLM_MAGAZINE_SIZE], MAG_BLQ);
+
+    blm_mag_stats(MAG_BLQ, &stats);
+    if (stats.frees != MAG_HELD || stats.spills != 1) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 3);             // step
+        local_csr_write(local_csr_mailbox3, stats.spills);  // actual
+        return 1;
+    }
+
+    blm_mag_drain(MAG_BLQ);
+
+    blm_mag_stats(MAG_BLQ, &stats);
+    if (stats.ring_frees != left + MAG_HELD - BLM_MAGAZINE_BATCH) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 4);             // step
+        local_csr_write(local_csr_mailbox3, stats.ring_frees);
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_blm_mag_drain
+    info: Drain the magazine with blm_mag_drain
+    summary: the handles go back to the ring and the next alloc refills
+    defs:
+        - UTFE_BLM_MAG_DRAIN
+</yaml>
+*/
+int32_t utfe_blm_mag_drain(void)
+{
+    struct blm_mag_stats stats;
+    blm_buf_handle_t buf;
+
+    blm_mag_init();
+
+    if (mag_alloc(1) != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 1);             // step
+        return 1;
+    }
+
+    blm_mag_drain(MAG_BLQ);
+
+    blm_mag_stats(MAG_BLQ, &stats);
+    if (stats.ring_frees != BLM_MAGAZINE_BATCH - 1) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 2);             // step
+        local_csr_write(local_csr_mailbox3, stats.ring_frees);
+        return 1;
+    }
+
+    if (blm_buf_alloc_cached(&buf, MAG_BLQ) != 0 || buf == mag_held[0]) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 3);             // step
+        local_csr_write(local_csr_mailbox3, buf);           // actual
+        return 1;
+    }
+    mag_held[1] = buf;
+
+    blm_mag_stats(MAG_BLQ, &stats);
+    if (stats.refills != 2) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 4);             // step
+        local_csr_write(local_csr_mailbox3, stats.refills); // actual
+        return 1;
+    }
+
+    mag_release(2);
+
+    blm_mag_stats(MAG_BLQ, &stats);
+    if (stats.ring_frees != 2 * BLM_MAGAZINE_BATCH) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 5);             // step
+        local_csr_write(local_csr_mailbox3, stats.ring_frees);
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
@@ -0,0 +1,311 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_bulk.h>
+#include <net/csum.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/mem_bulk.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/net/libnet.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 200000
+# The step interval when running the simulator
+          stepsize: 200
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_csum_ones_sum_mem(void);
+int32_t utfe_csum_ones_sum_mem_bench(void);
+
+#ifdef ALL_TEST
+    #define UTFE_CSUM_ONES_SUM_MEM
+    #define UTFE_CSUM_ONES_SUM_MEM_BENCH
+#endif
+
+
+
+/* globals */
+#define BUF_SIZE    9216
+#define BENCH_ITER  8
+#define BENCH_SIZES 3
+
+__export __emem __align(64) uint8_t csum_test_buf[BUF_SIZE];
+
+/*
+ * Benchmark results, readable with nfp-rtsym after the test has run.
+ * For each of the frame sizes: the size, then cycles/byte * 100 for the
+ * serial (one read in flight) and the pipelined ones_sum_mem().  No
+ * figures have been recorded yet, the test has not been run.
+ * user/tools/csum_model gives modelled figures for the same sizes.
+ */
+__export __emem uint32_t csum_bench_res[BENCH_SIZES * 3];
+
+const uint32_t bench_sizes[BENCH_SIZES] = {64, 1500, 9000};
+
+
+/*
+ * Reference implementation: the single buffered ones_sum_mem() loop which
+ * waits for each 64B read to complete before summing it.
+ */
+__intrinsic uint32_t
+ones_sum_mem_serial(__mem40 void *mem, int32_t len)
+{
+    __xread uint32_t pkt_cache[16];
+    __gpr int curr_len;
+    __mem40 void* pkt_ptr;
+    SIGNAL read_sig;
+    __gpr uint32_t sum = 0;
+
+    pkt_ptr = mem;
+    while (len > 0) {
+        if (len > sizeof(pkt_cache))
+            curr_len = sizeof(pkt_cache);
+        else
+            curr_len = len;
+        __mem_read64(pkt_cache, pkt_ptr, ((curr_len + 7) & 0x78),
+                     sizeof(pkt_cache), ctx_swap, &read_sig);
+        sum = ones_sum_add(sum, ones_sum_warr(pkt_cache, curr_len));
+        __implicit_read(pkt_cache);
+        ((__mem40 uint8_t*)pkt_ptr) += curr_len;
+        len -= curr_len;
+    }
+    return sum;
+}
+
+
+/* word of the test pattern at a word aligned offset */
+#define CSUM_TEST_WORD(_off)    (((_off) * 0x01030507) ^ 0xA5C3E10F)
+
+/* fill the test buffer with a byte pattern that is not word symmetric */
+void
+csum_test_buf_init(void)
+{
+    __xwrite uint32_t wr[16];
+    uint32_t off;
+    uint32_t i;
+
+    for (off = 0; off < BUF_SIZE; off += sizeof(wr)) {
+        for (i = 0; i < 16; i++)
+            wr[i] = CSUM_TEST_WORD(off + i * 4);
+        mem_write64(wr, csum_test_buf + off, sizeof(wr));
+    }
+}
+
+
+/*
+ * Sum of a region of the test buffer computed from the pattern one byte
+ * at a time, without reading memory.
+ */
+uint32_t
+csum_test_buf_sum(uint32_t off, uint32_t len)
+{
+    uint32_t sum = 0;
+    uint32_t val;
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        val = CSUM_TEST_WORD((off + i) & ~3);
+        val = (val >> (24 - ((off + i) & 3) * 8)) & 0xFF;
+        if ((i & 1) == 0)
+            val <<= 8;
+        sum = ones_sum_add(sum, val);
+    }
+    return sum;
+}
+
+
+/* main test loop */
+void main(void)
+{
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    csum_test_buf_init();
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+#ifdef UTFE_CSUM_ONES_SUM_MEM
+    if (utfe_csum_ones_sum_mem() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_CSUM_ONES_SUM_MEM_BENCH
+    if (utfe_csum_ones_sum_mem_bench() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
+
+
+/*
+<yaml>
+  - name: utfe_csum_ones_sum_mem
+    info: Test ones_sum_mem against the serial reference and the pattern
+    summary: pipelined ones_sum_mem gives the same sums as the serial
+             loop and as the byte by byte sum of the test pattern
+    defs:
+        - UTFE_CSUM_ONES_SUM_MEM
+</yaml>
+*/
+int32_t utfe_csum_ones_sum_mem(void)
+{
+    uint32_t len;
+    uint32_t off;
+    uint32_t expected;
+    uint32_t serial;
+    uint32_t actual;
+
+    // odd lengths and every offset within a word exercise the partial
+    // word and chunk paths
+    for (off = 0; off < 4; off++) {
+        for (len = 1; len <= 300; len += 13) {
+            expected = ones_sum_fold16(csum_test_buf_sum(off, len));
+            serial = ones_sum_fold16(
+                ones_sum_mem_serial(csum_test_buf + off, len));
+            actual = ones_sum_fold16(ones_sum_mem(csum_test_buf + off, len));
+
+            if (actual != expected || serial != expected)
+            {
+                // FAIL
+                local_csr_write(local_csr_mailbox1, (off << 16) | len);
+                local_csr_write(local_csr_mailbox2, expected);  // expected
+                local_csr_write(local_csr_mailbox3, actual);    // actual
+                return 1;
+            }
+        }
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_csum_ones_sum_mem_bench
+    info: Benchmark ones_sum_mem for 64B, 1500B and 9000B frames
+    summary: cycles/byte of serial and pipelined ones_sum_mem
+    defs:
+        - UTFE_CSUM_ONES_SUM_MEM_BENCH
+</yaml>
+*/
+int32_t utfe_csum_ones_sum_mem_bench(void)
+{
+    __xwrite uint32_t res[3];
+    __gpr uint32_t sum_serial;
+    __gpr uint32_t sum_pipe;
+    uint64_t t0;
+    uint64_t t_serial;
+    uint64_t t_pipe;
+    uint32_t size;
+    uint32_t i, j;
+
+    for (i = 0; i < BENCH_SIZES; i++) {
+        size = bench_sizes[i];
+
+        t0 = me_tsc_read();
+        for (j = 0; j < BENCH_ITER; j++)
+            sum_serial = ones_sum_mem_serial(csum_test_buf, size);
+        t_serial = me_tsc_read() - t0;
+
+        t0 = me_tsc_read();
+        for (j = 0; j < BENCH_ITER; j++)
+            sum_pipe = ones_sum_mem(csum_test_buf, size);
+        t_pipe = me_tsc_read() - t0;
+
+        if (ones_sum_fold16(sum_serial) != ones_sum_fold16(sum_pipe))
+        {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, size);          // length
+            local_csr_write(local_csr_mailbox2, sum_serial);    // expected
+            local_csr_write(local_csr_mailbox3, sum_pipe);      // actual
+            return 1;
+        }
+
+        // the timestamp counter increments every 16 ME cycles
+        res[0] = size;
+        res[1] = (uint32_t)((t_serial * 16 * 100) / (BENCH_ITER * size));
+        res[2] = (uint32_t)((t_pipe * 16 * 100) / (BENCH_ITER * size));
+        mem_write32(res, &csum_bench_res[i * 3], sizeof(res));
+    }
+
+    // PASS
+    return 0;
+}
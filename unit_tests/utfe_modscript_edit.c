@@ -0,0 +1,302 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_bulk.h>
+#include <pkt/pkt.h>
+#include <modscript/modscript.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/mem_bulk.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 400000
+# The step interval when running the simulator
+          stepsize: 200
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_modscript_edit_insert(void);
+int32_t utfe_modscript_edit_delete(void);
+int32_t utfe_modscript_cache(void);
+
+#ifdef ALL_TEST
+    #define UTFE_MODSCRIPT_EDIT_INSERT
+    #define UTFE_MODSCRIPT_EDIT_DELETE
+    #define UTFE_MODSCRIPT_CACHE
+#endif
+
+
+#include "../me/lib/modscript/libmodscript.c"
+
+
+/* globals */
+__export __emem __align(256) uint8_t ms_test_buf[256];
+
+__lmem uint32_t ms_test_data[MODSCRIPT_EDIT_MAX_LEN / 4] = {
+    0x81000064, 0x11223344, 0x55667788, 0x99aabbcc};
+
+
+/* Read two words of the buffer, fail if they are not as expected */
+int32_t
+ms_test_words(uint32_t off, uint32_t w0, uint32_t w1, uint32_t check)
+{
+    __xread uint32_t rd[2];
+
+    mem_read32(rd, ms_test_buf + off, sizeof(rd));
+    if (rd[0] != w0 || rd[1] != w1) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, check); // check
+        local_csr_write(local_csr_mailbox2, rd[0]); // actual
+        local_csr_write(local_csr_mailbox3, rd[1]);
+        return 1;
+    }
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_modscript_edit_insert
+    info: Push and rewrite a VLAN tag with modscript_edit_write
+    summary: script words, offset encoding and unsupported offsets
+    defs:
+        - UTFE_MODSCRIPT_EDIT_INSERT
+</yaml>
+*/
+int32_t utfe_modscript_edit_insert(void)
+{
+    struct pkt_ms_info msi;
+
+    msi = modscript_edit_write(ms_test_buf, 64, MODSCRIPT_ACT_INSERT, 12, 4,
+                               ms_test_data);
+    if (msi.off_enc != 6 || msi.len_adj != 64) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 1);     // check
+        return 1;
+    }
+    if (ms_test_words(56, 0x80260c04, 0x81000064, 2))
+        return 1;
+
+    /* Twice from the cache, then a 16B replace in a 24B script */
+    msi = modscript_edit_write(ms_test_buf, 64, MODSCRIPT_ACT_INSERT, 12, 4,
+                               ms_test_data);
+    if (msi.off_enc != 6 || ms_test_words(56, 0x80260c04, 0x81000064, 3))
+        return 1;
+    msi = modscript_edit_write(ms_test_buf, 96, MODSCRIPT_ACT_REPLACE, 14,
+                               16, ms_test_data);
+    if (msi.off_enc != 8 || ms_test_words(72, 0x805e0e10, 0x81000064, 4) ||
+        ms_test_words(88, 0x99aabbcc, 0, 5))
+        return 1;
+
+    /* A replace or insert needs an 8B aligned packet */
+    msi = modscript_edit_write(ms_test_buf, 66, MODSCRIPT_ACT_INSERT, 12, 4,
+                               ms_test_data);
+    if (msi.off_enc != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 6);     // check
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_modscript_edit_delete
+    info: Delete bytes with modscript_edit_write
+    summary: delete at 0 of an unaligned packet, VLAN pop and limits
+    defs:
+        - UTFE_MODSCRIPT_EDIT_DELETE
+</yaml>
+*/
+int32_t utfe_modscript_edit_delete(void)
+{
+    struct pkt_ms_info msi;
+
+    /* 2 bytes up to the packet and 14 of it */
+    msi = modscript_edit_write(ms_test_buf, 42, MODSCRIPT_ACT_DELETE, 0, 14,
+                               ms_test_data);
+    if (msi.off_enc != 3 || msi.len_adj != 42) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 1);     // check
+        return 1;
+    }
+    if (ms_test_words(32, 0x801e0000, 0, 2))
+        return 1;
+
+    msi = modscript_edit_write(ms_test_buf, 64, MODSCRIPT_ACT_DELETE, 12, 4,
+                               ms_test_data);
+    if (msi.off_enc != 6 || ms_test_words(56, 0x80060c00, 0, 3))
+        return 1;
+
+    /* Too many bytes with the gap, or no room for the script */
+    msi = modscript_edit_write(ms_test_buf, 42, MODSCRIPT_ACT_DELETE, 0, 15,
+                               ms_test_data);
+    if (msi.off_enc != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 4);     // check
+        return 1;
+    }
+    msi = modscript_edit_write(ms_test_buf, 8, MODSCRIPT_ACT_DELETE, 0, 4,
+                               ms_test_data);
+    if (msi.off_enc != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 5);     // check
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_modscript_cache
+    info: modscript_write from the LMEM cache
+    summary: scripts written on a miss and on a hit match modscript_tbl
+    defs:
+        - UTFE_MODSCRIPT_CACHE
+</yaml>
+*/
+int32_t utfe_modscript_cache(void)
+{
+    __xread uint32_t tbl[4];
+    __xwrite uint32_t zero[2];
+    struct pkt_ms_info msi;
+    uint32_t off, ms_off, n;
+
+    for (off = 40; off < 160; off += 7) {
+        cls_read(tbl, &modscript_tbl[off - PKTIO_MIN_NBI_TX_OFFSET][0],
+                 sizeof(tbl));
+        ms_off = tbl[3] & 0xff;
+
+        /* Miss then hit */
+        for (n = 0; n < 2; n++) {
+            reg_zero(zero, sizeof(zero));
+            mem_write32(zero, ms_test_buf + ms_off, sizeof(zero));
+
+            msi = modscript_write(ms_test_buf, off);
+            if (msi.off_enc != (ms_off >> 3) - 1 || msi.len_adj != off) {
+                // FAIL
+                local_csr_write(local_csr_mailbox1, 1);     // check
+                local_csr_write(local_csr_mailbox2, off);
+                return 1;
+            }
+            if (ms_test_words(ms_off, tbl[0], tbl[1], 2 + n))
+                return 1;
+        }
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/* main test loop */
+void main(void)
+{
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+    modscript_cache_init();
+
+#ifdef UTFE_MODSCRIPT_EDIT_INSERT
+    if (utfe_modscript_edit_insert() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_MODSCRIPT_EDIT_DELETE
+    if (utfe_modscript_edit_delete() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_MODSCRIPT_CACHE
+    if (utfe_modscript_cache() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
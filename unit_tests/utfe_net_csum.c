@@ -0,0 +1,359 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_bulk.h>
+#include <net/csum.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/mem_bulk.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/net/libnet.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 100000
+# The step interval when running the simulator
+          stepsize: 100
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_net_csum_icmp(void);
+int32_t utfe_net_csum_icmp6(void);
+int32_t utfe_net_csum_sctp(void);
+
+#ifdef ALL_TEST
+    #define UTFE_NET_CSUM_ICMP
+    #define UTFE_NET_CSUM_ICMP6
+    #define UTFE_NET_CSUM_SCTP
+#endif
+
+
+
+/* globals */
+#define BUF_SIZE    256
+
+/*
+ * The CTM part of a test packet is read from ctm_buf, the memory part from
+ * mem_buf, which holds the packet from the split onwards so that both parts
+ * start word aligned whatever the split.
+ */
+__export __emem __align(64) uint8_t ctm_buf[BUF_SIZE];
+__export __emem __align(64) uint8_t mem_buf[BUF_SIZE];
+
+/*
+ * Test packets as big-endian words, each padded with a zero word.  The
+ * expected checksums were computed independently on the host: RFC1071 for
+ * ICMP/ICMPv6 and the reflected CRC-32c of RFC4960 (which gives 0xE3069283
+ * for "123456789") for SCTP.  The SCTP value also matches a bit swapped
+ * nfp_me_crc32c() (user/libs/flowenv/nfp_me_crc.c), the model of the ME CRC
+ * unit used by net_csum_sctp().
+ */
+
+/* ICMP echo request, checksum zeroed, 101 bytes */
+#define ICMP_LEN    101
+#define ICMP_CSUM   0x264f
+const uint32_t icmp_pkt[27] = {
+    0x08000000, 0x12340001, 0x030a1118, 0x1f262d34,
+    0x3b424950, 0x575e656c, 0x737a8188, 0x8f969da4,
+    0xabb2b9c0, 0xc7ced5dc, 0xe3eaf1f8, 0xff060d14,
+    0x1b222930, 0x373e454c, 0x535a6168, 0x6f767d84,
+    0x8b9299a0, 0xa7aeb5bc, 0xc3cad1d8, 0xdfe6edf4,
+    0xfb020910, 0x171e252c, 0x333a4148, 0x4f565d64,
+    0x6b727980, 0x87000000, 0x00000000
+};
+
+/* ICMPv6 echo request from fe80::1 to fe80::2, checksum zeroed, 77 bytes */
+#define ICMP6_LEN   77
+#define ICMP6_CSUM  0xaa30
+const uint32_t icmp6_ip[10] = {
+    0x60000000, 0x004d3aff, 0xfe800000, 0x00000000,
+    0x00000000, 0x00000001, 0xfe800000, 0x00000000,
+    0x00000000, 0x00000002
+};
+const uint32_t icmp6_pkt[21] = {
+    0x80000000, 0xabcd0007, 0x05121f2c, 0x39465360,
+    0x6d7a8794, 0xa1aebbc8, 0xd5e2effc, 0x09162330,
+    0x3d4a5764, 0x717e8b98, 0xa5b2bfcc, 0xd9e6f300,
+    0x0d1a2734, 0x414e5b68, 0x75828f9c, 0xa9b6c3d0,
+    0xddeaf704, 0x111e2b38, 0x45525f6c, 0x79000000,
+    0x00000000
+};
+
+/*
+ * SCTP packet with a DATA chunk, 113 bytes.  The checksum field holds
+ * garbage, which net_csum_sctp() must treat as zero.  The CRC-32c is
+ * 0x6ae2fb6c, stored least significant byte first.
+ */
+#define SCTP_LEN    113
+#define SCTP_CSUM   0x6cfbe26a
+const uint32_t sctp_pkt[30] = {
+    0x13880050, 0x01020304, 0xdeadbeef, 0x00030065,
+    0x010c1722, 0x2d38434e, 0x59646f7a, 0x85909ba6,
+    0xb1bcc7d2, 0xdde8f3fe, 0x09141f2a, 0x35404b56,
+    0x616c7782, 0x8d98a3ae, 0xb9c4cfda, 0xe5f0fb06,
+    0x111c2732, 0x3d48535e, 0x69747f8a, 0x95a0abb6,
+    0xc1ccd7e2, 0xedf8030e, 0x19242f3a, 0x45505b66,
+    0x717c8792, 0x9da8b3be, 0xc9d4dfea, 0xf5000b16,
+    0x21000000, 0x00000000
+};
+
+/*
+ * CTM part lengths to test, each list ends with the whole packet in CTM.
+ * Odd lengths put the memory part in the opposite byte lanes, and lengths
+ * shorter than the header make it straddle the split.
+ */
+#define NUM_SPLITS  6
+const uint32_t icmp_splits[NUM_SPLITS] = {0, 5, 8, 61, 64, ICMP_LEN};
+const uint32_t icmp6_splits[NUM_SPLITS] = {0, 3, 6, 40, 71, ICMP6_LEN};
+const uint32_t sctp_splits[NUM_SPLITS] = {0, 6, 12, 15, 64, SCTP_LEN};
+
+
+/*
+ * Write a test packet to ctm_buf and the bytes from @split onwards to the
+ * start of mem_buf.
+ */
+void
+csum_test_split(const uint32_t *pkt, uint32_t nwords, uint32_t split)
+{
+    __xwrite uint32_t wr[16];
+    uint32_t shf = (split & 3) * 8;
+    uint32_t off;
+    uint32_t i;
+    uint32_t k;
+
+    for (off = 0; off < BUF_SIZE; off += sizeof(wr)) {
+        for (i = 0; i < 16; i++) {
+            k = off / 4 + i;
+            wr[i] = (k < nwords) ? pkt[k] : 0;
+        }
+        mem_write64(wr, ctm_buf + off, sizeof(wr));
+
+        for (i = 0; i < 16; i++) {
+            k = (split / 4) + off / 4 + i;
+            wr[i] = 0;
+            if (k < nwords)
+                wr[i] = pkt[k] << shf;
+            if (shf != 0 && k + 1 < nwords)
+                wr[i] |= pkt[k + 1] >> (32 - shf);
+        }
+        mem_write64(wr, mem_buf + off, sizeof(wr));
+    }
+}
+
+
+/* main test loop */
+void main(void)
+{
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+#ifdef UTFE_NET_CSUM_ICMP
+    if (utfe_net_csum_icmp() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_NET_CSUM_ICMP6
+    if (utfe_net_csum_icmp6() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_NET_CSUM_SCTP
+    if (utfe_net_csum_sctp() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
+
+
+/*
+<yaml>
+  - name: utfe_net_csum_icmp
+    info: Test net_csum_icmp against a known checksum
+    summary: ICMP checksum for every CTM/memory split
+    defs:
+        - UTFE_NET_CSUM_ICMP
+</yaml>
+*/
+int32_t utfe_net_csum_icmp(void)
+{
+    uint32_t split;
+    uint32_t actual;
+    uint32_t i;
+
+    for (i = 0; i < NUM_SPLITS; i++) {
+        split = icmp_splits[i];
+        csum_test_split(icmp_pkt, sizeof(icmp_pkt) / 4, split);
+        actual = net_csum_icmp(ctm_buf, split, mem_buf, ICMP_LEN - split);
+
+        if (actual != ICMP_CSUM)
+        {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, split);     // split
+            local_csr_write(local_csr_mailbox2, ICMP_CSUM); // expected
+            local_csr_write(local_csr_mailbox3, actual);    // actual
+            return 1;
+        }
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_net_csum_icmp6
+    info: Test net_csum_icmp6 against a known checksum
+    summary: ICMPv6 checksum for every CTM/memory split
+    defs:
+        - UTFE_NET_CSUM_ICMP6
+</yaml>
+*/
+int32_t utfe_net_csum_icmp6(void)
+{
+    uint32_t ip[10];
+    uint32_t split;
+    uint32_t actual;
+    uint32_t i;
+
+    for (i = 0; i < 10; i++)
+        ip[i] = icmp6_ip[i];
+
+    for (i = 0; i < NUM_SPLITS; i++) {
+        split = icmp6_splits[i];
+        csum_test_split(icmp6_pkt, sizeof(icmp6_pkt) / 4, split);
+        actual = net_csum_icmp6(ip, ctm_buf, split,
+                                mem_buf, ICMP6_LEN - split);
+
+        if (actual != ICMP6_CSUM)
+        {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, split);         // split
+            local_csr_write(local_csr_mailbox2, ICMP6_CSUM);    // expected
+            local_csr_write(local_csr_mailbox3, actual);        // actual
+            return 1;
+        }
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_net_csum_sctp
+    info: Test net_csum_sctp against a known CRC-32c
+    summary: SCTP checksum for every CTM/memory split
+    defs:
+        - UTFE_NET_CSUM_SCTP
+</yaml>
+*/
+int32_t utfe_net_csum_sctp(void)
+{
+    uint32_t sctp[3];
+    uint32_t split;
+    uint32_t actual;
+    uint32_t i;
+
+    for (i = 0; i < 3; i++)
+        sctp[i] = sctp_pkt[i];
+
+    for (i = 0; i < NUM_SPLITS; i++) {
+        split = sctp_splits[i];
+        csum_test_split(sctp_pkt, sizeof(sctp_pkt) / 4, split);
+        actual = net_csum_sctp(sctp, ctm_buf, split,
+                               mem_buf, SCTP_LEN - split);
+
+        if (actual != SCTP_CSUM)
+        {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, split);     // split
+            local_csr_write(local_csr_mailbox2, SCTP_CSUM); // expected
+            local_csr_write(local_csr_mailbox3, actual);    // actual
+            return 1;
+        }
+    }
+
+    // PASS
+    return 0;
+}
@@ -0,0 +1,206 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_bulk.h>
+#include <pkt/pkt.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/mem_bulk.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 400000
+# The step interval when running the simulator
+          stepsize: 200
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_pkt_ctm_credits_bench(void);
+
+#ifdef ALL_TEST
+    #define UTFE_PKT_CTM_CREDITS_BENCH
+#endif
+
+
+#include "../me/lib/pkt/libpkt.c"
+
+
+/* globals */
+#define BENCH_ITER      64
+#define BENCH_MODES     2
+
+/* Credits taken from the island for every packet, or from a cache */
+#define BENCH_MODE_ISLAND   0
+#define BENCH_MODE_CACHE    1
+
+#define CTM_ALLOC_ERR       0xffffffff
+
+__export __shared __cls struct ctm_pkt_credits bench_credits = {256, 64};
+__shared __lmem struct ctm_pkt_credits bench_cache = {0, 0};
+
+/*
+ * Benchmark results, readable with nfp-rtsym after the test has run.
+ * For each mode: the mode, ME cycles per allocation and thousands of
+ * allocations/s for one context of an ME clocked at 1 GHz.  No figures
+ * have been recorded yet, the test has not been run.
+ */
+__export __emem uint32_t ctm_bench_res[BENCH_MODES * 3];
+
+
+/* main test loop */
+void main(void)
+{
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+#ifdef UTFE_PKT_CTM_CREDITS_BENCH
+    if (utfe_pkt_ctm_credits_bench() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
+
+
+/*
+<yaml>
+  - name: utfe_pkt_ctm_credits_bench
+    info: Benchmark pkt_ctm_alloc against pkt_ctm_cache_alloc
+    summary: cycles per allocation and allocations/s with island and cached credits
+    defs:
+        - UTFE_PKT_CTM_CREDITS_BENCH
+</yaml>
+*/
+int32_t utfe_pkt_ctm_credits_bench(void)
+{
+    __xwrite uint32_t res[3];
+    uint64_t t0;
+    uint64_t t_alloc;
+    uint32_t cyc;
+    uint32_t mode;
+    uint32_t i;
+    unsigned int pnum;
+
+    for (mode = 0; mode < BENCH_MODES; mode++) {
+        t_alloc = 0;
+        for (i = 0; i < BENCH_ITER; i++) {
+            t0 = me_tsc_read();
+            if (mode == BENCH_MODE_ISLAND)
+                pnum = pkt_ctm_alloc(&bench_credits, __ISLAND,
+                                     PKT_CTM_SIZE_256, 1, 1);
+            else
+                pnum = pkt_ctm_cache_alloc(&bench_credits, &bench_cache,
+                                           __ISLAND, PKT_CTM_SIZE_256, 1);
+            t_alloc += me_tsc_read() - t0;
+
+            if (pnum == CTM_ALLOC_ERR) {
+                // FAIL
+                local_csr_write(local_csr_mailbox1, mode);  // mode
+                local_csr_write(local_csr_mailbox2, i);     // iteration
+                return 1;
+            }
+            pkt_ctm_free(__ISLAND, pnum);
+
+            /* The cache stays within its bounds */
+            if (bench_cache.pkts > PKT_CTM_CREDIT_CACHE_MAX ||
+                bench_cache.bufs > PKT_CTM_CREDIT_CACHE_MAX) {
+                // FAIL
+                local_csr_write(local_csr_mailbox1, mode);  // mode
+                local_csr_write(local_csr_mailbox2, i);     // iteration
+                local_csr_write(local_csr_mailbox3, bench_cache.pkts);
+                return 1;
+            }
+        }
+
+        // the timestamp counter increments every 16 ME cycles
+        cyc = (uint32_t)((t_alloc * 16) / BENCH_ITER);
+        res[0] = mode;
+        res[1] = cyc;
+        res[2] = 1000000 / (cyc ? cyc : 1);
+        mem_write32(res, &ctm_bench_res[mode * 3], sizeof(res));
+    }
+
+    /* Releasing empties the cache */
+    pkt_ctm_cache_put_credits(&bench_credits, &bench_cache);
+    if (bench_cache.pkts != 0 || bench_cache.bufs != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, BENCH_MODES);
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
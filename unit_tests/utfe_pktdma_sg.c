@@ -0,0 +1,242 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_bulk.h>
+#include <pktdma/pktdma.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/mem_bulk.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 2000000
+# The step interval when running the simulator
+          stepsize: 200
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_pktdma_sg(void);
+
+#ifdef ALL_TEST
+    #define UTFE_PKTDMA_SG
+#endif
+
+
+#include "../me/lib/pktdma/libpktdma.c"
+#include "../me/lib/std/libstd.c"
+
+
+/* globals */
+#define SG_BUF_SZ       4096
+#define SG_NUM          3
+
+__export __emem __align(64) uint8_t sg_mu_src[SG_BUF_SZ];
+__export __emem __align(64) uint8_t sg_mu_dst[SG_BUF_SZ];
+__export __ctm __align(64) uint8_t sg_ctm[SG_BUF_SZ];
+
+/*
+ * Entries: an unaligned head and tail around two DMA commands, MU and CTM
+ * addresses of different alignment (bulk copy only), and less than 64B.
+ */
+const uint32_t sg_mem_off[SG_NUM]   = {5,    2600, 3900};
+const uint32_t sg_ctm_off[SG_NUM]   = {13,   2501, 3300};
+const uint32_t sg_size[SG_NUM]      = {2200, 300,  40};
+
+__lmem struct pktdma_sg sg_list[SG_NUM];
+
+
+/* The byte at offset off of sg_mu_src */
+uint32_t
+sg_pattern(uint32_t off)
+{
+    return (off + (off >> 8)) & 0xff;
+}
+
+
+/* Compare size bytes at a and b, return 0 if equal */
+int
+sg_cmp(__mem40 uint8_t *a, __mem40 uint8_t *b, uint32_t size)
+{
+    __xread uint32_t rd_a;
+    __xread uint32_t rd_b;
+    uint32_t n;
+
+    for (; size > 0; size -= n, a += n, b += n) {
+        n = (size < 4) ? size : 4;
+        mem_read8(&rd_a, a, n);
+        mem_read8(&rd_b, b, n);
+        if ((rd_a ^ rd_b) >> (32 - n * 8))
+            return 1;
+    }
+
+    return 0;
+}
+
+
+/* main test loop */
+void main(void)
+{
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+#ifdef UTFE_PKTDMA_SG
+    if (utfe_pktdma_sg() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
+
+
+/*
+<yaml>
+  - name: utfe_pktdma_sg
+    info: Move a scatter list MU to CTM and back with pktdma_*_sg
+    summary: unaligned head and tail, bulk only entry, too many commands
+    defs:
+        - UTFE_PKTDMA_SG
+</yaml>
+*/
+int32_t utfe_pktdma_sg(void)
+{
+    __xwrite uint32_t wr[16];
+    uint32_t off;
+    uint32_t i, j;
+
+    for (off = 0; off < SG_BUF_SZ; off += sizeof(wr)) {
+        for (i = 0; i < 16; i++) {
+            wr[i] = 0;
+            for (j = 0; j < 4; j++)
+                wr[i] |= sg_pattern(off + i * 4 + j) << (24 - j * 8);
+        }
+        mem_write32(wr, sg_mu_src + off, sizeof(wr));
+    }
+
+    for (i = 0; i < SG_NUM; i++) {
+        sg_list[i].mem_addr = (uint64_t)(sg_mu_src + sg_mem_off[i]);
+        sg_list[i].ctm_addr = (uint32_t)sg_ctm + sg_ctm_off[i];
+        sg_list[i].size = sg_size[i];
+    }
+
+    if (pktdma_mu_to_ctm_sg(sg_list, SG_NUM) != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 1);     // step
+        return 1;
+    }
+
+    for (i = 0; i < SG_NUM; i++) {
+        if (sg_cmp(PKTDMA_CTM_PTR40((uint32_t)sg_ctm + sg_ctm_off[i]),
+                   (__mem40 uint8_t *)sg_mu_src + sg_mem_off[i],
+                   sg_size[i]) != 0) {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, 2);     // step
+            local_csr_write(local_csr_mailbox2, i);     // entry
+            return 1;
+        }
+    }
+
+    /* And back to another MU buffer at the same offsets */
+    for (i = 0; i < SG_NUM; i++)
+        sg_list[i].mem_addr = (uint64_t)(sg_mu_dst + sg_mem_off[i]);
+
+    if (pktdma_ctm_to_mu_sg(sg_list, SG_NUM) != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 3);     // step
+        return 1;
+    }
+
+    for (i = 0; i < SG_NUM; i++) {
+        if (sg_cmp((__mem40 uint8_t *)sg_mu_dst + sg_mem_off[i],
+                   (__mem40 uint8_t *)sg_mu_src + sg_mem_off[i],
+                   sg_size[i]) != 0) {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, 4);     // step
+            local_csr_write(local_csr_mailbox2, i);     // entry
+            return 1;
+        }
+    }
+
+    /* More than PKTDMA_SG_MAX_CMDS commands are refused */
+    sg_list[0].size = (PKTDMA_SG_MAX_CMDS + 1) * 2048;
+    if (pktdma_mu_to_ctm_sg(sg_list, 1) != -1) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 5);     // step
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
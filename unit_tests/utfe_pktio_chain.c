@@ -0,0 +1,447 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_bulk.h>
+#include <pkt/pkt.h>
+#include <net/csum.h>
+#include <pktdma/pktdma.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/mem_bulk.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/net/libnet.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 200000
+# The step interval when running the simulator
+          stepsize: 200
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_pktio_chain_iter(void);
+int32_t utfe_pktio_chain_ptr(void);
+int32_t utfe_pktio_chain_csum(void);
+int32_t utfe_pktio_chain_sg(void);
+
+#ifdef ALL_TEST
+    #define UTFE_PKTIO_CHAIN_ITER
+    #define UTFE_PKTIO_CHAIN_PTR
+    #define UTFE_PKTIO_CHAIN_CSUM
+    #define UTFE_PKTIO_CHAIN_SG
+#endif
+
+
+// these defines are needed by libpktio.c
+#define NBI_PKT_PREPEND_BYTES       0
+#define SPLIT_LENGTH                0
+#define CHANNEL_TO_TMQ(y)           (y << 3)
+#define PORT_TO_CHANNEL(x)          (x << 4)
+#define PKT_NBI_OFFSET              64
+#define PKTIO_NBI_SEQD_MAP_SEQR
+#define PKTIO_CHAIN_ENABLED
+
+#include "../me/lib/modscript/libmodscript.c"
+#include "../me/lib/pkt/libpkt.c"
+#include "../me/lib/pktio/libpktio.c"
+#include "../me/lib/pktdma/libpktdma.c"
+#include "../me/lib/std/libstd.c"
+
+
+
+/* globals */
+
+/*
+ * A 5000B packet in a 256B CTM buffer and a chain of 3 MU buffers: 192B in
+ * CTM, the rest at buffer offsets 256 to 5063.  The buffers of the chain
+ * are the rows of chain_mu[] in the order 0, 2, 1 so that a chain walked
+ * as one contiguous buffer reads the wrong data.
+ */
+#define PKT_LEN         5000
+#define PKT_CTM_LEN     (256 - PKT_NBI_OFFSET)
+#define PKT_BUF_LEN     5056
+#define CHAIN_NUM       3
+
+__export __emem __align(2048) uint32_t chain_mu[CHAIN_NUM][2048 / 4];
+
+/* The same packet in one buffer */
+__export __emem __align(64) uint32_t chain_ref[PKT_BUF_LEN / 4];
+
+__lmem uint32_t chain_bufs[PKTIO_CHAIN_BUFS];
+__lmem struct pktdma_sg chain_sg[4];
+
+/* Row of chain_mu[] holding buffer n of the chain */
+#define CHAIN_ROW(_n)   ((_n) == 0 ? 0 : 3 - (_n))
+
+
+/* Word at offset off of the test packet */
+uint32_t
+chain_word(uint32_t off)
+{
+    uint32_t w = 0;
+    uint32_t i;
+
+    for (i = off; i < off + 4; i++)
+        w = (w << 8) | ((i * 7 + 3) & 0xff);
+    return w;
+}
+
+/* Handle of buffer n of the chain */
+uint32_t
+chain_handle(uint32_t n)
+{
+    return (uint64_t)(__mem40 void *)chain_mu[CHAIN_ROW(n)] >> 11;
+}
+
+/* Build the packet in a CTM buffer and the chain of chain_mu[] */
+int
+chain_pkt(void)
+{
+    __xwrite uint32_t wr[16];
+    __xwrite uint32_t desc[PKTIO_CHAIN_BUFS];
+    unsigned int pnum;
+    uint32_t off, boff, i;
+
+    pnum = pkt_ctm_alloc(&ctm_credits, __ISLAND, PKT_CTM_SIZE_256, 1, 1);
+    if (pnum == CTM_ALLOC_ERR)
+        return -1;
+
+    for (off = 0; off < PKT_BUF_LEN; off += sizeof(wr)) {
+        for (i = 0; i < 16; i++)
+            wr[i] = chain_word(off + i * 4);
+
+        mem_write32(wr, &chain_ref[off / 4], sizeof(wr));
+        boff = PKT_NBI_OFFSET + off;
+        if (off < PKT_CTM_LEN)
+            mem_write32(wr, pkt_ctm_ptr40(__ISLAND, pnum, boff), sizeof(wr));
+        else
+            mem_write32(wr, &chain_mu[CHAIN_ROW(boff / 2048)]
+                                     [(boff & 2047) / 4], sizeof(wr));
+    }
+
+    /* The descriptor at the start of the head buffer */
+    desc[0] = CHAIN_NUM << 24;
+    desc[1] = chain_handle(1);
+    desc[2] = chain_handle(2);
+    desc[3] = 0;
+    desc[4] = 0;
+    desc[5] = 0;
+    desc[6] = 0;
+    desc[7] = 0;
+    mem_write32(desc, chain_mu[0], sizeof(desc));
+
+    reg_zero((void *)pkt.__raw, sizeof(pkt));
+    pkt.p_isl = __ISLAND;
+    pkt.p_pnum = pnum;
+    pkt.p_len = PKT_LEN;
+    pkt.p_orig_len = PKT_LEN;
+    pkt.p_offset = PKT_NBI_OFFSET;
+    pkt.p_ctm_size = PKT_CTM_SIZE_256;
+    pkt.p_is_split = 1;
+    pkt.p_muptr = chain_handle(0);
+    pkt.p_chained = 1;
+    pkt.p_src = PKT_WIRE_PORT(0, 0);
+
+    return 0;
+}
+
+
+/* main test loop */
+void main(void)
+{
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+    if (chain_pkt() != 0) {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+        for (;;)
+            ;
+    }
+
+#ifdef UTFE_PKTIO_CHAIN_ITER
+    if (utfe_pktio_chain_iter() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_PKTIO_CHAIN_PTR
+    if (utfe_pktio_chain_ptr() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_PKTIO_CHAIN_CSUM
+    if (utfe_pktio_chain_csum() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_PKTIO_CHAIN_SG
+    if (utfe_pktio_chain_sg() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
+
+
+/*
+<yaml>
+  - name: utfe_pktio_chain_iter
+    info: Walk a chained packet with pktio_pkt_iter_first/next
+    summary: one region for the CTM part and one per chained buffer
+    defs:
+        - UTFE_PKTIO_CHAIN_ITER
+</yaml>
+*/
+int32_t utfe_pktio_chain_iter(void)
+{
+    const uint32_t lens[4] = {PKT_CTM_LEN, 2048 - 256, 2048,
+                              PKT_NBI_OFFSET + PKT_LEN - 4096};
+    __gpr struct pktio_pkt_iter it;
+    __xread uint32_t rd;
+    uint32_t off = 0;
+    uint32_t i = 0;
+    int ret;
+
+    ret = pktio_pkt_iter_first(0, &it);
+    while (ret == 0) {
+        if (i >= 4 || it.len != lens[i]) {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, i);         // region
+            local_csr_write(local_csr_mailbox3, it.len);    // actual
+            return 1;
+        }
+
+        mem_read32(&rd, it.ptr, sizeof(rd));
+        if (rd != chain_word(off)) {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, off);       // offset
+            local_csr_write(local_csr_mailbox3, rd);        // actual
+            return 1;
+        }
+
+        off += it.len;
+        i++;
+        ret = pktio_pkt_iter_next(&it);
+    }
+
+    if (i != 4 || off != PKT_LEN || it.len != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, i);             // regions
+        local_csr_write(local_csr_mailbox3, off);           // actual
+        return 1;
+    }
+
+    if (pktio_pkt_iter_first(PKT_LEN, &it) != -1) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, PKT_LEN);       // offset
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_pktio_chain_ptr
+    info: Test pktio_pkt_ptr40 on a chained packet
+    summary: bytes in every buffer of the chain are found
+    defs:
+        - UTFE_PKTIO_CHAIN_PTR
+</yaml>
+*/
+int32_t utfe_pktio_chain_ptr(void)
+{
+    const uint32_t offs[8] = {0, 188, 192, 1980, 1984, 3000, 4032, 4996};
+    __xread uint32_t rd;
+    uint32_t i;
+
+    for (i = 0; i < 8; i++) {
+        mem_read32(&rd, pktio_pkt_ptr40(offs[i]), sizeof(rd));
+        if (rd != chain_word(offs[i])) {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, offs[i]);   // offset
+            local_csr_write(local_csr_mailbox2, chain_word(offs[i]));
+            local_csr_write(local_csr_mailbox3, rd);        // actual
+            return 1;
+        }
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_pktio_chain_csum
+    info: Test pktio_pkt_ones_sum on a chained packet
+    summary: sums match those of the packet in one buffer, also from odd
+             offsets, and pktio_pkt_regions refuses the packet
+    defs:
+        - UTFE_PKTIO_CHAIN_CSUM
+</yaml>
+*/
+int32_t utfe_pktio_chain_csum(void)
+{
+    const uint32_t offs[5] = {0, 14, 191, 1001, 4000};
+    __gpr struct pktio_pkt_regions r;
+    uint16_t exp, sum;
+    uint32_t i;
+
+    if (pktio_pkt_regions(0, &r) != -1) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 0);             // offset
+        return 1;
+    }
+
+    for (i = 0; i < 5; i++) {
+        sum = ones_sum_fold16(pktio_pkt_ones_sum(offs[i]));
+        exp = ones_sum_fold16(ones_sum_mem(
+            (__mem40 uint8_t *)chain_ref + offs[i], PKT_LEN - offs[i]));
+        if (sum != exp) {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, offs[i]);   // offset
+            local_csr_write(local_csr_mailbox2, exp);       // expected
+            local_csr_write(local_csr_mailbox3, sum);       // actual
+            return 1;
+        }
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_pktio_chain_sg
+    info: Test pktio_chain_bufs and pktdma_sg_chain
+    summary: a region across a buffer boundary takes one entry per buffer
+    defs:
+        - UTFE_PKTIO_CHAIN_SG
+</yaml>
+*/
+int32_t utfe_pktio_chain_sg(void)
+{
+    uint32_t ctm_addr = 0x1000;
+    int n;
+
+    if (pktio_chain_bufs(chain_bufs) != CHAIN_NUM ||
+        chain_bufs[0] != chain_handle(0) ||
+        chain_bufs[1] != chain_handle(1) ||
+        chain_bufs[2] != chain_handle(2)) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, chain_bufs[1]);
+        local_csr_write(local_csr_mailbox3, chain_bufs[2]);
+        return 1;
+    }
+
+    /* 200B from buffer offset 1984 */
+    n = pktdma_sg_chain(chain_sg, 4, chain_bufs, CHAIN_NUM, 1984, ctm_addr,
+                        200);
+    if (n != 2 ||
+        chain_sg[0].mem_addr != ((uint64_t)chain_handle(0) << 11) + 1984 ||
+        chain_sg[0].ctm_addr != ctm_addr || chain_sg[0].size != 64 ||
+        chain_sg[1].mem_addr != (uint64_t)chain_handle(1) << 11 ||
+        chain_sg[1].ctm_addr != ctm_addr + 64 || chain_sg[1].size != 136) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, n);             // entries
+        local_csr_write(local_csr_mailbox3, chain_sg[1].size);
+        return 1;
+    }
+
+    /* Past the end of the chain, and too few entries */
+    if (pktdma_sg_chain(chain_sg, 4, chain_bufs, CHAIN_NUM, 6144, ctm_addr,
+                        200) != -1 ||
+        pktdma_sg_chain(chain_sg, 1, chain_bufs, CHAIN_NUM, 1984, ctm_addr,
+                        200) != -1) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 6144);
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
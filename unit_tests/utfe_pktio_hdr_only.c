@@ -0,0 +1,289 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_bulk.h>
+#include <pkt/pkt.h>
+#include <net/csum.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/mem_bulk.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/net/libnet.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 200000
+# The step interval when running the simulator
+          stepsize: 200
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_pktio_hdr_only_ptr(void);
+int32_t utfe_pktio_hdr_only_csum(void);
+
+#ifdef ALL_TEST
+    #define UTFE_PKTIO_HDR_ONLY_PTR
+    #define UTFE_PKTIO_HDR_ONLY_CSUM
+#endif
+
+
+// these defines are needed by libpktio.c
+#define NBI_PKT_PREPEND_BYTES       0
+#define SPLIT_LENGTH                0
+#define CHANNEL_TO_TMQ(y)           (y << 3)
+#define PORT_TO_CHANNEL(x)          (x << 4)
+#define PKT_NBI_OFFSET              64
+#define PKTIO_NBI_SEQD_MAP_SEQR
+
+#include "../me/lib/modscript/libmodscript.c"
+#include "../me/lib/pkt/libpkt.c"
+#include "../me/lib/pktio/libpktio.c"
+#include "../me/lib/std/libstd.c"
+
+
+
+/* globals */
+
+/* A 600B packet in a 256B CTM buffer: 192B in CTM, 408B in MU */
+#define PKT_LEN         600
+#define PKT_CTM_LEN     (256 - PKT_NBI_OFFSET)
+#define PKT_BUF_LEN     640
+
+__export __emem __align(2048) uint32_t hdr_only_mu[2048 / 4];
+
+/* The same packet in one buffer */
+__export __emem __align(64) uint32_t hdr_only_ref[PKT_BUF_LEN / 4];
+
+
+/* Word at offset off of the test packet */
+uint32_t
+hdr_only_word(uint32_t off)
+{
+    uint32_t w = 0;
+    uint32_t i;
+
+    for (i = off; i < off + 4; i++)
+        w = (w << 8) | ((i * 7 + 3) & 0xff);
+    return w;
+}
+
+/* Build the packet split between a CTM buffer and hdr_only_mu[] */
+int
+hdr_only_pkt(void)
+{
+    __xwrite uint32_t wr[16];
+    unsigned int pnum;
+    uint32_t off, i;
+
+    pnum = pkt_ctm_alloc(&ctm_credits, __ISLAND, PKT_CTM_SIZE_256, 1, 1);
+    if (pnum == CTM_ALLOC_ERR)
+        return -1;
+
+    for (off = 0; off < PKT_BUF_LEN; off += sizeof(wr)) {
+        for (i = 0; i < 16; i++)
+            wr[i] = hdr_only_word(off + i * 4);
+
+        mem_write32(wr, &hdr_only_ref[off / 4], sizeof(wr));
+        if (off < PKT_CTM_LEN)
+            mem_write32(wr, pkt_ctm_ptr40(__ISLAND, pnum,
+                                          PKT_NBI_OFFSET + off),
+                        sizeof(wr));
+        else
+            mem_write32(wr, &hdr_only_mu[(PKT_NBI_OFFSET + off) / 4],
+                        sizeof(wr));
+    }
+
+    reg_zero((void *)pkt.__raw, sizeof(pkt));
+    pkt.p_isl = __ISLAND;
+    pkt.p_pnum = pnum;
+    pkt.p_len = PKT_LEN;
+    pkt.p_orig_len = PKT_LEN;
+    pkt.p_offset = PKT_NBI_OFFSET;
+    pkt.p_ctm_size = PKT_CTM_SIZE_256;
+    pkt.p_is_split = 1;
+    pkt.p_muptr = (uint64_t)(__mem40 void *)hdr_only_mu >> 11;
+    pkt.p_src = PKT_WIRE_PORT(0, 0);
+
+    return 0;
+}
+
+
+/* main test loop */
+void main(void)
+{
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+    if (hdr_only_pkt() != 0) {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+        for (;;)
+            ;
+    }
+
+#ifdef UTFE_PKTIO_HDR_ONLY_PTR
+    if (utfe_pktio_hdr_only_ptr() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_PKTIO_HDR_ONLY_CSUM
+    if (utfe_pktio_hdr_only_csum() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
+
+
+/*
+<yaml>
+  - name: utfe_pktio_hdr_only_ptr
+    info: Test pktio_ctm_len and pktio_pkt_ptr40 on a split packet
+    summary: bytes on both sides of the split are found
+    defs:
+        - UTFE_PKTIO_HDR_ONLY_PTR
+</yaml>
+*/
+int32_t utfe_pktio_hdr_only_ptr(void)
+{
+    const uint32_t offs[6] = {0, 100, 188, 192, 300, 596};
+    __xread uint32_t rd;
+    uint32_t i;
+
+    if (pktio_ctm_len() != PKT_CTM_LEN) {
+        // FAIL
+        local_csr_write(local_csr_mailbox3, pktio_ctm_len());   // actual
+        return 1;
+    }
+
+    for (i = 0; i < 6; i++) {
+        mem_read32(&rd, pktio_pkt_ptr40(offs[i]), sizeof(rd));
+        if (rd != hdr_only_word(offs[i])) {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, offs[i]);   // offset
+            local_csr_write(local_csr_mailbox2, hdr_only_word(offs[i]));
+            local_csr_write(local_csr_mailbox3, rd);        // actual
+            return 1;
+        }
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/*
+<yaml>
+  - name: utfe_pktio_hdr_only_csum
+    info: Test pktio_pkt_regions with ones_sum_split on a split packet
+    summary: sums match those of the packet in one buffer
+    defs:
+        - UTFE_PKTIO_HDR_ONLY_CSUM
+</yaml>
+*/
+int32_t utfe_pktio_hdr_only_csum(void)
+{
+    const uint32_t offs[5] = {0, 14, 34, 192, 250};
+    __gpr struct pktio_pkt_regions r;
+    uint16_t exp, sum;
+    uint32_t i;
+
+    for (i = 0; i < 5; i++) {
+        if (pktio_pkt_regions(offs[i], &r) != 0 ||
+            r.ctm_len + r.mu_len != PKT_LEN - offs[i]) {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, offs[i]);   // offset
+            local_csr_write(local_csr_mailbox3, r.ctm_len); // actual
+            return 1;
+        }
+
+        sum = ones_sum_fold16(ones_sum_split(r.ctm_ptr, r.ctm_len,
+                                             r.mu_ptr, r.mu_len, 0));
+        exp = ones_sum_fold16(ones_sum_mem(
+            (__mem40 uint8_t *)hdr_only_ref + offs[i], PKT_LEN - offs[i]));
+        if (sum != exp) {
+            // FAIL
+            local_csr_write(local_csr_mailbox1, offs[i]);   // offset
+            local_csr_write(local_csr_mailbox2, exp);       // expected
+            local_csr_write(local_csr_mailbox3, sum);       // actual
+            return 1;
+        }
+    }
+
+    // PASS
+    return 0;
+}
@@ -0,0 +1,345 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_bulk.h>
+#include <net/csum.h>
+#include <pkt/pkt.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/mem_bulk.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/net/libnet.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 400000
+# The step interval when running the simulator
+          stepsize: 200
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_pktio_lso_ipv4(void);
+int32_t utfe_pktio_lso_ipv6(void);
+
+#ifdef ALL_TEST
+    #define UTFE_PKTIO_LSO_IPV4
+    #define UTFE_PKTIO_LSO_IPV6
+#endif
+
+
+// these defines are needed by libpktio.c
+#define NBI_PKT_PREPEND_BYTES       0
+#define SPLIT_LENGTH                3
+#define CHANNEL_TO_TMQ(y)           (y << 3)
+#define PORT_TO_CHANNEL(x)          (x << 4)
+#define PKT_NBI_OFFSET              64
+#define PKTIO_NBI_SEQD_MAP_SEQR
+#define PKTIO_LSO_ENABLED
+
+#include "../me/lib/modscript/libmodscript.c"
+#include "../me/lib/pkt/libpkt.c"
+#include "../me/lib/pktio/libpktio.c"
+#include "../me/lib/std/libstd.c"
+
+
+/* globals */
+#define LSO_TEST_LEN    1400
+#define LSO_TEST_MSS    536
+#define LSO_TEST_SEQ    0x11223344
+#define LSO_TEST_ID     0x1234
+#define LSO_TEST_FLAGS  0x18    /* ACK, PSH */
+
+/*
+ * Ethernet, IPv4 and TCP headers of a 1400B packet, followed by the 2
+ * bytes of the data pattern that share their last word.
+ */
+#define LSO_IPV4_HDR_LEN    54
+const uint32_t lso_ipv4_hdr[] = {
+    0x02000000, 0x00020200, 0x00000001, 0x08004500,
+    0x056a1234, 0x40004006, 0x0f580a00, 0x00010a00,
+    0x00021388, 0x13891122, 0x33440000, 0x00005018,
+    0xffff0000, 0x00003637};
+
+/* Ethernet, IPv6 and TCP headers of a 1400B packet, as above */
+#define LSO_IPV6_HDR_LEN    74
+const uint32_t lso_ipv6_hdr[] = {
+    0x02000000, 0x00020200, 0x00000001, 0x86dd6000,
+    0x00000542, 0x06402001, 0x0db80000, 0x00000000,
+    0x00000000, 0x00012001, 0x0db80000, 0x00000000,
+    0x00000000, 0x00021388, 0x13891122, 0x33440000,
+    0x00005018, 0xffff0000, 0x00004a4b};
+
+
+/* The word at offset off of the packet data pattern */
+uint32_t
+lso_test_pattern(uint32_t off)
+{
+    return ((off & 0xff) << 24) | (((off + 1) & 0xff) << 16) |
+           (((off + 2) & 0xff) << 8) | ((off + 3) & 0xff);
+}
+
+
+/* Receive a packet with the data pattern and the given headers into the
+ * global packet metadata */
+int
+lso_test_pkt(const uint32_t *hdr, uint32_t hdr_words)
+{
+    __xwrite uint32_t wr[16];
+    unsigned int pnum;
+    uint32_t off;
+    uint32_t i;
+
+    pnum = pkt_ctm_alloc(&ctm_credits, __ISLAND, PKT_CTM_SIZE_2048, 1, 1);
+    if (pnum == CTM_ALLOC_ERR)
+        return -1;
+
+    for (off = 0; off < LSO_TEST_LEN; off += sizeof(wr)) {
+        for (i = 0; i < 16; i++)
+            wr[i] = lso_test_pattern(off + i * 4);
+        mem_write32(wr, pkt_ctm_ptr40(__ISLAND, pnum, PKT_NBI_OFFSET + off),
+                    sizeof(wr));
+    }
+    for (i = 0; i < hdr_words; i++) {
+        wr[0] = hdr[i];
+        mem_write32(wr, pkt_ctm_ptr40(__ISLAND, pnum, PKT_NBI_OFFSET + i * 4),
+                    4);
+    }
+
+    reg_zero((void *)pkt.__raw, sizeof(pkt));
+    pkt.p_isl = __ISLAND;
+    pkt.p_pnum = pnum;
+    pkt.p_len = LSO_TEST_LEN;
+    pkt.p_orig_len = LSO_TEST_LEN;
+    pkt.p_offset = PKT_NBI_OFFSET;
+    pkt.p_ctm_size = PKT_CTM_SIZE_2048;
+    pkt.p_src = PKT_NOTX;
+    /* Keep the segments in CTM for inspection */
+    pkt.p_dst = PKT_NOTX;
+
+    return 0;
+}
+
+
+/*
+ * Check the last segment, left in the global packet metadata by
+ * pktio_tx_lso().  Returns 0 or the number of the failed check.
+ */
+int32_t
+lso_test_check(uint32_t l3_off, uint32_t l4_off, uint32_t hdr_len,
+               uint32_t is_ipv4)
+{
+    __xread uint32_t rd[2];
+    __mem40 uint8_t *seg;
+    uint32_t pay_len, seg_len, nsegs;
+    uint32_t pay_off;
+    uint32_t sum;
+    uint32_t off;
+
+    /* Payload and number of segments of the original */
+    pay_len = LSO_TEST_LEN - hdr_len;
+    nsegs = 1;
+    while (pay_len > LSO_TEST_MSS) {
+        pay_len -= LSO_TEST_MSS;
+        nsegs++;
+    }
+    pay_off = hdr_len + (nsegs - 1) * LSO_TEST_MSS;
+    seg_len = hdr_len + pay_len;
+
+    if (pkt.p_len != seg_len || pkt.p_muptr != 0)
+        return 1;
+    seg = pkt_ctm_ptr40(pkt.p_isl, pkt.p_pnum, pkt.p_offset);
+
+    mem_read32(rd, seg + l3_off, sizeof(rd));
+    if (is_ipv4) {
+        if ((rd[0] & 0xffff) != seg_len - l3_off ||
+            (rd[1] >> 16) != LSO_TEST_ID + nsegs - 1)
+            return 2;
+        if (ones_sum_fold16(ones_sum_mem(seg + l3_off, 20)) != 0xffff)
+            return 3;
+        sum = ones_sum_mem(seg + l3_off + 12, 8);
+    } else {
+        if ((rd[1] >> 16) != seg_len - l3_off - 40)
+            return 2;
+        sum = ones_sum_mem(seg + l3_off + 8, 32);
+    }
+
+    /* Sequence number and flags, PSH is kept on the last segment */
+    mem_read32(rd, seg + l4_off + 4, 4);
+    if (rd[0] != LSO_TEST_SEQ + (nsegs - 1) * LSO_TEST_MSS)
+        return 4;
+    mem_read32(rd, seg + l4_off + 12, 4);
+    if (((rd[0] >> 16) & 0xff) != LSO_TEST_FLAGS)
+        return 5;
+
+    sum = ones_sum_add(sum, NET_IP_PROTO_TCP + seg_len - l4_off);
+    sum = ones_sum_add(sum, ones_sum_mem(seg + l4_off, seg_len - l4_off));
+    if (ones_sum_fold16(sum) != 0xffff)
+        return 6;
+
+    for (off = hdr_len; off + 4 <= seg_len; off += 4) {
+        mem_read32(rd, seg + off, 4);
+        if (rd[0] != lso_test_pattern(off - hdr_len + pay_off))
+            return 7;
+    }
+
+    return 0;
+}
+
+
+int32_t
+lso_test(const uint32_t *hdr, uint32_t hdr_words, uint32_t l3_off,
+         uint32_t l4_off, uint32_t hdr_len, uint32_t is_ipv4)
+{
+    int32_t ret;
+
+    if (lso_test_pkt(hdr, hdr_words) != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 0xffffffff);
+        return 1;
+    }
+
+    ret = pktio_tx_lso(l3_off, l4_off, LSO_TEST_MSS);
+    if (ret != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, 0);     // check
+        local_csr_write(local_csr_mailbox3, ret);   // actual
+        return 1;
+    }
+
+    ret = lso_test_check(l3_off, l4_off, hdr_len, is_ipv4);
+    if (ret != 0) {
+        // FAIL
+        local_csr_write(local_csr_mailbox1, ret);   // check
+        return 1;
+    }
+
+    // PASS
+    return 0;
+}
+
+
+/* main test loop */
+void main(void)
+{
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+#ifdef UTFE_PKTIO_LSO_IPV4
+    if (utfe_pktio_lso_ipv4() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+#ifdef UTFE_PKTIO_LSO_IPV6
+    if (utfe_pktio_lso_ipv6() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
+
+
+/*
+<yaml>
+  - name: utfe_pktio_lso_ipv4
+    info: Segment a 1400B IPv4/TCP packet with pktio_tx_lso
+    summary: lengths, IP ID, TCP seq and flags, checksums and payload of the last segment
+    defs:
+        - UTFE_PKTIO_LSO_IPV4
+</yaml>
+*/
+int32_t utfe_pktio_lso_ipv4(void)
+{
+    return lso_test(lso_ipv4_hdr, sizeof(lso_ipv4_hdr) / 4, 14, 34,
+                    LSO_IPV4_HDR_LEN, 1);
+}
+
+
+/*
+<yaml>
+  - name: utfe_pktio_lso_ipv6
+    info: Segment a 1400B IPv6/TCP packet with pktio_tx_lso
+    summary: payload length, TCP seq and flags, checksum and payload of the last segment
+    defs:
+        - UTFE_PKTIO_LSO_IPV6
+</yaml>
+*/
+int32_t utfe_pktio_lso_ipv6(void)
+{
+    return lso_test(lso_ipv6_hdr, sizeof(lso_ipv6_hdr) / 4, 14, 54,
+                    LSO_IPV6_HDR_LEN, 0);
+}
@@ -0,0 +1,269 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_bulk.h>
+#include <pkt/pkt.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/mem_bulk.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 400000
+# The step interval when running the simulator
+          stepsize: 200
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_pktio_replicate_bench(void);
+
+#ifdef ALL_TEST
+    #define UTFE_PKTIO_REPLICATE_BENCH
+#endif
+
+
+// these defines are needed by libpktio.c
+#define NBI_PKT_PREPEND_BYTES       0
+#define SPLIT_LENGTH                3
+#define CHANNEL_TO_TMQ(y)           (y << 3)
+#define PORT_TO_CHANNEL(x)          (x << 4)
+#define PKT_NBI_OFFSET              64
+#define PKTIO_NBI_SEQD_MAP_SEQR
+#define PKTIO_REPL_ENABLED
+
+#include "../me/lib/modscript/libmodscript.c"
+#include "../me/lib/pkt/libpkt.c"
+#include "../me/lib/pktio/libpktio.c"
+#include "../me/lib/std/libstd.c"
+
+
+
+/* globals */
+#define BENCH_ITER      4
+#define BENCH_SIZES     3
+#define BENCH_MODES     2
+#define BENCH_COPIES    8
+
+/* Replication groups: every entry mirrors, or every entry rewrites the
+ * first 8B of the Ethernet header (destination and part of the source
+ * address) */
+#define BENCH_MODE_MIRROR   0
+#define BENCH_MODE_REWRITE  1
+
+__export __emem __align(64)
+    struct pktio_repl_dst repl_bench_grp[BENCH_MODES][BENCH_COPIES];
+
+/*
+ * Benchmark results, readable with nfp-rtsym after the test has run.
+ * For each frame size and mode: the size, the mode, ME cycles per copy and
+ * thousands of copies/s for one context of an ME clocked at 1 GHz.
+ * Mirrors are sent from the original's buffers, rewritten entries get
+ * copies in their own.  No figures have been recorded yet, the test has
+ * not been run; user/tools/repl_model estimates the same groups.
+ */
+__export __emem uint32_t repl_bench_res[BENCH_SIZES * BENCH_MODES * 4];
+
+const uint32_t bench_sizes[BENCH_SIZES] = {64, 512, 1500};
+const uint32_t bench_ctm_size[BENCH_SIZES] = {
+    PKT_CTM_SIZE_256, PKT_CTM_SIZE_1024, PKT_CTM_SIZE_2048};
+
+
+void
+repl_bench_grp_init(void)
+{
+    __xwrite uint32_t wr[4];
+    uint32_t i;
+
+    for (i = 0; i < BENCH_COPIES; i++) {
+        wr[0] = PKT_WIRE_PORT(0, i) << 16;
+        mem_write32(wr, &repl_bench_grp[BENCH_MODE_MIRROR][i], 4);
+
+        /* hdr_off 0, hdr_len 8 */
+        wr[0] = (PKT_WIRE_PORT(0, i) << 16) | 8;
+        wr[1] = 0x02000000 | i;
+        wr[2] = 0x00010000;
+        mem_write32(wr, &repl_bench_grp[BENCH_MODE_REWRITE][i], 12);
+    }
+}
+
+
+/* Receive a fresh packet into the global packet metadata */
+int
+repl_bench_pkt(uint32_t size, uint32_t ctm_size)
+{
+    __xwrite uint32_t wr[16];
+    unsigned int pnum;
+    uint32_t off;
+    uint32_t i;
+
+    pnum = pkt_ctm_alloc(&ctm_credits, __ISLAND, ctm_size, 1, 1);
+    if (pnum == CTM_ALLOC_ERR)
+        return -1;
+
+    for (i = 0; i < 16; i++)
+        wr[i] = 0x01020304 * i;
+    for (off = PKT_NBI_OFFSET; off < PKT_NBI_OFFSET + size; off += 64)
+        mem_write32(wr, pkt_ctm_ptr40(__ISLAND, pnum, off), sizeof(wr));
+
+    reg_zero((void *)pkt.__raw, sizeof(pkt));
+    pkt.p_isl = __ISLAND;
+    pkt.p_pnum = pnum;
+    pkt.p_len = size;
+    pkt.p_orig_len = size;
+    pkt.p_offset = PKT_NBI_OFFSET;
+    pkt.p_ctm_size = ctm_size;
+    pkt.p_src = PKT_WIRE_PORT(0, 0);
+
+    return 0;
+}
+
+
+/* main test loop */
+void main(void)
+{
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    repl_bench_grp_init();
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+#ifdef UTFE_PKTIO_REPLICATE_BENCH
+    if (utfe_pktio_replicate_bench() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
+
+
+/*
+<yaml>
+  - name: utfe_pktio_replicate_bench
+    info: Benchmark pktio_tx_replicate for 64B, 512B and 1500B frames
+    summary: cycles per copy and copies/s of mirrored and rewritten copies
+    defs:
+        - UTFE_PKTIO_REPLICATE_BENCH
+</yaml>
+*/
+int32_t utfe_pktio_replicate_bench(void)
+{
+    __xwrite uint32_t res[4];
+    uint64_t t0;
+    uint64_t t_repl;
+    uint32_t cyc;
+    uint32_t size;
+    uint32_t mode;
+    uint32_t i, j;
+    int ret;
+
+    for (i = 0; i < BENCH_SIZES; i++) {
+        size = bench_sizes[i];
+
+        for (mode = 0; mode < BENCH_MODES; mode++) {
+            t_repl = 0;
+            for (j = 0; j < BENCH_ITER; j++) {
+                if (repl_bench_pkt(size, bench_ctm_size[i]) != 0) {
+                    // FAIL
+                    local_csr_write(local_csr_mailbox1, size);  // length
+                    return 1;
+                }
+
+                t0 = me_tsc_read();
+                ret = pktio_tx_replicate(repl_bench_grp[mode], BENCH_COPIES);
+                t_repl += me_tsc_read() - t0;
+
+                if (ret != 0) {
+                    // FAIL
+                    local_csr_write(local_csr_mailbox1, size);  // length
+                    local_csr_write(local_csr_mailbox2, mode);  // mode
+                    local_csr_write(local_csr_mailbox3, ret);   // actual
+                    return 1;
+                }
+            }
+
+            // the timestamp counter increments every 16 ME cycles
+            cyc = (uint32_t)((t_repl * 16) / (BENCH_ITER * BENCH_COPIES));
+            res[0] = size;
+            res[1] = mode;
+            res[2] = cyc;
+            res[3] = 1000000 / (cyc ? cyc : 1);
+            mem_write32(res, &repl_bench_res[(i * BENCH_MODES + mode) * 4],
+                        sizeof(res));
+        }
+    }
+
+    // PASS
+    return 0;
+}
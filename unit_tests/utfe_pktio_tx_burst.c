@@ -0,0 +1,267 @@
+#include <nfp.h>
+#include <assert.h>
+#include <stdint.h>
+#include <nfp/me.h>
+#include <nfp/mem_bulk.h>
+#include <pkt/pkt.h>
+
+
+/*
+<yaml>
+tests:
+# common defines used for all tests, unless overwritten within the test itself
+  - name: defaults
+# Assembler or compiler flags
+    flags:
+        - -chip nfp-6xxx
+        - -Qrevision_min=0
+        - <-O1, -O2, -Od> -ng
+        - -Ob1 -W3
+        - -Qbigendian -Qnctx=8 -Qspill=1 -Qnctx_mode=8 -Qnn_mode=0 -Qlm_start=0
+        - -Zi
+# Assembler or compiler includes
+    inc:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/include
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/include/
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/
+# Additional files used when compiling microc
+    cfiles:
+        - $TOOLCHAIN_INC_DIR/standardlibrary/microc/src/rtl.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/mem_bulk.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/_c/me.c
+        - $TOOLCHAIN_INC_DIR/flowenv-ng.hg/me/lib/nfp/libnfp.c
+# Linker flags
+    nfld_flags:
+        - -chip nfp-6xxx
+        - -g
+# Linker assignment of list file to ME
+    nfld_list:
+        - i32.me4:$FNAME.list
+# Linker name of nffw (elf) file to generate
+    nfld_elf: -elf64 $FNAME.nffw
+# Simulation options
+    sim:
+        - meids:
+            - mei0.me4:-1
+# Total number of steps to run the simulator
+          run: 600000
+# The step interval when running the simulator
+          stepsize: 200
+# The expected result of running a test
+    expected_result: True
+</yaml>
+*/
+
+
+
+/* prototypes */
+
+int32_t utfe_pktio_tx_burst_bench(void);
+
+#ifdef ALL_TEST
+    #define UTFE_PKTIO_TX_BURST_BENCH
+#endif
+
+
+// these defines are needed by libpktio.c
+#define NBI_PKT_PREPEND_BYTES       0
+#define SPLIT_LENGTH                3
+#define CHANNEL_TO_TMQ(y)           (y << 3)
+#define PORT_TO_CHANNEL(x)          (x << 4)
+#define PKT_NBI_OFFSET              64
+#define PKTIO_NBI_SEQD_MAP_SEQR
+#define PKTIO_TX_BURST_ENABLED
+
+#include "../me/lib/modscript/libmodscript.c"
+#include "../me/lib/pkt/libpkt.c"
+#include "../me/lib/pktio/libpktio.c"
+#include "../me/lib/std/libstd.c"
+
+
+
+/* globals */
+#define BENCH_ITER      4
+#define BENCH_BURSTS    3
+#define BENCH_MAX       8
+#define BENCH_SIZE      64
+
+__shared __lmem struct pktio_meta bench_pkts[BENCH_MAX];
+
+/*
+ * Benchmark results, readable with nfp-rtsym after the test has run.
+ * For each burst size: the burst size, ME cycles per packet sending the
+ * packets one by one with pktio_tx(), ME cycles per packet with
+ * pktio_tx_burst() and the saving in percent.  No figures have been
+ * recorded yet, the test has not been run.  user/tools/tx_burst_model
+ * gives modelled figures for the same bursts.
+ */
+__export __emem uint32_t tx_burst_bench_res[BENCH_BURSTS * 4];
+
+const uint32_t bench_bursts[BENCH_BURSTS] = {1, 4, 8};
+
+
+/* Receive fresh packets into bench_pkts[] */
+int
+tx_burst_bench_pkts(uint32_t num)
+{
+    __xwrite uint32_t wr[16];
+    unsigned int pnum;
+    uint32_t i, j;
+
+    for (i = 0; i < 16; i++)
+        wr[i] = 0x01020304 * i;
+
+    for (j = 0; j < num; j++) {
+        pnum = pkt_ctm_alloc(&ctm_credits, __ISLAND, PKT_CTM_SIZE_256, 1, 1);
+        if (pnum == CTM_ALLOC_ERR)
+            return -1;
+
+        mem_write32(wr, pkt_ctm_ptr40(__ISLAND, pnum, PKT_NBI_OFFSET),
+                    sizeof(wr));
+
+        reg_zero((void *)pkt.__raw, sizeof(pkt));
+        pkt.p_isl = __ISLAND;
+        pkt.p_pnum = pnum;
+        pkt.p_len = BENCH_SIZE;
+        pkt.p_orig_len = BENCH_SIZE;
+        pkt.p_offset = PKT_NBI_OFFSET;
+        pkt.p_ctm_size = PKT_CTM_SIZE_256;
+        /* Not from the wire, so that the NBI metadata is written too */
+        pkt.p_src = PKT_NOTX;
+        pkt.p_dst = PKT_WIRE_PORT(0, j);
+        bench_pkts[j] = pkt;
+    }
+
+    return 0;
+}
+
+
+/* main test loop */
+void main(void)
+{
+    uint32_t tests_passed = 0;
+    uint32_t tests_failed = 0;
+
+    // only one context
+    if ( ctx() != 0)
+    {
+        return;
+    }
+
+    // write non-zero value to mailbox0, this to detect if a function does not return
+    // if a function is aborted then all 4 mailboxes have value 0 (specific for non-nti test)
+    local_csr_write(local_csr_mailbox0, 2);     // ERROR
+    local_csr_write(local_csr_mailbox1, 0);
+    local_csr_write(local_csr_mailbox2, 0);
+    local_csr_write(local_csr_mailbox3, 0);
+
+#ifdef UTFE_PKTIO_TX_BURST_BENCH
+    if (utfe_pktio_tx_burst_bench() == 0) {
+        tests_passed++;
+    }  else {
+        tests_failed++;
+    }
+#endif
+
+    /* Use the mailboxes to indicate results from running the test
+    * Mailbox0 = 0 for a Pass, else indicates a error condition
+    */
+    if (tests_failed == 0)
+    {
+        local_csr_write(local_csr_mailbox0, 0);     // OK
+    } else {
+        local_csr_write(local_csr_mailbox0, 1);     // ERROR
+    }
+
+#ifdef ALL_TEST
+    local_csr_write(local_csr_mailbox2, tests_passed);                  // number of test passed
+    local_csr_write(local_csr_mailbox3, tests_failed + tests_passed);   // number of test excuted
+#endif
+
+    for (;;)
+        ;
+}
+
+
+/*
+<yaml>
+  - name: utfe_pktio_tx_burst_bench
+    info: Benchmark pktio_tx_burst against pktio_tx for 1, 4 and 8 packets
+    summary: cycles per packet sent one by one and in a burst
+    defs:
+        - UTFE_PKTIO_TX_BURST_BENCH
+</yaml>
+*/
+int32_t utfe_pktio_tx_burst_bench(void)
+{
+    __xwrite uint32_t res[4];
+    uint64_t t0;
+    uint64_t t_single, t_burst;
+    uint32_t cyc_single, cyc_burst;
+    uint32_t num;
+    uint32_t i, j, k;
+    int ret;
+
+    for (i = 0; i < BENCH_BURSTS; i++) {
+        num = bench_bursts[i];
+        t_single = 0;
+        t_burst = 0;
+
+        for (j = 0; j < BENCH_ITER; j++) {
+            /* One by one */
+            if (tx_burst_bench_pkts(num) != 0) {
+                // FAIL
+                local_csr_write(local_csr_mailbox1, num);   // burst
+                return 1;
+            }
+
+            t0 = me_tsc_read();
+            for (k = 0; k < num; k++) {
+                pkt = bench_pkts[k];
+                ret = pktio_tx();
+                if (ret != 0)
+                    break;
+            }
+            t_single += me_tsc_read() - t0;
+
+            if (ret != 0) {
+                // FAIL
+                local_csr_write(local_csr_mailbox1, num);   // burst
+                local_csr_write(local_csr_mailbox3, ret);   // actual
+                return 1;
+            }
+
+            /* Burst */
+            if (tx_burst_bench_pkts(num) != 0) {
+                // FAIL
+                local_csr_write(local_csr_mailbox1, num);   // burst
+                return 1;
+            }
+
+            t0 = me_tsc_read();
+            ret = pktio_tx_burst(bench_pkts, num);
+            t_burst += me_tsc_read() - t0;
+
+            if (ret != 0) {
+                // FAIL
+                local_csr_write(local_csr_mailbox1, num);   // burst
+                local_csr_write(local_csr_mailbox2, 1);     // burst mode
+                local_csr_write(local_csr_mailbox3, ret);   // actual
+                return 1;
+            }
+        }
+
+        // the timestamp counter increments every 16 ME cycles
+        cyc_single = (uint32_t)((t_single * 16) / (BENCH_ITER * num));
+        cyc_burst = (uint32_t)((t_burst * 16) / (BENCH_ITER * num));
+        res[0] = num;
+        res[1] = cyc_single;
+        res[2] = cyc_burst;
+        res[3] = (cyc_single > cyc_burst) ?
+            ((cyc_single - cyc_burst) * 100) / cyc_single : 0;
+        mem_write32(res, &tx_burst_bench_res[i * 4], sizeof(res));
+    }
+
+    // PASS
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_blm_stat.c
+ * @brief         Host side of the BLM stats, buffer accounting and tags.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nfp_blm_stat.h"
+
+/* Tags read at a time by nfp_blm_dbg_scan() */
+#define BLM_DBG_SCAN_CHUNK      4096
+
+#define TAG_GEN_MASK            0x7fffffff
+
+static uint64_t
+get64(const uint32_t *words)
+{
+    return ((uint64_t)words[1] << 32) | words[0];
+}
+
+void
+nfp_blm_stat_decode(const uint32_t *words, struct nfp_blm_blq_stat *bs)
+{
+    unsigned int i;
+
+    memset(bs, 0, sizeof(*bs));
+    for (i = 0; i < NFP_BLM_NUM_CNTRS; i++)
+        bs->cntr[i] = get64(&words[i * 2]);
+    bs->total = get64(&words[NFP_BLM_POOL_TOTAL * 2]);
+    bs->free = get64(&words[NFP_BLM_POOL_FREE * 2]);
+    bs->free_min = get64(&words[NFP_BLM_POOL_FREE_MIN * 2]);
+    bs->free_max = get64(&words[NFP_BLM_POOL_FREE_MAX * 2]);
+    bs->low_events = get64(&words[NFP_BLM_POOL_LOW_EVNTS * 2]);
+    /* The highest sample is written with the first */
+    bs->sampled = bs->free_max != 0;
+}
+
+int
+nfp_blm_stat_read(const struct nfp_blm_stat_io *io, unsigned int island,
+                  struct nfp_blm_stat *st)
+{
+    uint32_t words[NFP_BLM_STATS_LW];
+    char name[64];
+    unsigned int blq;
+
+    memset(st, 0, sizeof(*st));
+    st->island = island;
+    for (blq = 0; blq < NFP_BLM_NUM_BLQ; blq++) {
+        snprintf(name, sizeof(name), NFP_BLM_STATS_SYM_FMT, island, blq);
+        if (io->read(io->priv, name, words, sizeof(words), 0) < 0)
+            return -1;
+        nfp_blm_stat_decode(words, &st->blq[blq]);
+    }
+    return 0;
+}
+
+uint64_t
+nfp_blm_in_use(const struct nfp_blm_blq_stat *bs)
+{
+    if (!bs->sampled || bs->free > bs->total)
+        return 0;
+    return bs->total - bs->free;
+}
+
+uint64_t
+nfp_blm_in_use_hwm(const struct nfp_blm_blq_stat *bs)
+{
+    if (!bs->sampled || bs->free_min > bs->total)
+        return 0;
+    return bs->total - bs->free_min;
+}
+
+uint64_t
+nfp_blm_in_use_lwm(const struct nfp_blm_blq_stat *bs)
+{
+    if (!bs->sampled || bs->free_max > bs->total)
+        return 0;
+    return bs->total - bs->free_max;
+}
+
+int
+nfp_blm_dbg_err_read(const struct nfp_blm_stat_io *io,
+                     struct nfp_blm_dbg_err *err)
+{
+    uint32_t words[4];
+
+    memset(err, 0, sizeof(*err));
+    if (io->read(io->priv, NFP_BLM_DBG_ERR_SYM, words, sizeof(words), 0) < 0)
+        return -1;
+    err->double_frees = words[0];
+    err->last_handle = words[1];
+    err->last_blq = words[2];
+    err->last_tag = words[3];
+    return 0;
+}
+
+int
+nfp_blm_dbg_next_gen(const struct nfp_blm_stat_io *io, uint32_t *gen)
+{
+    uint32_t g;
+
+    if (io->read(io->priv, NFP_BLM_DBG_GEN_SYM, &g, sizeof(g), 0) < 0)
+        return -1;
+    /* Skip 0, the generation of the untagged buffers */
+    g = (g + 1) & TAG_GEN_MASK;
+    if (g == 0)
+        g = 1;
+    if (io->write(io->priv, NFP_BLM_DBG_GEN_SYM, &g, sizeof(g), 0) < 0)
+        return -1;
+    *gen = g;
+    return 0;
+}
+
+uint32_t
+nfp_blm_dbg_tag_age(uint32_t tag, uint32_t gen)
+{
+    return (gen - (tag >> NFP_BLM_DBG_TAG_GEN_SHF)) & TAG_GEN_MASK;
+}
+
+unsigned int
+nfp_blm_dbg_age_bucket(uint32_t age)
+{
+    unsigned int b = 0;
+
+    while (age != 0 && b < NFP_BLM_DBG_AGE_NBUCKETS - 1) {
+        age >>= 1;
+        b++;
+    }
+    return b;
+}
+
+void
+nfp_blm_dbg_scan_tags(const uint32_t *tags, size_t n, uint32_t gen,
+                      struct nfp_blm_dbg_scan *sc)
+{
+    size_t i;
+
+    sc->gen = gen;
+    for (i = 0; i < n; i++) {
+        if (tags[i] == 0)
+            sc->untagged++;
+        else if (tags[i] & NFP_BLM_DBG_TAG_FREE)
+            sc->free++;
+        else {
+            sc->out++;
+            sc->age[nfp_blm_dbg_age_bucket(
+                nfp_blm_dbg_tag_age(tags[i], gen))]++;
+        }
+    }
+}
+
+int
+nfp_blm_dbg_scan(const struct nfp_blm_stat_io *io, uint32_t min_age,
+                 void (*report)(void *priv, uint32_t key, uint32_t tag),
+                 void *priv, struct nfp_blm_dbg_scan *sc)
+{
+    uint32_t cfg[2];
+    uint32_t *tags;
+    size_t num_tags, off, n, i;
+
+    memset(sc, 0, sizeof(*sc));
+    if (io->read(io->priv, NFP_BLM_DBG_GEN_SYM, cfg, sizeof(cfg), 0) < 0)
+        return -1;
+    if (cfg[1] == 0 || cfg[1] > NFP_BLM_DBG_MAX_KEY_BITS)
+        return -1;
+    num_tags = (size_t)1 << cfg[1];
+
+    tags = malloc(BLM_DBG_SCAN_CHUNK * sizeof(*tags));
+    if (!tags)
+        return -1;
+    for (off = 0; off < num_tags; off += n) {
+        n = num_tags - off;
+        if (n > BLM_DBG_SCAN_CHUNK)
+            n = BLM_DBG_SCAN_CHUNK;
+        if (io->read(io->priv, NFP_BLM_DBG_TAGS_SYM, tags,
+                     n * sizeof(*tags), off * sizeof(*tags)) < 0) {
+            free(tags);
+            return -1;
+        }
+        nfp_blm_dbg_scan_tags(tags, n, cfg[0], sc);
+        if (!report)
+            continue;
+        for (i = 0; i < n; i++) {
+            if (tags[i] != 0 && !(tags[i] & NFP_BLM_DBG_TAG_FREE) &&
+                nfp_blm_dbg_tag_age(tags[i], cfg[0]) >= min_age)
+                report(priv, off + i, tags[i]);
+        }
+    }
+    free(tags);
+    sc->gen = cfg[0];
+    return 0;
+}
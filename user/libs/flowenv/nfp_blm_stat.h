@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_blm_stat.h
+ * @brief         Host side of the BLM stats, buffer accounting and tags.
+ *
+ * The layouts below mirror BLQ_STATS_OFFSETS (me/blocks/blm/_h/
+ * blm_internal.h) and the buffer debugging symbols of blm_main.uc, see
+ * "Buffer accounting" and "Buffer debugging" in me/blocks/blm/blm_cfg.h.
+ * The symbols are accessed through a struct nfp_blm_stat_io, so the
+ * decoding can be run against memory without the NFP BSP.
+ */
+#ifndef _LIBS_FLOWENV__NFP_BLM_STAT_H_
+#define _LIBS_FLOWENV__NFP_BLM_STAT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Island scope stats symbol of a BLQ, with the island of the BLM */
+#define NFP_BLM_STATS_SYM_FMT       "i%u.CTM_NBI_BLQ%u_STATS_BASE"
+#define NFP_BLM_DBG_TAGS_SYM        "_blm_dbg_tags"
+#define NFP_BLM_DBG_GEN_SYM         "_blm_dbg_gen"
+#define NFP_BLM_DBG_ERR_SYM         "_blm_dbg_err"
+
+#define NFP_BLM_NUM_BLQ             4
+#define NFP_BLM_STATS_LW            64      /* BLQ_STATS_SIZE */
+
+/* 64-bit counters of BLQ_STATS_OFFSETS, in units of 8 bytes */
+enum nfp_blm_cntr {
+    NFP_BLM_CACHE_REFILLS = 0,
+    NFP_BLM_EMU_RING_UNDERFLOW,
+    NFP_BLM_RECYCLE_DIRECT,
+    NFP_BLM_RECYCLE_TM_TO_EMU,
+    NFP_BLM_RECYCLE_TM_TO_CACHE,
+    NFP_BLM_RECYCLE_CACHE_TO_DMA,
+    NFP_BLM_RECYCLE_CACHE_LOW,
+    NFP_BLM_NUM_DMA_EVNTS_RCVD,
+    NFP_BLM_NUM_TM_EVNTS_RCVD,
+    NFP_BLM_DMA_NULL_RECYCLE,
+    NFP_BLM_TM_NULL_RECYCLE,
+    NFP_BLM_NUM_ALARMS,
+    NFP_BLM_NUM_CNTRS
+};
+
+#define NFP_BLM_POOL_TOTAL          16
+#define NFP_BLM_POOL_FREE           17
+#define NFP_BLM_POOL_FREE_MIN       18
+#define NFP_BLM_POOL_FREE_MAX       19
+#define NFP_BLM_POOL_LOW_EVNTS      20
+
+#define NFP_BLM_DBG_TAG_FREE        1       /* BLM_DBG_TAG_FREE */
+#define NFP_BLM_DBG_TAG_GEN_SHF     1       /* BLM_DBG_TAG_GEN_shf */
+#define NFP_BLM_DBG_MAX_KEY_BITS    24
+#define NFP_BLM_DBG_AGE_NBUCKETS    16
+
+/**
+ * Stats and buffer accounting of a BLQ.  The watermarks are those of the
+ * free buffers, which the in-use ones mirror.
+ */
+struct nfp_blm_blq_stat {
+    uint64_t cntr[NFP_BLM_NUM_CNTRS];   /* enum nfp_blm_cntr */
+    uint64_t total;         /* Buffers configured for the BLQ */
+    uint64_t free;          /* In the EMU ring and BLM cache, last sample */
+    uint64_t free_min;      /* Lowest sample */
+    uint64_t free_max;      /* Highest sample */
+    uint64_t low_events;    /* Low pool events sent */
+    int sampled;            /* Seen with a free buffer, since loaded */
+};
+
+/**
+ * Snapshot of the BLQs of a BLM instance.
+ */
+struct nfp_blm_stat {
+    unsigned int island;
+    struct nfp_blm_blq_stat blq[NFP_BLM_NUM_BLQ];
+};
+
+/**
+ * Buffer debugging errors, struct blm_dbg_err of me/blocks/blm/blm.h.
+ */
+struct nfp_blm_dbg_err {
+    uint32_t double_frees;
+    uint32_t last_handle;
+    uint32_t last_blq;
+    uint32_t last_tag;
+};
+
+/**
+ * Census of the buffer tags.  A buffer is out if its FREE bit is clear
+ * and it has been tagged at all; its age is the number of generations
+ * since it was last allocated or freed by the application.
+ */
+struct nfp_blm_dbg_scan {
+    uint32_t gen;           /* Generation of the scan */
+    uint64_t untagged;      /* Never allocated or freed since loaded */
+    uint64_t free;          /* In an EMU ring or a magazine */
+    uint64_t out;           /* Tagged and not free */
+    uint64_t age[NFP_BLM_DBG_AGE_NBUCKETS];     /* Out buffers by age */
+};
+
+/**
+ * Access to the run time symbols, as 32-bit words in host byte order.
+ */
+struct nfp_blm_stat_io {
+    int (*read)(void *priv, const char *sym, uint32_t *words,
+                size_t len, uint64_t off);
+    int (*write)(void *priv, const char *sym, const uint32_t *words,
+                 size_t len, uint64_t off);
+    void *priv;
+};
+
+/**
+ * Take a snapshot of the BLQs of the BLM running in an island.
+ *
+ * @param io        [in] Symbol access
+ * @param island    [in] Island of the BLM instance
+ * @param st        [out] Snapshot
+ *
+ * @return 0 on success, -1 on an access error.
+ */
+int nfp_blm_stat_read(const struct nfp_blm_stat_io *io, unsigned int island,
+                      struct nfp_blm_stat *st);
+
+/**
+ * Decode the stats of a BLQ.
+ *
+ * @param words     [in] NFP_BLM_STATS_LW words of CTM_NBI_BLQx_STATS_BASE
+ * @param bs        [out] The BLQ stats
+ */
+void nfp_blm_stat_decode(const uint32_t *words, struct nfp_blm_blq_stat *bs);
+
+/**
+ * Buffers in use:  now, at the highest and at the lowest.  0 if the BLQ
+ * has not been sampled.
+ */
+uint64_t nfp_blm_in_use(const struct nfp_blm_blq_stat *bs);
+uint64_t nfp_blm_in_use_hwm(const struct nfp_blm_blq_stat *bs);
+uint64_t nfp_blm_in_use_lwm(const struct nfp_blm_blq_stat *bs);
+
+/**
+ * Read the buffer debugging errors.
+ *
+ * @return 0 on success, -1 if the firmware is built without
+ * BLM_BUF_DEBUG or on an access error.
+ */
+int nfp_blm_dbg_err_read(const struct nfp_blm_stat_io *io,
+                         struct nfp_blm_dbg_err *err);
+
+/**
+ * Advance the generation of the buffer tags.
+ *
+ * @param gen       [out] The new generation
+ *
+ * @return 0 on success, -1 on an access error.
+ */
+int nfp_blm_dbg_next_gen(const struct nfp_blm_stat_io *io, uint32_t *gen);
+
+/**
+ * Count the buffer tags of a table.
+ *
+ * @param tags      [in] Tags
+ * @param n         [in] Number of tags
+ * @param gen       [in] Current generation
+ * @param sc        [in,out] Census, added to
+ */
+void nfp_blm_dbg_scan_tags(const uint32_t *tags, size_t n, uint32_t gen,
+                           struct nfp_blm_dbg_scan *sc);
+
+/**
+ * Age of a tag:  the generations from its own to @gen, modulo 2^31.
+ */
+uint32_t nfp_blm_dbg_tag_age(uint32_t tag, uint32_t gen);
+
+/**
+ * Bucket of an age:  0 for 0, b for [2^(b-1), 2^b - 1], and the last
+ * bucket for every age from 2^(NFP_BLM_DBG_AGE_NBUCKETS - 2).
+ */
+unsigned int nfp_blm_dbg_age_bucket(uint32_t age);
+
+/**
+ * Read and count all the buffer tags.
+ *
+ * @param io        [in] Symbol access
+ * @param min_age   [in] Report the out buffers of at least this age
+ * @param report    [in] Called with the key and tag of each, or NULL
+ * @param priv      [in] Passed to @report
+ * @param sc        [out] Census
+ *
+ * @return 0 on success, -1 if the firmware is built without
+ * BLM_BUF_DEBUG, on an access error or an allocation failure.
+ */
+int nfp_blm_dbg_scan(const struct nfp_blm_stat_io *io, uint32_t min_age,
+                     void (*report)(void *priv, uint32_t key, uint32_t tag),
+                     void *priv, struct nfp_blm_dbg_scan *sc);
+
+#endif /* _LIBS_FLOWENV__NFP_BLM_STAT_H_ */
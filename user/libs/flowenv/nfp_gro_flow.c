@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_gro_flow.c
+ * @brief         Rebalancing of the GRO flow spreading table.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "nfp_gro_flow.h"
+
+struct flow_ctx {
+    double load;                /* Estimated, after the moves so far */
+    unsigned int nent;          /* Table entries */
+};
+
+struct flow_blk {
+    double load;
+    unsigned int nflow;         /* Flow spreading contexts */
+};
+
+int
+nfp_gro_flow_rebalance(uint32_t *tbl, const uint64_t *ent_load,
+                       const uint64_t *ctx_load, unsigned int num_ctx,
+                       unsigned int ctx_per_block, double tol,
+                       unsigned int max_moves)
+{
+    struct flow_ctx *ctx;
+    struct flow_blk *blk;
+    unsigned int num_blocks = num_ctx / ctx_per_block;
+    unsigned int moves = 0;
+    unsigned int i, b, hot, cold, ent, src, dst, nblk;
+    double total, diff, e, d, best;
+    int ret = -1;
+
+    ctx = calloc(num_ctx, sizeof(*ctx));
+    blk = calloc(num_blocks, sizeof(*blk));
+    if (!ctx || !blk)
+        goto out;
+
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++) {
+        if (NFP_GRO_FLOW_ENT_CTX(tbl[i]) >= num_ctx ||
+            NFP_GRO_FLOW_ENT_NEXT(tbl[i]) >= num_ctx)
+            goto out;
+        ctx[NFP_GRO_FLOW_ENT_NEXT(tbl[i])].nent++;
+    }
+    for (i = 0; i < num_ctx; i++) {
+        ctx[i].load = ctx_load[i];
+        blk[i / ctx_per_block].load += ctx_load[i];
+        if (ctx[i].nent)
+            blk[i / ctx_per_block].nflow++;
+    }
+
+    /* The load of an entry that is moving will be the new context's */
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++) {
+        if (!(tbl[i] & NFP_GRO_FLOW_ENT_FENCE))
+            continue;
+        src = NFP_GRO_FLOW_ENT_CTX(tbl[i]);
+        dst = NFP_GRO_FLOW_ENT_NEXT(tbl[i]);
+        e = (ent_load[i] < ctx[src].load) ? ent_load[i] : ctx[src].load;
+        ctx[src].load -= e;
+        ctx[dst].load += e;
+        blk[src / ctx_per_block].load -= e;
+        blk[dst / ctx_per_block].load += e;
+    }
+
+    total = 0;
+    nblk = 0;
+    for (b = 0; b < num_blocks; b++) {
+        if (blk[b].nflow) {
+            total += blk[b].load;
+            nblk++;
+        }
+    }
+
+    while (moves < max_moves && nblk > 1 && total > 0) {
+        hot = cold = num_blocks;
+        for (b = 0; b < num_blocks; b++) {
+            if (!blk[b].nflow)
+                continue;
+            if (hot == num_blocks || blk[b].load > blk[hot].load)
+                hot = b;
+            if (cold == num_blocks || blk[b].load < blk[cold].load)
+                cold = b;
+        }
+        diff = blk[hot].load - blk[cold].load;
+        if (diff <= tol * total / nblk)
+            break;
+
+        /*
+         * The entry closest to half the difference:  moving e leaves the
+         * two blocks |diff - 2e| apart, closer only if 0 < e < diff.
+         */
+        ent = NFP_GRO_FLOW_TBL_SIZE;
+        best = diff;
+        for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++) {
+            if ((tbl[i] & NFP_GRO_FLOW_ENT_FENCE) ||
+                tbl[i] / ctx_per_block != hot || ctx[tbl[i]].nent < 2)
+                continue;
+            e = ent_load[i];
+            d = (diff > 2 * e) ? diff - 2 * e : 2 * e - diff;
+            if (e > 0 && e < diff && d < best) {
+                best = d;
+                ent = i;
+            }
+        }
+        if (ent == NFP_GRO_FLOW_TBL_SIZE)
+            break;
+
+        /* The least busy flow spreading context of the other block */
+        dst = num_ctx;
+        for (i = cold * ctx_per_block; i < (cold + 1) * ctx_per_block; i++) {
+            if (ctx[i].nent &&
+                (dst == num_ctx || ctx[i].load < ctx[dst].load))
+                dst = i;
+        }
+
+        e = ent_load[ent];
+        ctx[tbl[ent]].load -= e;
+        ctx[tbl[ent]].nent--;
+        ctx[dst].load += e;
+        ctx[dst].nent++;
+        blk[hot].load -= e;
+        blk[cold].load += e;
+        tbl[ent] |= NFP_GRO_FLOW_ENT_FENCE |
+            (dst << NFP_GRO_FLOW_ENT_NEXT_shf);
+        moves++;
+    }
+    ret = moves;
+
+out:
+    free(ctx);
+    free(blk);
+    return ret;
+}
+
+int
+nfp_gro_flow_drain(uint32_t *tbl)
+{
+    unsigned int i;
+    int n = 0;
+
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++) {
+        if ((tbl[i] & NFP_GRO_FLOW_ENT_FENCE) &&
+            !(tbl[i] & NFP_GRO_FLOW_ENT_DRAIN)) {
+            tbl[i] |= NFP_GRO_FLOW_ENT_DRAIN;
+            n++;
+        }
+    }
+    return n;
+}
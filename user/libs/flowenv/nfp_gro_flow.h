@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_gro_flow.h
+ * @brief         Rebalancing of the GRO flow spreading table.
+ *
+ * _gro_flow_tbl (me/blocks/gro/gro.h) maps a flow hash to a reorder
+ * context, and so to the GRO block whose GRO.OUT ME releases the flow.
+ * Both gro_cli_flow_map() in libgro.c and the gro.uc client look the
+ * table up in the same way, so rewriting it moves flows for all clients.
+ *
+ * An entry is never rewritten to another context directly: that would let
+ * the next packets of its flows overtake those still waiting in the old
+ * context.  nfp_gro_flow_rebalance() fences the entries it moves, and
+ * nfp_gro_flow_drain(), at least an interval later, lets the clients
+ * complete the moves once the old contexts have drained.
+ */
+#ifndef _LIBS_FLOWENV__NFP_GRO_FLOW_H_
+#define _LIBS_FLOWENV__NFP_GRO_FLOW_H_
+
+#include <stdint.h>
+
+#define NFP_GRO_FLOW_TBL_SYM        "_gro_flow_tbl"
+#define NFP_GRO_FLOW_CNT_SYM        "_gro_flow_cnt"
+#define NFP_GRO_FLOW_LOCK_SYM       "_gro_flow_lock"
+#define NFP_GRO_FLOW_FLAGS          0x4     /* GRO_GLOBAL_CFG_FLAGS_FLOW */
+#define NFP_GRO_FLOW_TBL_SIZE       256     /* GRO_FLOW_TBL_SIZE_LW */
+
+/* GRO_FLOW_TBL_IDX() */
+#define NFP_GRO_FLOW_TBL_IDX(_hash) \
+    (((_hash) ^ ((_hash) >> 16)) & (NFP_GRO_FLOW_TBL_SIZE - 1))
+
+/* GRO_FLOW_ENT_* */
+#define NFP_GRO_FLOW_ENT_CTX_msk    0xfff
+#define NFP_GRO_FLOW_ENT_NEXT_shf   16
+#define NFP_GRO_FLOW_ENT_NEXT_msk   0xfff
+#define NFP_GRO_FLOW_ENT_DRAIN      0x40000000
+#define NFP_GRO_FLOW_ENT_FENCE      0x80000000
+
+/* The context an entry maps to now, and the one it will map to */
+#define NFP_GRO_FLOW_ENT_CTX(_ent)  ((_ent) & NFP_GRO_FLOW_ENT_CTX_msk)
+#define NFP_GRO_FLOW_ENT_NEXT(_ent) \
+    (((_ent) & NFP_GRO_FLOW_ENT_FENCE) ? \
+     (((_ent) >> NFP_GRO_FLOW_ENT_NEXT_shf) & NFP_GRO_FLOW_ENT_NEXT_msk) : \
+     NFP_GRO_FLOW_ENT_CTX(_ent))
+
+/**
+ * Move table entries from the busiest GRO block to the least busy one.
+ *
+ * The load of a block is that of all its contexts, flow spreading or not.
+ * While the difference between the loads of the busiest and the least
+ * busy block exceeds @tol times the mean block load, the entry of the
+ * busiest block that best halves the difference moves to the least busy
+ * flow spreading context of the other block.  Only the blocks with flow
+ * spreading contexts take part, a context never loses its last entry and
+ * an entry never moves if that would not reduce the difference.  An entry
+ * that is already moving counts for the context it moves to and does not
+ * move again.  Each entry moved keeps its context and gets
+ * NFP_GRO_FLOW_ENT_FENCE and the context it moves to.
+ *
+ * @param tbl           [in,out] NFP_GRO_FLOW_TBL_SIZE entries
+ * @param ent_load      [in] Load of each entry, e.g. the increase of its
+ *                      _gro_flow_cnt over an interval
+ * @param ctx_load      [in] Load of each context over the same interval,
+ *                      e.g. the packets it enqueued
+ * @param num_ctx       [in] Contexts, across all blocks
+ * @param ctx_per_block [in] Contexts per block
+ * @param tol           [in] Imbalance tolerated, e.g. 0.1
+ * @param max_moves     [in] Most entries to move
+ *
+ * @return the number of entries fenced, or -1 if an entry is not a
+ * context.
+ */
+int nfp_gro_flow_rebalance(uint32_t *tbl, const uint64_t *ent_load,
+                           const uint64_t *ctx_load, unsigned int num_ctx,
+                           unsigned int ctx_per_block, double tol,
+                           unsigned int max_moves);
+
+/**
+ * Allow the moves of the entries that nfp_gro_flow_rebalance() fenced.
+ *
+ * Sets NFP_GRO_FLOW_ENT_DRAIN in every fenced entry.  The first client to
+ * map through such an entry once its old context has drained rewrites it
+ * to the new context.  Call it at least an interval after the entries
+ * were fenced, so that every client that read an entry before its fence
+ * has taken its sequence number, and write back only the entries it
+ * changed:  the clients rewrite the others.
+ *
+ * @param tbl           [in,out] NFP_GRO_FLOW_TBL_SIZE entries
+ *
+ * @return the number of entries changed.
+ */
+int nfp_gro_flow_drain(uint32_t *tbl);
+
+#endif /* _LIBS_FLOWENV__NFP_GRO_FLOW_H_ */
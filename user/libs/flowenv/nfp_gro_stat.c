@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_gro_stat.c
+ * @brief         Host side of the GRO counters and telemetry histograms.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nfp_gro_stat.h"
+
+/* Sanity bound on _gro_global_config.num_blocks */
+#define GRO_STAT_MAX_BLOCKS     256
+
+static uint64_t
+get64(const uint32_t *words)
+{
+    return ((uint64_t)words[1] << 32) | words[0];
+}
+
+int
+nfp_gro_stat_read(const struct nfp_gro_stat_io *io, struct nfp_gro_stat *st)
+{
+    uint32_t cfg[NFP_GRO_CFG_LW];
+    uint32_t *words = NULL;
+    unsigned int i, b;
+    size_t len;
+
+    memset(st, 0, sizeof(*st));
+    if (io->read(io->priv, NFP_GRO_CFG_SYM, cfg, sizeof(cfg), 0) < 0)
+        return -1;
+    if (cfg[0] == 0 || cfg[0] > GRO_STAT_MAX_BLOCKS || cfg[1] == 0 ||
+        cfg[1] > NFP_GRO_MAX_CTX_PER_BLOCK || (cfg[1] & (cfg[1] - 1)) != 0)
+        return -1;
+
+    st->num_blocks = cfg[0];
+    st->ctx_per_block = cfg[1];
+    st->flags = cfg[2];
+    st->num_ctx = st->num_blocks * st->ctx_per_block;
+    st->ctx = calloc(st->num_ctx, sizeof(*st->ctx));
+    /* Large enough for the biggest of the symbols */
+    words = malloc(st->num_ctx * NFP_GRO_TELEM_LW * sizeof(uint32_t));
+    if (!st->ctx || !words)
+        goto fail;
+
+    len = st->num_ctx * NFP_GRO_CLI_CNTRS_LW * sizeof(uint32_t);
+    if (io->read(io->priv, NFP_GRO_CLI_CNTRS_SYM, words, len, 0) < 0)
+        goto fail;
+    for (i = 0; i < st->num_ctx; i++) {
+        st->ctx[i].enqueued = get64(&words[i * NFP_GRO_CLI_CNTRS_LW]);
+        st->ctx[i].released = get64(&words[i * NFP_GRO_CLI_CNTRS_LW + 2]);
+    }
+
+    if (st->flags & NFP_GRO_FLAGS_WD) {
+        len = st->num_ctx * NFP_GRO_WD_CNTRS_LW * sizeof(uint32_t);
+        if (io->read(io->priv, NFP_GRO_WD_CNTRS_SYM, words, len, 0) < 0)
+            goto fail;
+        for (i = 0; i < st->num_ctx; i++)
+            st->ctx[i].skipped = get64(&words[i * NFP_GRO_WD_CNTRS_LW]);
+    }
+
+    if (st->flags & NFP_GRO_FLAGS_TELEM) {
+        len = st->num_ctx * NFP_GRO_TELEM_LW * sizeof(uint32_t);
+        if (io->read(io->priv, NFP_GRO_TELEM_SYM, words, len, 0) < 0)
+            goto fail;
+        for (i = 0; i < st->num_ctx; i++) {
+            for (b = 0; b < NFP_GRO_TELEM_NBUCKETS; b++) {
+                st->ctx[i].depth[b] = words[i * NFP_GRO_TELEM_LW + b];
+                st->ctx[i].wait[b] = words[i * NFP_GRO_TELEM_LW +
+                                           NFP_GRO_TELEM_NBUCKETS + b];
+            }
+        }
+    }
+
+    free(words);
+    return 0;
+
+fail:
+    free(words);
+    nfp_gro_stat_free(st);
+    return -1;
+}
+
+void
+nfp_gro_stat_free(struct nfp_gro_stat *st)
+{
+    free(st->ctx);
+    st->ctx = NULL;
+    st->num_ctx = 0;
+}
+
+int
+nfp_gro_stat_delta(const struct nfp_gro_stat *prev, struct nfp_gro_stat *st)
+{
+    const struct nfp_gro_ctx_stat *p;
+    struct nfp_gro_ctx_stat *c;
+    unsigned int i, b;
+
+    if (prev->num_blocks != st->num_blocks ||
+        prev->ctx_per_block != st->ctx_per_block ||
+        prev->flags != st->flags)
+        return -1;
+
+    for (i = 0; i < st->num_ctx; i++) {
+        p = &prev->ctx[i];
+        c = &st->ctx[i];
+        c->enqueued -= p->enqueued;
+        c->released -= p->released;
+        c->skipped -= p->skipped;
+        for (b = 0; b < NFP_GRO_TELEM_NBUCKETS; b++) {
+            c->depth[b] -= p->depth[b];
+            c->wait[b] -= p->wait[b];
+        }
+    }
+    return 0;
+}
+
+uint64_t
+nfp_gro_hist_count(const uint32_t *hist)
+{
+    uint64_t n = 0;
+    unsigned int b;
+
+    for (b = 0; b < NFP_GRO_TELEM_NBUCKETS; b++)
+        n += hist[b];
+    return n;
+}
+
+int
+nfp_gro_hist_pctl(const uint32_t *hist, double pct)
+{
+    uint64_t n = nfp_gro_hist_count(hist);
+    uint64_t sum = 0;
+    unsigned int b;
+    double target;
+
+    if (n == 0)
+        return -1;
+    target = pct / 100 * n;
+    for (b = 0; b < NFP_GRO_TELEM_NBUCKETS - 1; b++) {
+        sum += hist[b];
+        if (sum > 0 && sum >= target)
+            return b;
+    }
+    return NFP_GRO_TELEM_NBUCKETS - 1;
+}
+
+uint64_t
+nfp_gro_bucket_max(unsigned int b)
+{
+    if (b >= NFP_GRO_TELEM_NBUCKETS - 1)
+        return UINT64_MAX;
+    return (1ULL << b) - 1;
+}
+
+uint64_t
+nfp_gro_bucket_min(unsigned int b)
+{
+    if (b == 0)
+        return 0;
+    return 1ULL << (b - 1);
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_gro_stat.h
+ * @brief         Host side of the GRO counters and telemetry histograms.
+ *
+ * The layouts below mirror _gro_global_config, _gro_cli_cntrs,
+ * _gro_wd_cntrs and _gro_telem (me/blocks/gro/gro.h).  Each symbol is
+ * read in one transfer for all the contexts, through a struct
+ * nfp_gro_stat_io, so the decoding can be run against memory without the
+ * NFP BSP.
+ */
+#ifndef _LIBS_FLOWENV__NFP_GRO_STAT_H_
+#define _LIBS_FLOWENV__NFP_GRO_STAT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NFP_GRO_CFG_SYM             "_gro_global_config"
+#define NFP_GRO_CLI_CNTRS_SYM       "_gro_cli_cntrs"
+#define NFP_GRO_WD_CNTRS_SYM        "_gro_wd_cntrs"
+#define NFP_GRO_TELEM_SYM           "_gro_telem"
+
+#define NFP_GRO_CFG_LW              3       /* GRO_GLOBAL_CFG_SIZE_LW */
+#define NFP_GRO_FLAGS_WD            0x1     /* GRO_GLOBAL_CFG_FLAGS_WD */
+#define NFP_GRO_FLAGS_TELEM         0x2     /* GRO_GLOBAL_CFG_FLAGS_TELEM */
+#define NFP_GRO_MAX_CTX_PER_BLOCK   8       /* GRO_MAX_CTX_PER_BLOCK */
+
+#define NFP_GRO_CLI_CNTRS_LW        4       /* Per context */
+#define NFP_GRO_WD_CNTRS_LW         2       /* Per context */
+#define NFP_GRO_TELEM_NBUCKETS      16      /* GRO_TELEM_NBUCKETS */
+#define NFP_GRO_TELEM_WAIT_SHF      8       /* GRO_TELEM_WAIT_shf */
+#define NFP_GRO_TELEM_LW            (2 * NFP_GRO_TELEM_NBUCKETS)
+
+/**
+ * Counters and histograms of a reorder context.
+ */
+struct nfp_gro_ctx_stat {
+    uint64_t enqueued;      /* Entries sent by the clients */
+    uint64_t released;      /* Entries whose tickets were released */
+    uint64_t skipped;       /* Sequence numbers skipped by the watchdog */
+    uint32_t depth[NFP_GRO_TELEM_NBUCKETS];     /* Entries held back */
+    uint32_t wait[NFP_GRO_TELEM_NBUCKETS];      /* Head-of-line wait */
+};
+
+/**
+ * Snapshot of all the reorder contexts, numbered across all blocks.
+ */
+struct nfp_gro_stat {
+    unsigned int num_blocks;
+    unsigned int ctx_per_block;
+    uint32_t flags;                 /* NFP_GRO_FLAGS_* */
+    unsigned int num_ctx;
+    struct nfp_gro_ctx_stat *ctx;   /* num_ctx entries */
+};
+
+/**
+ * Access to the run time symbols, as 32-bit words in host byte order.
+ */
+struct nfp_gro_stat_io {
+    int (*read)(void *priv, const char *sym, uint32_t *words,
+                size_t len, uint64_t off);
+    void *priv;
+};
+
+/**
+ * Take a snapshot of the GRO blocks.
+ *
+ * @param io        [in] Symbol access
+ * @param st        [out] Snapshot, to free with nfp_gro_stat_free()
+ *
+ * @return 0 on success, or -1 on an access error, an allocation failure
+ * or an inconsistent _gro_global_config.  The watchdog counters and the
+ * histograms are left 0 if the firmware does not have them.
+ */
+int nfp_gro_stat_read(const struct nfp_gro_stat_io *io,
+                      struct nfp_gro_stat *st);
+
+/**
+ * Free the contexts of a snapshot.
+ */
+void nfp_gro_stat_free(struct nfp_gro_stat *st);
+
+/**
+ * Compute the activity between two snapshots of the same firmware.
+ *
+ * @param prev      [in] Earlier snapshot
+ * @param st        [in,out] Later snapshot, replaced by the difference
+ *
+ * @return 0 on success, -1 if the snapshots do not have the same topology.
+ * The histogram buckets are 32 bits and wrap: the snapshots must be taken
+ * less than 2^32 samples apart.
+ */
+int nfp_gro_stat_delta(const struct nfp_gro_stat *prev,
+                       struct nfp_gro_stat *st);
+
+/**
+ * Total number of samples in a histogram.
+ */
+uint64_t nfp_gro_hist_count(const uint32_t *hist);
+
+/**
+ * Find the bucket of a percentile.
+ *
+ * @param hist      [in] NFP_GRO_TELEM_NBUCKETS buckets
+ * @param pct       [in] Percentile, 0 to 100
+ *
+ * @return the first bucket at which the cumulative count reaches @pct
+ * percent of the samples, or -1 if the histogram is empty.
+ */
+int nfp_gro_hist_pctl(const uint32_t *hist, double pct);
+
+/**
+ * Largest value that a bucket counts.
+ *
+ * @return 0 for bucket 0, 2^b - 1 for bucket b, or UINT64_MAX for the
+ * last bucket, which counts every value from 2^(NFP_GRO_TELEM_NBUCKETS - 2).
+ */
+uint64_t nfp_gro_bucket_max(unsigned int b);
+
+/**
+ * Smallest value that a bucket counts.
+ */
+uint64_t nfp_gro_bucket_min(unsigned int b);
+
+#endif /* _LIBS_FLOWENV__NFP_GRO_STAT_H_ */
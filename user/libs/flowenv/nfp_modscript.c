@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_modscript.c
+ * @brief         Host side of the direct edit scripts of libmodscript.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "nfp_modscript.h"
+
+/* First word of a direct script, MODSCRIPT_DIRECT_* in modscript.h */
+#define DIRECT_shf          31
+#define OPCODE_shf          16
+#define OFFSET_shf          8
+#define RDATA_shf           0
+#define RDATA_msk           0x1f
+
+/* enum nbi_pkt_ms_instruct in me/lib/pkt/pkt.h */
+#define INSTRUCT_DELETE     0
+#define INSTRUCT_INSERT     1
+#define INSTRUCT_REPLACE    2
+
+/* NBI_PM_OPCODE() for data from the script */
+#define OPCODE(_instruct, _bytes) \
+    ((((_instruct) & 0x7) << 5) | ((((_bytes) - 1) & 0xf) << 1))
+
+static void
+put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t
+get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+int
+nfp_modscript_encode(const struct nfp_modscript_edit *e, unsigned int off,
+                     uint8_t *script, unsigned int *ms_off)
+{
+    unsigned int ms_len, del;
+    uint32_t hdr;
+
+    if (e->len == 0 || e->len > NFP_MODSCRIPT_MAX_LEN ||
+        e->at > NFP_MODSCRIPT_MAX_AT || off > 255)
+        return -1;
+
+    memset(script, 0, NFP_MODSCRIPT_MAX_SZ);
+
+    switch (e->act) {
+    case NFP_MODSCRIPT_ACT_DELETE:
+        ms_len = 8;
+        del = e->len;
+        if (e->at == 0) {
+            /* Also delete up to an unaligned packet */
+            if (off < 8 + ms_len)
+                return -1;
+            *ms_off = (off & ~7) - ms_len;
+            del += off - *ms_off - ms_len;
+        } else {
+            if (off < ms_len)
+                return -1;
+            *ms_off = off - ms_len;
+        }
+        if (del > NFP_MODSCRIPT_MAX_LEN)
+            return -1;
+        hdr = OPCODE(INSTRUCT_DELETE, del) << OPCODE_shf;
+        break;
+    case NFP_MODSCRIPT_ACT_REPLACE:
+    case NFP_MODSCRIPT_ACT_INSERT:
+        ms_len = (4 + e->len + 7) & ~7;
+        if (off < ms_len)
+            return -1;
+        *ms_off = off - ms_len;
+        hdr = OPCODE(e->act == NFP_MODSCRIPT_ACT_REPLACE ? INSTRUCT_REPLACE :
+                     INSTRUCT_INSERT, e->len) << OPCODE_shf;
+        hdr |= e->len << RDATA_shf;
+        memcpy(script + 4, e->data, e->len);
+        break;
+    default:
+        return -1;
+    }
+
+    if ((*ms_off & 7) != 0 || *ms_off < 8 || *ms_off > NFP_MODSCRIPT_MAX_OFF)
+        return -1;
+
+    hdr |= (1u << DIRECT_shf) | (e->at << OFFSET_shf);
+    put32(script, hdr);
+    return ms_len;
+}
+
+int
+nfp_modscript_decode(const uint8_t *script, size_t size,
+                     struct nfp_modscript_edit *e)
+{
+    uint32_t hdr;
+    unsigned int opcode, rdata;
+    unsigned int ms_len;
+
+    if (size < 8)
+        return -1;
+
+    hdr = get32(script);
+    opcode = (hdr >> OPCODE_shf) & 0xff;
+    rdata = (hdr >> RDATA_shf) & RDATA_msk;
+
+    /* Direct, no reserved bits, data from the script */
+    if (!(hdr >> DIRECT_shf) || (hdr & 0x7f0000e0) || (opcode & 1))
+        return -1;
+
+    memset(e, 0, sizeof(*e));
+    e->at = (hdr >> OFFSET_shf) & 0xff;
+    e->len = ((opcode >> 1) & 0xf) + 1;
+
+    switch (opcode >> 5) {
+    case INSTRUCT_DELETE:
+        if (rdata != 0)
+            return -1;
+        e->act = NFP_MODSCRIPT_ACT_DELETE;
+        ms_len = 8;
+        break;
+    case INSTRUCT_REPLACE:
+    case INSTRUCT_INSERT:
+        if (rdata != e->len)
+            return -1;
+        e->act = (opcode >> 5) == INSTRUCT_REPLACE ?
+            NFP_MODSCRIPT_ACT_REPLACE : NFP_MODSCRIPT_ACT_INSERT;
+        ms_len = (4 + e->len + 7) & ~7;
+        if (size < ms_len)
+            return -1;
+        memcpy(e->data, script + 4, e->len);
+        break;
+    default:
+        return -1;
+    }
+
+    return ms_len;
+}
+
+int
+nfp_modscript_apply(const uint8_t *buf, unsigned int ms_off,
+                    unsigned int end, uint8_t *out, size_t size)
+{
+    struct nfp_modscript_edit e;
+    const uint8_t *pkt;
+    unsigned int pkt_len, out_len;
+    int ms_len;
+
+    if (end < ms_off)
+        return -1;
+    ms_len = nfp_modscript_decode(buf + ms_off, end - ms_off, &e);
+    if (ms_len < 0)
+        return -1;
+
+    /* The modifier works on the data following the script */
+    pkt = buf + ms_off + ms_len;
+    pkt_len = end - ms_off - ms_len;
+
+    if (e.act == NFP_MODSCRIPT_ACT_INSERT) {
+        if (e.at > pkt_len)
+            return -1;
+        out_len = pkt_len + e.len;
+    } else {
+        if (e.at + e.len > pkt_len)
+            return -1;
+        out_len = (e.act == NFP_MODSCRIPT_ACT_DELETE) ?
+            pkt_len - e.len : pkt_len;
+    }
+    if (out_len > size)
+        return -1;
+
+    memcpy(out, pkt, e.at);
+    switch (e.act) {
+    case NFP_MODSCRIPT_ACT_DELETE:
+        memcpy(out + e.at, pkt + e.at + e.len, pkt_len - e.at - e.len);
+        break;
+    case NFP_MODSCRIPT_ACT_REPLACE:
+        memcpy(out + e.at, e.data, e.len);
+        memcpy(out + e.at + e.len, pkt + e.at + e.len,
+               pkt_len - e.at - e.len);
+        break;
+    default:
+        memcpy(out + e.at, e.data, e.len);
+        memcpy(out + e.at + e.len, pkt + e.at, pkt_len - e.at);
+        break;
+    }
+
+    return out_len;
+}
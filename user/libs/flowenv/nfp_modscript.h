@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_modscript.h
+ * @brief         Host side of the direct edit scripts of libmodscript.
+ *
+ * The encoder builds the same scripts as modscript_edit_write()
+ * (me/lib/modscript/libmodscript.c), the decoder parses a direct script
+ * back into an edit and nfp_modscript_apply() makes the edit the way the
+ * NBI packet modifier does at egress.  Nothing here needs the NFP BSP.
+ */
+#ifndef _LIBS_FLOWENV__NFP_MODSCRIPT_H_
+#define _LIBS_FLOWENV__NFP_MODSCRIPT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NFP_MODSCRIPT_ACT_DELETE    1       /* MODSCRIPT_ACT_DELETE */
+#define NFP_MODSCRIPT_ACT_REPLACE   2       /* MODSCRIPT_ACT_REPLACE */
+#define NFP_MODSCRIPT_ACT_INSERT    3       /* MODSCRIPT_ACT_INSERT */
+
+#define NFP_MODSCRIPT_MAX_LEN       16      /* MODSCRIPT_EDIT_MAX_LEN */
+#define NFP_MODSCRIPT_MAX_AT        255     /* MODSCRIPT_EDIT_MAX_AT */
+#define NFP_MODSCRIPT_MAX_SZ        24      /* MODSCRIPT_EDIT_MAX_SZ */
+#define NFP_MODSCRIPT_MAX_OFF       120     /* MODSCRIPT_MAX_OFF */
+
+/**
+ * One edit of a packet.
+ */
+struct nfp_modscript_edit {
+    unsigned int act;       /* NFP_MODSCRIPT_ACT_* */
+    unsigned int at;        /* Offset of the edit in the packet */
+    unsigned int len;       /* Bytes deleted, replaced or inserted */
+    uint8_t data[NFP_MODSCRIPT_MAX_LEN];
+};
+
+/**
+ * Build the direct script for an edit of a packet starting at @off.
+ *
+ * @param e         [in] Edit
+ * @param off       [in] Start of the packet in the buffer
+ * @param script    [out] Script, NFP_MODSCRIPT_MAX_SZ bytes
+ * @param ms_off    [out] Offset of the script in the buffer
+ *
+ * @return the length of the script, or -1 if modscript_edit_write() does
+ * not support the edit at @off.
+ *
+ * A delete at offset 0 of an unaligned packet also deletes the bytes
+ * between the script and the packet, so the script decodes to a longer
+ * delete than @e.
+ */
+int nfp_modscript_encode(const struct nfp_modscript_edit *e, unsigned int off,
+                         uint8_t *script, unsigned int *ms_off);
+
+/**
+ * Parse a direct script.
+ *
+ * @param script    [in] Script
+ * @param size      [in] Bytes available at @script
+ * @param e         [out] Edit made by the script, offsets relative to the
+ *                  end of the script
+ *
+ * @return the length of the script, or -1 if it is not a direct delete,
+ * replace or insert script.
+ */
+int nfp_modscript_decode(const uint8_t *script, size_t size,
+                         struct nfp_modscript_edit *e);
+
+/**
+ * Make the edit of the script at @ms_off of a buffer, as the packet
+ * modifier does.
+ *
+ * @param buf       [in] Buffer holding the script and the packet
+ * @param ms_off    [in] Offset of the script
+ * @param end       [in] End of the packet in @buf
+ * @param out       [out] Packet sent
+ * @param size      [in] Size of @out
+ *
+ * @return the length of the packet sent, or -1 if the script is invalid,
+ * the edit falls outside of the packet or @out is too small.
+ */
+int nfp_modscript_apply(const uint8_t *buf, unsigned int ms_off,
+                        unsigned int end, uint8_t *out, size_t size);
+
+#endif /* _LIBS_FLOWENV__NFP_MODSCRIPT_H_ */
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_pktcap.c
+ * @brief         Host side of the pktio_cap() packet capture tap.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "nfp_pktcap.h"
+
+/* pcapng block types and options */
+#define PCAPNG_SHB              0x0a0d0d0a
+#define PCAPNG_IDB              0x00000001
+#define PCAPNG_EPB              0x00000006
+#define PCAPNG_BYTE_ORDER       0x1a2b3c4d
+#define PCAPNG_LINKTYPE_ETH     1
+#define PCAPNG_OPT_END          0
+#define PCAPNG_OPT_COMMENT      1
+#define PCAPNG_OPT_TSRESOL      9
+
+#define PCAPNG_PAD4(_x)         (((_x) + 3) & ~3u)
+
+/* Bytes of packet data a slot holds after the header */
+#define SLOT_DATA_SZ    ((NFP_PKTCAP_SLOT_LW - NFP_PKTCAP_HDR_LW) * 4)
+
+static void
+put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/* pcapng fields, in host byte order */
+static void
+put16h(uint8_t *p, uint16_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static void
+put32h(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+void
+nfp_pktcap_cfg_pack(const struct nfp_pktcap_cfg *cfg, uint32_t *words)
+{
+    words[0] = cfg->sample;
+    words[1] = cfg->snaplen;
+    words[2] = cfg->points;
+    words[3] = ((uint32_t)cfg->src_mask << 16) | cfg->src_val;
+    words[4] = ((uint32_t)cfg->dst_mask << 16) | cfg->dst_val;
+    words[5] = ((uint32_t)cfg->len_min << 16) | cfg->len_max;
+}
+
+void
+nfp_pktcap_cfg_unpack(const uint32_t *words, struct nfp_pktcap_cfg *cfg)
+{
+    cfg->sample = words[0];
+    cfg->snaplen = words[1];
+    cfg->points = words[2];
+    cfg->src_mask = words[3] >> 16;
+    cfg->src_val = words[3];
+    cfg->dst_mask = words[4] >> 16;
+    cfg->dst_val = words[4];
+    cfg->len_min = words[5] >> 16;
+    cfg->len_max = words[5];
+}
+
+uint32_t
+nfp_pktcap_sample(double n)
+{
+    double sample;
+
+    if (n < 1)
+        return 0;
+
+    /* Round, but never to 0 which would disable the tap */
+    sample = NFP_PKTCAP_SAMPLE_ALL / n + 0.5;
+    if (sample < 1)
+        return 1;
+    return (uint32_t)sample;
+}
+
+int
+nfp_pktcap_rec_decode(const uint32_t *words, struct nfp_pktcap_rec *rec)
+{
+    uint8_t data[SLOT_DATA_SZ];
+    unsigned int pad;
+    int i;
+
+    rec->tsc = ((uint64_t)words[0] << 32) | words[1];
+    rec->point = words[2] >> 24;
+    pad = (words[2] >> 22) & 0x3;
+    rec->snap = (words[2] >> 15) & 0x7f;
+    rec->len = words[2] & 0x7fff;
+    rec->src = words[3] >> 16;
+    rec->dst = words[3];
+
+    if (rec->point >= NFP_PKTCAP_POINTS || rec->snap > rec->len ||
+        rec->snap > NFP_PKTCAP_SNAP_MAX || pad + rec->snap > SLOT_DATA_SZ)
+        return -1;
+
+    for (i = 0; i < SLOT_DATA_SZ / 4; i++)
+        put32(data + i * 4, words[NFP_PKTCAP_HDR_LW + i]);
+    memcpy(rec->data, data + pad, rec->snap);
+    return 0;
+}
+
+int
+nfp_pktcap_drain(const struct nfp_pktcap_io *io, nfp_pktcap_cb cb,
+                 void *arg, unsigned int max)
+{
+    struct nfp_pktcap_rec rec;
+    uint32_t slot[NFP_PKTCAP_SLOT_LW];
+    uint32_t idx[2];
+    uint32_t prod, cons, n, i;
+    uint32_t s;
+    int ret = 0;
+
+    if (io->read(io->priv, NFP_PKTCAP_CTL_SYM, idx, sizeof(idx),
+                 NFP_PKTCAP_CTL_PROD * 4) < 0)
+        return -1;
+    prod = idx[0];
+    cons = idx[1];
+
+    n = prod - cons;
+    if (n > NFP_PKTCAP_SLOTS)
+        return -1;
+    if (n > max)
+        n = max;
+
+    for (i = 0; i < n; i++) {
+        if (io->read(io->priv, NFP_PKTCAP_IDX_SYM, &s, sizeof(s),
+                     ((cons + i) % NFP_PKTCAP_SLOTS) * 4) < 0 ||
+            s >= NFP_PKTCAP_SLOTS ||
+            io->read(io->priv, NFP_PKTCAP_SLOTS_SYM, slot, sizeof(slot),
+                     (uint64_t)s * sizeof(slot)) < 0) {
+            ret = -1;
+            break;
+        }
+
+        if (nfp_pktcap_rec_decode(slot, &rec) == 0 && cb(arg, &rec) < 0)
+            break;
+    }
+
+    /* The slots go back to the free ring on the next pktio_cap_drain() */
+    if (i != 0) {
+        cons += i;
+        if (io->write(io->priv, NFP_PKTCAP_CTL_SYM, &cons, sizeof(cons),
+                      NFP_PKTCAP_CTL_CONS * 4) < 0)
+            return -1;
+    }
+
+    return ret < 0 ? ret : (int)i;
+}
+
+int
+nfp_pktcap_pcapng_hdr(uint8_t *buf, size_t size, unsigned int snaplen)
+{
+    const unsigned int shb_len = 28, idb_len = 32;
+
+    if (size < shb_len + idb_len)
+        return -1;
+
+    memset(buf, 0, shb_len + idb_len);
+
+    /* Section header, of unspecified length */
+    put32h(buf, PCAPNG_SHB);
+    put32h(buf + 4, shb_len);
+    put32h(buf + 8, PCAPNG_BYTE_ORDER);
+    put16h(buf + 12, 1);
+    put16h(buf + 14, 0);
+    memset(buf + 16, 0xff, 8);
+    put32h(buf + 24, shb_len);
+
+    /* Interface, with a 10^-9 s resolution */
+    buf += shb_len;
+    put32h(buf, PCAPNG_IDB);
+    put32h(buf + 4, idb_len);
+    put16h(buf + 8, PCAPNG_LINKTYPE_ETH);
+    put32h(buf + 12, snaplen);
+    put16h(buf + 16, PCAPNG_OPT_TSRESOL);
+    put16h(buf + 18, 1);
+    buf[20] = 9;
+    put16h(buf + 24, PCAPNG_OPT_END);
+    put32h(buf + 28, idb_len);
+
+    return shb_len + idb_len;
+}
+
+uint64_t
+nfp_pktcap_tsc_ns(uint64_t tsc, double me_mhz)
+{
+    /* Whole and fractional ticks apart, to keep the precision */
+    double ns_per_tick = 16 * 1000 / me_mhz;
+    uint64_t whole = (uint64_t)ns_per_tick;
+
+    return tsc * whole + (uint64_t)(tsc * (ns_per_tick - whole));
+}
+
+int
+nfp_pktcap_pcapng_epb(uint8_t *buf, size_t size,
+                      const struct nfp_pktcap_rec *rec, double me_mhz)
+{
+    char comment[64];
+    unsigned int comment_len, len, off;
+    uint64_t ns;
+
+    comment_len = snprintf(comment, sizeof(comment),
+                           "point %u src 0x%04x dst 0x%04x", rec->point,
+                           rec->src, rec->dst);
+
+    len = 28 + PCAPNG_PAD4(rec->snap) + 4 + PCAPNG_PAD4(comment_len) + 4 +
+        4;
+    if (size < len)
+        return -1;
+
+    memset(buf, 0, len);
+    ns = nfp_pktcap_tsc_ns(rec->tsc, me_mhz);
+
+    put32h(buf, PCAPNG_EPB);
+    put32h(buf + 4, len);
+    put32h(buf + 8, 0);
+    put32h(buf + 12, ns >> 32);
+    put32h(buf + 16, ns);
+    put32h(buf + 20, rec->snap);
+    put32h(buf + 24, rec->len);
+    memcpy(buf + 28, rec->data, rec->snap);
+
+    off = 28 + PCAPNG_PAD4(rec->snap);
+    put16h(buf + off, PCAPNG_OPT_COMMENT);
+    put16h(buf + off + 2, comment_len);
+    memcpy(buf + off + 4, comment, comment_len);
+    off += 4 + PCAPNG_PAD4(comment_len);
+    put16h(buf + off, PCAPNG_OPT_END);
+    put32h(buf + off + 4, len);
+
+    return len;
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_pktcap.h
+ * @brief         Host side of the pktio_cap() packet capture tap.
+ *
+ * The layouts below mirror struct pktio_cap_ctl and struct pktio_cap_hdr
+ * (me/lib/pktio/pktio.h).  The symbols are accessed through a struct
+ * nfp_pktcap_io, so the drain and the pcapng writer need neither the NFP
+ * BSP nor a device and can be run by host models against memory.
+ */
+#ifndef _LIBS_FLOWENV__NFP_PKTCAP_H_
+#define _LIBS_FLOWENV__NFP_PKTCAP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NFP_PKTCAP_SLOTS        256     /* PKTIO_CAP_SLOTS */
+#define NFP_PKTCAP_SLOT_LW      32      /* PKTIO_CAP_SLOT_SZ / 4 */
+#define NFP_PKTCAP_HDR_LW       4       /* PKTIO_CAP_HDR_SZ / 4 */
+#define NFP_PKTCAP_SNAP_MAX     108     /* PKTIO_CAP_SNAP_MAX */
+#define NFP_PKTCAP_SAMPLE_ALL   65536   /* PKTIO_CAP_SAMPLE_ALL */
+#define NFP_PKTCAP_POINTS       32
+
+/* Words of struct pktio_cap_ctl */
+#define NFP_PKTCAP_CTL_LW       8
+#define NFP_PKTCAP_CFG_LW       6       /* PKTIO_CAP_CFG_LW */
+#define NFP_PKTCAP_CTL_PROD     6
+#define NFP_PKTCAP_CTL_CONS     7
+
+/* Run time symbols of libpktio with PKTIO_CAP_ENABLED */
+#define NFP_PKTCAP_CTL_SYM      "_pktio_cap_ctl"
+#define NFP_PKTCAP_SLOTS_SYM    "_pktio_cap_slots"
+#define NFP_PKTCAP_IDX_SYM      "_pktio_cap_idx"
+
+/**
+ * Capture configuration, the first NFP_PKTCAP_CFG_LW words of
+ * pktio_cap_ctl.
+ */
+struct nfp_pktcap_cfg {
+    uint32_t sample;        /* Packets captured per 65536 matching */
+    uint32_t snaplen;       /* Bytes kept of each packet */
+    uint32_t points;        /* Mask of tap points */
+    uint16_t src_mask;
+    uint16_t src_val;
+    uint16_t dst_mask;
+    uint16_t dst_val;
+    uint16_t len_min;
+    uint16_t len_max;
+};
+
+/**
+ * Decoded capture record.
+ */
+struct nfp_pktcap_rec {
+    uint64_t tsc;           /* me_tsc_read() at capture */
+    unsigned int point;     /* Tap point */
+    unsigned int len;       /* Length of the packet */
+    unsigned int snap;      /* Bytes of data[] */
+    uint16_t src;           /* Pkt.p_src */
+    uint16_t dst;           /* Pkt.p_dst */
+    uint8_t data[NFP_PKTCAP_SNAP_MAX];
+};
+
+/**
+ * Access to the run time symbols, as 32-bit words in host byte order.
+ */
+struct nfp_pktcap_io {
+    int (*read)(void *priv, const char *sym, uint32_t *words,
+                size_t len, uint64_t off);
+    int (*write)(void *priv, const char *sym, const uint32_t *words,
+                 size_t len, uint64_t off);
+    void *priv;
+};
+
+/**
+ * Called by nfp_pktcap_drain() for each record.
+ *
+ * @return 0 to go on, or -1 to stop the drain, in which case the record
+ * is drained again by the next call.
+ */
+typedef int (*nfp_pktcap_cb)(void *arg, const struct nfp_pktcap_rec *rec);
+
+/**
+ * Pack a configuration into the words of pktio_cap_ctl.
+ *
+ * @param cfg       [in] Configuration
+ * @param words     [out] NFP_PKTCAP_CFG_LW words to write to memory
+ */
+void nfp_pktcap_cfg_pack(const struct nfp_pktcap_cfg *cfg, uint32_t *words);
+
+/**
+ * Unpack the configuration words of pktio_cap_ctl.
+ *
+ * @param words     [in] NFP_PKTCAP_CFG_LW words read from memory
+ * @param cfg       [out] Configuration
+ */
+void nfp_pktcap_cfg_unpack(const uint32_t *words, struct nfp_pktcap_cfg *cfg);
+
+/**
+ * Compute the pktio_cap_ctl sample value to capture one in @n packets.
+ *
+ * @param n         [in] Sampling rate, 1 or more
+ *
+ * @return the sample value, 0 if @n is below 1.
+ */
+uint32_t nfp_pktcap_sample(double n);
+
+/**
+ * Decode a record slot.
+ *
+ * @param words     [in] NFP_PKTCAP_SLOT_LW words of the slot
+ * @param rec       [out] Record
+ *
+ * @return 0 on success, -1 if the header is inconsistent.
+ */
+int nfp_pktcap_rec_decode(const uint32_t *words, struct nfp_pktcap_rec *rec);
+
+/**
+ * Consume the records published by pktio_cap_drain().
+ *
+ * @param io        [in] Symbol access
+ * @param cb        [in] Called for each record, in order
+ * @param arg       [in] Passed to @cb
+ * @param max       [in] Most records to consume
+ *
+ * @return the number of records consumed, or -1 on an access error or a
+ * corrupt index.  pktio_cap_ctl.cons is advanced past the records
+ * consumed, including those that fail to decode, which are skipped.
+ */
+int nfp_pktcap_drain(const struct nfp_pktcap_io *io, nfp_pktcap_cb cb,
+                     void *arg, unsigned int max);
+
+/**
+ * Write the pcapng section header and Ethernet interface blocks.
+ *
+ * @param buf       [out] Buffer
+ * @param size      [in] Size of @buf
+ * @param snaplen   [in] Snap length of the interface
+ *
+ * @return the number of bytes written, or -1 if @buf is too small.
+ *
+ * The interface has a nanosecond timestamp resolution.  Blocks are
+ * written in host byte order, as pcapng allows.
+ */
+int nfp_pktcap_pcapng_hdr(uint8_t *buf, size_t size, unsigned int snaplen);
+
+/**
+ * Write a record as a pcapng enhanced packet block.
+ *
+ * @param buf       [out] Buffer
+ * @param size      [in] Size of @buf
+ * @param rec       [in] Record
+ * @param me_mhz    [in] ME clock in MHz, to convert the timestamp
+ *
+ * @return the number of bytes written, or -1 if @buf is too small.
+ *
+ * The tap point and the source and destination ports go in the comment
+ * of the block.
+ */
+int nfp_pktcap_pcapng_epb(uint8_t *buf, size_t size,
+                          const struct nfp_pktcap_rec *rec, double me_mhz);
+
+/**
+ * Convert a timestamp counter value to nanoseconds.
+ *
+ * @param tsc       [in] me_tsc_read() value, 16 ME cycles per tick
+ * @param me_mhz    [in] ME clock in MHz
+ */
+uint64_t nfp_pktcap_tsc_ns(uint64_t tsc, double me_mhz);
+
+#endif /* _LIBS_FLOWENV__NFP_PKTCAP_H_ */
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_pktgen.c
+ * @brief         Host side of pktio_gen() templates and the pktgen app.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "nfp_pktgen.h"
+
+/* Timestamp ticks per second per MHz of ME clock */
+#define TICKS_PER_MHZ   (1000000.0 / 16)
+
+static void
+put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void
+put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t
+get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+int
+nfp_pktgen_tmpl_udp(struct nfp_pktgen_tmpl *t, const uint8_t dmac[6],
+                    const uint8_t smac[6], uint32_t sip, uint32_t dip,
+                    uint16_t sport, uint16_t dport, unsigned int len)
+{
+    uint8_t *ip;
+    uint32_t sum = 0;
+    int i;
+
+    if (len < 60 || len > NFP_PKTGEN_MAX_LEN)
+        return -1;
+
+    memset(t, 0, sizeof(*t));
+    t->len = len;
+    t->tmpl_len = 44;
+    t->stamp_off = 44;
+
+    memcpy(t->data, dmac, 6);
+    memcpy(t->data + 6, smac, 6);
+    put16(t->data + 12, 0x0800);
+
+    ip = t->data + 14;
+    ip[0] = 0x45;
+    put16(ip + 2, len - 14);
+    ip[8] = 64;
+    ip[9] = 17;
+    put32(ip + 12, sip);
+    put32(ip + 16, dip);
+    for (i = 0; i < 20; i += 2)
+        sum += (ip[i] << 8) | ip[i + 1];
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    put16(ip + 10, ~sum);
+
+    put16(ip + 20, sport);
+    put16(ip + 22, dport);
+    put16(ip + 24, len - 34);
+
+    return 0;
+}
+
+int
+nfp_pktgen_tmpl_check(const struct nfp_pktgen_tmpl *t)
+{
+    /* Same checks as pktio_gen() */
+    if (t->len == 0 || t->len > NFP_PKTGEN_MAX_LEN || t->tmpl_len > t->len ||
+        t->tmpl_len > NFP_PKTGEN_TMPL_LW * 4 ||
+        ((t->tmpl_len | t->stamp_off) & 0x3) ||
+        (t->stamp_off != 0 &&
+         t->stamp_off + NFP_PKTGEN_STAMP_SZ > t->len))
+        return -1;
+    return 0;
+}
+
+void
+nfp_pktgen_tmpl_pack(const struct nfp_pktgen_tmpl *t, uint32_t *words)
+{
+    int i;
+
+    words[0] = ((uint32_t)t->len << 16) | (t->tmpl_len << 8) | t->stamp_off;
+    words[1] = t->fill;
+    /* Packet data is big endian within the words seen by the ME */
+    for (i = 0; i < NFP_PKTGEN_TMPL_LW; i++)
+        words[i + 2] = get32(t->data + i * 4);
+}
+
+void
+nfp_pktgen_tmpl_unpack(const uint32_t *words, struct nfp_pktgen_tmpl *t)
+{
+    int i;
+
+    t->len = words[0] >> 16;
+    t->tmpl_len = words[0] >> 8;
+    t->stamp_off = words[0];
+    t->fill = words[1];
+    for (i = 0; i < NFP_PKTGEN_TMPL_LW; i++)
+        put32(t->data + i * 4, words[i + 2]);
+}
+
+int
+nfp_pktgen_build(const uint32_t *words, uint32_t seq, uint64_t tsc,
+                 uint8_t *pkt, size_t size)
+{
+    struct nfp_pktgen_tmpl t;
+    unsigned int off;
+
+    nfp_pktgen_tmpl_unpack(words, &t);
+    if (nfp_pktgen_tmpl_check(&t) != 0 || size < t.len)
+        return -1;
+
+    memcpy(pkt, t.data, t.tmpl_len);
+    for (off = t.tmpl_len; off < t.len; off++)
+        pkt[off] = t.fill >> (24 - 8 * (off & 3));
+
+    if (t.stamp_off != 0) {
+        put32(pkt + t.stamp_off, seq);
+        put32(pkt + t.stamp_off + 4, tsc >> 32);
+        put32(pkt + t.stamp_off + 8, tsc);
+    }
+
+    return t.len;
+}
+
+int
+nfp_pktgen_stamp(const uint8_t *pkt, size_t len, unsigned int stamp_off,
+                 uint32_t *seq, uint64_t *tsc)
+{
+    if (stamp_off + NFP_PKTGEN_STAMP_SZ > len)
+        return -1;
+
+    *seq = get32(pkt + stamp_off);
+    *tsc = ((uint64_t)get32(pkt + stamp_off + 4) << 32) |
+           get32(pkt + stamp_off + 8);
+    return 0;
+}
+
+uint32_t
+nfp_pktgen_interval(double pps, double me_mhz)
+{
+    double ticks;
+
+    if (pps <= 0)
+        return 0;
+
+    ticks = me_mhz * TICKS_PER_MHZ / pps * 256 + 0.5;
+    if (ticks >= 4294967296.0)
+        return 0;
+    if (ticks < 1)
+        ticks = 1;
+    return (uint32_t)ticks;
+}
+
+double
+nfp_pktgen_rate(uint32_t interval, double me_mhz)
+{
+    if (interval == 0)
+        return 0;
+    return me_mhz * TICKS_PER_MHZ * 256 / interval;
+}
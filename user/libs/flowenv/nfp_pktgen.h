@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/libs/flowenv/nfp_pktgen.h
+ * @brief         Host side of pktio_gen() templates and the pktgen app.
+ *
+ * The layouts below mirror struct pktio_gen_tmpl (me/lib/pktio/pktio.h)
+ * and struct pktgen_cfg (me/apps/pktgen/pktgen.c).  Nothing here needs
+ * the NFP BSP, so the code can be used by host models as well as by tools
+ * accessing the run time symbols of the pktgen app.
+ */
+#ifndef _LIBS_FLOWENV__NFP_PKTGEN_H_
+#define _LIBS_FLOWENV__NFP_PKTGEN_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NFP_PKTGEN_NUM_GENS     8       /* PKTGEN_NUM_GENS */
+#define NFP_PKTGEN_TMPL_LW      30      /* PKTIO_GEN_TMPL_LW */
+#define NFP_PKTGEN_TMPL_SZ      ((NFP_PKTGEN_TMPL_LW + 2) * 4)
+#define NFP_PKTGEN_STAMP_SZ     12      /* PKTIO_GEN_STAMP_SZ */
+#define NFP_PKTGEN_OFFSET       64      /* PKTIO_GEN_OFFSET */
+#define NFP_PKTGEN_MAX_LEN      (2048 - NFP_PKTGEN_OFFSET)
+
+/* Destination of the packets, PKT_WIRE_PORT() in me/lib/pktio/pktio.h */
+#define NFP_PKTGEN_WIRE_PORT(_nbi, _port) \
+    ((1 << 13) | ((_nbi) << 10) | (_port))
+
+/* Run time symbols of the pktgen app */
+#define NFP_PKTGEN_CFG_SYM      "_pktgen_cfg"
+#define NFP_PKTGEN_TMPL_SYM     "_pktgen_tmpl"
+#define NFP_PKTGEN_STATS_SYM    "_pktgen_stats"
+
+/* Set in nfp_pktgen_cfg.enable at the end of a run, keeping the run id */
+#define NFP_PKTGEN_DONE         0x80000000
+
+/**
+ * Generator configuration, as 32-bit words in the pktgen_cfg symbol.
+ */
+struct nfp_pktgen_cfg {
+    uint32_t enable;
+    uint32_t dst;
+    uint32_t interval;
+    uint32_t count;
+};
+
+/**
+ * Unpacked packet template.
+ */
+struct nfp_pktgen_tmpl {
+    uint16_t len;           /* Length of the packets */
+    uint8_t tmpl_len;       /* Bytes of data[] used, multiple of 4 */
+    uint8_t stamp_off;      /* Offset of the stamp, 0 for none */
+    uint32_t fill;          /* Pattern for the bytes after data[] */
+    uint8_t data[NFP_PKTGEN_TMPL_LW * 4];
+};
+
+/**
+ * Build a template for an Ethernet/IPv4/UDP packet.
+ *
+ * @param t         [out] Template
+ * @param dmac      [in] Destination MAC address
+ * @param smac      [in] Source MAC address
+ * @param sip       [in] Source IPv4 address, host byte order
+ * @param dip       [in] Destination IPv4 address, host byte order
+ * @param sport     [in] UDP source port
+ * @param dport     [in] UDP destination port
+ * @param len       [in] Length of the packets without FCS, 60 or more
+ *
+ * @return 0 on success, -1 if @len is out of range.
+ *
+ * The IPv4 header checksum is filled in and the UDP checksum is 0.  The
+ * stamp follows the UDP header after 2 bytes of padding, at offset 44.
+ */
+int nfp_pktgen_tmpl_udp(struct nfp_pktgen_tmpl *t, const uint8_t dmac[6],
+                        const uint8_t smac[6], uint32_t sip, uint32_t dip,
+                        uint16_t sport, uint16_t dport, unsigned int len);
+
+/**
+ * Check a template against the limits enforced by pktio_gen().
+ *
+ * @param t         [in] Template
+ *
+ * @return 0 if pktio_gen() accepts the template, -1 otherwise.
+ */
+int nfp_pktgen_tmpl_check(const struct nfp_pktgen_tmpl *t);
+
+/**
+ * Pack a template into the words of a struct pktio_gen_tmpl.
+ *
+ * @param t         [in] Template
+ * @param words     [out] NFP_PKTGEN_TMPL_SZ / 4 words to write to memory
+ */
+void nfp_pktgen_tmpl_pack(const struct nfp_pktgen_tmpl *t, uint32_t *words);
+
+/**
+ * Unpack the words of a struct pktio_gen_tmpl.
+ *
+ * @param words     [in] NFP_PKTGEN_TMPL_SZ / 4 words read from memory
+ * @param t         [out] Template
+ */
+void nfp_pktgen_tmpl_unpack(const uint32_t *words, struct nfp_pktgen_tmpl *t);
+
+/**
+ * Build the packet pktio_gen() builds from a template.
+ *
+ * @param words     [in] Packed template
+ * @param seq       [in] Sequence number
+ * @param tsc       [in] Timestamp counter value
+ * @param pkt       [out] Packet buffer
+ * @param size      [in] Size of @pkt
+ *
+ * @return the length of the packet, or -1 if pktio_gen() would reject the
+ * template or @pkt is too small.
+ */
+int nfp_pktgen_build(const uint32_t *words, uint32_t seq, uint64_t tsc,
+                     uint8_t *pkt, size_t size);
+
+/**
+ * Extract the stamp from a generated packet.
+ *
+ * @param pkt       [in] Packet
+ * @param len       [in] Length of @pkt
+ * @param stamp_off [in] Offset of the stamp
+ * @param seq       [out] Sequence number
+ * @param tsc       [out] Timestamp counter value
+ *
+ * @return 0 on success, -1 if the packet is too short.
+ */
+int nfp_pktgen_stamp(const uint8_t *pkt, size_t len, unsigned int stamp_off,
+                     uint32_t *seq, uint64_t *tsc);
+
+/**
+ * Compute the pktgen_cfg interval for a packet rate.
+ *
+ * @param pps       [in] Packets per second
+ * @param me_mhz    [in] ME clock in MHz
+ *
+ * @return the interval in timestamp ticks (16 ME cycles), 24.8 fixed
+ * point, or 0 if the rate is too low to represent.
+ */
+uint32_t nfp_pktgen_interval(double pps, double me_mhz);
+
+/**
+ * Compute the packet rate of a pktgen_cfg interval.
+ *
+ * @param interval  [in] Interval, 24.8 fixed point ticks
+ * @param me_mhz    [in] ME clock in MHz
+ *
+ * @return packets per second.
+ */
+double nfp_pktgen_rate(uint32_t interval, double me_mhz);
+
+#endif /* _LIBS_FLOWENV__NFP_PKTGEN_H_ */
@@ -0,0 +1,596 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/blm_class_model.c
+ * @brief         Host model of the memory efficiency of BLM buffer size
+ *                classes (me/blocks/blm, "Buffer size classes" in
+ *                blm_cfg.h)
+ *
+ * Replays a packet size mix, built in or read from a file, and places
+ * each packet in the smallest buffer class that holds the packet offset
+ * plus its length, as the NBI DMA does through the buffer pools and
+ * their BLQs.  The class configurations compared are:
+ *
+ * - a single class of 2048 byte buffers, the BLM default, which drops
+ *   the packets that do not fit;
+ * - a single class of buffers large enough for jumbo frames;
+ * - the BLM_SIZE_CLASSES configuration, 2048 byte buffers for BLQs 0
+ *   and 1 and large buffers for BLQs 2 and 3;
+ * - a custom list of classes, by default 256/512/2K/10K.  Classes that
+ *   are not multiples of 2048 bytes cannot be handed to the NBI, the
+ *   model reports them for comparison only.
+ *
+ * For each configuration the model reports the packet bytes over the
+ * buffer bytes held, and the packets in flight that a given amount of
+ * buffer memory allows if the BLQs are sized for the mix.
+ *
+ * BLM_SIZE_CLASSES gains over large buffers only, not over 2048 byte
+ * buffers:  on imix both are 17.7% efficient, as every packet below
+ * 2048 bytes takes a 2048 byte buffer either way.  Only the custom
+ * classes below 2048 bytes, which the NBI cannot use, do better.
+ *
+ * With -T the model runs its own scenarios instead and checks the class
+ * selection against the buffer pool thresholds, the efficiency of known
+ * mixes and the parsing of replay files.  The program exits with a
+ * failure if any check fails.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+#define MAX_CLASSES     8
+#define MAX_BINS        4096
+#define MAX_PKT_SIZE    16383   /* 14 bit length in the packet metadata */
+#define BUF_ALIGN       2048    /* MU address >> 11 in handles and BDs */
+
+#define CFG_2K          0
+#define CFG_LARGE       1
+#define CFG_CLASSES     2
+#define CFG_CUSTOM      3
+#define NUM_CFGS        4
+
+struct classes
+{
+    const char *name;
+    unsigned int num;
+    unsigned int size[MAX_CLASSES];     /* Ascending */
+};
+
+/* Packet sizes drawn uniformly from [lo, hi] with a relative weight */
+struct bin
+{
+    unsigned int lo;
+    unsigned int hi;
+    double weight;
+};
+
+struct mix
+{
+    const char *name;
+    unsigned int num;
+    struct bin bins[MAX_BINS];
+};
+
+struct parameters
+{
+    unsigned int offset;        /* PKT_NBI_OFFSET */
+    unsigned int large;         /* BLM_LARGE_PKTBUF_SIZE */
+    unsigned long pkts;
+    unsigned int mem_mb;        /* Buffer memory for the in-flight count */
+};
+
+struct result
+{
+    unsigned long stored;
+    unsigned long dropped;
+    uint64_t pkt_bytes;
+    uint64_t buf_bytes;
+    unsigned long cls[MAX_CLASSES];
+};
+
+static const struct mix builtin_mixes[] = {
+    {"imix", 3, {{64, 64, 7}, {594, 594, 4}, {1518, 1518, 1}}},
+    {"small", 1, {{64, 64, 1}}},
+    {"mtu", 1, {{1518, 1518, 1}}},
+    /* Requests and acks, full frames and jumbo frames of storage */
+    {"dc", 3, {{64, 256, 45}, {1518, 1518, 35}, {9018, 9018, 20}}},
+    {"jumbo", 1, {{9018, 9018, 1}}},
+};
+
+#define NUM_MIXES (sizeof(builtin_mixes) / sizeof(builtin_mixes[0]))
+
+static int failures;
+
+#define CHECK(_cond, ...)                                   \
+    do {                                                    \
+        if (!(_cond)) {                                     \
+            printf("FAIL: " __VA_ARGS__);                   \
+            printf("\n");                                   \
+            failures++;                                     \
+        }                                                   \
+    } while (0)
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t
+rng32(void)
+{
+    /* xorshift64*, deterministic so that runs are comparable */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 2685821657736338717ULL) >> 32;
+}
+
+static double
+rng_unit(void)
+{
+    return (double)rng32() / 4294967296.0;
+}
+
+/* Index of the smallest class that holds need bytes, -1 if none */
+static int
+class_of(const struct classes *c, unsigned int need)
+{
+    unsigned int i;
+
+    for (i = 0; i < c->num; i++) {
+        if (need <= c->size[i])
+            return i;
+    }
+    return -1;
+}
+
+static int
+classes_nbi_ok(const struct classes *c)
+{
+    unsigned int i;
+
+    for (i = 0; i < c->num; i++) {
+        if (c->size[i] % BUF_ALIGN)
+            return 0;
+    }
+    return 1;
+}
+
+static int
+classes_sort(struct classes *c)
+{
+    unsigned int i, j, t;
+
+    if (c->num == 0)
+        return -1;
+    for (i = 1; i < c->num; i++) {
+        for (j = i; j > 0 && c->size[j - 1] > c->size[j]; j--) {
+            t = c->size[j];
+            c->size[j] = c->size[j - 1];
+            c->size[j - 1] = t;
+        }
+    }
+    for (i = 0; i < c->num; i++) {
+        if (c->size[i] == 0 || (i > 0 && c->size[i] == c->size[i - 1]))
+            return -1;
+    }
+    return 0;
+}
+
+/* Parse a comma separated list of class sizes */
+static int
+classes_parse(struct classes *c, const char *s)
+{
+    char *end;
+    unsigned long v;
+
+    c->num = 0;
+    while (*s) {
+        if (c->num == MAX_CLASSES)
+            return -1;
+        v = strtoul(s, &end, 0);
+        if (end == s || v > 0xffffffffUL)
+            return -1;
+        c->size[c->num++] = v;
+        s = end;
+        if (*s == ',')
+            s++;
+        else if (*s)
+            return -1;
+    }
+    return classes_sort(c);
+}
+
+/*
+ * Read a replay file, one "<size> [<count>]" or "<lo>-<hi> [<count>]"
+ * per line, '#' starting a comment.  The count defaults to 1, so that a
+ * plain list of packet sizes, such as one dumped from a capture, replays
+ * as is.
+ */
+static int
+mix_read(struct mix *m, FILE *f)
+{
+    static unsigned int bin_of[MAX_PKT_SIZE + 1];   /* Of a size, + 1 */
+    char line[256], *s, *end;
+    unsigned long lo, hi;
+    double w;
+
+    memset(bin_of, 0, sizeof(bin_of));
+    m->num = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if ((s = strchr(line, '#')) != NULL)
+            *s = '\0';
+        s = line;
+        while (*s == ' ' || *s == '\t')
+            s++;
+        if (*s == '\n' || *s == '\0')
+            continue;
+        lo = strtoul(s, &end, 0);
+        if (end == s)
+            return -1;
+        hi = lo;
+        s = end;
+        if (*s == '-') {
+            hi = strtoul(s + 1, &end, 0);
+            if (end == s + 1)
+                return -1;
+            s = end;
+        }
+        w = 1;
+        if (*s == ' ' || *s == '\t') {
+            w = strtod(s, &end);
+            if (end == s)
+                w = 1;
+        }
+        if (lo == 0 || hi < lo || hi > MAX_PKT_SIZE || w <= 0)
+            return -1;
+        if (lo == hi && bin_of[lo] != 0) {
+            m->bins[bin_of[lo] - 1].weight += w;
+            continue;
+        }
+        if (lo == hi)
+            bin_of[lo] = m->num + 1;
+        if (m->num == MAX_BINS)
+            return -1;
+        m->bins[m->num].lo = lo;
+        m->bins[m->num].hi = hi;
+        m->bins[m->num].weight = w;
+        m->num++;
+    }
+    return m->num ? 0 : -1;
+}
+
+static unsigned int
+mix_draw(const struct mix *m, double total)
+{
+    double x = rng_unit() * total;
+    const struct bin *b = &m->bins[m->num - 1];
+    unsigned int i;
+
+    for (i = 0; i < m->num; i++) {
+        if (x < m->bins[i].weight) {
+            b = &m->bins[i];
+            break;
+        }
+        x -= m->bins[i].weight;
+    }
+    return b->lo + rng32() % (b->hi - b->lo + 1);
+}
+
+static void
+configs_init(struct classes *cfg, const struct parameters *p,
+             const struct classes *custom)
+{
+    memset(cfg, 0, sizeof(*cfg) * NUM_CFGS);
+    cfg[CFG_2K].name = "2K";
+    cfg[CFG_2K].num = 1;
+    cfg[CFG_2K].size[0] = 2048;
+    cfg[CFG_LARGE].name = "large";
+    cfg[CFG_LARGE].num = 1;
+    cfg[CFG_LARGE].size[0] = p->large;
+    cfg[CFG_CLASSES].name = "size classes";
+    cfg[CFG_CLASSES].num = 2;
+    cfg[CFG_CLASSES].size[0] = 2048;
+    cfg[CFG_CLASSES].size[1] = p->large;
+    cfg[CFG_CUSTOM] = *custom;
+    cfg[CFG_CUSTOM].name = "custom";
+}
+
+static void
+run(const struct parameters *p, const struct mix *m,
+    const struct classes *cfg, struct result *res)
+{
+    double total = 0;
+    unsigned int i, len;
+    unsigned long k;
+    int c;
+
+    memset(res, 0, sizeof(*res) * NUM_CFGS);
+    for (i = 0; i < m->num; i++)
+        total += m->bins[i].weight;
+
+    for (k = 0; k < p->pkts; k++) {
+        len = mix_draw(m, total);
+        for (i = 0; i < NUM_CFGS; i++) {
+            c = class_of(&cfg[i], p->offset + len);
+            if (c < 0) {
+                res[i].dropped++;
+                continue;
+            }
+            res[i].stored++;
+            res[i].cls[c]++;
+            res[i].pkt_bytes += len;
+            res[i].buf_bytes += cfg[i].size[c];
+        }
+    }
+}
+
+static double
+efficiency(const struct result *r)
+{
+    return r->buf_bytes ? (double)r->pkt_bytes / r->buf_bytes : 0;
+}
+
+/* Packets in flight in mem_mb of buffers shared out to the classes */
+static double
+in_flight(const struct parameters *p, const struct result *r)
+{
+    if (r->buf_bytes == 0)
+        return 0;
+    return (double)p->mem_mb * 1024 * 1024 * r->stored / r->buf_bytes;
+}
+
+static void
+report(const struct parameters *p, const struct mix *m,
+       const struct classes *cfg, const struct result *res)
+{
+    unsigned int i, c;
+
+    printf("mix %s, %lu packets, offset %u, %u MB of buffers\n\n", m->name,
+           p->pkts, p->offset, p->mem_mb);
+    printf("%-13s %-4s %10s %8s %10s  classes\n", "config", "nbi",
+           "efficiency", "dropped", "in flight");
+    for (i = 0; i < NUM_CFGS; i++) {
+        printf("%-13s %-4s %9.1f%% %7.2f%% %10.0f ", cfg[i].name,
+               classes_nbi_ok(&cfg[i]) ? "yes" : "no",
+               efficiency(&res[i]) * 100,
+               (double)res[i].dropped * 100 / p->pkts, in_flight(p, &res[i]));
+        for (c = 0; c < cfg[i].num; c++)
+            printf(" %u:%.1f%%", cfg[i].size[c],
+                   res[i].stored ?
+                   (double)res[i].cls[c] * 100 / res[i].stored : 0);
+        printf("\n");
+    }
+}
+
+static const struct mix *
+mix_find(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < NUM_MIXES; i++) {
+        if (strcmp(builtin_mixes[i].name, name) == 0)
+            return &builtin_mixes[i];
+    }
+    return NULL;
+}
+
+static void
+test_classes(const struct parameters *p)
+{
+    struct classes cfg[NUM_CFGS], c;
+
+    classes_parse(&c, "256,512,2048,10240");
+    configs_init(cfg, p, &c);
+
+    /* Buffer pool 1 takes packets up to 1984B, which fill 2048 bytes */
+    CHECK(class_of(&cfg[CFG_CLASSES], 64 + 1984) == 0 &&
+          class_of(&cfg[CFG_CLASSES], 64 + 1985) == 1,
+          "1984B threshold not at the 2048 byte class");
+    CHECK(class_of(&cfg[CFG_2K], 64 + 9018) == -1,
+          "jumbo frame fits a 2048 byte buffer");
+    CHECK(class_of(&cfg[CFG_CUSTOM], 64 + 100) == 0 &&
+          class_of(&cfg[CFG_CUSTOM], 64 + 300) == 1,
+          "custom classes not smallest fit");
+    CHECK(classes_nbi_ok(&cfg[CFG_CLASSES]) &&
+          !classes_nbi_ok(&cfg[CFG_CUSTOM]),
+          "NBI usable classes misreported");
+
+    CHECK(classes_parse(&c, "10240,2048") == 0 && c.size[0] == 2048 &&
+          c.size[1] == 10240, "class list not sorted");
+    CHECK(classes_parse(&c, "2048,2048") == -1, "duplicate class accepted");
+    CHECK(classes_parse(&c, "2048,x") == -1, "bad class list accepted");
+    CHECK(classes_parse(&c, "") == -1, "empty class list accepted");
+}
+
+static void
+test_mix_read(void)
+{
+    struct mix m;
+    FILE *f;
+
+    f = tmpfile();
+    if (f == NULL) {
+        CHECK(0, "no temporary file");
+        return;
+    }
+    fputs("# size count\n64 6\n\n594\t4\n1000-1500 2 # range\n64\n", f);
+    rewind(f);
+    CHECK(mix_read(&m, f) == 0 && m.num == 3 &&
+          m.bins[0].lo == 64 && m.bins[0].weight == 7 &&
+          m.bins[1].lo == 594 && m.bins[1].weight == 4 &&
+          m.bins[2].lo == 1000 && m.bins[2].hi == 1500 &&
+          m.bins[2].weight == 2, "replay file misread");
+    fclose(f);
+
+    f = tmpfile();
+    if (f == NULL)
+        return;
+    fputs("64\n20000\n", f);
+    rewind(f);
+    CHECK(mix_read(&m, f) == -1, "oversized packet accepted");
+    fclose(f);
+}
+
+static void
+self_test(const struct parameters *dflt)
+{
+    struct parameters p = *dflt;
+    struct classes cfg[NUM_CFGS], custom;
+    struct result res[NUM_CFGS];
+    double e;
+
+    test_classes(&p);
+    test_mix_read();
+
+    classes_parse(&custom, "256,512,2048,10240");
+    configs_init(cfg, &p, &custom);
+    p.pkts = 100000;
+
+    /* Minimum sized packets use 1/32 of a 2048 byte buffer */
+    run(&p, mix_find("small"), cfg, res);
+    e = efficiency(&res[CFG_2K]);
+    CHECK(e > 0.03124 && e < 0.03126, "small: 2K efficiency %.5f", e);
+    CHECK(res[CFG_CLASSES].buf_bytes == res[CFG_2K].buf_bytes,
+          "small: size classes differ from 2K");
+
+    /* Jumbo frames:  size classes cost nothing over large buffers */
+    run(&p, mix_find("jumbo"), cfg, res);
+    CHECK(res[CFG_2K].dropped == p.pkts, "jumbo: 2K stored %lu",
+          res[CFG_2K].stored);
+    CHECK(res[CFG_CLASSES].buf_bytes == res[CFG_LARGE].buf_bytes,
+          "jumbo: size classes differ from large buffers");
+
+    /*
+     * A data centre mix:  size classes hold the jumbo frames without
+     * dropping and keep several times the packets of large buffers in
+     * flight, the smaller custom classes do better still.
+     */
+    run(&p, mix_find("dc"), cfg, res);
+    CHECK(res[CFG_2K].dropped > p.pkts * 0.18 &&
+          res[CFG_2K].dropped < p.pkts * 0.22,
+          "dc: 2K dropped %lu", res[CFG_2K].dropped);
+    CHECK(res[CFG_CLASSES].dropped == 0 && res[CFG_LARGE].dropped == 0,
+          "dc: drops with large buffers");
+    CHECK(in_flight(&p, &res[CFG_CLASSES]) >
+          2.5 * in_flight(&p, &res[CFG_LARGE]),
+          "dc: in flight %.0f with size classes, %.0f with large buffers",
+          in_flight(&p, &res[CFG_CLASSES]), in_flight(&p, &res[CFG_LARGE]));
+    CHECK(efficiency(&res[CFG_CUSTOM]) > efficiency(&res[CFG_CLASSES]),
+          "dc: custom efficiency %.3f, size classes %.3f",
+          efficiency(&res[CFG_CUSTOM]), efficiency(&res[CFG_CLASSES]));
+    CHECK(efficiency(&res[CFG_CUSTOM]) < 1 &&
+          efficiency(&res[CFG_LARGE]) < efficiency(&res[CFG_CLASSES]),
+          "dc: efficiency out of order");
+}
+
+void usage(void)
+{
+    printf("blm_class_model [options]\n"
+           "options:\n"
+           " -d <name>  Built in packet size mix: imix, small, mtu, dc, "
+           "jumbo\n"
+           "            (default imix)\n"
+           " -f <file>  Replay the packet size mix of a file, lines of\n"
+           "            \"<size>|<lo>-<hi> [<count>]\"\n"
+           " -c <list>  Custom buffer classes (default 256,512,2048,10240)\n"
+           " -L <num>   Large buffer size, BLM_LARGE_PKTBUF_SIZE "
+           "(default 10240)\n"
+           " -o <num>   Packet offset in the buffer (default 64)\n"
+           " -n <num>   Packets (default 1000000)\n"
+           " -m <num>   MB of buffer memory (default 64)\n"
+           " -T         Run the self test instead\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct parameters p = {64, 10240, 1000000, 64};
+    struct classes cfg[NUM_CFGS], custom;
+    struct result res[NUM_CFGS];
+    static struct mix file_mix;
+    const struct mix *m = &builtin_mixes[0];
+    const char *clist = "256,512,2048,10240";
+    FILE *f;
+    int self = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "d:f:c:L:o:n:m:T")) != -1) {
+        switch (c) {
+        case 'd':
+            m = mix_find(optarg);
+            if (m == NULL) {
+                fprintf(stderr, "unknown mix %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'f':
+            f = fopen(optarg, "r");
+            if (f == NULL) {
+                perror(optarg);
+                exit(EXIT_FAILURE);
+            }
+            if (mix_read(&file_mix, f) != 0) {
+                fprintf(stderr, "invalid replay file %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            fclose(f);
+            file_mix.name = optarg;
+            m = &file_mix;
+            break;
+        case 'c':
+            clist = optarg;
+            break;
+        case 'L':
+            p.large = atoi(optarg);
+            break;
+        case 'o':
+            p.offset = atoi(optarg);
+            break;
+        case 'n':
+            p.pkts = atol(optarg);
+            break;
+        case 'm':
+            p.mem_mb = atoi(optarg);
+            break;
+        case 'T':
+            self = 1;
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (classes_parse(&custom, clist) != 0 || p.large <= 2048 ||
+        p.pkts == 0 || p.mem_mb == 0) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if (self) {
+        self_test(&p);
+    } else {
+        configs_init(cfg, &p, &custom);
+        run(&p, m, cfg, res);
+        report(&p, m, cfg, res);
+    }
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
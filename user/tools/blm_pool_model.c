@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/blm_pool_model.c
+ * @brief         Host model of the BLM buffer accounting and debug tags
+ *
+ * The firmware side is replayed against memory:  blm_pool_sample() and
+ * blm_init_lm() of blm_main.uc are mirrored for the free buffer
+ * watermarks and the low pool event, and the tagging of libblm.c and
+ * blm_api.uc for the debug tags.  The host side is the real
+ * nfp_blm_stat_read(), nfp_blm_in_use*(), nfp_blm_dbg_err_read(),
+ * nfp_blm_dbg_next_gen() and nfp_blm_dbg_scan() reading the symbols from
+ * that memory.  unit_tests/utfe_blm_dbg.c tests the Micro-C tags on an
+ * ME; the watermarks are sampled by the BLM ME only, which the unit test
+ * harness does not load.
+ *
+ * Checks cover the watermarks over a random load, an unsampled BLQ, the
+ * low pool event and its hysteresis, double frees, the allocations that
+ * must be tagged to avoid a false double free, and the census of the
+ * tags by age.
+ *
+ * The program exits with a failure if any check fails.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nfp_blm_stat.h"
+
+#define KEY_BITS        10      /* BLM_BUF_DEBUG_KEY_BITS */
+#define NUM_TAGS        (1 << KEY_BITS)
+#define ISLAND          48
+#define TOTAL           1024    /* Buffers of a BLQ, EMU ring and BDSRAM */
+#define LOW_THRESH      100     /* BLM_POOL_LOW_THRESH */
+#define LOW_HYST        64      /* BLM_POOL_LOW_HYST */
+#define DISARMED        (1u << 31)  /* BLM_POOL_EVENT_DISARMED_bit */
+
+static int failures;
+
+#define CHECK(_cond, ...)                                   \
+    do {                                                    \
+        if (!(_cond)) {                                     \
+            printf("FAIL: " __VA_ARGS__);                   \
+            printf("\n");                                   \
+            failures++;                                     \
+        }                                                   \
+    } while (0)
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t
+rng32(void)
+{
+    /* xorshift64*, deterministic so that runs are comparable */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 2685821657736338717ULL) >> 32;
+}
+
+/* Firmware state: the symbols and the LMEM of the BLM ME */
+struct fw {
+    uint32_t stats[NFP_BLM_NUM_BLQ][NFP_BLM_STATS_LW];
+    uint32_t tags[NUM_TAGS];
+    uint32_t gen[2];
+    uint32_t err[4];
+    uint32_t free_min[NFP_BLM_NUM_BLQ];     /* LM */
+    uint32_t free_max[NFP_BLM_NUM_BLQ];     /* LM */
+    uint32_t event[NFP_BLM_NUM_BLQ];        /* LM, DISARMED only */
+    unsigned int events_sent;
+};
+
+static struct fw fw;
+
+/* blm_init_lm() and blm_init_pool_total() */
+static void
+fw_init(void)
+{
+    unsigned int blq;
+
+    memset(&fw, 0, sizeof(fw));
+    fw.gen[0] = 1;
+    fw.gen[1] = KEY_BITS;
+    for (blq = 0; blq < NFP_BLM_NUM_BLQ; blq++) {
+        fw.free_min[blq] = 0x7fffffff;
+        fw.stats[blq][NFP_BLM_POOL_TOTAL * 2] = TOTAL;
+    }
+}
+
+/* blm_pool_sample() */
+static void
+fw_pool_sample(unsigned int blq, uint32_t free)
+{
+    uint32_t *st = fw.stats[blq];
+
+    if (free < fw.free_min[blq])
+        fw.free_min[blq] = free;
+    if (free > fw.free_max[blq])
+        fw.free_max[blq] = free;
+
+    st[NFP_BLM_POOL_FREE * 2] = free;
+    st[NFP_BLM_POOL_FREE * 2 + 1] = 0;
+    st[NFP_BLM_POOL_FREE_MIN * 2] = fw.free_min[blq];
+    st[NFP_BLM_POOL_FREE_MIN * 2 + 1] = 0;
+    st[NFP_BLM_POOL_FREE_MAX * 2] = fw.free_max[blq];
+    st[NFP_BLM_POOL_FREE_MAX * 2 + 1] = 0;
+
+    if (free < LOW_THRESH) {
+        if (!(fw.event[blq] & DISARMED)) {
+            fw.event[blq] |= DISARMED;
+            fw.events_sent++;
+            st[NFP_BLM_POOL_LOW_EVNTS * 2]++;
+        }
+    } else if (free >= LOW_THRESH + LOW_HYST) {
+        fw.event[blq] &= ~DISARMED;
+    }
+}
+
+/* _blm_dbg_gen_tag() */
+static uint32_t
+fw_gen_tag(void)
+{
+    return fw.gen[0] << 1;
+}
+
+/* blm_buf_dbg_alloc(), and blm_buf_alloc() which calls it */
+static void
+fw_dbg_alloc(uint32_t buf)
+{
+    fw.tags[buf & (NUM_TAGS - 1)] = fw_gen_tag();
+}
+
+/* _blm_dbg_free(), from blm_buf_free() */
+static void
+fw_dbg_free(uint32_t buf, unsigned int blq)
+{
+    uint32_t *tag = &fw.tags[buf & (NUM_TAGS - 1)];
+    uint32_t old = *tag;
+
+    *tag = fw_gen_tag() | NFP_BLM_DBG_TAG_FREE;
+    if (old & NFP_BLM_DBG_TAG_FREE) {
+        fw.err[0]++;
+        fw.err[1] = buf;
+        fw.err[2] = blq;
+        fw.err[3] = old;
+    }
+}
+
+/* blm_dbg_tag(set_imm) of the BLM, freeing the buffers of the TM */
+static void
+fw_dbg_tm_free(uint32_t buf)
+{
+    fw.tags[buf & (NUM_TAGS - 1)] |= NFP_BLM_DBG_TAG_FREE;
+}
+
+/* blm_dbg_tag(clr_imm), of the BLM filling its cache for the NBI DMA and
+ * of nfp_blm_buf_dbg_alloc() in blm_api.uc */
+static void
+fw_dbg_clr(uint32_t buf)
+{
+    fw.tags[buf & (NUM_TAGS - 1)] &= ~NFP_BLM_DBG_TAG_FREE;
+}
+
+static uint32_t *
+sym_addr(const char *sym, size_t len, uint64_t off)
+{
+    uint32_t *base;
+    size_t size;
+    unsigned int isl, blq;
+
+    if (sscanf(sym, NFP_BLM_STATS_SYM_FMT, &isl, &blq) == 2 &&
+        isl == ISLAND && blq < NFP_BLM_NUM_BLQ) {
+        base = fw.stats[blq];
+        size = sizeof(fw.stats[blq]);
+    } else if (strcmp(sym, NFP_BLM_DBG_TAGS_SYM) == 0) {
+        base = fw.tags;
+        size = sizeof(fw.tags);
+    } else if (strcmp(sym, NFP_BLM_DBG_GEN_SYM) == 0) {
+        base = fw.gen;
+        size = sizeof(fw.gen);
+    } else if (strcmp(sym, NFP_BLM_DBG_ERR_SYM) == 0) {
+        base = fw.err;
+        size = sizeof(fw.err);
+    } else {
+        return NULL;
+    }
+
+    if (off % 4 || off + len > size)
+        return NULL;
+    return base + off / 4;
+}
+
+static int
+mem_read(void *priv, const char *sym, uint32_t *words, size_t len,
+         uint64_t off)
+{
+    uint32_t *p = sym_addr(sym, len, off);
+
+    if (!p)
+        return -1;
+    memcpy(words, p, len);
+    return 0;
+}
+
+static int
+mem_write(void *priv, const char *sym, const uint32_t *words, size_t len,
+          uint64_t off)
+{
+    uint32_t *p = sym_addr(sym, len, off);
+
+    if (!p)
+        return -1;
+    memcpy(p, words, len);
+    return 0;
+}
+
+static const struct nfp_blm_stat_io io = {mem_read, mem_write, NULL};
+
+static void
+check_watermarks(void)
+{
+    struct nfp_blm_stat st;
+    uint32_t free = TOTAL, lo = TOTAL, hi = 0;
+    unsigned int i;
+
+    fw_init();
+    for (i = 0; i < 10000; i++) {
+        /* A random walk of the free buffers of BLQ 1 */
+        if (rng32() & 1)
+            free = (free < TOTAL) ? free + 1 : free;
+        else
+            free = (free > 0) ? free - 1 : free;
+        if (free < lo)
+            lo = free;
+        if (free > hi)
+            hi = free;
+        fw_pool_sample(1, free);
+    }
+
+    CHECK(nfp_blm_stat_read(&io, ISLAND, &st) == 0, "stat read");
+    CHECK(st.blq[1].sampled, "BLQ 1 not sampled");
+    CHECK(st.blq[1].total == TOTAL, "total %llu",
+          (unsigned long long)st.blq[1].total);
+    CHECK(st.blq[1].free == free && st.blq[1].free_min == lo &&
+          st.blq[1].free_max == hi, "free %llu min %llu max %llu, "
+          "expected %u %u %u", (unsigned long long)st.blq[1].free,
+          (unsigned long long)st.blq[1].free_min,
+          (unsigned long long)st.blq[1].free_max, free, lo, hi);
+    CHECK(nfp_blm_in_use(&st.blq[1]) == TOTAL - free &&
+          nfp_blm_in_use_hwm(&st.blq[1]) == TOTAL - lo &&
+          nfp_blm_in_use_lwm(&st.blq[1]) == TOTAL - hi,
+          "in use %llu hwm %llu lwm %llu",
+          (unsigned long long)nfp_blm_in_use(&st.blq[1]),
+          (unsigned long long)nfp_blm_in_use_hwm(&st.blq[1]),
+          (unsigned long long)nfp_blm_in_use_lwm(&st.blq[1]));
+
+    /* A BLQ never sampled reports nothing in use */
+    CHECK(!st.blq[2].sampled && nfp_blm_in_use(&st.blq[2]) == 0 &&
+          nfp_blm_in_use_hwm(&st.blq[2]) == 0, "BLQ 2 sampled");
+
+    /* The cold start watermarks do not leak into the stats */
+    fw_init();
+    fw_pool_sample(0, 700);
+    CHECK(nfp_blm_stat_read(&io, ISLAND, &st) == 0, "stat read");
+    CHECK(st.blq[0].free_min == 700 && st.blq[0].free_max == 700,
+          "first sample min %llu max %llu",
+          (unsigned long long)st.blq[0].free_min,
+          (unsigned long long)st.blq[0].free_max);
+}
+
+static void
+check_low_event(void)
+{
+    struct nfp_blm_stat st;
+
+    fw_init();
+    fw_pool_sample(3, LOW_THRESH);
+    CHECK(fw.events_sent == 0, "event at the threshold");
+    fw_pool_sample(3, LOW_THRESH - 1);
+    fw_pool_sample(3, 0);
+    CHECK(fw.events_sent == 1, "%u events below the threshold",
+          fw.events_sent);
+
+    /* Not re-armed short of the hysteresis */
+    fw_pool_sample(3, LOW_THRESH + LOW_HYST - 1);
+    fw_pool_sample(3, LOW_THRESH - 1);
+    CHECK(fw.events_sent == 1, "re-armed inside the hysteresis");
+
+    fw_pool_sample(3, LOW_THRESH + LOW_HYST);
+    fw_pool_sample(3, LOW_THRESH - 1);
+    CHECK(fw.events_sent == 2, "not re-armed after recovery");
+
+    CHECK(nfp_blm_stat_read(&io, ISLAND, &st) == 0, "stat read");
+    CHECK(st.blq[3].low_events == 2, "%llu low events counted",
+          (unsigned long long)st.blq[3].low_events);
+}
+
+static void
+check_tags(void)
+{
+    struct nfp_blm_dbg_err err;
+    struct nfp_blm_dbg_scan sc;
+    uint32_t gen;
+
+    fw_init();
+
+    /* blm_buf_alloc() then blm_buf_free() */
+    fw_dbg_alloc(0x10);
+    fw_dbg_free(0x10, 0);
+    CHECK(nfp_blm_dbg_err_read(&io, &err) == 0, "err read");
+    CHECK(err.double_frees == 0, "false double free of a C alloc");
+
+    /* A second free */
+    fw_dbg_free(0x10, 0);
+    CHECK(nfp_blm_dbg_err_read(&io, &err) == 0, "err read");
+    CHECK(err.double_frees == 1 && err.last_handle == 0x10 &&
+          err.last_blq == 0 && err.last_tag == (fw_gen_tag() | 1),
+          "double free: %u, handle 0x%x", err.double_frees,
+          err.last_handle);
+
+    /* __blm_buf_alloc() with sig_done, not passed to blm_buf_dbg_alloc():
+     * the buffer is still tagged free, which is why the call is needed */
+    fw_dbg_free(0x11, 1);
+    fw_dbg_free(0x11, 1);
+    CHECK(nfp_blm_dbg_err_read(&io, &err) == 0, "err read");
+    CHECK(err.double_frees == 2, "untagged sig_done alloc not reported");
+
+    /* The same with blm_buf_dbg_alloc(), and the microcode allocations
+     * with nfp_blm_buf_dbg_alloc() */
+    fw_dbg_alloc(0x11);
+    fw_dbg_free(0x11, 1);
+    fw_dbg_free(0x12, 2);
+    fw_dbg_clr(0x12);
+    fw_dbg_free(0x12, 2);
+    CHECK(nfp_blm_dbg_err_read(&io, &err) == 0, "err read");
+    CHECK(err.double_frees == 2, "false double free of a tagged alloc");
+
+    /* Buffers of the NBI:  the BLM clears the tag filling its cache and
+     * sets it again taking them back from the TM */
+    fw_dbg_clr(0x13);
+    fw_dbg_tm_free(0x13);
+    fw_dbg_clr(0x13);
+    fw_dbg_free(0x13, 0);
+    CHECK(nfp_blm_dbg_err_read(&io, &err) == 0, "err read");
+    CHECK(err.double_frees == 2, "false double free of an NBI buffer");
+
+    /* Census: 0x20 out for 3 generations, 0x21 out for none */
+    fw_dbg_alloc(0x20);
+    CHECK(nfp_blm_dbg_next_gen(&io, &gen) == 0 && gen == 2, "gen %u", gen);
+    CHECK(nfp_blm_dbg_next_gen(&io, &gen) == 0 && gen == 3, "gen %u", gen);
+    CHECK(nfp_blm_dbg_next_gen(&io, &gen) == 0 && gen == 4, "gen %u", gen);
+    fw_dbg_alloc(0x21);
+    CHECK(nfp_blm_dbg_scan(&io, 0, NULL, NULL, &sc) == 0, "scan");
+    CHECK(sc.gen == 4 && sc.out == 2 && sc.free == 4 &&
+          sc.untagged == NUM_TAGS - 6,
+          "scan: out %llu free %llu untagged %llu",
+          (unsigned long long)sc.out, (unsigned long long)sc.free,
+          (unsigned long long)sc.untagged);
+    /* 0x21 is age 0, 0x20 age 3 */
+    CHECK(sc.age[0] == 1 && sc.age[2] == 1, "ages %llu %llu",
+          (unsigned long long)sc.age[0], (unsigned long long)sc.age[2]);
+}
+
+int main(int argc, char *argv[])
+{
+    check_watermarks();
+    check_low_event();
+    check_tags();
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/blm_stat.c
+ * @brief         Report the BLM buffer accounting, stats and buffer tags.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <nfp.h>
+#include <nfp_nffw.h>
+
+#include "nfp_blm_stat.h"
+
+struct parameters
+{
+    int nfp_num;
+    unsigned int island;
+    unsigned int watch_ms;
+    int cntrs;
+    int errors;
+    int next_gen;
+    int scan;
+    uint32_t min_age;
+    unsigned int max_report;
+};
+
+static const char *cntr_names[NFP_BLM_NUM_CNTRS] = {
+    "cache_refills", "emu_ring_underflow", "recycle_direct",
+    "recycle_tm_to_emu", "recycle_tm_to_cache", "recycle_cache_to_dma",
+    "recycle_cache_low", "dma_events", "tm_events", "dma_null_recycle",
+    "tm_null_recycle", "alarms"
+};
+
+void usage(void)
+{
+    printf("blm_stat [options]\n"
+           "options:\n"
+           " -n, --nfp <nfp num>    Select which NFP to access (default 0)\n"
+           " -l, --island <island>  Island of the BLM instance (default 48)\n"
+           " -w, --watch <ms>       Report again every interval\n"
+           " -c, --cntrs            Print the BLM counters of each BLQ\n"
+           " -e, --errors           Print the double frees caught, with\n"
+           "                        BLM_BUF_DEBUG\n"
+           " -g, --next-gen         Advance the generation of the buffer\n"
+           "                        tags, with BLM_BUF_DEBUG\n"
+           " -s, --scan <age>       Count the buffer tags and list the\n"
+           "                        buffers out for at least <age>\n"
+           "                        generations, with BLM_BUF_DEBUG\n"
+           " -m, --max <num>        Most buffers to list with -s\n"
+           "                        (default 32)\n\n");
+}
+
+static const struct option g_opt[] = {
+    {"help",     no_argument,        NULL, 'h'},
+    {"nfp",      required_argument,  NULL, 'n'},
+    {"island",   required_argument,  NULL, 'l'},
+    {"watch",    required_argument,  NULL, 'w'},
+    {"cntrs",    no_argument,        NULL, 'c'},
+    {"errors",   no_argument,        NULL, 'e'},
+    {"next-gen", no_argument,        NULL, 'g'},
+    {"scan",     required_argument,  NULL, 's'},
+    {"max",      required_argument,  NULL, 'm'},
+    {NULL,       0, 0, '\0'}
+};
+
+static const char *g_optstr = "hn:l:w:cegs:m:";
+
+void parse_params(int argc, char *argv[], struct parameters *p)
+{
+    int c;
+
+    while ((c = getopt_long(argc, argv, g_optstr, g_opt, NULL)) != -1) {
+        switch (c) {
+        case 'h':
+            usage();
+            exit(EXIT_SUCCESS);
+            break;
+        case 'n':
+            p->nfp_num = atoi(optarg);
+            break;
+        case 'l':
+            p->island = atoi(optarg);
+            break;
+        case 'w':
+            p->watch_ms = atoi(optarg);
+            break;
+        case 'c':
+            p->cntrs = 1;
+            break;
+        case 'e':
+            p->errors = 1;
+            break;
+        case 'g':
+            p->next_gen = 1;
+            break;
+        case 's':
+            p->scan = 1;
+            p->min_age = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            p->max_report = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Unknown option: '%c'\n", c);
+            usage();
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    if (p->watch_ms && (p->next_gen || p->scan)) {
+        fprintf(stderr, "-g and -s report once, without -w\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int
+rtsym_read(void *priv, const char *name, uint32_t *words, size_t len,
+           uint64_t off)
+{
+    struct nfp_device *nfp = priv;
+    const struct nfp_rtsym *sym;
+
+    sym = nfp_rtsym_lookup(nfp, name);
+    if (!sym)
+        return -1;
+    return nfp_rtsym_read(nfp, sym, words, len, off) < 0 ? -1 : 0;
+}
+
+static int
+rtsym_write(void *priv, const char *name, const uint32_t *words, size_t len,
+            uint64_t off)
+{
+    struct nfp_device *nfp = priv;
+    const struct nfp_rtsym *sym;
+
+    sym = nfp_rtsym_lookup(nfp, name);
+    if (!sym)
+        return -1;
+    return nfp_rtsym_write(nfp, sym, words, len, off) < 0 ? -1 : 0;
+}
+
+static void
+print_stat(const struct nfp_blm_stat *st, const struct parameters *p)
+{
+    const struct nfp_blm_blq_stat *bs;
+    unsigned int blq, i;
+
+    printf("BLM in island %u, buffers in use now and lowest/highest since "
+           "loaded\n", st->island);
+    printf("%3s %8s %8s %8s %8s %8s %10s\n", "blq", "total", "free",
+           "in_use", "lwm", "hwm", "low_evnts");
+    for (blq = 0; blq < NFP_BLM_NUM_BLQ; blq++) {
+        bs = &st->blq[blq];
+        if (!bs->sampled) {
+            printf("%3u %8llu %8s %8s %8s %8s %10llu\n", blq,
+                   (unsigned long long)bs->total, "-", "-", "-", "-",
+                   (unsigned long long)bs->low_events);
+            continue;
+        }
+        printf("%3u %8llu %8llu %8llu %8llu %8llu %10llu\n", blq,
+               (unsigned long long)bs->total,
+               (unsigned long long)bs->free,
+               (unsigned long long)nfp_blm_in_use(bs),
+               (unsigned long long)nfp_blm_in_use_lwm(bs),
+               (unsigned long long)nfp_blm_in_use_hwm(bs),
+               (unsigned long long)bs->low_events);
+    }
+
+    if (!p->cntrs)
+        return;
+    for (blq = 0; blq < NFP_BLM_NUM_BLQ; blq++) {
+        printf("blq %u:", blq);
+        for (i = 0; i < NFP_BLM_NUM_CNTRS; i++) {
+            if (st->blq[blq].cntr[i] != 0)
+                printf(" %s:%llu", cntr_names[i],
+                       (unsigned long long)st->blq[blq].cntr[i]);
+        }
+        printf("\n");
+    }
+}
+
+struct scan_report {
+    uint32_t gen;
+    unsigned int max;
+    unsigned int listed;
+};
+
+static void
+report_out(void *priv, uint32_t key, uint32_t tag)
+{
+    struct scan_report *r = priv;
+
+    if (r->listed++ >= r->max)
+        return;
+    printf("  key 0x%06x gen %u age %u\n", key,
+           tag >> NFP_BLM_DBG_TAG_GEN_SHF, nfp_blm_dbg_tag_age(tag, r->gen));
+}
+
+static int
+scan(const struct nfp_blm_stat_io *io, const struct parameters *p)
+{
+    struct nfp_blm_dbg_scan sc;
+    struct scan_report r;
+    uint32_t gen;
+    unsigned int b;
+
+    /* For the ages in the report */
+    if (io->read(io->priv, NFP_BLM_DBG_GEN_SYM, &gen, sizeof(gen), 0) < 0)
+        return -1;
+    memset(&r, 0, sizeof(r));
+    r.gen = gen;
+    r.max = p->max_report;
+
+    printf("buffers out for %u generations or more:\n", p->min_age);
+    if (nfp_blm_dbg_scan(io, p->min_age, report_out, &r, &sc) < 0)
+        return -1;
+    if (r.listed > r.max)
+        printf("  ... %u more\n", r.listed - r.max);
+
+    printf("generation %u: %llu untagged, %llu free, %llu out\n", sc.gen,
+           (unsigned long long)sc.untagged, (unsigned long long)sc.free,
+           (unsigned long long)sc.out);
+    printf("out by age:");
+    for (b = 0; b < NFP_BLM_DBG_AGE_NBUCKETS; b++) {
+        if (sc.age[b] == 0)
+            continue;
+        if (b == 0)
+            printf(" 0:%llu", (unsigned long long)sc.age[b]);
+        else if (b == NFP_BLM_DBG_AGE_NBUCKETS - 1)
+            printf(" >=%u:%llu", 1u << (b - 1),
+                   (unsigned long long)sc.age[b]);
+        else
+            printf(" <%u:%llu", 1u << b, (unsigned long long)sc.age[b]);
+    }
+    printf("\n");
+    return 0;
+}
+
+static int
+debug(const struct nfp_blm_stat_io *io, const struct parameters *p)
+{
+    struct nfp_blm_dbg_err err;
+    uint32_t gen;
+
+    if (p->errors) {
+        if (nfp_blm_dbg_err_read(io, &err) < 0)
+            return -1;
+        printf("double frees %u", err.double_frees);
+        if (err.double_frees)
+            printf(", last handle 0x%08x blq %u freed in generation %u",
+                   err.last_handle, err.last_blq,
+                   err.last_tag >> NFP_BLM_DBG_TAG_GEN_SHF);
+        printf("\n");
+    }
+    if (p->scan && scan(io, p) < 0)
+        return -1;
+    if (p->next_gen) {
+        if (nfp_blm_dbg_next_gen(io, &gen) < 0)
+            return -1;
+        printf("generation advanced to %u\n", gen);
+    }
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    struct parameters p;
+    struct nfp_device *nfp;
+    struct nfp_blm_stat_io io;
+    struct nfp_blm_stat st;
+    int ret = 0;
+
+    memset(&p, 0, sizeof(p));
+    p.island = 48;
+    p.max_report = 32;
+    parse_params(argc, argv, &p);
+
+    nfp = nfp_device_open(p.nfp_num);
+    if (!nfp) {
+        fprintf(stderr, "Failed to open NFP device %d\n", p.nfp_num);
+        exit(EXIT_FAILURE);
+    }
+    io.read = rtsym_read;
+    io.write = rtsym_write;
+    io.priv = nfp;
+
+    for (;;) {
+        if (nfp_blm_stat_read(&io, p.island, &st) < 0) {
+            fprintf(stderr, "Failed to read the BLM stats, is BLM loaded "
+                    "in island %u?\n", p.island);
+            ret = -1;
+            break;
+        }
+        print_stat(&st, &p);
+        if ((p.errors || p.scan || p.next_gen) && debug(&io, &p) < 0) {
+            fprintf(stderr, "Failed to read the buffer tags, is BLM built "
+                    "with BLM_BUF_DEBUG?\n");
+            ret = -1;
+            break;
+        }
+        if (!p.watch_ms)
+            break;
+        usleep(p.watch_ms * 1000);
+        printf("\n");
+    }
+
+    nfp_device_close(nfp);
+    return ret < 0 ? EXIT_FAILURE : 0;
+}
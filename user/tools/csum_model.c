@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/csum_model.c
+ * @brief         Cost model of ones_sum_mem() (me/lib/net/_c/csum.c)
+ *
+ * Follows the reads and the summing of ones_sum_mem() for one context,
+ * chunk by chunk, and turns them into ME cycles per byte for two loops:
+ *
+ *  - serial:     the single buffered loop ones_sum_mem_serial() of
+ *                unit_tests/utfe_csum.c, which waits for each 64B read
+ *                before summing it.
+ *  - pipelined:  ones_sum_mem(), which keeps the read of the next chunk
+ *                in flight while summing the current one.
+ *
+ * A read completes a latency after its issue, but not before the previous
+ * read has moved its data, at a number of cycles per 64B.  The cost of
+ * summing a chunk follows ones_sum_warr().  Latencies are parameters, in
+ * ME cycles.  The figures are a model of the code, not a measurement on
+ * hardware:  the unit test utfe_csum_ones_sum_mem_bench measures the same
+ * sizes in the simulator.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+
+#define CHUNK           64      /* Transfer registers per buffer, bytes */
+
+struct parameters
+{
+    unsigned int lat;           /* Read latency */
+    unsigned int xfer;          /* Data transfer per 64B read */
+    unsigned int issue;         /* Instructions to issue a read */
+    unsigned int swap;          /* Context swap out and back in */
+    unsigned int mhz;           /* ME clock */
+};
+
+struct cost
+{
+    unsigned long cycles;
+    unsigned long reads;
+    unsigned long bytes;        /* Summed */
+};
+
+/* Memory:  when the data of a read issued at t is in the registers */
+static unsigned long
+mem_read(const struct parameters *p, unsigned long t, unsigned long *busy)
+{
+    unsigned long done = t + p->lat;
+
+    if (done < *busy + p->xfer)
+        done = *busy + p->xfer;
+    *busy = done;
+    return done;
+}
+
+/*
+ * ones_sum_warr() and ones_sum_add():  the T_INDEX setup and its latency,
+ * the jump into the unrolled adds, one add per word and the partial word.
+ */
+static unsigned int
+sum_cycles(unsigned int len)
+{
+    return 4 + 4 + 3 + len / 4 + 1 + ((len & 3) ? 6 : 0) + 2;
+}
+
+static struct cost
+serial(const struct parameters *p, unsigned int len)
+{
+    struct cost c = {0, 0, 0};
+    unsigned long t = 0, busy = 0;
+    unsigned int chunk;
+
+    while (len > 0) {
+        chunk = len > CHUNK ? CHUNK : len;
+        t += p->issue;
+        t = mem_read(p, t, &busy) + p->swap;
+        t += sum_cycles(chunk);
+        c.reads++;
+        c.bytes += chunk;
+        len -= chunk;
+    }
+    c.cycles = t;
+    return c;
+}
+
+/* ONES_SUM_MEM_ISSUE() into buffer b */
+static void
+issue(const struct parameters *p, struct cost *c, unsigned long *t,
+      unsigned long *busy, unsigned int *len, unsigned int *chunk,
+      unsigned long *done)
+{
+    *chunk = *len > CHUNK ? CHUNK : *len;
+    *t += p->issue;
+    *done = mem_read(p, *t, busy);
+    *len -= *chunk;
+    c->reads++;
+}
+
+static struct cost
+pipelined(const struct parameters *p, unsigned int len)
+{
+    struct cost c = {0, 0, 0};
+    unsigned long t = 0, busy = 0;
+    unsigned long done[2];
+    unsigned int chunk[2];
+    int b = 0;
+
+    if (len == 0)
+        return c;
+
+    issue(p, &c, &t, &busy, &len, &chunk[0], &done[0]);
+    for (;;) {
+        chunk[!b] = 0;
+        if (len > 0)
+            issue(p, &c, &t, &busy, &len, &chunk[!b], &done[!b]);
+
+        /* wait_for_all() only swaps out if the read is still in flight */
+        if (t < done[b])
+            t = done[b] + p->swap;
+        t += sum_cycles(chunk[b]);
+        c.bytes += chunk[b];
+        if (chunk[!b] == 0)
+            break;
+        b = !b;
+    }
+    c.cycles = t;
+    return c;
+}
+
+static void
+usage(void)
+{
+    printf("csum_model [options]\n"
+           "options:\n"
+           " -l <num>  Read latency, cycles (default 250)\n"
+           " -x <num>  Data transfer per 64B read, cycles (default 8)\n"
+           " -i <num>  Instructions to issue a read (default 8)\n"
+           " -s <num>  Context swap, cycles (default 4)\n"
+           " -f <num>  ME clock in MHz (default 1000)\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const unsigned int sizes[] = {64, 1500, 9000};
+    struct parameters p = {250, 8, 8, 4, 1000};
+    struct cost s, q;
+    unsigned int i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:x:i:s:f:")) != -1) {
+        switch (opt) {
+        case 'l':
+            p.lat = atoi(optarg);
+            break;
+        case 'x':
+            p.xfer = atoi(optarg);
+            break;
+        case 'i':
+            p.issue = atoi(optarg);
+            break;
+        case 's':
+            p.swap = atoi(optarg);
+            break;
+        case 'f':
+            p.mhz = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (p.mhz < 1) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    printf("read latency %u, transfer %u/64B, issue %u, swap %u cycles, "
+           "%u MHz, one context\n\n", p.lat, p.xfer, p.issue, p.swap,
+           p.mhz);
+    printf("size  reads  serial cycles  cycles/B  pipelined cycles  "
+           "cycles/B  speedup  MB/s\n");
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        s = serial(&p, sizes[i]);
+        q = pipelined(&p, sizes[i]);
+        if (s.bytes != sizes[i] || q.bytes != sizes[i] ||
+            s.reads != q.reads) {
+            fprintf(stderr, "size %u: loops disagree\n", sizes[i]);
+            exit(EXIT_FAILURE);
+        }
+        printf("%4u  %5lu  %13lu  %8.2f  %16lu  %8.2f  %6.2fx  %4lu\n",
+               sizes[i], s.reads, s.cycles, (double)s.cycles / sizes[i],
+               q.cycles, (double)q.cycles / sizes[i],
+               (double)s.cycles / q.cycles,
+               (unsigned long)sizes[i] * p.mhz / q.cycles);
+    }
+
+    return 0;
+}
@@ -0,0 +1,564 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/gro_flow_model.c
+ * @brief         Host model of the load of the GRO blocks under flow
+ *                spreading (me/blocks/gro, FLOW SPREADING in gro.uc)
+ *
+ * Draws packets from a set of flows whose rates follow a Zipf law, with
+ * one hot port carrying a given share of the traffic, and counts the
+ * packets that each GRO block releases when:
+ *
+ * - each port has its own reorder context, as with the NBI sequencers
+ *   mapped 1:1 to contexts, the ports dealt round robin over the blocks;
+ * - the flows are spread by their hash over the contexts of all blocks
+ *   through the initial _gro_flow_tbl of gro_declare_block();
+ * - the table is also rebalanced after each round of packets, on the
+ *   load of its blocks and table entries in that round, as "gro_stat -r"
+ *   does:  nfp_gro_flow_drain() allows the moves fenced the round before
+ *   and nfp_gro_flow_rebalance() fences new ones.  The first packet
+ *   through an entry allowed to move completes the move, as if its old
+ *   context had drained, so a move takes effect two rounds after it was
+ *   chosen.
+ *
+ * The load of the busiest block over the mean bounds the throughput of
+ * the GRO blocks to mean / max of what they could release together.  For
+ * the rebalanced table the model also reports the entries fenced and the
+ * moves completed.
+ *
+ * With -T the model runs its own scenarios instead and checks that
+ * spreading balances a hot port, that rebalancing helps with elephant
+ * flows and leaves a balanced table alone, and the invariants of
+ * nfp_gro_flow_rebalance().  The program exits with a failure if any
+ * check fails.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "nfp_gro_flow.h"
+
+#define MAX_BLOCKS      64
+#define MAX_CTX_PER_BLK 8       /* GRO_MAX_CTX_PER_BLOCK */
+
+#define MODE_SEQR       0
+#define MODE_FLOW       1
+#define MODE_REBAL      2
+#define NUM_MODES       3
+
+struct parameters
+{
+    unsigned int blocks;
+    unsigned int ctx_per_block;
+    unsigned int flow_ctx;      /* GRO_FLOW_CTX_PER_BLOCK, from context 0 */
+    unsigned int ports;
+    unsigned int flows;
+    double zipf;
+    double hot;                 /* Share of the traffic on port 0 */
+    unsigned int rounds;
+    unsigned long pkts;         /* Per round */
+    double tol;
+    unsigned int max_moves;     /* Per round */
+};
+
+struct result
+{
+    double blk[MAX_BLOCKS];     /* Share of the packets, over all rounds */
+    double imbalance;           /* Busiest block / mean, over all rounds */
+    double last;                /* Busiest block / mean, last round */
+    unsigned long moves;        /* Entries fenced */
+    unsigned long done;         /* Moves completed */
+};
+
+static const char *mode_names[NUM_MODES] = {
+    "per port", "flow hash", "rebalanced"
+};
+
+static int failures;
+
+#define CHECK(_cond, ...)                                   \
+    do {                                                    \
+        if (!(_cond)) {                                     \
+            printf("FAIL: " __VA_ARGS__);                   \
+            printf("\n");                                   \
+            failures++;                                     \
+        }                                                   \
+    } while (0)
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t
+rng32(void)
+{
+    /* xorshift64*, deterministic so that runs are comparable */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 2685821657736338717ULL) >> 32;
+}
+
+static double
+rng_unit(void)
+{
+    return (double)rng32() / 4294967296.0;
+}
+
+static void *
+xcalloc(size_t n, size_t sz)
+{
+    void *p = calloc(n ? n : 1, sz);
+
+    if (p == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+/* Stand-in for the NBI flow hash of a 5-tuple */
+static uint32_t
+flow_hash(unsigned int flow)
+{
+    uint32_t h = flow * 0x9e3779b1u + 0x7f4a7c15u;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/* The .init of _gro_flow_tbl in gro_declare_block() */
+static void
+tbl_init(uint32_t *tbl, const struct parameters *p)
+{
+    unsigned int i, b;
+
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++) {
+        b = i % p->blocks;
+        tbl[i] = b * p->ctx_per_block + (i / p->blocks) % p->flow_ctx;
+    }
+}
+
+/* Cumulative rates of the flows, and the port of each */
+static double *
+flows_init(const struct parameters *p, unsigned int *port)
+{
+    double *cum = xcalloc(p->flows, sizeof(*cum));
+    double hot_sum = 0, cold_sum = 0, w;
+    unsigned int i;
+
+    for (i = 0; i < p->flows; i++) {
+        port[i] = flow_hash(i ^ 0x5bd1e995u) % p->ports;
+        w = 1 / pow(i + 1, p->zipf);
+        if (port[i] == 0)
+            hot_sum += w;
+        else
+            cold_sum += w;
+    }
+
+    for (i = 0; i < p->flows; i++) {
+        w = 1 / pow(i + 1, p->zipf);
+        if (p->ports > 1 && hot_sum > 0 && cold_sum > 0)
+            w *= (port[i] == 0) ? p->hot / hot_sum : (1 - p->hot) / cold_sum;
+        cum[i] = (i ? cum[i - 1] : 0) + w;
+    }
+    return cum;
+}
+
+static unsigned int
+flow_draw(const double *cum, unsigned int n)
+{
+    double x = rng_unit() * cum[n - 1];
+    unsigned int lo = 0, hi = n - 1, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (cum[mid] <= x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static double
+busiest(const uint64_t *blk, unsigned int n)
+{
+    uint64_t max = 0, sum = 0;
+    unsigned int b;
+
+    for (b = 0; b < n; b++) {
+        sum += blk[b];
+        if (blk[b] > max)
+            max = blk[b];
+    }
+    return sum ? (double)max * n / sum : 0;
+}
+
+static void
+run(const struct parameters *p, struct result *res)
+{
+    unsigned int nctx = p->blocks * p->ctx_per_block;
+    unsigned int *port = xcalloc(p->flows, sizeof(*port));
+    double *cum = flows_init(p, port);
+    uint64_t *load = xcalloc(nctx, sizeof(*load));
+    uint64_t ent[NFP_GRO_FLOW_TBL_SIZE];
+    uint64_t total[NUM_MODES][MAX_BLOCKS];
+    uint64_t blk[NUM_MODES][MAX_BLOCKS];
+    uint32_t tbl[NFP_GRO_FLOW_TBL_SIZE];
+    uint32_t static_tbl[NFP_GRO_FLOW_TBL_SIZE];
+    unsigned int r, f, m, b, ctx, i;
+    unsigned long k;
+    int moved;
+
+    memset(res, 0, sizeof(*res) * NUM_MODES);
+    memset(total, 0, sizeof(total));
+    tbl_init(static_tbl, p);
+    memcpy(tbl, static_tbl, sizeof(tbl));
+
+    for (r = 0; r < p->rounds; r++) {
+        memset(blk, 0, sizeof(blk));
+        memset(load, 0, nctx * sizeof(*load));
+        memset(ent, 0, sizeof(ent));
+        for (k = 0; k < p->pkts; k++) {
+            f = flow_draw(cum, p->flows);
+
+            /* Ports dealt round robin over the blocks */
+            b = port[f] % p->blocks;
+            blk[MODE_SEQR][b]++;
+
+            ctx = static_tbl[NFP_GRO_FLOW_TBL_IDX(flow_hash(f))];
+            blk[MODE_FLOW][ctx / p->ctx_per_block]++;
+
+            i = NFP_GRO_FLOW_TBL_IDX(flow_hash(f));
+            if (tbl[i] & NFP_GRO_FLOW_ENT_DRAIN) {
+                tbl[i] = NFP_GRO_FLOW_ENT_NEXT(tbl[i]);
+                res[MODE_REBAL].done++;
+            }
+            ctx = NFP_GRO_FLOW_ENT_CTX(tbl[i]);
+            blk[MODE_REBAL][ctx / p->ctx_per_block]++;
+            load[ctx]++;
+            ent[i]++;
+        }
+
+        for (m = 0; m < NUM_MODES; m++) {
+            for (b = 0; b < p->blocks; b++)
+                total[m][b] += blk[m][b];
+            res[m].last = busiest(blk[m], p->blocks);
+        }
+
+        nfp_gro_flow_drain(tbl);
+        moved = nfp_gro_flow_rebalance(tbl, ent, load, nctx,
+                                       p->ctx_per_block, p->tol,
+                                       p->max_moves);
+        if (moved < 0) {
+            fprintf(stderr, "invalid flow table\n");
+            exit(EXIT_FAILURE);
+        }
+        res[MODE_REBAL].moves += moved;
+    }
+
+    for (m = 0; m < NUM_MODES; m++) {
+        res[m].imbalance = busiest(total[m], p->blocks);
+        for (b = 0; b < p->blocks; b++)
+            res[m].blk[b] = (double)total[m][b] / (p->pkts * p->rounds);
+    }
+
+    free(port);
+    free(cum);
+    free(load);
+}
+
+static void
+report(const struct parameters *p, const struct result *res)
+{
+    unsigned int m, b;
+
+    printf("%u blocks of %u contexts (%u for flows), %u ports, "
+           "port 0 %.0f%%\n", p->blocks, p->ctx_per_block, p->flow_ctx,
+           p->ports, p->hot * 100);
+    printf("%u flows, zipf %.2f, %u rounds of %lu packets\n\n", p->flows,
+           p->zipf, p->rounds, p->pkts);
+
+    printf("%-11s %9s %9s %10s  block shares\n", "mapping", "max/mean",
+           "last", "throughput");
+    for (m = 0; m < NUM_MODES; m++) {
+        printf("%-11s %9.3f %9.3f %9.1f%% ", mode_names[m], res[m].imbalance,
+               res[m].last, 100 / res[m].imbalance);
+        for (b = 0; b < p->blocks; b++)
+            printf(" %5.1f%%", res[m].blk[b] * 100);
+        printf("\n");
+    }
+    printf("\nrebalancing fenced %lu entries, %lu moves completed\n",
+           res[MODE_REBAL].moves, res[MODE_REBAL].done);
+}
+
+static int
+param_check(const struct parameters *p)
+{
+    return p->blocks >= 1 && p->blocks <= MAX_BLOCKS &&
+        p->ctx_per_block >= 1 && p->ctx_per_block <= MAX_CTX_PER_BLK &&
+        (p->ctx_per_block & (p->ctx_per_block - 1)) == 0 &&
+        p->flow_ctx >= 1 && p->flow_ctx <= p->ctx_per_block &&
+        p->ports >= 1 && p->flows >= 1 && p->rounds >= 1 && p->pkts >= 1 &&
+        p->hot >= 0 && p->hot <= 1 && p->zipf >= 0 && p->tol >= 0;
+}
+
+/* Set the load of the contexts to that of their entries */
+static void
+ctx_load_sum(const uint32_t *tbl, const uint64_t *ent, uint64_t *ctx,
+             unsigned int nctx)
+{
+    unsigned int i;
+
+    memset(ctx, 0, nctx * sizeof(*ctx));
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++)
+        ctx[NFP_GRO_FLOW_ENT_CTX(tbl[i])] += ent[i];
+}
+
+static void
+test_rebalance(void)
+{
+    uint32_t tbl[NFP_GRO_FLOW_TBL_SIZE], orig[NFP_GRO_FLOW_TBL_SIZE];
+    uint32_t fenced[NFP_GRO_FLOW_TBL_SIZE];
+    uint64_t ent[NFP_GRO_FLOW_TBL_SIZE];
+    uint64_t load[16], blk[4];
+    unsigned int nent[16];
+    struct parameters p;
+    unsigned int i, n;
+    int moved;
+
+    memset(&p, 0, sizeof(p));
+    p.blocks = 4;
+    p.ctx_per_block = 4;
+    p.flow_ctx = 4;
+    tbl_init(tbl, &p);
+    memcpy(orig, tbl, sizeof(tbl));
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++)
+        ent[i] = 100;
+    ctx_load_sum(tbl, ent, load, 16);
+    CHECK(nfp_gro_flow_rebalance(tbl, ent, load, 16, 4, 0.1, 64) == 0 &&
+          memcmp(tbl, orig, sizeof(tbl)) == 0, "balanced table changed");
+
+    /* All of the load on context 0:  it gives entries, keeps one */
+    memset(ent, 0, sizeof(ent));
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++)
+        ent[i] = (tbl[i] == 0) ? 1000 : 0;
+    ctx_load_sum(tbl, ent, load, 16);
+    moved = nfp_gro_flow_rebalance(tbl, ent, load, 16, 4, 0.1, 256);
+    memset(nent, 0, sizeof(nent));
+    memset(blk, 0, sizeof(blk));
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++) {
+        nent[NFP_GRO_FLOW_ENT_NEXT(tbl[i])]++;
+        blk[NFP_GRO_FLOW_ENT_NEXT(tbl[i]) / 4] += ent[i];
+    }
+    CHECK(moved > 0 && nent[0] >= 1, "hot context: %d moves, %u entries left",
+          moved, nent[0]);
+    CHECK(busiest(blk, 4) < 1.1, "hot context: max/mean %.3f after %d moves",
+          busiest(blk, 4), moved);
+    for (i = 0, n = 0; i < 16; i++)
+        n += (nent[i] == 0);
+    CHECK(n == 0, "%u contexts lost all their entries", n);
+
+    /* The entries moved are fenced on their old context, and stay so */
+    for (i = 0, n = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++) {
+        if (tbl[i] != orig[i] &&
+            (NFP_GRO_FLOW_ENT_CTX(tbl[i]) != orig[i] ||
+             (tbl[i] & (NFP_GRO_FLOW_ENT_FENCE | NFP_GRO_FLOW_ENT_DRAIN)) !=
+             NFP_GRO_FLOW_ENT_FENCE))
+            n++;
+    }
+    CHECK(n == 0, "%u entries moved without a fence", n);
+    memcpy(fenced, tbl, sizeof(tbl));
+    nfp_gro_flow_rebalance(tbl, ent, load, 16, 4, 0.1, 256);
+    for (i = 0, n = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++)
+        n += ((fenced[i] & NFP_GRO_FLOW_ENT_FENCE) && tbl[i] != fenced[i]);
+    CHECK(n == 0, "%u fenced entries moved again", n);
+
+    /* Only fenced entries are allowed to drain, once */
+    memcpy(tbl, fenced, sizeof(tbl));
+    CHECK(nfp_gro_flow_drain(tbl) == moved && nfp_gro_flow_drain(tbl) == 0,
+          "drain did not allow each of %d moves once", moved);
+    for (i = 0, n = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++) {
+        if (!(tbl[i] & NFP_GRO_FLOW_ENT_DRAIN) !=
+            !(fenced[i] & NFP_GRO_FLOW_ENT_FENCE))
+            n++;
+    }
+    CHECK(n == 0, "%u entries drained wrongly", n);
+
+    /* Bounded moves */
+    memcpy(tbl, orig, sizeof(tbl));
+    CHECK(nfp_gro_flow_rebalance(tbl, ent, load, 16, 4, 0.1, 3) == 3,
+          "max_moves not honoured");
+
+    /* A single elephant entry would only move the imbalance elsewhere */
+    memcpy(tbl, orig, sizeof(tbl));
+    memset(ent, 0, sizeof(ent));
+    ent[0] = 10000;
+    ctx_load_sum(tbl, ent, load, 16);
+    CHECK(nfp_gro_flow_rebalance(tbl, ent, load, 16, 4, 0.1, 8) == 0,
+          "elephant entry moved");
+
+    /* The entries of non-flow contexts are never taken or given */
+    p.flow_ctx = 2;
+    tbl_init(tbl, &p);
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++)
+        ent[i] = (tbl[i] == 0) ? 500 : 0;
+    ctx_load_sum(tbl, ent, load, 16);
+    load[3] = 100000;
+    moved = nfp_gro_flow_rebalance(tbl, ent, load, 16, 4, 0.1, 256);
+    for (i = 0, n = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++)
+        n += (NFP_GRO_FLOW_ENT_NEXT(tbl[i]) % 4 >= 2);
+    CHECK(moved > 0 && n == 0, "%u entries on non-flow contexts", n);
+
+    tbl[7] = 16;
+    CHECK(nfp_gro_flow_rebalance(tbl, ent, load, 16, 4, 0.1, 8) == -1,
+          "invalid entry accepted");
+}
+
+static void
+self_test(const struct parameters *dflt)
+{
+    struct parameters p = *dflt;
+    struct result res[NUM_MODES];
+
+    test_rebalance();
+
+    /* A hot port: one block per port is lopsided, hashing is not */
+    p.hot = 0.6;
+    p.zipf = 0.8;
+    p.flows = 8192;
+    run(&p, res);
+    CHECK(res[MODE_SEQR].imbalance > 2.0,
+          "hot port: per port max/mean %.3f", res[MODE_SEQR].imbalance);
+    CHECK(res[MODE_FLOW].imbalance < 1.15,
+          "hot port: flow hash max/mean %.3f", res[MODE_FLOW].imbalance);
+
+    /* Uniform traffic:  the initial table is already balanced */
+    p.hot = 1.0 / p.ports;
+    p.zipf = 0;
+    run(&p, res);
+    CHECK(res[MODE_REBAL].moves == 0 && res[MODE_REBAL].imbalance < 1.1,
+          "uniform: %lu moves, max/mean %.3f", res[MODE_REBAL].moves,
+          res[MODE_REBAL].imbalance);
+
+    /* Elephants:  rebalancing converges below the static table */
+    p.zipf = 1.1;
+    p.flows = 512;
+    p.rounds = 20;
+    run(&p, res);
+    CHECK(res[MODE_REBAL].last < res[MODE_FLOW].last &&
+          res[MODE_REBAL].last < 1.25,
+          "elephants: rebalanced max/mean %.3f, static %.3f",
+          res[MODE_REBAL].last, res[MODE_FLOW].last);
+    CHECK(res[MODE_REBAL].moves <= 2 * p.max_moves,
+          "elephants: %lu moves in %u rounds", res[MODE_REBAL].moves,
+          p.rounds);
+}
+
+void usage(void)
+{
+    printf("gro_flow_model [options]\n"
+           "options:\n"
+           " -b <num>  GRO blocks (default 4)\n"
+           " -c <num>  Contexts per block (default 4)\n"
+           " -f <num>  Flow spreading contexts per block (default 4)\n"
+           " -P <num>  Ports (default 8)\n"
+           " -F <num>  Flows (default 4096)\n"
+           " -z <num>  Zipf exponent of the flow rates (default 1.0)\n"
+           " -H <num>  Share of the traffic on port 0 (default 0.5)\n"
+           " -r <num>  Rounds (default 10)\n"
+           " -n <num>  Packets per round (default 200000)\n"
+           " -t <num>  Imbalance tolerated by rebalancing (default 0.1)\n"
+           " -m <num>  Entries moved per round at most (default 16)\n"
+           " -T        Run the self test instead\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct parameters p = {4, 4, 4, 8, 4096, 1.0, 0.5, 10, 200000, 0.1, 16};
+    struct result res[NUM_MODES];
+    int self = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:c:f:P:F:z:H:r:n:t:m:T")) != -1) {
+        switch (c) {
+        case 'b':
+            p.blocks = atoi(optarg);
+            break;
+        case 'c':
+            p.ctx_per_block = atoi(optarg);
+            break;
+        case 'f':
+            p.flow_ctx = atoi(optarg);
+            break;
+        case 'P':
+            p.ports = atoi(optarg);
+            break;
+        case 'F':
+            p.flows = atoi(optarg);
+            break;
+        case 'z':
+            p.zipf = atof(optarg);
+            break;
+        case 'H':
+            p.hot = atof(optarg);
+            break;
+        case 'r':
+            p.rounds = atoi(optarg);
+            break;
+        case 'n':
+            p.pkts = atol(optarg);
+            break;
+        case 't':
+            p.tol = atof(optarg);
+            break;
+        case 'm':
+            p.max_moves = atoi(optarg);
+            break;
+        case 'T':
+            self = 1;
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!param_check(&p)) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if (self) {
+        self_test(&p);
+    } else {
+        run(&p, res);
+        report(&p, res);
+    }
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
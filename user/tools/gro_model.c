@@ -0,0 +1,1422 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/gro_model.c
+ * @brief         Host model of the GRO reorder algorithm (me/blocks/gro)
+ *
+ * Replays a trace of packets through a model of the GRO clients and the
+ * GRO.OUT dispatchers, to size NUMENT and SKIDLEN for gro_declare_ctx()
+ * and GRO_RELEASE_RING_SIZE without hardware.
+ *
+ * Each reorder context has the ticket tapes of the memory unit bitmap:
+ * word 0 holds the epoch in bits 8-9 and the next ticket in bits 0-6,
+ * the other words a bit per pending ticket, and release_ticket behaves as
+ * described in the NFP-6xxx databook, 9.2.2.1.2.10.  The client side
+ * mirrors _gro_cli_send() in gro.uc:  the metadata write, the release of
+ * the first ticket, the cascade to ticket 0 of the following tapes, the
+ * retries while a tape is in the skid and the fatal ticket errors.  The
+ * dispatcher side mirrors gro_out_dispatch() and reset_next_bitmap() in
+ * _uc/gro_out.uc:  it walks the reorder queue for each release message
+ * and resets the tape SKIDLEN entries behind it, in the next epoch, each
+ * time it crosses a tape.  The initial state is that of the .init
+ * directives of gro_declare_ctx() for the given ISEQ.
+ *
+ * Time is in ME cycles.  Memory operations take a fixed latency, a
+ * client sleeps GRO_SEQ_OVERFLOW_TICKS between retries, and a dispatcher
+ * takes a fixed time per release message plus per packet.
+ *
+ * A trace has one packet per line, "ctx seq arrival latency", where the
+ * client calls gro_cli_send() 'latency' cycles after 'arrival'.  Lines
+ * starting with '#' are ignored.  Without a trace a synthetic one is
+ * generated.  The model reports reorder queue occupancy, release latency
+ * percentiles and the NUMENT and release ring depth the trace needed.
+ *
+ * With -w the model adds the lost sequence watchdog of _gro_out_wd():  each
+ * block visits one of its contexts per interval and, once a hole at the
+ * head has been waiting with later tickets released for the timeout,
+ * marks the entry with GRO_META_WD_SKIP, releases its ticket, steps over
+ * it, dispatches what that releases and cascades.  The timeout is fixed
+ * rather than adaptive, and a visit is atomic.  Clients then test the tape
+ * before writing the entry, as _gro_cli_test_skipped() does:  a late
+ * client claims the marker and is counted as skipped, one that finds no
+ * marker is a fatal duplicate, and one that the watchdog overtakes
+ * between the test and its release is skipped on the ticket error.
+ *
+ * With -T the model runs its own scenarios instead, covering in order and
+ * reordered traffic, sequence and epoch wrap, the skid, a non-zero ISEQ,
+ * an overrun of the reorder queue, and with the watchdog lost, late,
+ * racing, duplicate and lapped packets, and checks that packets leave
+ * exactly once and in order.  The program exits with a failure if any
+ * check fails.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+/* From me/blocks/gro/gro.h and gro.uc */
+#define GRO_TICKET_PER_TAPE     64
+#define GRO_SEQSKID_VALUE       65
+#define GRO_TICKET_msk          0x3F
+#define GRO_TICKET_ERROR        0xFF
+#define GRO_TAPE_SEQ_msk        0x7F
+#define GRO_NUM_EPOCHS          4
+#define GRO_EPOCH_msk           0x3
+#define GRO_EPOCH_shf           8
+#define GRO_SEQ_OVERFLOW_TICKS  (2560 / 16)
+#define GRO_META_WD_SKIP_SIG    0xA5C00000
+#define GRO_META_WD_SKIP_TICKET_shf 8
+
+#define TICKS_CYCLES            16
+
+#define MAX_CTX                 256
+#define MAX_NUMENT              65536
+
+/* Clients retrying this long with no packet sent or released: deadlock */
+#define STALL_CYCLES            10000000
+
+/* Client send phases, see _gro_cli_send() */
+#define PH_CHECK        0
+#define PH_META         1
+#define PH_TICKET       2
+#define PH_CASCADE      3
+
+#define EV_SEND         0
+#define EV_PUT          1
+#define EV_DISP         2
+#define EV_WD           3
+
+struct parameters
+{
+    unsigned int nent;          /* NUMENT */
+    unsigned int skid;          /* SKIDLEN */
+    unsigned int iseq;          /* ISEQ */
+    unsigned int ctx_per_block; /* GRO_CTX_PER_BLOCK */
+    unsigned int ring_size;     /* GRO_RELEASE_RING_SIZE, in bytes */
+    unsigned int mem_lat;       /* Cycles per memory operation */
+    unsigned int disp_msg;      /* Dispatcher cycles per release message */
+    unsigned int disp_pkt;      /* Dispatcher cycles per packet */
+    unsigned int wd_timeout;    /* Watchdog timeout in cycles, 0 is off */
+    unsigned int wd_interval;   /* Cycles between watchdog visits */
+};
+
+/* Synthetic trace */
+struct gen
+{
+    unsigned long pkts;
+    unsigned int ctxs;
+    unsigned int gap;           /* Cycles between arrivals */
+    unsigned int lat;           /* Minimum worker latency */
+    unsigned int jitter;        /* Worker latency spread */
+};
+
+struct pkt
+{
+    unsigned int ctx;
+    uint64_t seq;
+    uint64_t arrival;
+    uint64_t ready;             /* arrival + latency */
+};
+
+struct tape
+{
+    uint32_t w0;
+    uint64_t bits;              /* Bit i is ticket i + 1 */
+};
+
+struct ctx
+{
+    struct tape *tapes;
+    unsigned int ntapes;
+    int64_t *q;                 /* Packet index in each entry, or -1 */
+    uint32_t *mark;             /* Word 0 of each entry, if a skip marker */
+
+    /* GRO.OUT LM_CTX_*, in queue entries and tape indices */
+    unsigned int q_addrlo;
+    unsigned int q_bm_reset;
+    unsigned int bm_next;
+    unsigned int rst_epoch;
+
+    uint64_t next_out;          /* Sequence number the dispatcher expects */
+    uint64_t max_seq;           /* Highest sequence number written */
+    int written;
+
+    unsigned long occ;          /* Written, not yet dispatched */
+    unsigned long occ_max;
+    uint64_t window_max;
+    double occ_area;
+    uint64_t occ_t;
+    unsigned long retries;
+
+    /* LM_CTX_WD_* */
+    unsigned int wd_head;
+    uint64_t wd_ts;
+    unsigned long wd_skips;
+};
+
+struct msg
+{
+    unsigned int ctx;
+    unsigned int nrel;
+};
+
+struct block
+{
+    struct msg *ring;
+    unsigned long cap, head, count;
+    unsigned long count_max;
+    int busy;
+    unsigned long msgs;
+    unsigned long rel;
+    unsigned int wd_next;       /* Context of the block to visit next */
+};
+
+struct send
+{
+    unsigned long pkt;
+    int phase;
+    unsigned int tape;
+    unsigned int epoch;
+};
+
+struct event
+{
+    uint64_t t;
+    uint64_t order;
+    int type;
+    unsigned long arg;          /* send index, or block */
+    struct msg m;
+};
+
+struct model
+{
+    struct parameters p;
+    struct pkt *pkts;
+    unsigned long npkts;
+    unsigned int nctx;
+    struct ctx ctx[MAX_CTX];
+    struct block *blocks;
+    unsigned int nblocks;
+    struct send *sends;
+
+    struct event *ev;
+    unsigned long nev, ev_cap;
+    unsigned long nwd;          /* EV_WD events among them */
+    uint64_t ev_order;
+    uint64_t now;
+    uint64_t progress;          /* Last time a packet was sent or released */
+    int deadlock;
+
+    uint32_t *lat;              /* Release latency of each packet */
+    unsigned long out;
+    unsigned long fatal;
+    unsigned long misorder;
+    unsigned long claimed;      /* Late sends that found the skip marker */
+    unsigned long raced;        /* Late sends skipped on the ticket error */
+    int quiet;
+};
+
+static int failures;
+
+#define CHECK(_cond, ...)                                   \
+    do {                                                    \
+        if (!(_cond)) {                                     \
+            printf("FAIL: " __VA_ARGS__);                   \
+            printf("\n");                                   \
+            failures++;                                     \
+        }                                                   \
+    } while (0)
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t
+rng32(void)
+{
+    /* xorshift64*, deterministic so that runs are comparable */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 2685821657736338717ULL) >> 32;
+}
+
+static void *
+xcalloc(size_t n, size_t sz)
+{
+    void *p = calloc(n ? n : 1, sz);
+
+    if (p == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static unsigned int
+log2u(uint64_t x)
+{
+    unsigned int l = 0;
+
+    while ((1ULL << l) < x)
+        l++;
+    return l;
+}
+
+/*
+ * release_ticket on a ticket tape.  Returns the number of tickets
+ * released, 0 if the ticket was queued or GRO_TICKET_ERROR.
+ */
+static unsigned int
+tape_release(struct tape *tp, uint32_t ticket)
+{
+    unsigned int t = ticket & GRO_TAPE_SEQ_msk;
+    unsigned int ts = tp->w0 & GRO_TAPE_SEQ_msk;
+    unsigned int n;
+
+    if (((ticket ^ tp->w0) >> GRO_EPOCH_shf) & GRO_EPOCH_msk ||
+        ts > GRO_TICKET_PER_TAPE || t < ts)
+        return GRO_TICKET_ERROR;
+
+    if (t > ts) {
+        if (tp->bits & (1ULL << (t - 1)))
+            return GRO_TICKET_ERROR;
+        tp->bits |= 1ULL << (t - 1);
+        return 0;
+    }
+
+    /* In order:  release it and the run of pending tickets after it */
+    for (n = 1, ts++; ts <= GRO_TICKET_PER_TAPE &&
+         (tp->bits & (1ULL << (ts - 1))); n++, ts++)
+        tp->bits &= ~(1ULL << (ts - 1));
+    tp->w0 = (tp->w0 & ~GRO_TAPE_SEQ_msk) | ts;
+    return n;
+}
+
+/* GRO_META_WD_SKIP for a ticket */
+static uint32_t
+wd_marker(uint32_t ticket)
+{
+    return GRO_META_WD_SKIP_SIG | (ticket << GRO_META_WD_SKIP_TICKET_shf);
+}
+
+/* ticket_passed():  the tape moved past ticket_seq of epoch */
+static int
+tape_passed(const struct tape *tp, unsigned int ticket_seq,
+            unsigned int epoch)
+{
+    unsigned int tape_epoch = (tp->w0 >> GRO_EPOCH_shf) & GRO_EPOCH_msk;
+
+    if (tape_epoch == ((epoch - 1) & GRO_EPOCH_msk))
+        return 0;
+    if (tape_epoch != epoch)
+        return 1;
+    return (tp->w0 & GRO_TAPE_SEQ_msk) > ticket_seq;
+}
+
+/* The .init of the LM_CTX_* and the bitmap in gro_declare_ctx() */
+static void
+ctx_init(struct ctx *c, const struct parameters *p)
+{
+    unsigned int skidoff = p->nent - p->skid;
+    unsigned int itape = p->iseq / GRO_TICKET_PER_TAPE;
+    unsigned int im1 = GRO_NUM_EPOCHS - 1;
+    unsigned int k;
+
+    c->ntapes = p->nent / GRO_TICKET_PER_TAPE;
+    c->tapes = xcalloc(c->ntapes, sizeof(*c->tapes));
+    c->q = xcalloc(p->nent, sizeof(*c->q));
+    c->mark = xcalloc(p->nent, sizeof(*c->mark));
+    for (k = 0; k < p->nent; k++)
+        c->q[k] = -1;
+
+    c->q_addrlo = p->iseq;
+    c->q_bm_reset = (p->iseq + GRO_TICKET_PER_TAPE) / GRO_TICKET_PER_TAPE *
+        GRO_TICKET_PER_TAPE;
+    c->bm_next = (itape * GRO_TICKET_PER_TAPE + skidoff) % p->nent /
+        GRO_TICKET_PER_TAPE;
+    c->rst_epoch = (itape * GRO_TICKET_PER_TAPE + skidoff < p->nent) ? 0 : 1;
+
+    /* The tapes before the initial one are used after the wrap */
+    for (k = 0; k < c->ntapes; k++) {
+        if (k == itape)
+            c->tapes[k].w0 = (p->iseq % GRO_TICKET_PER_TAPE) + 1;
+        else if (p->skid > 0 && k < itape &&
+                 (itape < p->skid / GRO_TICKET_PER_TAPE ||
+                  k >= itape - p->skid / GRO_TICKET_PER_TAPE))
+            c->tapes[k].w0 = GRO_SEQSKID_VALUE;
+        else if (p->skid > 0 &&
+                 itape * GRO_TICKET_PER_TAPE + skidoff < p->nent &&
+                 k >= itape + skidoff / GRO_TICKET_PER_TAPE)
+            c->tapes[k].w0 = GRO_SEQSKID_VALUE | (im1 << GRO_EPOCH_shf);
+        else if (k < itape)
+            c->tapes[k].w0 = 1 << GRO_EPOCH_shf;
+        else
+            c->tapes[k].w0 = 0;
+    }
+
+    c->next_out = p->iseq;
+    c->wd_head = c->q_addrlo;
+}
+
+static void
+ev_push(struct model *m, uint64_t t, int type, unsigned long arg,
+        const struct msg *msg)
+{
+    struct event e = {t, m->ev_order++, type, arg, {0, 0}};
+    unsigned long i;
+
+    if (msg != NULL)
+        e.m = *msg;
+    if (type == EV_WD)
+        m->nwd++;
+
+    if (m->nev == m->ev_cap) {
+        m->ev_cap = m->ev_cap ? m->ev_cap * 2 : 1024;
+        m->ev = realloc(m->ev, m->ev_cap * sizeof(*m->ev));
+        if (m->ev == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Binary heap on (time, order of insertion) */
+    for (i = m->nev++; i > 0; i = (i - 1) / 2) {
+        struct event *up = &m->ev[(i - 1) / 2];
+
+        if (up->t < e.t || (up->t == e.t && up->order < e.order))
+            break;
+        m->ev[i] = *up;
+    }
+    m->ev[i] = e;
+}
+
+static struct event
+ev_pop(struct model *m)
+{
+    struct event top = m->ev[0];
+    struct event last = m->ev[--m->nev];
+    unsigned long i = 0, c;
+
+    while ((c = 2 * i + 1) < m->nev) {
+        if (c + 1 < m->nev &&
+            (m->ev[c + 1].t < m->ev[c].t ||
+             (m->ev[c + 1].t == m->ev[c].t &&
+              m->ev[c + 1].order < m->ev[c].order)))
+            c++;
+        if (last.t < m->ev[c].t ||
+            (last.t == m->ev[c].t && last.order < m->ev[c].order))
+            break;
+        m->ev[i] = m->ev[c];
+        i = c;
+    }
+    m->ev[i] = last;
+    return top;
+}
+
+static void
+occ_update(struct model *m, struct ctx *c, long delta)
+{
+    c->occ_area += (double)c->occ * (m->now - c->occ_t);
+    c->occ_t = m->now;
+    c->occ += delta;
+    if (c->occ > c->occ_max)
+        c->occ_max = c->occ;
+}
+
+/* _gro_cli_release():  the put lands on the ring one memory op later */
+static void
+cli_release(struct model *m, unsigned int ctx, unsigned int nrel)
+{
+    struct msg msg = {ctx, nrel};
+
+    ev_push(m, m->now + m->p.mem_lat, EV_PUT, ctx / m->p.ctx_per_block,
+            &msg);
+}
+
+static void
+cli_fatal(struct model *m, const struct pkt *pk, const char *why)
+{
+    m->fatal++;
+    if (!m->quiet && m->fatal <= 10)
+        printf("ctx %u seq %llu at %llu: %s\n", pk->ctx,
+               (unsigned long long)pk->seq, (unsigned long long)m->now, why);
+}
+
+/* One step of _gro_cli_send() for send 'si' */
+static void
+cli_step(struct model *m, unsigned long si)
+{
+    struct send *s = &m->sends[si];
+    const struct pkt *pk = &m->pkts[s->pkt];
+    struct ctx *c = &m->ctx[pk->ctx];
+    unsigned int nent = m->p.nent;
+    unsigned int ctx_seq = pk->seq & (nent - 1);
+    unsigned int ticket_seq = (pk->seq & GRO_TICKET_msk) + 1;
+    unsigned int skid_marker, r, tseq;
+    uint32_t ticket;
+    uint64_t sleep = GRO_SEQ_OVERFLOW_TICKS * TICKS_CYCLES;
+
+    switch (s->phase) {
+    case PH_CHECK:
+        /* _gro_cli_test_skipped():  read the tape before the write */
+        s->tape = ctx_seq / GRO_TICKET_PER_TAPE;
+        s->epoch = (pk->seq >> log2u(nent)) & GRO_EPOCH_msk;
+        if (tape_passed(&c->tapes[s->tape], ticket_seq, s->epoch)) {
+            ticket = ticket_seq | (s->epoch << GRO_EPOCH_shf);
+            if (c->mark[ctx_seq] != wd_marker(ticket)) {
+                cli_fatal(m, pk, "passed ticket without a skip marker");
+                return;
+            }
+            /* Claimed:  a duplicate finds GRO_DTYPE_DROP_SEQ */
+            c->mark[ctx_seq] = 0;
+            m->claimed++;
+            m->progress = m->now;
+            return;
+        }
+        s->phase = PH_META;
+        ev_push(m, m->now + m->p.mem_lat, EV_SEND, si, NULL);
+        return;
+
+    case PH_META:
+        /* A slot still in use means the application overran NUMENT */
+        if (c->q[ctx_seq] >= 0) {
+            cli_fatal(m, pk, "reorder queue entry still in use");
+            return;
+        }
+        c->q[ctx_seq] = s->pkt;
+        c->mark[ctx_seq] = 0;
+        m->progress = m->now;
+        occ_update(m, c, 1);
+        if (!c->written || pk->seq > c->max_seq)
+            c->max_seq = pk->seq;
+        c->written = 1;
+        if (c->max_seq >= c->next_out &&
+            c->max_seq - c->next_out + 1 > c->window_max)
+            c->window_max = c->max_seq - c->next_out + 1;
+
+        s->phase = PH_TICKET;
+        s->tape = ctx_seq / GRO_TICKET_PER_TAPE;
+        s->epoch = (pk->seq >> log2u(nent)) & GRO_EPOCH_msk;
+        ev_push(m, m->now + m->p.mem_lat, EV_SEND, si, NULL);
+        return;
+
+    case PH_TICKET:
+        r = tape_release(&c->tapes[s->tape],
+                         ticket_seq | (s->epoch << GRO_EPOCH_shf));
+        if (r == GRO_TICKET_ERROR) {
+            /* _gro_cli_test_ticket_error() */
+            struct tape *tp = &c->tapes[s->tape];
+
+            skid_marker = GRO_SEQSKID_VALUE |
+                (((s->epoch - 1) & GRO_EPOCH_msk) << GRO_EPOCH_shf);
+            tseq = tp->w0 & GRO_TAPE_SEQ_msk;
+            if (tp->w0 != skid_marker && m->p.wd_timeout &&
+                (((tp->w0 >> GRO_EPOCH_shf) & GRO_EPOCH_msk) != s->epoch ||
+                 ticket_seq < tseq)) {
+                /* Skipped since PH_CHECK, the entry is never read */
+                if (c->q[ctx_seq] == (int64_t)s->pkt) {
+                    c->q[ctx_seq] = -1;
+                    occ_update(m, c, -1);
+                }
+                m->raced++;
+                m->progress = m->now;
+                return;
+            }
+            if (tp->w0 != skid_marker) {
+                if (((tp->w0 >> GRO_EPOCH_shf) & GRO_EPOCH_msk) != s->epoch) {
+                    cli_fatal(m, pk, "ticket error, epoch");
+                    return;
+                }
+                if (ticket_seq < tseq) {
+                    cli_fatal(m, pk, "ticket error, duplicate");
+                    return;
+                }
+                if (ticket_seq > tseq &&
+                    (tp->bits & (1ULL << (ticket_seq - 1)))) {
+                    cli_fatal(m, pk, "ticket error, bit set");
+                    return;
+                }
+            }
+            c->retries++;
+            ev_push(m, m->now + m->p.mem_lat + sleep, EV_SEND, si, NULL);
+            return;
+        }
+
+        if (r == 0)
+            return;
+        cli_release(m, pk->ctx, r);
+        if (ticket_seq + r <= GRO_TICKET_PER_TAPE)
+            return;
+        break;
+
+    case PH_CASCADE:
+        r = tape_release(&c->tapes[s->tape], s->epoch << GRO_EPOCH_shf);
+        if (r == GRO_TICKET_ERROR) {
+            /* _gro_cli_test_cascade_error() */
+            skid_marker = GRO_SEQSKID_VALUE |
+                (((s->epoch - 1) & GRO_EPOCH_msk) << GRO_EPOCH_shf);
+            if (c->tapes[s->tape].w0 != skid_marker) {
+                /* The watchdog released the tape for us */
+                if (!m->p.wd_timeout)
+                    cli_fatal(m, pk, "cascade error");
+                return;
+            }
+            c->retries++;
+            ev_push(m, m->now + m->p.mem_lat + sleep, EV_SEND, si, NULL);
+            return;
+        }
+
+        /* Ticket 0 is not a packet */
+        if (r - 1 > 0)
+            cli_release(m, pk->ctx, r - 1);
+        if (r - 1 < GRO_TICKET_PER_TAPE)
+            return;
+        break;
+    }
+
+    /* Released through the end of the tape:  cascade to the next one */
+    s->phase = PH_CASCADE;
+    if (++s->tape >= c->ntapes) {
+        s->tape = 0;
+        s->epoch = (s->epoch + 1) & GRO_EPOCH_msk;
+    }
+    ev_push(m, m->now + 2 * m->p.mem_lat, EV_SEND, si, NULL);
+}
+
+/* reset_next_bitmap() */
+static void
+disp_reset_next_bitmap(struct ctx *c, unsigned int nent)
+{
+    if (c->q_bm_reset == nent)
+        c->q_bm_reset = 0;
+    c->q_bm_reset += GRO_TICKET_PER_TAPE;
+
+    c->tapes[c->bm_next].w0 = c->rst_epoch << GRO_EPOCH_shf;
+    c->tapes[c->bm_next].bits = 0;
+    if (++c->bm_next == c->ntapes) {
+        c->bm_next = 0;
+        c->rst_epoch = (c->rst_epoch + 1) & GRO_EPOCH_msk;
+    }
+}
+
+static void
+disp_start(struct model *m, unsigned int b)
+{
+    struct block *bl = &m->blocks[b];
+    struct msg *msg;
+
+    if (bl->busy || bl->count == 0)
+        return;
+    msg = &bl->ring[bl->head];
+    bl->busy = 1;
+    ev_push(m, m->now + m->p.disp_msg + msg->nrel * m->p.disp_pkt, EV_DISP,
+            b, NULL);
+}
+
+/* Step the head of the reorder queue, resetting tapes behind it */
+static void
+disp_advance(struct model *m, struct ctx *c)
+{
+    c->next_out++;
+    if (++c->q_addrlo == c->q_bm_reset)
+        disp_reset_next_bitmap(c, m->p.nent);
+    if (c->q_addrlo == m->p.nent)
+        c->q_addrlo = 0;
+}
+
+/* Send nrel entries from the head of context ctx, from time t0 */
+static void
+disp_entries(struct model *m, unsigned int ctx, unsigned int nrel,
+             uint64_t t0)
+{
+    struct ctx *c = &m->ctx[ctx];
+    unsigned int i;
+    int64_t pi;
+
+    for (i = 0; i < nrel; i++) {
+        pi = c->q[c->q_addrlo];
+        if (pi < 0 || m->pkts[pi].seq != c->next_out) {
+            m->misorder++;
+            if (!m->quiet && m->misorder <= 10)
+                printf("ctx %u entry %u: expected seq %llu, found %lld\n",
+                       ctx, c->q_addrlo,
+                       (unsigned long long)c->next_out,
+                       pi < 0 ? -1LL : (long long)m->pkts[pi].seq);
+        } else {
+            uint64_t t = t0 + (i + 1) * m->p.disp_pkt;
+
+            m->lat[m->out++] = t - m->pkts[pi].ready;
+            m->progress = m->now;
+            occ_update(m, c, -1);
+        }
+        c->q[c->q_addrlo] = -1;
+        disp_advance(m, c);
+    }
+}
+
+/* gro_out_dispatch() for the message at the head of the release ring */
+static void
+disp_done(struct model *m, unsigned int b)
+{
+    struct block *bl = &m->blocks[b];
+    struct msg msg = bl->ring[bl->head];
+
+    disp_entries(m, msg.ctx, msg.nrel,
+                 m->now - msg.nrel * m->p.disp_pkt);
+
+    bl->msgs++;
+    bl->rel += msg.nrel;
+    bl->head = (bl->head + 1) % bl->cap;
+    bl->count--;
+    bl->busy = 0;
+    disp_start(m, b);
+}
+
+/* _gro_out_wd() for the next context of block b */
+static void
+wd_visit(struct model *m, unsigned int b)
+{
+    struct block *bl = &m->blocks[b];
+    unsigned int ci = b * m->p.ctx_per_block + bl->wd_next;
+    unsigned int head, tape, slot, tseq, epoch, r;
+    uint32_t ticket, old_mark;
+    struct ctx *c;
+    struct tape *tp;
+    int64_t old_q;
+
+    if (++bl->wd_next == m->p.ctx_per_block)
+        bl->wd_next = 0;
+
+    /* The dispatcher visits between release messages */
+    if (ci >= m->nctx || bl->busy)
+        return;
+
+    /* A head that moved since the last visit filled its hole */
+    c = &m->ctx[ci];
+    head = c->q_addrlo;
+    if (head != c->wd_head) {
+        c->wd_head = head;
+        c->wd_ts = 0;
+        return;
+    }
+
+    /* The tape waits for the head or for the cascade into it, with later
+     * tickets released on it or on the next tape */
+    tape = head / GRO_TICKET_PER_TAPE;
+    slot = head % GRO_TICKET_PER_TAPE;
+    tp = &c->tapes[tape];
+    tseq = tp->w0 & GRO_TAPE_SEQ_msk;
+    if ((tseq != slot + 1 && (tseq | slot) != 0) ||
+        (tp->bits == 0 && c->tapes[(tape + 1) % c->ntapes].bits == 0)) {
+        c->wd_ts = 0;
+        return;
+    }
+
+    if (c->wd_ts == 0) {
+        c->wd_ts = m->now | 1;
+        return;
+    }
+    if (m->now - c->wd_ts < m->p.wd_timeout)
+        return;
+
+    /* Mark the entry and release its ticket, or put the entry back */
+    epoch = (tp->w0 >> GRO_EPOCH_shf) & GRO_EPOCH_msk;
+    ticket = tseq | (epoch << GRO_EPOCH_shf);
+    old_q = c->q[head];
+    old_mark = c->mark[head];
+    if (tseq != 0) {
+        c->q[head] = -1;
+        c->mark[head] = wd_marker(ticket);
+    }
+    r = tape_release(tp, ticket);
+    if (r == GRO_TICKET_ERROR || r == 0) {
+        c->q[head] = old_q;
+        c->mark[head] = old_mark;
+        return;
+    }
+
+    /* Step over the skipped entry, whose client may not have released
+     * it yet, and dispatch the entries released behind it */
+    c->wd_skips++;
+    m->progress = m->now;
+    if (tseq != 0) {
+        if (old_q >= 0)
+            occ_update(m, c, -1);
+        disp_advance(m, c);
+    }
+    for (;;) {
+        tseq += r;
+        if (r > 1)
+            disp_entries(m, ci, r - 1, m->now);
+        if (tseq <= GRO_TICKET_PER_TAPE)
+            break;
+
+        /* Released through the end of the tape:  ticket 0 of the next */
+        if (++tape == c->ntapes) {
+            tape = 0;
+            epoch = (epoch + 1) & GRO_EPOCH_msk;
+        }
+        tseq = 0;
+        r = tape_release(&c->tapes[tape], epoch << GRO_EPOCH_shf);
+        if (r == GRO_TICKET_ERROR || r == 0)
+            break;
+    }
+
+    c->wd_head = c->q_addrlo;
+    c->wd_ts = 0;
+}
+
+/* Whether a context of block b holds entries that a hole may block */
+static int
+wd_pending(const struct model *m, unsigned int b)
+{
+    unsigned int i, ci;
+
+    for (i = 0; i < m->p.ctx_per_block; i++) {
+        ci = b * m->p.ctx_per_block + i;
+        if (ci < m->nctx && m->ctx[ci].occ > 0)
+            return 1;
+    }
+    return 0;
+}
+
+static int
+pkt_cmp(const void *a, const void *b)
+{
+    const struct pkt *x = a, *y = b;
+
+    if (x->ready != y->ready)
+        return x->ready < y->ready ? -1 : 1;
+    return x->arrival < y->arrival ? -1 : (x->arrival > y->arrival);
+}
+
+static int
+u32_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return x < y ? -1 : (x > y);
+}
+
+static void
+model_init(struct model *m, const struct parameters *p, struct pkt *pkts,
+           unsigned long npkts)
+{
+    unsigned long i;
+    unsigned int b;
+
+    memset(m, 0, sizeof(*m));
+    m->p = *p;
+    m->pkts = pkts;
+    m->npkts = npkts;
+
+    for (i = 0; i < npkts; i++)
+        if (pkts[i].ctx + 1 > m->nctx)
+            m->nctx = pkts[i].ctx + 1;
+    for (i = 0; i < m->nctx; i++)
+        ctx_init(&m->ctx[i], p);
+
+    m->nblocks = (m->nctx + p->ctx_per_block - 1) / p->ctx_per_block;
+    m->blocks = xcalloc(m->nblocks, sizeof(*m->blocks));
+    for (b = 0; b < m->nblocks; b++) {
+        /* Sized for the worst case, the depth needed is what we report */
+        m->blocks[b].cap = npkts + 1;
+        m->blocks[b].ring = xcalloc(npkts + 1, sizeof(struct msg));
+    }
+
+    m->sends = xcalloc(npkts, sizeof(*m->sends));
+    m->lat = xcalloc(npkts, sizeof(*m->lat));
+
+    /* Clients start sending when the packets are ready */
+    qsort(pkts, npkts, sizeof(*pkts), pkt_cmp);
+    for (i = 0; i < npkts; i++) {
+        m->sends[i].pkt = i;
+        m->sends[i].phase = p->wd_timeout ? PH_CHECK : PH_META;
+        ev_push(m, pkts[i].ready, EV_SEND, i, NULL);
+    }
+
+    if (p->wd_timeout)
+        for (b = 0; b < m->nblocks; b++)
+            ev_push(m, p->wd_interval, EV_WD, b, NULL);
+}
+
+static void
+model_run(struct model *m)
+{
+    struct event e;
+    struct block *bl;
+
+    while (m->nev > 0) {
+        e = ev_pop(m);
+        m->now = e.t;
+        if (m->now - m->progress > STALL_CYCLES) {
+            m->deadlock = 1;
+            break;
+        }
+
+        switch (e.type) {
+        case EV_SEND:
+            cli_step(m, e.arg);
+            break;
+        case EV_PUT:
+            bl = &m->blocks[e.arg];
+            bl->ring[(bl->head + bl->count) % bl->cap] = e.m;
+            bl->count++;
+            if (bl->count > bl->count_max)
+                bl->count_max = bl->count;
+            disp_start(m, e.arg);
+            break;
+        case EV_DISP:
+            disp_done(m, e.arg);
+            break;
+        case EV_WD:
+            m->nwd--;
+            wd_visit(m, e.arg);
+            if (m->nev > m->nwd || wd_pending(m, e.arg))
+                ev_push(m, m->now + m->p.wd_interval, EV_WD, e.arg, NULL);
+            break;
+        }
+    }
+}
+
+static void
+model_free(struct model *m)
+{
+    unsigned int i;
+
+    for (i = 0; i < m->nctx; i++) {
+        free(m->ctx[i].tapes);
+        free(m->ctx[i].q);
+        free(m->ctx[i].mark);
+    }
+    for (i = 0; i < m->nblocks; i++)
+        free(m->blocks[i].ring);
+    free(m->blocks);
+    free(m->sends);
+    free(m->lat);
+    free(m->ev);
+}
+
+static unsigned long
+retries(const struct model *m)
+{
+    unsigned long n = 0;
+    unsigned int i;
+
+    for (i = 0; i < m->nctx; i++)
+        n += m->ctx[i].retries;
+    return n;
+}
+
+static unsigned long
+wd_skips(const struct model *m)
+{
+    unsigned long n = 0;
+    unsigned int i;
+
+    for (i = 0; i < m->nctx; i++)
+        n += m->ctx[i].wd_skips;
+    return n;
+}
+
+static void
+report(struct model *m)
+{
+    static const double pct[] = {50, 90, 99, 99.9, 100};
+    const struct parameters *p = &m->p;
+    uint64_t window = 0;
+    unsigned long ring = 0, msgs = 0, rel = 0;
+    unsigned int i, need;
+
+    printf("%lu packets in %u contexts, %u blocks, %llu cycles\n",
+           m->npkts, m->nctx, m->nblocks, (unsigned long long)m->now);
+    printf("%lu released in order, %lu stuck, %lu out of order, "
+           "%lu fatal ticket errors, %lu skid retries\n", m->out,
+           m->npkts - m->out, m->misorder, m->fatal, retries(m));
+    if (m->p.wd_timeout)
+        printf("watchdog:  %lu skipped, %lu sent late and claimed the "
+               "marker, %lu skipped after the tape test\n", wd_skips(m),
+               m->claimed, m->raced);
+    if (m->deadlock)
+        printf("deadlock:  clients retried for %u cycles with no progress\n",
+               STALL_CYCLES);
+    printf("\n");
+
+    printf("ctx  occupancy avg    max   window\n");
+    for (i = 0; i < m->nctx; i++) {
+        struct ctx *c = &m->ctx[i];
+
+        occ_update(m, c, 0);
+        printf("%3u  %13.1f %6lu %8llu\n", i,
+               m->now ? c->occ_area / m->now : 0, c->occ_max,
+               (unsigned long long)c->window_max);
+        if (c->window_max > window)
+            window = c->window_max;
+    }
+
+    if (m->out > 0) {
+        qsort(m->lat, m->out, sizeof(*m->lat), u32_cmp);
+        printf("\nrelease latency (cycles from gro_cli_send() to "
+               "dispatch):\n");
+        for (i = 0; i < sizeof(pct) / sizeof(pct[0]); i++) {
+            unsigned long k = (unsigned long)(pct[i] / 100 * (m->out - 1));
+
+            printf("  p%-5g %10u\n", pct[i], m->lat[k]);
+        }
+    }
+
+    for (i = 0; i < m->nblocks; i++) {
+        if (m->blocks[i].count_max > ring)
+            ring = m->blocks[i].count_max;
+        msgs += m->blocks[i].msgs;
+        rel += m->blocks[i].rel;
+    }
+
+    need = 1U << log2u(window + p->skid);
+    if (need < GRO_TICKET_PER_TAPE)
+        need = GRO_TICKET_PER_TAPE;
+    printf("\n%.2f packets per release message\n",
+           msgs ? (double)rel / msgs : 0);
+    printf("NUMENT %u SKIDLEN %u: largest window %llu, NUMENT needed %u\n",
+           p->nent, p->skid, (unsigned long long)window, need);
+    printf("release ring: %lu messages at most, %lu bytes needed, "
+           "GRO_RELEASE_RING_SIZE %u%s\n", ring, ring * 4, p->ring_size,
+           ring * 4 > p->ring_size ? " is too small" : "");
+}
+
+static struct pkt *
+gen_trace(const struct gen *g, const struct parameters *p)
+{
+    struct pkt *pkts = xcalloc(g->pkts, sizeof(*pkts));
+    uint64_t seq[MAX_CTX];
+    unsigned long i;
+
+    for (i = 0; i < g->ctxs; i++)
+        seq[i] = p->iseq;
+
+    for (i = 0; i < g->pkts; i++) {
+        unsigned int c = rng32() % g->ctxs;
+
+        pkts[i].ctx = c;
+        pkts[i].seq = seq[c]++;
+        pkts[i].arrival = i * g->gap;
+        pkts[i].ready = pkts[i].arrival + g->lat +
+            (g->jitter ? rng32() % g->jitter : 0);
+    }
+    return pkts;
+}
+
+static struct pkt *
+read_trace(const char *path, unsigned long *npkts)
+{
+    FILE *f = fopen(path, "r");
+    struct pkt *pkts = NULL;
+    unsigned long n = 0, cap = 0, line = 0;
+    unsigned long long seq, arrival, lat;
+    unsigned int ctx;
+    char buf[256];
+
+    if (f == NULL) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(buf, sizeof(buf), f) != NULL) {
+        line++;
+        if (buf[0] == '#' || buf[strspn(buf, " \t\r\n")] == '\0')
+            continue;
+        if (sscanf(buf, "%u %llu %llu %llu", &ctx, &seq, &arrival,
+                   &lat) != 4 || ctx >= MAX_CTX) {
+            fprintf(stderr, "%s:%lu: expected \"ctx seq arrival latency\""
+                    " with ctx below %u\n", path, line, MAX_CTX);
+            exit(EXIT_FAILURE);
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 4096;
+            pkts = realloc(pkts, cap * sizeof(*pkts));
+            if (pkts == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        pkts[n].ctx = ctx;
+        pkts[n].seq = seq;
+        pkts[n].arrival = arrival;
+        pkts[n].ready = arrival + lat;
+        n++;
+    }
+
+    fclose(f);
+    *npkts = n;
+    return pkts;
+}
+
+static int
+param_check(const struct parameters *p)
+{
+    return p->nent >= GRO_TICKET_PER_TAPE && p->nent <= MAX_NUMENT &&
+        (p->nent & (p->nent - 1)) == 0 && p->skid % GRO_TICKET_PER_TAPE == 0 &&
+        p->skid <= p->nent - GRO_TICKET_PER_TAPE && p->iseq < p->nent &&
+        p->ctx_per_block > 0 && p->disp_pkt > 0 &&
+        (p->wd_timeout == 0 ||
+         (p->wd_interval > 0 && p->wd_timeout < STALL_CYCLES / 2));
+}
+
+/* release_ticket on its own */
+static void
+test_tape(void)
+{
+    struct tape t = {1, 0};
+
+    CHECK(tape_release(&t, 3) == 0 && tape_release(&t, 2) == 0,
+          "out of order tickets not queued");
+    CHECK(tape_release(&t, 3) == GRO_TICKET_ERROR, "duplicate accepted");
+    CHECK(tape_release(&t, 1) == 3 && (t.w0 & GRO_TAPE_SEQ_msk) == 4,
+          "in order ticket did not release the run");
+    CHECK(tape_release(&t, 2) == GRO_TICKET_ERROR, "late ticket accepted");
+    CHECK(tape_release(&t, 4 | (1 << GRO_EPOCH_shf)) == GRO_TICKET_ERROR,
+          "ticket of another epoch accepted");
+
+    t.w0 = GRO_TICKET_PER_TAPE;
+    t.bits = 0;
+    CHECK(tape_release(&t, GRO_TICKET_PER_TAPE) == 1 &&
+          t.w0 == GRO_SEQSKID_VALUE, "tape not exhausted to the skid value");
+    CHECK(tape_release(&t, 0) == GRO_TICKET_ERROR,
+          "exhausted tape accepted a ticket");
+}
+
+static void
+test_run(const char *name, const struct parameters *p, const struct gen *g,
+         int expect_fatal, int expect_retries)
+{
+    struct model m;
+    struct pkt *pkts = gen_trace(g, p);
+    uint64_t seqs;
+
+    model_init(&m, p, pkts, g->pkts);
+    m.quiet = 1;
+    model_run(&m);
+
+    seqs = 0;
+    if (m.nctx)
+        seqs = m.ctx[0].next_out - p->iseq;
+    printf("%-24s %7lu pkts  %6lu retries  %3lu fatal  ctx 0 seq %llu\n",
+           name, m.out, retries(&m), m.fatal,
+           (unsigned long long)(p->iseq + seqs));
+
+    if (expect_fatal) {
+        CHECK(m.fatal > 0 && m.deadlock, "%s: overrun not detected", name);
+    } else {
+        CHECK(m.fatal == 0 && m.misorder == 0 && m.out == g->pkts &&
+              !m.deadlock,
+              "%s: %lu of %lu released, %lu out of order, %lu fatal",
+              name, m.out, g->pkts, m.misorder, m.fatal);
+    }
+    if (expect_retries)
+        CHECK(retries(&m) > 0, "%s: the skid never held a client", name);
+    else if (!expect_fatal)
+        CHECK(retries(&m) == 0, "%s: %lu unexpected skid retries", name,
+              retries(&m));
+
+    model_free(&m);
+    free(pkts);
+}
+
+/* Remove packet k of the trace, as if its client never sent it */
+static void
+trace_drop(struct pkt *pkts, unsigned long *npkts, unsigned long k)
+{
+    memmove(&pkts[k], &pkts[k + 1], (*npkts - k - 1) * sizeof(*pkts));
+    (*npkts)--;
+}
+
+static void
+test_wd_run(const char *name, const struct parameters *p, struct pkt *pkts,
+            unsigned long npkts, struct model *m)
+{
+    model_init(m, p, pkts, npkts);
+    m->quiet = 1;
+    model_run(m);
+
+    printf("%-24s %7lu pkts  %3lu skipped  %3lu claimed  %3lu raced  "
+           "%3lu fatal\n", name, m->out, wd_skips(m), m->claimed, m->raced,
+           m->fatal);
+
+    CHECK(m->misorder == 0 && !m->deadlock,
+          "%s: %lu out of order%s", name, m->misorder,
+          m->deadlock ? ", deadlock" : "");
+    CHECK(m->out + m->claimed + m->raced + m->fatal == npkts,
+          "%s: %lu sent, %lu claimed, %lu raced, %lu fatal of %lu", name,
+          m->out, m->claimed, m->raced, m->fatal, npkts);
+}
+
+/* The lost sequence watchdog against lost, late and duplicate packets */
+static void
+test_wd(const struct parameters *dflt)
+{
+    struct parameters p = *dflt;
+    struct gen g = {20000, 2, 40, 500, 3000};
+    struct model m;
+    struct pkt *pkts;
+    unsigned long npkts, i, n;
+    uint32_t lap;
+
+    p.iseq = 0;
+    p.nent = 1024;
+    p.skid = 128;
+    p.ctx_per_block = 2;
+    p.wd_timeout = 20000;
+    p.wd_interval = 256;
+
+    /* Cycles for a context to go once around its reorder queue */
+    lap = p.nent * g.ctxs * g.gap;
+
+    /* No hole lasts the timeout:  nothing is skipped */
+    pkts = gen_trace(&g, &p);
+    test_wd_run("wd quiet", &p, pkts, g.pkts, &m);
+    CHECK(wd_skips(&m) == 0 && m.fatal == 0 && m.out == g.pkts,
+          "wd quiet: %lu skipped", wd_skips(&m));
+    model_free(&m);
+    free(pkts);
+
+    /* A packet that is never sent is skipped */
+    pkts = gen_trace(&g, &p);
+    npkts = g.pkts;
+    trace_drop(pkts, &npkts, 5000);
+    test_wd_run("wd lost", &p, pkts, npkts, &m);
+    CHECK(wd_skips(&m) == 1 && m.fatal == 0 && m.out == npkts,
+          "wd lost: %lu skipped, %lu sent", wd_skips(&m), m.out);
+    model_free(&m);
+    free(pkts);
+
+    /* One sent after the skip, within the lap, claims the marker */
+    pkts = gen_trace(&g, &p);
+    pkts[5000].ready += 2 * p.wd_timeout;
+    test_wd_run("wd late", &p, pkts, g.pkts, &m);
+    CHECK(wd_skips(&m) == 1 && m.claimed == 1 && m.fatal == 0,
+          "wd late: %lu skipped, %lu claimed", wd_skips(&m), m.claimed);
+    model_free(&m);
+    free(pkts);
+
+    /* Late packets around the timeout race the skip:  each one is sent
+     * or skipped, once, whether the skip comes before its tape test,
+     * between the test and its release, or not at all, and all three
+     * happen */
+    g.pkts = 60000;
+    pkts = gen_trace(&g, &p);
+    for (i = 1500, n = 0; i < g.pkts; i += 1500, n++)
+        pkts[i].ready += p.wd_timeout + 2000 + n * 97 % 3000;
+    test_wd_run("wd race", &p, pkts, g.pkts, &m);
+    CHECK(m.fatal == 0 && wd_skips(&m) == m.claimed + m.raced &&
+          m.claimed > 0 && m.raced > 0 && m.out > g.pkts - n,
+          "wd race: %lu skipped, %lu claimed, %lu raced, %lu fatal",
+          wd_skips(&m), m.claimed, m.raced, m.fatal);
+    model_free(&m);
+    free(pkts);
+    g.pkts = 20000;
+
+    /* A duplicate of a sent packet still aborts */
+    pkts = gen_trace(&g, &p);
+    pkts = realloc(pkts, (g.pkts + 1) * sizeof(*pkts));
+    pkts[g.pkts] = pkts[5000];
+    pkts[g.pkts].ready += p.wd_timeout;
+    test_wd_run("wd duplicate", &p, pkts, g.pkts + 1, &m);
+    CHECK(m.fatal == 1 && wd_skips(&m) == 0 && m.out == g.pkts,
+          "wd duplicate: %lu fatal, %lu skipped", m.fatal, wd_skips(&m));
+    model_free(&m);
+    free(pkts);
+
+    /* One sent more than a lap after the skip finds the entry reused:
+     * that is an error, not a skip, and nothing else is disturbed */
+    pkts = gen_trace(&g, &p);
+    pkts[5000].ready += lap + lap / 2;
+    test_wd_run("wd lapped", &p, pkts, g.pkts, &m);
+    CHECK(m.fatal == 1 && wd_skips(&m) == 1 && m.claimed == 0 &&
+          m.out == g.pkts - 1, "wd lapped: %lu fatal, %lu claimed",
+          m.fatal, m.claimed);
+    model_free(&m);
+    free(pkts);
+}
+
+static void
+self_test(const struct parameters *dflt)
+{
+    struct parameters p = *dflt;
+    struct gen g;
+
+    test_tape();
+
+    p.wd_timeout = 0;
+
+    /* In order, through all the epochs twice */
+    p.nent = 256;
+    p.skid = 64;
+    g = (struct gen){p.nent * GRO_NUM_EPOCHS * 2 + 17, 1, 40, 500, 0};
+    test_run("in order", &p, &g, 0, 0);
+
+    /* Reordered over several contexts and blocks, small reorder queues */
+    g = (struct gen){60000, 12, 40, 500, 2000};
+    p.ctx_per_block = 4;
+    test_run("reordered", &p, &g, 0, 0);
+
+    /* The first tape is not tape 0 */
+    p.iseq = 1000;
+    p.nent = 1024;
+    p.skid = 128;
+    g = (struct gen){20000, 3, 40, 500, 3000};
+    test_run("iseq 1000", &p, &g, 0, 0);
+
+    /* The skid has not wrapped yet */
+    p.iseq = 100;
+    p.skid = 256;
+    test_run("iseq 100", &p, &g, 0, 0);
+
+    /* Reordering reaches into the skid:  clients wait, nothing breaks */
+    p.iseq = 0;
+    p.nent = 512;
+    p.skid = 256;
+    g = (struct gen){40000, 1, 20, 1000, 5000};
+    test_run("skid", &p, &g, 0, 1);
+
+    /* Reordering past the reorder queue is detected */
+    p.skid = 64;
+    g = (struct gen){40000, 1, 10, 1000, 20000};
+    test_run("overrun", &p, &g, 1, 0);
+
+    test_wd(dflt);
+}
+
+void usage(void)
+{
+    printf("gro_model [options] [trace]\n"
+           "options:\n"
+           " -n <num>  NUMENT, entries per reorder context (default 8192)\n"
+           " -s <num>  SKIDLEN (default 64)\n"
+           " -i <num>  ISEQ, initial sequence number (default 0)\n"
+           " -b <num>  Contexts per block (default 4)\n"
+           " -r <num>  GRO_RELEASE_RING_SIZE in bytes (default 2048)\n"
+           " -m <num>  Cycles per memory operation (default 250)\n"
+           " -d <num>  Dispatcher cycles per release message (default 20)\n"
+           " -D <num>  Dispatcher cycles per packet (default 12)\n"
+           " -w <num>  Watchdog timeout in cycles (default 0, off)\n"
+           " -W <num>  Cycles between watchdog visits (default 4096)\n"
+           "without a trace:\n"
+           " -p <num>  Packets to generate (default 200000)\n"
+           " -c <num>  Contexts (default 4)\n"
+           " -g <num>  Cycles between packets (default 20)\n"
+           " -l <num>  Minimum worker latency (default 2000)\n"
+           " -j <num>  Worker latency spread (default 4000)\n"
+           " -T        Run the self test instead\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct parameters p = {8192, 64, 0, 4, 2048, 250, 20, 12, 0, 4096};
+    struct gen g = {200000, 4, 20, 2000, 4000};
+    struct model m;
+    struct pkt *pkts;
+    unsigned long npkts;
+    int self = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:i:b:r:m:d:D:w:W:p:c:g:l:j:T")) != -1) {
+        switch (c) {
+        case 'n':
+            p.nent = atoi(optarg);
+            break;
+        case 's':
+            p.skid = atoi(optarg);
+            break;
+        case 'i':
+            p.iseq = atoi(optarg);
+            break;
+        case 'b':
+            p.ctx_per_block = atoi(optarg);
+            break;
+        case 'r':
+            p.ring_size = atoi(optarg);
+            break;
+        case 'm':
+            p.mem_lat = atoi(optarg);
+            break;
+        case 'd':
+            p.disp_msg = atoi(optarg);
+            break;
+        case 'D':
+            p.disp_pkt = atoi(optarg);
+            break;
+        case 'w':
+            p.wd_timeout = atoi(optarg);
+            break;
+        case 'W':
+            p.wd_interval = atoi(optarg);
+            break;
+        case 'p':
+            g.pkts = atol(optarg);
+            break;
+        case 'c':
+            g.ctxs = atoi(optarg);
+            break;
+        case 'g':
+            g.gap = atoi(optarg);
+            break;
+        case 'l':
+            g.lat = atoi(optarg);
+            break;
+        case 'j':
+            g.jitter = atoi(optarg);
+            break;
+        case 'T':
+            self = 1;
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!param_check(&p) || g.ctxs < 1 || g.ctxs > MAX_CTX || g.pkts < 1) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if (self) {
+        self_test(&p);
+    } else {
+        if (optind < argc)
+            pkts = read_trace(argv[optind], &npkts);
+        else {
+            pkts = gen_trace(&g, &p);
+            npkts = g.pkts;
+        }
+
+        model_init(&m, &p, pkts, npkts);
+        model_run(&m);
+        report(&m);
+        CHECK(m.misorder == 0 && m.fatal == 0 && !m.deadlock,
+              "%lu out of order, %lu fatal ticket errors%s", m.misorder,
+              m.fatal, m.deadlock ? ", deadlock" : "");
+        model_free(&m);
+        free(pkts);
+    }
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
@@ -0,0 +1,408 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/gro_stat.c
+ * @brief         Report the GRO counters and telemetry of every context.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <nfp.h>
+#include <nfp_nffw.h>
+
+#include "nfp_gro_stat.h"
+#include "nfp_gro_flow.h"
+
+/* Words of a ticket tape, GRO_TICKET_TAPE_SIZE_LW */
+#define TAPE_LW         4
+
+struct parameters
+{
+    int nfp_num;
+    unsigned int interval_ms;
+    int ctx;
+    int hist;
+    int tapes;
+    int rebalance;
+    unsigned int max_moves;
+};
+
+/* Imbalance between the GRO blocks that -r leaves alone */
+#define REBALANCE_TOL   0.1
+
+static const double pctls[] = {50, 90, 99, 100};
+#define NUM_PCTLS       (sizeof(pctls) / sizeof(pctls[0]))
+
+void usage(void)
+{
+    printf("gro_stat [options]\n"
+           "options:\n"
+           " -n, --nfp <nfp num>    Select which NFP to access (default 0)\n"
+           " -i, --interval <ms>    Report the activity over an interval,\n"
+           "                        0 for the totals since the firmware\n"
+           "                        was loaded (default 1000)\n"
+           " -c, --ctx <ctx>        Report a single context, numbered\n"
+           "                        across all blocks (default all)\n"
+           " -H, --hist             Print the histograms\n"
+           " -t, --tapes            Print the ticket tapes of the context\n"
+           "                        given with -c\n"
+           " -r, --rebalance        Move flow spreading table entries from\n"
+           "                        the busiest GRO block to the least busy\n"
+           "                        one, on the load over the interval.\n"
+           "                        The entries moved by a run complete\n"
+           "                        their moves after the next run\n"
+           " -m, --moves <num>      Most entries to move with -r\n"
+           "                        (default 16)\n\n");
+}
+
+static const struct option g_opt[] = {
+    {"help",     no_argument,        NULL, 'h'},
+    {"nfp",      required_argument,  NULL, 'n'},
+    {"interval", required_argument,  NULL, 'i'},
+    {"ctx",      required_argument,  NULL, 'c'},
+    {"hist",     no_argument,        NULL, 'H'},
+    {"tapes",    no_argument,        NULL, 't'},
+    {"rebalance", no_argument,       NULL, 'r'},
+    {"moves",    required_argument,  NULL, 'm'},
+    {NULL,       0, 0, '\0'}
+};
+
+static const char *g_optstr = "hn:i:c:Htrm:";
+
+void parse_params(int argc, char *argv[], struct parameters *p)
+{
+    int c;
+
+    while ((c = getopt_long(argc, argv, g_optstr, g_opt, NULL)) != -1) {
+        switch (c) {
+        case 'h':
+            usage();
+            exit(EXIT_SUCCESS);
+            break;
+        case 'n':
+            p->nfp_num = atoi(optarg);
+            break;
+        case 'i':
+            p->interval_ms = atoi(optarg);
+            break;
+        case 'c':
+            p->ctx = atoi(optarg);
+            if (p->ctx < 0) {
+                fprintf(stderr, "Context must be 0 or more\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'H':
+            p->hist = 1;
+            break;
+        case 't':
+            p->tapes = 1;
+            break;
+        case 'r':
+            p->rebalance = 1;
+            break;
+        case 'm':
+            p->max_moves = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Unknown option: '%c'\n", c);
+            usage();
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    if (p->tapes && p->ctx < 0) {
+        fprintf(stderr, "Ticket tapes need a context (-c)\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (p->rebalance && p->interval_ms == 0) {
+        fprintf(stderr, "Rebalancing needs an interval (-i)\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int
+rtsym_read(void *priv, const char *name, uint32_t *words, size_t len,
+           uint64_t off)
+{
+    struct nfp_device *nfp = priv;
+    const struct nfp_rtsym *sym;
+
+    sym = nfp_rtsym_lookup(nfp, name);
+    if (!sym)
+        return -1;
+    return nfp_rtsym_read(nfp, sym, words, len, off) < 0 ? -1 : 0;
+}
+
+/* Upper bound of a bucket, in units of 2^shf */
+static const char *
+fmt_bucket(char *buf, size_t size, int b, unsigned int shf)
+{
+    if (b < 0)
+        snprintf(buf, size, "-");
+    else if (b == 0)
+        snprintf(buf, size, "0");
+    else if (b == NFP_GRO_TELEM_NBUCKETS - 1)
+        snprintf(buf, size, ">=%llu",
+                 (unsigned long long)nfp_gro_bucket_min(b) << shf);
+    else
+        snprintf(buf, size, "<%llu",
+                 (unsigned long long)(nfp_gro_bucket_max(b) + 1) << shf);
+    return buf;
+}
+
+static void
+print_pctls(const uint32_t *hist, unsigned int shf)
+{
+    char buf[32];
+    unsigned int i;
+
+    for (i = 0; i < NUM_PCTLS; i++)
+        printf(" %9s", fmt_bucket(buf, sizeof(buf),
+                                  nfp_gro_hist_pctl(hist, pctls[i]), shf));
+}
+
+static void
+print_hist(const char *name, const uint32_t *hist, unsigned int shf)
+{
+    char buf[32];
+    unsigned int b;
+
+    printf("    %s:", name);
+    for (b = 0; b < NFP_GRO_TELEM_NBUCKETS; b++) {
+        if (hist[b] != 0)
+            printf(" %s:%u", fmt_bucket(buf, sizeof(buf), b, shf), hist[b]);
+    }
+    printf("\n");
+}
+
+static void
+print_stat(const struct nfp_gro_stat *st, struct parameters *p)
+{
+    const struct nfp_gro_ctx_stat *c;
+    unsigned int i;
+
+    printf("%u blocks, %u contexts per block, watchdog %s, telemetry %s\n",
+           st->num_blocks, st->ctx_per_block,
+           (st->flags & NFP_GRO_FLAGS_WD) ? "on" : "off",
+           (st->flags & NFP_GRO_FLAGS_TELEM) ? "on" : "off");
+    if (p->interval_ms)
+        printf("activity over %u ms\n", p->interval_ms);
+    else
+        printf("totals since the firmware was loaded\n");
+
+    printf("%4s %5s %12s %12s %8s  %-39s  %-39s\n", "ctx", "blk.c",
+           "enqueued", "released", "skipped",
+           "depth (entries) p50/p90/p99/max",
+           "wait (cycles) p50/p90/p99/max");
+    for (i = 0; i < st->num_ctx; i++) {
+        if (p->ctx >= 0 && (int)i != p->ctx)
+            continue;
+        c = &st->ctx[i];
+        printf("%4u %2u.%-2u %12llu %12llu %8llu ", i,
+               i / st->ctx_per_block, i % st->ctx_per_block,
+               (unsigned long long)c->enqueued,
+               (unsigned long long)c->released,
+               (unsigned long long)c->skipped);
+        print_pctls(c->depth, 0);
+        printf(" ");
+        print_pctls(c->wait, NFP_GRO_TELEM_WAIT_SHF);
+        printf("\n");
+        if (p->hist) {
+            print_hist("depth", c->depth, 0);
+            print_hist("wait", c->wait, NFP_GRO_TELEM_WAIT_SHF);
+        }
+    }
+}
+
+/* The ticket tapes of a context:  epoch, next ticket and pending bits */
+static int
+print_tapes(struct nfp_device *nfp, const struct nfp_gro_stat *st,
+            unsigned int ctx)
+{
+    const struct nfp_rtsym *sym;
+    uint32_t *words;
+    char name[64];
+    unsigned int i, ntapes;
+
+    snprintf(name, sizeof(name), "_gro_bm_%u_%u", ctx / st->ctx_per_block,
+             ctx % st->ctx_per_block);
+    sym = nfp_rtsym_lookup(nfp, name);
+    if (!sym) {
+        fprintf(stderr, "Context %u is not declared\n", ctx);
+        return -1;
+    }
+    ntapes = sym->size / (TAPE_LW * sizeof(uint32_t));
+    words = malloc(ntapes * TAPE_LW * sizeof(uint32_t));
+    if (!words)
+        return -1;
+    if (nfp_rtsym_read(nfp, sym, words, ntapes * TAPE_LW * sizeof(uint32_t),
+                       0) < 0) {
+        free(words);
+        return -1;
+    }
+
+    printf("ticket tapes of context %u (%s):\n", ctx, name);
+    for (i = 0; i < ntapes; i++) {
+        printf("%4u: epoch %u next %2u pending %08x %08x\n", i,
+               (words[i * TAPE_LW] >> 8) & 0x3, words[i * TAPE_LW] & 0x7f,
+               words[i * TAPE_LW + 1], words[i * TAPE_LW + 2]);
+    }
+    free(words);
+    return 0;
+}
+
+static int
+flow_cnt_read(struct nfp_device *nfp, uint32_t *cnt)
+{
+    return rtsym_read(nfp, NFP_GRO_FLOW_CNT_SYM, cnt,
+                      NFP_GRO_FLOW_TBL_SIZE * sizeof(uint32_t), 0);
+}
+
+/*
+ * Rebalance _gro_flow_tbl on the activity over the interval in st.  The
+ * entries that an earlier run fenced may now complete their moves, and
+ * the entries that this run moves are fenced.  Only the entries changed
+ * are written back:  clients rewrite those that complete their moves.
+ */
+static int
+rebalance(struct nfp_device *nfp, const struct nfp_gro_stat *st,
+          const uint32_t *prev_cnt, unsigned int max_moves)
+{
+    const struct nfp_rtsym *sym;
+    uint32_t tbl[NFP_GRO_FLOW_TBL_SIZE], orig[NFP_GRO_FLOW_TBL_SIZE];
+    uint32_t cnt[NFP_GRO_FLOW_TBL_SIZE];
+    uint64_t ent_load[NFP_GRO_FLOW_TBL_SIZE];
+    uint64_t *ctx_load;
+    unsigned int i;
+    int drained;
+    int moved = -1;
+
+    sym = nfp_rtsym_lookup(nfp, NFP_GRO_FLOW_TBL_SYM);
+    ctx_load = calloc(st->num_ctx, sizeof(*ctx_load));
+    if (!sym || !ctx_load || flow_cnt_read(nfp, cnt) < 0 ||
+        nfp_rtsym_read(nfp, sym, tbl, sizeof(tbl), 0) < 0) {
+        fprintf(stderr, "Failed to read the flow spreading table\n");
+        goto out;
+    }
+
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++)
+        ent_load[i] = (uint32_t)(cnt[i] - prev_cnt[i]);
+    for (i = 0; i < st->num_ctx; i++)
+        ctx_load[i] = st->ctx[i].enqueued;
+
+    memcpy(orig, tbl, sizeof(tbl));
+    drained = nfp_gro_flow_drain(tbl);
+    moved = nfp_gro_flow_rebalance(tbl, ent_load, ctx_load, st->num_ctx,
+                                   st->ctx_per_block, REBALANCE_TOL,
+                                   max_moves);
+    if (moved < 0) {
+        fprintf(stderr, "The flow spreading table is corrupt\n");
+        goto out;
+    }
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++) {
+        if (tbl[i] != orig[i] &&
+            nfp_rtsym_write(nfp, sym, &tbl[i], sizeof(tbl[i]),
+                            i * sizeof(tbl[i])) < 0) {
+            fprintf(stderr, "Failed to write the flow spreading table\n");
+            moved = -1;
+            goto out;
+        }
+    }
+
+    printf("rebalancing moved %d entries, %d earlier moves may complete\n",
+           moved, drained);
+    for (i = 0; i < NFP_GRO_FLOW_TBL_SIZE; i++) {
+        if (tbl[i] == orig[i])
+            continue;
+        printf("%4u: ctx %u -> %u, %s, %llu packets\n", i,
+               NFP_GRO_FLOW_ENT_CTX(tbl[i]), NFP_GRO_FLOW_ENT_NEXT(tbl[i]),
+               (orig[i] & NFP_GRO_FLOW_ENT_FENCE) ? "draining" : "fenced",
+               (unsigned long long)ent_load[i]);
+    }
+
+out:
+    free(ctx_load);
+    return moved < 0 ? -1 : 0;
+}
+
+int main (int argc, char *argv[])
+{
+    struct parameters p;
+    struct nfp_device *nfp;
+    struct nfp_gro_stat_io io;
+    struct nfp_gro_stat prev, st;
+    uint32_t prev_cnt[NFP_GRO_FLOW_TBL_SIZE];
+    int ret = 0;
+
+    memset(&p, 0, sizeof(p));
+    p.interval_ms = 1000;
+    p.ctx = -1;
+    p.max_moves = 16;
+    parse_params(argc, argv, &p);
+
+    nfp = nfp_device_open(p.nfp_num);
+    if (!nfp) {
+        fprintf(stderr, "Failed to open NFP device %d\n", p.nfp_num);
+        exit(EXIT_FAILURE);
+    }
+    io.read = rtsym_read;
+    io.priv = nfp;
+
+    if (nfp_gro_stat_read(&io, &st) < 0) {
+        fprintf(stderr, "Failed to read the GRO symbols, is GRO loaded?\n");
+        nfp_device_close(nfp);
+        exit(EXIT_FAILURE);
+    }
+
+    if (p.ctx >= (int)st.num_ctx) {
+        fprintf(stderr, "Context %d is out of range, GRO has %u\n", p.ctx,
+                st.num_ctx);
+        ret = -1;
+    } else if (p.rebalance && !(st.flags & NFP_GRO_FLOW_FLAGS)) {
+        fprintf(stderr, "GRO is built without flow spreading\n");
+        ret = -1;
+    } else if (p.rebalance && flow_cnt_read(nfp, prev_cnt) < 0) {
+        fprintf(stderr, "Failed to read the flow spreading counters\n");
+        ret = -1;
+    } else if (p.interval_ms) {
+        prev = st;
+        usleep(p.interval_ms * 1000);
+        if (nfp_gro_stat_read(&io, &st) < 0 ||
+            nfp_gro_stat_delta(&prev, &st) < 0) {
+            fprintf(stderr, "Failed to read the GRO symbols again\n");
+            ret = -1;
+        }
+        nfp_gro_stat_free(&prev);
+    }
+
+    if (ret == 0) {
+        print_stat(&st, &p);
+        if (p.tapes)
+            ret = print_tapes(nfp, &st, p.ctx);
+        if (ret == 0 && p.rebalance)
+            ret = rebalance(nfp, &st, prev_cnt, p.max_moves);
+    }
+
+    nfp_gro_stat_free(&st);
+    nfp_device_close(nfp);
+    return ret < 0 ? EXIT_FAILURE : 0;
+}
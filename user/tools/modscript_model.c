@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/modscript_model.c
+ * @brief         Round trip checks of the libmodscript direct edit scripts
+ *
+ * For every packet offset, edit, edit offset and length the model checks
+ * that nfp_modscript_encode() accepts exactly the edits
+ * modscript_edit_write() supports, that the script decodes back to the
+ * edit, and that the packet the modifier sends from the buffer, script
+ * and packet included, is the original packet with the edit made.  A few
+ * scripts are checked word for word, and malformed scripts must be
+ * rejected by the decoder.
+ *
+ * The program exits with a failure if any check fails.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nfp_modscript.h"
+
+#define BUF_SZ          512
+#define PKT_LEN         300
+
+static int failures;
+
+#define CHECK(_cond, ...)                                   \
+    do {                                                    \
+        if (!(_cond)) {                                     \
+            printf("FAIL: " __VA_ARGS__);                   \
+            printf("\n");                                   \
+            failures++;                                     \
+        }                                                   \
+    } while (0)
+
+static const char *act_names[] = {"none", "delete", "replace", "insert"};
+
+/* Whether modscript_edit_write() supports an edit, from its description */
+static int
+supported(const struct nfp_modscript_edit *e, unsigned int off)
+{
+    unsigned int ms_len, ms_off;
+
+    if (e->len == 0 || e->len > NFP_MODSCRIPT_MAX_LEN ||
+        e->at > NFP_MODSCRIPT_MAX_AT)
+        return 0;
+
+    if (e->act == NFP_MODSCRIPT_ACT_DELETE && e->at == 0) {
+        if (off < 16 || e->len + (off & 7) > NFP_MODSCRIPT_MAX_LEN)
+            return 0;
+        ms_off = (off & ~7) - 8;
+        return ms_off <= NFP_MODSCRIPT_MAX_OFF;
+    }
+
+    ms_len = (e->act == NFP_MODSCRIPT_ACT_DELETE) ?
+        8 : (4 + e->len + 7) & ~7;
+    if ((off & 7) != 0 || off < ms_len + 8)
+        return 0;
+    return off - ms_len <= NFP_MODSCRIPT_MAX_OFF;
+}
+
+/* The packet with the edit made */
+static unsigned int
+expect(const uint8_t *pkt, unsigned int len,
+       const struct nfp_modscript_edit *e, uint8_t *out)
+{
+    memcpy(out, pkt, e->at);
+    switch (e->act) {
+    case NFP_MODSCRIPT_ACT_DELETE:
+        memcpy(out + e->at, pkt + e->at + e->len, len - e->at - e->len);
+        return len - e->len;
+    case NFP_MODSCRIPT_ACT_REPLACE:
+        memcpy(out + e->at, e->data, e->len);
+        memcpy(out + e->at + e->len, pkt + e->at + e->len,
+               len - e->at - e->len);
+        return len;
+    default:
+        memcpy(out + e->at, e->data, e->len);
+        memcpy(out + e->at + e->len, pkt + e->at, len - e->at);
+        return len + e->len;
+    }
+}
+
+static void
+check_edit(const struct nfp_modscript_edit *e, unsigned int off)
+{
+    uint8_t script[NFP_MODSCRIPT_MAX_SZ];
+    uint8_t buf[BUF_SZ], out[BUF_SZ], exp[BUF_SZ];
+    struct nfp_modscript_edit d;
+    unsigned int ms_off, gap, exp_len;
+    int ms_len, len, i;
+
+    ms_len = nfp_modscript_encode(e, off, script, &ms_off);
+    CHECK((ms_len >= 0) == supported(e, off), "%s at %u len %u off %u: %s",
+          act_names[e->act], e->at, e->len, off,
+          ms_len < 0 ? "rejected" : "accepted");
+    if (ms_len < 0)
+        return;
+
+    CHECK(ms_off % 8 == 0 && ms_len % 8 == 0 &&
+          ms_len <= NFP_MODSCRIPT_MAX_SZ,
+          "%s off %u: script of %d B at %u", act_names[e->act], off, ms_len,
+          ms_off);
+
+    /* Round trip, a delete at 0 also deletes up to the packet */
+    gap = off - ms_off - ms_len;
+    CHECK(nfp_modscript_decode(script, sizeof(script), &d) == ms_len &&
+          d.act == e->act && d.at == e->at && d.len == e->len + gap &&
+          memcmp(d.data, e->data, e->act == NFP_MODSCRIPT_ACT_DELETE ?
+                 0 : e->len) == 0,
+          "%s at %u len %u off %u: decodes to %s at %u len %u",
+          act_names[e->act], e->at, e->len, off, act_names[d.act], d.at,
+          d.len);
+
+    /* What the modifier sends, with garbage in the gap */
+    for (i = 0; i < BUF_SZ; i++)
+        buf[i] = (i < (int)off) ? 0xa5 : (i - off) * 7 + 3;
+    memcpy(buf + ms_off, script, ms_len);
+
+    len = nfp_modscript_apply(buf, ms_off, off + PKT_LEN, out, sizeof(out));
+    if (e->at + (e->act == NFP_MODSCRIPT_ACT_INSERT ? 0 : e->len) >
+        PKT_LEN) {
+        CHECK(len < 0, "%s at %u len %u: applied past the packet",
+              act_names[e->act], e->at, e->len);
+        return;
+    }
+    exp_len = expect(buf + off, PKT_LEN, e, exp);
+    CHECK(len == (int)exp_len && memcmp(out, exp, exp_len) == 0,
+          "%s at %u len %u off %u: wrong packet sent",
+          act_names[e->act], e->at, e->len, off);
+}
+
+static void
+check_round_trip(void)
+{
+    const unsigned int ats[] = {0, 1, 2, 6, 12, 13, 14, 18, 30, 64, 255,
+                                256};
+    struct nfp_modscript_edit e;
+    unsigned int off, act, a, len, i;
+
+    for (off = 0; off < 256; off++) {
+        for (act = NFP_MODSCRIPT_ACT_DELETE; act <= NFP_MODSCRIPT_ACT_INSERT;
+             act++) {
+            for (a = 0; a < sizeof(ats) / sizeof(ats[0]); a++) {
+                for (len = 0; len <= NFP_MODSCRIPT_MAX_LEN + 1; len++) {
+                    e.act = act;
+                    e.at = ats[a];
+                    e.len = len;
+                    for (i = 0; i < sizeof(e.data); i++)
+                        e.data[i] = 0xf0 + i + len + off;
+                    check_edit(&e, off);
+                }
+            }
+        }
+    }
+}
+
+/* Scripts worked out by hand from the modifier script format */
+static void
+check_vectors(void)
+{
+    const struct {
+        struct nfp_modscript_edit e;
+        unsigned int off;
+        unsigned int ms_off;
+        uint32_t w0, w1;
+    } v[] = {
+        /* Pop a VLAN tag of a packet at 64 */
+        {{NFP_MODSCRIPT_ACT_DELETE, 12, 4, {0}}, 64, 56,
+         0x80060c00, 0x00000000},
+        /* Delete 2 bytes up to a packet at 42 and 14 bytes of it */
+        {{NFP_MODSCRIPT_ACT_DELETE, 0, 14, {0}}, 42, 32,
+         0x801e0000, 0x00000000},
+        /* Rewrite a VLAN tag */
+        {{NFP_MODSCRIPT_ACT_REPLACE, 12, 4, {0x81, 0x00, 0x00, 0x64}},
+         64, 56, 0x80460c04, 0x81000064},
+        /* Push a VLAN tag */
+        {{NFP_MODSCRIPT_ACT_INSERT, 12, 4, {0x81, 0x00, 0x00, 0x64}},
+         64, 56, 0x80260c04, 0x81000064},
+    };
+    uint8_t script[NFP_MODSCRIPT_MAX_SZ];
+    unsigned int ms_off;
+    uint32_t w0, w1;
+    unsigned int i;
+    int ms_len;
+
+    for (i = 0; i < sizeof(v) / sizeof(v[0]); i++) {
+        ms_len = nfp_modscript_encode(&v[i].e, v[i].off, script, &ms_off);
+        w0 = ((uint32_t)script[0] << 24) | (script[1] << 16) |
+             (script[2] << 8) | script[3];
+        w1 = ((uint32_t)script[4] << 24) | (script[5] << 16) |
+             (script[6] << 8) | script[7];
+        CHECK(ms_len == 8 && ms_off == v[i].ms_off && w0 == v[i].w0 &&
+              w1 == v[i].w1, "vector %u: %d B at %u, %08x %08x", i, ms_len,
+              ms_off, w0, w1);
+    }
+}
+
+static void
+check_reject(void)
+{
+    const uint32_t bad[] = {
+        0x00060c00,     /* Indirect */
+        0x81060c00,     /* Reserved bits */
+        0x80060c20,     /* Reserved bits */
+        0x80070c00,     /* Data from config RAM */
+        0x80060c04,     /* Delete with data */
+        0x80460c03,     /* Replace with the wrong data length */
+        0x80660c00,     /* Increment */
+        0x80e00000,     /* No-op */
+    };
+    struct nfp_modscript_edit e;
+    uint8_t script[NFP_MODSCRIPT_MAX_SZ];
+    unsigned int i;
+
+    memset(script, 0, sizeof(script));
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        script[0] = bad[i] >> 24;
+        script[1] = bad[i] >> 16;
+        script[2] = bad[i] >> 8;
+        script[3] = bad[i];
+        CHECK(nfp_modscript_decode(script, sizeof(script), &e) < 0,
+              "script %08x accepted", bad[i]);
+    }
+
+    /* Truncated script */
+    script[0] = 0x80;
+    script[1] = 0x5e;
+    script[2] = 0x00;
+    script[3] = 0x10;
+    CHECK(nfp_modscript_decode(script, 16, &e) < 0,
+          "truncated script accepted");
+    CHECK(nfp_modscript_decode(script, 24, &e) == 24,
+          "16 B replace not decoded");
+}
+
+int main(int argc, char *argv[])
+{
+    check_vectors();
+    check_reject();
+    check_round_trip();
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
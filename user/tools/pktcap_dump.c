@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/pktcap_dump.c
+ * @brief         Configure the pktio_cap() tap and drain it to pcapng.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <nfp.h>
+#include <nfp_nffw.h>
+
+#include "nfp_pktcap.h"
+
+/* Records consumed per nfp_pktcap_drain() */
+#define DRAIN_BATCH     64
+
+struct parameters
+{
+    int nfp_num;
+    double rate;
+    double me_mhz;
+    unsigned int snaplen;
+    uint32_t points;
+    unsigned int src_val, src_mask;
+    unsigned int dst_val, dst_mask;
+    unsigned int len_min, len_max;
+    unsigned long count;
+    unsigned int poll_ms;
+    const char *file;
+};
+
+struct dump_state {
+    FILE *f;
+    double me_mhz;
+    unsigned long written;
+};
+
+static volatile sig_atomic_t stop;
+
+void usage(void)
+{
+    printf("pktcap_dump [options] start|stop|dump|stats\n"
+           "options:\n"
+           " -n, --nfp <nfp num>    Select which NFP to access (default 0)\n"
+           " -r, --rate <n>         Capture 1 in n matching packets\n"
+           "                        (default 1)\n"
+           " -s, --snaplen <bytes>  Bytes kept per packet (default %d)\n"
+           " -P, --points <mask>    Tap points to capture (default all)\n"
+           " -S, --src <val[/mask]> Match Pkt.p_src (default any)\n"
+           " -D, --dst <val[/mask]> Match Pkt.p_dst (default any)\n"
+           " -l, --len <min:max>    Match the packet length (default any)\n"
+           " -c, --count <num>      Records to dump, 0 for no limit\n"
+           "                        (default 0)\n"
+           " -w, --write <file>     pcapng file to dump to\n"
+           "                        (default pktcap.pcapng)\n"
+           " -f, --freq <MHz>       ME clock frequency (default 1200)\n"
+           " -i, --interval <ms>    Poll interval when idle (default 10)\n\n",
+           NFP_PKTCAP_SNAP_MAX);
+}
+
+static const struct option g_opt[] = {
+    {"help",     no_argument,        NULL, 'h'},
+    {"nfp",      required_argument,  NULL, 'n'},
+    {"rate",     required_argument,  NULL, 'r'},
+    {"snaplen",  required_argument,  NULL, 's'},
+    {"points",   required_argument,  NULL, 'P'},
+    {"src",      required_argument,  NULL, 'S'},
+    {"dst",      required_argument,  NULL, 'D'},
+    {"len",      required_argument,  NULL, 'l'},
+    {"count",    required_argument,  NULL, 'c'},
+    {"write",    required_argument,  NULL, 'w'},
+    {"freq",     required_argument,  NULL, 'f'},
+    {"interval", required_argument,  NULL, 'i'},
+    {NULL,       0, 0, '\0'}
+};
+
+static const char *g_optstr = "hn:r:s:P:S:D:l:c:w:f:i:";
+
+/* Parse <val>[/<mask>], a missing mask matching all 16 bits */
+static int
+parse_match(const char *arg, unsigned int *val, unsigned int *mask)
+{
+    char *end;
+
+    *val = strtoul(arg, &end, 0);
+    *mask = 0xffff;
+    if (*end == '/')
+        *mask = strtoul(end + 1, &end, 0);
+    return (*end != '\0' || *val > 0xffff || *mask > 0xffff) ? -1 : 0;
+}
+
+void parse_params(int argc, char *argv[], struct parameters *p)
+{
+    int c;
+
+    if (argc == 1) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    while ((c = getopt_long(argc, argv, g_optstr, g_opt, NULL)) != -1) {
+        switch (c) {
+        case 'h':
+            usage();
+            exit(EXIT_SUCCESS);
+            break;
+        case 'n':
+            p->nfp_num = atoi(optarg);
+            break;
+        case 'r':
+            p->rate = atof(optarg);
+            if (p->rate < 1) {
+                fprintf(stderr, "Rate must be 1 or more\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            p->snaplen = atoi(optarg);
+            if (p->snaplen == 0 || p->snaplen > NFP_PKTCAP_SNAP_MAX) {
+                fprintf(stderr, "Snap length must be 1 to %d\n",
+                        NFP_PKTCAP_SNAP_MAX);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'P':
+            p->points = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            if (parse_match(optarg, &p->src_val, &p->src_mask) < 0) {
+                fprintf(stderr, "Source must be <val>[/<mask>]\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'D':
+            if (parse_match(optarg, &p->dst_val, &p->dst_mask) < 0) {
+                fprintf(stderr, "Destination must be <val>[/<mask>]\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'l':
+            if (sscanf(optarg, "%u:%u", &p->len_min, &p->len_max) != 2 ||
+                p->len_min > p->len_max || p->len_max > 0xffff) {
+                fprintf(stderr, "Length must be <min>:<max>\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'c':
+            p->count = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            p->file = optarg;
+            break;
+        case 'f':
+            p->me_mhz = atof(optarg);
+            break;
+        case 'i':
+            p->poll_ms = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Unknown option: '%c'\n", c);
+            usage();
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+}
+
+static int
+rtsym_read(void *priv, const char *name, uint32_t *words, size_t len,
+           uint64_t off)
+{
+    struct nfp_device *nfp = priv;
+    const struct nfp_rtsym *sym;
+
+    sym = nfp_rtsym_lookup(nfp, name);
+    if (!sym)
+        return -1;
+    return nfp_rtsym_read(nfp, sym, words, len, off) < 0 ? -1 : 0;
+}
+
+static int
+rtsym_write(void *priv, const char *name, const uint32_t *words,
+            size_t len, uint64_t off)
+{
+    struct nfp_device *nfp = priv;
+    const struct nfp_rtsym *sym;
+
+    sym = nfp_rtsym_lookup(nfp, name);
+    if (!sym)
+        return -1;
+    return nfp_rtsym_write(nfp, sym, words, len, off) < 0 ? -1 : 0;
+}
+
+static int
+pktcap_start(struct nfp_pktcap_io *io, struct parameters *p)
+{
+    struct nfp_pktcap_cfg cfg;
+    uint32_t words[NFP_PKTCAP_CFG_LW];
+
+    cfg.sample = nfp_pktcap_sample(p->rate);
+    cfg.snaplen = p->snaplen;
+    cfg.points = p->points;
+    cfg.src_val = p->src_val & p->src_mask;
+    cfg.src_mask = p->src_mask;
+    cfg.dst_val = p->dst_val & p->dst_mask;
+    cfg.dst_mask = p->dst_mask;
+    cfg.len_min = p->len_min;
+    cfg.len_max = p->len_max;
+
+    nfp_pktcap_cfg_pack(&cfg, words);
+    if (io->write(io->priv, NFP_PKTCAP_CTL_SYM, words, sizeof(words), 0) < 0)
+        return -1;
+
+    printf("capturing 1 in %.1f packets (sample %u), %u B each\n",
+           (double)NFP_PKTCAP_SAMPLE_ALL / cfg.sample, cfg.sample,
+           cfg.snaplen);
+    return 0;
+}
+
+static int
+pktcap_stop(struct nfp_pktcap_io *io, struct parameters *p)
+{
+    uint32_t sample = 0;
+
+    return io->write(io->priv, NFP_PKTCAP_CTL_SYM, &sample, sizeof(sample),
+                     0);
+}
+
+static int
+pktcap_stats(struct nfp_pktcap_io *io, struct parameters *p)
+{
+    struct nfp_pktcap_cfg cfg;
+    uint32_t words[NFP_PKTCAP_CTL_LW];
+
+    if (io->read(io->priv, NFP_PKTCAP_CTL_SYM, words, sizeof(words), 0) < 0)
+        return -1;
+    nfp_pktcap_cfg_unpack(words, &cfg);
+
+    printf("sample %u/%u snaplen %u points 0x%08x\n"
+           "src 0x%04x/0x%04x dst 0x%04x/0x%04x len %u:%u\n"
+           "published %u consumed %u pending %u\n",
+           cfg.sample, NFP_PKTCAP_SAMPLE_ALL, cfg.snaplen, cfg.points,
+           cfg.src_val, cfg.src_mask, cfg.dst_val, cfg.dst_mask,
+           cfg.len_min, cfg.len_max, words[NFP_PKTCAP_CTL_PROD],
+           words[NFP_PKTCAP_CTL_CONS],
+           words[NFP_PKTCAP_CTL_PROD] - words[NFP_PKTCAP_CTL_CONS]);
+    return 0;
+}
+
+static int
+dump_rec(void *arg, const struct nfp_pktcap_rec *rec)
+{
+    struct dump_state *st = arg;
+    uint8_t buf[256];
+    int len;
+
+    len = nfp_pktcap_pcapng_epb(buf, sizeof(buf), rec, st->me_mhz);
+    if (len < 0 || fwrite(buf, len, 1, st->f) != 1)
+        return -1;
+    st->written++;
+    return 0;
+}
+
+static void
+sig_stop(int sig)
+{
+    stop = 1;
+}
+
+static int
+pktcap_dump(struct nfp_pktcap_io *io, struct parameters *p)
+{
+    struct dump_state st;
+    uint8_t hdr[64];
+    unsigned int max;
+    int len, n;
+
+    st.f = fopen(p->file, "wb");
+    if (!st.f) {
+        fprintf(stderr, "Failed to open %s: %s\n", p->file,
+                strerror(errno));
+        return -1;
+    }
+    st.me_mhz = p->me_mhz;
+    st.written = 0;
+
+    len = nfp_pktcap_pcapng_hdr(hdr, sizeof(hdr), NFP_PKTCAP_SNAP_MAX);
+    if (fwrite(hdr, len, 1, st.f) != 1) {
+        fclose(st.f);
+        return -1;
+    }
+
+    signal(SIGINT, sig_stop);
+    signal(SIGTERM, sig_stop);
+    while (!stop && (p->count == 0 || st.written < p->count)) {
+        max = DRAIN_BATCH;
+        if (p->count != 0 && p->count - st.written < max)
+            max = p->count - st.written;
+
+        n = nfp_pktcap_drain(io, dump_rec, &st, max);
+        if (n < 0) {
+            fclose(st.f);
+            return -1;
+        }
+        if (n == 0) {
+            fflush(st.f);
+            usleep(p->poll_ms * 1000);
+        }
+    }
+
+    fclose(st.f);
+    printf("%lu records written to %s\n", st.written, p->file);
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    struct parameters p;
+    struct nfp_device *nfp;
+    struct nfp_pktcap_io io;
+    const char *cmd;
+    int ret;
+
+    memset(&p, 0, sizeof(p));
+    p.rate = 1;
+    p.me_mhz = 1200;
+    p.snaplen = NFP_PKTCAP_SNAP_MAX;
+    p.points = 0xffffffff;
+    p.len_max = 0xffff;
+    p.poll_ms = 10;
+    p.file = "pktcap.pcapng";
+    parse_params(argc, argv, &p);
+
+    if (optind == argc) {
+        fprintf(stderr, "error: command must be provided\n");
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    cmd = argv[optind];
+
+    nfp = nfp_device_open(p.nfp_num);
+    if (!nfp) {
+        fprintf(stderr, "Failed to open NFP device %d\n", p.nfp_num);
+        exit(EXIT_FAILURE);
+    }
+    io.read = rtsym_read;
+    io.write = rtsym_write;
+    io.priv = nfp;
+
+    if (!nfp_rtsym_lookup(nfp, NFP_PKTCAP_CTL_SYM)) {
+        fprintf(stderr, "pktio capture symbols not found, is the firmware "
+                "built with PKTIO_CAP_ENABLED?\n");
+        ret = -1;
+    } else if (strcmp(cmd, "start") == 0) {
+        ret = pktcap_start(&io, &p);
+    } else if (strcmp(cmd, "stop") == 0) {
+        ret = pktcap_stop(&io, &p);
+    } else if (strcmp(cmd, "dump") == 0) {
+        ret = pktcap_dump(&io, &p);
+    } else if (strcmp(cmd, "stats") == 0) {
+        ret = pktcap_stats(&io, &p);
+    } else {
+        fprintf(stderr, "Unknown command: %s\n", cmd);
+        usage();
+        ret = -1;
+    }
+
+    nfp_device_close(nfp);
+    if (ret < 0) {
+        fprintf(stderr, "%s failed\n", cmd);
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
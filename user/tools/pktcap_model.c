@@ -0,0 +1,670 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/pktcap_model.c
+ * @brief         Host model of the pktio_cap() tap and its drain to pcapng
+ *
+ * The firmware side is replayed against memory: the queue engine rings of
+ * free and captured slots are stood in for by arrays that refuse a put
+ * when full and a get when empty, and pktio_cap() and pktio_cap_drain()
+ * are mirrored word for word, as is the per ME caching of the
+ * configuration.  The host side is the real nfp_pktcap_drain() reading
+ * the symbols from that memory, and the pcapng it writes is parsed back
+ * and compared with the packets tapped.
+ *
+ * Checks cover the records of packets at any alignment, the filters, the
+ * sampling rate, drops and recovery when the host falls behind, slots
+ * never being lost, configuration refresh and bad host indices.
+ *
+ * The program exits with a failure if any check fails.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nfp_pktcap.h"
+
+#define RING_ENTRIES    512     /* MEM_RING_INIT(pktio_cap_*, 2048) */
+#define CAP_REFRESH     1024    /* PKTIO_CAP_REFRESH */
+#define DRAIN_MAX       32      /* PKTIO_CAP_DRAIN_MAX */
+#define BUF_SZ          2048
+#define ME_MHZ          1200.0
+
+static int failures;
+
+#define CHECK(_cond, ...)                                   \
+    do {                                                    \
+        if (!(_cond)) {                                     \
+            printf("FAIL: " __VA_ARGS__);                   \
+            printf("\n");                                   \
+            failures++;                                     \
+        }                                                   \
+    } while (0)
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t
+rng32(void)
+{
+    /* xorshift64*, deterministic so that runs are comparable */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 2685821657736338717ULL) >> 32;
+}
+
+/* Stand-in for a queue engine ring */
+struct ring {
+    uint32_t e[RING_ENTRIES];
+    unsigned int head;
+    unsigned int count;
+};
+
+static int
+ring_put(struct ring *r, uint32_t v)
+{
+    if (r->count == RING_ENTRIES)
+        return -1;
+    r->e[(r->head + r->count++) % RING_ENTRIES] = v;
+    return 0;
+}
+
+static int
+ring_get(struct ring *r, uint32_t *v)
+{
+    if (r->count == 0)
+        return -1;
+    *v = r->e[r->head];
+    r->head = (r->head + 1) % RING_ENTRIES;
+    r->count--;
+    return 0;
+}
+
+/* Firmware state: the symbols, the rings and the LMEM of the MEs */
+struct fw {
+    uint32_t ctl[NFP_PKTCAP_CTL_LW];
+    uint32_t slots[NFP_PKTCAP_SLOTS][NFP_PKTCAP_SLOT_LW];
+    uint32_t idx[NFP_PKTCAP_SLOTS];
+    struct ring free;
+    struct ring cap;
+    uint32_t cfg[NFP_PKTCAP_CFG_LW];
+    uint32_t calls;
+    uint32_t prod;
+    uint32_t freed;
+    uint64_t tsc;
+    unsigned long cntr_cap;
+    unsigned long cntr_err;
+};
+
+static struct fw fw;
+
+/* The current packet */
+struct pkt {
+    uint8_t buf[BUF_SZ];
+    unsigned int off;
+    unsigned int len;
+    uint16_t src;
+    uint16_t dst;
+};
+
+static void
+fw_init(const struct nfp_pktcap_cfg *cfg)
+{
+    uint32_t slot;
+
+    memset(&fw, 0, sizeof(fw));
+    fw.tsc = 1000;
+    if (cfg)
+        nfp_pktcap_cfg_pack(cfg, fw.ctl);
+
+    /* pktio_cap_init() */
+    for (slot = 0; slot < NFP_PKTCAP_SLOTS; slot++)
+        ring_put(&fw.free, slot);
+}
+
+static uint32_t
+get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Mirror of pktio_cap() */
+static int
+fw_cap(const struct pkt *p, unsigned int point)
+{
+    uint32_t sample, snaplen, points, slot, snap, off, end;
+    uint32_t *w;
+    unsigned int i;
+
+    fw.tsc += 1 + rng32() % 100;
+
+    if ((fw.calls++ & (CAP_REFRESH - 1)) == 0)
+        memcpy(fw.cfg, fw.ctl, sizeof(fw.cfg));
+
+    sample = fw.cfg[0];
+    snaplen = fw.cfg[1];
+    points = fw.cfg[2];
+    if (sample == 0 || point > 31 || !((points >> point) & 1))
+        return 0;
+
+    if (((p->src ^ fw.cfg[3]) & (fw.cfg[3] >> 16) & 0xffff) ||
+        ((p->dst ^ fw.cfg[4]) & (fw.cfg[4] >> 16) & 0xffff) ||
+        p->len < (fw.cfg[5] >> 16) || p->len > (fw.cfg[5] & 0xffff))
+        return 0;
+
+    if (sample < NFP_PKTCAP_SAMPLE_ALL && (rng32() & 0xffff) >= sample)
+        return 0;
+
+    if (ring_get(&fw.free, &slot) < 0) {
+        fw.cntr_err++;
+        return -1;
+    }
+    slot &= NFP_PKTCAP_SLOTS - 1;
+
+    snap = p->len;
+    if (snap > snaplen)
+        snap = snaplen;
+    if (snap > NFP_PKTCAP_SNAP_MAX)
+        snap = NFP_PKTCAP_SNAP_MAX;
+
+    w = fw.slots[slot];
+    end = (p->off + snap + 3) & ~3;
+    for (i = NFP_PKTCAP_HDR_LW, off = p->off & ~3; off < end; off += 4) {
+        CHECK(i < NFP_PKTCAP_SLOT_LW, "copy past the slot, off %u snap %u",
+              p->off, snap);
+        if (i >= NFP_PKTCAP_SLOT_LW)
+            break;
+        w[i++] = get32(p->buf + off);
+    }
+
+    w[0] = fw.tsc >> 32;
+    w[1] = fw.tsc;
+    w[2] = (point << 24) | ((p->off & 3) << 22) | (snap << 15) | p->len;
+    w[3] = ((uint32_t)p->src << 16) | p->dst;
+
+    CHECK(ring_put(&fw.cap, slot) == 0, "capture ring full");
+    fw.cntr_cap++;
+    return 1;
+}
+
+/* Mirror of pktio_cap_drain() */
+static void
+fw_drain(void)
+{
+    uint32_t prod = fw.prod;
+    uint32_t freed = fw.freed;
+    uint32_t cons, slot, n;
+
+    cons = fw.ctl[NFP_PKTCAP_CTL_CONS];
+    if (cons - freed > prod - freed)
+        cons = prod;
+    for (; freed != cons; freed++)
+        ring_put(&fw.free, fw.idx[freed & (NFP_PKTCAP_SLOTS - 1)]);
+
+    for (n = 0; n < DRAIN_MAX && prod - freed < NFP_PKTCAP_SLOTS; n++) {
+        if (ring_get(&fw.cap, &slot) < 0)
+            break;
+        fw.idx[prod & (NFP_PKTCAP_SLOTS - 1)] = slot;
+        prod++;
+    }
+    if (n != 0)
+        fw.ctl[NFP_PKTCAP_CTL_PROD] = prod;
+
+    fw.prod = prod;
+    fw.freed = freed;
+}
+
+/* Symbol access for nfp_pktcap_drain(), against struct fw */
+static uint32_t *
+sym_words(const char *sym, size_t *size)
+{
+    if (strcmp(sym, NFP_PKTCAP_CTL_SYM) == 0) {
+        *size = sizeof(fw.ctl);
+        return fw.ctl;
+    }
+    if (strcmp(sym, NFP_PKTCAP_SLOTS_SYM) == 0) {
+        *size = sizeof(fw.slots);
+        return fw.slots[0];
+    }
+    if (strcmp(sym, NFP_PKTCAP_IDX_SYM) == 0) {
+        *size = sizeof(fw.idx);
+        return fw.idx;
+    }
+    return NULL;
+}
+
+static int
+mem_read(void *priv, const char *sym, uint32_t *words, size_t len,
+         uint64_t off)
+{
+    size_t size;
+    uint32_t *base = sym_words(sym, &size);
+
+    if (!base || off % 4 || len % 4 || off + len > size)
+        return -1;
+    memcpy(words, base + off / 4, len);
+    return 0;
+}
+
+static int
+mem_write(void *priv, const char *sym, const uint32_t *words, size_t len,
+          uint64_t off)
+{
+    size_t size;
+    uint32_t *base = sym_words(sym, &size);
+
+    if (!base || off % 4 || len % 4 || off + len > size)
+        return -1;
+    memcpy(base + off / 4, words, len);
+    return 0;
+}
+
+static const struct nfp_pktcap_io mem_io = {mem_read, mem_write, NULL};
+
+/* pcapng written by the host */
+struct out {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+};
+
+static int
+out_rec(void *arg, const struct nfp_pktcap_rec *rec)
+{
+    struct out *o = arg;
+    int len;
+
+    len = nfp_pktcap_pcapng_epb(o->buf + o->len, o->size - o->len, rec,
+                                ME_MHZ);
+    if (len < 0)
+        return -1;
+    o->len += len;
+    return 0;
+}
+
+static int
+count_rec(void *arg, const struct nfp_pktcap_rec *rec)
+{
+    (*(unsigned long *)arg)++;
+    return 0;
+}
+
+static void
+rand_pkt(struct pkt *p)
+{
+    unsigned int i;
+
+    p->off = 32 + rng32() % 64;
+    p->len = 14 + rng32() % 1500;
+    p->src = rng32();
+    p->dst = rng32();
+    for (i = 0; i < BUF_SZ; i++)
+        p->buf[i] = rng32();
+}
+
+static struct nfp_pktcap_cfg
+cfg_all(unsigned int snaplen)
+{
+    struct nfp_pktcap_cfg cfg;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.sample = NFP_PKTCAP_SAMPLE_ALL;
+    cfg.snaplen = snaplen;
+    cfg.points = 0xffffffff;
+    cfg.len_max = 0xffff;
+    return cfg;
+}
+
+static uint32_t
+rd32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint16_t
+rd16(const uint8_t *p)
+{
+    uint16_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Expected records, in order */
+struct exp {
+    uint64_t tsc;
+    unsigned int point, len, snap;
+    uint16_t src, dst;
+    uint8_t data[NFP_PKTCAP_SNAP_MAX];
+};
+
+static void
+check_pcapng(const struct out *o, const struct exp *e, unsigned int num)
+{
+    const uint8_t *b = o->buf;
+    char comment[64];
+    unsigned int i, blen, clen, off;
+    uint64_t ns;
+
+    CHECK(o->len >= 60 && rd32(b) == 0x0a0d0d0a && rd32(b + 4) == 28 &&
+          rd32(b + 8) == 0x1a2b3c4d && rd32(b + 24) == 28,
+          "bad section header");
+    CHECK(rd32(b + 28) == 1 && rd32(b + 32) == 32 && rd16(b + 36) == 1 &&
+          rd16(b + 44) == 9 && b[48] == 9 && rd32(b + 56) == 32,
+          "bad interface block");
+
+    off = 60;
+    for (i = 0; i < num; i++) {
+        if (off + 28 > o->len) {
+            CHECK(0, "%u records in the pcapng, expected %u", i, num);
+            return;
+        }
+        b = o->buf + off;
+        blen = rd32(b + 4);
+        ns = ((uint64_t)rd32(b + 12) << 32) | rd32(b + 16);
+        CHECK(rd32(b) == 6 && blen % 4 == 0 && off + blen <= o->len &&
+              rd32(b + blen - 4) == blen, "record %u: bad block", i);
+        CHECK(rd32(b + 20) == e[i].snap && rd32(b + 24) == e[i].len &&
+              memcmp(b + 28, e[i].data, e[i].snap) == 0,
+              "record %u: %u of %u B, expected %u of %u", i, rd32(b + 20),
+              rd32(b + 24), e[i].snap, e[i].len);
+        CHECK(ns == nfp_pktcap_tsc_ns(e[i].tsc, ME_MHZ),
+              "record %u: timestamp %llu", i, (unsigned long long)ns);
+
+        snprintf(comment, sizeof(comment), "point %u src 0x%04x dst 0x%04x",
+                 e[i].point, e[i].src, e[i].dst);
+        clen = rd16(b + 28 + ((e[i].snap + 3) & ~3) + 2);
+        CHECK(clen == strlen(comment) &&
+              memcmp(b + 28 + ((e[i].snap + 3) & ~3) + 4, comment,
+                     clen) == 0, "record %u: bad comment", i);
+        off += blen;
+    }
+    CHECK(off == o->len, "%zu trailing bytes in the pcapng", o->len - off);
+}
+
+/* Packets at any alignment and length, through to pcapng */
+static void
+check_end_to_end(unsigned int snaplen)
+{
+    struct nfp_pktcap_cfg cfg = cfg_all(snaplen);
+    static struct exp e[1000];
+    struct pkt p;
+    struct out o;
+    unsigned int i, num = 0;
+    int ret;
+
+    cfg.points = 0x3;
+    fw_init(&cfg);
+
+    o.size = 1 << 20;
+    o.buf = malloc(o.size);
+    o.len = nfp_pktcap_pcapng_hdr(o.buf, o.size, NFP_PKTCAP_SNAP_MAX);
+
+    for (i = 0; i < 1000; i++) {
+        rand_pkt(&p);
+        ret = fw_cap(&p, i % 3);
+        CHECK(ret == (i % 3 < 2), "snaplen %u packet %u: tap returned %d",
+              snaplen, i, ret);
+        if (ret == 1) {
+            e[num].tsc = fw.tsc;
+            e[num].point = i % 3;
+            e[num].len = p.len;
+            e[num].snap = p.len < snaplen ? p.len : snaplen;
+            e[num].src = p.src;
+            e[num].dst = p.dst;
+            memcpy(e[num].data, p.buf + p.off, e[num].snap);
+            num++;
+        }
+
+        if (i % 10 == 9) {
+            fw_drain();
+            CHECK(nfp_pktcap_drain(&mem_io, out_rec, &o, 1000) >= 0,
+                  "drain failed");
+        }
+    }
+    fw_drain();
+    nfp_pktcap_drain(&mem_io, out_rec, &o, 1000);
+
+    CHECK(fw.cntr_err == 0, "%lu samples dropped", fw.cntr_err);
+    check_pcapng(&o, e, num);
+    free(o.buf);
+}
+
+/* Filters on the ports and length */
+static void
+check_filters(void)
+{
+    struct nfp_pktcap_cfg cfg;
+    struct pkt p;
+    unsigned int i, t, match;
+    int ret;
+
+    for (t = 0; t < 4; t++) {
+        cfg = cfg_all(64);
+        switch (t) {
+        case 0:
+            cfg.src_mask = 0xff00;
+            cfg.src_val = 0x2000;
+            break;
+        case 1:
+            cfg.dst_mask = 0x0003;
+            cfg.dst_val = 0x0001;
+            break;
+        case 2:
+            cfg.len_min = 100;
+            cfg.len_max = 200;
+            break;
+        default:
+            cfg.points = 0x10;
+            break;
+        }
+        fw_init(&cfg);
+
+        for (i = 0; i < 5000; i++) {
+            rand_pkt(&p);
+            if (i % 4 == 0)
+                p.src = 0x2000 | (p.src & 0xff);
+            if (i % 3 == 0)
+                p.len = 90 + i % 120;
+            match = ((p.src & cfg.src_mask) == cfg.src_val) &&
+                ((p.dst & cfg.dst_mask) == cfg.dst_val) &&
+                p.len >= cfg.len_min && p.len <= cfg.len_max &&
+                ((cfg.points >> (i % 8)) & 1);
+
+            ret = fw_cap(&p, i % 8);
+            CHECK(ret == (int)match, "filter %u packet %u: tap returned %d",
+                  t, i, ret);
+
+            fw_drain();
+            fw.ctl[NFP_PKTCAP_CTL_CONS] = fw.ctl[NFP_PKTCAP_CTL_PROD];
+        }
+    }
+}
+
+/* The fraction of packets sampled */
+static void
+check_sampling(void)
+{
+    const double rates[] = {1, 2, 8, 100, 1000};
+    struct nfp_pktcap_cfg cfg;
+    struct pkt p;
+    unsigned long n, got;
+    unsigned int r;
+    double want;
+
+    CHECK(nfp_pktcap_sample(1) == NFP_PKTCAP_SAMPLE_ALL &&
+          nfp_pktcap_sample(0.5) == 0 && nfp_pktcap_sample(1e9) == 1,
+          "sample values");
+
+    rand_pkt(&p);
+    for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        cfg = cfg_all(64);
+        cfg.sample = nfp_pktcap_sample(rates[r]);
+        fw_init(&cfg);
+
+        got = 0;
+        for (n = 0; n < 400000; n++) {
+            fw_cap(&p, 0);
+            if (n % 16 == 15) {
+                fw_drain();
+                nfp_pktcap_drain(&mem_io, count_rec, &got, 1000);
+            }
+        }
+        fw_drain();
+        nfp_pktcap_drain(&mem_io, count_rec, &got, 1000);
+
+        want = n / rates[r];
+        CHECK(fw.cntr_err == 0 && got == fw.cntr_cap &&
+              got > want * 0.9 - 10 && got < want * 1.1 + 10,
+              "1 in %.0f: %lu of %lu sampled", rates[r], got, n);
+    }
+}
+
+/* A host that falls behind costs samples, never slots */
+static void
+check_full(void)
+{
+    struct nfp_pktcap_cfg cfg = cfg_all(64);
+    struct pkt p;
+    unsigned long got = 0;
+    unsigned int i, ok = 0, dropped = 0;
+    int ret;
+
+    fw_init(&cfg);
+    rand_pkt(&p);
+
+    for (i = 0; i < NFP_PKTCAP_SLOTS + 50; i++) {
+        ret = fw_cap(&p, 0);
+        if (ret == 1)
+            ok++;
+        else if (ret == -1)
+            dropped++;
+        fw_drain();
+    }
+    CHECK(ok == NFP_PKTCAP_SLOTS && dropped == 50 && fw.cntr_err == 50,
+          "host stalled: %u captured, %u dropped", ok, dropped);
+    CHECK(fw.ctl[NFP_PKTCAP_CTL_PROD] == NFP_PKTCAP_SLOTS,
+          "%u records published", fw.ctl[NFP_PKTCAP_CTL_PROD]);
+
+    /* The host catches up in batches and the tap recovers */
+    while (nfp_pktcap_drain(&mem_io, count_rec, &got, 40) > 0)
+        fw_drain();
+    CHECK(got == NFP_PKTCAP_SLOTS, "%lu records drained", got);
+    CHECK(fw_cap(&p, 0) == 1, "tap did not recover");
+
+    fw_drain();
+    nfp_pktcap_drain(&mem_io, count_rec, &got, 40);
+    fw_drain();
+    CHECK(fw.free.count == NFP_PKTCAP_SLOTS && fw.cap.count == 0,
+          "%u slots free, %u captured after the drain", fw.free.count,
+          fw.cap.count);
+}
+
+/* Configuration changes reach an ME within PKTIO_CAP_REFRESH calls */
+static void
+check_refresh(void)
+{
+    struct nfp_pktcap_cfg cfg = cfg_all(64);
+    struct pkt p;
+    unsigned int i, last = 0;
+
+    fw_init(&cfg);
+    rand_pkt(&p);
+
+    for (i = 0; i < 100; i++) {
+        fw_cap(&p, 0);
+        fw_drain();
+        fw.ctl[NFP_PKTCAP_CTL_CONS] = fw.ctl[NFP_PKTCAP_CTL_PROD];
+    }
+
+    fw.ctl[0] = 0;
+    for (i = 0; i < 2 * CAP_REFRESH; i++) {
+        if (fw_cap(&p, 0) == 1)
+            last = i + 1;
+        fw_drain();
+        fw.ctl[NFP_PKTCAP_CTL_CONS] = fw.ctl[NFP_PKTCAP_CTL_PROD];
+    }
+    CHECK(last > 0 && last <= CAP_REFRESH,
+          "still capturing %u calls after being disabled", last);
+}
+
+/* Indices written wrongly by the host */
+static void
+check_bad_host(void)
+{
+    struct nfp_pktcap_cfg cfg = cfg_all(64);
+    struct pkt p;
+    unsigned long got = 0;
+    uint32_t w[NFP_PKTCAP_SLOT_LW];
+    struct nfp_pktcap_rec rec;
+    unsigned int i;
+
+    fw_init(&cfg);
+    rand_pkt(&p);
+    for (i = 0; i < 10; i++)
+        fw_cap(&p, 0);
+    fw_drain();
+
+    /* A consumer index ahead of the producer frees nothing extra */
+    fw.ctl[NFP_PKTCAP_CTL_CONS] = fw.ctl[NFP_PKTCAP_CTL_PROD] + 1000;
+    fw_drain();
+    CHECK(fw.free.count == NFP_PKTCAP_SLOTS,
+          "%u slots free after a bad consumer index", fw.free.count);
+    CHECK(nfp_pktcap_drain(&mem_io, count_rec, &got, 100) == -1 && got == 0,
+          "drain accepted a consumer index ahead of the producer");
+
+    /* Slot numbers out of range */
+    fw.ctl[NFP_PKTCAP_CTL_CONS] = fw.ctl[NFP_PKTCAP_CTL_PROD] - 1;
+    fw.idx[fw.ctl[NFP_PKTCAP_CTL_CONS] % NFP_PKTCAP_SLOTS] =
+        NFP_PKTCAP_SLOTS;
+    CHECK(nfp_pktcap_drain(&mem_io, count_rec, &got, 100) == -1,
+          "drain accepted a slot out of range");
+
+    /* Inconsistent headers */
+    memset(w, 0, sizeof(w));
+    w[2] = (0 << 24) | (3 << 22) | (100 << 15) | 50;
+    CHECK(nfp_pktcap_rec_decode(w, &rec) < 0, "snap longer than packet");
+    w[2] = (0 << 24) | (3 << 22) | (110 << 15) | 500;
+    CHECK(nfp_pktcap_rec_decode(w, &rec) < 0, "snap past the slot");
+    w[2] = (32u << 24) | (10 << 15) | 500;
+    CHECK(nfp_pktcap_rec_decode(w, &rec) < 0, "tap point 32");
+    w[2] = (31u << 24) | (3 << 22) | (108 << 15) | 500;
+    CHECK(nfp_pktcap_rec_decode(w, &rec) == 0, "largest record rejected");
+}
+
+int main(int argc, char *argv[])
+{
+    check_end_to_end(64);
+    check_end_to_end(NFP_PKTCAP_SNAP_MAX);
+    check_end_to_end(1);
+    check_filters();
+    check_sampling();
+    check_full();
+    check_refresh();
+    check_bad_host();
+
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
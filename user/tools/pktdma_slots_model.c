@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/pktdma_slots_model.c
+ * @brief         Host concurrency model of the libpktdma DMA slot accounting
+ *
+ * Threads stand in for the MEs of an island, each repeatedly claiming a
+ * random number of DMA slots, holding them for the time of a DMA and
+ * returning them.  CLS atomics are C11 atomics:
+ *
+ *  - sem:  the ticketed CLS semaphore libpktdma uses by default
+ *          (SEM_WAIT_N() and SEM_POST_N() in me/lib/std), polling every
+ *          poll_int.
+ *  - part: the partitions of free slots with stealing that libpktdma
+ *          uses with PKTDMA_SLOT_PARTS_ENABLED, test_subsat being a CAS
+ *          loop.
+ *  - part-nh: the same without the hoard token, which shows how small
+ *          claims starve large ones when every failed claim gives its
+ *          slots back.
+ *
+ * A shared counter of slots held is checked against the bound of 16 on
+ * every claim.  The model prints the time spent waiting for slots (mean,
+ * 99th percentile and maximum) and the throughput of each scheme, and
+ * exits with an error if the bound was ever exceeded.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define DMA_CMDS_PER_CTM    16      /* libpktdma.c */
+#define PKTDMA_SLOT_PARTS   4       /* libpktdma.c */
+#define PKTDMA_SG_MAX_CMDS  8       /* pktdma.h */
+#define PKTDMA_SLOT_STARVE  4       /* libpktdma.c */
+#define MAX_THREADS         64
+
+#define SCHEME_SEM          0
+#define SCHEME_PART_NOHOARD 1
+#define SCHEME_PART         2
+#define SCHEME_NUM          3
+
+static const char *scheme_names[SCHEME_NUM] = {"sem", "part-nh", "part"};
+
+struct parameters
+{
+    int threads;            /* Claiming threads, i.e. MEs */
+    int iters;              /* Claims per thread */
+    int max_claim;          /* Largest claim, in slots */
+    int hold;               /* Spin loops a DMA holds its slots for */
+    int poll;               /* Spin loops between retries */
+};
+
+/* Shared state of both schemes, as in CLS */
+static struct {
+    atomic_int next_credit;                 /* struct sem */
+    atomic_int last_complete;
+    atomic_uint free[PKTDMA_SLOT_PARTS];    /* pktdma_slots[] */
+    atomic_uint hoard;                      /* pktdma_slots_hoard */
+    atomic_int held;                        /* Slots held, for checking */
+    atomic_int max_held;
+} cls;
+
+struct thread
+{
+    pthread_t tid;
+    int id;
+    int scheme;
+    const struct parameters *p;
+    unsigned int seed;
+    uint64_t *waits;        /* Wait of each claim, ns */
+};
+
+static uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+spin(int loops)
+{
+    volatile int i;
+
+    for (i = 0; i < loops; i++)
+        ;
+}
+
+/* sleep(poll_int) of an ME context: let the others run for a while */
+static void
+poll_wait(int loops)
+{
+    sched_yield();
+    spin(loops);
+}
+
+/* sem_cls_wait_n() */
+static void
+sem_wait_n(int n, int poll)
+{
+    int my_credit = atomic_fetch_add(&cls.next_credit, n);
+
+    while (my_credit + n - atomic_load(&cls.last_complete) >
+           DMA_CMDS_PER_CTM)
+        poll_wait(poll);
+}
+
+static void
+sem_post_n(int n)
+{
+    atomic_fetch_add(&cls.last_complete, n);
+}
+
+/* cls[test_subsat]: subtract saturating at 0, return the value before */
+static unsigned int
+test_subsat(atomic_uint *addr, unsigned int n)
+{
+    unsigned int old = atomic_load(addr);
+
+    while (!atomic_compare_exchange_weak(addr, &old,
+                                         (old > n) ? old - n : 0))
+        ;
+    return old;
+}
+
+/* pktdma_slots_take() */
+static void
+part_take(int part, unsigned int n, int poll, int starve)
+{
+    unsigned int got = 0, pre;
+    int tries = 0;
+    int hoard = 0;
+    int i;
+
+    for (;;) {
+        /* Leave returned slots to a starving claim */
+        if (starve && !hoard && atomic_load(&cls.hoard) != 0) {
+            poll_wait(poll);
+            continue;
+        }
+
+        for (i = 0; got < n && i < PKTDMA_SLOT_PARTS; i++) {
+            pre = test_subsat(&cls.free[(part + i) % PKTDMA_SLOT_PARTS],
+                              n - got);
+            got += (pre < n - got) ? pre : n - got;
+        }
+
+        if (got == n)
+            break;
+
+        if (starve && !hoard && ++tries >= starve)
+            hoard = (atomic_fetch_or(&cls.hoard, 1) & 1) == 0;
+
+        if (!hoard && got != 0) {
+            atomic_fetch_add(&cls.free[part], got);
+            got = 0;
+        }
+        poll_wait(poll);
+    }
+
+    if (hoard)
+        atomic_store(&cls.hoard, 0);
+}
+
+/* pktdma_slots_give() */
+static void
+part_give(int part, unsigned int n)
+{
+    atomic_fetch_add(&cls.free[part], n);
+}
+
+static void
+check_held(int n)
+{
+    int held = atomic_fetch_add(&cls.held, n) + n;
+    int max = atomic_load(&cls.max_held);
+
+    while (held > max &&
+           !atomic_compare_exchange_weak(&cls.max_held, &max, held))
+        ;
+}
+
+static void *
+thread_run(void *arg)
+{
+    struct thread *t = arg;
+    const struct parameters *p = t->p;
+    int part = t->id % PKTDMA_SLOT_PARTS;
+    uint64_t t0;
+    int i, n;
+
+    for (i = 0; i < p->iters; i++) {
+        n = 1 + rand_r(&t->seed) % p->max_claim;
+
+        t0 = now_ns();
+        if (t->scheme == SCHEME_SEM)
+            sem_wait_n(n, p->poll);
+        else if (t->scheme == SCHEME_PART_NOHOARD)
+            part_take(part, n, p->poll, 0);
+        else
+            part_take(part, n, p->poll, PKTDMA_SLOT_STARVE);
+        t->waits[i] = now_ns() - t0;
+
+        check_held(n);
+        spin(p->hold);
+        atomic_fetch_sub(&cls.held, n);
+
+        if (t->scheme == SCHEME_SEM)
+            sem_post_n(n);
+        else
+            part_give(part, n);
+    }
+
+    return NULL;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Run one scheme, return the largest number of slots held at once */
+static int
+run_scheme(int scheme, const struct parameters *p)
+{
+    struct thread threads[MAX_THREADS];
+    uint64_t *waits;
+    uint64_t start, elapsed, sum = 0;
+    long total = (long)p->threads * p->iters;
+    long i;
+    int j;
+
+    waits = calloc(total, sizeof(*waits));
+    if (!waits) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    atomic_store(&cls.next_credit, 0);
+    atomic_store(&cls.last_complete, 0);
+    for (j = 0; j < PKTDMA_SLOT_PARTS; j++)
+        atomic_store(&cls.free[j], DMA_CMDS_PER_CTM / PKTDMA_SLOT_PARTS);
+    atomic_store(&cls.hoard, 0);
+    atomic_store(&cls.held, 0);
+    atomic_store(&cls.max_held, 0);
+
+    start = now_ns();
+    for (j = 0; j < p->threads; j++) {
+        threads[j].id = j;
+        threads[j].scheme = scheme;
+        threads[j].p = p;
+        threads[j].seed = 1 + j;
+        threads[j].waits = waits + (long)j * p->iters;
+        if (pthread_create(&threads[j].tid, NULL, thread_run,
+                           &threads[j]) != 0) {
+            fprintf(stderr, "Failed to create thread %d\n", j);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (j = 0; j < p->threads; j++)
+        pthread_join(threads[j].tid, NULL);
+    elapsed = now_ns() - start;
+
+    qsort(waits, total, sizeof(*waits), cmp_u64);
+    for (i = 0; i < total; i++)
+        sum += waits[i];
+
+    printf("%-8s %10.0f %10.0f %12.0f %12.0f %9d\n",
+           scheme_names[scheme], (double)sum / total,
+           (double)waits[total * 99 / 100], (double)waits[total - 1],
+           total * 1e9 / elapsed, atomic_load(&cls.max_held));
+
+    free(waits);
+    return atomic_load(&cls.max_held);
+}
+
+static void
+usage(void)
+{
+    printf("pktdma_slots_model [options]\n"
+           "options:\n"
+           " -t <num>   Threads claiming slots (default 12)\n"
+           " -i <num>   Claims per thread (default 20000)\n"
+           " -n <num>   Largest claim in slots, up to %d (default 4)\n"
+           " -d <num>   Spin loops slots are held for (default 200)\n"
+           " -p <num>   Spin loops between retries (default 1000)\n",
+           PKTDMA_SG_MAX_CMDS);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct parameters p;
+    int failed = 0;
+    int scheme;
+    int c;
+
+    p.threads = 12;
+    p.iters = 20000;
+    p.max_claim = 4;
+    p.hold = 200;
+    p.poll = 1000;
+
+    while ((c = getopt(argc, argv, "ht:i:n:d:p:")) != -1) {
+        switch (c) {
+        case 't':
+            p.threads = atoi(optarg);
+            break;
+        case 'i':
+            p.iters = atoi(optarg);
+            break;
+        case 'n':
+            p.max_claim = atoi(optarg);
+            break;
+        case 'd':
+            p.hold = atoi(optarg);
+            break;
+        case 'p':
+            p.poll = atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (p.threads < 1 || p.threads > MAX_THREADS || p.iters < 1 ||
+        p.max_claim < 1 || p.max_claim > PKTDMA_SG_MAX_CMDS) {
+        usage();
+        return 1;
+    }
+
+    printf("%d threads, %d claims each of 1..%d slots, hold %d, poll %d\n\n",
+           p.threads, p.iters, p.max_claim, p.hold, p.poll);
+    printf("%-8s %10s %10s %12s %12s %9s\n", "scheme", "wait(ns)",
+           "p99(ns)", "max(ns)", "claims/s", "max held");
+
+    for (scheme = 0; scheme < SCHEME_NUM; scheme++) {
+        if (run_scheme(scheme, &p) > DMA_CMDS_PER_CTM) {
+            fprintf(stderr, "%s: more than %d slots held\n",
+                    scheme_names[scheme], DMA_CMDS_PER_CTM);
+            failed = 1;
+        }
+    }
+
+    return failed;
+}
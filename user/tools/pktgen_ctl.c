@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/pktgen_ctl.c
+ * @brief         Control the pktgen app (me/apps/pktgen) through its rtsyms.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <nfp.h>
+#include <nfp_nffw.h>
+
+#include "nfp_pktgen.h"
+
+struct parameters
+{
+    int nfp_num;
+    int gen;
+    double pps;
+    double me_mhz;
+    int len;
+    unsigned int count;
+    int nbi;
+    int port;
+    const char *tmpl_file;
+};
+
+void usage(void)
+{
+    printf("pktgen_ctl [options] start|stop|stats\n"
+           "options:\n"
+           " -n, --nfp <nfp num>    Select which NFP to access (default 0)\n"
+           " -g, --gen <gen>        Generator to control (default 0)\n"
+           " -r, --rate <pps>       Packets per second (default 1000000)\n"
+           " -f, --freq <MHz>       ME clock frequency (default 1200)\n"
+           " -l, --len <bytes>      UDP packet length without FCS\n"
+           "                        (default 60)\n"
+           " -c, --count <num>      Packets to send, 0 for no limit\n"
+           "                        (default 0)\n"
+           " -p, --port <nbi:port>  Egress port (default 0:0)\n"
+           " -t, --tmpl <file>      Load the template from a file of hex\n"
+           "                        bytes, the first %d bytes are used as\n"
+           "                        the template and the stamp is placed\n"
+           "                        after them\n\n",
+           NFP_PKTGEN_TMPL_LW * 4 - NFP_PKTGEN_STAMP_SZ);
+}
+
+static const struct option g_opt[] = {
+    {"help",    no_argument,        NULL, 'h'},
+    {"nfp",     required_argument,  NULL, 'n'},
+    {"gen",     required_argument,  NULL, 'g'},
+    {"rate",    required_argument,  NULL, 'r'},
+    {"freq",    required_argument,  NULL, 'f'},
+    {"len",     required_argument,  NULL, 'l'},
+    {"count",   required_argument,  NULL, 'c'},
+    {"port",    required_argument,  NULL, 'p'},
+    {"tmpl",    required_argument,  NULL, 't'},
+    {NULL,      0, 0, '\0'}
+};
+
+static const char *g_optstr = "hn:g:r:f:l:c:p:t:";
+
+void parse_params(int argc, char *argv[], struct parameters *p)
+{
+    int c;
+
+    if (argc == 1) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    while ((c = getopt_long(argc, argv, g_optstr, g_opt, NULL)) != -1) {
+        switch (c) {
+        case 'h':
+            usage();
+            exit(EXIT_SUCCESS);
+            break;
+        case 'n':
+            p->nfp_num = atoi(optarg);
+            break;
+        case 'g':
+            p->gen = atoi(optarg);
+            if (p->gen < 0 || p->gen >= NFP_PKTGEN_NUM_GENS) {
+                fprintf(stderr, "Generator must be < %d\n",
+                        NFP_PKTGEN_NUM_GENS);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'r':
+            p->pps = atof(optarg);
+            break;
+        case 'f':
+            p->me_mhz = atof(optarg);
+            break;
+        case 'l':
+            p->len = atoi(optarg);
+            break;
+        case 'c':
+            p->count = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            if (sscanf(optarg, "%d:%d", &p->nbi, &p->port) != 2) {
+                fprintf(stderr, "Port must be <nbi>:<port>\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 't':
+            p->tmpl_file = optarg;
+            break;
+        default:
+            fprintf(stderr, "Unknown option: '%c'\n", c);
+            usage();
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+}
+
+/* Load template bytes from a file of whitespace separated hex bytes */
+static int
+load_tmpl(const char *name, int len, struct nfp_pktgen_tmpl *t)
+{
+    FILE *f;
+    unsigned int byte;
+    int n = 0;
+
+    f = fopen(name, "r");
+    if (!f)
+        return -1;
+
+    memset(t, 0, sizeof(*t));
+    while (n < NFP_PKTGEN_TMPL_LW * 4 - NFP_PKTGEN_STAMP_SZ &&
+           fscanf(f, "%x", &byte) == 1)
+        t->data[n++] = byte;
+    fclose(f);
+
+    /* Stamp after the template bytes, word aligned */
+    t->len = len;
+    t->stamp_off = (n + 3) & ~3;
+    t->tmpl_len = t->stamp_off;
+    return 0;
+}
+
+static int
+pktgen_start(struct nfp_device *nfp, struct parameters *p)
+{
+    const uint8_t dmac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+    const uint8_t smac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    const struct nfp_rtsym *cfg_sym, *tmpl_sym;
+    struct nfp_pktgen_tmpl tmpl;
+    struct nfp_pktgen_cfg cfg;
+    uint32_t words[NFP_PKTGEN_TMPL_SZ / 4];
+    uint32_t enable;
+
+    cfg_sym = nfp_rtsym_lookup(nfp, NFP_PKTGEN_CFG_SYM);
+    tmpl_sym = nfp_rtsym_lookup(nfp, NFP_PKTGEN_TMPL_SYM);
+    if (!cfg_sym || !tmpl_sym) {
+        fprintf(stderr, "pktgen symbols not found, is pktgen loaded?\n");
+        return -1;
+    }
+
+    if (p->tmpl_file) {
+        if (load_tmpl(p->tmpl_file, p->len, &tmpl) < 0) {
+            fprintf(stderr, "Failed to read %s: %s\n", p->tmpl_file,
+                    strerror(errno));
+            return -1;
+        }
+    } else if (nfp_pktgen_tmpl_udp(&tmpl, dmac, smac, 0x0a000001,
+                                   0x0a000002, 5000, 5001, p->len) < 0) {
+        fprintf(stderr, "UDP packets must be 60 to %d bytes\n",
+                NFP_PKTGEN_MAX_LEN);
+        return -1;
+    }
+    if (nfp_pktgen_tmpl_check(&tmpl) < 0) {
+        fprintf(stderr, "Invalid template for a %d byte packet\n", p->len);
+        return -1;
+    }
+
+    cfg.interval = nfp_pktgen_interval(p->pps, p->me_mhz);
+    if (cfg.interval == 0) {
+        fprintf(stderr, "Rate out of range\n");
+        return -1;
+    }
+    cfg.dst = NFP_PKTGEN_WIRE_PORT(p->nbi, p->port);
+    cfg.count = p->count;
+
+    /* A new run identifier restarts the generator */
+    if (nfp_rtsym_read(nfp, cfg_sym, &enable, sizeof(enable),
+                       p->gen * sizeof(cfg)) < 0)
+        return -1;
+    cfg.enable = ((enable & ~NFP_PKTGEN_DONE) + 1) & ~NFP_PKTGEN_DONE;
+    if (cfg.enable == 0)
+        cfg.enable = 1;
+
+    nfp_pktgen_tmpl_pack(&tmpl, words);
+    if (nfp_rtsym_write(nfp, tmpl_sym, words, sizeof(words),
+                        p->gen * sizeof(words)) < 0 ||
+        nfp_rtsym_write(nfp, cfg_sym, &cfg, sizeof(cfg),
+                        p->gen * sizeof(cfg)) < 0)
+        return -1;
+
+    printf("gen %d: %d B to %d:%d at %.0f pps (%.0f requested)\n",
+           p->gen, p->len, p->nbi, p->port,
+           nfp_pktgen_rate(cfg.interval, p->me_mhz), p->pps);
+    return 0;
+}
+
+static int
+pktgen_stop(struct nfp_device *nfp, struct parameters *p)
+{
+    const struct nfp_rtsym *sym;
+    uint32_t enable;
+
+    sym = nfp_rtsym_lookup(nfp, NFP_PKTGEN_CFG_SYM);
+    if (!sym)
+        return -1;
+
+    /* Keep the run identifier so that the next start picks a new one */
+    if (nfp_rtsym_read(nfp, sym, &enable, sizeof(enable),
+                       p->gen * sizeof(struct nfp_pktgen_cfg)) < 0)
+        return -1;
+    enable |= NFP_PKTGEN_DONE;
+
+    if (nfp_rtsym_write(nfp, sym, &enable, sizeof(enable),
+                        p->gen * sizeof(struct nfp_pktgen_cfg)) < 0)
+        return -1;
+    return 0;
+}
+
+static int
+pktgen_stats(struct nfp_device *nfp, struct parameters *p)
+{
+    const struct nfp_rtsym *sym;
+    unsigned long long stats[3];
+
+    sym = nfp_rtsym_lookup(nfp, NFP_PKTGEN_STATS_SYM);
+    if (!sym)
+        return -1;
+
+    if (nfp_rtsym_read(nfp, sym, stats, sizeof(stats),
+                       p->gen * sizeof(stats)) < 0)
+        return -1;
+
+    printf("gen %d: sent %llu, not built %llu, not sent %llu\n", p->gen,
+           stats[0], stats[1], stats[2]);
+    return 0;
+}
+
+int main (int argc, char *argv[])
+{
+    struct parameters p;
+    struct nfp_device *nfp;
+    const char *cmd;
+    int ret;
+
+    memset(&p, 0, sizeof(p));
+    p.pps = 1000000;
+    p.me_mhz = 1200;
+    p.len = 60;
+    parse_params(argc, argv, &p);
+
+    if (optind == argc) {
+        fprintf(stderr, "error: command must be provided\n");
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    cmd = argv[optind];
+
+    nfp = nfp_device_open(p.nfp_num);
+    if (!nfp) {
+        fprintf(stderr, "Failed to open NFP device %d\n", p.nfp_num);
+        exit(EXIT_FAILURE);
+    }
+
+    if (strcmp(cmd, "start") == 0) {
+        ret = pktgen_start(nfp, &p);
+    } else if (strcmp(cmd, "stop") == 0) {
+        ret = pktgen_stop(nfp, &p);
+    } else if (strcmp(cmd, "stats") == 0) {
+        ret = pktgen_stats(nfp, &p);
+    } else {
+        fprintf(stderr, "Unknown command: %s\n", cmd);
+        usage();
+        ret = -1;
+    }
+
+    nfp_device_close(nfp);
+    if (ret < 0) {
+        fprintf(stderr, "%s failed\n", cmd);
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
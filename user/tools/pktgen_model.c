@@ -0,0 +1,522 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/pktgen_model.c
+ * @brief         Host model of pktio_gen() and the pacing of the pktgen app
+ *
+ * The packet construction part replays the word writes pktio_gen() makes
+ * into a CTM buffer of the size it allocates, and checks that no write
+ * goes past the buffer and that the packet matches both nfp_pktgen_build()
+ * and a byte by byte expectation, for a range of lengths, template sizes,
+ * stamp offsets and fill patterns.  Templates pktio_gen() must reject are
+ * checked as well.
+ *
+ * The pacing part models the contexts of one ME claiming transmit slots
+ * as main() in me/apps/pktgen/pktgen.c does.  A packet takes some cycles
+ * of the ME, which the contexts share, and some cycles of I/O latency
+ * during which the ME runs other contexts.  For a sweep of rates the model
+ * prints the achieved rate, which must match the requested one while
+ * below the capacity of the ME, and the largest burst after a stall.
+ *
+ * The program exits with a failure if any check fails.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "nfp_pktgen.h"
+
+#define MAX_THREADS     8
+#define PKTGEN_MAX_BURST 16     /* me/apps/pktgen/pktgen.c */
+
+struct parameters
+{
+    int threads;            /* Contexts on the ME */
+    int service;            /* ME cycles to build and send a packet */
+    int latency;            /* I/O cycles per packet, overlapped */
+    double me_mhz;          /* ME clock */
+    long cycles;            /* Cycles to simulate per rate */
+};
+
+static int failures;
+
+#define CHECK(_cond, ...)                                   \
+    do {                                                    \
+        if (!(_cond)) {                                     \
+            printf("FAIL: " __VA_ARGS__);                   \
+            printf("\n");                                   \
+            failures++;                                     \
+        }                                                   \
+    } while (0)
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t
+rng32(void)
+{
+    /* xorshift64*, deterministic so that runs are comparable */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 2685821657736338717ULL) >> 32;
+}
+
+/*
+ * Mirror of the writes in pktio_gen(): the CTM buffer is modelled as
+ * words, and each write of n bytes from transfer registers writes n bytes
+ * of whole words.  Returns the packet length or -1 if the template is
+ * rejected, *end is set to the end of the last write in the buffer.
+ */
+static int
+gen_replay(const uint32_t *tmpl, uint32_t seq, uint64_t tsc, uint8_t *ctm,
+           unsigned int *ctm_bytes, unsigned int *end_max)
+{
+    uint32_t xfer[16];
+    uint32_t ctl = tmpl[0];
+    uint32_t fill = tmpl[1];
+    uint32_t len = ctl >> 16;
+    uint32_t tmpl_len = (ctl >> 8) & 0xff;
+    uint32_t stamp_off = ctl & 0xff;
+    uint32_t off, n, i, end;
+    uint8_t *pkt;
+
+    if (len == 0 || len > 2048 - NFP_PKTGEN_OFFSET || tmpl_len > len ||
+        tmpl_len > NFP_PKTGEN_TMPL_LW * 4 || ((tmpl_len | stamp_off) & 0x3) ||
+        (stamp_off != 0 && stamp_off + NFP_PKTGEN_STAMP_SZ > len))
+        return -1;
+
+    if (len + NFP_PKTGEN_OFFSET <= 256)
+        *ctm_bytes = 256;
+    else if (len + NFP_PKTGEN_OFFSET <= 512)
+        *ctm_bytes = 512;
+    else if (len + NFP_PKTGEN_OFFSET <= 1024)
+        *ctm_bytes = 1024;
+    else
+        *ctm_bytes = 2048;
+
+    pkt = ctm + NFP_PKTGEN_OFFSET;
+    *end_max = 0;
+
+#define WRITE_WORDS(_off, _src, _n)                                 \
+    do {                                                            \
+        for (i = 0; i < (_n) / 4; i++) {                            \
+            pkt[(_off) + i * 4] = (_src)[i] >> 24;                  \
+            pkt[(_off) + i * 4 + 1] = (_src)[i] >> 16;              \
+            pkt[(_off) + i * 4 + 2] = (_src)[i] >> 8;               \
+            pkt[(_off) + i * 4 + 3] = (_src)[i];                    \
+        }                                                           \
+        if (NFP_PKTGEN_OFFSET + (_off) + (_n) > *end_max)           \
+            *end_max = NFP_PKTGEN_OFFSET + (_off) + (_n);           \
+    } while (0)
+
+    for (off = 0; off < tmpl_len; off += sizeof(xfer)) {
+        n = tmpl_len - off;
+        if (n > sizeof(xfer))
+            n = sizeof(xfer);
+        memcpy(xfer, &tmpl[2 + (off >> 2)], n);
+        WRITE_WORDS(off, xfer, n);
+    }
+
+    for (i = 0; i < 16; i++)
+        xfer[i] = fill;
+    end = (len + 3) & ~0x3;
+    for (off = tmpl_len; off < end; off += sizeof(xfer)) {
+        n = end - off;
+        if (n > sizeof(xfer))
+            n = sizeof(xfer);
+        WRITE_WORDS(off, xfer, n);
+    }
+
+    if (stamp_off != 0) {
+        xfer[0] = seq;
+        xfer[1] = tsc >> 32;
+        xfer[2] = tsc;
+        WRITE_WORDS(stamp_off, xfer, 12);
+    }
+
+#undef WRITE_WORDS
+
+    return len;
+}
+
+/* Byte by byte expectation of the packet built from a template */
+static uint8_t
+expect_byte(const struct nfp_pktgen_tmpl *t, uint32_t seq, uint64_t tsc,
+            unsigned int off)
+{
+    unsigned int s;
+
+    if (t->stamp_off != 0 && off >= t->stamp_off &&
+        off < t->stamp_off + NFP_PKTGEN_STAMP_SZ) {
+        s = off - t->stamp_off;
+        if (s < 4)
+            return seq >> (24 - 8 * s);
+        return tsc >> (56 - 8 * (s - 4));
+    }
+    if (off < t->tmpl_len)
+        return t->data[off];
+    return t->fill >> (24 - 8 * (off % 4));
+}
+
+/* Build one packet three ways and compare */
+static void
+check_gen(const struct nfp_pktgen_tmpl *t, uint32_t seq, uint64_t tsc)
+{
+    static uint8_t ctm[2048 + 64];
+    static uint8_t ref[2048];
+    uint32_t words[NFP_PKTGEN_TMPL_SZ / 4];
+    unsigned int ctm_bytes, end_max, off;
+    int len, ref_len;
+
+    nfp_pktgen_tmpl_pack(t, words);
+    memset(ctm, 0xee, sizeof(ctm));
+    len = gen_replay(words, seq, tsc, ctm, &ctm_bytes, &end_max);
+    ref_len = nfp_pktgen_build(words, seq, tsc, ref, sizeof(ref));
+
+    CHECK(len == t->len && ref_len == t->len,
+          "len %u tmpl_len %u stamp_off %u: built %d and %d bytes",
+          t->len, t->tmpl_len, t->stamp_off, len, ref_len);
+    if (len != t->len || ref_len != t->len)
+        return;
+
+    CHECK(end_max <= ctm_bytes,
+          "len %u: write to %u past %u B CTM buffer", t->len, end_max,
+          ctm_bytes);
+    CHECK(end_max == NFP_PKTGEN_OFFSET + ((t->len + 3) & ~3u),
+          "len %u: writes end at %u", t->len, end_max);
+
+    for (off = 0; off < t->len; off++) {
+        if (ctm[NFP_PKTGEN_OFFSET + off] != ref[off] ||
+            ref[off] != expect_byte(t, seq, tsc, off)) {
+            CHECK(0, "len %u tmpl_len %u stamp_off %u: byte %u is %02x/%02x"
+                  ", expected %02x", t->len, t->tmpl_len, t->stamp_off, off,
+                  ctm[NFP_PKTGEN_OFFSET + off], ref[off],
+                  expect_byte(t, seq, tsc, off));
+            break;
+        }
+    }
+}
+
+static void
+check_udp(void)
+{
+    const uint8_t dmac[6] = {0x02, 0, 0, 0, 0, 0x02};
+    const uint8_t smac[6] = {0x02, 0, 0, 0, 0, 0x01};
+    struct nfp_pktgen_tmpl t;
+    uint32_t words[NFP_PKTGEN_TMPL_SZ / 4];
+    uint8_t pkt[2048];
+    uint32_t sum, seq;
+    uint64_t tsc;
+    unsigned int len, i;
+    int plen;
+
+    CHECK(nfp_pktgen_tmpl_udp(&t, dmac, smac, 1, 2, 3, 4, 59) < 0,
+          "59 B UDP template accepted");
+    CHECK(nfp_pktgen_tmpl_udp(&t, dmac, smac, 1, 2, 3, 4,
+                              NFP_PKTGEN_MAX_LEN + 1) < 0,
+          "%d B UDP template accepted", NFP_PKTGEN_MAX_LEN + 1);
+
+    for (len = 60; len <= NFP_PKTGEN_MAX_LEN; len += 7) {
+        if (nfp_pktgen_tmpl_udp(&t, dmac, smac, 0xc0a80001 + len,
+                                0xc0a80101, len, 9, len) < 0) {
+            CHECK(0, "%u B UDP template rejected", len);
+            continue;
+        }
+        CHECK(nfp_pktgen_tmpl_check(&t) == 0, "%u B UDP template invalid",
+              len);
+        check_gen(&t, len * 1000, 0x0123456789abcdefULL + len);
+
+        nfp_pktgen_tmpl_pack(&t, words);
+        plen = nfp_pktgen_build(words, len, len * 3ULL << 32, pkt,
+                                sizeof(pkt));
+        if (plen != (int)len)
+            continue;
+
+        CHECK(pkt[12] == 0x08 && pkt[13] == 0x00, "%u B: ethertype", len);
+        for (sum = 0, i = 14; i < 34; i += 2)
+            sum += (pkt[i] << 8) | pkt[i + 1];
+        while (sum >> 16)
+            sum = (sum & 0xffff) + (sum >> 16);
+        CHECK(sum == 0xffff, "%u B: IPv4 checksum %04x", len, sum);
+        CHECK(((pkt[16] << 8) | pkt[17]) == len - 14, "%u B: IPv4 length",
+              len);
+        CHECK(((pkt[38] << 8) | pkt[39]) == len - 34, "%u B: UDP length",
+              len);
+        CHECK(nfp_pktgen_stamp(pkt, len, t.stamp_off, &seq, &tsc) == 0 &&
+              seq == len && tsc == (len * 3ULL << 32),
+              "%u B: stamp", len);
+    }
+}
+
+static void
+check_tmpl(void)
+{
+    struct nfp_pktgen_tmpl t;
+    unsigned int tmpl_len, stamp_off, i, n = 0;
+    static const uint16_t lens[] = {1, 3, 12, 60, 61, 64, 65, 127, 128, 129,
+                                    191, 192, 193, 255, 256, 448, 449, 960,
+                                    961, 1500, 1983, 1984};
+
+    for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        for (tmpl_len = 0; tmpl_len <= NFP_PKTGEN_TMPL_LW * 4;
+             tmpl_len += 4) {
+            for (stamp_off = 0; stamp_off < 256; stamp_off += 4) {
+                if (tmpl_len > lens[i] ||
+                    (stamp_off != 0 &&
+                     stamp_off + NFP_PKTGEN_STAMP_SZ > lens[i]))
+                    continue;
+
+                memset(&t, 0, sizeof(t));
+                t.len = lens[i];
+                t.tmpl_len = tmpl_len;
+                t.stamp_off = stamp_off;
+                t.fill = rng32();
+                for (n = 0; n < sizeof(t.data); n++)
+                    t.data[n] = rng32();
+                check_gen(&t, rng32(), ((uint64_t)rng32() << 32) | rng32());
+            }
+        }
+    }
+}
+
+static void
+check_reject(void)
+{
+    static const struct {
+        uint16_t len;
+        uint8_t tmpl_len;
+        uint8_t stamp_off;
+    } bad[] = {
+        {0, 0, 0},                                  /* No packet */
+        {NFP_PKTGEN_MAX_LEN + 1, 0, 0},             /* Too long for CTM */
+        {60, 64, 0},                                /* Template too long */
+        {200, NFP_PKTGEN_TMPL_LW * 4 + 4, 0},       /* Past data[] */
+        {200, 42, 0},                               /* Unaligned */
+        {200, 44, 42},                              /* Unaligned stamp */
+        {60, 44, 52},                               /* Stamp past end */
+    };
+    struct nfp_pktgen_tmpl t;
+    uint32_t words[NFP_PKTGEN_TMPL_SZ / 4];
+    uint8_t ctm[2048 + 64], pkt[2048];
+    unsigned int ctm_bytes, end_max, i;
+
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        memset(&t, 0, sizeof(t));
+        t.len = bad[i].len;
+        t.tmpl_len = bad[i].tmpl_len;
+        t.stamp_off = bad[i].stamp_off;
+        nfp_pktgen_tmpl_pack(&t, words);
+        CHECK(nfp_pktgen_tmpl_check(&t) < 0 &&
+              gen_replay(words, 0, 0, ctm, &ctm_bytes, &end_max) < 0 &&
+              nfp_pktgen_build(words, 0, 0, pkt, sizeof(pkt)) < 0,
+              "len %u tmpl_len %u stamp_off %u accepted", t.len, t.tmpl_len,
+              t.stamp_off);
+    }
+}
+
+static void
+check_interval(const struct parameters *p)
+{
+    double pps, rate;
+    uint32_t interval;
+
+    for (pps = 10; pps <= 40e6; pps *= 1.7) {
+        interval = nfp_pktgen_interval(pps, p->me_mhz);
+        rate = nfp_pktgen_rate(interval, p->me_mhz);
+        CHECK(interval != 0 && rate > pps * 0.995 && rate < pps * 1.005,
+              "%.0f pps: interval %u is %.0f pps", pps, interval, rate);
+    }
+    CHECK(nfp_pktgen_interval(1, p->me_mhz) == 0,
+          "1 pps representable at %.0f MHz", p->me_mhz);
+}
+
+/*
+ * Pacing of main() in pktgen.c.  Returns packets sent in p->cycles, and
+ * the largest number sent in an interval's worth of cycles after a stall
+ * of stall cycles at mid run.
+ */
+static long
+pace(const struct parameters *p, uint32_t interval, long stall, int *burst)
+{
+    long ctx_free[MAX_THREADS];
+    long me_free = 0;
+    long sent = 0;
+    long stall_at = p->cycles / 2;
+    long last_send = -1;
+    long cyc_per_pkt = (long)interval * 16 / 256;
+    uint64_t next = 0;
+    uint64_t slot, now;
+    long t, start;
+    int i, c, run = 0;
+
+    memset(ctx_free, 0, sizeof(ctx_free));
+    *burst = 0;
+
+    for (;;) {
+        /* The context that is ready first runs next */
+        c = 0;
+        for (i = 1; i < p->threads; i++)
+            if (ctx_free[i] < ctx_free[c])
+                c = i;
+        t = ctx_free[c];
+        if (t < me_free)
+            t = me_free;
+        if (t >= p->cycles)
+            break;
+
+        /* Claim the next slot */
+        now = t / 16;
+        slot = next;
+        if (slot + PKTGEN_MAX_BURST * (uint64_t)interval < (now << 8))
+            slot = now << 8;
+        next = slot + interval;
+
+        /* Wait for the slot, then build and send */
+        start = (long)((slot + 255) >> 8) * 16;
+        if (start < t)
+            start = t;
+        if (start < me_free)
+            start = me_free;
+        if (stall && start >= stall_at && start < stall_at + stall)
+            start = stall_at + stall;
+        me_free = start + p->service;
+        ctx_free[c] = me_free + p->latency;
+
+        if (me_free > p->cycles)
+            break;
+        sent++;
+
+        /* Back to back sends after the stall */
+        if (start >= stall_at + stall && stall) {
+            if (last_send >= 0 && start - last_send < cyc_per_pkt / 2)
+                run++;
+            else
+                run = 1;
+            if (run > *burst)
+                *burst = run;
+        }
+        last_send = start;
+    }
+
+    return sent;
+}
+
+static void
+check_pacing(const struct parameters *p)
+{
+    static const double rates[] = {1e3, 1e5, 1e6, 5e6, 10e6, 14.88e6,
+                                   20e6, 30e6, 60e6};
+    double cap, want, got;
+    uint32_t interval;
+    unsigned int i;
+    int burst;
+    long sent;
+
+    cap = p->me_mhz * 1e6 / p->service;
+    if (cap > p->threads * p->me_mhz * 1e6 / (p->service + p->latency))
+        cap = p->threads * p->me_mhz * 1e6 / (p->service + p->latency);
+
+    printf("%d contexts, %d cycles/pkt, %d cycles latency, %.0f MHz: "
+           "capacity %.2f Mpps\n\n", p->threads, p->service, p->latency,
+           p->me_mhz, cap / 1e6);
+    printf("    req Mpps   interval    achieved Mpps   error%%   "
+           "burst after stall\n");
+
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        interval = nfp_pktgen_interval(rates[i], p->me_mhz);
+        want = nfp_pktgen_rate(interval, p->me_mhz);
+        sent = pace(p, interval, 0, &burst);
+        got = sent * p->me_mhz * 1e6 / p->cycles;
+        pace(p, interval, p->cycles / 8, &burst);
+
+        printf("%12.3f %10u %16.3f %8.2f %10d\n", rates[i] / 1e6, interval,
+               got / 1e6, 100 * (got - want) / want, burst);
+
+        /* Below capacity the rate is met to within a packet per period */
+        if (want < 0.9 * cap)
+            CHECK(got > want - 1.5e6 * p->me_mhz / p->cycles &&
+                  got < want * 1.001 + 1.5e6 * p->me_mhz / p->cycles,
+                  "%.0f pps: achieved %.0f", want, got);
+        else
+            CHECK(got > 0.9 * cap, "%.0f pps: achieved %.0f of %.0f "
+                  "capacity", want, got, cap);
+        CHECK(burst <= PKTGEN_MAX_BURST + 1, "%.0f pps: burst of %d",
+              want, burst);
+    }
+}
+
+void usage(void)
+{
+    printf("pktgen_model [options]\n"
+           "options:\n"
+           " -t <num>  Contexts per ME (default 8)\n"
+           " -s <num>  ME cycles to build and send a packet (default 150)\n"
+           " -L <num>  I/O latency cycles per packet (default 1000)\n"
+           " -f <MHz>  ME clock (default 1200)\n"
+           " -c <num>  Cycles to simulate per rate (default 120000000)\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct parameters p = {8, 150, 1000, 1200, 120000000};
+    int c;
+
+    while ((c = getopt(argc, argv, "t:s:L:f:c:")) != -1) {
+        switch (c) {
+        case 't':
+            p.threads = atoi(optarg);
+            break;
+        case 's':
+            p.service = atoi(optarg);
+            break;
+        case 'L':
+            p.latency = atoi(optarg);
+            break;
+        case 'f':
+            p.me_mhz = atof(optarg);
+            break;
+        case 'c':
+            p.cycles = atol(optarg);
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (p.threads < 1 || p.threads > MAX_THREADS || p.service < 1 ||
+        p.latency < 0 || p.me_mhz <= 0 || p.cycles < 1000000) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    check_reject();
+    check_tmpl();
+    check_udp();
+    check_interval(&p);
+    printf("packet construction: %s\n\n", failures ? "FAIL" : "ok");
+
+    check_pacing(&p);
+
+    if (failures) {
+        printf("\n%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("\nall checks passed\n");
+    return 0;
+}
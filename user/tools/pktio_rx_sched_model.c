@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/pktio_rx_sched_model.c
+ * @brief         Host model of pktio_rx_sched() versus static partitioning
+ *
+ * Models one ME worth of threads receiving from a wire and a host work
+ * queue.  Each source is a bounded FIFO of packets fed by a Bernoulli
+ * arrival process and a FIFO of threads with a request outstanding on it,
+ * which is how the NBI and NFD work queues hand out packets.  A packet
+ * delivered to a thread that is busy (only possible with the scheduler)
+ * waits in that thread's transfer registers until the thread returns to
+ * pktio_rx_sched().
+ *
+ * For a range of wire/host mixes the model prints the throughput and
+ * drop rate of static partitioning (half the threads on each source) and
+ * of the scheduler, with the total offered load held constant.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+#define SRC_WIRE        0
+#define SRC_HOST        1
+#define SRC_NUM         2
+
+#define MAX_THREADS     8
+#define MAX_QUEUE       4096
+
+struct parameters
+{
+    int threads;            /* Threads on the ME */
+    int service;            /* Cycles to process one packet */
+    double load;            /* Offered load as a fraction of ME capacity */
+    int queue;              /* Source queue depth */
+    long cycles;            /* Cycles to simulate */
+    int wire_weight;        /* PKTIO_RX_SCHED_WIRE_WEIGHT */
+    int host_weight;        /* PKTIO_RX_SCHED_HOST_WEIGHT */
+};
+
+struct thread
+{
+    int mask;               /* Sources the thread receives from */
+    long busy_until;        /* Cycle at which processing completes */
+    int pending;            /* Sources with a request outstanding */
+    int ready;              /* Sources with a packet in xfer registers */
+    long ready_at[SRC_NUM]; /* Arrival cycle of the packet in xfer regs */
+    int last;               /* Source served last */
+    int credit[SRC_NUM];    /* Remaining WRR credit */
+};
+
+struct source
+{
+    long pkts[MAX_QUEUE];   /* Arrival cycles of queued packets */
+    int head, count, cap;
+    int waiters[MAX_THREADS];
+    int whead, wcount;
+    long offered, dropped;
+};
+
+struct result
+{
+    long done;
+    long dropped;
+    long offered;
+    double latency;
+};
+
+static uint64_t rng_state;
+
+static double
+rng_uniform(void)
+{
+    /* xorshift64*, deterministic so that runs are comparable */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (double)((rng_state * 2685821657736338717ULL) >> 11) /
+           (double)(1ULL << 53);
+}
+
+static void
+src_push_waiter(struct source *s, int t)
+{
+    s->waiters[(s->whead + s->wcount) % MAX_THREADS] = t;
+    s->wcount++;
+}
+
+/* Hand out queued packets to waiting threads, in FIFO order */
+static void
+src_deliver(struct source *s, struct thread *thr, int src)
+{
+    struct thread *t;
+
+    while (s->count > 0 && s->wcount > 0) {
+        t = &thr[s->waiters[s->whead]];
+        s->whead = (s->whead + 1) % MAX_THREADS;
+        s->wcount--;
+
+        t->ready |= 1 << src;
+        t->ready_at[src] = s->pkts[s->head];
+        s->head = (s->head + 1) % MAX_QUEUE;
+        s->count--;
+    }
+}
+
+/* Mirror of the source selection in pktio_rx_sched() */
+static int
+thread_pick(struct thread *t, const struct parameters *p)
+{
+    if (t->ready == 3) {
+        if (t->credit[SRC_WIRE] == 0 && t->credit[SRC_HOST] == 0) {
+            t->credit[SRC_WIRE] = p->wire_weight;
+            t->credit[SRC_HOST] = p->host_weight;
+        }
+        if (t->credit[SRC_WIRE] != 0 &&
+            (t->last == SRC_HOST || t->credit[SRC_HOST] == 0)) {
+            t->credit[SRC_WIRE]--;
+            return SRC_WIRE;
+        }
+        t->credit[SRC_HOST]--;
+        return SRC_HOST;
+    }
+    return (t->ready & 1) ? SRC_WIRE : SRC_HOST;
+}
+
+static struct result
+run(const struct parameters *p, double wire_frac, int sched)
+{
+    static struct source src[SRC_NUM];
+    struct thread thr[MAX_THREADS];
+    struct result r;
+    double rate[SRC_NUM];
+    double lat_sum = 0;
+    long now;
+    int i, s;
+
+    memset(src, 0, sizeof(src));
+    memset(thr, 0, sizeof(thr));
+    memset(&r, 0, sizeof(r));
+    rng_state = 0x9e3779b97f4a7c15ULL;
+
+    rate[SRC_WIRE] = p->load * wire_frac * p->threads / p->service;
+    rate[SRC_HOST] = p->load * (1 - wire_frac) * p->threads / p->service;
+
+    for (s = 0; s < SRC_NUM; s++)
+        src[s].cap = p->queue;
+
+    for (i = 0; i < p->threads; i++) {
+        if (sched)
+            thr[i].mask = 3;
+        else
+            thr[i].mask = (i < p->threads / 2) ? 1 << SRC_WIRE
+                                               : 1 << SRC_HOST;
+        thr[i].last = SRC_HOST;
+        thr[i].credit[SRC_WIRE] = p->wire_weight;
+        thr[i].credit[SRC_HOST] = p->host_weight;
+    }
+
+    for (now = 0; now < p->cycles; now++) {
+        /* Arrivals */
+        for (s = 0; s < SRC_NUM; s++) {
+            if (rng_uniform() >= rate[s])
+                continue;
+            src[s].offered++;
+            if (src[s].count == src[s].cap) {
+                src[s].dropped++;
+                continue;
+            }
+            src[s].pkts[(src[s].head + src[s].count) % MAX_QUEUE] = now;
+            src[s].count++;
+        }
+
+        /* Threads that are free re-issue and pick up a ready packet */
+        for (i = 0; i < p->threads; i++) {
+            struct thread *t = &thr[i];
+
+            if (t->busy_until > now)
+                continue;
+
+            for (s = 0; s < SRC_NUM; s++) {
+                if ((t->mask & (1 << s)) && !(t->pending & (1 << s))) {
+                    t->pending |= 1 << s;
+                    src_push_waiter(&src[s], i);
+                }
+            }
+        }
+
+        for (s = 0; s < SRC_NUM; s++)
+            src_deliver(&src[s], thr, s);
+
+        for (i = 0; i < p->threads; i++) {
+            struct thread *t = &thr[i];
+
+            if (t->busy_until > now || !t->ready)
+                continue;
+
+            s = thread_pick(t, p);
+            t->ready &= ~(1 << s);
+            t->pending &= ~(1 << s);
+            t->last = s;
+            t->busy_until = now + p->service;
+            lat_sum += now + p->service - t->ready_at[s];
+            r.done++;
+        }
+    }
+
+    for (s = 0; s < SRC_NUM; s++) {
+        r.offered += src[s].offered;
+        r.dropped += src[s].dropped;
+    }
+    r.latency = r.done ? lat_sum / r.done : 0;
+    return r;
+}
+
+void usage(void)
+{
+    printf("pktio_rx_sched_model [options]\n"
+           "options:\n"
+           " -t <num>  Threads per ME (default 8)\n"
+           " -s <num>  Cycles of processing per packet (default 600)\n"
+           " -l <f>    Offered load as a fraction of capacity (default 0.9)\n"
+           " -q <num>  Source queue depth in packets (default 256)\n"
+           " -c <num>  Cycles to simulate (default 2000000)\n"
+           " -w <num>  Wire weight (default 1)\n"
+           " -H <num>  Host weight (default 1)\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const double mix[] = {0.95, 0.9, 0.75, 0.5, 0.25, 0.1, 0.05};
+    struct parameters p = {8, 600, 0.9, 256, 2000000, 1, 1};
+    struct result st, sc;
+    unsigned int i;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:s:l:q:c:w:H:")) != -1) {
+        switch (c) {
+        case 't':
+            p.threads = atoi(optarg);
+            break;
+        case 's':
+            p.service = atoi(optarg);
+            break;
+        case 'l':
+            p.load = atof(optarg);
+            break;
+        case 'q':
+            p.queue = atoi(optarg);
+            break;
+        case 'c':
+            p.cycles = atol(optarg);
+            break;
+        case 'w':
+            p.wire_weight = atoi(optarg);
+            break;
+        case 'H':
+            p.host_weight = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (p.threads < 2 || p.threads > MAX_THREADS || p.service < 1 ||
+        p.queue < 1 || p.queue > MAX_QUEUE || p.wire_weight < 1 ||
+        p.host_weight < 1) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%d threads, %d cycles/pkt, load %.2f, queue %d, weights %d:%d\n\n",
+           p.threads, p.service, p.load, p.queue, p.wire_weight,
+           p.host_weight);
+    printf("wire%%   static Mpps/GHz  drop%%   sched Mpps/GHz  drop%%"
+           "  latency\n");
+
+    for (i = 0; i < sizeof(mix) / sizeof(mix[0]); i++) {
+        st = run(&p, mix[i], 0);
+        sc = run(&p, mix[i], 1);
+        printf("%5.0f   %15.3f %6.2f   %14.3f %6.2f  %7.0f\n",
+               mix[i] * 100,
+               st.done * 1000.0 / p.cycles,
+               st.offered ? 100.0 * st.dropped / st.offered : 0,
+               sc.done * 1000.0 / p.cycles,
+               sc.offered ? 100.0 * sc.dropped / sc.offered : 0,
+               sc.latency);
+    }
+
+    return 0;
+}
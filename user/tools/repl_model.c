@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/repl_model.c
+ * @brief         Cost model of pktio_tx_replicate() (me/lib/pktio)
+ *
+ * Counts the memory commands that pktio_tx_replicate() issues for a group
+ * and the bytes it copies, following libpktio.c, and turns them into ME
+ * cycles per copy and copies/s for one context that waits for each
+ * command, as the library does.  Two schemes are compared:
+ *
+ *  - copy:   every entry but the original's gets its own CTM buffer and,
+ *            for a split packet, its own MU buffer, mirrors included.
+ *  - share:  mirrors are multicast sends of the original, freed on the
+ *            last send, and only rewritten entries get copies.
+ *
+ * Latencies are parameters, in ME cycles per command waited for.  The
+ * figures are a model of the code, not a measurement on hardware:  the
+ * unit test utfe_pktio_replicate_bench measures the same groups in the
+ * simulator.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+
+#define BLOCK           64      /* pktio_tx_repl_blocks() moves 64B */
+#define NBI_OFFSET      64      /* PKT_NBI_OFFSET of the unit test */
+
+#define MODE_MIRROR     0
+#define MODE_REWRITE    1
+
+struct parameters
+{
+    unsigned int ctm_lat;       /* CTM read or write */
+    unsigned int emem_lat;      /* EMEM read, MU read or write */
+    unsigned int alloc_lat;     /* CTM packet alloc or BLM buffer alloc */
+    unsigned int insn;          /* Instructions around each command */
+    unsigned int copies;        /* Entries in the group */
+    unsigned int mhz;           /* ME clock */
+};
+
+struct cost
+{
+    unsigned long cmds;
+    unsigned long cycles;
+    unsigned long bytes;        /* Copied */
+};
+
+static void
+cmd(struct cost *c, const struct parameters *p, unsigned int lat)
+{
+    c->cmds++;
+    c->cycles += lat + p->insn;
+}
+
+/* pktio_tx_repl_blocks():  a read and a write per 64B block */
+static void
+blocks(struct cost *c, const struct parameters *p, unsigned int start,
+       unsigned int end, unsigned int lat)
+{
+    unsigned int i;
+
+    for (i = start & ~(BLOCK - 1); i < end; i += BLOCK) {
+        cmd(c, p, lat);
+        cmd(c, p, lat);
+        c->bytes += BLOCK;
+    }
+}
+
+/* pktio_tx_repl_wire():  the script write and the packet ready command */
+static void
+wire(struct cost *c, const struct parameters *p)
+{
+    cmd(c, p, p->ctm_lat);
+    cmd(c, p, 0);
+}
+
+/* pktio_tx_repl_copy() for one entry */
+static void
+copy(struct cost *c, const struct parameters *p, unsigned int len,
+     unsigned int ctm_len, int rewrite)
+{
+    cmd(c, p, p->alloc_lat);
+    if (len > ctm_len) {
+        cmd(c, p, p->alloc_lat);
+        blocks(c, p, NBI_OFFSET + ctm_len, NBI_OFFSET + len, p->emem_lat);
+    }
+    blocks(c, p, NBI_OFFSET, NBI_OFFSET + ctm_len, p->ctm_lat);
+    cmd(c, p, p->ctm_lat);
+    if (rewrite) {
+        cmd(c, p, p->emem_lat);
+        cmd(c, p, p->ctm_lat);
+    }
+    wire(c, p);
+}
+
+/*
+ * pktio_tx_replicate() for a group of p->copies entries that all mirror or
+ * all rewrite, including the original's send.
+ */
+static struct cost
+replicate(const struct parameters *p, unsigned int len, unsigned int ctm,
+          int mode, int share)
+{
+    struct cost c = {0, 0, 0};
+    unsigned int ctm_len = ctm - NBI_OFFSET;
+    unsigned int i;
+
+    if (ctm_len > len)
+        ctm_len = len;
+
+    /* The entries are read to pick the original, and its entry again to
+     * decide whether the mirrors share its buffers */
+    for (i = 0; i <= p->copies; i++)
+        cmd(&c, p, p->emem_lat);
+
+    for (i = 0; i < p->copies - 1; i++) {
+        cmd(&c, p, p->emem_lat);
+        if (share && mode == MODE_MIRROR)
+            continue;
+        copy(&c, p, len, ctm_len, mode == MODE_REWRITE);
+    }
+
+    /* pktio_tx_repl_mirrors():  every entry is read, the original's
+     * twice, and each is sent from the original's buffers */
+    if (share && mode == MODE_MIRROR) {
+        for (i = 0; i <= p->copies; i++)
+            cmd(&c, p, p->emem_lat);
+        for (i = 0; i < p->copies; i++)
+            wire(&c, p);
+        return c;
+    }
+
+    /* The original through pktio_tx() */
+    cmd(&c, p, p->emem_lat);
+    if (mode == MODE_REWRITE) {
+        cmd(&c, p, p->emem_lat);
+        cmd(&c, p, p->ctm_lat);
+    }
+    wire(&c, p);
+    return c;
+}
+
+static void
+usage(void)
+{
+    printf("repl_model [options]\n"
+           "options:\n"
+           " -c <num>  CTM command latency, cycles (default 100)\n"
+           " -e <num>  EMEM/MU command latency, cycles (default 250)\n"
+           " -a <num>  Buffer allocation latency, cycles (default 100)\n"
+           " -i <num>  Instructions around each command (default 10)\n"
+           " -n <num>  Entries per group (default 8)\n"
+           " -f <num>  ME clock in MHz (default 1000)\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        unsigned int len, ctm;
+    } sizes[] = {{64, 256}, {512, 1024}, {1500, 2048}, {1500, 256}};
+    static const char *modes[] = {"mirror", "rewrite"};
+    struct parameters p = {100, 250, 100, 10, 8, 1000};
+    struct cost c[2];
+    unsigned int i, k;
+    int mode, s;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:e:a:i:n:f:")) != -1) {
+        switch (opt) {
+        case 'c':
+            p.ctm_lat = atoi(optarg);
+            break;
+        case 'e':
+            p.emem_lat = atoi(optarg);
+            break;
+        case 'a':
+            p.alloc_lat = atoi(optarg);
+            break;
+        case 'i':
+            p.insn = atoi(optarg);
+            break;
+        case 'n':
+            p.copies = atoi(optarg);
+            break;
+        case 'f':
+            p.mhz = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (p.copies < 1 || p.mhz < 1) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%u entries, CTM %u, EMEM %u, alloc %u cycles, %u MHz, "
+           "one context\n\n", p.copies, p.ctm_lat, p.emem_lat, p.alloc_lat,
+           p.mhz);
+    printf("size  ctm   mode     scheme  cmds/copy  cycles/copy  "
+           "copied B/copy  Kcopies/s\n");
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (mode = MODE_MIRROR; mode <= MODE_REWRITE; mode++) {
+            for (s = 0; s < 2; s++) {
+                c[s] = replicate(&p, sizes[i].len, sizes[i].ctm, mode, s);
+                k = c[s].cycles / p.copies;
+                printf("%4u  %4u  %-7s  %-6s  %9.1f  %11u  %13lu  %9lu\n",
+                       sizes[i].len, sizes[i].ctm, modes[mode],
+                       s ? "share" : "copy", (double)c[s].cmds / p.copies,
+                       k, c[s].bytes / p.copies,
+                       k ? p.mhz * 1000UL / k : 0);
+            }
+        }
+    }
+
+    return 0;
+}
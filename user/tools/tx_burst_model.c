@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2018,  Netronome Systems, Inc.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * @file          user/tools/tx_burst_model.c
+ * @brief         Cost model of pktio_tx_burst() (me/lib/pktio)
+ *
+ * Follows the commands that pktio_tx() and pktio_tx_burst() issue for
+ * wire packets and turns them into ME cycles per packet for one context,
+ * for bursts of 1, 4 and 8 packets:
+ *
+ *  - single:  pktio_tx() for each packet, which waits for the script
+ *             write and its read back before sending.
+ *  - burst:   pktio_tx_burst(), which looks the script up once per chunk
+ *             of up to PKTIO_TX_BURST_PIPE packets, issues the writes of
+ *             the chunk and waits once for all the read backs.
+ *
+ * The packets are those of the unit test: not from the wire, so the NBI
+ * metadata is written too, all at the same offset.  A CTM write or read
+ * completes a latency after its issue.  Latencies are parameters, in ME
+ * cycles.  The figures are a model of the code, not a measurement on
+ * hardware:  the unit test utfe_pktio_tx_burst_bench measures the same
+ * bursts in the simulator.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+
+#define BURST_PIPE      4       /* PKTIO_TX_BURST_PIPE */
+
+struct parameters
+{
+    unsigned int ctm_lat;       /* CTM write or read */
+    unsigned int insn;          /* Instructions around each command */
+    unsigned int lookup;        /* modscript_lookup(), cache hit */
+    unsigned int pkt;           /* Per packet work besides the commands */
+    unsigned int swap;          /* Context swap out and back in */
+    int mac;                    /* MAC_EGRESS_PREPEND_ENABLE */
+    int cntrs;                  /* Counters compiled in */
+    unsigned int mhz;           /* ME clock */
+};
+
+struct cost
+{
+    unsigned long cmds;
+    unsigned long cycles;
+    unsigned long waits;
+};
+
+/* Issue a command at c->cycles, return when it completes */
+static unsigned long
+cmd(struct cost *c, const struct parameters *p, unsigned int lat)
+{
+    c->cmds++;
+    c->cycles += p->insn;
+    return c->cycles + lat;
+}
+
+static void
+wait(struct cost *c, const struct parameters *p, unsigned long done)
+{
+    c->waits++;
+    if (c->cycles < done)
+        c->cycles = done + p->swap;
+}
+
+/* The writes of one packet and the read back of its script */
+static unsigned long
+writes(struct cost *c, const struct parameters *p)
+{
+    unsigned long done;
+
+    cmd(c, p, 0);                       /* NBI metadata, unsignalled */
+    if (p->mac)
+        cmd(c, p, p->ctm_lat);          /* MAC egress command */
+    cmd(c, p, p->ctm_lat);              /* Script write */
+    done = cmd(c, p, p->ctm_lat);       /* Script read back */
+    return done;
+}
+
+/* pktio_tx() in a loop */
+static struct cost
+single(const struct parameters *p, unsigned int num)
+{
+    struct cost c = {0, 0, 0};
+    unsigned long done;
+    unsigned int i;
+
+    for (i = 0; i < num; i++) {
+        c.cycles += p->pkt + p->lookup;
+        done = writes(&c, p);
+        wait(&c, p, done);
+        cmd(&c, p, 0);                  /* pkt_nbi_send() */
+        if (p->cntrs)
+            cmd(&c, p, 0);              /* TX_TO_WIRE */
+    }
+    return c;
+}
+
+/* pktio_tx_burst() */
+static struct cost
+burst(const struct parameters *p, unsigned int num)
+{
+    struct cost c = {0, 0, 0};
+    unsigned long done = 0;
+    unsigned int k, n;
+
+    for (k = 0; k < num; k += n) {
+        c.cycles += p->lookup;
+        for (n = 0; n < BURST_PIPE && k + n < num; n++) {
+            c.cycles += p->pkt;
+            done = writes(&c, p);
+        }
+        wait(&c, p, done);
+        for (n = 0; n < BURST_PIPE && k + n < num; n++)
+            cmd(&c, p, 0);              /* pkt_nbi_send() */
+    }
+    if (p->cntrs)
+        cmd(&c, p, 0);                  /* TX_TO_WIRE, once */
+    return c;
+}
+
+static void
+usage(void)
+{
+    printf("tx_burst_model [options]\n"
+           "options:\n"
+           " -c <num>  CTM command latency, cycles (default 100)\n"
+           " -i <num>  Instructions around each command (default 10)\n"
+           " -l <num>  Script lookup, cycles (default 12)\n"
+           " -p <num>  Other work per packet, cycles (default 20)\n"
+           " -s <num>  Context swap, cycles (default 4)\n"
+           " -m        MAC egress prepend enabled\n"
+           " -n        Counters enabled\n"
+           " -f <num>  ME clock in MHz (default 1000)\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const unsigned int bursts[] = {1, 4, 8};
+    struct parameters p = {100, 10, 12, 20, 4, 0, 0, 1000};
+    struct cost s, b;
+    unsigned long ks, kb;
+    unsigned int i, num;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:i:l:p:s:mnf:")) != -1) {
+        switch (opt) {
+        case 'c':
+            p.ctm_lat = atoi(optarg);
+            break;
+        case 'i':
+            p.insn = atoi(optarg);
+            break;
+        case 'l':
+            p.lookup = atoi(optarg);
+            break;
+        case 'p':
+            p.pkt = atoi(optarg);
+            break;
+        case 's':
+            p.swap = atoi(optarg);
+            break;
+        case 'm':
+            p.mac = 1;
+            break;
+        case 'n':
+            p.cntrs = 1;
+            break;
+        case 'f':
+            p.mhz = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (p.mhz < 1) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    printf("CTM %u, insn %u, lookup %u, packet %u cycles, MAC prepend %s, "
+           "counters %s, %u MHz, one context\n\n", p.ctm_lat, p.insn,
+           p.lookup, p.pkt, p.mac ? "on" : "off", p.cntrs ? "on" : "off",
+           p.mhz);
+    printf("burst  scheme  cmds/pkt  waits/pkt  cycles/pkt  Kpkts/s  "
+           "saving\n");
+
+    for (i = 0; i < sizeof(bursts) / sizeof(bursts[0]); i++) {
+        num = bursts[i];
+        s = single(&p, num);
+        b = burst(&p, num);
+        ks = s.cycles / num;
+        kb = b.cycles / num;
+        printf("%5u  single  %8.2f  %9.2f  %10lu  %7lu\n", num,
+               (double)s.cmds / num, (double)s.waits / num, ks,
+               ks ? p.mhz * 1000UL / ks : 0);
+        printf("%5u  burst   %8.2f  %9.2f  %10lu  %7lu  %5lu%%\n", num,
+               (double)b.cmds / num, (double)b.waits / num, kb,
+               kb ? p.mhz * 1000UL / kb : 0,
+               ks > kb ? (ks - kb) * 100 / ks : 0);
+    }
+
+    return 0;
+}